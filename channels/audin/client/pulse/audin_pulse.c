@@ -437,6 +437,7 @@ static void audin_pulse_open(IAudinDevice* device, AudinReceive receive, void* u
 	if (state == PA_STREAM_READY)
 	{
 		freerdp_dsp_context_reset_adpcm(pulse->dsp_context);
+		freerdp_dsp_context_reset_resampler(pulse->dsp_context);
 		pulse->buffer = malloc(pulse->bytes_per_frame * pulse->frames_per_packet);
 		ZeroMemory(pulse->buffer, pulse->bytes_per_frame * pulse->frames_per_packet);
 		pulse->buffer_frames = 0;
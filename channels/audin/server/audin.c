@@ -193,6 +193,9 @@ static void audin_server_send_open(audin_server* audin, wStream* s)
 
 	audin->opened = TRUE;
 
+	freerdp_dsp_context_reset_adpcm(audin->dsp_context);
+	freerdp_dsp_context_reset_resampler(audin->dsp_context);
+
 	Stream_SetPosition(s, 0);
 	Stream_Write_UINT8(s, MSG_SNDIN_OPEN);
 	Stream_Write_UINT32(s, audin->context.frames_per_packet); /* FramesPerPacket (4 bytes) */
@@ -0,0 +1,535 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * File System Virtual Channel
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifndef _WIN32
+#define __USE_LARGEFILE64
+#define _LARGEFILE_SOURCE
+#define _LARGEFILE64_SOURCE
+#define _ATFILE_SOURCE
+#endif
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <winpr/crt.h>
+#include <winpr/file.h>
+#include <winpr/path.h>
+#include <winpr/sysinfo.h>
+#include <winpr/interlocked.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
+#ifdef HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif
+
+#include "drive_file.h"
+#include "drive_cache.h"
+
+/**
+ * Directory Cache
+ *
+ * Enumerating a directory used to cost a readdir, a pattern match and a
+ * stat per query IRP. A snapshot now collects all matching entries with
+ * their metadata once, and later queries walk it.
+ *
+ * Snapshots are kept per directory and pattern, so that reopening a
+ * directory does not enumerate it again. The drive invalidates them all on
+ * its own changes by bumping the cache generation. Changes made behind its
+ * back are reported by inotify, and only invalidate the snapshots of the
+ * directory they happened in. A directory is watched while it has cached
+ * snapshots. Snapshots of directories that could not be watched expire
+ * after DRIVE_DIR_CACHE_TTL milliseconds.
+ */
+
+#define DRIVE_DIR_CACHE_TTL		2000
+#define DRIVE_DIR_CACHE_SIZE	64
+
+static int drive_dir_entry_compare(const void* a, const void* b)
+{
+	return strcmp(*((const char**) a), *((const char**) b));
+}
+
+static void drive_dir_snapshot_free(DRIVE_DIR_SNAPSHOT* snapshot)
+{
+	UINT32 index;
+
+	for (index = 0; index < snapshot->count; index++)
+		free(snapshot->entries[index].name);
+
+	free(snapshot->entries);
+	free(snapshot);
+}
+
+void drive_dir_snapshot_release(DRIVE_DIR_SNAPSHOT* snapshot)
+{
+	if (!snapshot)
+		return;
+
+	if (InterlockedDecrement(&snapshot->refCount) == 0)
+		drive_dir_snapshot_free(snapshot);
+}
+
+static char** drive_dir_read_names(DIR* dir, const char* pattern, UINT32* count)
+{
+	char** names;
+	char** newNames;
+	UINT32 capacity = 256;
+	struct dirent* ent;
+
+	*count = 0;
+	names = (char**) malloc(sizeof(char*) * capacity);
+
+	if (!names)
+		return NULL;
+
+	rewinddir(dir);
+
+	while ((ent = readdir(dir)) != NULL)
+	{
+		if (pattern && !FilePatternMatchA(ent->d_name, pattern))
+			continue;
+
+		if (*count == capacity)
+		{
+			capacity *= 2;
+			newNames = (char**) realloc(names, sizeof(char*) * capacity);
+
+			if (!newNames)
+				break;
+
+			names = newNames;
+		}
+
+		names[*count] = _strdup(ent->d_name);
+
+		if (names[*count])
+			(*count)++;
+	}
+
+	qsort(names, *count, sizeof(char*), drive_dir_entry_compare);
+
+	return names;
+}
+
+static void drive_dir_entry_init(DRIVE_DIR_ENTRY* entry, DIR* dir, const char* path, const char* name)
+{
+	struct STAT st;
+
+	ZeroMemory(&st, sizeof(struct STAT));
+
+#ifdef _WIN32
+	{
+		char* fullpath = GetCombinedPath(path, name);
+
+		if (fullpath)
+			STAT(fullpath, &st);
+
+		free(fullpath);
+	}
+#else
+	FSTATAT(dirfd(dir), name, &st, 0);
+#endif
+
+	entry->length = ConvertToUnicode(sys_code_page, 0, name, -1, &entry->name, 0) * 2;
+
+	entry->lastAccessTime = FILE_TIME_SYSTEM_TO_RDP(st.st_atime);
+	entry->lastWriteTime = FILE_TIME_SYSTEM_TO_RDP(st.st_mtime);
+	entry->changeTime = FILE_TIME_SYSTEM_TO_RDP(st.st_ctime);
+	entry->size = st.st_size;
+
+	entry->attributes = (S_ISDIR(st.st_mode) ? FILE_ATTRIBUTE_DIRECTORY : 0) |
+		(name[0] == '.' ? FILE_ATTRIBUTE_HIDDEN : 0) |
+		(st.st_mode & S_IWUSR ? 0 : FILE_ATTRIBUTE_READONLY);
+}
+
+static DRIVE_DIR_SNAPSHOT* drive_dir_snapshot_new(DIR* dir, const char* path, const char* pattern)
+{
+	UINT32 index;
+	UINT32 count = 0;
+	char** names;
+	DRIVE_DIR_SNAPSHOT* snapshot;
+
+	snapshot = (DRIVE_DIR_SNAPSHOT*) calloc(1, sizeof(DRIVE_DIR_SNAPSHOT));
+
+	if (!snapshot)
+		return NULL;
+
+	snapshot->refCount = 1;
+
+	names = drive_dir_read_names(dir, pattern, &count);
+
+	if (!names)
+	{
+		free(snapshot);
+		return NULL;
+	}
+
+	if (count)
+	{
+		snapshot->entries = (DRIVE_DIR_ENTRY*) calloc(count, sizeof(DRIVE_DIR_ENTRY));
+
+		if (snapshot->entries)
+		{
+			for (index = 0; index < count; index++)
+				drive_dir_entry_init(&snapshot->entries[index], dir, path, names[index]);
+
+			snapshot->count = count;
+		}
+	}
+
+	for (index = 0; index < count; index++)
+		free(names[index]);
+
+	free(names);
+
+	return snapshot;
+}
+
+static DRIVE_DIR_WATCH* drive_dir_cache_get_watch(DRIVE_DIR_CACHE* cache, int wd)
+{
+	if (wd < 0)
+		return NULL;
+
+	return (DRIVE_DIR_WATCH*) HashTable_GetItemValue(cache->watches, (void*) (size_t) wd);
+}
+
+/**
+ * Watches a directory, or takes another reference on its watch.
+ * Returns the watch descriptor, or -1. Called with the lock held.
+ */
+
+static int drive_dir_cache_watch(DRIVE_DIR_CACHE* cache, const char* path)
+{
+#ifdef HAVE_SYS_INOTIFY_H
+	int wd;
+	DRIVE_DIR_WATCH* watch;
+
+	if (cache->inotify < 0)
+		return -1;
+
+	/* watching a directory twice returns the existing watch */
+
+	wd = inotify_add_watch(cache->inotify, path, IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+			IN_ATTRIB | IN_MODIFY | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR);
+
+	if (wd < 0)
+		return -1;
+
+	watch = drive_dir_cache_get_watch(cache, wd);
+
+	if (!watch)
+	{
+		watch = (DRIVE_DIR_WATCH*) calloc(1, sizeof(DRIVE_DIR_WATCH));
+
+		if (!watch || (HashTable_Add(cache->watches, (void*) (size_t) wd, watch) < 0))
+		{
+			free(watch);
+			inotify_rm_watch(cache->inotify, wd);
+			return -1;
+		}
+
+		watch->wd = wd;
+	}
+
+	watch->refCount++;
+
+	return wd;
+#else
+	return -1;
+#endif
+}
+
+/**
+ * Drops a reference on a watch, removing it with the last one.
+ * Called with the lock held.
+ */
+
+static void drive_dir_cache_unwatch(DRIVE_DIR_CACHE* cache, int wd)
+{
+	DRIVE_DIR_WATCH* watch = drive_dir_cache_get_watch(cache, wd);
+
+	if (!watch || (--watch->refCount > 0))
+		return;
+
+#ifdef HAVE_SYS_INOTIFY_H
+	inotify_rm_watch(cache->inotify, wd);
+#endif
+
+	HashTable_Remove(cache->watches, (void*) (size_t) wd);
+}
+
+/**
+ * Bumps the generation of the watches the pending events are about.
+ * Called with the lock held.
+ */
+
+static void drive_dir_cache_poll(DRIVE_DIR_CACHE* cache)
+{
+#ifdef HAVE_SYS_INOTIFY_H
+	ssize_t length;
+	ssize_t offset;
+	DRIVE_DIR_WATCH* watch;
+	struct inotify_event* event;
+	union
+	{
+		struct inotify_event event;
+		char data[4096];
+	} buffer;
+
+	if (cache->inotify < 0)
+		return;
+
+	while ((length = read(cache->inotify, buffer.data, sizeof(buffer.data))) > 0)
+	{
+		for (offset = 0; offset + (ssize_t) sizeof(struct inotify_event) <= length;
+				offset += sizeof(struct inotify_event) + event->len)
+		{
+			event = (struct inotify_event*) &buffer.data[offset];
+
+			/* events were lost, any directory may have changed */
+
+			if (event->mask & IN_Q_OVERFLOW)
+			{
+				drive_dir_cache_invalidate(cache);
+				continue;
+			}
+
+			watch = drive_dir_cache_get_watch(cache, event->wd);
+
+			if (watch)
+				watch->generation++;
+		}
+	}
+#endif
+}
+
+static BOOL drive_dir_snapshot_is_valid(DRIVE_DIR_CACHE* cache, DRIVE_DIR_SNAPSHOT* snapshot, LONG generation)
+{
+	DRIVE_DIR_WATCH* watch;
+
+	if (snapshot->generation != generation)
+		return FALSE;
+
+	if (snapshot->wd < 0)
+		return ((GetTickCount64() - snapshot->timestamp) < DRIVE_DIR_CACHE_TTL) ? TRUE : FALSE;
+
+	watch = drive_dir_cache_get_watch(cache, snapshot->wd);
+
+	return (watch && (watch->generation == snapshot->watchGeneration)) ? TRUE : FALSE;
+}
+
+/**
+ * Removes all snapshots, dropping the references they hold on their watches.
+ * Called with the lock held.
+ */
+
+static void drive_dir_cache_clear(DRIVE_DIR_CACHE* cache)
+{
+	int index;
+	int count;
+	ULONG_PTR* keys = NULL;
+	DRIVE_DIR_SNAPSHOT* snapshot;
+
+	count = HashTable_GetKeys(cache->snapshots, &keys);
+
+	for (index = 0; index < count; index++)
+	{
+		snapshot = (DRIVE_DIR_SNAPSHOT*) HashTable_GetItemValue(cache->snapshots, (void*) keys[index]);
+
+		if (snapshot)
+			drive_dir_cache_unwatch(cache, snapshot->wd);
+	}
+
+	free(keys);
+
+	HashTable_Clear(cache->snapshots);
+}
+
+/**
+ * Returns a referenced snapshot of the entries of dir matching pattern,
+ * building it when there is no valid one. The caller must hold the lock
+ * of the handle that owns dir.
+ */
+
+DRIVE_DIR_SNAPSHOT* drive_dir_cache_get_snapshot(DRIVE_DIR_CACHE* cache, DIR* dir,
+	const char* path, const char* pattern)
+{
+	int wd;
+	int length;
+	char* key;
+	LONG generation;
+	LONG watchGeneration;
+	DRIVE_DIR_WATCH* watch;
+	DRIVE_DIR_SNAPSHOT* cached;
+	DRIVE_DIR_SNAPSHOT* snapshot;
+
+	length = (int) (strlen(path) + (pattern ? strlen(pattern) : 0) + 2);
+	key = (char*) malloc(length);
+
+	if (!key)
+		return NULL;
+
+	sprintf_s(key, length, "%s\n%s", path, pattern ? pattern : "");
+
+	EnterCriticalSection(&cache->lock);
+
+	/* watch before reading the generations, so no change can slip through */
+
+	wd = drive_dir_cache_watch(cache, path);
+	drive_dir_cache_poll(cache);
+
+	generation = cache->generation;
+	watch = drive_dir_cache_get_watch(cache, wd);
+	watchGeneration = watch ? watch->generation : 0;
+
+	snapshot = (DRIVE_DIR_SNAPSHOT*) HashTable_GetItemValue(cache->snapshots, key);
+
+	if (snapshot && drive_dir_snapshot_is_valid(cache, snapshot, generation))
+	{
+		drive_dir_cache_unwatch(cache, wd);
+		InterlockedIncrement(&snapshot->refCount);
+		LeaveCriticalSection(&cache->lock);
+		free(key);
+		return snapshot;
+	}
+
+	LeaveCriticalSection(&cache->lock);
+
+	snapshot = drive_dir_snapshot_new(dir, path, pattern);
+
+	EnterCriticalSection(&cache->lock);
+
+	if (!snapshot)
+	{
+		drive_dir_cache_unwatch(cache, wd);
+		LeaveCriticalSection(&cache->lock);
+		free(key);
+		return NULL;
+	}
+
+	snapshot->generation = generation;
+	snapshot->timestamp = GetTickCount64();
+	snapshot->wd = wd;
+	snapshot->watchGeneration = watchGeneration;
+
+	/* the reference taken on the watch above goes with the cached snapshot */
+
+	cached = (DRIVE_DIR_SNAPSHOT*) HashTable_GetItemValue(cache->snapshots, key);
+
+	if (cached)
+	{
+		drive_dir_cache_unwatch(cache, cached->wd);
+		HashTable_Remove(cache->snapshots, key);
+	}
+
+	if (HashTable_Count(cache->snapshots) >= DRIVE_DIR_CACHE_SIZE)
+		drive_dir_cache_clear(cache);
+
+	InterlockedIncrement(&snapshot->refCount);
+
+	if (HashTable_Add(cache->snapshots, key, snapshot) < 0)
+	{
+		drive_dir_cache_unwatch(cache, wd);
+		InterlockedDecrement(&snapshot->refCount);
+	}
+
+	LeaveCriticalSection(&cache->lock);
+
+	free(key);
+
+	return snapshot;
+}
+
+void drive_dir_cache_invalidate(DRIVE_DIR_CACHE* cache)
+{
+	InterlockedIncrement(&cache->generation);
+}
+
+DRIVE_DIR_CACHE* drive_dir_cache_new(void)
+{
+	DRIVE_DIR_CACHE* cache;
+
+	cache = (DRIVE_DIR_CACHE*) calloc(1, sizeof(DRIVE_DIR_CACHE));
+
+	if (!cache)
+		return NULL;
+
+	cache->snapshots = HashTable_New(FALSE);
+
+	if (!cache->snapshots)
+	{
+		free(cache);
+		return NULL;
+	}
+
+	cache->snapshots->hash = HashTable_StringHash;
+	cache->snapshots->keyCompare = HashTable_StringCompare;
+	cache->snapshots->keyClone = HashTable_StringClone;
+	cache->snapshots->keyFree = HashTable_StringFree;
+	cache->snapshots->valueFree = (HASH_TABLE_VALUE_FREE_FN) drive_dir_snapshot_release;
+
+	cache->watches = HashTable_New(FALSE);
+
+	if (!cache->watches)
+	{
+		HashTable_Free(cache->snapshots);
+		free(cache);
+		return NULL;
+	}
+
+	cache->watches->valueFree = (HASH_TABLE_VALUE_FREE_FN) free;
+
+	InitializeCriticalSection(&cache->lock);
+
+#ifdef HAVE_SYS_INOTIFY_H
+	cache->inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#else
+	cache->inotify = -1;
+#endif
+
+	return cache;
+}
+
+void drive_dir_cache_free(DRIVE_DIR_CACHE* cache)
+{
+	if (!cache)
+		return;
+
+#ifdef HAVE_SYS_INOTIFY_H
+	if (cache->inotify >= 0)
+		close(cache->inotify);
+#endif
+
+	HashTable_Free(cache->snapshots);
+	HashTable_Free(cache->watches);
+	DeleteCriticalSection(&cache->lock);
+
+	free(cache);
+}
@@ -0,0 +1,99 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * File System Virtual Channel
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FREERDP_CHANNEL_DRIVE_CACHE_H
+#define FREERDP_CHANNEL_DRIVE_CACHE_H
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+#include <winpr/collections.h>
+
+#ifdef _WIN32
+#include "dirent.h"
+#else
+#include <dirent.h>
+#endif
+
+typedef struct _DRIVE_DIR_ENTRY DRIVE_DIR_ENTRY;
+typedef struct _DRIVE_DIR_WATCH DRIVE_DIR_WATCH;
+typedef struct _DRIVE_DIR_SNAPSHOT DRIVE_DIR_SNAPSHOT;
+typedef struct _DRIVE_DIR_CACHE DRIVE_DIR_CACHE;
+
+/**
+ * A directory entry with its metadata already in wire format.
+ */
+
+struct _DRIVE_DIR_ENTRY
+{
+	WCHAR* name;
+	UINT32 length;
+	UINT64 lastAccessTime;
+	UINT64 lastWriteTime;
+	UINT64 changeTime;
+	UINT64 size;
+	UINT32 attributes;
+};
+
+/**
+ * An inotify watch of a directory, shared by the cached snapshots of that
+ * directory. Its generation is bumped by every event in the directory.
+ */
+
+struct _DRIVE_DIR_WATCH
+{
+	int wd;
+	LONG generation;
+	UINT32 refCount;
+};
+
+/**
+ * The entries of a directory that match a pattern, sorted by name.
+ * A snapshot is immutable once built and shared by all handles that
+ * enumerate the same directory with the same pattern.
+ */
+
+struct _DRIVE_DIR_SNAPSHOT
+{
+	LONG volatile refCount;
+	LONG generation;
+	UINT64 timestamp;
+	int wd;
+	LONG watchGeneration;
+
+	UINT32 count;
+	DRIVE_DIR_ENTRY* entries;
+};
+
+struct _DRIVE_DIR_CACHE
+{
+	CRITICAL_SECTION lock;
+	wHashTable* snapshots;
+	wHashTable* watches;
+	LONG volatile generation;
+	int inotify;
+};
+
+DRIVE_DIR_SNAPSHOT* drive_dir_cache_get_snapshot(DRIVE_DIR_CACHE* cache, DIR* dir,
+	const char* path, const char* pattern);
+void drive_dir_snapshot_release(DRIVE_DIR_SNAPSHOT* snapshot);
+
+void drive_dir_cache_invalidate(DRIVE_DIR_CACHE* cache);
+
+DRIVE_DIR_CACHE* drive_dir_cache_new(void);
+void drive_dir_cache_free(DRIVE_DIR_CACHE* cache);
+
+#endif /* FREERDP_CHANNEL_DRIVE_CACHE_H */
@@ -41,6 +41,7 @@
 #include <winpr/crt.h>
 #include <winpr/file.h>
 #include <winpr/stream.h>
+#include <winpr/interlocked.h>
 
 #include <freerdp/channels/rdpdr.h>
 
@@ -302,7 +303,10 @@ DRIVE_FILE* drive_file_new(const char* base_path, const char* path, UINT32 id,
 	file = (DRIVE_FILE*) malloc(sizeof(DRIVE_FILE));
 	ZeroMemory(file, sizeof(DRIVE_FILE));
 
+	InitializeCriticalSection(&file->lock);
+
 	file->id = id;
+	file->refCount = 1;
 	file->basepath = (char*) base_path;
 	drive_file_set_fullpath(file, drive_file_combine_fullpath(base_path, path));
 	file->fd = -1;
@@ -351,30 +355,71 @@ void drive_file_free(DRIVE_FILE* file)
 			unlink(file->fullpath);
 	}
 
-	free(file->pattern);
+	drive_dir_snapshot_release(file->snapshot);
 	free(file->fullpath);
+
+	DeleteCriticalSection(&file->lock);
+
 	free(file);
 }
 
-BOOL drive_file_seek(DRIVE_FILE* file, UINT64 Offset)
+void drive_file_add_ref(DRIVE_FILE* file)
 {
-	if (file->is_dir || file->fd == -1)
-		return FALSE;
+	InterlockedIncrement(&file->refCount);
+}
 
-	if (LSEEK(file->fd, Offset, SEEK_SET) == (off_t)-1)
-		return FALSE;
+void drive_file_release(DRIVE_FILE* file)
+{
+	if (InterlockedDecrement(&file->refCount) == 0)
+		drive_file_free(file);
+}
 
-	return TRUE;
+#ifdef _WIN32
+static ssize_t drive_file_pread(int fd, void* buffer, UINT32 length, UINT64 offset)
+{
+	DWORD count = 0;
+	OVERLAPPED overlapped;
+	HANDLE handle = (HANDLE) _get_osfhandle(fd);
+
+	ZeroMemory(&overlapped, sizeof(OVERLAPPED));
+	overlapped.Offset = (DWORD) (offset & 0xFFFFFFFF);
+	overlapped.OffsetHigh = (DWORD) (offset >> 32);
+
+	if (!ReadFile(handle, buffer, length, &count, &overlapped))
+		return (GetLastError() == ERROR_HANDLE_EOF) ? 0 : -1;
+
+	return (ssize_t) count;
 }
 
-BOOL drive_file_read(DRIVE_FILE* file, BYTE* buffer, UINT32* Length)
+static ssize_t drive_file_pwrite(int fd, const void* buffer, UINT32 length, UINT64 offset)
+{
+	DWORD count = 0;
+	OVERLAPPED overlapped;
+	HANDLE handle = (HANDLE) _get_osfhandle(fd);
+
+	ZeroMemory(&overlapped, sizeof(OVERLAPPED));
+	overlapped.Offset = (DWORD) (offset & 0xFFFFFFFF);
+	overlapped.OffsetHigh = (DWORD) (offset >> 32);
+
+	if (!WriteFile(handle, buffer, length, &count, &overlapped))
+		return -1;
+
+	return (ssize_t) count;
+}
+#endif
+
+BOOL drive_file_read(DRIVE_FILE* file, UINT64 Offset, BYTE* buffer, UINT32* Length)
 {
 	ssize_t r;
 
 	if (file->is_dir || file->fd == -1)
 		return FALSE;
 
-	r = read(file->fd, buffer, *Length);
+	do
+	{
+		r = PREAD(file->fd, buffer, *Length, Offset);
+	}
+	while ((r < 0) && (errno == EINTR));
 
 	if (r < 0)
 		return FALSE;
@@ -384,7 +429,7 @@ BOOL drive_file_read(DRIVE_FILE* file, BYTE* buffer, UINT32* Length)
 	return TRUE;
 }
 
-BOOL drive_file_write(DRIVE_FILE* file, BYTE* buffer, UINT32 Length)
+BOOL drive_file_write(DRIVE_FILE* file, UINT64 Offset, BYTE* buffer, UINT32 Length)
 {
 	ssize_t r;
 
@@ -393,13 +438,19 @@ BOOL drive_file_write(DRIVE_FILE* file, BYTE* buffer, UINT32 Length)
 
 	while (Length > 0)
 	{
-		r = write(file->fd, buffer, Length);
+		r = PWRITE(file->fd, buffer, Length, Offset);
 
 		if (r == -1)
+		{
+			if (errno == EINTR)
+				continue;
+
 			return FALSE;
+		}
 
 		Length -= r;
 		buffer += r;
+		Offset += r;
 	}
 
 	return TRUE;
@@ -606,14 +657,14 @@ BOOL drive_file_set_information(DRIVE_FILE* file, UINT32 FsInformationClass, UIN
 	return TRUE;
 }
 
-BOOL drive_file_query_directory(DRIVE_FILE* file, UINT32 FsInformationClass, BYTE InitialQuery,
-	const char* path, wStream* output)
+BOOL drive_file_query_directory(DRIVE_FILE* file, DRIVE_DIR_CACHE* cache, UINT32 FsInformationClass,
+	BYTE InitialQuery, const char* path, wStream* output)
 {
 	int length;
 	BOOL ret;
+	char* pattern;
 	WCHAR* ent_path;
-	struct STAT st;
-	struct dirent* ent;
+	DRIVE_DIR_ENTRY* entry;
 
 	if (!file->dir)
 	{
@@ -622,57 +673,30 @@ BOOL drive_file_query_directory(DRIVE_FILE* file, UINT32 FsInformationClass, BYT
 		return FALSE;
 	}
 
-	if (InitialQuery != 0)
+	if ((InitialQuery != 0) || !file->snapshot)
 	{
-		rewinddir(file->dir);
-		free(file->pattern);
+		drive_dir_snapshot_release(file->snapshot);
 
-		if (path[0])
-			file->pattern = _strdup(strrchr(path, '\\') + 1);
-		else
-			file->pattern = NULL;
-	}
+		pattern = path[0] ? strrchr(path, '\\') : NULL;
 
-	if (file->pattern)
-	{
-		do
-		{
-			ent = readdir(file->dir);
+		if (pattern)
+			pattern++;
 
-			if (ent == NULL)
-				continue;
-
-			if (FilePatternMatchA(ent->d_name, file->pattern))
-				break;
-
-		}
-		while (ent);
-	}
-	else
-	{
-		ent = readdir(file->dir);
+		file->snapshot = drive_dir_cache_get_snapshot(cache, file->dir, file->fullpath, pattern);
+		file->snapshot_index = 0;
 	}
 
-	if (!ent)
+	if (!file->snapshot || (file->snapshot_index >= file->snapshot->count))
 	{
 		Stream_Write_UINT32(output, 0); /* Length */
 		Stream_Write_UINT8(output, 0); /* Padding */
 		return FALSE;
 	}
 
-	memset(&st, 0, sizeof(struct STAT));
-	ent_path = (WCHAR*) malloc(strlen(file->fullpath) + strlen(ent->d_name) + 2);
-	sprintf((char*) ent_path, "%s/%s", file->fullpath, ent->d_name);
+	entry = &file->snapshot->entries[file->snapshot_index++];
 
-	if (STAT((char*) ent_path, &st) != 0)
-	{
-
-	}
-
-	free(ent_path);
-	ent_path = NULL;
-
-	length = ConvertToUnicode(sys_code_page, 0, ent->d_name, -1, &ent_path, 0) * 2;
+	ent_path = entry->name;
+	length = (int) entry->length;
 
 	ret = TRUE;
 
@@ -684,13 +708,13 @@ BOOL drive_file_query_directory(DRIVE_FILE* file, UINT32 FsInformationClass, BYT
 			Stream_EnsureRemainingCapacity(output, 64 + length);
 			Stream_Write_UINT32(output, 0); /* NextEntryOffset */
 			Stream_Write_UINT32(output, 0); /* FileIndex */
-			Stream_Write_UINT64(output, FILE_TIME_SYSTEM_TO_RDP(st.st_mtime)); /* CreationTime */
-			Stream_Write_UINT64(output, FILE_TIME_SYSTEM_TO_RDP(st.st_atime)); /* LastAccessTime */
-			Stream_Write_UINT64(output, FILE_TIME_SYSTEM_TO_RDP(st.st_mtime)); /* LastWriteTime */
-			Stream_Write_UINT64(output, FILE_TIME_SYSTEM_TO_RDP(st.st_ctime)); /* ChangeTime */
-			Stream_Write_UINT64(output, st.st_size); /* EndOfFile */
-			Stream_Write_UINT64(output, st.st_size); /* AllocationSize */
-			Stream_Write_UINT32(output, FILE_ATTR_SYSTEM_TO_RDP(file, st)); /* FileAttributes */
+			Stream_Write_UINT64(output, entry->lastWriteTime); /* CreationTime */
+			Stream_Write_UINT64(output, entry->lastAccessTime); /* LastAccessTime */
+			Stream_Write_UINT64(output, entry->lastWriteTime); /* LastWriteTime */
+			Stream_Write_UINT64(output, entry->changeTime); /* ChangeTime */
+			Stream_Write_UINT64(output, entry->size); /* EndOfFile */
+			Stream_Write_UINT64(output, entry->size); /* AllocationSize */
+			Stream_Write_UINT32(output, entry->attributes); /* FileAttributes */
 			Stream_Write_UINT32(output, length); /* FileNameLength */
 			Stream_Write(output, ent_path, length);
 			break;
@@ -701,13 +725,13 @@ BOOL drive_file_query_directory(DRIVE_FILE* file, UINT32 FsInformationClass, BYT
 			Stream_EnsureRemainingCapacity(output, 68 + length);
 			Stream_Write_UINT32(output, 0); /* NextEntryOffset */
 			Stream_Write_UINT32(output, 0); /* FileIndex */
-			Stream_Write_UINT64(output, FILE_TIME_SYSTEM_TO_RDP(st.st_mtime)); /* CreationTime */
-			Stream_Write_UINT64(output, FILE_TIME_SYSTEM_TO_RDP(st.st_atime)); /* LastAccessTime */
-			Stream_Write_UINT64(output, FILE_TIME_SYSTEM_TO_RDP(st.st_mtime)); /* LastWriteTime */
-			Stream_Write_UINT64(output, FILE_TIME_SYSTEM_TO_RDP(st.st_ctime)); /* ChangeTime */
-			Stream_Write_UINT64(output, st.st_size); /* EndOfFile */
-			Stream_Write_UINT64(output, st.st_size); /* AllocationSize */
-			Stream_Write_UINT32(output, FILE_ATTR_SYSTEM_TO_RDP(file, st)); /* FileAttributes */
+			Stream_Write_UINT64(output, entry->lastWriteTime); /* CreationTime */
+			Stream_Write_UINT64(output, entry->lastAccessTime); /* LastAccessTime */
+			Stream_Write_UINT64(output, entry->lastWriteTime); /* LastWriteTime */
+			Stream_Write_UINT64(output, entry->changeTime); /* ChangeTime */
+			Stream_Write_UINT64(output, entry->size); /* EndOfFile */
+			Stream_Write_UINT64(output, entry->size); /* AllocationSize */
+			Stream_Write_UINT32(output, entry->attributes); /* FileAttributes */
 			Stream_Write_UINT32(output, length); /* FileNameLength */
 			Stream_Write_UINT32(output, 0); /* EaSize */
 			Stream_Write(output, ent_path, length);
@@ -719,13 +743,13 @@ BOOL drive_file_query_directory(DRIVE_FILE* file, UINT32 FsInformationClass, BYT
 			Stream_EnsureRemainingCapacity(output, 93 + length);
 			Stream_Write_UINT32(output, 0); /* NextEntryOffset */
 			Stream_Write_UINT32(output, 0); /* FileIndex */
-			Stream_Write_UINT64(output, FILE_TIME_SYSTEM_TO_RDP(st.st_mtime)); /* CreationTime */
-			Stream_Write_UINT64(output, FILE_TIME_SYSTEM_TO_RDP(st.st_atime)); /* LastAccessTime */
-			Stream_Write_UINT64(output, FILE_TIME_SYSTEM_TO_RDP(st.st_mtime)); /* LastWriteTime */
-			Stream_Write_UINT64(output, FILE_TIME_SYSTEM_TO_RDP(st.st_ctime)); /* ChangeTime */
-			Stream_Write_UINT64(output, st.st_size); /* EndOfFile */
-			Stream_Write_UINT64(output, st.st_size); /* AllocationSize */
-			Stream_Write_UINT32(output, FILE_ATTR_SYSTEM_TO_RDP(file, st)); /* FileAttributes */
+			Stream_Write_UINT64(output, entry->lastWriteTime); /* CreationTime */
+			Stream_Write_UINT64(output, entry->lastAccessTime); /* LastAccessTime */
+			Stream_Write_UINT64(output, entry->lastWriteTime); /* LastWriteTime */
+			Stream_Write_UINT64(output, entry->changeTime); /* ChangeTime */
+			Stream_Write_UINT64(output, entry->size); /* EndOfFile */
+			Stream_Write_UINT64(output, entry->size); /* AllocationSize */
+			Stream_Write_UINT32(output, entry->attributes); /* FileAttributes */
 			Stream_Write_UINT32(output, length); /* FileNameLength */
 			Stream_Write_UINT32(output, 0); /* EaSize */
 			Stream_Write_UINT8(output, 0); /* ShortNameLength */
@@ -751,8 +775,6 @@ BOOL drive_file_query_directory(DRIVE_FILE* file, UINT32 FsInformationClass, BYT
 			break;
 	}
 
-	free(ent_path);
-
 	return ret;
 }
 
@@ -25,6 +25,8 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 
+#include <winpr/synch.h>
+
 #ifdef _WIN32
 #include <direct.h>
 #include <io.h>
@@ -46,6 +48,8 @@
 #define read  _read
 #define write _write
 #define LSEEK _lseeki64
+#define PREAD drive_file_pread
+#define PWRITE drive_file_pwrite
 #define FSTAT _fstat64
 #define STATVFS statvfs
 #define mkdir(a,b) _mkdir(a)
@@ -60,23 +64,34 @@ typedef UINT32 mode_t;
 #define STAT stat
 #define OPEN open
 #define LSEEK lseek
+#define PREAD pread
+#define PWRITE pwrite
 #define FSTAT fstat
+#define FSTATAT fstatat
 #define STATVFS statvfs
 #define O_LARGEFILE 0
 #elif defined(ANDROID)
 #define STAT stat
 #define OPEN open
 #define LSEEK lseek
+#define PREAD pread
+#define PWRITE pwrite
 #define FSTAT fstat
+#define FSTATAT fstatat
 #define STATVFS statfs
 #else
 #define STAT stat64
 #define OPEN open64
 #define LSEEK lseek64
+#define PREAD pread64
+#define PWRITE pwrite64
 #define FSTAT fstat64
+#define FSTATAT fstatat64
 #define STATVFS statvfs64
 #endif
 
+#include "drive_cache.h"
+
 #define EPOCH_DIFF 11644473600LL
 
 #define FILE_TIME_SYSTEM_TO_RDP(_t) \
@@ -92,9 +107,18 @@ typedef UINT32 mode_t;
 
 typedef struct _DRIVE_FILE DRIVE_FILE;
 
+/**
+ * A file is shared by the IRP workers: reads and writes go through
+ * pread/pwrite and need no locking, everything that touches the path
+ * or the directory stream holds the file lock. The file is freed when
+ * the last reference is released.
+ */
+
 struct _DRIVE_FILE
 {
 	UINT32 id;
+	LONG volatile refCount;
+	CRITICAL_SECTION lock;
 	BOOL is_dir;
 	int fd;
 	int err;
@@ -102,7 +126,8 @@ struct _DRIVE_FILE
 	char* basepath;
 	char* fullpath;
 	char* filename;
-	char* pattern;
+	DRIVE_DIR_SNAPSHOT* snapshot;
+	UINT32 snapshot_index;
 	BOOL delete_pending;
 };
 
@@ -110,13 +135,15 @@ DRIVE_FILE* drive_file_new(const char* base_path, const char* path, UINT32 id,
 	UINT32 DesiredAccess, UINT32 CreateDisposition, UINT32 CreateOptions);
 void drive_file_free(DRIVE_FILE* file);
 
-BOOL drive_file_seek(DRIVE_FILE* file, UINT64 Offset);
-BOOL drive_file_read(DRIVE_FILE* file, BYTE* buffer, UINT32* Length);
-BOOL drive_file_write(DRIVE_FILE* file, BYTE* buffer, UINT32 Length);
+void drive_file_add_ref(DRIVE_FILE* file);
+void drive_file_release(DRIVE_FILE* file);
+
+BOOL drive_file_read(DRIVE_FILE* file, UINT64 Offset, BYTE* buffer, UINT32* Length);
+BOOL drive_file_write(DRIVE_FILE* file, UINT64 Offset, BYTE* buffer, UINT32 Length);
 BOOL drive_file_query_information(DRIVE_FILE* file, UINT32 FsInformationClass, wStream* output);
 BOOL drive_file_set_information(DRIVE_FILE* file, UINT32 FsInformationClass, UINT32 Length, wStream* input);
-BOOL drive_file_query_directory(DRIVE_FILE* file, UINT32 FsInformationClass, BYTE InitialQuery,
-	const char* path, wStream* output);
+BOOL drive_file_query_directory(DRIVE_FILE* file, DRIVE_DIR_CACHE* cache, UINT32 FsInformationClass,
+	BYTE InitialQuery, const char* path, wStream* output);
 int dir_empty(const char *path);
 
 extern UINT sys_code_page;
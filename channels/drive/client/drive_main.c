@@ -46,16 +46,27 @@
 
 #include "drive_file.h"
 
+#define DRIVE_WORKER_COUNT	4
+
 typedef struct _DRIVE_DEVICE DRIVE_DEVICE;
 
+/**
+ * IRPs are picked up from IrpQueue by a pool of workers and processed
+ * concurrently. The file table maps file ids to referenced DRIVE_FILEs
+ * and is protected by the device lock.
+ */
+
 struct _DRIVE_DEVICE
 {
 	DEVICE device;
 
 	char* path;
-	wListDictionary* files;
+	wHashTable* files;
+	CRITICAL_SECTION lock;
+	DRIVE_DIR_CACHE* cache;
 
-	HANDLE thread;
+	int workerCount;
+	HANDLE workers[DRIVE_WORKER_COUNT];
 	wMessageQueue* IrpQueue;
 
 	DEVMAN* devman;
@@ -94,12 +105,23 @@ static UINT32 drive_map_posix_err(int fs_errno)
 	return rc;
 }
 
+/**
+ * Returns a new reference to the file, to be dropped with drive_file_release.
+ */
+
 static DRIVE_FILE* drive_get_file_by_id(DRIVE_DEVICE* drive, UINT32 id)
 {
 	DRIVE_FILE* file = NULL;
 	void* key = (void*) (size_t) id;
 
-	file = (DRIVE_FILE*) ListDictionary_GetItemValue(drive->files, key);
+	EnterCriticalSection(&drive->lock);
+
+	file = (DRIVE_FILE*) HashTable_GetItemValue(drive->files, key);
+
+	if (file)
+		drive_file_add_ref(file);
+
+	LeaveCriticalSection(&drive->lock);
 
 	return file;
 }
@@ -129,7 +151,7 @@ static void drive_process_irp_create(DRIVE_DEVICE* drive, IRP* irp)
 	if (status < 1)
 		path = (char*) calloc(1, 1);
 
-	FileId = irp->devman->id_sequence++;
+	FileId = (UINT32) InterlockedIncrement((LONG volatile*) &irp->devman->id_sequence) - 1;
 
 	file = drive_file_new(drive->path, path, FileId,
 		DesiredAccess, CreateDisposition, CreateOptions);
@@ -152,25 +174,41 @@ static void drive_process_irp_create(DRIVE_DEVICE* drive, IRP* irp)
 	else
 	{
 		key = (void*) (size_t) file->id;
-		ListDictionary_Add(drive->files, key, file);
 
-		switch (CreateDisposition)
+		if (CreateDisposition != FILE_OPEN)
+			drive_dir_cache_invalidate(drive->cache);
+
+		EnterCriticalSection(&drive->lock);
+		status = HashTable_Add(drive->files, key, file);
+		LeaveCriticalSection(&drive->lock);
+
+		if (status < 0)
 		{
-			case FILE_SUPERSEDE:
-			case FILE_OPEN:
-			case FILE_CREATE:
-			case FILE_OVERWRITE:
-				Information = FILE_SUPERSEDED;
-				break;
-			case FILE_OPEN_IF:
-				Information = FILE_OPENED;
-				break;
-			case FILE_OVERWRITE_IF:
-				Information = FILE_OVERWRITTEN;
-				break;
-			default:
-				Information = 0;
-				break;
+			irp->IoStatus = STATUS_NO_MEMORY;
+			FileId = 0;
+			Information = 0;
+			drive_file_free(file);
+		}
+		else
+		{
+			switch (CreateDisposition)
+			{
+				case FILE_SUPERSEDE:
+				case FILE_OPEN:
+				case FILE_CREATE:
+				case FILE_OVERWRITE:
+					Information = FILE_SUPERSEDED;
+					break;
+				case FILE_OPEN_IF:
+					Information = FILE_OPENED;
+					break;
+				case FILE_OVERWRITE_IF:
+					Information = FILE_OVERWRITTEN;
+					break;
+				default:
+					Information = 0;
+					break;
+			}
 		}
 	}
 
@@ -184,23 +222,33 @@ static void drive_process_irp_create(DRIVE_DEVICE* drive, IRP* irp)
 
 static void drive_process_irp_close(DRIVE_DEVICE* drive, IRP* irp)
 {
+	BOOL found;
 	void* key;
 	DRIVE_FILE* file;
 
-	file = drive_get_file_by_id(drive, irp->FileId);
-
 	key = (void*) (size_t) irp->FileId;
 
-	if (!file)
-	{
-		irp->IoStatus = STATUS_UNSUCCESSFUL;
-	}
-	else
+	/* a file pending deletion goes away with its last reference */
+
+	file = drive_get_file_by_id(drive, irp->FileId);
+
+	if (file)
 	{
-		ListDictionary_Remove(drive->files, key);
-		drive_file_free(file);
+		if (file->delete_pending)
+			drive_dir_cache_invalidate(drive->cache);
+
+		drive_file_release(file);
 	}
 
+	/* workers still using the file keep it alive until they are done */
+
+	EnterCriticalSection(&drive->lock);
+	found = HashTable_Remove(drive->files, key);
+	LeaveCriticalSection(&drive->lock);
+
+	if (!found)
+		irp->IoStatus = STATUS_UNSUCCESSFUL;
+
 	Stream_Zero(irp->output, 5); /* Padding(5) */
 
 	irp->Complete(irp);
@@ -211,49 +259,38 @@ static void drive_process_irp_read(DRIVE_DEVICE* drive, IRP* irp)
 	DRIVE_FILE* file;
 	UINT32 Length;
 	UINT64 Offset;
-	BYTE* buffer = NULL;
+	size_t position;
 
 	Stream_Read_UINT32(irp->input, Length);
 	Stream_Read_UINT64(irp->input, Offset);
 
 	file = drive_get_file_by_id(drive, irp->FileId);
 
+	/* the data is read straight into the response, after its length field */
+
+	position = Stream_GetPosition(irp->output);
+
 	if (!file)
 	{
 		irp->IoStatus = STATUS_UNSUCCESSFUL;
 		Length = 0;
 	}
-	else if (!drive_file_seek(file, Offset))
-	{
-		irp->IoStatus = STATUS_UNSUCCESSFUL;
-		Length = 0;
-	}
 	else
 	{
-		buffer = (BYTE*) malloc(Length);
+		Stream_EnsureRemainingCapacity(irp->output, 4 + (size_t) Length);
 
-		if (!drive_file_read(file, buffer, &Length))
+		if (!drive_file_read(file, Offset, Stream_Pointer(irp->output) + 4, &Length))
 		{
 			irp->IoStatus = STATUS_UNSUCCESSFUL;
-			free(buffer);
-			buffer = NULL;
 			Length = 0;
 		}
-		else
-		{
 
-		}
+		drive_file_release(file);
 	}
 
+	Stream_SetPosition(irp->output, position);
 	Stream_Write_UINT32(irp->output, Length);
-
-	if (Length > 0)
-	{
-		Stream_EnsureRemainingCapacity(irp->output, (int) Length);
-		Stream_Write(irp->output, buffer, Length);
-	}
-
-	free(buffer);
+	Stream_Seek(irp->output, Length);
 
 	irp->Complete(irp);
 }
@@ -275,19 +312,17 @@ static void drive_process_irp_write(DRIVE_DEVICE* drive, IRP* irp)
 		irp->IoStatus = STATUS_UNSUCCESSFUL;
 		Length = 0;
 	}
-	else if (!drive_file_seek(file, Offset))
-	{
-		irp->IoStatus = STATUS_UNSUCCESSFUL;
-		Length = 0;
-	}
-	else if (!drive_file_write(file, Stream_Pointer(irp->input), Length))
-	{
-		irp->IoStatus = STATUS_UNSUCCESSFUL;
-		Length = 0;
-	}
 	else
 	{
+		if (!drive_file_write(file, Offset, Stream_Pointer(irp->input), Length))
+		{
+			irp->IoStatus = STATUS_UNSUCCESSFUL;
+			Length = 0;
+		}
+
+		drive_dir_cache_invalidate(drive->cache);
 
+		drive_file_release(file);
 	}
 
 	Stream_Write_UINT32(irp->output, Length);
@@ -309,13 +344,16 @@ static void drive_process_irp_query_information(DRIVE_DEVICE* drive, IRP* irp)
 	{
 		irp->IoStatus = STATUS_UNSUCCESSFUL;
 	}
-	else if (!drive_file_query_information(file, FsInformationClass, irp->output))
-	{
-		irp->IoStatus = STATUS_UNSUCCESSFUL;
-	}
 	else
 	{
+		EnterCriticalSection(&file->lock);
 
+		if (!drive_file_query_information(file, FsInformationClass, irp->output))
+			irp->IoStatus = STATUS_UNSUCCESSFUL;
+
+		LeaveCriticalSection(&file->lock);
+
+		drive_file_release(file);
 	}
 
 	irp->Complete(irp);
@@ -337,17 +375,22 @@ static void drive_process_irp_set_information(DRIVE_DEVICE* drive, IRP* irp)
 	{
 		irp->IoStatus = STATUS_UNSUCCESSFUL;
 	}
-	else if (!drive_file_set_information(file, FsInformationClass, Length, irp->input))
-	{
-		irp->IoStatus = STATUS_UNSUCCESSFUL;
-	}
 	else
 	{
+		EnterCriticalSection(&file->lock);
 
-	}
+		if (!drive_file_set_information(file, FsInformationClass, Length, irp->input))
+			irp->IoStatus = STATUS_UNSUCCESSFUL;
+
+		drive_dir_cache_invalidate(drive->cache);
 
-	if (file && file->is_dir && !dir_empty(file->fullpath))
-		irp->IoStatus = STATUS_DIRECTORY_NOT_EMPTY;
+		if (file->is_dir && !dir_empty(file->fullpath))
+			irp->IoStatus = STATUS_DIRECTORY_NOT_EMPTY;
+
+		LeaveCriticalSection(&file->lock);
+
+		drive_file_release(file);
+	}
 
 	Stream_Write_UINT32(irp->output, Length);
 
@@ -488,9 +531,16 @@ static void drive_process_irp_query_directory(DRIVE_DEVICE* drive, IRP* irp)
 		irp->IoStatus = STATUS_UNSUCCESSFUL;
 		Stream_Write_UINT32(irp->output, 0); /* Length */
 	}
-	else if (!drive_file_query_directory(file, FsInformationClass, InitialQuery, path, irp->output))
+	else
 	{
-		irp->IoStatus = STATUS_NO_MORE_FILES;
+		EnterCriticalSection(&file->lock);
+
+		if (!drive_file_query_directory(file, drive->cache, FsInformationClass, InitialQuery, path, irp->output))
+			irp->IoStatus = STATUS_NO_MORE_FILES;
+
+		LeaveCriticalSection(&file->lock);
+
+		drive_file_release(file);
 	}
 
 	free(path);
@@ -588,8 +638,10 @@ static void* drive_thread_func(void* arg)
 		if (!MessageQueue_Wait(drive->IrpQueue))
 			break;
 
+		/* another worker may have taken the message */
+
 		if (!MessageQueue_Peek(drive->IrpQueue, &message, TRUE))
-			break;
+			continue;
 
 		if (message.id == WMQ_QUIT)
 			break;
@@ -612,14 +664,25 @@ static void drive_irp_request(DEVICE* device, IRP* irp)
 
 static void drive_free(DEVICE* device)
 {
+	int index;
 	DRIVE_DEVICE* drive = (DRIVE_DEVICE*) device;
 
-	MessageQueue_PostQuit(drive->IrpQueue, 0);
-	WaitForSingleObject(drive->thread, INFINITE);
+	/* each worker leaves on its own quit message */
 
-	CloseHandle(drive->thread);
+	for (index = 0; index < drive->workerCount; index++)
+		MessageQueue_PostQuit(drive->IrpQueue, 0);
+
+	for (index = 0; index < drive->workerCount; index++)
+	{
+		WaitForSingleObject(drive->workers[index], INFINITE);
+		CloseHandle(drive->workers[index]);
+	}
+
+	HashTable_Free(drive->files);
+	DeleteCriticalSection(&drive->lock);
+
+	drive_dir_cache_free(drive->cache);
 
-	ListDictionary_Free(drive->files);
 	MessageQueue_Free(drive->IrpQueue);
 
 	Stream_Free(drive->device.data, TRUE);
@@ -630,6 +693,7 @@ static void drive_free(DEVICE* device)
 void drive_register_drive_path(PDEVICE_SERVICE_ENTRY_POINTS pEntryPoints, char* name, char* path)
 {
 	int i, length;
+	int index;
 	DRIVE_DEVICE* drive;
 
 #ifdef WIN32
@@ -664,15 +728,29 @@ void drive_register_drive_path(PDEVICE_SERVICE_ENTRY_POINTS pEntryPoints, char*
 
 		drive->path = path;
 
-		drive->files = ListDictionary_New(TRUE);
-		ListDictionary_ValueObject(drive->files)->fnObjectFree = (OBJECT_FREE_FN) drive_file_free;
+		drive->files = HashTable_New(FALSE);
+		drive->files->valueFree = (HASH_TABLE_VALUE_FREE_FN) drive_file_release;
+		InitializeCriticalSection(&drive->lock);
+
+		drive->cache = drive_dir_cache_new();
 
 		drive->IrpQueue = MessageQueue_New(NULL);
-		drive->thread = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE) drive_thread_func, drive, CREATE_SUSPENDED, NULL);
+
+		for (index = 0; index < DRIVE_WORKER_COUNT; index++)
+		{
+			drive->workers[index] = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE) drive_thread_func,
+					drive, CREATE_SUSPENDED, NULL);
+
+			if (!drive->workers[index])
+				break;
+
+			drive->workerCount++;
+		}
 
 		pEntryPoints->RegisterDevice(pEntryPoints->devman, (DEVICE*) drive);
 
-		ResumeThread(drive->thread);
+		for (index = 0; index < drive->workerCount; index++)
+			ResumeThread(drive->workers[index]);
 	}
 }
 
@@ -0,0 +1,555 @@
+
+#include <stdio.h>
+
+#include <winpr/crt.h>
+#include <winpr/file.h>
+#include <winpr/path.h>
+#include <winpr/synch.h>
+#include <winpr/sysinfo.h>
+#include <winpr/interlocked.h>
+
+#include <freerdp/channels/rdpdr.h>
+
+#define TEST_BLOCK_SIZE		65536
+#define TEST_BLOCK_COUNT	128
+#define TEST_READ_PASSES	8
+#define TEST_QUERY_COUNT	20000
+#define TEST_DIR_ENTRIES	50000
+
+int drive_DeviceServiceEntry(PDEVICE_SERVICE_ENTRY_POINTS pEntryPoints);
+
+static DEVICE* g_Device = NULL;
+static HANDLE g_DoneEvent = NULL;
+static LONG volatile g_Pending = 0;
+static LONG volatile g_Failures = 0;
+
+static BOOL g_Capture = TRUE;
+static UINT32 g_Status = 0;
+static UINT32 g_Value = 0;
+static BYTE g_Data[TEST_BLOCK_SIZE];
+
+static void test_register_device(DEVMAN* devman, DEVICE* device)
+{
+	g_Device = device;
+}
+
+static void test_irp_free(IRP* irp)
+{
+	Stream_Free(irp->input, TRUE);
+	Stream_Free(irp->output, TRUE);
+	free(irp);
+}
+
+/**
+ * Stands in for the rdpdr completion: checks the status, captures the
+ * first field of the response and wakes up the submitter with the last one.
+ */
+
+static void test_irp_complete(IRP* irp)
+{
+	UINT32 value = 0;
+
+	if (Stream_GetPosition(irp->output) >= RDPDR_DEVICE_IO_RESPONSE_LENGTH + 4)
+	{
+		Stream_SetPosition(irp->output, RDPDR_DEVICE_IO_RESPONSE_LENGTH);
+		Stream_Read_UINT32(irp->output, value);
+	}
+
+	if ((irp->IoStatus != STATUS_SUCCESS) && (irp->IoStatus != STATUS_NO_MORE_FILES))
+		InterlockedIncrement(&g_Failures);
+
+	if (g_Capture)
+	{
+		g_Status = irp->IoStatus;
+		g_Value = value;
+
+		if ((irp->MajorFunction == IRP_MJ_READ) && (value <= sizeof(g_Data)))
+			CopyMemory(g_Data, Stream_Pointer(irp->output), value);
+	}
+
+	test_irp_free(irp);
+
+	if (InterlockedDecrement(&g_Pending) == 0)
+		SetEvent(g_DoneEvent);
+}
+
+static IRP* test_irp_new(UINT32 MajorFunction, UINT32 MinorFunction, UINT32 FileId, size_t size)
+{
+	IRP* irp;
+
+	irp = (IRP*) calloc(1, sizeof(IRP));
+
+	if (!irp)
+		return NULL;
+
+	irp->device = g_Device;
+	irp->FileId = FileId;
+	irp->MajorFunction = MajorFunction;
+	irp->MinorFunction = MinorFunction;
+	irp->input = Stream_New(NULL, size + 64);
+	irp->output = Stream_New(NULL, 256);
+
+	Stream_Zero(irp->output, RDPDR_DEVICE_IO_RESPONSE_LENGTH);
+
+	irp->Complete = test_irp_complete;
+	irp->Discard = test_irp_free;
+
+	return irp;
+}
+
+static void test_irp_submit(IRP* irp)
+{
+	Stream_SealLength(irp->input);
+	Stream_SetPosition(irp->input, 0);
+
+	g_Device->IRPRequest(g_Device, irp);
+}
+
+static BOOL test_irp_wait(void)
+{
+	return (WaitForSingleObject(g_DoneEvent, 30000) == WAIT_OBJECT_0) ? TRUE : FALSE;
+}
+
+static void test_irp_begin(LONG count)
+{
+	ResetEvent(g_DoneEvent);
+	g_Pending = count;
+}
+
+static IRP* test_irp_create(DEVMAN* devman, const char* path, UINT32 CreateDisposition, UINT32 CreateOptions)
+{
+	IRP* irp;
+	int length;
+	WCHAR* unicode = NULL;
+
+	length = ConvertToUnicode(CP_UTF8, 0, path, -1, &unicode, 0) * 2;
+	irp = test_irp_new(IRP_MJ_CREATE, 0, 0, length + 32);
+	irp->devman = devman;
+
+	Stream_Write_UINT32(irp->input, GENERIC_READ | GENERIC_WRITE); /* DesiredAccess */
+	Stream_Zero(irp->input, 16); /* AllocationSize(8), FileAttributes(4), SharedAccess(4) */
+	Stream_Write_UINT32(irp->input, CreateDisposition);
+	Stream_Write_UINT32(irp->input, CreateOptions);
+	Stream_Write_UINT32(irp->input, length); /* PathLength */
+	Stream_Write(irp->input, unicode, length);
+
+	free(unicode);
+
+	return irp;
+}
+
+static UINT32 test_open(DEVMAN* devman, const char* path, UINT32 CreateDisposition, UINT32 CreateOptions)
+{
+	test_irp_begin(1);
+	test_irp_submit(test_irp_create(devman, path, CreateDisposition, CreateOptions));
+
+	if (!test_irp_wait() || (g_Status != STATUS_SUCCESS))
+		return 0;
+
+	return g_Value;
+}
+
+static BOOL test_close(UINT32 FileId)
+{
+	test_irp_begin(1);
+	test_irp_submit(test_irp_new(IRP_MJ_CLOSE, 0, FileId, 32));
+
+	return (test_irp_wait() && (g_Status == STATUS_SUCCESS)) ? TRUE : FALSE;
+}
+
+static void test_submit_write(UINT32 FileId, UINT64 Offset, BYTE* data, UINT32 Length)
+{
+	IRP* irp;
+
+	irp = test_irp_new(IRP_MJ_WRITE, 0, FileId, Length + 32);
+
+	Stream_Write_UINT32(irp->input, Length);
+	Stream_Write_UINT64(irp->input, Offset);
+	Stream_Zero(irp->input, 20); /* Padding */
+	Stream_Write(irp->input, data, Length);
+
+	test_irp_submit(irp);
+}
+
+static void test_submit_read(UINT32 FileId, UINT64 Offset, UINT32 Length)
+{
+	IRP* irp;
+
+	irp = test_irp_new(IRP_MJ_READ, 0, FileId, 32);
+
+	Stream_Write_UINT32(irp->input, Length);
+	Stream_Write_UINT64(irp->input, Offset);
+	Stream_Zero(irp->input, 20); /* Padding */
+
+	test_irp_submit(irp);
+}
+
+static void test_submit_query_information(UINT32 FileId)
+{
+	IRP* irp;
+
+	irp = test_irp_new(IRP_MJ_QUERY_INFORMATION, 0, FileId, 32);
+
+	Stream_Write_UINT32(irp->input, FileStandardInformation);
+
+	test_irp_submit(irp);
+}
+
+static int test_list_directory(UINT32 FileId, int max)
+{
+	IRP* irp;
+	int count = 0;
+	BYTE InitialQuery = 1;
+	WCHAR pattern[] = { '\\', '*', 0 };
+
+	while (count < max)
+	{
+		irp = test_irp_new(IRP_MJ_DIRECTORY_CONTROL, IRP_MN_QUERY_DIRECTORY, FileId, 64);
+
+		Stream_Write_UINT32(irp->input, FileDirectoryInformation);
+		Stream_Write_UINT8(irp->input, InitialQuery);
+		Stream_Write_UINT32(irp->input, InitialQuery ? sizeof(pattern) : 0); /* PathLength */
+		Stream_Zero(irp->input, 23); /* Padding */
+
+		if (InitialQuery)
+			Stream_Write(irp->input, pattern, sizeof(pattern));
+
+		test_irp_begin(1);
+		test_irp_submit(irp);
+
+		if (!test_irp_wait())
+			return -1;
+
+		if (g_Status == STATUS_NO_MORE_FILES)
+			break;
+
+		if (g_Status != STATUS_SUCCESS)
+			return -1;
+
+		InitialQuery = 0;
+		count++;
+	}
+
+	return count;
+}
+
+static double test_rate(double amount, UINT64 start)
+{
+	UINT64 elapsed = GetTickCount64() - start;
+
+	if (!elapsed)
+		elapsed = 1;
+
+	return amount / ((double) elapsed / 1000.0);
+}
+
+static int test_drive_irps(DEVMAN* devman)
+{
+	int pass;
+	int index;
+	int entries;
+	UINT64 start;
+	UINT32 FileId;
+	UINT32 DirId;
+	BYTE* block;
+	double rate;
+
+	block = (BYTE*) malloc(TEST_BLOCK_SIZE);
+
+	if (!block)
+		return -1;
+
+	for (index = 0; index < TEST_BLOCK_SIZE; index++)
+		block[index] = (BYTE) (index * 7);
+
+	FileId = test_open(devman, "\\bench.bin", FILE_OVERWRITE_IF, FILE_NON_DIRECTORY_FILE);
+
+	if (!FileId)
+	{
+		printf("failed to create the benchmark file\n");
+		free(block);
+		return -1;
+	}
+
+	/* writes to independent offsets may complete in any order */
+
+	g_Capture = FALSE;
+	test_irp_begin(TEST_BLOCK_COUNT);
+
+	for (index = 0; index < TEST_BLOCK_COUNT; index++)
+		test_submit_write(FileId, (UINT64) index * TEST_BLOCK_SIZE, block, TEST_BLOCK_SIZE);
+
+	if (!test_irp_wait() || g_Failures)
+	{
+		printf("failed to write the benchmark file\n");
+		free(block);
+		return -1;
+	}
+
+	g_Capture = TRUE;
+	test_irp_begin(1);
+	test_submit_read(FileId, (UINT64) (TEST_BLOCK_COUNT - 1) * TEST_BLOCK_SIZE, TEST_BLOCK_SIZE);
+
+	if (!test_irp_wait() || (g_Value != TEST_BLOCK_SIZE) || memcmp(g_Data, block, TEST_BLOCK_SIZE))
+	{
+		printf("unexpected data read back from the benchmark file\n");
+		free(block);
+		return -1;
+	}
+
+	free(block);
+
+	/* reading past the end of the file returns no data */
+
+	test_irp_begin(1);
+	test_submit_read(FileId, (UINT64) TEST_BLOCK_COUNT * TEST_BLOCK_SIZE, TEST_BLOCK_SIZE);
+
+	if (!test_irp_wait() || (g_Status != STATUS_SUCCESS) || (g_Value != 0))
+		return -1;
+
+	g_Capture = FALSE;
+
+	start = GetTickCount64();
+	test_irp_begin(TEST_BLOCK_COUNT * TEST_READ_PASSES);
+
+	for (pass = 0; pass < TEST_READ_PASSES; pass++)
+	{
+		for (index = 0; index < TEST_BLOCK_COUNT; index++)
+			test_submit_read(FileId, (UINT64) index * TEST_BLOCK_SIZE, TEST_BLOCK_SIZE);
+	}
+
+	if (!test_irp_wait() || g_Failures)
+		return -1;
+
+	rate = test_rate((double) TEST_BLOCK_COUNT * TEST_READ_PASSES * TEST_BLOCK_SIZE / (1024.0 * 1024.0), start);
+	printf("read:              %10.1f MB/s\n", rate);
+
+	start = GetTickCount64();
+	test_irp_begin(TEST_QUERY_COUNT);
+
+	for (index = 0; index < TEST_QUERY_COUNT; index++)
+		test_submit_query_information(FileId);
+
+	if (!test_irp_wait() || g_Failures)
+		return -1;
+
+	rate = test_rate((double) TEST_QUERY_COUNT, start);
+	printf("query information: %10.0f IRPs/s\n", rate);
+
+	g_Capture = TRUE;
+
+	DirId = test_open(devman, "\\", FILE_OPEN, FILE_DIRECTORY_FILE);
+
+	if (!DirId)
+		return -1;
+
+	entries = test_list_directory(DirId, 1000);
+
+	if (entries < 1)
+	{
+		printf("unexpected directory listing: %d entries\n", entries);
+		return -1;
+	}
+
+	if (!test_close(DirId) || !test_close(FileId))
+		return -1;
+
+	/* the file id is gone once the file is closed */
+
+	if (test_close(FileId))
+		return -1;
+
+	return 0;
+}
+
+static int test_list_directory_rate(DEVMAN* devman, const char* name)
+{
+	int entries;
+	UINT64 start;
+	UINT32 DirId;
+
+	DirId = test_open(devman, "\\listing", FILE_OPEN, FILE_DIRECTORY_FILE);
+
+	if (!DirId)
+		return -1;
+
+	start = GetTickCount64();
+	entries = test_list_directory(DirId, TEST_DIR_ENTRIES * 2);
+	printf("%-18s %10.0f entries/s\n", name, test_rate((double) entries, start));
+
+	if (!test_close(DirId))
+		return -1;
+
+	return entries;
+}
+
+/**
+ * Enumerates a large directory through the IRP path, once to build the
+ * snapshot and once from the cache, then checks that creating a file
+ * through the drive, and then behind its back, shows up in the next
+ * enumeration.
+ */
+
+static int test_drive_directory(DEVMAN* devman, const char* path)
+{
+	FILE* fp;
+	int index;
+	int entries;
+	char name[64];
+	char* filename;
+	char* listing;
+	UINT32 FileId;
+	int status = -1;
+
+	listing = GetCombinedPath(path, "listing");
+
+	if (!listing)
+		return -1;
+
+	if (!PathFileExistsA(listing))
+		CreateDirectoryA(listing, NULL);
+
+	for (index = 0; index < TEST_DIR_ENTRIES; index++)
+	{
+		sprintf_s(name, sizeof(name), "file%05d.txt", index);
+		filename = GetCombinedPath(listing, name);
+		fp = fopen(filename, "wb");
+		free(filename);
+
+		if (!fp)
+			goto out;
+
+		fclose(fp);
+	}
+
+	/* the listing includes the . and .. entries */
+
+	entries = test_list_directory_rate(devman, "list (snapshot):");
+
+	if (entries != TEST_DIR_ENTRIES + 2)
+	{
+		printf("unexpected directory listing: %d entries\n", entries);
+		goto out;
+	}
+
+	entries = test_list_directory_rate(devman, "list (cached):");
+
+	if (entries != TEST_DIR_ENTRIES + 2)
+		goto out;
+
+	FileId = test_open(devman, "\\listing\\extra.txt", FILE_CREATE, FILE_NON_DIRECTORY_FILE);
+
+	if (!FileId || !test_close(FileId))
+		goto out;
+
+	entries = test_list_directory_rate(devman, "list (changed):");
+
+	if (entries != TEST_DIR_ENTRIES + 3)
+	{
+		printf("created file missing from the listing: %d entries\n", entries);
+		goto out;
+	}
+
+	filename = GetCombinedPath(listing, "external.txt");
+	fp = filename ? fopen(filename, "wb") : NULL;
+	free(filename);
+
+	if (!fp)
+		goto out;
+
+	fclose(fp);
+
+#ifndef __linux__
+	/* without inotify, the snapshot expires */
+	Sleep(2100);
+#endif
+
+	entries = test_list_directory_rate(devman, "list (external):");
+
+	if (entries != TEST_DIR_ENTRIES + 4)
+	{
+		printf("file created behind the drive missing from the listing: %d entries\n", entries);
+		goto out;
+	}
+
+	status = 0;
+
+out:
+	for (index = 0; index < TEST_DIR_ENTRIES; index++)
+	{
+		sprintf_s(name, sizeof(name), "file%05d.txt", index);
+		filename = GetCombinedPath(listing, name);
+		DeleteFileA(filename);
+		free(filename);
+	}
+
+	filename = GetCombinedPath(listing, "extra.txt");
+	DeleteFileA(filename);
+	free(filename);
+
+	filename = GetCombinedPath(listing, "external.txt");
+	DeleteFileA(filename);
+	free(filename);
+
+	free(listing);
+
+	return status;
+}
+
+int TestDriveIrp(int argc, char* argv[])
+{
+	int status;
+	char* path;
+	char* filename;
+	DEVMAN devman;
+	RDPDR_DRIVE drive;
+	DEVICE_SERVICE_ENTRY_POINTS entryPoints;
+
+	path = GetKnownSubPath(KNOWN_PATH_TEMP, "TestDriveIrp");
+
+	if (!path)
+		return -1;
+
+	if (!PathFileExistsA(path))
+		CreateDirectoryA(path, NULL);
+
+	g_DoneEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+	ZeroMemory(&devman, sizeof(DEVMAN));
+	devman.id_sequence = 1;
+
+	ZeroMemory(&drive, sizeof(RDPDR_DRIVE));
+	drive.Type = RDPDR_DTYP_FILESYSTEM;
+	drive.Name = "test";
+	drive.Path = path;
+
+	ZeroMemory(&entryPoints, sizeof(DEVICE_SERVICE_ENTRY_POINTS));
+	entryPoints.devman = &devman;
+	entryPoints.RegisterDevice = test_register_device;
+	entryPoints.device = (RDPDR_DEVICE*) &drive;
+
+	drive_DeviceServiceEntry(&entryPoints);
+
+	if (!g_Device)
+		return -1;
+
+	status = test_drive_irps(&devman);
+
+	if (status == 0)
+		status = test_drive_directory(&devman, path);
+
+	if (status < 0)
+		printf("drive IRP test failed (%d failed IRPs)\n", (int) g_Failures);
+
+	g_Device->Free(g_Device);
+
+	filename = GetCombinedPath(path, "bench.bin");
+	DeleteFileA(filename);
+	free(filename);
+
+	free(path);
+
+	CloseHandle(g_DoneEvent);
+
+	return status;
+}
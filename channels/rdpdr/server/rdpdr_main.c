@@ -347,51 +347,553 @@ static int rdpdr_server_send_client_id_confirm(RdpdrServerContext* context)
 	return 0;
 }
 
+static void rdpdr_server_device_free(RDPDR_SERVER_DEVICE* device)
+{
+	if (!device)
+		return;
+
+	free(device->DeviceData);
+	free(device);
+}
+
+static int rdpdr_server_send_device_announce_response(RdpdrServerContext* context, UINT32 DeviceId, UINT32 ResultCode)
+{
+	wStream* s;
+	BOOL status;
+	RDPDR_HEADER header;
+	ULONG written;
+	header.Component = RDPDR_CTYP_CORE;
+	header.PacketId = PAKID_CORE_DEVICE_REPLY;
+	s = Stream_New(NULL, RDPDR_HEADER_LENGTH + 8);
+
+	if (!s)
+		return -1;
+
+	Stream_Write_UINT16(s, header.Component); /* Component (2 bytes) */
+	Stream_Write_UINT16(s, header.PacketId); /* PacketId (2 bytes) */
+	Stream_Write_UINT32(s, DeviceId); /* DeviceId (4 bytes) */
+	Stream_Write_UINT32(s, ResultCode); /* ResultCode (4 bytes) */
+	Stream_SealLength(s);
+	status = WTSVirtualChannelWrite(context->priv->ChannelHandle, (PCHAR) Stream_Buffer(s), Stream_Length(s), &written);
+	Stream_Free(s, TRUE);
+	return status ? 0 : -1;
+}
+
 static int rdpdr_server_receive_device_list_announce_request(RdpdrServerContext* context, wStream* s, RDPDR_HEADER* header)
 {
 	int i;
 	UINT32 DeviceCount;
-	UINT32 DeviceType;
-	UINT32 DeviceId;
-	char PreferredDosName[9];
-	UINT32 DeviceDataLength;
-	PreferredDosName[8] = 0;
+	RDPDR_SERVER_DEVICE* device;
+	RDPDR_SERVER_DEVICE* previous;
+
+	if (Stream_GetRemainingLength(s) < 4)
+		return -1;
+
 	Stream_Read_UINT32(s, DeviceCount); /* DeviceCount (4 bytes) */
 	WLog_DBG(TAG, "DeviceCount: %d", DeviceCount);
 
 	for (i = 0; i < DeviceCount; i++)
 	{
-		Stream_Read_UINT32(s, DeviceType); /* DeviceType (4 bytes) */
+		if (Stream_GetRemainingLength(s) < 20)
+			return -1;
+
+		device = (RDPDR_SERVER_DEVICE*) calloc(1, sizeof(RDPDR_SERVER_DEVICE));
+
+		if (!device)
+			return -1;
+
+		Stream_Read_UINT32(s, device->DeviceType); /* DeviceType (4 bytes) */
+		Stream_Read_UINT32(s, device->DeviceId); /* DeviceId (4 bytes) */
+		Stream_Read(s, device->PreferredDosName, 8); /* PreferredDosName (8 bytes) */
+		Stream_Read_UINT32(s, device->DeviceDataLength); /* DeviceDataLength (4 bytes) */
+		WLog_DBG(TAG, "Device %d Name: %s Type: %d Id: 0x%04X DataLength: %d",
+				 i, device->PreferredDosName, device->DeviceType, device->DeviceId, device->DeviceDataLength);
+
+		if (Stream_GetRemainingLength(s) < device->DeviceDataLength)
+		{
+			rdpdr_server_device_free(device);
+			return -1;
+		}
+
+		if (device->DeviceDataLength)
+		{
+			device->DeviceData = (BYTE*) malloc(device->DeviceDataLength);
+
+			if (!device->DeviceData)
+			{
+				rdpdr_server_device_free(device);
+				return -1;
+			}
+
+			Stream_Read(s, device->DeviceData, device->DeviceDataLength);
+		}
+
+		/* a device announced again replaces the previous one */
+
+		previous = (RDPDR_SERVER_DEVICE*) ListDictionary_Remove(context->priv->Devices,
+				(void*) (size_t) device->DeviceId);
+		rdpdr_server_device_free(previous);
+
+		if (!ListDictionary_Add(context->priv->Devices, (void*) (size_t) device->DeviceId, device))
+		{
+			rdpdr_server_device_free(device);
+			return -1;
+		}
+
+		rdpdr_server_send_device_announce_response(context, device->DeviceId, STATUS_SUCCESS);
+
+		if (context->OnDeviceAnnounce)
+			context->OnDeviceAnnounce(context, device);
+	}
+
+	return 0;
+}
+
+static int rdpdr_server_receive_device_list_remove_request(RdpdrServerContext* context, wStream* s, RDPDR_HEADER* header)
+{
+	int i;
+	UINT32 DeviceId;
+	UINT32 DeviceCount;
+	RDPDR_SERVER_DEVICE* device;
+
+	if (Stream_GetRemainingLength(s) < 4)
+		return -1;
+
+	Stream_Read_UINT32(s, DeviceCount); /* DeviceCount (4 bytes) */
+
+	if (DeviceCount > Stream_GetRemainingLength(s) / 4)
+		return -1;
+
+	for (i = 0; i < DeviceCount; i++)
+	{
 		Stream_Read_UINT32(s, DeviceId); /* DeviceId (4 bytes) */
-		Stream_Read(s, PreferredDosName, 8); /* PreferredDosName (8 bytes) */
-		Stream_Read_UINT32(s, DeviceDataLength); /* DeviceDataLength (4 bytes) */
-		WLog_DBG(TAG, "Device %d Name: %s Id: 0x%04X DataLength: %d",
-				 i, PreferredDosName, DeviceId, DeviceDataLength);
+		device = (RDPDR_SERVER_DEVICE*) ListDictionary_Remove(context->priv->Devices, (void*) (size_t) DeviceId);
+
+		if (!device)
+			continue;
+
+		if (context->OnDeviceRemove)
+			context->OnDeviceRemove(context, device);
+
+		rdpdr_server_device_free(device);
+	}
+
+	return 0;
+}
+
+static RDPDR_SERVER_IRP* rdpdr_server_irp_new(UINT32 DeviceId, UINT32 FileId, UINT32 MajorFunction, UINT32 MinorFunction)
+{
+	RDPDR_SERVER_IRP* irp;
+
+	irp = (RDPDR_SERVER_IRP*) calloc(1, sizeof(RDPDR_SERVER_IRP));
+
+	if (!irp)
+		return NULL;
+
+	irp->CompletionEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+	if (!irp->CompletionEvent)
+	{
+		free(irp);
+		return NULL;
+	}
+
+	irp->DeviceId = DeviceId;
+	irp->FileId = FileId;
+	irp->MajorFunction = MajorFunction;
+	irp->MinorFunction = MinorFunction;
+
+	return irp;
+}
+
+static void rdpdr_server_irp_free(RDPDR_SERVER_IRP* irp)
+{
+	if (!irp)
+		return;
 
-		switch (DeviceId)
+	CloseHandle(irp->CompletionEvent);
+	free(irp->Buffer);
+	free(irp);
+}
+
+/**
+ * Returns a stream for a device I/O request with parameters of the given
+ * length, positioned after the header written by rdpdr_server_send_irp().
+ */
+
+static wStream* rdpdr_server_irp_stream_new(size_t length)
+{
+	wStream* s;
+
+	s = Stream_New(NULL, RDPDR_DEVICE_IO_REQUEST_LENGTH + length);
+
+	if (s)
+		Stream_Seek(s, RDPDR_DEVICE_IO_REQUEST_LENGTH);
+
+	return s;
+}
+
+/**
+ * Registers the IRP under a CompletionId not in use, then sends the request:
+ * the completion may be received before the write returns.
+ */
+
+static RDPDR_SERVER_IRP* rdpdr_server_send_irp(RdpdrServerContext* context, RDPDR_SERVER_IRP* irp, wStream* s)
+{
+	BOOL status;
+	size_t position;
+	ULONG written;
+	RdpdrServerPrivate* priv = context->priv;
+
+	if (!irp || !s)
+	{
+		rdpdr_server_irp_free(irp);
+		Stream_Free(s, TRUE);
+		return NULL;
+	}
+
+	EnterCriticalSection(&priv->IrpLock);
+
+	do
+	{
+		irp->CompletionId = priv->NextCompletionId++;
+	}
+	while (!irp->CompletionId || HashTable_Contains(priv->Irps, (void*) (size_t) irp->CompletionId));
+
+	status = (HashTable_Add(priv->Irps, (void*) (size_t) irp->CompletionId, irp) >= 0) ? TRUE : FALSE;
+
+	LeaveCriticalSection(&priv->IrpLock);
+
+	if (status)
+	{
+		position = Stream_GetPosition(s);
+		Stream_SetPosition(s, 0);
+		Stream_Write_UINT16(s, RDPDR_CTYP_CORE); /* Component (2 bytes) */
+		Stream_Write_UINT16(s, PAKID_CORE_DEVICE_IOREQUEST); /* PacketId (2 bytes) */
+		Stream_Write_UINT32(s, irp->DeviceId); /* DeviceId (4 bytes) */
+		Stream_Write_UINT32(s, irp->FileId); /* FileId (4 bytes) */
+		Stream_Write_UINT32(s, irp->CompletionId); /* CompletionId (4 bytes) */
+		Stream_Write_UINT32(s, irp->MajorFunction); /* MajorFunction (4 bytes) */
+		Stream_Write_UINT32(s, irp->MinorFunction); /* MinorFunction (4 bytes) */
+		Stream_SetPosition(s, position);
+		Stream_SealLength(s);
+
+		status = WTSVirtualChannelWrite(priv->ChannelHandle, (PCHAR) Stream_Buffer(s), Stream_Length(s), &written);
+
+		if (!status)
 		{
-			case RDPDR_DTYP_FILESYSTEM:
-				break;
+			EnterCriticalSection(&priv->IrpLock);
+			HashTable_Remove(priv->Irps, (void*) (size_t) irp->CompletionId);
+			LeaveCriticalSection(&priv->IrpLock);
+		}
+	}
 
-			case RDPDR_DTYP_PRINT:
-				break;
+	Stream_Free(s, TRUE);
+
+	if (!status)
+	{
+		rdpdr_server_irp_free(irp);
+		return NULL;
+	}
+
+	return irp;
+}
+
+static RDPDR_SERVER_IRP* rdpdr_server_drive_create(RdpdrServerContext* context, UINT32 DeviceId, const char* path,
+		UINT32 DesiredAccess, UINT32 CreateDisposition, UINT32 CreateOptions)
+{
+	wStream* s;
+	int length;
+	UINT32 PathLength;
+	WCHAR* unicode = NULL;
+
+	length = ConvertToUnicode(CP_UTF8, 0, path, -1, &unicode, 0);
+
+	if (length < 1)
+		return NULL;
+
+	PathLength = length * 2;
+	s = rdpdr_server_irp_stream_new(32 + PathLength);
+
+	if (s)
+	{
+		Stream_Write_UINT32(s, DesiredAccess); /* DesiredAccess (4 bytes) */
+		Stream_Write_UINT64(s, 0); /* AllocationSize (8 bytes) */
+		Stream_Write_UINT32(s, 0); /* FileAttributes (4 bytes) */
+		Stream_Write_UINT32(s, FILE_SHARE_READ | FILE_SHARE_WRITE); /* SharedAccess (4 bytes) */
+		Stream_Write_UINT32(s, CreateDisposition); /* CreateDisposition (4 bytes) */
+		Stream_Write_UINT32(s, CreateOptions); /* CreateOptions (4 bytes) */
+		Stream_Write_UINT32(s, PathLength); /* PathLength (4 bytes) */
+		Stream_Write(s, unicode, PathLength); /* Path (variable) */
+	}
 
-			case RDPDR_DTYP_SERIAL:
+	free(unicode);
+
+	return rdpdr_server_send_irp(context, rdpdr_server_irp_new(DeviceId, 0, IRP_MJ_CREATE, 0), s);
+}
+
+static RDPDR_SERVER_IRP* rdpdr_server_drive_read(RdpdrServerContext* context, UINT32 DeviceId, UINT32 FileId,
+		UINT32 Length, UINT64 Offset)
+{
+	wStream* s;
+
+	s = rdpdr_server_irp_stream_new(32);
+
+	if (s)
+	{
+		Stream_Write_UINT32(s, Length); /* Length (4 bytes) */
+		Stream_Write_UINT64(s, Offset); /* Offset (8 bytes) */
+		Stream_Zero(s, 20); /* Padding (20 bytes) */
+	}
+
+	return rdpdr_server_send_irp(context, rdpdr_server_irp_new(DeviceId, FileId, IRP_MJ_READ, 0), s);
+}
+
+static RDPDR_SERVER_IRP* rdpdr_server_drive_write(RdpdrServerContext* context, UINT32 DeviceId, UINT32 FileId,
+		const BYTE* data, UINT32 Length, UINT64 Offset)
+{
+	wStream* s;
+
+	s = rdpdr_server_irp_stream_new(32 + (size_t) Length);
+
+	if (s)
+	{
+		Stream_Write_UINT32(s, Length); /* Length (4 bytes) */
+		Stream_Write_UINT64(s, Offset); /* Offset (8 bytes) */
+		Stream_Zero(s, 20); /* Padding (20 bytes) */
+		Stream_Write(s, data, Length); /* WriteData (variable) */
+	}
+
+	return rdpdr_server_send_irp(context, rdpdr_server_irp_new(DeviceId, FileId, IRP_MJ_WRITE, 0), s);
+}
+
+static RDPDR_SERVER_IRP* rdpdr_server_drive_query_information(RdpdrServerContext* context, UINT32 DeviceId, UINT32 FileId,
+		UINT32 FsInformationClass)
+{
+	wStream* s;
+
+	s = rdpdr_server_irp_stream_new(32);
+
+	if (s)
+	{
+		Stream_Write_UINT32(s, FsInformationClass); /* FsInformationClass (4 bytes) */
+		Stream_Write_UINT32(s, 0); /* Length (4 bytes) */
+		Stream_Zero(s, 24); /* Padding (24 bytes) */
+	}
+
+	return rdpdr_server_send_irp(context, rdpdr_server_irp_new(DeviceId, FileId, IRP_MJ_QUERY_INFORMATION, 0), s);
+}
+
+static RDPDR_SERVER_IRP* rdpdr_server_drive_query_directory(RdpdrServerContext* context, UINT32 DeviceId, UINT32 FileId,
+		UINT32 FsInformationClass, BOOL InitialQuery, const char* path)
+{
+	wStream* s;
+	int length = 0;
+	UINT32 PathLength = 0;
+	WCHAR* unicode = NULL;
+
+	/* the path (a pattern such as \*) is only sent with the initial query */
+
+	if (InitialQuery && path)
+	{
+		length = ConvertToUnicode(CP_UTF8, 0, path, -1, &unicode, 0);
+
+		if (length < 1)
+			return NULL;
+
+		PathLength = length * 2;
+	}
+
+	s = rdpdr_server_irp_stream_new(32 + PathLength);
+
+	if (s)
+	{
+		Stream_Write_UINT32(s, FsInformationClass); /* FsInformationClass (4 bytes) */
+		Stream_Write_UINT8(s, InitialQuery ? 1 : 0); /* InitialQuery (1 byte) */
+		Stream_Write_UINT32(s, PathLength); /* PathLength (4 bytes) */
+		Stream_Zero(s, 23); /* Padding (23 bytes) */
+		Stream_Write(s, unicode, PathLength); /* Path (variable) */
+	}
+
+	free(unicode);
+
+	return rdpdr_server_send_irp(context, rdpdr_server_irp_new(DeviceId, FileId,
+			IRP_MJ_DIRECTORY_CONTROL, IRP_MN_QUERY_DIRECTORY), s);
+}
+
+static RDPDR_SERVER_IRP* rdpdr_server_drive_close(RdpdrServerContext* context, UINT32 DeviceId, UINT32 FileId)
+{
+	wStream* s;
+
+	s = rdpdr_server_irp_stream_new(32);
+
+	if (s)
+		Stream_Zero(s, 32); /* Padding (32 bytes) */
+
+	return rdpdr_server_send_irp(context, rdpdr_server_irp_new(DeviceId, FileId, IRP_MJ_CLOSE, 0), s);
+}
+
+/**
+ * A pending IRP is forgotten, its completion will be dropped. Otherwise its
+ * completion may still be in progress on the channel thread: the IRP is
+ * released once its CompletionEvent is signaled.
+ */
+
+static void rdpdr_server_free_irp(RdpdrServerContext* context, RDPDR_SERVER_IRP* irp)
+{
+	BOOL pending;
+	RdpdrServerPrivate* priv = context->priv;
+
+	if (!irp)
+		return;
+
+	EnterCriticalSection(&priv->IrpLock);
+
+	pending = (HashTable_GetItemValue(priv->Irps, (void*) (size_t) irp->CompletionId) == irp) ? TRUE : FALSE;
+
+	if (pending)
+		HashTable_Remove(priv->Irps, (void*) (size_t) irp->CompletionId);
+
+	LeaveCriticalSection(&priv->IrpLock);
+
+	if (!pending)
+		WaitForSingleObject(irp->CompletionEvent, INFINITE);
+
+	rdpdr_server_irp_free(irp);
+}
+
+/**
+ * Completes the pending IRPs with STATUS_CANCELLED
+ */
+
+static void rdpdr_server_cancel_irps(RdpdrServerContext* context)
+{
+	int index;
+	int count;
+	ULONG_PTR* keys = NULL;
+	RDPDR_SERVER_IRP* irp;
+	RdpdrServerPrivate* priv = context->priv;
+
+	EnterCriticalSection(&priv->IrpLock);
+
+	count = HashTable_GetKeys(priv->Irps, &keys);
+
+	for (index = 0; index < count; index++)
+	{
+		irp = (RDPDR_SERVER_IRP*) HashTable_GetItemValue(priv->Irps, (void*) keys[index]);
+		HashTable_Remove(priv->Irps, (void*) keys[index]);
+
+		if (!irp)
+			continue;
+
+		irp->IoStatus = STATUS_CANCELLED;
+		SetEvent(irp->CompletionEvent);
+	}
+
+	LeaveCriticalSection(&priv->IrpLock);
+
+	free(keys);
+}
+
+static int rdpdr_server_receive_device_io_completion(RdpdrServerContext* context, wStream* s, RDPDR_HEADER* header)
+{
+	UINT32 DeviceId;
+	UINT32 CompletionId;
+	UINT32 IoStatus;
+	UINT32 Length;
+	RDPDR_SERVER_IRP* irp;
+	RdpdrServerPrivate* priv = context->priv;
+
+	if (Stream_GetRemainingLength(s) < 12)
+		return -1;
+
+	Stream_Read_UINT32(s, DeviceId); /* DeviceId (4 bytes) */
+	Stream_Read_UINT32(s, CompletionId); /* CompletionId (4 bytes) */
+	Stream_Read_UINT32(s, IoStatus); /* IoStatus (4 bytes) */
+
+	EnterCriticalSection(&priv->IrpLock);
+
+	irp = (RDPDR_SERVER_IRP*) HashTable_GetItemValue(priv->Irps, (void*) (size_t) CompletionId);
+
+	if (irp)
+		HashTable_Remove(priv->Irps, (void*) (size_t) CompletionId);
+
+	LeaveCriticalSection(&priv->IrpLock);
+
+	if (!irp)
+	{
+		WLog_WARN(TAG, "I/O completion for unknown CompletionId %d (DeviceId %d)", CompletionId, DeviceId);
+		return -1;
+	}
+
+	irp->IoStatus = IoStatus;
+
+	switch (irp->MajorFunction)
+	{
+		case IRP_MJ_CREATE:
+			if (Stream_GetRemainingLength(s) < 5)
+			{
+				irp->IoStatus = STATUS_UNSUCCESSFUL;
 				break;
+			}
 
-			case RDPDR_DTYP_PARALLEL:
+			Stream_Read_UINT32(s, irp->FileId); /* FileId (4 bytes) */
+			Stream_Read_UINT8(s, irp->Information); /* Information (1 byte) */
+			break;
+
+		case IRP_MJ_WRITE:
+			if (Stream_GetRemainingLength(s) < 4)
+			{
+				irp->IoStatus = STATUS_UNSUCCESSFUL;
 				break;
+			}
+
+			Stream_Read_UINT32(s, irp->Length); /* Length (4 bytes) */
+			break;
 
-			case RDPDR_DTYP_SMARTCARD:
+		case IRP_MJ_READ:
+		case IRP_MJ_QUERY_INFORMATION:
+		case IRP_MJ_QUERY_VOLUME_INFORMATION:
+		case IRP_MJ_DIRECTORY_CONTROL:
+			if (Stream_GetRemainingLength(s) < 4)
+			{
+				irp->IoStatus = STATUS_UNSUCCESSFUL;
 				break;
+			}
 
-			default:
+			Stream_Read_UINT32(s, Length); /* Length (4 bytes) */
+
+			if (Stream_GetRemainingLength(s) < Length)
+			{
+				irp->IoStatus = STATUS_UNSUCCESSFUL;
 				break;
-		}
+			}
+
+			if (Length)
+			{
+				irp->Buffer = (BYTE*) malloc(Length);
 
-		Stream_Seek(s, DeviceDataLength);
+				if (!irp->Buffer)
+				{
+					irp->IoStatus = STATUS_NO_MEMORY;
+					break;
+				}
+
+				Stream_Read(s, irp->Buffer, Length); /* Buffer (variable) */
+			}
+
+			irp->Length = Length;
+			break;
+
+		default:
+			break;
 	}
 
+	if (context->OnIrpCompleted)
+		context->OnIrpCompleted(context, irp);
+
+	SetEvent(irp->CompletionEvent);
+
 	return 0;
 }
 
@@ -417,7 +919,11 @@ static int rdpdr_server_receive_pdu(RdpdrServerContext* context, wStream* s, RDP
 {
 	WLog_DBG(TAG, "RdpdrServerReceivePdu: Component: 0x%04X PacketId: 0x%04X",
 			 header->Component, header->PacketId);
-	winpr_HexDump(TAG, WLOG_DEBUG, Stream_Buffer(s), Stream_Length(s));
+
+	/* completions carry the file data, too large to be dumped */
+
+	if (header->PacketId != PAKID_CORE_DEVICE_IOCOMPLETION)
+		winpr_HexDump(TAG, WLOG_DEBUG, Stream_Buffer(s), Stream_Length(s));
 
 	if (header->Component == RDPDR_CTYP_CORE)
 	{
@@ -452,9 +958,11 @@ static int rdpdr_server_receive_pdu(RdpdrServerContext* context, wStream* s, RDP
 				break;
 
 			case PAKID_CORE_DEVICE_IOCOMPLETION:
+				rdpdr_server_receive_device_io_completion(context, s, header);
 				break;
 
 			case PAKID_CORE_DEVICELIST_REMOVE:
+				rdpdr_server_receive_device_list_remove_request(context, s, header);
 				break;
 
 			default:
@@ -538,6 +1046,8 @@ static void* rdpdr_server_thread(void* arg)
 			break;
 		}
 
+		Stream_SetPosition(s, BytesReturned);
+
 		if (Stream_GetPosition(s) >= RDPDR_HEADER_LENGTH)
 		{
 			position = Stream_GetPosition(s);
@@ -574,6 +1084,15 @@ static int rdpdr_server_stop(RdpdrServerContext* context)
 	SetEvent(context->priv->StopEvent);
 	WaitForSingleObject(context->priv->Thread, INFINITE);
 	CloseHandle(context->priv->Thread);
+	context->priv->Thread = NULL;
+
+	if (context->priv->ChannelHandle)
+	{
+		WTSVirtualChannelClose(context->priv->ChannelHandle);
+		context->priv->ChannelHandle = NULL;
+	}
+
+	rdpdr_server_cancel_irps(context);
 	return 0;
 }
 
@@ -588,15 +1107,35 @@ RdpdrServerContext* rdpdr_server_context_new(HANDLE vcm)
 		context->vcm = vcm;
 		context->Start = rdpdr_server_start;
 		context->Stop = rdpdr_server_stop;
+		context->DriveCreate = rdpdr_server_drive_create;
+		context->DriveRead = rdpdr_server_drive_read;
+		context->DriveWrite = rdpdr_server_drive_write;
+		context->DriveQueryInformation = rdpdr_server_drive_query_information;
+		context->DriveQueryDirectory = rdpdr_server_drive_query_directory;
+		context->DriveClose = rdpdr_server_drive_close;
+		context->FreeIrp = rdpdr_server_free_irp;
 		context->priv = (RdpdrServerPrivate*) malloc(sizeof(RdpdrServerPrivate));
 
-		if (context->priv)
+		if (!context->priv)
+		{
+			free(context);
+			return NULL;
+		}
+
+		ZeroMemory(context->priv, sizeof(RdpdrServerPrivate));
+		context->priv->VersionMajor = RDPDR_VERSION_MAJOR;
+		context->priv->VersionMinor = RDPDR_VERSION_MINOR_RDP6X;
+		context->priv->ClientId = g_ClientId++;
+		context->priv->UserLoggedOnPdu = TRUE;
+		context->priv->NextCompletionId = 1;
+		context->priv->Devices = ListDictionary_New(TRUE);
+		context->priv->Irps = HashTable_New(FALSE);
+		InitializeCriticalSectionAndSpinCount(&context->priv->IrpLock, 4000);
+
+		if (!context->priv->Devices || !context->priv->Irps)
 		{
-			ZeroMemory(context->priv, sizeof(RdpdrServerPrivate));
-			context->priv->VersionMajor = RDPDR_VERSION_MAJOR;
-			context->priv->VersionMinor = RDPDR_VERSION_MINOR_RDP6X;
-			context->priv->ClientId = g_ClientId++;
-			context->priv->UserLoggedOnPdu = TRUE;
+			rdpdr_server_context_free(context);
+			return NULL;
 		}
 	}
 
@@ -605,10 +1144,32 @@ RdpdrServerContext* rdpdr_server_context_new(HANDLE vcm)
 
 void rdpdr_server_context_free(RdpdrServerContext* context)
 {
+	RDPDR_SERVER_DEVICE* device;
+
 	if (context)
 	{
 		if (context->priv)
 		{
+			if (context->priv->Irps)
+			{
+				rdpdr_server_cancel_irps(context);
+				HashTable_Free(context->priv->Irps);
+			}
+
+			if (context->priv->Devices)
+			{
+				while ((device = (RDPDR_SERVER_DEVICE*) ListDictionary_Remove_Head(context->priv->Devices)))
+					rdpdr_server_device_free(device);
+
+				ListDictionary_Free(context->priv->Devices);
+			}
+
+			DeleteCriticalSection(&context->priv->IrpLock);
+
+			if (context->priv->StopEvent)
+				CloseHandle(context->priv->StopEvent);
+
+			free(context->priv->ClientComputerName);
 			free(context->priv);
 		}
 
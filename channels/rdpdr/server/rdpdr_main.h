@@ -23,6 +23,7 @@
 #include <winpr/crt.h>
 #include <winpr/synch.h>
 #include <winpr/thread.h>
+#include <winpr/collections.h>
 
 #include <freerdp/settings.h>
 #include <freerdp/server/rdpdr.h>
@@ -39,6 +40,12 @@ struct _rdpdr_server_private
 	char* ClientComputerName;
 
 	BOOL UserLoggedOnPdu;
+
+	wListDictionary* Devices;
+
+	wHashTable* Irps;
+	CRITICAL_SECTION IrpLock;
+	UINT32 NextCompletionId;
 };
 
 #define RDPDR_HEADER_LENGTH		4
@@ -0,0 +1,736 @@
+
+#include <stdio.h>
+
+#include <winpr/crt.h>
+#include <winpr/file.h>
+#include <winpr/path.h>
+#include <winpr/synch.h>
+#include <winpr/sysinfo.h>
+#include <winpr/wtsapi.h>
+#include <winpr/collections.h>
+
+#include <freerdp/channels/rdpdr.h>
+#include <freerdp/server/rdpdr.h>
+
+#define TEST_BLOCK_SIZE		65536
+#define TEST_BLOCK_COUNT	128
+#define TEST_READ_PASSES	8
+#define TEST_DIR_ENTRIES	100
+
+int drive_DeviceServiceEntry(PDEVICE_SERVICE_ENTRY_POINTS pEntryPoints);
+
+/**
+ * A loopback virtual channel: what the server writes is handled right away
+ * by a minimal rdpdr client in front of the drive device, and what this
+ * client sends is queued for the server to read.
+ */
+
+static wMessageQueue* g_ServerQueue = NULL;
+static DEVMAN g_Devman;
+static DEVICE* g_Device = NULL;
+
+static HANDLE g_AnnounceEvent = NULL;
+static UINT32 g_DeviceId = 0;
+
+static HANDLE g_RemoveEvent = NULL;
+static UINT32 g_RemovedDeviceId = 0;
+static LONG g_RemoveCount = 0;
+
+static void test_client_send(wStream* s)
+{
+	BYTE* buffer;
+	size_t length = Stream_GetPosition(s);
+
+	buffer = (BYTE*) malloc(length);
+
+	if (!buffer)
+		return;
+
+	CopyMemory(buffer, Stream_Buffer(s), length);
+	MessageQueue_Post(g_ServerQueue, NULL, 0, (void*) buffer, (void*) (size_t) length);
+}
+
+static void test_client_irp_free(IRP* irp)
+{
+	Stream_Free(irp->input, TRUE);
+	Stream_Free(irp->output, TRUE);
+	free(irp);
+}
+
+static void test_client_irp_complete(IRP* irp)
+{
+	size_t position;
+
+	position = Stream_GetPosition(irp->output);
+	Stream_SetPosition(irp->output, RDPDR_DEVICE_IO_RESPONSE_LENGTH - 4);
+	Stream_Write_UINT32(irp->output, irp->IoStatus); /* IoStatus (4 bytes) */
+	Stream_SetPosition(irp->output, position);
+
+	test_client_send(irp->output);
+	test_client_irp_free(irp);
+}
+
+static void test_client_irp_request(wStream* s)
+{
+	IRP* irp;
+	UINT32 DeviceId;
+
+	irp = (IRP*) calloc(1, sizeof(IRP));
+
+	if (!irp)
+		return;
+
+	Stream_Read_UINT32(s, DeviceId); /* DeviceId (4 bytes) */
+	Stream_Read_UINT32(s, irp->FileId); /* FileId (4 bytes) */
+	Stream_Read_UINT32(s, irp->CompletionId); /* CompletionId (4 bytes) */
+	Stream_Read_UINT32(s, irp->MajorFunction); /* MajorFunction (4 bytes) */
+	Stream_Read_UINT32(s, irp->MinorFunction); /* MinorFunction (4 bytes) */
+
+	irp->device = g_Device;
+	irp->devman = &g_Devman;
+
+	irp->input = Stream_New(NULL, Stream_GetRemainingLength(s) + 1);
+	Stream_Write(irp->input, Stream_Pointer(s), Stream_GetRemainingLength(s));
+	Stream_SealLength(irp->input);
+	Stream_SetPosition(irp->input, 0);
+
+	irp->output = Stream_New(NULL, 256);
+	Stream_Write_UINT16(irp->output, RDPDR_CTYP_CORE); /* Component (2 bytes) */
+	Stream_Write_UINT16(irp->output, PAKID_CORE_DEVICE_IOCOMPLETION); /* PacketId (2 bytes) */
+	Stream_Write_UINT32(irp->output, DeviceId); /* DeviceId (4 bytes) */
+	Stream_Write_UINT32(irp->output, irp->CompletionId); /* CompletionId (4 bytes) */
+	Stream_Write_UINT32(irp->output, 0); /* IoStatus (4 bytes) */
+
+	irp->Complete = test_client_irp_complete;
+	irp->Discard = test_client_irp_free;
+
+	g_Device->IRPRequest(g_Device, irp);
+}
+
+static void test_client_receive(wStream* s)
+{
+	UINT16 Component;
+	UINT16 PacketId;
+	UINT32 ClientId;
+	UINT32 DeviceDataLength;
+	wStream* out;
+
+	Stream_Read_UINT16(s, Component); /* Component (2 bytes) */
+	Stream_Read_UINT16(s, PacketId); /* PacketId (2 bytes) */
+
+	if (Component != RDPDR_CTYP_CORE)
+		return;
+
+	out = Stream_New(NULL, 256);
+
+	switch (PacketId)
+	{
+		case PAKID_CORE_SERVER_ANNOUNCE:
+			Stream_Seek(s, 4); /* VersionMajor (2 bytes), VersionMinor (2 bytes) */
+			Stream_Read_UINT32(s, ClientId); /* ClientId (4 bytes) */
+
+			Stream_Write_UINT16(out, RDPDR_CTYP_CORE);
+			Stream_Write_UINT16(out, PAKID_CORE_CLIENTID_CONFIRM);
+			Stream_Write_UINT16(out, 1); /* VersionMajor */
+			Stream_Write_UINT16(out, 0x000C); /* VersionMinor */
+			Stream_Write_UINT32(out, ClientId);
+			test_client_send(out);
+
+			Stream_SetPosition(out, 0);
+			Stream_Write_UINT16(out, RDPDR_CTYP_CORE);
+			Stream_Write_UINT16(out, PAKID_CORE_CLIENT_NAME);
+			Stream_Write_UINT32(out, 0); /* UnicodeFlag */
+			Stream_Write_UINT32(out, 0); /* CodePage */
+			Stream_Write_UINT32(out, 5); /* ComputerNameLen */
+			Stream_Write(out, "test", 5);
+			test_client_send(out);
+			break;
+
+		case PAKID_CORE_SERVER_CAPABILITY:
+			Stream_Write_UINT16(out, RDPDR_CTYP_CORE);
+			Stream_Write_UINT16(out, PAKID_CORE_CLIENT_CAPABILITY);
+			Stream_Write_UINT16(out, 2); /* numCapabilities */
+			Stream_Write_UINT16(out, 0); /* Padding */
+			Stream_Write_UINT16(out, CAP_GENERAL_TYPE);
+			Stream_Write_UINT16(out, 44); /* CapabilityLength */
+			Stream_Write_UINT32(out, GENERAL_CAPABILITY_VERSION_02);
+			Stream_Write_UINT32(out, 0); /* osType */
+			Stream_Write_UINT32(out, 0); /* osVersion */
+			Stream_Write_UINT16(out, 1); /* protocolMajorVersion */
+			Stream_Write_UINT16(out, 0x000C); /* protocolMinorVersion */
+			Stream_Write_UINT32(out, 0x0000FFFF); /* ioCode1 */
+			Stream_Write_UINT32(out, 0); /* ioCode2 */
+			Stream_Write_UINT32(out, RDPDR_DEVICE_REMOVE_PDUS | RDPDR_CLIENT_DISPLAY_NAME_PDU); /* extendedPdu */
+			Stream_Write_UINT32(out, 0); /* extraFlags1 */
+			Stream_Write_UINT32(out, 0); /* extraFlags2 */
+			Stream_Write_UINT32(out, 0); /* SpecialTypeDeviceCap */
+			Stream_Write_UINT16(out, CAP_DRIVE_TYPE);
+			Stream_Write_UINT16(out, 8); /* CapabilityLength */
+			Stream_Write_UINT32(out, DRIVE_CAPABILITY_VERSION_02);
+			test_client_send(out);
+			break;
+
+		case PAKID_CORE_CLIENTID_CONFIRM:
+			DeviceDataLength = (UINT32) Stream_GetPosition(g_Device->data);
+
+			Stream_Write_UINT16(out, RDPDR_CTYP_CORE);
+			Stream_Write_UINT16(out, PAKID_CORE_DEVICELIST_ANNOUNCE);
+			Stream_Write_UINT32(out, 1); /* DeviceCount */
+			Stream_Write_UINT32(out, g_Device->type);
+			Stream_Write_UINT32(out, g_Device->id);
+			Stream_Write(out, "TEST\0\0\0\0", 8); /* PreferredDosName */
+			Stream_Write_UINT32(out, DeviceDataLength);
+			Stream_Write(out, Stream_Buffer(g_Device->data), DeviceDataLength);
+			test_client_send(out);
+			break;
+
+		case PAKID_CORE_DEVICE_IOREQUEST:
+			test_client_irp_request(s);
+			break;
+
+		default:
+			break;
+	}
+
+	Stream_Free(out, TRUE);
+}
+
+static HANDLE WINAPI test_channel_open(HANDLE hServer, DWORD SessionId, LPSTR pVirtualName)
+{
+	return (HANDLE) g_ServerQueue;
+}
+
+static BOOL WINAPI test_channel_close(HANDLE hChannelHandle)
+{
+	return TRUE;
+}
+
+static BOOL WINAPI test_channel_read(HANDLE hChannelHandle, ULONG TimeOut, PCHAR Buffer, ULONG BufferSize, PULONG pBytesRead)
+{
+	wMessage message;
+
+	if (!MessageQueue_Peek(g_ServerQueue, &message, FALSE))
+	{
+		*pBytesRead = 0;
+		return FALSE;
+	}
+
+	*pBytesRead = (ULONG) (size_t) message.lParam;
+
+	if (!Buffer || !BufferSize)
+		return TRUE;
+
+	if (*pBytesRead > BufferSize)
+		return FALSE;
+
+	CopyMemory(Buffer, message.wParam, *pBytesRead);
+	MessageQueue_Peek(g_ServerQueue, &message, TRUE);
+	free(message.wParam);
+
+	return TRUE;
+}
+
+static BOOL WINAPI test_channel_write(HANDLE hChannelHandle, PCHAR Buffer, ULONG Length, PULONG pBytesWritten)
+{
+	wStream* s;
+
+	s = Stream_New((BYTE*) Buffer, Length);
+
+	if (!s)
+		return FALSE;
+
+	test_client_receive(s);
+	Stream_Free(s, FALSE);
+
+	*pBytesWritten = Length;
+
+	return TRUE;
+}
+
+static BOOL WINAPI test_channel_query(HANDLE hChannelHandle, WTS_VIRTUAL_CLASS WtsVirtualClass, PVOID* ppBuffer, DWORD* pBytesReturned)
+{
+	HANDLE event;
+
+	if (WtsVirtualClass != WTSVirtualEventHandle)
+		return FALSE;
+
+	event = MessageQueue_Event(g_ServerQueue);
+	*ppBuffer = malloc(sizeof(HANDLE));
+
+	if (!*ppBuffer)
+		return FALSE;
+
+	CopyMemory(*ppBuffer, &event, sizeof(HANDLE));
+	*pBytesReturned = sizeof(HANDLE);
+
+	return TRUE;
+}
+
+static VOID WINAPI test_free_memory(PVOID pMemory)
+{
+	free(pMemory);
+}
+
+static WtsApiFunctionTable g_TestWtsApi;
+
+static void test_register_device(DEVMAN* devman, DEVICE* device)
+{
+	device->id = devman->id_sequence++;
+	g_Device = device;
+}
+
+static int test_on_device_announce(RdpdrServerContext* context, RDPDR_SERVER_DEVICE* device)
+{
+	if (device->DeviceType == RDPDR_DTYP_FILESYSTEM)
+	{
+		g_DeviceId = device->DeviceId;
+		SetEvent(g_AnnounceEvent);
+	}
+
+	return 0;
+}
+
+static int test_on_device_remove(RdpdrServerContext* context, RDPDR_SERVER_DEVICE* device)
+{
+	g_RemovedDeviceId = device->DeviceId;
+	InterlockedIncrement(&g_RemoveCount);
+	SetEvent(g_RemoveEvent);
+
+	return 0;
+}
+
+static void test_client_send_device_remove(UINT32 DeviceCount, const UINT32* DeviceIds, int count)
+{
+	int index;
+	wStream* s;
+
+	s = Stream_New(NULL, 64);
+
+	if (!s)
+		return;
+
+	Stream_Write_UINT16(s, RDPDR_CTYP_CORE); /* Component (2 bytes) */
+	Stream_Write_UINT16(s, PAKID_CORE_DEVICELIST_REMOVE); /* PacketId (2 bytes) */
+	Stream_Write_UINT32(s, DeviceCount); /* DeviceCount (4 bytes) */
+
+	for (index = 0; index < count; index++)
+		Stream_Write_UINT32(s, DeviceIds[index]); /* DeviceId (4 bytes) */
+
+	test_client_send(s);
+	Stream_Free(s, TRUE);
+}
+
+/**
+ * Waits for the completion of the IRP, returns its status and keeps the
+ * handle for the caller to look at the results and free it.
+ */
+
+static UINT32 test_wait(RDPDR_SERVER_IRP* irp)
+{
+	if (!irp)
+		return STATUS_UNSUCCESSFUL;
+
+	if (WaitForSingleObject(irp->CompletionEvent, 30000) != WAIT_OBJECT_0)
+		return STATUS_UNSUCCESSFUL;
+
+	return irp->IoStatus;
+}
+
+static UINT32 test_open(RdpdrServerContext* context, const char* path, UINT32 CreateDisposition, UINT32 CreateOptions)
+{
+	UINT32 FileId = 0;
+	RDPDR_SERVER_IRP* irp;
+
+	irp = context->DriveCreate(context, g_DeviceId, path, GENERIC_READ | GENERIC_WRITE,
+			CreateDisposition, CreateOptions);
+
+	if (test_wait(irp) == STATUS_SUCCESS)
+		FileId = irp->FileId;
+
+	context->FreeIrp(context, irp);
+
+	return FileId;
+}
+
+static BOOL test_close(RdpdrServerContext* context, UINT32 FileId)
+{
+	UINT32 status;
+	RDPDR_SERVER_IRP* irp;
+
+	irp = context->DriveClose(context, g_DeviceId, FileId);
+	status = test_wait(irp);
+	context->FreeIrp(context, irp);
+
+	return (status == STATUS_SUCCESS) ? TRUE : FALSE;
+}
+
+static double test_rate(double amount, UINT64 start)
+{
+	UINT64 elapsed = GetTickCount64() - start;
+
+	if (!elapsed)
+		elapsed = 1;
+
+	return amount / ((double) elapsed / 1000.0);
+}
+
+static BOOL test_read_check(RdpdrServerContext* context, RDPDR_SERVER_IRP* irp, const BYTE* block)
+{
+	BOOL success;
+
+	success = ((test_wait(irp) == STATUS_SUCCESS) && (irp->Length == TEST_BLOCK_SIZE) &&
+			(memcmp(irp->Buffer, block, TEST_BLOCK_SIZE) == 0)) ? TRUE : FALSE;
+
+	context->FreeIrp(context, irp);
+
+	return success;
+}
+
+/**
+ * Reads the file block by block, either waiting for each read before
+ * sending the next one, or with all the reads of a pass in flight.
+ */
+
+static double test_read_throughput(RdpdrServerContext* context, UINT32 FileId, const BYTE* block, BOOL pipelined)
+{
+	int pass;
+	int index;
+	UINT64 start;
+	BOOL success = TRUE;
+	RDPDR_SERVER_IRP* irps[TEST_BLOCK_COUNT];
+
+	start = GetTickCount64();
+
+	for (pass = 0; pass < TEST_READ_PASSES; pass++)
+	{
+		for (index = 0; index < TEST_BLOCK_COUNT; index++)
+		{
+			irps[index] = context->DriveRead(context, g_DeviceId, FileId,
+					TEST_BLOCK_SIZE, (UINT64) index * TEST_BLOCK_SIZE);
+
+			if (!pipelined && !test_read_check(context, irps[index], block))
+				success = FALSE;
+		}
+
+		if (!pipelined)
+			continue;
+
+		for (index = 0; index < TEST_BLOCK_COUNT; index++)
+		{
+			if (!test_read_check(context, irps[index], block))
+				success = FALSE;
+		}
+	}
+
+	if (!success)
+		return -1.0;
+
+	return test_rate((double) TEST_BLOCK_COUNT * TEST_READ_PASSES * TEST_BLOCK_SIZE / (1024.0 * 1024.0), start);
+}
+
+/**
+ * Device list removals whose count does not match their length, including
+ * one whose size overflows 32 bits, are dropped without reading past their
+ * end. A valid one then removes the drive.
+ */
+
+static int test_device_remove(RdpdrServerContext* context)
+{
+	UINT32 FileId;
+	UINT32 DeviceIds[2];
+
+	DeviceIds[0] = 0xFFFFFFFF;
+	DeviceIds[1] = g_DeviceId;
+
+	test_client_send_device_remove(2, &DeviceIds[1], 1);
+	test_client_send_device_remove(0x40000001, &DeviceIds[1], 1);
+
+	/* the server handles the client PDUs in order, an IRP completes after them */
+
+	FileId = test_open(context, "\\bench.bin", FILE_OPEN, FILE_NON_DIRECTORY_FILE);
+
+	if (!FileId || !test_close(context, FileId))
+		return -1;
+
+	if (g_RemoveCount != 0)
+	{
+		printf("a malformed device list removal was processed\n");
+		return -1;
+	}
+
+	test_client_send_device_remove(2, DeviceIds, 2);
+
+	if (WaitForSingleObject(g_RemoveEvent, 30000) != WAIT_OBJECT_0)
+	{
+		printf("the drive was not removed\n");
+		return -1;
+	}
+
+	if ((g_RemoveCount != 1) || (g_RemovedDeviceId != g_DeviceId))
+	{
+		printf("unexpected device list removal\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+static int test_server_irps(RdpdrServerContext* context)
+{
+	int index;
+	int entries;
+	UINT32 FileId;
+	UINT32 DirId;
+	UINT64 EndOfFile;
+	BYTE* block;
+	double sequential;
+	double pipelined;
+	int status = -1;
+	RDPDR_SERVER_IRP* irp;
+	RDPDR_SERVER_IRP* irps[TEST_BLOCK_COUNT];
+
+	block = (BYTE*) malloc(TEST_BLOCK_SIZE);
+
+	if (!block)
+		return -1;
+
+	for (index = 0; index < TEST_BLOCK_SIZE; index++)
+		block[index] = (BYTE) (index * 7);
+
+	FileId = test_open(context, "\\bench.bin", FILE_OVERWRITE_IF, FILE_NON_DIRECTORY_FILE);
+
+	if (!FileId)
+	{
+		printf("failed to create the benchmark file\n");
+		goto out;
+	}
+
+	/* writes to independent offsets, all in flight */
+
+	for (index = 0; index < TEST_BLOCK_COUNT; index++)
+	{
+		irps[index] = context->DriveWrite(context, g_DeviceId, FileId, block,
+				TEST_BLOCK_SIZE, (UINT64) index * TEST_BLOCK_SIZE);
+	}
+
+	for (index = 0; index < TEST_BLOCK_COUNT; index++)
+	{
+		if ((test_wait(irps[index]) != STATUS_SUCCESS) || (irps[index]->Length != TEST_BLOCK_SIZE))
+			FileId = 0;
+
+		context->FreeIrp(context, irps[index]);
+	}
+
+	if (!FileId)
+	{
+		printf("failed to write the benchmark file\n");
+		goto out;
+	}
+
+	irp = context->DriveQueryInformation(context, g_DeviceId, FileId, FileStandardInformation);
+	EndOfFile = 0;
+
+	if ((test_wait(irp) == STATUS_SUCCESS) && (irp->Length >= 16))
+		CopyMemory(&EndOfFile, &irp->Buffer[8], 8);
+
+	context->FreeIrp(context, irp);
+
+	if (EndOfFile != (UINT64) TEST_BLOCK_COUNT * TEST_BLOCK_SIZE)
+	{
+		printf("unexpected file size: %d\n", (int) EndOfFile);
+		goto out;
+	}
+
+	/* reading past the end of the file returns no data */
+
+	irp = context->DriveRead(context, g_DeviceId, FileId, TEST_BLOCK_SIZE, EndOfFile);
+
+	if ((test_wait(irp) != STATUS_SUCCESS) || irp->Length)
+	{
+		context->FreeIrp(context, irp);
+		goto out;
+	}
+
+	context->FreeIrp(context, irp);
+
+	sequential = test_read_throughput(context, FileId, block, FALSE);
+	pipelined = test_read_throughput(context, FileId, block, TRUE);
+
+	if ((sequential < 0.0) || (pipelined < 0.0))
+	{
+		printf("failed to read the benchmark file\n");
+		goto out;
+	}
+
+	printf("read (one IRP at a time): %10.1f MB/s\n", sequential);
+	printf("read (pipelined):         %10.1f MB/s\n", pipelined);
+
+	/* a pending IRP may be released before its completion */
+
+	context->FreeIrp(context, context->DriveRead(context, g_DeviceId, FileId, TEST_BLOCK_SIZE, 0));
+
+	DirId = test_open(context, "\\listing", FILE_OPEN, FILE_DIRECTORY_FILE);
+
+	if (!DirId)
+		goto out;
+
+	for (entries = 0; entries < TEST_DIR_ENTRIES * 2; entries++)
+	{
+		irp = context->DriveQueryDirectory(context, g_DeviceId, DirId,
+				FileDirectoryInformation, entries ? FALSE : TRUE, "\\*");
+		status = test_wait(irp);
+		context->FreeIrp(context, irp);
+
+		if (status == STATUS_NO_MORE_FILES)
+			break;
+
+		if (status != STATUS_SUCCESS)
+			break;
+	}
+
+	status = -1;
+
+	/* the listing includes the . and .. entries */
+
+	if (entries != TEST_DIR_ENTRIES + 2)
+	{
+		printf("unexpected directory listing: %d entries\n", entries);
+		goto out;
+	}
+
+	if (!test_close(context, DirId) || !test_close(context, FileId))
+		goto out;
+
+	/* the file id is gone once the file is closed */
+
+	if (test_close(context, FileId))
+		goto out;
+
+	status = 0;
+
+out:
+	free(block);
+
+	return status;
+}
+
+int TestRdpdrServerIrp(int argc, char* argv[])
+{
+	FILE* fp;
+	int index;
+	int status = -1;
+	char name[64];
+	char* path;
+	char* listing;
+	char* filename;
+	wMessage message;
+	RDPDR_DRIVE drive;
+	RdpdrServerContext* context;
+	DEVICE_SERVICE_ENTRY_POINTS entryPoints;
+
+	path = GetKnownSubPath(KNOWN_PATH_TEMP, "TestRdpdrServerIrp");
+
+	if (!path)
+		return -1;
+
+	if (!PathFileExistsA(path))
+		CreateDirectoryA(path, NULL);
+
+	listing = GetCombinedPath(path, "listing");
+
+	if (!PathFileExistsA(listing))
+		CreateDirectoryA(listing, NULL);
+
+	for (index = 0; index < TEST_DIR_ENTRIES; index++)
+	{
+		sprintf_s(name, sizeof(name), "file%05d.txt", index);
+		filename = GetCombinedPath(listing, name);
+		fp = fopen(filename, "wb");
+		free(filename);
+
+		if (fp)
+			fclose(fp);
+	}
+
+	g_ServerQueue = MessageQueue_New(NULL);
+	g_AnnounceEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+	g_RemoveEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+	ZeroMemory(&g_TestWtsApi, sizeof(WtsApiFunctionTable));
+	g_TestWtsApi.pVirtualChannelOpen = test_channel_open;
+	g_TestWtsApi.pVirtualChannelClose = test_channel_close;
+	g_TestWtsApi.pVirtualChannelRead = test_channel_read;
+	g_TestWtsApi.pVirtualChannelWrite = test_channel_write;
+	g_TestWtsApi.pVirtualChannelQuery = test_channel_query;
+	g_TestWtsApi.pFreeMemory = test_free_memory;
+	WTSRegisterWtsApiFunctionTable(&g_TestWtsApi);
+
+	ZeroMemory(&g_Devman, sizeof(DEVMAN));
+	g_Devman.id_sequence = 1;
+
+	ZeroMemory(&drive, sizeof(RDPDR_DRIVE));
+	drive.Type = RDPDR_DTYP_FILESYSTEM;
+	drive.Name = "test";
+	drive.Path = path;
+
+	ZeroMemory(&entryPoints, sizeof(DEVICE_SERVICE_ENTRY_POINTS));
+	entryPoints.devman = &g_Devman;
+	entryPoints.RegisterDevice = test_register_device;
+	entryPoints.device = (RDPDR_DEVICE*) &drive;
+
+	drive_DeviceServiceEntry(&entryPoints);
+
+	if (!g_Device)
+		return -1;
+
+	context = rdpdr_server_context_new(NULL);
+
+	if (!context)
+		return -1;
+
+	context->OnDeviceAnnounce = test_on_device_announce;
+	context->OnDeviceRemove = test_on_device_remove;
+
+	if (context->Start(context) < 0)
+		return -1;
+
+	if (WaitForSingleObject(g_AnnounceEvent, 30000) == WAIT_OBJECT_0)
+	{
+		status = test_server_irps(context);
+
+		if (status == 0)
+			status = test_device_remove(context);
+	}
+	else
+		printf("the drive was not announced\n");
+
+	context->Stop(context);
+	rdpdr_server_context_free(context);
+
+	g_Device->Free(g_Device);
+
+	for (index = 0; index < TEST_DIR_ENTRIES; index++)
+	{
+		sprintf_s(name, sizeof(name), "file%05d.txt", index);
+		filename = GetCombinedPath(listing, name);
+		DeleteFileA(filename);
+		free(filename);
+	}
+
+	filename = GetCombinedPath(path, "bench.bin");
+	DeleteFileA(filename);
+	free(filename);
+
+	free(listing);
+	free(path);
+
+	CloseHandle(g_AnnounceEvent);
+	CloseHandle(g_RemoveEvent);
+
+	while (MessageQueue_Peek(g_ServerQueue, &message, TRUE))
+		free(message.wParam);
+
+	MessageQueue_Free(g_ServerQueue);
+
+	return status;
+}
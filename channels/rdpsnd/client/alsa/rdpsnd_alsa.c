@@ -29,6 +29,7 @@
 #include <winpr/crt.h>
 #include <winpr/cmdline.h>
 #include <winpr/sysinfo.h>
+#include <winpr/interlocked.h>
 #include <winpr/collections.h>
 
 #include <alsa/asoundlib.h>
@@ -54,6 +55,7 @@ struct rdpsnd_alsa_plugin
 	UINT32 source_rate;
 	UINT32 actual_rate;
 	UINT32 wLocalTimeClose;
+	volatile LONG playout_end;
 	snd_pcm_format_t format;
 	UINT32 source_channels;
 	UINT32 actual_channels;
@@ -315,6 +317,7 @@ static void rdpsnd_alsa_open(rdpsndDevicePlugin* device, AUDIO_FORMAT* format, i
 	else
 	{
 		freerdp_dsp_context_reset_adpcm(alsa->dsp_context);
+		freerdp_dsp_context_reset_resampler(alsa->dsp_context);
 		rdpsnd_alsa_set_format(device, format, latency);
 		rdpsnd_alsa_open_mixer(alsa);
 	}
@@ -339,6 +342,36 @@ static void rdpsnd_alsa_close(rdpsndDevicePlugin* device)
 	alsa->wLocalTimeClose += (((frames * 1000) / alsa->actual_rate) / alsa->actual_channels);
 }
 
+/**
+ * The device delay is sampled on the channel thread after each write, which
+ * also owns pcm_handle, and published as the tick at which playout ends.
+ * GetPlayoutTime only reads that tick, so it never touches the handle.
+ */
+
+static void rdpsnd_alsa_update_playout(rdpsndAlsaPlugin* alsa)
+{
+	snd_pcm_sframes_t delay = 0;
+	DWORD playout = 0;
+
+	if (alsa->pcm_handle && alsa->actual_rate)
+	{
+		if ((snd_pcm_delay(alsa->pcm_handle, &delay) == 0) && (delay > 0))
+			playout = (DWORD) ((((UINT64) delay) * 1000) / alsa->actual_rate);
+	}
+
+	InterlockedExchange(&alsa->playout_end, (LONG) (GetTickCount() + playout));
+}
+
+static UINT32 rdpsnd_alsa_get_playout_time(rdpsndDevicePlugin* device)
+{
+	LONG remaining;
+	rdpsndAlsaPlugin* alsa = (rdpsndAlsaPlugin*) device;
+
+	remaining = (LONG) ((DWORD) alsa->playout_end - GetTickCount());
+
+	return (remaining > 0) ? (UINT32) remaining : 0;
+}
+
 static void rdpsnd_alsa_free(rdpsndDevicePlugin* device)
 {
 	rdpsndAlsaPlugin* alsa = (rdpsndAlsaPlugin*) device;
@@ -591,7 +624,12 @@ static void rdpsnd_alsa_wave_play(rdpsndDevicePlugin* device, RDPSND_WAVE* wave)
 
 	free(data);
 
-	snd_pcm_htimestamp(alsa->pcm_handle, &frames, &tstamp);
+	rdpsnd_alsa_update_playout(alsa);
+
+	frames = 0;
+
+	if (alsa->pcm_handle)
+		snd_pcm_htimestamp(alsa->pcm_handle, &frames, &tstamp);
 
 	wave->wPlaybackDelay = ((frames * 1000) / alsa->actual_rate);
 
@@ -663,6 +701,7 @@ int freerdp_rdpsnd_client_subsystem_entry(PFREERDP_RDPSND_DEVICE_ENTRY_POINTS pE
 	alsa->device.WavePlay = rdpsnd_alsa_wave_play;
 	alsa->device.Close = rdpsnd_alsa_close;
 	alsa->device.Free = rdpsnd_alsa_free;
+	alsa->device.GetPlayoutTime = rdpsnd_alsa_get_playout_time;
 
 	args = pEntryPoints->args;
 	rdpsnd_alsa_parse_addin_args((rdpsndDevicePlugin*) alsa, args);
@@ -677,6 +716,7 @@ int freerdp_rdpsnd_client_subsystem_entry(PFREERDP_RDPSND_DEVICE_ENTRY_POINTS pE
 	alsa->source_channels = 2;
 	alsa->actual_channels = 2;
 	alsa->bytes_per_channel = 2;
+	alsa->playout_end = (LONG) GetTickCount();
 
 	alsa->dsp_context = freerdp_dsp_context_new();
 
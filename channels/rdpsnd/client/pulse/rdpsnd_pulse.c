@@ -324,6 +324,7 @@ static void rdpsnd_pulse_open(rdpsndDevicePlugin* device, AUDIO_FORMAT* format,
 	if (state == PA_STREAM_READY)
 	{
 		freerdp_dsp_context_reset_adpcm(pulse->dsp_context);
+		freerdp_dsp_context_reset_resampler(pulse->dsp_context);
 
 #ifdef WITH_GSM
 		if (pulse->gsm_context)
@@ -574,6 +575,25 @@ static void rdpsnd_pulse_play(rdpsndDevicePlugin* device, BYTE* data, int size)
 	pa_threaded_mainloop_unlock(pulse->mainloop);
 }
 
+static UINT32 rdpsnd_pulse_get_playout_time(rdpsndDevicePlugin* device)
+{
+	int negative;
+	pa_usec_t latency;
+	rdpsndPulsePlugin* pulse = (rdpsndPulsePlugin*) device;
+
+	if (!pulse->mainloop)
+		return 0;
+
+	pa_threaded_mainloop_lock(pulse->mainloop);
+
+	if (!pulse->stream || (pa_stream_get_latency(pulse->stream, &latency, &negative) < 0) || negative)
+		latency = 0;
+
+	pa_threaded_mainloop_unlock(pulse->mainloop);
+
+	return (UINT32) (latency / 1000);
+}
+
 static void rdpsnd_pulse_start(rdpsndDevicePlugin* device)
 {
 	rdpsndPulsePlugin* pulse = (rdpsndPulsePlugin*) device;
@@ -644,6 +664,7 @@ int freerdp_rdpsnd_client_subsystem_entry(PFREERDP_RDPSND_DEVICE_ENTRY_POINTS pE
 	pulse->device.Start = rdpsnd_pulse_start;
 	pulse->device.Close = rdpsnd_pulse_close;
 	pulse->device.Free = rdpsnd_pulse_free;
+	pulse->device.GetPlayoutTime = rdpsnd_pulse_get_playout_time;
 
 	args = pEntryPoints->args;
 	rdpsnd_pulse_parse_addin_args((rdpsndDevicePlugin*) pulse, args);
@@ -49,8 +49,7 @@
 #include <freerdp/utils/signal.h>
 
 #include "rdpsnd_main.h"
-
-#define TIME_DELAY_MS	65
+#include "rdpsnd_scheduler.h"
 
 struct rdpsnd_plugin
 {
@@ -66,6 +65,7 @@ struct rdpsnd_plugin
 	wLog* log;
 	HANDLE stopEvent;
 	HANDLE ScheduleThread;
+	RDPSND_SCHEDULER* scheduler;
 
 	BYTE cBlockNo;
 	UINT16 wQualityMode;
@@ -97,41 +97,38 @@ struct rdpsnd_plugin
 
 static void rdpsnd_confirm_wave(rdpsndPlugin* rdpsnd, RDPSND_WAVE* wave);
 
+static void rdpsnd_scheduler_confirm(void* context, RDPSND_WAVE* wave)
+{
+	rdpsnd_confirm_wave((rdpsndPlugin*) context, wave);
+}
+
+/**
+ * Confirms waves as the device plays them out, waking up when a wave is
+ * handed to the device or when the next one is due to have been played.
+ */
+
 static void* rdpsnd_schedule_thread(void* arg)
 {
-	wMessage message;
-	UINT16 wTimeDiff;
-	UINT16 wTimeStamp;
-	UINT16 wCurrentTime;
-	RDPSND_WAVE* wave;
-	rdpsndPlugin* rdpsnd = (rdpsndPlugin*) arg;
+	DWORD status;
+	DWORD timeout;
 	HANDLE events[2];
+	rdpsndPlugin* rdpsnd = (rdpsndPlugin*) arg;
 
-	events[0] = MessageQueue_Event(rdpsnd->MsgPipe->Out);
-	events[1] = rdpsnd->stopEvent;
+	events[0] = rdpsnd->stopEvent;
+	events[1] = rdpsnd->scheduler->event;
 
-	while (WaitForMultipleObjects(2, events, FALSE, INFINITE) == WAIT_OBJECT_0)
+	timeout = INFINITE;
+
+	while (1)
 	{
-		if (!MessageQueue_Peek(rdpsnd->MsgPipe->Out, &message, TRUE))
-			break;
+		status = WaitForMultipleObjects(2, events, FALSE, timeout);
 
-		if (message.id == WMQ_QUIT)
+		if ((status != WAIT_OBJECT_0 + 1) && (status != WAIT_TIMEOUT))
 			break;
 
-		wave = (RDPSND_WAVE*) message.wParam;
-		wCurrentTime = (UINT16) GetTickCount();
-		wTimeStamp = wave->wLocalTimeB;
-
-		if (wCurrentTime <= wTimeStamp)
-		{
-			wTimeDiff = wTimeStamp - wCurrentTime;
-			Sleep(wTimeDiff);
-		}
+		ResetEvent(rdpsnd->scheduler->event);
 
-		rdpsnd_confirm_wave(rdpsnd, wave);
-
-		message.wParam = NULL;
-		free(wave);
+		timeout = rdpsnd_scheduler_poll(rdpsnd->scheduler, rdpsnd_scheduler_confirm, (void*) rdpsnd);
 	}
 
 	ExitThread(0);
@@ -390,6 +387,9 @@ static void rdpsnd_recv_wave_info_pdu(rdpsndPlugin* rdpsnd, wStream* s, UINT16 B
 		{
 			IFCALL(rdpsnd->device->Open, rdpsnd->device, format, rdpsnd->latency);
 		}
+
+		if (rdpsnd->scheduler)
+			rdpsnd_scheduler_open(rdpsnd->scheduler, rdpsnd->latency);
 	}
 	else if (wFormatNo != rdpsnd->wCurrentFormatNo)
 	{
@@ -427,10 +427,7 @@ void rdpsnd_confirm_wave(rdpsndPlugin* rdpsnd, RDPSND_WAVE* wave)
 
 static void rdpsnd_device_send_wave_confirm_pdu(rdpsndDevicePlugin* device, RDPSND_WAVE* wave)
 {
-	if (device->DisableConfirmThread)
-		rdpsnd_confirm_wave(device->rdpsnd, wave);
-	else
-		MessageQueue_Post(device->rdpsnd->MsgPipe->Out, NULL, 0, (void*) wave, NULL);
+	rdpsnd_confirm_wave(device->rdpsnd, wave);
 }
 
 static void rdpsnd_recv_wave_pdu(rdpsndPlugin* rdpsnd, wStream* s)
@@ -454,7 +451,39 @@ static void rdpsnd_recv_wave_pdu(rdpsndPlugin* rdpsnd, wStream* s)
 	data = Stream_Buffer(s);
 	size = (int) Stream_Capacity(s);
 
-	wave = (RDPSND_WAVE*) malloc(sizeof(RDPSND_WAVE));
+	format = &rdpsnd->ClientFormats[rdpsnd->wCurrentFormatNo];
+
+	WLog_Print(rdpsnd->log, WLOG_DEBUG, "Wave: cBlockNo: %d wTimeStamp: %d",
+			rdpsnd->cBlockNo, rdpsnd->wTimeStamp);
+
+	if (rdpsnd->scheduler)
+	{
+		/* played by the channel thread and confirmed once played out */
+
+		wave = rdpsnd_scheduler_queue(rdpsnd->scheduler, format, data, size);
+
+		if (wave)
+		{
+			wave->wTimeStampA = rdpsnd->wTimeStamp;
+			wave->wFormatNo = rdpsnd->wCurrentFormatNo;
+			wave->cBlockNo = rdpsnd->cBlockNo;
+			return;
+		}
+
+		/**
+		 * The wave cannot be held until it is played: drop it without
+		 * confirming it, rather than report audio that was never heard.
+		 */
+
+		WLog_Print(rdpsnd->log, WLOG_WARN, "Wave: cBlockNo: %d dropped, too many waves queued",
+				rdpsnd->cBlockNo);
+		return;
+	}
+
+	wave = (RDPSND_WAVE*) calloc(1, sizeof(RDPSND_WAVE));
+
+	if (!wave)
+		return;
 
 	wave->wLocalTimeA = GetTickCount();
 	wave->wTimeStampA = rdpsnd->wTimeStamp;
@@ -464,13 +493,8 @@ static void rdpsnd_recv_wave_pdu(rdpsndPlugin* rdpsnd, wStream* s)
 	wave->data = data;
 	wave->length = size;
 	wave->AutoConfirm = TRUE;
-
-	format = &rdpsnd->ClientFormats[rdpsnd->wCurrentFormatNo];
 	wave->wAudioLength = rdpsnd_compute_audio_time_length(format, size);
 
-	WLog_Print(rdpsnd->log, WLOG_DEBUG, "Wave: cBlockNo: %d wTimeStamp: %d",
-			wave->cBlockNo, wave->wTimeStampA);
-
 	if (!rdpsnd->device)
 	{
 		wave->wLocalTimeB = wave->wLocalTimeA;
@@ -480,34 +504,25 @@ static void rdpsnd_recv_wave_pdu(rdpsndPlugin* rdpsnd, wStream* s)
 		return;
 	}
 
-	if (rdpsnd->device->WaveDecode)
-	{
-		IFCALL(rdpsnd->device->WaveDecode, rdpsnd->device, wave);
-	}
+	/* the device plays and confirms waves from its own callbacks, and frees them */
 
-	if (rdpsnd->device->WavePlay)
-	{
-		IFCALL(rdpsnd->device->WavePlay, rdpsnd->device, wave);
-	}
-	else
-	{
-		IFCALL(rdpsnd->device->Play, rdpsnd->device, data, size);
-	}
-
-	if (!rdpsnd->device->WavePlay)
-	{
-		wave->wTimeStampB = rdpsnd->wTimeStamp + wave->wAudioLength + TIME_DELAY_MS;
-		wave->wLocalTimeB = wave->wLocalTimeA + wave->wAudioLength + TIME_DELAY_MS;
-	}
+	IFCALL(rdpsnd->device->WaveDecode, rdpsnd->device, wave);
+	IFCALL(rdpsnd->device->WavePlay, rdpsnd->device, wave);
 
 	if (wave->AutoConfirm)
+	{
 		rdpsnd->device->WaveConfirm(rdpsnd->device, wave);
+		free(wave);
+	}
 }
 
 static void rdpsnd_recv_close_pdu(rdpsndPlugin* rdpsnd)
 {
 	WLog_Print(rdpsnd->log, WLOG_DEBUG, "Close");
 
+	if (rdpsnd->scheduler)
+		rdpsnd_scheduler_flush(rdpsnd->scheduler);
+
 	if (rdpsnd->device)
 	{
 		IFCALL(rdpsnd->device->Close, rdpsnd->device);
@@ -803,6 +818,14 @@ static void rdpsnd_process_connect(rdpsndPlugin* rdpsnd)
 
 	if (!rdpsnd->device->DisableConfirmThread)
 	{
+		rdpsnd->scheduler = rdpsnd_scheduler_new(rdpsnd->device, NULL, NULL);
+
+		if (!rdpsnd->scheduler)
+		{
+			WLog_ERR(TAG, "failed to create the playout scheduler");
+			return;
+		}
+
 		rdpsnd->stopEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
 		rdpsnd->ScheduleThread = CreateThread(NULL, 0,
 			(LPTHREAD_START_ROUTINE) rdpsnd_schedule_thread,
@@ -818,7 +841,12 @@ static void rdpsnd_process_disconnect(rdpsndPlugin* rdpsnd)
 		WaitForSingleObject(rdpsnd->ScheduleThread, INFINITE);
 		CloseHandle(rdpsnd->ScheduleThread);
 		CloseHandle(rdpsnd->stopEvent);
+		rdpsnd->ScheduleThread = NULL;
+		rdpsnd->stopEvent = NULL;
 	}
+
+	rdpsnd_scheduler_free(rdpsnd->scheduler);
+	rdpsnd->scheduler = NULL;
 }
 
 /****************************************************************************************/
@@ -972,6 +1000,8 @@ static VOID VCAPITYPE rdpsnd_virtual_channel_open_event(DWORD openHandle, UINT e
 
 static void* rdpsnd_virtual_channel_client_thread(void* arg)
 {
+	DWORD status;
+	DWORD timeout;
 	wStream* data;
 	wMessage message;
 	rdpsndPlugin* rdpsnd = (rdpsndPlugin*) arg;
@@ -980,7 +1010,19 @@ static void* rdpsnd_virtual_channel_client_thread(void* arg)
 
 	while (1)
 	{
-		if (!MessageQueue_Wait(rdpsnd->MsgPipe->In))
+		/* hand held waves to the device once their prefill is over */
+
+		timeout = INFINITE;
+
+		if (rdpsnd->scheduler)
+			timeout = rdpsnd_scheduler_release(rdpsnd->scheduler);
+
+		status = WaitForSingleObject(MessageQueue_Event(rdpsnd->MsgPipe->In), timeout);
+
+		if (status == WAIT_TIMEOUT)
+			continue;
+
+		if (status != WAIT_OBJECT_0)
 			break;
 
 		if (MessageQueue_Peek(rdpsnd->MsgPipe->In, &message, TRUE))
@@ -0,0 +1,460 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Audio Output Virtual Channel - Playout Scheduler
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+#include <winpr/sysinfo.h>
+
+#include "rdpsnd_scheduler.h"
+
+/**
+ * Playout Scheduler
+ *
+ * Positions in the audio stream are kept in microseconds of audio handed to
+ * the device, accumulated from exact frame counts so that they do not drift
+ * over long sessions. The device reports how much of what it was given is
+ * still to be played (GetPlayoutTime), which places the playout position
+ * within the stream; a wave is confirmed once that position passes its last
+ * sample, with a timestamp corrected by how far it has been passed.
+ *
+ * Waves are held back after the device is opened or runs dry, until enough
+ * audio to cover the target latency is queued. The target follows the
+ * arrival jitter of the waves and is raised for a while after an underrun.
+ *
+ * All times come from a monotonic 64-bit millisecond clock.
+ */
+
+static UINT64 rdpsnd_scheduler_tick_count(void* context)
+{
+	return GetTickCount64();
+}
+
+static UINT32 rdpsnd_scheduler_frames(AUDIO_FORMAT* format, int length)
+{
+	UINT16 nSamplesPerBlock;
+
+	if (format->wFormatTag == WAVE_FORMAT_PCM)
+	{
+		if (!format->wBitsPerSample || !format->nChannels)
+			return 0;
+
+		return (UINT32) ((length * 8) / (format->wBitsPerSample * format->nChannels));
+	}
+
+	/* ADPCM formats carry the number of samples per block */
+
+	if ((format->cbSize >= 2) && format->data && format->nBlockAlign)
+	{
+		nSamplesPerBlock = *((UINT16*) format->data);
+		return (UINT32) ((length / format->nBlockAlign) * nSamplesPerBlock);
+	}
+
+	return (UINT32) (((UINT64) rdpsnd_compute_audio_time_length(format, length) * format->nSamplesPerSec) / 1000);
+}
+
+static UINT64 rdpsnd_scheduler_duration(RDPSND_SCHEDULER_SLOT* slot)
+{
+	if (!slot->rate)
+		return 0;
+
+	return ((UINT64) slot->frames * 1000000) / slot->rate;
+}
+
+/**
+ * Returns the microseconds of audio handed to the device that it has not
+ * played yet. Without GetPlayoutTime, the device is assumed to play in real
+ * time from the moment it was last given audio while idle.
+ */
+
+static UINT64 rdpsnd_scheduler_pending(RDPSND_SCHEDULER* scheduler, UINT64 now)
+{
+	UINT64 pending;
+	UINT64 elapsed;
+	rdpsndDevicePlugin* device = scheduler->device;
+
+	if (device && device->GetPlayoutTime)
+	{
+		pending = ((UINT64) device->GetPlayoutTime(device)) * 1000;
+	}
+	else
+	{
+		elapsed = (now - scheduler->runStart) * 1000;
+		pending = scheduler->written - scheduler->runPosition;
+		pending = (pending > elapsed) ? (pending - elapsed) : 0;
+	}
+
+	return (pending < scheduler->written) ? pending : scheduler->written;
+}
+
+static void rdpsnd_scheduler_update_target(RDPSND_SCHEDULER* scheduler)
+{
+	UINT32 target;
+
+	target = scheduler->latency + (UINT32) (((scheduler->jitter / 16) * 3) / 1000) + scheduler->penalty;
+
+	if (target < RDPSND_TARGET_LATENCY_MIN)
+		target = RDPSND_TARGET_LATENCY_MIN;
+
+	if (target > RDPSND_TARGET_LATENCY_MAX)
+		target = RDPSND_TARGET_LATENCY_MAX;
+
+	scheduler->target = target;
+}
+
+/**
+ * Interarrival jitter as in RFC 3550 (6.4.1): the deviation of the time
+ * between two waves from the duration of the first, smoothed over 16
+ * waves and kept scaled by 16.
+ */
+
+static void rdpsnd_scheduler_update_jitter(RDPSND_SCHEDULER* scheduler, UINT64 now)
+{
+	INT64 deviation;
+	UINT64 decay;
+
+	if (scheduler->lastArrival)
+	{
+		deviation = (INT64) ((now - scheduler->lastArrival) * 1000) - (INT64) scheduler->lastDuration;
+
+		if (deviation < 0)
+			deviation = -deviation;
+
+		scheduler->jitter += (UINT64) deviation;
+		scheduler->jitter -= scheduler->jitter / 16;
+	}
+
+	/* the underrun penalty wears off by 1 ms per second */
+
+	if (scheduler->penalty && (now - scheduler->penaltyTime >= 1000))
+	{
+		decay = (now - scheduler->penaltyTime) / 1000;
+		scheduler->penalty = (scheduler->penalty > decay) ? (scheduler->penalty - (UINT32) decay) : 0;
+		scheduler->penaltyTime += decay * 1000;
+	}
+
+	rdpsnd_scheduler_update_target(scheduler);
+}
+
+/**
+ * Copies a received wave into the next slot. The caller fills in the wave
+ * header fields before the next call to rdpsnd_scheduler_release.
+ */
+
+RDPSND_WAVE* rdpsnd_scheduler_queue(RDPSND_SCHEDULER* scheduler, AUDIO_FORMAT* format, BYTE* data, int length)
+{
+	UINT64 now;
+	BYTE* buffer;
+	RDPSND_SCHEDULER_SLOT* slot;
+
+	EnterCriticalSection(&scheduler->lock);
+
+	if (scheduler->count >= RDPSND_SCHEDULER_MAX_WAVES)
+	{
+		LeaveCriticalSection(&scheduler->lock);
+		return NULL;
+	}
+
+	slot = &scheduler->slots[(scheduler->head + scheduler->count) % RDPSND_SCHEDULER_MAX_WAVES];
+
+	if (slot->capacity < length)
+	{
+		buffer = (BYTE*) realloc(slot->buffer, length);
+
+		if (!buffer)
+		{
+			LeaveCriticalSection(&scheduler->lock);
+			return NULL;
+		}
+
+		slot->buffer = buffer;
+		slot->capacity = length;
+	}
+
+	now = scheduler->clock(scheduler->clockContext);
+
+	/* the device ran dry: hold waves back again, and for longer */
+
+	if (!scheduler->prefill && (scheduler->played == scheduler->count) && scheduler->written &&
+			!rdpsnd_scheduler_pending(scheduler, now))
+	{
+		scheduler->prefill = TRUE;
+		scheduler->underruns++;
+
+		scheduler->penalty += RDPSND_UNDERRUN_PENALTY;
+
+		if (scheduler->penalty > RDPSND_UNDERRUN_PENALTY_MAX)
+			scheduler->penalty = RDPSND_UNDERRUN_PENALTY_MAX;
+
+		scheduler->penaltyTime = now;
+	}
+
+	if (scheduler->prefill && (scheduler->played == scheduler->count))
+		scheduler->prefillStart = now;
+
+	CopyMemory(slot->buffer, data, length);
+
+	ZeroMemory(&slot->wave, sizeof(RDPSND_WAVE));
+	slot->wave.data = slot->buffer;
+	slot->wave.length = length;
+	slot->wave.wLocalTimeA = (UINT32) now;
+	slot->wave.wAudioLength = (UINT16) rdpsnd_compute_audio_time_length(format, length);
+	slot->wave.AutoConfirm = TRUE;
+
+	slot->frames = rdpsnd_scheduler_frames(format, length);
+	slot->rate = format->nSamplesPerSec;
+	slot->arrival = now;
+	slot->end = 0;
+
+	rdpsnd_scheduler_update_jitter(scheduler, now);
+
+	scheduler->lastArrival = now;
+	scheduler->lastDuration = rdpsnd_scheduler_duration(slot);
+	scheduler->held += scheduler->lastDuration;
+	scheduler->count++;
+
+	LeaveCriticalSection(&scheduler->lock);
+
+	return &slot->wave;
+}
+
+static void rdpsnd_scheduler_deliver(RDPSND_SCHEDULER* scheduler, RDPSND_SCHEDULER_SLOT* slot)
+{
+	RDPSND_WAVE* wave = &slot->wave;
+	rdpsndDevicePlugin* device = scheduler->device;
+
+	if (device->WaveDecode)
+		device->WaveDecode(device, wave);
+
+	if (device->WavePlay)
+		device->WavePlay(device, wave);
+	else if (device->Play)
+		device->Play(device, slot->buffer, slot->wave.length);
+
+	wave->data = NULL;
+}
+
+/**
+ * Hands the queued waves to the device once the prefill is over, on the
+ * thread that owns the device. Returns the number of milliseconds after
+ * which it must be called again if no new wave arrives.
+ */
+
+DWORD rdpsnd_scheduler_release(RDPSND_SCHEDULER* scheduler)
+{
+	UINT64 now;
+	UINT64 total;
+	UINT64 deadline;
+	RDPSND_SCHEDULER_SLOT* slot;
+
+	EnterCriticalSection(&scheduler->lock);
+
+	now = scheduler->clock(scheduler->clockContext);
+
+	if (scheduler->prefill)
+	{
+		if (scheduler->played == scheduler->count)
+		{
+			LeaveCriticalSection(&scheduler->lock);
+			return INFINITE;
+		}
+
+		deadline = scheduler->prefillStart + scheduler->target;
+
+		if ((scheduler->held < (UINT64) scheduler->target * 1000) && (now < deadline))
+		{
+			LeaveCriticalSection(&scheduler->lock);
+			return (DWORD) (deadline - now);
+		}
+
+		scheduler->prefill = FALSE;
+	}
+
+	while (scheduler->played < scheduler->count)
+	{
+		slot = &scheduler->slots[(scheduler->head + scheduler->played) % RDPSND_SCHEDULER_MAX_WAVES];
+
+		if (!rdpsnd_scheduler_pending(scheduler, now))
+		{
+			scheduler->runStart = now;
+			scheduler->runPosition = scheduler->written;
+		}
+
+		LeaveCriticalSection(&scheduler->lock);
+
+		rdpsnd_scheduler_deliver(scheduler, slot);
+
+		EnterCriticalSection(&scheduler->lock);
+
+		if (slot->rate)
+		{
+			total = ((UINT64) slot->frames * 1000000) + scheduler->remainder;
+			scheduler->written += total / slot->rate;
+			scheduler->remainder = total % slot->rate;
+		}
+
+		slot->end = scheduler->written;
+		scheduler->held -= rdpsnd_scheduler_duration(slot);
+		scheduler->played++;
+
+		SetEvent(scheduler->event);
+
+		now = scheduler->clock(scheduler->clockContext);
+	}
+
+	LeaveCriticalSection(&scheduler->lock);
+
+	return INFINITE;
+}
+
+/**
+ * Confirms the waves that have been played out, from the confirmation
+ * thread. Returns the number of milliseconds until the next one is due,
+ * or INFINITE when the device holds none.
+ */
+
+DWORD rdpsnd_scheduler_poll(RDPSND_SCHEDULER* scheduler, RDPSND_CONFIRM_FN fnConfirm, void* context)
+{
+	UINT64 now;
+	UINT64 played;
+	UINT64 position;
+	UINT64 overshoot;
+	RDPSND_WAVE wave;
+	RDPSND_SCHEDULER_SLOT* slot;
+
+	for (;;)
+	{
+		EnterCriticalSection(&scheduler->lock);
+
+		if (!scheduler->played)
+		{
+			LeaveCriticalSection(&scheduler->lock);
+			return INFINITE;
+		}
+
+		slot = &scheduler->slots[scheduler->head];
+
+		now = scheduler->clock(scheduler->clockContext);
+		position = scheduler->written - rdpsnd_scheduler_pending(scheduler, now);
+
+		if (slot->end > position)
+		{
+			LeaveCriticalSection(&scheduler->lock);
+			return (DWORD) ((slot->end - position + 999) / 1000);
+		}
+
+		/* the last sample was played as long ago as the position has passed it */
+
+		overshoot = (position - slot->end) / 1000;
+		played = (now > overshoot) ? (now - overshoot) : now;
+
+		if (played < slot->arrival)
+			played = slot->arrival;
+
+		CopyMemory(&wave, &slot->wave, sizeof(RDPSND_WAVE));
+
+		wave.wLocalTimeB = (UINT32) played;
+		wave.wLatency = (UINT16) (played - slot->arrival);
+		wave.wTimeStampB = wave.wTimeStampA + wave.wLatency;
+
+		scheduler->head = (scheduler->head + 1) % RDPSND_SCHEDULER_MAX_WAVES;
+		scheduler->played--;
+		scheduler->count--;
+
+		LeaveCriticalSection(&scheduler->lock);
+
+		fnConfirm(context, &wave);
+	}
+}
+
+void rdpsnd_scheduler_open(RDPSND_SCHEDULER* scheduler, int latency)
+{
+	EnterCriticalSection(&scheduler->lock);
+
+	scheduler->prefill = TRUE;
+	scheduler->lastArrival = 0;
+	scheduler->latency = (latency > 0) ? latency : 0;
+	rdpsnd_scheduler_update_target(scheduler);
+
+	LeaveCriticalSection(&scheduler->lock);
+}
+
+/**
+ * Ends the prefill and hands all queued waves to the device,
+ * before it is closed.
+ */
+
+void rdpsnd_scheduler_flush(RDPSND_SCHEDULER* scheduler)
+{
+	EnterCriticalSection(&scheduler->lock);
+	scheduler->prefill = FALSE;
+	LeaveCriticalSection(&scheduler->lock);
+
+	rdpsnd_scheduler_release(scheduler);
+}
+
+RDPSND_SCHEDULER* rdpsnd_scheduler_new(rdpsndDevicePlugin* device, RDPSND_CLOCK_FN fnClock, void* clockContext)
+{
+	RDPSND_SCHEDULER* scheduler;
+
+	scheduler = (RDPSND_SCHEDULER*) calloc(1, sizeof(RDPSND_SCHEDULER));
+
+	if (!scheduler)
+		return NULL;
+
+	scheduler->event = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+	if (!scheduler->event)
+	{
+		free(scheduler);
+		return NULL;
+	}
+
+	InitializeCriticalSectionAndSpinCount(&scheduler->lock, 4000);
+
+	scheduler->device = device;
+	scheduler->clock = fnClock ? fnClock : rdpsnd_scheduler_tick_count;
+	scheduler->clockContext = clockContext;
+	scheduler->prefill = TRUE;
+
+	rdpsnd_scheduler_update_target(scheduler);
+
+	return scheduler;
+}
+
+void rdpsnd_scheduler_free(RDPSND_SCHEDULER* scheduler)
+{
+	int index;
+
+	if (!scheduler)
+		return;
+
+	for (index = 0; index < RDPSND_SCHEDULER_MAX_WAVES; index++)
+		free(scheduler->slots[index].buffer);
+
+	CloseHandle(scheduler->event);
+	DeleteCriticalSection(&scheduler->lock);
+
+	free(scheduler);
+}
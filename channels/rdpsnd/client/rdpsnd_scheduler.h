@@ -0,0 +1,102 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Audio Output Virtual Channel - Playout Scheduler
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __RDPSND_SCHEDULER_H
+#define __RDPSND_SCHEDULER_H
+
+#include <winpr/synch.h>
+
+#include <freerdp/codec/audio.h>
+#include <freerdp/client/rdpsnd.h>
+
+/**
+ * Waves are held in a preallocated ring from the time they are received
+ * until their last sample has been played out. cBlockNo is a byte, so the
+ * server never has more blocks outstanding than the ring holds.
+ */
+
+#define RDPSND_SCHEDULER_MAX_WAVES	256
+
+/* target jitter buffer latency bounds and underrun penalty, in ms */
+
+#define RDPSND_TARGET_LATENCY_MIN	40
+#define RDPSND_TARGET_LATENCY_MAX	400
+#define RDPSND_UNDERRUN_PENALTY		20
+#define RDPSND_UNDERRUN_PENALTY_MAX	200
+
+typedef UINT64 (*RDPSND_CLOCK_FN)(void* context);
+typedef void (*RDPSND_CONFIRM_FN)(void* context, RDPSND_WAVE* wave);
+
+struct _RDPSND_SCHEDULER_SLOT
+{
+	RDPSND_WAVE wave;
+
+	BYTE* buffer;
+	int capacity;
+
+	UINT32 frames;
+	UINT32 rate;
+	UINT64 arrival;
+	UINT64 end;
+};
+typedef struct _RDPSND_SCHEDULER_SLOT RDPSND_SCHEDULER_SLOT;
+
+struct _RDPSND_SCHEDULER
+{
+	CRITICAL_SECTION lock;
+	HANDLE event;
+
+	rdpsndDevicePlugin* device;
+	RDPSND_CLOCK_FN clock;
+	void* clockContext;
+
+	RDPSND_SCHEDULER_SLOT slots[RDPSND_SCHEDULER_MAX_WAVES];
+	int head;
+	int played;
+	int count;
+
+	BOOL prefill;
+	UINT64 prefillStart;
+	UINT64 held;
+
+	int latency;
+	UINT32 target;
+	UINT64 jitter;
+	UINT32 penalty;
+	UINT64 penaltyTime;
+	UINT64 lastArrival;
+	UINT64 lastDuration;
+	UINT32 underruns;
+
+	UINT64 written;
+	UINT64 remainder;
+	UINT64 runStart;
+	UINT64 runPosition;
+};
+typedef struct _RDPSND_SCHEDULER RDPSND_SCHEDULER;
+
+RDPSND_WAVE* rdpsnd_scheduler_queue(RDPSND_SCHEDULER* scheduler, AUDIO_FORMAT* format, BYTE* data, int length);
+DWORD rdpsnd_scheduler_release(RDPSND_SCHEDULER* scheduler);
+DWORD rdpsnd_scheduler_poll(RDPSND_SCHEDULER* scheduler, RDPSND_CONFIRM_FN fnConfirm, void* context);
+
+void rdpsnd_scheduler_open(RDPSND_SCHEDULER* scheduler, int latency);
+void rdpsnd_scheduler_flush(RDPSND_SCHEDULER* scheduler);
+
+RDPSND_SCHEDULER* rdpsnd_scheduler_new(rdpsndDevicePlugin* device, RDPSND_CLOCK_FN fnClock, void* clockContext);
+void rdpsnd_scheduler_free(RDPSND_SCHEDULER* scheduler);
+
+#endif /* __RDPSND_SCHEDULER_H */
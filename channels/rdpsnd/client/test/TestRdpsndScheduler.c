@@ -0,0 +1,310 @@
+
+#include <stdio.h>
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+
+#include <freerdp/codec/audio.h>
+#include <freerdp/client/rdpsnd.h>
+
+#include "../rdpsnd_scheduler.h"
+
+#define TEST_RATE		44100
+#define TEST_WAVE_MS		20
+#define TEST_WAVE_FRAMES	((TEST_RATE * TEST_WAVE_MS) / 1000)
+#define TEST_WAVE_SIZE		(TEST_WAVE_FRAMES * 4)
+#define TEST_JITTER_MS		40
+#define TEST_DURATION_MS	(2 * 3600 * 1000)
+#define TEST_DRAIN_MS		2000
+#define TEST_WAVES		(TEST_DURATION_MS / TEST_WAVE_MS)
+#define TEST_TOLERANCE_MS	3
+
+/* the clock wraps 32 bits ten minutes in, the server clock every 65 seconds */
+
+#define TEST_CLOCK_BASE		(0x100000000ULL - (10 * 60 * 1000))
+#define TEST_SERVER_OFFSET	12345
+
+struct _TEST_DEVICE
+{
+	rdpsndDevicePlugin device;
+
+	double speed;
+	UINT64 queued;
+	double consumed;
+
+	int played;
+	int finished;
+	UINT64* ends;
+	double* finish;
+};
+typedef struct _TEST_DEVICE TEST_DEVICE;
+
+struct _TEST_SESSION
+{
+	UINT64 now;
+	TEST_DEVICE* device;
+
+	int confirmed;
+	BOOL failed;
+	UINT64* arrival;
+	UINT16* stampA;
+	UINT32* localB;
+	UINT16* stampB;
+};
+typedef struct _TEST_SESSION TEST_SESSION;
+
+static UINT64 test_clock(void* context)
+{
+	TEST_SESSION* session = (TEST_SESSION*) context;
+
+	return TEST_CLOCK_BASE + (session->now / 1000);
+}
+
+static void test_device_play(rdpsndDevicePlugin* device, BYTE* data, int size)
+{
+	UINT32 sequence;
+	TEST_DEVICE* test = (TEST_DEVICE*) device;
+
+	CopyMemory(&sequence, data, sizeof(UINT32));
+
+	if ((int) sequence != test->played)
+		printf("wave %d played out of order as %d\n", (int) sequence, test->played);
+
+	test->queued += ((UINT64) (size / 4) * 1000000) / TEST_RATE;
+	test->ends[test->played++] = test->queued;
+}
+
+static UINT32 test_device_get_playout_time(rdpsndDevicePlugin* device)
+{
+	TEST_DEVICE* test = (TEST_DEVICE*) device;
+
+	return (UINT32) (((test->queued - test->consumed) / test->speed) / 1000);
+}
+
+/**
+ * Consumes one millisecond of audio at the device rate, noting the exact
+ * time at which each wave has been played out.
+ */
+
+static void test_device_advance(TEST_DEVICE* test, UINT64 start)
+{
+	double consumed;
+
+	consumed = test->consumed + (1000.0 * test->speed);
+
+	if (consumed > (double) test->queued)
+		consumed = (double) test->queued;
+
+	while ((test->finished < test->played) && ((double) test->ends[test->finished] <= consumed))
+	{
+		test->finish[test->finished] = start + (test->ends[test->finished] - test->consumed) / test->speed;
+		test->finished++;
+	}
+
+	test->consumed = consumed;
+}
+
+static void test_confirm(void* context, RDPSND_WAVE* wave)
+{
+	TEST_SESSION* session = (TEST_SESSION*) context;
+	int index = session->confirmed;
+
+	if ((index >= TEST_WAVES) || (wave->cBlockNo != (BYTE) index))
+	{
+		printf("unexpected confirmation of block %d after %d waves\n", wave->cBlockNo, index);
+		session->failed = TRUE;
+		return;
+	}
+
+	session->localB[index] = wave->wLocalTimeB;
+	session->stampB[index] = wave->wTimeStampB;
+	session->confirmed++;
+}
+
+static int test_scheduler_run(const char* name, double speed, BOOL playoutTime)
+{
+	int index;
+	int sent;
+	int status;
+	int underruns;
+	INT32 error;
+	INT32 maxError;
+	UINT64 now;
+	UINT64 buffered;
+	UINT64 maxBuffered;
+	UINT64 lastArrival;
+	UINT64 arrival;
+	double oldError;
+	UINT32 finish;
+	UINT16 expected;
+	UINT32 random;
+	BYTE* data;
+	RDPSND_WAVE* wave;
+	AUDIO_FORMAT format;
+	TEST_DEVICE device;
+	TEST_SESSION session;
+	RDPSND_SCHEDULER* scheduler;
+
+	status = -1;
+
+	ZeroMemory(&device, sizeof(TEST_DEVICE));
+	ZeroMemory(&session, sizeof(TEST_SESSION));
+
+	device.device.Play = test_device_play;
+	device.device.GetPlayoutTime = playoutTime ? test_device_get_playout_time : NULL;
+	device.speed = speed;
+	device.ends = (UINT64*) calloc(TEST_WAVES, sizeof(UINT64));
+	device.finish = (double*) calloc(TEST_WAVES, sizeof(double));
+
+	session.device = &device;
+	session.arrival = (UINT64*) calloc(TEST_WAVES, sizeof(UINT64));
+	session.stampA = (UINT16*) calloc(TEST_WAVES, sizeof(UINT16));
+	session.localB = (UINT32*) calloc(TEST_WAVES, sizeof(UINT32));
+	session.stampB = (UINT16*) calloc(TEST_WAVES, sizeof(UINT16));
+
+	data = (BYTE*) calloc(1, TEST_WAVE_SIZE);
+	scheduler = rdpsnd_scheduler_new((rdpsndDevicePlugin*) &device, test_clock, &session);
+
+	if (!device.ends || !device.finish || !session.arrival || !session.stampA ||
+			!session.localB || !session.stampB || !data || !scheduler)
+		goto out;
+
+	ZeroMemory(&format, sizeof(AUDIO_FORMAT));
+	format.wFormatTag = WAVE_FORMAT_PCM;
+	format.nChannels = 2;
+	format.nSamplesPerSec = TEST_RATE;
+	format.nAvgBytesPerSec = TEST_RATE * 4;
+	format.nBlockAlign = 4;
+	format.wBitsPerSample = 16;
+
+	rdpsnd_scheduler_open(scheduler, 0);
+
+	/* the server sends a wave every 20 ms, delayed by up to 40 ms on the way */
+
+	random = 0x12345678;
+	lastArrival = 0;
+
+	for (index = 0; index < TEST_WAVES; index++)
+	{
+		random = random * 1103515245 + 12345;
+		arrival = (UINT64) index * TEST_WAVE_MS + ((random >> 16) % (TEST_JITTER_MS + 1));
+
+		if (arrival < lastArrival)
+			arrival = lastArrival;
+
+		session.arrival[index] = lastArrival = arrival;
+		session.stampA[index] = (UINT16) (index * TEST_WAVE_MS + TEST_SERVER_OFFSET);
+	}
+
+	sent = 0;
+	maxBuffered = 0;
+
+	for (now = 0; now < TEST_DURATION_MS + TEST_DRAIN_MS; now++)
+	{
+		test_device_advance(&device, session.now);
+		session.now = now * 1000;
+
+		while ((sent < TEST_WAVES) && (session.arrival[sent] <= now))
+		{
+			*((UINT32*) data) = (UINT32) sent;
+
+			wave = rdpsnd_scheduler_queue(scheduler, &format, data, TEST_WAVE_SIZE);
+
+			if (!wave)
+			{
+				printf("%s: wave %d rejected\n", name, sent);
+				goto out;
+			}
+
+			wave->wTimeStampA = session.stampA[sent];
+			wave->cBlockNo = (BYTE) sent;
+			sent++;
+		}
+
+		rdpsnd_scheduler_release(scheduler);
+		rdpsnd_scheduler_poll(scheduler, test_confirm, &session);
+
+		if (session.failed)
+			goto out;
+
+		buffered = (device.queued - (UINT64) device.consumed) + scheduler->held;
+
+		if (buffered > maxBuffered)
+			maxBuffered = buffered;
+	}
+
+	if ((session.confirmed != TEST_WAVES) || (device.finished != TEST_WAVES))
+	{
+		printf("%s: %d waves confirmed, %d played out of %d\n", name,
+				session.confirmed, device.finished, TEST_WAVES);
+		goto out;
+	}
+
+	maxError = 0;
+	oldError = 0;
+
+	for (index = 0; index < TEST_WAVES; index++)
+	{
+		finish = (UINT32) (TEST_CLOCK_BASE + (UINT64) (device.finish[index] / 1000));
+
+		error = (INT32) (session.localB[index] - finish);
+		error = (error < 0) ? -error : error;
+
+		if (error > maxError)
+			maxError = error;
+
+		expected = (UINT16) (session.stampA[index] + (finish - (UINT32) (TEST_CLOCK_BASE + session.arrival[index])));
+		error = (INT16) (session.stampB[index] - expected);
+
+		if ((error > TEST_TOLERANCE_MS) || (error < -TEST_TOLERANCE_MS))
+		{
+			printf("%s: wave %d confirmed with timestamp %d, expected %d\n", name, index,
+					session.stampB[index], expected);
+			goto out;
+		}
+
+		/* the previous estimate: audio length plus a fixed 65 ms after arrival */
+
+		oldError += abs((int) ((session.arrival[index] + TEST_WAVE_MS + 65) - (UINT64) (device.finish[index] / 1000)));
+	}
+
+	underruns = (int) scheduler->underruns;
+
+	printf("%s: max error %d ms (previously %.1f ms average), max buffered %d ms, "
+			"%d underruns, target %d ms\n", name, maxError, oldError / TEST_WAVES,
+			(int) (maxBuffered / 1000), underruns, (int) scheduler->target);
+
+	if (maxError > TEST_TOLERANCE_MS)
+		goto out;
+
+	if (maxBuffered > (RDPSND_TARGET_LATENCY_MAX + 100) * 1000)
+		goto out;
+
+	status = 0;
+
+out:
+	rdpsnd_scheduler_free(scheduler);
+	free(data);
+	free(session.arrival);
+	free(session.stampA);
+	free(session.localB);
+	free(session.stampB);
+	free(device.ends);
+	free(device.finish);
+
+	return status;
+}
+
+int TestRdpsndScheduler(int argc, char* argv[])
+{
+	if (test_scheduler_run("exact", 1.0, TRUE) < 0)
+		return -1;
+
+	if (test_scheduler_run("fast", 1.001, TRUE) < 0)
+		return -1;
+
+	if (test_scheduler_run("estimated", 1.0, FALSE) < 0)
+		return -1;
+
+	return 0;
+}
@@ -284,6 +284,7 @@ static BOOL rdpsnd_server_select_format(RdpsndServerContext* context, int client
 	}
 
 	freerdp_dsp_context_reset_adpcm(context->priv->dsp_context);
+	freerdp_dsp_context_reset_resampler(context->priv->dsp_context);
 	return TRUE;
 }
 
@@ -106,7 +106,7 @@ void android_begin_paint(rdpContext* context)
 {
 	rdpGdi* gdi = context->gdi;
 	gdi->primary->hdc->hwnd->invalid->null = 1;
-	gdi->primary->hdc->hwnd->ninvalid = 0;
+	region16_clear(&gdi->primary->hdc->hwnd->invalidRegion);
 }
 
 void android_end_paint(rdpContext* context)
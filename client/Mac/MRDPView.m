@@ -1195,7 +1195,7 @@ void mac_end_paint(rdpContext* context)
 
 	[view setNeedsDisplayInRect:newDrawRect];
 
-	gdi->primary->hdc->hwnd->ninvalid = 0;
+	region16_clear(&gdi->primary->hdc->hwnd->invalidRegion);
 }
 
 void mac_desktop_resize(rdpContext* context)
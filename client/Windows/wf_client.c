@@ -73,44 +73,24 @@ void wf_sw_begin_paint(wfContext* wfc)
 {
 	rdpGdi* gdi = ((rdpContext*) wfc)->gdi;
 	gdi->primary->hdc->hwnd->invalid->null = 1;
-	gdi->primary->hdc->hwnd->ninvalid = 0;
+	region16_clear(&gdi->primary->hdc->hwnd->invalidRegion);
 }
 
 void wf_sw_end_paint(wfContext* wfc)
 {
-	int i;
 	rdpGdi* gdi;
-	int ninvalid;
 	RECT updateRect;
-	HGDI_RGN cinvalid;
-	REGION16 invalidRegion;
-	RECTANGLE_16 invalidRect;
+	REGION16* invalidRegion;
 	const RECTANGLE_16* extents;
 	rdpContext* context = (rdpContext*) wfc;
 
 	gdi = context->gdi;
 
-	ninvalid = gdi->primary->hdc->hwnd->ninvalid;
-	cinvalid = gdi->primary->hdc->hwnd->cinvalid;
+	invalidRegion = &gdi->primary->hdc->hwnd->invalidRegion;
 
-	if (ninvalid < 1)
-		return;
-
-	region16_init(&invalidRegion);
-
-	for (i = 0; i < ninvalid; i++)
-	{
-		invalidRect.left = cinvalid[i].x;
-		invalidRect.top = cinvalid[i].y;
-		invalidRect.right = cinvalid[i].x + cinvalid[i].w;
-		invalidRect.bottom = cinvalid[i].y + cinvalid[i].h;
-
-		region16_union_rect(&invalidRegion, &invalidRegion, &invalidRect);
-	}
-
-	if (!region16_is_empty(&invalidRegion))
+	if (!region16_is_empty(invalidRegion))
 	{
-		extents = region16_extents(&invalidRegion);
+		extents = region16_extents(invalidRegion);
 
 		updateRect.left = extents->left;
 		updateRect.top = extents->top;
@@ -120,10 +100,8 @@ void wf_sw_end_paint(wfContext* wfc)
 		InvalidateRect(wfc->hwnd, &updateRect, FALSE);
 
 		if (wfc->rail)
-			wf_rail_invalidate_region(wfc, &invalidRegion);
+			wf_rail_invalidate_region(wfc, invalidRegion);
 	}
-
-	region16_uninit(&invalidRegion);
 }
 
 void wf_sw_desktop_resize(wfContext* wfc)
@@ -150,7 +128,7 @@ void wf_sw_desktop_resize(wfContext* wfc)
 void wf_hw_begin_paint(wfContext* wfc)
 {
 	wfc->hdc->hwnd->invalid->null = 1;
-	wfc->hdc->hwnd->ninvalid = 0;
+	region16_clear(&wfc->hdc->hwnd->invalidRegion);
 }
 
 void wf_hw_end_paint(wfContext* wfc)
@@ -391,9 +369,8 @@ BOOL wf_post_connect(freerdp* instance)
 		wfc->hdc->hwnd->invalid = gdi_CreateRectRgn(0, 0, 0, 0);
 		wfc->hdc->hwnd->invalid->null = 1;
 
-		wfc->hdc->hwnd->count = 32;
-		wfc->hdc->hwnd->cinvalid = (HGDI_RGN) malloc(sizeof(GDI_RGN) * wfc->hdc->hwnd->count);
-		wfc->hdc->hwnd->ninvalid = 0;
+		wfc->hdc->hwnd->maxInvalidRects = 32;
+		region16_init(&wfc->hdc->hwnd->invalidRegion);
 
 		if (settings->RemoteFxCodec)
 		{
@@ -257,7 +257,7 @@ void xf_sw_begin_paint(rdpContext* context)
 {
 	rdpGdi* gdi = context->gdi;
 	gdi->primary->hdc->hwnd->invalid->null = 1;
-	gdi->primary->hdc->hwnd->ninvalid = 0;
+	region16_clear(&gdi->primary->hdc->hwnd->invalidRegion);
 }
 
 void xf_sw_end_paint(rdpContext* context)
@@ -266,7 +266,7 @@ void xf_sw_end_paint(rdpContext* context)
 	INT32 x, y;
 	UINT32 w, h;
 	int ninvalid;
-	HGDI_RGN cinvalid;
+	const RECTANGLE_16* cinvalid;
 	xfContext* xfc = (xfContext*) context;
 	rdpGdi* gdi = context->gdi;
 
@@ -275,8 +275,7 @@ void xf_sw_end_paint(rdpContext* context)
 	w = gdi->primary->hdc->hwnd->invalid->w;
 	h = gdi->primary->hdc->hwnd->invalid->h;
 
-	ninvalid = gdi->primary->hdc->hwnd->ninvalid;
-	cinvalid = gdi->primary->hdc->hwnd->cinvalid;
+	cinvalid = region16_rects(&gdi->primary->hdc->hwnd->invalidRegion, &ninvalid);
 
 	if (!xfc->remote_app)
 	{
@@ -295,17 +294,17 @@ void xf_sw_end_paint(rdpContext* context)
 		}
 		else
 		{
-			if (gdi->primary->hdc->hwnd->ninvalid < 1)
+			if (ninvalid < 1)
 				return;
 
 			xf_lock_x11(xfc, FALSE);
 
 			for (i = 0; i < ninvalid; i++)
 			{
-				x = cinvalid[i].x;
-				y = cinvalid[i].y;
-				w = cinvalid[i].w;
-				h = cinvalid[i].h;
+				x = cinvalid[i].left;
+				y = cinvalid[i].top;
+				w = cinvalid[i].right - cinvalid[i].left;
+				h = cinvalid[i].bottom - cinvalid[i].top;
 
 				XPutImage(xfc->display, xfc->primary, xfc->gc, xfc->image, x, y, x, y, w, h);
 
@@ -360,7 +359,7 @@ void xf_hw_begin_paint(rdpContext* context)
 {
 	xfContext* xfc = (xfContext*) context;
 	xfc->hdc->hwnd->invalid->null = 1;
-	xfc->hdc->hwnd->ninvalid = 0;
+	region16_clear(&xfc->hdc->hwnd->invalidRegion);
 }
 
 void xf_hw_end_paint(rdpContext* context)
@@ -391,22 +390,21 @@ void xf_hw_end_paint(rdpContext* context)
 		{
 			int i;
 			int ninvalid;
-			HGDI_RGN cinvalid;
+			const RECTANGLE_16* cinvalid;
 
-			if (xfc->hdc->hwnd->ninvalid < 1)
-				return;
+			cinvalid = region16_rects(&xfc->hdc->hwnd->invalidRegion, &ninvalid);
 
-			ninvalid = xfc->hdc->hwnd->ninvalid;
-			cinvalid = xfc->hdc->hwnd->cinvalid;
+			if (ninvalid < 1)
+				return;
 
 			xf_lock_x11(xfc, FALSE);
 
 			for (i = 0; i < ninvalid; i++)
 			{
-				x = cinvalid[i].x;
-				y = cinvalid[i].y;
-				w = cinvalid[i].w;
-				h = cinvalid[i].h;
+				x = cinvalid[i].left;
+				y = cinvalid[i].top;
+				w = cinvalid[i].right - cinvalid[i].left;
+				h = cinvalid[i].bottom - cinvalid[i].top;
 
 				xf_draw_screen(xfc, x, y, w, h);
 			}
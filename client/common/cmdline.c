@@ -147,6 +147,8 @@ COMMAND_LINE_ARGUMENT_A args[] =
 	{ "mouse-motion", COMMAND_LINE_VALUE_BOOL, NULL, BoolValueTrue, NULL, -1, NULL, "mouse-motion" },
 	{ "parent-window", COMMAND_LINE_VALUE_REQUIRED, "<window id>", NULL, NULL, -1, NULL, "Parent window id" },
 	{ "bitmap-cache", COMMAND_LINE_VALUE_BOOL, NULL, BoolValueTrue, NULL, -1, NULL, "bitmap cache" },
+	{ "persist-cache", COMMAND_LINE_VALUE_BOOL, NULL, BoolValueFalse, NULL, -1, NULL, "persistent bitmap cache" },
+	{ "persist-cache-file", COMMAND_LINE_VALUE_REQUIRED, "<filename>", NULL, NULL, -1, NULL, "persistent bitmap cache file" },
 	{ "offscreen-cache", COMMAND_LINE_VALUE_BOOL, NULL, BoolValueTrue, NULL, -1, NULL, "offscreen bitmap cache" },
 	{ "glyph-cache", COMMAND_LINE_VALUE_BOOL, NULL, BoolValueTrue, NULL, -1, NULL, "glyph cache" },
 	{ "codec-cache", COMMAND_LINE_VALUE_REQUIRED, "<rfx|nsc|jpeg>", NULL, NULL, -1, NULL, "bitmap codec cache" },
@@ -160,6 +162,7 @@ COMMAND_LINE_ARGUMENT_A args[] =
 	{ "version", COMMAND_LINE_VALUE_FLAG | COMMAND_LINE_PRINT_VERSION, NULL, NULL, NULL, -1, NULL, "print version" },
 	{ "help", COMMAND_LINE_VALUE_FLAG | COMMAND_LINE_PRINT_HELP, NULL, NULL, NULL, -1, "?", "print help" },
 	{ "play-rfx", COMMAND_LINE_VALUE_REQUIRED, "<pcap file>", NULL, NULL, -1, NULL, "Replay rfx pcap file" },
+	{ "record", COMMAND_LINE_VALUE_REQUIRED, "<file>", NULL, NULL, -1, NULL, "Record the session for offline replay" },
 	{ "auth-only", COMMAND_LINE_VALUE_BOOL, NULL, BoolValueFalse, NULL, -1, NULL, "Authenticate only." },
 	{ "auto-reconnect", COMMAND_LINE_VALUE_BOOL, NULL, BoolValueFalse, NULL, -1, NULL, "Automatic reconnection" },
 	{ "reconnect-cookie", COMMAND_LINE_VALUE_REQUIRED, "<base64 cookie>", NULL, NULL, -1, NULL, "Pass base64 reconnect cookie to the connection" },
@@ -1164,6 +1167,7 @@ int freerdp_client_settings_command_line_status_print(rdpSettings* settings, int
 
 int freerdp_client_settings_parse_command_line_arguments(rdpSettings* settings, int argc, char** argv)
 {
+	int i;
 	char* p;
 	char* str;
 	int length;
@@ -1858,6 +1862,23 @@ int freerdp_client_settings_parse_command_line_arguments(rdpSettings* settings,
 		{
 			settings->BitmapCacheEnabled = arg->Value ? TRUE : FALSE;
 		}
+		CommandLineSwitchCase(arg, "persist-cache")
+		{
+			for (i = 0; i < (int) settings->BitmapCacheV2NumCells; i++)
+				settings->BitmapCacheV2CellInfo[i].persistent = arg->Value ? TRUE : FALSE;
+
+			settings->BitmapCachePersistEnabled = arg->Value ? TRUE : FALSE;
+		}
+		CommandLineSwitchCase(arg, "persist-cache-file")
+		{
+			free(settings->BitmapCachePersistFile);
+			settings->BitmapCachePersistFile = _strdup(arg->Value);
+
+			for (i = 0; i < (int) settings->BitmapCacheV2NumCells; i++)
+				settings->BitmapCacheV2CellInfo[i].persistent = TRUE;
+
+			settings->BitmapCachePersistEnabled = TRUE;
+		}
 		CommandLineSwitchCase(arg, "offscreen-cache")
 		{
 			settings->OffscreenSupportLevel = arg->Value ? TRUE : FALSE;
@@ -1920,6 +1941,11 @@ int freerdp_client_settings_parse_command_line_arguments(rdpSettings* settings,
 			settings->PlayRemoteFxFile = _strdup(arg->Value);
 			settings->PlayRemoteFx = TRUE;
 		}
+		CommandLineSwitchCase(arg, "record")
+		{
+			settings->SessionRecordingFile = _strdup(arg->Value);
+			settings->SessionRecording = TRUE;
+		}
 		CommandLineSwitchCase(arg, "auth-only")
 		{
 			settings->AuthenticationOnly = arg->Value ? TRUE : FALSE;
@@ -13,7 +13,6 @@ elseif(CMAKE_SYSTEM_PROCESSOR MATCHES "sparc")
 endif()
 
 option(WITH_MANPAGES "Generate manpages." ON)
-option(WITH_PROFILER "Compile profiler." OFF)
 option(WITH_GPROF "Compile with GProf profiler." OFF)
 
 if((TARGET_ARCH MATCHES "x86|x64") AND (NOT DEFINED WITH_SSE2))
@@ -27,6 +27,8 @@
 
 #include <winpr/stream.h>
 
+#include <freerdp/cache/persistent.h>
+
 typedef struct _BITMAP_V2_CELL BITMAP_V2_CELL;
 typedef struct rdp_bitmap_cache rdpBitmapCache;
 
@@ -58,6 +60,7 @@ struct rdp_bitmap_cache
 	rdpUpdate* update;
 	rdpContext* context;
 	rdpSettings* settings;
+	rdpPersistentCache* persistent;
 };
 
 #ifdef __cplusplus
@@ -0,0 +1,69 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Persistent Bitmap Cache
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FREERDP_PERSISTENT_CACHE_H
+#define FREERDP_PERSISTENT_CACHE_H
+
+#include <freerdp/api.h>
+#include <freerdp/types.h>
+#include <freerdp/settings.h>
+
+#define PERSISTENT_CACHE_ENTRY_COMPRESSED	0x0001
+
+typedef struct rdp_persistent_cache rdpPersistentCache;
+
+/**
+ * A bitmap as it was received from the server: the data is kept in its
+ * wire encoding and decoded again when the entry is loaded.
+ */
+
+struct _PERSISTENT_CACHE_ENTRY
+{
+	UINT64 key64;
+	UINT16 width;
+	UINT16 height;
+	UINT16 bpp;
+	UINT16 flags;
+	UINT32 codecId;
+	UINT32 size;
+	BYTE* data;
+};
+typedef struct _PERSISTENT_CACHE_ENTRY PERSISTENT_CACHE_ENTRY;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+FREERDP_API BOOL persistent_cache_enabled(rdpSettings* settings);
+
+FREERDP_API int persistent_cache_open(rdpPersistentCache* persistent, const char* filename, BOOL write);
+FREERDP_API void persistent_cache_close(rdpPersistentCache* persistent);
+
+FREERDP_API UINT32 persistent_cache_get_count(rdpPersistentCache* persistent, UINT32 id);
+FREERDP_API BOOL persistent_cache_get_key(rdpPersistentCache* persistent, UINT32 id, UINT32 index, UINT64* key64);
+
+FREERDP_API int persistent_cache_read_entry(rdpPersistentCache* persistent, UINT32 id, UINT32 index, PERSISTENT_CACHE_ENTRY* entry);
+FREERDP_API int persistent_cache_write_entry(rdpPersistentCache* persistent, UINT32 id, UINT32 index, PERSISTENT_CACHE_ENTRY* entry);
+
+FREERDP_API rdpPersistentCache* persistent_cache_new(rdpSettings* settings);
+FREERDP_API void persistent_cache_free(rdpPersistentCache* persistent);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FREERDP_PERSISTENT_CACHE_H */
@@ -61,6 +61,7 @@ typedef void (*pcPlay) (rdpsndDevicePlugin* device, BYTE* data, int size);
 typedef void (*pcStart) (rdpsndDevicePlugin* device);
 typedef void (*pcClose) (rdpsndDevicePlugin* device);
 typedef void (*pcFree) (rdpsndDevicePlugin* device);
+typedef UINT32 (*pcGetPlayoutTime) (rdpsndDevicePlugin* device);
 
 typedef void (*pcWaveDecode) (rdpsndDevicePlugin* device, RDPSND_WAVE* wave);
 typedef void (*pcWavePlay) (rdpsndDevicePlugin* device, RDPSND_WAVE* wave);
@@ -80,6 +81,12 @@ struct rdpsnd_device_plugin
 	pcClose Close;
 	pcFree Free;
 
+	/**
+	 * Returns the number of milliseconds until the last sample handed to the
+	 * device has been played out. May be called from any thread.
+	 */
+	pcGetPlayoutTime GetPlayoutTime;
+
 	pcWaveDecode WaveDecode;
 	pcWavePlay WavePlay;
 	pcWaveConfirm WaveConfirm;
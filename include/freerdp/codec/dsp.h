@@ -39,7 +39,17 @@ union _ADPCM
 };
 typedef union _ADPCM ADPCM;
 
+/**
+ * Resampler quality levels: the number of filter taps per output sample
+ * and the size of the precomputed polyphase filter bank grow with the level.
+ */
+
+#define FREERDP_DSP_QUALITY_LOW		0
+#define FREERDP_DSP_QUALITY_MEDIUM	1
+#define FREERDP_DSP_QUALITY_HIGH	2
+
 typedef struct _FREERDP_DSP_CONTEXT FREERDP_DSP_CONTEXT;
+typedef struct _FREERDP_DSP_RESAMPLER FREERDP_DSP_RESAMPLER;
 
 struct _FREERDP_DSP_CONTEXT
 {
@@ -48,6 +58,9 @@ struct _FREERDP_DSP_CONTEXT
 	UINT32 resampled_frames;
 	UINT32 resampled_maxlength;
 
+	int quality;
+	FREERDP_DSP_RESAMPLER* resampler;
+
 	BYTE* adpcm_buffer;
 	UINT32 adpcm_size;
 	UINT32 adpcm_maxlength;
@@ -78,6 +91,15 @@ FREERDP_API FREERDP_DSP_CONTEXT* freerdp_dsp_context_new(void);
 FREERDP_API void freerdp_dsp_context_free(FREERDP_DSP_CONTEXT* context);
 #define freerdp_dsp_context_reset_adpcm(_c) memset(&_c->adpcm, 0, sizeof(ADPCM))
 
+FREERDP_API void freerdp_dsp_context_set_quality(FREERDP_DSP_CONTEXT* context, int quality);
+FREERDP_API void freerdp_dsp_context_reset_resampler(FREERDP_DSP_CONTEXT* context);
+
+FREERDP_API void freerdp_dsp_s16_to_f32(const INT16* src, float* dst, int samples);
+FREERDP_API void freerdp_dsp_f32_to_s16(const float* src, INT16* dst, int samples);
+FREERDP_API void freerdp_dsp_mono_to_stereo(const INT16* src, INT16* dst, int frames);
+FREERDP_API void freerdp_dsp_stereo_to_mono(const INT16* src, INT16* dst, int frames);
+FREERDP_API void freerdp_dsp_downmix_51_to_stereo(const INT16* src, INT16* dst, int frames);
+
 #ifdef __cplusplus
 }
 #endif
@@ -23,12 +23,23 @@
 #include <freerdp/api.h>
 #include <freerdp/types.h>
 
+typedef struct _JPEG_CONTEXT JPEG_CONTEXT;
+
 #ifdef __cplusplus
  extern "C" {
 #endif
 
 FREERDP_API BOOL jpeg_decompress(BYTE* input, BYTE* output, int width, int height, int size, int bpp);
 
+FREERDP_API int jpeg_compress(JPEG_CONTEXT* jpeg, const BYTE* pSrcData, UINT32 SrcFormat, int nSrcStep,
+		int nWidth, int nHeight, BYTE** ppDstData, UINT32* pDstSize);
+
+FREERDP_API void jpeg_context_set_quality(JPEG_CONTEXT* jpeg, int quality);
+FREERDP_API void jpeg_context_set_max_slices(JPEG_CONTEXT* jpeg, int maxSlices);
+
+FREERDP_API JPEG_CONTEXT* jpeg_context_new(void);
+FREERDP_API void jpeg_context_free(JPEG_CONTEXT* jpeg);
+
 #ifdef __cplusplus
  }
 #endif
@@ -95,6 +95,13 @@ struct _BITMAP_PLANAR_CONTEXT
 
 	UINT32 TempSize;
 	BYTE* TempBuffer;
+
+	BOOL UseThreads;
+
+	void (*split_planes)(const BYTE* pSrcData, UINT32 format, int width, int height, int scanline, BYTE* planes[4]);
+	void (*split_delta_planes)(const BYTE* pSrcData, UINT32 format, int width, int height, int scanline,
+			BYTE* deltaPlanes[4], BOOL skipAlpha);
+	int (*scan_run)(const BYTE* pSrcData, int index, int width, int* runLength);
 };
 
 #ifdef __cplusplus
@@ -136,6 +136,71 @@ FREERDP_API BOOL region16_intersects_rect(const REGION16 *src, const RECTANGLE_1
  */
 FREERDP_API BOOL region16_intersect_rect(REGION16 *dst, const REGION16 *src, const RECTANGLE_16 *arg2);
 
+/** computes the union of two regions, dst can be one of the sources
+ * @param dst destination region
+ * @param src1 first region
+ * @param src2 second region
+ * @return if the operation was successful (false meaning out-of-memory)
+ */
+FREERDP_API BOOL region16_union(REGION16 *dst, const REGION16 *src1, const REGION16 *src2);
+
+/** computes the intersection of two regions, dst can be one of the sources
+ * @param dst destination region
+ * @param src1 first region
+ * @param src2 second region
+ * @return if the operation was successful (false meaning out-of-memory)
+ */
+FREERDP_API BOOL region16_intersect(REGION16 *dst, const REGION16 *src1, const REGION16 *src2);
+
+/** removes src2 from src1 and stores the resulting region in dst
+ * @param dst destination region
+ * @param src1 region to subtract from
+ * @param src2 region to subtract
+ * @return if the operation was successful (false meaning out-of-memory)
+ */
+FREERDP_API BOOL region16_subtract(REGION16 *dst, const REGION16 *src1, const REGION16 *src2);
+
+/** removes a rectangle from src and stores the resulting region in dst
+ * @param dst destination region
+ * @param src source region
+ * @param rect the rectangle to remove
+ * @return if the operation was successful (false meaning out-of-memory)
+ */
+FREERDP_API BOOL region16_subtract_rect(REGION16 *dst, const REGION16 *src, const RECTANGLE_16 *rect);
+
+/** computes the area covered by exactly one of the two regions
+ * @param dst destination region
+ * @param src1 first region
+ * @param src2 second region
+ * @return if the operation was successful (false meaning out-of-memory)
+ */
+FREERDP_API BOOL region16_xor(REGION16 *dst, const REGION16 *src1, const REGION16 *src2);
+
+/** adds many rectangles to src in a single sweep and stores the resulting region
+ * in dst. Unlike repeated calls to region16_union_rect() the cost does not grow
+ * with the square of the number of rectangles. The rectangles may overlap.
+ * @param dst destination region
+ * @param src source region
+ * @param rects the rectangles to add
+ * @param count number of rectangles
+ * @return if the operation was successful (false meaning out-of-memory)
+ */
+FREERDP_API BOOL region16_union_rects(REGION16 *dst, const REGION16 *src, const RECTANGLE_16 *rects, int count);
+
+/** builds the region covered by the dirty tiles of a grid. Bit (x % 8) of byte
+ * (y * stride + x / 8) of the bitmap is set when tile (x, y) is dirty.
+ * @param dst destination region
+ * @param bitmap the dirty tile bitmap
+ * @param stride number of bytes per row of tiles in the bitmap
+ * @param tilesX number of tiles per row
+ * @param tilesY number of rows of tiles
+ * @param tileWidth width of a tile
+ * @param tileHeight height of a tile
+ * @return if the operation was successful (false meaning out-of-memory)
+ */
+FREERDP_API BOOL region16_from_tile_bitmap(REGION16 *dst, const BYTE *bitmap, UINT32 stride,
+		UINT32 tilesX, UINT32 tilesY, UINT32 tileWidth, UINT32 tileHeight);
+
 /** release internal data associated with this region
  * @param region the region to release
  */
@@ -43,6 +43,8 @@ enum _RLGR_MODE
 };
 typedef enum _RLGR_MODE RLGR_MODE;
 
+#define RFX_QUANT_SCALE_MAX	6
+
 struct _RFX_RECT
 {
 	UINT16 x;
@@ -155,6 +157,11 @@ struct _RFX_CONTEXT
 
 FREERDP_API void rfx_context_set_pixel_format(RFX_CONTEXT* context, RDP_PIXEL_FORMAT pixel_format);
 
+FREERDP_API void rfx_context_set_adaptive_quantization(RFX_CONTEXT* context, BOOL enabled);
+FREERDP_API void rfx_context_set_quant_scale(RFX_CONTEXT* context, int scale);
+FREERDP_API int rfx_context_get_quant_scale(RFX_CONTEXT* context);
+FREERDP_API void rfx_context_set_target_frame_size(RFX_CONTEXT* context, UINT32 frameSize);
+
 FREERDP_API int rfx_rlgr_decode(const BYTE* pSrcData, UINT32 SrcSize, INT16* pDstData, UINT32 DstSize, int mode);
 
 FREERDP_API RFX_MESSAGE* rfx_process_message(RFX_CONTEXT* context, BYTE* data, UINT32 length);
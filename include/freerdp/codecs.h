@@ -26,6 +26,7 @@
 
 #include <freerdp/codec/rfx.h>
 #include <freerdp/codec/nsc.h>
+#include <freerdp/codec/jpeg.h>
 #include <freerdp/codec/h264.h>
 #include <freerdp/codec/clear.h>
 #include <freerdp/codec/planar.h>
@@ -40,6 +41,7 @@
 #define FREERDP_CODEC_ALPHACODEC		0x00000020
 #define FREERDP_CODEC_PROGRESSIVE		0x00000040
 #define FREERDP_CODEC_H264			0x00000080
+#define FREERDP_CODEC_JPEG			0x00000100
 #define FREERDP_CODEC_ALL			0xFFFFFFFF
 
 struct rdp_codecs
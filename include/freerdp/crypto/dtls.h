@@ -0,0 +1,78 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Datagram Transport Layer Security
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FREERDP_CRYPTO_DTLS_H
+#define FREERDP_CRYPTO_DTLS_H
+
+#include "crypto.h"
+
+#include <winpr/crt.h>
+
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+
+#include <freerdp/api.h>
+#include <freerdp/types.h>
+
+#define DTLS_RECORD_HEADER_LENGTH	13
+
+/* record header, explicit IV or nonce, MAC or tag and padding */
+#define DTLS_RECORD_OVERHEAD		64
+
+typedef struct rdp_dtls rdpDtls;
+
+/* sends one datagram to the peer */
+typedef int (*pDtlsSend)(rdpDtls* dtls, const BYTE* data, int length, void* param);
+
+struct rdp_dtls
+{
+	SSL* ssl;
+	SSL_CTX* ctx;
+	BIO* bioRead;
+	BIO* bioWrite;
+	BOOL server;
+	BOOL connected;
+	int mtu;
+	BYTE* PublicKey;
+	DWORD PublicKeyLength;
+	pDtlsSend Send;
+	void* param;
+};
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+FREERDP_API BOOL dtls_set_certificate(rdpDtls* dtls, const char* cert_file, const char* privatekey_file);
+
+FREERDP_API int dtls_handshake(rdpDtls* dtls);
+FREERDP_API int dtls_receive(rdpDtls* dtls, const BYTE* data, int length);
+FREERDP_API int dtls_read(rdpDtls* dtls, BYTE* data, int length);
+FREERDP_API int dtls_write(rdpDtls* dtls, const BYTE* data, int length);
+FREERDP_API int dtls_get_max_payload(rdpDtls* dtls);
+
+FREERDP_API DWORD dtls_get_timeout(rdpDtls* dtls);
+FREERDP_API int dtls_check_timeout(rdpDtls* dtls);
+
+FREERDP_API rdpDtls* dtls_new(BOOL server, int mtu, pDtlsSend send, void* param);
+FREERDP_API void dtls_free(rdpDtls* dtls);
+
+#ifdef __cplusplus
+ }
+#endif
+
+#endif /* FREERDP_CRYPTO_DTLS_H */
@@ -71,6 +71,7 @@ typedef BOOL (*pVerifyChangedCertificate)(freerdp* instance, char* subject, char
 typedef int (*pVerifyX509Certificate)(freerdp* instance, BYTE* data, int length, const char* hostname, int port, DWORD flags);
 
 typedef int (*pLogonErrorInfo)(freerdp* instance, UINT32 data, UINT32 type);
+typedef BOOL (*pHeartbeatMissed)(freerdp* instance, UINT32 missed, BOOL reconnect);
 
 typedef int (*pSendChannelData)(freerdp* instance, UINT16 channelId, BYTE* data, int size);
 typedef int (*pReceiveChannelData)(freerdp* instance, UINT16 channelId, BYTE* data, int size, int flags, int totalSize);
@@ -223,7 +224,11 @@ struct rdp_freerdp
 									 Callback for gateway authentication.
 									 It is used to get the username/password when it was not provided at connection time. */
 
-	UINT64 paddingD[64 - 57]; /* 57 */
+	ALIGN64 pHeartbeatMissed HeartbeatMissed; /**< (offset 57)
+									 Callback for the heartbeats missed from the server, from count1 on, and with 0 when they resume.
+									 reconnect is set from count2 on; returning FALSE prevents the automatic reconnection. */
+
+	UINT64 paddingD[64 - 58]; /* 58 */
 
 	ALIGN64 pSendChannelData SendChannelData; /* (offset 64)
 										 Callback for sending data to a channel.
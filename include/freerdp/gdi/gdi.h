@@ -223,10 +223,9 @@ typedef GDI_BRUSH* HGDI_BRUSH;
 
 struct _GDI_WND
 {
-	int count;
-	int ninvalid;
+	int maxInvalidRects;
 	HGDI_RGN invalid;
-	HGDI_RGN cinvalid;
+	REGION16 invalidRegion;
 };
 typedef struct _GDI_WND GDI_WND;
 typedef GDI_WND* HGDI_WND;
@@ -263,7 +262,7 @@ typedef struct gdi_bitmap gdiBitmap;
 
 struct gdi_glyph
 {
-	rdpBitmap _p;
+	rdpGlyph _p;
 
 	HGDI_DC hdc;
 	HGDI_BITMAP bitmap;
@@ -297,6 +296,10 @@ struct rdp_gdi
 	gdiBitmap* tile;
 	gdiBitmap* image;
 
+	GDI_RECT glyphClip;
+	GDI_RGN glyphBounds;
+	BYTE glyphColor[32];
+
 	BOOL inGfxFrame;
 	BOOL graphicsReset;
 	UINT16 outputSurfaceId;
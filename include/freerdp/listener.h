@@ -33,6 +33,7 @@ extern "C" {
 
 typedef BOOL (*psListenerOpen)(freerdp_listener* instance, const char* bind_address, UINT16 port);
 typedef BOOL (*psListenerOpenLocal)(freerdp_listener* instance, const char* path);
+typedef BOOL (*psListenerOpenMultitransport)(freerdp_listener* instance, const char* bind_address, UINT16 port);
 typedef BOOL (*psListenerGetFileDescriptor)(freerdp_listener* instance, void** rfds, int* rcount);
 typedef int (*psListenerGetEventHandles)(freerdp_listener* instance, HANDLE* events, DWORD* nCount);
 typedef BOOL (*psListenerCheckFileDescriptor)(freerdp_listener* instance);
@@ -50,6 +51,7 @@ struct rdp_freerdp_listener
 
 	psListenerOpen Open;
 	psListenerOpenLocal OpenLocal;
+	psListenerOpenMultitransport OpenMultitransport;
 	psListenerGetFileDescriptor GetFileDescriptor;
 	psListenerGetEventHandles GetEventHandles;
 	psListenerCheckFileDescriptor CheckFileDescriptor;
@@ -29,16 +29,25 @@
 
 #include <winpr/sspi.h>
 
+typedef struct rdp_reactor rdpReactor;
+
+#define FREERDP_PEER_EVENT_READ		0x00000001
+#define FREERDP_PEER_EVENT_TIMER	0x00000002
+#define FREERDP_PEER_EVENT_SIGNAL	0x00000004
+#define FREERDP_PEER_EVENT_CLOSED	0x00000008
+
 typedef void (*psPeerContextNew)(freerdp_peer* client, rdpContext* context);
 typedef void (*psPeerContextFree)(freerdp_peer* client, rdpContext* context);
 
 typedef BOOL (*psPeerInitialize)(freerdp_peer* client);
 typedef BOOL (*psPeerGetFileDescriptor)(freerdp_peer* client, void** rfds, int* rcount);
 typedef HANDLE (*psPeerGetEventHandle)(freerdp_peer* client);
+typedef DWORD (*psPeerGetEventHandles)(freerdp_peer* client, HANDLE* events);
 typedef HANDLE (*psPeerGetReceiveEventHandle)(freerdp_peer* client);
 typedef BOOL (*psPeerCheckFileDescriptor)(freerdp_peer* client);
 typedef BOOL (*psPeerIsWriteBlocked)(freerdp_peer* client);
 typedef int (*psPeerDrainOutputBuffer)(freerdp_peer* client);
+typedef BOOL (*psPeerReactorEvent)(freerdp_peer* client, UINT32 events);
 typedef BOOL (*psPeerClose)(freerdp_peer* client);
 typedef void (*psPeerDisconnect)(freerdp_peer* client);
 typedef BOOL (*psPeerCapabilities)(freerdp_peer* client);
@@ -106,6 +115,11 @@ struct rdp_freerdp_peer
 
 	psPeerIsWriteBlocked IsWriteBlocked;
 	psPeerDrainOutputBuffer DrainOutputBuffer;
+
+	void* reactor;
+	psPeerReactorEvent ReactorEvent;
+
+	psPeerGetEventHandles GetEventHandles;
 };
 
 #ifdef __cplusplus
@@ -118,6 +132,16 @@ FREERDP_API void freerdp_peer_context_free(freerdp_peer* client);
 FREERDP_API freerdp_peer* freerdp_peer_new(int sockfd);
 FREERDP_API void freerdp_peer_free(freerdp_peer* client);
 
+FREERDP_API rdpReactor* freerdp_reactor_new(int loops, int threads);
+FREERDP_API void freerdp_reactor_free(rdpReactor* reactor);
+
+FREERDP_API BOOL freerdp_peer_attach_reactor(freerdp_peer* client, rdpReactor* reactor);
+FREERDP_API void freerdp_peer_detach_reactor(freerdp_peer* client);
+FREERDP_API BOOL freerdp_peer_set_reactor_timer(freerdp_peer* client, UINT32 dueTime, UINT32 period);
+FREERDP_API void freerdp_peer_signal_reactor(freerdp_peer* client);
+
+FREERDP_API BOOL freerdp_peer_initiate_multitransport(freerdp_peer* client, UINT16 protocol);
+
 #ifdef __cplusplus
 }
 #endif
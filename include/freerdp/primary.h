@@ -155,7 +155,7 @@ struct _MULTI_DSTBLT_ORDER
 	UINT32 bRop;
 	UINT32 numRectangles;
 	UINT32 cbData;
-	DELTA_RECT rectangles[45];
+	DELTA_RECT rectangles[46];
 };
 typedef struct _MULTI_DSTBLT_ORDER MULTI_DSTBLT_ORDER;
 
@@ -171,7 +171,7 @@ struct _MULTI_PATBLT_ORDER
 	rdpBrush brush;
 	UINT32 numRectangles;
 	UINT32 cbData;
-	DELTA_RECT rectangles[45];
+	DELTA_RECT rectangles[46];
 };
 typedef struct _MULTI_PATBLT_ORDER MULTI_PATBLT_ORDER;
 
@@ -186,7 +186,7 @@ struct _MULTI_SCRBLT_ORDER
 	INT32 nYSrc;
 	UINT32 numRectangles;
 	UINT32 cbData;
-	DELTA_RECT rectangles[45];
+	DELTA_RECT rectangles[46];
 };
 typedef struct _MULTI_SCRBLT_ORDER MULTI_SCRBLT_ORDER;
 
@@ -199,7 +199,7 @@ struct _MULTI_OPAQUE_RECT_ORDER
 	UINT32 color;
 	UINT32 numRectangles;
 	UINT32 cbData;
-	DELTA_RECT rectangles[45];
+	DELTA_RECT rectangles[46];
 };
 typedef struct _MULTI_OPAQUE_RECT_ORDER MULTI_OPAQUE_RECT_ORDER;
 
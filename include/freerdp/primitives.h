@@ -182,6 +182,14 @@ typedef pstatus_t (*__orC_32u_t)(
 	UINT32 val,
 	UINT32 *pDst,
 	INT32 len);
+#define PRIM_ROP3_PATTERN_SIZE	32	/* bytes, the rop3 pattern period */
+
+typedef pstatus_t (*__rop3_8u_t)(
+	BYTE rop3,
+	const BYTE *pSrc,
+	const BYTE *pPat,	/* 32-byte pattern period, NULL if unused */
+	BYTE *pDst,
+	INT32 len);
 
 typedef struct
 {
@@ -219,6 +227,8 @@ typedef struct
 	__YCoCgToRGB_8u_AC4R_t YCoCgToRGB_8u_AC4R;
 	__RGB565ToARGB_16u32u_C3C4_t RGB565ToARGB_16u32u_C3C4;
 	__YUV420ToRGB_8u_P3AC4R_t YUV420ToRGB_8u_P3AC4R;
+	/* Raster operations */
+	__rop3_8u_t rop3_8u;
 } primitives_t;
 
 #ifdef __cplusplus
@@ -0,0 +1,73 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Session Replay
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FREERDP_REPLAY_H
+#define FREERDP_REPLAY_H
+
+#include <freerdp/api.h>
+#include <freerdp/types.h>
+#include <freerdp/freerdp.h>
+
+typedef struct rdp_replay rdpReplay;
+
+/**
+ * Stages the replay time is accounted to. PROTOCOL is everything not
+ * spent in one of the other stages: parsing, bulk decompression and the
+ * connection state machine.
+ */
+
+enum REPLAY_STAGE
+{
+	REPLAY_STAGE_PROTOCOL = 0,
+	REPLAY_STAGE_SURFACE,
+	REPLAY_STAGE_BITMAP,
+	REPLAY_STAGE_ORDERS,
+	REPLAY_STAGE_CACHE,
+	REPLAY_STAGE_CHANNELS,
+	REPLAY_STAGE_COUNT
+};
+
+struct rdp_replay_stats
+{
+	UINT32 pdus;
+	UINT64 bytes;
+	UINT64 elapsed; /* wall clock, microseconds */
+	UINT64 busy; /* processing, microseconds */
+	UINT32 calls[REPLAY_STAGE_COUNT];
+	UINT64 times[REPLAY_STAGE_COUNT]; /* microseconds */
+};
+typedef struct rdp_replay_stats rdpReplayStats;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+FREERDP_API int freerdp_replay_run(rdpReplay* replay, BOOL realtime);
+
+FREERDP_API freerdp* freerdp_replay_get_instance(rdpReplay* replay);
+FREERDP_API const rdpReplayStats* freerdp_replay_get_stats(rdpReplay* replay);
+FREERDP_API const char* freerdp_replay_get_stage_name(int stage);
+FREERDP_API void freerdp_replay_print_stats(rdpReplay* replay);
+
+FREERDP_API rdpReplay* freerdp_replay_new(const char* filename);
+FREERDP_API void freerdp_replay_free(rdpReplay* replay);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FREERDP_REPLAY_H */
@@ -32,16 +32,100 @@
 typedef struct _rdpdr_server_context RdpdrServerContext;
 typedef struct _rdpdr_server_private RdpdrServerPrivate;
 
+typedef struct _RDPDR_SERVER_DEVICE RDPDR_SERVER_DEVICE;
+typedef struct _RDPDR_SERVER_IRP RDPDR_SERVER_IRP;
+
+/**
+ * A device announced by the client
+ */
+
+struct _RDPDR_SERVER_DEVICE
+{
+	UINT32 DeviceType;
+	UINT32 DeviceId;
+	char PreferredDosName[9];
+	UINT32 DeviceDataLength;
+	BYTE* DeviceData;
+};
+
+/**
+ * An I/O request sent to a client device, and the handle of its completion:
+ * CompletionEvent is signaled once the client has answered, or once the
+ * channel is stopped (IoStatus is then STATUS_CANCELLED).
+ *
+ * FileId is the id of the opened file on completion of a create. Length and
+ * Buffer hold the data read, or the information queried; Length is the
+ * number of bytes written on completion of a write.
+ */
+
+struct _RDPDR_SERVER_IRP
+{
+	UINT32 DeviceId;
+	UINT32 FileId;
+	UINT32 CompletionId;
+	UINT32 MajorFunction;
+	UINT32 MinorFunction;
+
+	HANDLE CompletionEvent;
+	UINT32 IoStatus;
+	UINT32 Information;
+	UINT32 Length;
+	BYTE* Buffer;
+
+	void* custom;
+};
+
 typedef int (*psRdpdrStart)(RdpdrServerContext* context);
 typedef int (*psRdpdrStop)(RdpdrServerContext* context);
 
+typedef int (*psRdpdrOnDeviceAnnounce)(RdpdrServerContext* context, RDPDR_SERVER_DEVICE* device);
+typedef int (*psRdpdrOnDeviceRemove)(RdpdrServerContext* context, RDPDR_SERVER_DEVICE* device);
+typedef int (*psRdpdrOnIrpCompleted)(RdpdrServerContext* context, RDPDR_SERVER_IRP* irp);
+
+typedef RDPDR_SERVER_IRP* (*psRdpdrDriveCreate)(RdpdrServerContext* context, UINT32 DeviceId, const char* path,
+		UINT32 DesiredAccess, UINT32 CreateDisposition, UINT32 CreateOptions);
+typedef RDPDR_SERVER_IRP* (*psRdpdrDriveRead)(RdpdrServerContext* context, UINT32 DeviceId, UINT32 FileId,
+		UINT32 Length, UINT64 Offset);
+typedef RDPDR_SERVER_IRP* (*psRdpdrDriveWrite)(RdpdrServerContext* context, UINT32 DeviceId, UINT32 FileId,
+		const BYTE* data, UINT32 Length, UINT64 Offset);
+typedef RDPDR_SERVER_IRP* (*psRdpdrDriveQueryInformation)(RdpdrServerContext* context, UINT32 DeviceId, UINT32 FileId,
+		UINT32 FsInformationClass);
+typedef RDPDR_SERVER_IRP* (*psRdpdrDriveQueryDirectory)(RdpdrServerContext* context, UINT32 DeviceId, UINT32 FileId,
+		UINT32 FsInformationClass, BOOL InitialQuery, const char* path);
+typedef RDPDR_SERVER_IRP* (*psRdpdrDriveClose)(RdpdrServerContext* context, UINT32 DeviceId, UINT32 FileId);
+typedef void (*psRdpdrFreeIrp)(RdpdrServerContext* context, RDPDR_SERVER_IRP* irp);
+
 struct _rdpdr_server_context
 {
 	HANDLE vcm;
+	void* custom;
 
 	psRdpdrStart Start;
 	psRdpdrStop Stop;
 
+	/**
+	 * The requests return NULL when they could not be sent. Any number of
+	 * them may be in flight: each one is matched with its completion by its
+	 * CompletionId, and must be released with FreeIrp, even when pending.
+	 */
+
+	psRdpdrDriveCreate DriveCreate;
+	psRdpdrDriveRead DriveRead;
+	psRdpdrDriveWrite DriveWrite;
+	psRdpdrDriveQueryInformation DriveQueryInformation;
+	psRdpdrDriveQueryDirectory DriveQueryDirectory;
+	psRdpdrDriveClose DriveClose;
+	psRdpdrFreeIrp FreeIrp;
+
+	/**
+	 * Called from the channel thread. OnIrpCompleted runs before the
+	 * CompletionEvent of the IRP is signaled, and must not free it.
+	 */
+
+	psRdpdrOnDeviceAnnounce OnDeviceAnnounce;
+	psRdpdrOnDeviceRemove OnDeviceRemove;
+	psRdpdrOnIrpCompleted OnIrpCompleted;
+
 	RdpdrServerPrivate* priv;
 };
 
@@ -44,6 +44,7 @@ typedef struct rdp_shadow_server rdpShadowServer;
 typedef struct rdp_shadow_screen rdpShadowScreen;
 typedef struct rdp_shadow_surface rdpShadowSurface;
 typedef struct rdp_shadow_encoder rdpShadowEncoder;
+typedef struct rdp_shadow_congestion rdpShadowCongestion;
 typedef struct rdp_shadow_capture rdpShadowCapture;
 typedef struct rdp_shadow_subsystem rdpShadowSubsystem;
 
@@ -85,6 +86,7 @@ struct rdp_shadow_client
 	rdpShadowServer* server;
 	rdpShadowSurface* lobby;
 	rdpShadowEncoder* encoder;
+	rdpShadowCongestion* congestion;
 	rdpShadowSubsystem* subsystem;
 
 	UINT32 pointerX;
@@ -111,6 +113,7 @@ struct rdp_shadow_server
 	BOOL mayInteract;
 	BOOL shareSubRect;
 	BOOL authentication;
+	DWORD heartbeatPeriod;
 	int selectedMonitor;
 	RECTANGLE_16 subRect;
 	char* ipcSocket;
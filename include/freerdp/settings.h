@@ -529,6 +529,9 @@ typedef struct _RDPDR_PARALLEL RDPDR_PARALLEL;
 #define FreeRDP_SupportGraphicsPipeline				142
 #define FreeRDP_SupportDynamicTimeZone				143
 #define FreeRDP_SupportHeartbeatPdu				144
+#define FreeRDP_HeartbeatPeriod					145
+#define FreeRDP_HeartbeatWarningCount				146
+#define FreeRDP_HeartbeatReconnectCount				147
 #define FreeRDP_UseRdpSecurityLayer				192
 #define FreeRDP_EncryptionMethods				193
 #define FreeRDP_ExtEncryptionMethods				194
@@ -681,6 +684,8 @@ typedef struct _RDPDR_PARALLEL RDPDR_PARALLEL;
 #define FreeRDP_PlayRemoteFx					1857
 #define FreeRDP_DumpRemoteFxFile				1858
 #define FreeRDP_PlayRemoteFxFile				1859
+#define FreeRDP_SessionRecording				1860
+#define FreeRDP_SessionRecordingFile				1861
 #define FreeRDP_GatewayUsageMethod				1984
 #define FreeRDP_GatewayPort					1985
 #define FreeRDP_GatewayHostname					1986
@@ -728,6 +733,7 @@ typedef struct _RDPDR_PARALLEL RDPDR_PARALLEL;
 #define FreeRDP_BitmapCachePersistEnabled			2500
 #define FreeRDP_BitmapCacheV2NumCells				2501
 #define FreeRDP_BitmapCacheV2CellInfo				2502
+#define FreeRDP_BitmapCachePersistFile				2503
 #define FreeRDP_ColorPointerFlag				2560
 #define FreeRDP_PointerCacheSize				2561
 #define FreeRDP_KeyboardLayout					2624
@@ -762,6 +768,7 @@ typedef struct _RDPDR_PARALLEL RDPDR_PARALLEL;
 #define FreeRDP_RemoteFxCodecMode				3651
 #define FreeRDP_RemoteFxImageCodec				3652
 #define FreeRDP_RemoteFxCaptureFlags				3653
+#define FreeRDP_RemoteFxImageCodecId				3654
 #define FreeRDP_NSCodec						3712
 #define FreeRDP_NSCodecId					3713
 #define FreeRDP_FrameAcknowledge				3714
@@ -858,7 +865,10 @@ struct rdp_settings
 	ALIGN64 BOOL SupportGraphicsPipeline; /* 142 */
 	ALIGN64 BOOL SupportDynamicTimeZone; /* 143 */
 	ALIGN64 BOOL SupportHeartbeatPdu; /* 144 */
-	UINT64 padding0192[192 - 145]; /* 145 */
+	ALIGN64 UINT32 HeartbeatPeriod; /* 145 */
+	ALIGN64 UINT32 HeartbeatWarningCount; /* 146 */
+	ALIGN64 UINT32 HeartbeatReconnectCount; /* 147 */
+	UINT64 padding0192[192 - 148]; /* 148 */
 
 	/* Client/Server Security Data */
 	ALIGN64 BOOL UseRdpSecurityLayer; /* 192 */
@@ -1107,7 +1117,9 @@ struct rdp_settings
 	ALIGN64 BOOL PlayRemoteFx; /* 1857 */
 	ALIGN64 char* DumpRemoteFxFile; /* 1858 */
 	ALIGN64 char* PlayRemoteFxFile; /* 1859 */
-	UINT64 padding1920[1920 - 1860]; /* 1860 */
+	ALIGN64 BOOL SessionRecording; /* 1860 */
+	ALIGN64 char* SessionRecordingFile; /* 1861 */
+	UINT64 padding1920[1920 - 1862]; /* 1862 */
 	UINT64 padding1984[1984 - 1920]; /* 1920 */
 
 	/**
@@ -1190,7 +1202,8 @@ struct rdp_settings
 	ALIGN64 BOOL BitmapCachePersistEnabled; /* 2500 */
 	ALIGN64 UINT32 BitmapCacheV2NumCells; /* 2501 */
 	ALIGN64 BITMAP_CACHE_V2_CELL_INFO* BitmapCacheV2CellInfo; /* 2502 */
-	UINT64 padding2560[2560 - 2503]; /* 2503 */
+	ALIGN64 char* BitmapCachePersistFile; /* 2503 */
+	UINT64 padding2560[2560 - 2504]; /* 2504 */
 
 	/* Pointer Capabilities */
 	ALIGN64 BOOL ColorPointerFlag; /* 2560 */
@@ -1282,7 +1295,8 @@ struct rdp_settings
 	ALIGN64 UINT32 RemoteFxCodecMode; /* 3651 */
 	ALIGN64 BOOL RemoteFxImageCodec; /* 3652 */
 	ALIGN64 UINT32 RemoteFxCaptureFlags; /* 3653 */
-	UINT64 padding3712[3712 - 3654]; /* 3654 */
+	ALIGN64 UINT32 RemoteFxImageCodecId; /* 3654 */
+	UINT64 padding3712[3712 - 3655]; /* 3655 */
 
 	/* NSCodec */
 	ALIGN64 BOOL NSCodec; /* 3712 */
@@ -208,6 +208,7 @@ struct rdp_update
 	BOOL asynchronous;
 	rdpUpdateProxy* proxy;
 	wMessageQueue* queue;
+	wStream* recvStream;
 
 	wStream* us;
 	UINT16 numberOrders;
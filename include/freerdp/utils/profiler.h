@@ -21,12 +21,27 @@
 #define FREERDP_UTILS_PROFILER_H
 
 #include <freerdp/api.h>
-#include <freerdp/utils/stopwatch.h>
+#include <freerdp/types.h>
+
+/**
+ * Tracing profiler: every thread records its events into a ring of its
+ * own, without locks, and the rings are dumped as a Chrome trace
+ * (about:tracing, Perfetto) JSON file.
+ *
+ * Probes cost a load and a branch while the profiler is stopped. It is
+ * started by profiler_start() or, for a whole process, by setting the
+ * FREERDP_PROFILER environment variable to the file the trace is written
+ * to on exit. Event names must be string literals, the rings only keep
+ * the pointers.
+ */
+
+#define PROFILER_ENVIRONMENT_VARIABLE	"FREERDP_PROFILER"
+
+#define PROFILER_RING_SIZE		65536
 
 struct _PROFILER
 {
 	char* name;
-	STOPWATCH* stopwatch;
 };
 typedef struct _PROFILER PROFILER;
 
@@ -34,40 +49,44 @@ typedef struct _PROFILER PROFILER;
 extern "C" {
 #endif
 
-FREERDP_API PROFILER* profiler_create(char* name);
-FREERDP_API void profiler_free(PROFILER* profiler);
+FREERDP_API extern volatile BOOL freerdp_profiler_enabled;
+
+FREERDP_API void profiler_init(void);
 
-FREERDP_API void profiler_enter(PROFILER* profiler);
-FREERDP_API void profiler_exit(PROFILER* profiler);
+FREERDP_API BOOL profiler_start(const char* filename);
+FREERDP_API BOOL profiler_stop(void);
+FREERDP_API BOOL profiler_dump(const char* filename);
+FREERDP_API void profiler_reset(void);
 
-FREERDP_API void profiler_print_header(void);
-FREERDP_API void profiler_print(PROFILER* profiler);
-FREERDP_API void profiler_print_footer(void);
+FREERDP_API void profiler_begin(const char* name);
+FREERDP_API void profiler_end(const char* name);
+FREERDP_API void profiler_counter(const char* name, INT64 value);
+FREERDP_API void profiler_flow_begin(const char* name, UINT64 id);
+FREERDP_API void profiler_flow_end(const char* name, UINT64 id);
+
+FREERDP_API PROFILER* profiler_create(char* name);
+FREERDP_API void profiler_free(PROFILER* profiler);
 
 #ifdef __cplusplus
 }
 #endif
 
-#ifdef WITH_PROFILER
-#define IF_PROFILER(then)			then
+#define PROFILER_BEGIN(name) \
+	do { if (freerdp_profiler_enabled) profiler_begin(name); } while (0)
+#define PROFILER_END(name) \
+	do { if (freerdp_profiler_enabled) profiler_end(name); } while (0)
+#define PROFILER_COUNTER(name, value) \
+	do { if (freerdp_profiler_enabled) profiler_counter(name, value); } while (0)
+#define PROFILER_FLOW_BEGIN(name, id) \
+	do { if (freerdp_profiler_enabled) profiler_flow_begin(name, id); } while (0)
+#define PROFILER_FLOW_END(name, id) \
+	do { if (freerdp_profiler_enabled) profiler_flow_end(name, id); } while (0)
+
+#define IF_PROFILER(then)		then
 #define PROFILER_DEFINE(prof)		PROFILER* prof
 #define PROFILER_CREATE(prof,name)	prof = profiler_create(name)
-#define PROFILER_FREE(prof)			profiler_free(prof)
-#define PROFILER_ENTER(prof)		profiler_enter(prof)
-#define PROFILER_EXIT(prof)			profiler_exit(prof)
-#define PROFILER_PRINT_HEADER		profiler_print_header()
-#define PROFILER_PRINT(prof)		profiler_print(prof)
-#define PROFILER_PRINT_FOOTER		profiler_print_footer()
-#else
-#define IF_PROFILER(then)		do { } while (0)
-#define PROFILER_DEFINE(prof)		void* prof
-#define PROFILER_CREATE(prof,name)	do { } while (0)
-#define PROFILER_FREE(prof)		do { } while (0)
-#define PROFILER_ENTER(prof)		do { } while (0)
-#define PROFILER_EXIT(prof)		do { } while (0)
-#define PROFILER_PRINT_HEADER		do { } while (0)
-#define PROFILER_PRINT(prof)		do { } while (0)
-#define PROFILER_PRINT_FOOTER		do { } while (0)
-#endif
+#define PROFILER_FREE(prof)		profiler_free(prof)
+#define PROFILER_ENTER(prof)		PROFILER_BEGIN((prof)->name)
+#define PROFILER_EXIT(prof)		PROFILER_END((prof)->name)
 
 #endif /* FREERDP_UTILS_PROFILER_H */
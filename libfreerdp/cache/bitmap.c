@@ -34,6 +34,73 @@
 
 #define TAG FREERDP_TAG("cache.bitmap")
 
+/**
+ * Bitmaps from the persistent cache are decoded the first time they are
+ * referenced, since the graphics callbacks are not registered yet when the
+ * cache is created.
+ */
+
+static rdpBitmap* bitmap_cache_get_persistent(rdpContext* context, UINT32 id, UINT32 index)
+{
+	rdpBitmap* bitmap;
+	PERSISTENT_CACHE_ENTRY entry;
+	rdpBitmapCache* bitmapCache = context->cache->bitmap;
+
+	bitmap = bitmap_cache_get(bitmapCache, id, index);
+
+	if (bitmap || !bitmapCache->persistent)
+		return bitmap;
+
+	if (index == BITMAP_CACHE_WAITING_LIST_INDEX)
+		return NULL;
+
+	ZeroMemory(&entry, sizeof(PERSISTENT_CACHE_ENTRY));
+
+	if (persistent_cache_read_entry(bitmapCache->persistent, id, index, &entry) < 1)
+		return NULL;
+
+	bitmap = Bitmap_Alloc(context);
+
+	if (bitmap)
+	{
+		Bitmap_SetDimensions(context, bitmap, entry.width, entry.height);
+
+		bitmap->Decompress(context, bitmap,
+				entry.data, entry.width, entry.height, entry.bpp, entry.size,
+				(entry.flags & PERSISTENT_CACHE_ENTRY_COMPRESSED) ? TRUE : FALSE, entry.codecId);
+
+		bitmap->New(context, bitmap);
+
+		bitmap_cache_put(bitmapCache, id, index, bitmap);
+	}
+
+	free(entry.data);
+
+	return bitmap;
+}
+
+static void bitmap_cache_write_persistent(rdpContext* context, UINT32 id, UINT32 index,
+		UINT32 key1, UINT32 key2, UINT32 width, UINT32 height, UINT32 bpp,
+		BYTE* data, UINT32 length, BOOL compressed, UINT32 codecId)
+{
+	PERSISTENT_CACHE_ENTRY entry;
+	rdpBitmapCache* bitmapCache = context->cache->bitmap;
+
+	if (!bitmapCache->persistent || (index == BITMAP_CACHE_WAITING_LIST_INDEX))
+		return;
+
+	entry.key64 = (((UINT64) key2) << 32) | key1;
+	entry.width = width;
+	entry.height = height;
+	entry.bpp = bpp;
+	entry.flags = compressed ? PERSISTENT_CACHE_ENTRY_COMPRESSED : 0;
+	entry.codecId = codecId;
+	entry.size = length;
+	entry.data = data;
+
+	persistent_cache_write_entry(bitmapCache->persistent, id, index, &entry);
+}
+
 void update_gdi_memblt(rdpContext* context, MEMBLT_ORDER* memblt)
 {
 	rdpBitmap* bitmap;
@@ -42,7 +109,7 @@ void update_gdi_memblt(rdpContext* context, MEMBLT_ORDER* memblt)
 	if (memblt->cacheId == 0xFF)
 		bitmap = offscreen_cache_get(cache->offscreen, memblt->cacheIndex);
 	else
-		bitmap = bitmap_cache_get(cache->bitmap, (BYTE) memblt->cacheId, memblt->cacheIndex);
+		bitmap = bitmap_cache_get_persistent(context, (BYTE) memblt->cacheId, memblt->cacheIndex);
 	/* XP-SP2 servers sometimes ask for cached bitmaps they've never defined. */
 	if (bitmap == NULL) return;
 
@@ -60,7 +127,7 @@ void update_gdi_mem3blt(rdpContext* context, MEM3BLT_ORDER* mem3blt)
 	if (mem3blt->cacheId == 0xFF)
 		bitmap = offscreen_cache_get(cache->offscreen, mem3blt->cacheIndex);
 	else
-		bitmap = bitmap_cache_get(cache->bitmap, (BYTE) mem3blt->cacheId, mem3blt->cacheIndex);
+		bitmap = bitmap_cache_get_persistent(context, (BYTE) mem3blt->cacheId, mem3blt->cacheIndex);
 
 	/* XP-SP2 servers sometimes ask for cached bitmaps they've never defined. */
 	if (!bitmap)
@@ -134,6 +201,15 @@ void update_gdi_cache_bitmap_v2(rdpContext* context, CACHE_BITMAP_V2_ORDER* cach
 		Bitmap_Free(context, prevBitmap);
 
 	bitmap_cache_put(cache->bitmap, cacheBitmapV2->cacheId, cacheBitmapV2->cacheIndex, bitmap);
+
+	if (cacheBitmapV2->flags & CBR2_PERSISTENT_KEY_PRESENT)
+	{
+		bitmap_cache_write_persistent(context, cacheBitmapV2->cacheId, cacheBitmapV2->cacheIndex,
+				cacheBitmapV2->key1, cacheBitmapV2->key2,
+				cacheBitmapV2->bitmapWidth, cacheBitmapV2->bitmapHeight, cacheBitmapV2->bitmapBpp,
+				cacheBitmapV2->bitmapDataStream, cacheBitmapV2->bitmapLength,
+				cacheBitmapV2->compressed, RDP_CODEC_ID_NONE);
+	}
 }
 
 void update_gdi_cache_bitmap_v3(rdpContext* context, CACHE_BITMAP_V3_ORDER* cacheBitmapV3)
@@ -167,6 +243,11 @@ void update_gdi_cache_bitmap_v3(rdpContext* context, CACHE_BITMAP_V3_ORDER* cach
 		Bitmap_Free(context, prevBitmap);
 
 	bitmap_cache_put(cache->bitmap, cacheBitmapV3->cacheId, cacheBitmapV3->cacheIndex, bitmap);
+
+	bitmap_cache_write_persistent(context, cacheBitmapV3->cacheId, cacheBitmapV3->cacheIndex,
+			cacheBitmapV3->key1, cacheBitmapV3->key2,
+			bitmapData->width, bitmapData->height, bitmapData->bpp,
+			bitmapData->data, bitmapData->length, compressed, bitmapData->codecID);
 }
 
 void update_gdi_bitmap_update(rdpContext* context, BITMAP_UPDATE* bitmapUpdate)
@@ -308,6 +389,17 @@ rdpBitmapCache* bitmap_cache_new(rdpSettings* settings)
 			/* allocate an extra entry for BITMAP_CACHE_WAITING_LIST_INDEX */
 			bitmapCache->cells[i].entries = (rdpBitmap**) calloc((bitmapCache->cells[i].number + 1), sizeof(rdpBitmap*));
 		}
+
+		if (persistent_cache_enabled(settings))
+		{
+			bitmapCache->persistent = persistent_cache_new(settings);
+
+			if (bitmapCache->persistent && (persistent_cache_open(bitmapCache->persistent, NULL, TRUE) < 1))
+			{
+				persistent_cache_free(bitmapCache->persistent);
+				bitmapCache->persistent = NULL;
+			}
+		}
 	}
 
 	return bitmapCache;
@@ -336,6 +428,8 @@ void bitmap_cache_free(rdpBitmapCache* bitmapCache)
 		if (bitmapCache->bitmap)
 			Bitmap_Free(bitmapCache->context, bitmapCache->bitmap);
 
+		persistent_cache_free(bitmapCache->persistent);
+
 		free(bitmapCache->cells);
 		free(bitmapCache);
 	}
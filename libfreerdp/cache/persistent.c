@@ -0,0 +1,796 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Persistent Bitmap Cache
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+#include <winpr/file.h>
+#include <winpr/path.h>
+#include <winpr/stream.h>
+
+#include <freerdp/log.h>
+#include <freerdp/cache/persistent.h>
+
+#define TAG FREERDP_TAG("cache.persistent")
+
+/**
+ * The cache file is a header followed by a journal of records, each one
+ * holding a single bitmap together with its cell and cache index:
+ *
+ * header:  magic (4 bytes), version (4 bytes)
+ * record:  length (4 bytes), crc32 (4 bytes), payload (length bytes)
+ * payload: key64 (8 bytes), cellId (1 byte), pad (1 byte), flags (2 bytes),
+ *          cacheIndex (4 bytes), width (2 bytes), height (2 bytes),
+ *          bpp (2 bytes), pad (2 bytes), codecId (4 bytes), size (4 bytes),
+ *          data (size bytes)
+ *
+ * Records are only ever appended, one at a time, so a crash can at worst leave
+ * a torn record at the end of the file. They are flushed as they are written
+ * but only synced to disk when the file is closed, to keep disk flushes off
+ * the update thread: a crash loses the records written since. Loading stops
+ * at the first record whose length or checksum does not match, and the last
+ * record written for a given cell and index wins. The file is compacted when it is opened for
+ * writing and holds a torn tail or more superseded records than live ones.
+ */
+
+#define PERSISTENT_CACHE_MAGIC		0x43425246 /* "FRBC" */
+#define PERSISTENT_CACHE_VERSION	1
+
+#define PERSISTENT_CACHE_HEADER_LENGTH	8
+#define PERSISTENT_RECORD_HEADER_LENGTH	8
+#define PERSISTENT_ENTRY_HEADER_LENGTH	32
+#define PERSISTENT_ENTRY_MAX_SIZE	0x100000
+
+struct _PERSISTENT_CACHE_SLOT
+{
+	BOOL valid;
+	UINT64 key64;
+	UINT32 offset;
+	UINT32 length;
+};
+typedef struct _PERSISTENT_CACHE_SLOT PERSISTENT_CACHE_SLOT;
+
+struct _PERSISTENT_CACHE_CELL
+{
+	UINT32 number;
+	BOOL persistent;
+	PERSISTENT_CACHE_SLOT* slots;
+};
+typedef struct _PERSISTENT_CACHE_CELL PERSISTENT_CACHE_CELL;
+
+struct rdp_persistent_cache
+{
+	FILE* fp;
+	BOOL write;
+	char* filename;
+	UINT32 numCells;
+	PERSISTENT_CACHE_CELL* cells;
+	rdpSettings* settings;
+};
+
+static UINT32 persistent_crc32_table[256];
+static INIT_ONCE persistent_crc32_once = INIT_ONCE_STATIC_INIT;
+
+static BOOL CALLBACK persistent_crc32_init(PINIT_ONCE once, PVOID param, PVOID* context)
+{
+	UINT32 i, k;
+	UINT32 crc;
+
+	for (i = 0; i < 256; i++)
+	{
+		crc = i;
+
+		for (k = 0; k < 8; k++)
+			crc = (crc & 1) ? (0xEDB88320 ^ (crc >> 1)) : (crc >> 1);
+
+		persistent_crc32_table[i] = crc;
+	}
+
+	return TRUE;
+}
+
+static UINT32 persistent_crc32(const BYTE* data, UINT32 length)
+{
+	UINT32 i;
+	UINT32 crc;
+
+	InitOnceExecuteOnce(&persistent_crc32_once, persistent_crc32_init, NULL, NULL);
+
+	crc = 0xFFFFFFFF;
+
+	for (i = 0; i < length; i++)
+		crc = persistent_crc32_table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+
+	return crc ^ 0xFFFFFFFF;
+}
+
+/**
+ * Flush the stdio buffers and have the operating system write the file
+ * through to disk, so that what was written survives a crash.
+ */
+
+static BOOL persistent_cache_sync(FILE* fp)
+{
+	if (fflush(fp) != 0)
+		return FALSE;
+
+#ifdef _WIN32
+	return FlushFileBuffers((HANDLE) _get_osfhandle(_fileno(fp)));
+#else
+	return (fsync(fileno(fp)) == 0) ? TRUE : FALSE;
+#endif
+}
+
+BOOL persistent_cache_enabled(rdpSettings* settings)
+{
+	UINT32 i;
+
+	if (!settings->BitmapCachePersistEnabled || !settings->BitmapCacheV2CellInfo)
+		return FALSE;
+
+	for (i = 0; i < settings->BitmapCacheV2NumCells; i++)
+	{
+		if (settings->BitmapCacheV2CellInfo[i].persistent)
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+static char* persistent_cache_get_filename(rdpSettings* settings, BOOL create)
+{
+	int length;
+	char* name;
+	char* path;
+	char* filename;
+
+	if (settings->BitmapCachePersistFile)
+		return _strdup(settings->BitmapCachePersistFile);
+
+	if (!settings->ConfigPath || !settings->ServerHostname)
+		return NULL;
+
+	path = GetCombinedPath(settings->ConfigPath, "cache");
+
+	if (!path)
+		return NULL;
+
+	if (create)
+	{
+		if (!PathFileExistsA(settings->ConfigPath))
+			CreateDirectoryA(settings->ConfigPath, 0);
+
+		if (!PathFileExistsA(path))
+			CreateDirectoryA(path, 0);
+	}
+
+	length = strlen(settings->ServerHostname) + 16;
+	name = (char*) malloc(length);
+
+	if (!name)
+	{
+		free(path);
+		return NULL;
+	}
+
+	sprintf_s(name, length, "%s_%d.bmc", settings->ServerHostname, (int) settings->ServerPort);
+
+	filename = GetCombinedPath(path, name);
+
+	free(name);
+	free(path);
+
+	return filename;
+}
+
+static int persistent_cache_read_record(FILE* fp, UINT32 offset, wStream* s)
+{
+	UINT32 crc;
+	UINT32 length;
+	BYTE header[PERSISTENT_RECORD_HEADER_LENGTH];
+
+	if (fseek(fp, offset, SEEK_SET) != 0)
+		return -1;
+
+	if (fread(header, 1, sizeof(header), fp) != sizeof(header))
+		return -1;
+
+	length = header[0] | (header[1] << 8) | (header[2] << 16) | ((UINT32) header[3] << 24);
+	crc = header[4] | (header[5] << 8) | (header[6] << 16) | ((UINT32) header[7] << 24);
+
+	if ((length < PERSISTENT_ENTRY_HEADER_LENGTH) ||
+			(length > PERSISTENT_ENTRY_HEADER_LENGTH + PERSISTENT_ENTRY_MAX_SIZE))
+		return -1;
+
+	Stream_SetPosition(s, 0);
+	Stream_EnsureCapacity(s, length);
+
+	if (fread(Stream_Buffer(s), 1, length, fp) != length)
+		return -1;
+
+	if (persistent_crc32(Stream_Buffer(s), length) != crc)
+		return -1;
+
+	Stream_SetLength(s, length);
+
+	return length;
+}
+
+static int persistent_cache_write_record(FILE* fp, wStream* s)
+{
+	UINT32 crc;
+	UINT32 length;
+	BYTE header[PERSISTENT_RECORD_HEADER_LENGTH];
+
+	length = Stream_GetPosition(s);
+	crc = persistent_crc32(Stream_Buffer(s), length);
+
+	header[0] = length & 0xFF;
+	header[1] = (length >> 8) & 0xFF;
+	header[2] = (length >> 16) & 0xFF;
+	header[3] = (length >> 24) & 0xFF;
+	header[4] = crc & 0xFF;
+	header[5] = (crc >> 8) & 0xFF;
+	header[6] = (crc >> 16) & 0xFF;
+	header[7] = (crc >> 24) & 0xFF;
+
+	if (fwrite(header, 1, sizeof(header), fp) != sizeof(header))
+		return -1;
+
+	if (fwrite(Stream_Buffer(s), 1, length, fp) != length)
+		return -1;
+
+	return length;
+}
+
+static BOOL persistent_cache_write_header(FILE* fp)
+{
+	wStream* s;
+	BOOL status;
+
+	s = Stream_New(NULL, PERSISTENT_CACHE_HEADER_LENGTH);
+
+	if (!s)
+		return FALSE;
+
+	Stream_Write_UINT32(s, PERSISTENT_CACHE_MAGIC); /* magic (4 bytes) */
+	Stream_Write_UINT32(s, PERSISTENT_CACHE_VERSION); /* version (4 bytes) */
+
+	status = (fwrite(Stream_Buffer(s), 1, PERSISTENT_CACHE_HEADER_LENGTH, fp) == PERSISTENT_CACHE_HEADER_LENGTH);
+
+	Stream_Free(s, TRUE);
+
+	return status;
+}
+
+static BOOL persistent_cache_read_header(FILE* fp)
+{
+	UINT32 magic;
+	UINT32 version;
+	wStream* s;
+
+	s = Stream_New(NULL, PERSISTENT_CACHE_HEADER_LENGTH);
+
+	if (!s)
+		return FALSE;
+
+	if (fread(Stream_Buffer(s), 1, PERSISTENT_CACHE_HEADER_LENGTH, fp) != PERSISTENT_CACHE_HEADER_LENGTH)
+	{
+		Stream_Free(s, TRUE);
+		return FALSE;
+	}
+
+	Stream_Read_UINT32(s, magic); /* magic (4 bytes) */
+	Stream_Read_UINT32(s, version); /* version (4 bytes) */
+
+	Stream_Free(s, TRUE);
+
+	return ((magic == PERSISTENT_CACHE_MAGIC) && (version == PERSISTENT_CACHE_VERSION));
+}
+
+/**
+ * Scan the journal, returning the number of superseded records, or -1
+ * if the file ends with a torn or corrupted record.
+ */
+
+static int persistent_cache_load(rdpPersistentCache* persistent, wStream* s)
+{
+	int length;
+	int garbage = 0;
+	BYTE cellId;
+	UINT32 cacheIndex;
+	UINT64 key64;
+	UINT32 offset;
+	PERSISTENT_CACHE_SLOT* slot;
+
+	offset = PERSISTENT_CACHE_HEADER_LENGTH;
+
+	while (1)
+	{
+		length = persistent_cache_read_record(persistent->fp, offset, s);
+
+		if (length < 0)
+			break;
+
+		Stream_Read_UINT64(s, key64); /* key64 (8 bytes) */
+		Stream_Read_UINT8(s, cellId); /* cellId (1 byte) */
+		Stream_Seek(s, 3); /* pad (1 byte), flags (2 bytes) */
+		Stream_Read_UINT32(s, cacheIndex); /* cacheIndex (4 bytes) */
+
+		if ((cellId < persistent->numCells) && (cacheIndex < persistent->cells[cellId].number))
+		{
+			slot = &persistent->cells[cellId].slots[cacheIndex];
+
+			if (slot->valid)
+				garbage++;
+
+			slot->valid = TRUE;
+			slot->key64 = key64;
+			slot->offset = offset;
+			slot->length = length;
+		}
+		else
+		{
+			garbage++;
+		}
+
+		offset += PERSISTENT_RECORD_HEADER_LENGTH + length;
+	}
+
+	if (fseek(persistent->fp, 0, SEEK_END) != 0)
+		return -1;
+
+	if ((UINT32) ftell(persistent->fp) != offset)
+		return -1;
+
+	return garbage;
+}
+
+/**
+ * Copy the live records into a fresh file and replace the journal with it.
+ */
+
+static BOOL persistent_cache_compact(rdpPersistentCache* persistent, wStream* s)
+{
+	int length;
+	UINT32 i, j;
+	UINT32 offset;
+	FILE* fp;
+	char* tmpname;
+	PERSISTENT_CACHE_SLOT* slot;
+
+	length = strlen(persistent->filename) + 5;
+	tmpname = (char*) malloc(length);
+
+	if (!tmpname)
+		return FALSE;
+
+	sprintf_s(tmpname, length, "%s.tmp", persistent->filename);
+
+	fp = fopen(tmpname, "w+b");
+
+	if (!fp || !persistent_cache_write_header(fp))
+	{
+		if (fp)
+			fclose(fp);
+
+		free(tmpname);
+		return FALSE;
+	}
+
+	offset = PERSISTENT_CACHE_HEADER_LENGTH;
+
+	for (i = 0; i < persistent->numCells; i++)
+	{
+		for (j = 0; j < persistent->cells[i].number; j++)
+		{
+			slot = &persistent->cells[i].slots[j];
+
+			if (!slot->valid)
+				continue;
+
+			if (persistent_cache_read_record(persistent->fp, slot->offset, s) < 0)
+			{
+				slot->valid = FALSE;
+				continue;
+			}
+
+			Stream_SetPosition(s, slot->length);
+
+			if (persistent_cache_write_record(fp, s) < 0)
+			{
+				fclose(fp);
+				DeleteFileA(tmpname);
+				free(tmpname);
+				return FALSE;
+			}
+
+			slot->offset = offset;
+			offset += PERSISTENT_RECORD_HEADER_LENGTH + slot->length;
+		}
+	}
+
+	if (!persistent_cache_sync(fp))
+	{
+		WLog_ERR(TAG, "failed to sync %s", tmpname);
+		fclose(fp);
+		DeleteFileA(tmpname);
+		free(tmpname);
+		return FALSE;
+	}
+
+	fclose(fp);
+
+	fclose(persistent->fp);
+	persistent->fp = NULL;
+
+#ifdef _WIN32
+	DeleteFileA(persistent->filename);
+#endif
+
+	if (rename(tmpname, persistent->filename) != 0)
+	{
+		WLog_ERR(TAG, "failed to replace %s", persistent->filename);
+		DeleteFileA(tmpname);
+		free(tmpname);
+		return FALSE;
+	}
+
+	free(tmpname);
+
+	persistent->fp = fopen(persistent->filename, "r+b");
+
+	return (persistent->fp) ? TRUE : FALSE;
+}
+
+static void persistent_cache_reset(rdpPersistentCache* persistent)
+{
+	UINT32 i;
+
+	for (i = 0; i < persistent->numCells; i++)
+		ZeroMemory(persistent->cells[i].slots, persistent->cells[i].number * sizeof(PERSISTENT_CACHE_SLOT));
+}
+
+/**
+ * Open the cache file, using the configured file or a file per server below
+ * the configuration directory when filename is NULL. Returns 1 when the cache
+ * is open, 0 when there is no cache to read, and -1 on error.
+ */
+
+int persistent_cache_open(rdpPersistentCache* persistent, const char* filename, BOOL write)
+{
+	int garbage;
+	UINT32 i, live = 0;
+	wStream* s;
+
+	persistent_cache_close(persistent);
+
+	persistent->write = write;
+	persistent->filename = filename ? _strdup(filename) :
+			persistent_cache_get_filename(persistent->settings, write);
+
+	if (!persistent->filename)
+		return -1;
+
+	persistent->fp = fopen(persistent->filename, write ? "r+b" : "rb");
+
+	if (!persistent->fp)
+	{
+		if (!write)
+			return 0;
+
+		persistent->fp = fopen(persistent->filename, "w+b");
+
+		if (!persistent->fp || !persistent_cache_write_header(persistent->fp) ||
+				!persistent_cache_sync(persistent->fp))
+		{
+			WLog_ERR(TAG, "failed to create %s", persistent->filename);
+			persistent_cache_close(persistent);
+			return -1;
+		}
+
+		return 1;
+	}
+
+	if (!persistent_cache_read_header(persistent->fp))
+	{
+		WLog_WARN(TAG, "ignoring invalid cache file %s", persistent->filename);
+
+		if (!write)
+		{
+			persistent_cache_close(persistent);
+			return 0;
+		}
+
+		fclose(persistent->fp);
+		persistent->fp = fopen(persistent->filename, "w+b");
+
+		if (!persistent->fp || !persistent_cache_write_header(persistent->fp) ||
+				!persistent_cache_sync(persistent->fp))
+		{
+			persistent_cache_close(persistent);
+			return -1;
+		}
+
+		return 1;
+	}
+
+	s = Stream_New(NULL, 1024);
+
+	if (!s)
+	{
+		persistent_cache_close(persistent);
+		return -1;
+	}
+
+	garbage = persistent_cache_load(persistent, s);
+
+	for (i = 0; i < persistent->numCells; i++)
+		live += persistent_cache_get_count(persistent, i);
+
+	if (write && ((garbage < 0) || ((UINT32) garbage > live)))
+	{
+		if (!persistent_cache_compact(persistent, s))
+		{
+			WLog_ERR(TAG, "failed to compact %s", persistent->filename);
+			Stream_Free(s, TRUE);
+			persistent_cache_close(persistent);
+			return -1;
+		}
+	}
+
+	Stream_Free(s, TRUE);
+
+	return 1;
+}
+
+void persistent_cache_close(rdpPersistentCache* persistent)
+{
+	if (persistent->fp)
+	{
+		if (persistent->write && !persistent_cache_sync(persistent->fp))
+			WLog_WARN(TAG, "failed to sync %s", persistent->filename);
+
+		fclose(persistent->fp);
+		persistent->fp = NULL;
+	}
+
+	free(persistent->filename);
+	persistent->filename = NULL;
+
+	persistent_cache_reset(persistent);
+}
+
+/**
+ * The server assigns cache indices in the order the keys are announced, so
+ * only the entries up to the first free slot of a cell can be offered.
+ */
+
+UINT32 persistent_cache_get_count(rdpPersistentCache* persistent, UINT32 id)
+{
+	UINT32 index;
+	PERSISTENT_CACHE_CELL* cell;
+
+	if (id >= persistent->numCells)
+		return 0;
+
+	cell = &persistent->cells[id];
+
+	if (!cell->persistent)
+		return 0;
+
+	for (index = 0; index < cell->number; index++)
+	{
+		if (!cell->slots[index].valid)
+			break;
+	}
+
+	return index;
+}
+
+BOOL persistent_cache_get_key(rdpPersistentCache* persistent, UINT32 id, UINT32 index, UINT64* key64)
+{
+	if ((id >= persistent->numCells) || (index >= persistent->cells[id].number))
+		return FALSE;
+
+	if (!persistent->cells[id].slots[index].valid)
+		return FALSE;
+
+	*key64 = persistent->cells[id].slots[index].key64;
+
+	return TRUE;
+}
+
+int persistent_cache_read_entry(rdpPersistentCache* persistent, UINT32 id, UINT32 index, PERSISTENT_CACHE_ENTRY* entry)
+{
+	wStream* s;
+	PERSISTENT_CACHE_SLOT* slot;
+
+	if (!persistent->fp || (id >= persistent->numCells) || (index >= persistent->cells[id].number))
+		return -1;
+
+	slot = &persistent->cells[id].slots[index];
+
+	if (!slot->valid)
+		return 0;
+
+	s = Stream_New(NULL, slot->length);
+
+	if (!s)
+		return -1;
+
+	if (persistent_cache_read_record(persistent->fp, slot->offset, s) != (int) slot->length)
+	{
+		WLog_ERR(TAG, "corrupted entry %d in cell %d", index, id);
+		slot->valid = FALSE;
+		Stream_Free(s, TRUE);
+		return -1;
+	}
+
+	Stream_Read_UINT64(s, entry->key64); /* key64 (8 bytes) */
+	Stream_Seek(s, 2); /* cellId (1 byte), pad (1 byte) */
+	Stream_Read_UINT16(s, entry->flags); /* flags (2 bytes) */
+	Stream_Seek(s, 4); /* cacheIndex (4 bytes) */
+	Stream_Read_UINT16(s, entry->width); /* width (2 bytes) */
+	Stream_Read_UINT16(s, entry->height); /* height (2 bytes) */
+	Stream_Read_UINT16(s, entry->bpp); /* bpp (2 bytes) */
+	Stream_Seek(s, 2); /* pad (2 bytes) */
+	Stream_Read_UINT32(s, entry->codecId); /* codecId (4 bytes) */
+	Stream_Read_UINT32(s, entry->size); /* size (4 bytes) */
+
+	if (Stream_GetRemainingLength(s) < entry->size)
+	{
+		Stream_Free(s, TRUE);
+		return -1;
+	}
+
+	entry->data = (BYTE*) malloc(entry->size);
+
+	if (!entry->data)
+	{
+		Stream_Free(s, TRUE);
+		return -1;
+	}
+
+	Stream_Read(s, entry->data, entry->size);
+	Stream_Free(s, TRUE);
+
+	return 1;
+}
+
+int persistent_cache_write_entry(rdpPersistentCache* persistent, UINT32 id, UINT32 index, PERSISTENT_CACHE_ENTRY* entry)
+{
+	long offset;
+	wStream* s;
+	PERSISTENT_CACHE_SLOT* slot;
+
+	if (!persistent->fp || !persistent->write)
+		return -1;
+
+	if ((id >= persistent->numCells) || (index >= persistent->cells[id].number))
+		return -1;
+
+	if (!persistent->cells[id].persistent)
+		return 0;
+
+	if (entry->size > PERSISTENT_ENTRY_MAX_SIZE)
+		return 0;
+
+	s = Stream_New(NULL, PERSISTENT_ENTRY_HEADER_LENGTH + entry->size);
+
+	if (!s)
+		return -1;
+
+	Stream_Write_UINT64(s, entry->key64); /* key64 (8 bytes) */
+	Stream_Write_UINT8(s, id); /* cellId (1 byte) */
+	Stream_Write_UINT8(s, 0); /* pad (1 byte) */
+	Stream_Write_UINT16(s, entry->flags); /* flags (2 bytes) */
+	Stream_Write_UINT32(s, index); /* cacheIndex (4 bytes) */
+	Stream_Write_UINT16(s, entry->width); /* width (2 bytes) */
+	Stream_Write_UINT16(s, entry->height); /* height (2 bytes) */
+	Stream_Write_UINT16(s, entry->bpp); /* bpp (2 bytes) */
+	Stream_Write_UINT16(s, 0); /* pad (2 bytes) */
+	Stream_Write_UINT32(s, entry->codecId); /* codecId (4 bytes) */
+	Stream_Write_UINT32(s, entry->size); /* size (4 bytes) */
+	Stream_Write(s, entry->data, entry->size);
+
+	fseek(persistent->fp, 0, SEEK_END);
+	offset = ftell(persistent->fp);
+
+	if ((offset < 0) || (persistent_cache_write_record(persistent->fp, s) < 0) ||
+			(fflush(persistent->fp) != 0))
+	{
+		WLog_ERR(TAG, "failed to write entry %d in cell %d", index, id);
+		Stream_Free(s, TRUE);
+		return -1;
+	}
+
+	slot = &persistent->cells[id].slots[index];
+	slot->valid = TRUE;
+	slot->key64 = entry->key64;
+	slot->offset = (UINT32) offset;
+	slot->length = Stream_GetPosition(s);
+
+	Stream_Free(s, TRUE);
+
+	return 1;
+}
+
+rdpPersistentCache* persistent_cache_new(rdpSettings* settings)
+{
+	UINT32 i;
+	rdpPersistentCache* persistent;
+
+	persistent = (rdpPersistentCache*) calloc(1, sizeof(rdpPersistentCache));
+
+	if (!persistent)
+		return NULL;
+
+	persistent->settings = settings;
+	persistent->numCells = settings->BitmapCacheV2NumCells;
+
+	persistent->cells = (PERSISTENT_CACHE_CELL*) calloc(persistent->numCells, sizeof(PERSISTENT_CACHE_CELL));
+
+	if (!persistent->cells)
+	{
+		free(persistent);
+		return NULL;
+	}
+
+	for (i = 0; i < persistent->numCells; i++)
+	{
+		persistent->cells[i].number = settings->BitmapCacheV2CellInfo[i].numEntries;
+		persistent->cells[i].persistent = settings->BitmapCacheV2CellInfo[i].persistent;
+		persistent->cells[i].slots = (PERSISTENT_CACHE_SLOT*) calloc(persistent->cells[i].number, sizeof(PERSISTENT_CACHE_SLOT));
+
+		if (!persistent->cells[i].slots && persistent->cells[i].number)
+		{
+			persistent->numCells = i;
+			persistent_cache_free(persistent);
+			return NULL;
+		}
+	}
+
+	return persistent;
+}
+
+void persistent_cache_free(rdpPersistentCache* persistent)
+{
+	UINT32 i;
+
+	if (!persistent)
+		return;
+
+	persistent_cache_close(persistent);
+
+	for (i = 0; i < persistent->numCells; i++)
+		free(persistent->cells[i].slots);
+
+	free(persistent->cells);
+	free(persistent);
+}
@@ -0,0 +1,199 @@
+
+#include <stdio.h>
+
+#include <winpr/crt.h>
+#include <winpr/file.h>
+#include <winpr/path.h>
+
+#include <freerdp/settings.h>
+#include <freerdp/cache/persistent.h>
+
+static int test_write_entry(rdpPersistentCache* persistent, UINT32 id, UINT32 index, UINT64 key64)
+{
+	BYTE data[64];
+	PERSISTENT_CACHE_ENTRY entry;
+
+	FillMemory(data, sizeof(data), (BYTE) key64);
+
+	entry.key64 = key64;
+	entry.width = 4;
+	entry.height = 4;
+	entry.bpp = 32;
+	entry.flags = 0;
+	entry.codecId = 0;
+	entry.size = sizeof(data);
+	entry.data = data;
+
+	return persistent_cache_write_entry(persistent, id, index, &entry);
+}
+
+static int test_check_entry(rdpPersistentCache* persistent, UINT32 id, UINT32 index, UINT64 key64)
+{
+	UINT32 i;
+	UINT64 key = 0;
+	PERSISTENT_CACHE_ENTRY entry;
+
+	if (!persistent_cache_get_key(persistent, id, index, &key) || (key != key64))
+	{
+		printf("unexpected key 0x%llX for entry %d in cell %d\n", (unsigned long long) key, index, id);
+		return -1;
+	}
+
+	ZeroMemory(&entry, sizeof(PERSISTENT_CACHE_ENTRY));
+
+	if (persistent_cache_read_entry(persistent, id, index, &entry) < 1)
+	{
+		printf("failed to read entry %d in cell %d\n", index, id);
+		return -1;
+	}
+
+	if ((entry.key64 != key64) || (entry.width != 4) || (entry.height != 4) ||
+			(entry.bpp != 32) || (entry.size != 64))
+	{
+		free(entry.data);
+		return -1;
+	}
+
+	for (i = 0; i < entry.size; i++)
+	{
+		if (entry.data[i] != (BYTE) key64)
+		{
+			free(entry.data);
+			return -1;
+		}
+	}
+
+	free(entry.data);
+
+	return 0;
+}
+
+static int test_check_cache(rdpPersistentCache* persistent)
+{
+	if ((persistent_cache_get_count(persistent, 0) != 3) ||
+			(persistent_cache_get_count(persistent, 1) != 1) ||
+			(persistent_cache_get_count(persistent, 2) != 0))
+	{
+		printf("unexpected entry count %d/%d/%d\n", persistent_cache_get_count(persistent, 0),
+				persistent_cache_get_count(persistent, 1), persistent_cache_get_count(persistent, 2));
+		return -1;
+	}
+
+	if (test_check_entry(persistent, 0, 0, 0x1111111100000001ULL) < 0)
+		return -1;
+
+	if (test_check_entry(persistent, 0, 1, 0x2222222200000012ULL) < 0)
+		return -1;
+
+	if (test_check_entry(persistent, 0, 2, 0x3333333300000003ULL) < 0)
+		return -1;
+
+	if (test_check_entry(persistent, 1, 0, 0x4444444400000004ULL) < 0)
+		return -1;
+
+	return 0;
+}
+
+int TestPersistentCache(int argc, char* argv[])
+{
+	FILE* fp;
+	int status = -1;
+	char* path;
+	char* filename;
+	rdpSettings* settings;
+	rdpPersistentCache* persistent;
+	BYTE torn[16] = { 0x40, 0x00, 0x00, 0x00, 0xAA, 0xBB };
+
+	settings = freerdp_settings_new(0);
+
+	if (!settings)
+		return -1;
+
+	settings->BitmapCachePersistEnabled = TRUE;
+	settings->BitmapCacheV2CellInfo[0].persistent = TRUE;
+	settings->BitmapCacheV2CellInfo[1].persistent = TRUE;
+
+	path = GetKnownPath(KNOWN_PATH_TEMP);
+	filename = GetCombinedPath(path, "TestPersistentCache.bmc");
+	free(path);
+	DeleteFileA(filename);
+
+	persistent = persistent_cache_new(settings);
+
+	if (!persistent)
+		goto out;
+
+	/* nothing to announce without a cache file */
+
+	if (persistent_cache_open(persistent, filename, FALSE) != 0)
+		goto out;
+
+	if (persistent_cache_open(persistent, filename, TRUE) != 1)
+		goto out;
+
+	test_write_entry(persistent, 0, 0, 0x1111111100000001ULL);
+	test_write_entry(persistent, 0, 1, 0x2222222200000002ULL);
+	test_write_entry(persistent, 0, 2, 0x3333333300000003ULL);
+	test_write_entry(persistent, 1, 0, 0x4444444400000004ULL);
+	test_write_entry(persistent, 0, 4, 0x5555555500000005ULL);
+	test_write_entry(persistent, 0, 1, 0x2222222200000012ULL);
+
+	/* entries of cells that are not persistent are not stored */
+
+	if (test_write_entry(persistent, 2, 0, 0x6666666600000006ULL) != 0)
+		goto out;
+
+	persistent_cache_close(persistent);
+
+	if (persistent_cache_open(persistent, filename, FALSE) != 1)
+		goto out;
+
+	if (test_check_cache(persistent) < 0)
+		goto out;
+
+	persistent_cache_close(persistent);
+
+	/* a torn record at the end of the file is ignored, then discarded */
+
+	fp = fopen(filename, "ab");
+
+	if (!fp)
+		goto out;
+
+	fwrite(torn, 1, sizeof(torn), fp);
+	fclose(fp);
+
+	if (persistent_cache_open(persistent, filename, FALSE) != 1)
+		goto out;
+
+	if (test_check_cache(persistent) < 0)
+		goto out;
+
+	if (persistent_cache_open(persistent, filename, TRUE) != 1)
+		goto out;
+
+	if (test_check_cache(persistent) < 0)
+		goto out;
+
+	test_write_entry(persistent, 1, 1, 0x7777777700000007ULL);
+	persistent_cache_close(persistent);
+
+	if (persistent_cache_open(persistent, filename, FALSE) != 1)
+		goto out;
+
+	if (persistent_cache_get_count(persistent, 1) != 2)
+		goto out;
+
+	if (test_check_entry(persistent, 1, 1, 0x7777777700000007ULL) < 0)
+		goto out;
+
+	status = 0;
+
+out:
+	persistent_cache_free(persistent);
+	DeleteFileA(filename);
+	free(filename);
+	freerdp_settings_free(settings);
+
+	return status;
+}
@@ -24,19 +24,449 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 
 #include <winpr/crt.h>
+#include <winpr/synch.h>
 
 #include <freerdp/types.h>
 
 #include <freerdp/codec/dsp.h>
 
+#include "dsp_types.h"
+#include "dsp_sse2.h"
+#include "dsp_neon.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#ifndef DSP_INIT_SIMD
+#define DSP_INIT_SIMD(_prims) do { } while (0)
+#endif
+
 /**
  * Microsoft Multimedia Standards Update
  * http://download.microsoft.com/download/9/8/6/9863C72A-A3AA-4DDB-B1BA-CA8D17EFD2D4/RIFFNEW.pdf
  */
 
-static BOOL freerdp_dsp_resample(FREERDP_DSP_CONTEXT* context,
+static float dsp_dot(const float* src, const float* taps, int count)
+{
+	int i;
+	float sum = 0.0f;
+
+	for (i = 0; i < count; i++)
+		sum += src[i] * taps[i];
+
+	return sum;
+}
+
+static void dsp_s16_to_f32(const INT16* src, float* dst, int samples)
+{
+	int i;
+
+	for (i = 0; i < samples; i++)
+		dst[i] = src[i] / 32768.0f;
+}
+
+static void dsp_f32_to_s16(const float* src, INT16* dst, int samples)
+{
+	int i;
+	float sample;
+
+	for (i = 0; i < samples; i++)
+	{
+		sample = src[i] * 32768.0f;
+
+		if (sample >= 32767.0f)
+			dst[i] = 32767;
+		else if (sample <= -32768.0f)
+			dst[i] = -32768;
+		else
+			dst[i] = (INT16) (sample < 0.0f ? sample - 0.5f : sample + 0.5f);
+	}
+}
+
+static void dsp_mono_to_stereo(const INT16* src, INT16* dst, int frames)
+{
+	int i;
+
+	for (i = 0; i < frames; i++)
+	{
+		dst[i * 2] = src[i];
+		dst[i * 2 + 1] = src[i];
+	}
+}
+
+static void dsp_stereo_to_mono(const INT16* src, INT16* dst, int frames)
+{
+	int i;
+
+	for (i = 0; i < frames; i++)
+		dst[i] = (INT16) ((src[i * 2] + src[i * 2 + 1]) >> 1);
+}
+
+static void dsp_downmix_51_to_stereo(const INT16* src, INT16* dst, int frames)
+{
+	int i;
+	INT32 left, right;
+
+	for (i = 0; i < frames; i++)
+	{
+		left = (src[i * 6] * DSP_DOWNMIX_FRONT + src[i * 6 + 2] * DSP_DOWNMIX_SIDE +
+				src[i * 6 + 4] * DSP_DOWNMIX_SIDE + (1 << 14)) >> 15;
+		right = (src[i * 6 + 1] * DSP_DOWNMIX_FRONT + src[i * 6 + 2] * DSP_DOWNMIX_SIDE +
+				src[i * 6 + 5] * DSP_DOWNMIX_SIDE + (1 << 14)) >> 15;
+
+		dst[i * 2] = (INT16) ((left > 32767) ? 32767 : ((left < -32768) ? -32768 : left));
+		dst[i * 2 + 1] = (INT16) ((right > 32767) ? 32767 : ((right < -32768) ? -32768 : right));
+	}
+}
+
+static FREERDP_DSP_PRIMITIVES g_DspPrimitives;
+static INIT_ONCE g_DspPrimitivesOnce = INIT_ONCE_STATIC_INIT;
+
+static BOOL CALLBACK dsp_primitives_init(PINIT_ONCE once, PVOID param, PVOID* context)
+{
+	FREERDP_DSP_PRIMITIVES* prims = &g_DspPrimitives;
+
+	prims->dot = dsp_dot;
+	prims->s16_to_f32 = dsp_s16_to_f32;
+	prims->f32_to_s16 = dsp_f32_to_s16;
+	prims->mono_to_stereo = dsp_mono_to_stereo;
+	prims->stereo_to_mono = dsp_stereo_to_mono;
+	prims->downmix_51_to_stereo = dsp_downmix_51_to_stereo;
+
+	DSP_INIT_SIMD(prims);
+
+	return TRUE;
+}
+
+static FREERDP_DSP_PRIMITIVES* dsp_get_primitives(void)
+{
+	InitOnceExecuteOnce(&g_DspPrimitivesOnce, dsp_primitives_init, NULL, NULL);
+	return &g_DspPrimitives;
+}
+
+void freerdp_dsp_s16_to_f32(const INT16* src, float* dst, int samples)
+{
+	dsp_get_primitives()->s16_to_f32(src, dst, samples);
+}
+
+void freerdp_dsp_f32_to_s16(const float* src, INT16* dst, int samples)
+{
+	dsp_get_primitives()->f32_to_s16(src, dst, samples);
+}
+
+void freerdp_dsp_mono_to_stereo(const INT16* src, INT16* dst, int frames)
+{
+	dsp_get_primitives()->mono_to_stereo(src, dst, frames);
+}
+
+void freerdp_dsp_stereo_to_mono(const INT16* src, INT16* dst, int frames)
+{
+	dsp_get_primitives()->stereo_to_mono(src, dst, frames);
+}
+
+void freerdp_dsp_downmix_51_to_stereo(const INT16* src, INT16* dst, int frames)
+{
+	dsp_get_primitives()->downmix_51_to_stereo(src, dst, frames);
+}
+
+/**
+ * Polyphase windowed-sinc resampler
+ *
+ * The rate ratio is reduced to L / M. Output sample n lies at input position
+ * n * M / L, kept as an integer index and a phase in [0, L) so that the timing
+ * is exact over any stream length. Each phase selects a row of a precomputed
+ * Kaiser windowed-sinc filter bank; when L exceeds the bank size for the
+ * quality level, the nearest lower row is used. The filter is widened by the
+ * decimation factor when downsampling so that its cutoff follows the lower
+ * of the two Nyquist rates.
+ *
+ * Channels are converted in 16-bit before filtering. The input samples that
+ * the filter still needs are kept between calls, so a stream may be fed in
+ * chunks of any size.
+ */
+
+struct _DSP_RESAMPLER_QUALITY
+{
+	int taps;
+	UINT32 phases;
+	double beta;
+	double rolloff;
+};
+typedef struct _DSP_RESAMPLER_QUALITY DSP_RESAMPLER_QUALITY;
+
+static const DSP_RESAMPLER_QUALITY dsp_resampler_quality[] =
+{
+	{ 8, 256, 5.0, 0.80 },		/* FREERDP_DSP_QUALITY_LOW */
+	{ 16, 512, 7.0, 0.88 },		/* FREERDP_DSP_QUALITY_MEDIUM */
+	{ 32, 1024, 9.0, 0.94 }		/* FREERDP_DSP_QUALITY_HIGH */
+};
+
+#define DSP_RESAMPLER_MAX_TAPS		512
+
+struct _FREERDP_DSP_RESAMPLER
+{
+	int quality;
+	UINT32 srate;
+	UINT32 rrate;
+	UINT32 channels;
+
+	UINT32 L;
+	UINT32 M;
+	UINT32 phase;
+
+	int taps;
+	UINT32 phases;
+	float* bank;
+
+	int history;
+	int length;
+	float* input;
+
+	int outputLength;
+	float* output;
+
+	int mixedLength;
+	INT16* mixed;
+};
+
+static UINT32 dsp_gcd(UINT32 a, UINT32 b)
+{
+	UINT32 t;
+
+	while (b)
+	{
+		t = a % b;
+		a = b;
+		b = t;
+	}
+
+	return a;
+}
+
+/* zeroth order modified Bessel function of the first kind, for the Kaiser window */
+
+static double dsp_bessel_i0(double x)
+{
+	int k;
+	double term = 1.0;
+	double sum = 1.0;
+
+	for (k = 1; k < 64; k++)
+	{
+		term *= (x / (2.0 * k)) * (x / (2.0 * k));
+		sum += term;
+
+		if (term < sum * 1e-12)
+			break;
+	}
+
+	return sum;
+}
+
+static BOOL dsp_resampler_init_bank(FREERDP_DSP_RESAMPLER* resampler)
+{
+	int j;
+	UINT32 row;
+	int taps;
+	int decimation;
+	double d, x, h;
+	double sum;
+	double cutoff;
+	double offset;
+	double i0beta;
+	float* coefficients;
+	const DSP_RESAMPLER_QUALITY* quality = &dsp_resampler_quality[resampler->quality];
+
+	decimation = (int) ((resampler->M + resampler->L - 1) / resampler->L);
+	taps = quality->taps * decimation;
+
+	if (taps > DSP_RESAMPLER_MAX_TAPS)
+		taps = DSP_RESAMPLER_MAX_TAPS;
+
+	/* the index advances by up to the decimation factor per output sample */
+
+	if (taps < decimation + 4)
+		taps = decimation + 4;
+
+	taps = (taps + 3) & ~3;
+
+	resampler->taps = taps;
+	resampler->phases = (resampler->L < quality->phases) ? resampler->L : quality->phases;
+
+	_aligned_free(resampler->bank);
+	resampler->bank = (float*) _aligned_malloc(resampler->phases * taps * sizeof(float), 16);
+
+	if (!resampler->bank)
+		return FALSE;
+
+	/* cutoff in cycles per input sample, below the lower of the two Nyquist rates */
+
+	cutoff = 0.5 * quality->rolloff;
+
+	if (resampler->M > resampler->L)
+		cutoff = cutoff * resampler->L / resampler->M;
+
+	i0beta = dsp_bessel_i0(quality->beta);
+
+	for (row = 0; row < resampler->phases; row++)
+	{
+		sum = 0.0;
+		offset = (taps / 2 - 1) + ((double) row / resampler->phases);
+		coefficients = &resampler->bank[row * taps];
+
+		for (j = 0; j < taps; j++)
+		{
+			d = j - offset;
+			x = d / (taps / 2);
+			h = 2.0 * cutoff;
+
+			if (d != 0.0)
+				h = sin(2.0 * M_PI * cutoff * d) / (M_PI * d);
+
+			if ((x < -1.0) || (x > 1.0))
+				h = 0.0;
+			else
+				h *= dsp_bessel_i0(quality->beta * sqrt(1.0 - x * x)) / i0beta;
+
+			coefficients[j] = (float) h;
+			sum += h;
+		}
+
+		/* unity gain at DC for every phase */
+
+		for (j = 0; j < taps; j++)
+			coefficients[j] = (float) (coefficients[j] / sum);
+	}
+
+	return TRUE;
+}
+
+static void dsp_resampler_free(FREERDP_DSP_RESAMPLER* resampler)
+{
+	if (!resampler)
+		return;
+
+	_aligned_free(resampler->bank);
+	free(resampler->input);
+	free(resampler->output);
+	free(resampler->mixed);
+	free(resampler);
+}
+
+static BOOL dsp_resampler_configure(FREERDP_DSP_CONTEXT* context,
+	UINT32 channels, UINT32 srate, UINT32 rrate)
+{
+	UINT32 gcd;
+	FREERDP_DSP_RESAMPLER* resampler = context->resampler;
+
+	if (!resampler)
+	{
+		resampler = (FREERDP_DSP_RESAMPLER*) calloc(1, sizeof(FREERDP_DSP_RESAMPLER));
+
+		if (!resampler)
+			return FALSE;
+
+		context->resampler = resampler;
+	}
+
+	if ((resampler->srate == srate) && (resampler->rrate == rrate) &&
+			(resampler->channels == channels) && (resampler->quality == context->quality))
+		return TRUE;
+
+	gcd = dsp_gcd(srate, rrate);
+
+	resampler->srate = 0;
+	resampler->quality = context->quality;
+	resampler->L = rrate / gcd;
+	resampler->M = srate / gcd;
+	resampler->phase = 0;
+
+	if (!dsp_resampler_init_bank(resampler))
+		return FALSE;
+
+	/* start centered on the first input sample, with silence before it */
+
+	resampler->history = resampler->taps / 2 - 1;
+
+	free(resampler->input);
+	resampler->input = NULL;
+	resampler->length = 0;
+
+	resampler->srate = srate;
+	resampler->rrate = rrate;
+	resampler->channels = channels;
+
+	return TRUE;
+}
+
+static BOOL dsp_ensure_capacity(void** buffer, int* length, int required, size_t size)
+{
+	void* newBuffer;
+
+	if (required <= *length)
+		return TRUE;
+
+	required += required / 2;
+	newBuffer = realloc(*buffer, required * size);
+
+	if (!newBuffer)
+		return FALSE;
+
+	*buffer = newBuffer;
+	*length = required;
+
+	return TRUE;
+}
+
+static void dsp_convert_channels(FREERDP_DSP_PRIMITIVES* prims, const INT16* src, UINT32 schan,
+	INT16* dst, UINT32 rchan, int frames)
+{
+	int i;
+	UINT32 j;
+
+	if ((schan == 1) && (rchan == 2))
+		prims->mono_to_stereo(src, dst, frames);
+	else if ((schan == 2) && (rchan == 1))
+		prims->stereo_to_mono(src, dst, frames);
+	else if ((schan == 6) && (rchan == 2))
+		prims->downmix_51_to_stereo(src, dst, frames);
+	else
+	{
+		for (i = 0; i < frames; i++)
+		{
+			for (j = 0; j < rchan; j++)
+				dst[i * rchan + j] = src[i * schan + (j % schan)];
+		}
+	}
+}
+
+static BOOL dsp_resampled_ensure_capacity(FREERDP_DSP_CONTEXT* context, int rsize)
+{
+	BYTE* newBuffer;
+
+	if (rsize <= (int) context->resampled_maxlength)
+		return TRUE;
+
+	newBuffer = (BYTE*) realloc(context->resampled_buffer, rsize + 1024);
+
+	if (!newBuffer)
+		return FALSE;
+
+	context->resampled_maxlength = rsize + 1024;
+	context->resampled_buffer = newBuffer;
+
+	return TRUE;
+}
+
+/**
+ * Nearest neighbour resampling, kept for sample sizes other than 16-bit.
+ */
+
+static BOOL freerdp_dsp_resample_nearest(FREERDP_DSP_CONTEXT* context,
 	const BYTE* src, int bytes_per_sample,
 	UINT32 schan, UINT32 srate, int sframes,
 	UINT32 rchan, UINT32 rrate)
@@ -54,15 +484,9 @@ static BOOL freerdp_dsp_resample(FREERDP_DSP_CONTEXT* context,
 	rframes = sframes * rrate / srate;
 	rsize = rbytes * rframes;
 
-	if (rsize > (int) context->resampled_maxlength)
-	{
-		BYTE *newBuffer = (BYTE*) realloc(context->resampled_buffer, rsize + 1024);
-		if (!newBuffer)
-			return FALSE;
+	if (!dsp_resampled_ensure_capacity(context, rsize))
+		return FALSE;
 
-		context->resampled_maxlength = rsize + 1024;
-		context->resampled_buffer = newBuffer;
-	}
 	dst = context->resampled_buffer;
 
 	p = dst;
@@ -90,6 +514,181 @@ static BOOL freerdp_dsp_resample(FREERDP_DSP_CONTEXT* context,
 	return TRUE;
 }
 
+static BOOL freerdp_dsp_resample(FREERDP_DSP_CONTEXT* context,
+	const BYTE* src, int bytes_per_sample,
+	UINT32 schan, UINT32 srate, int sframes,
+	UINT32 rchan, UINT32 rrate)
+{
+	int i;
+	int index;
+	int avail;
+	int taps;
+	int rframes;
+	int maxframes;
+	UINT32 j;
+	UINT32 row;
+	UINT32 phase;
+	float* input;
+	float* output;
+	const float* coefficients;
+	const INT16* mixed;
+	FREERDP_DSP_RESAMPLER* resampler;
+	FREERDP_DSP_PRIMITIVES* prims = dsp_get_primitives();
+
+	if (!srate || !rrate || !schan || !rchan)
+		return FALSE;
+
+	if (bytes_per_sample != 2)
+		return freerdp_dsp_resample_nearest(context, src, bytes_per_sample,
+				schan, srate, sframes, rchan, rrate);
+
+	mixed = (const INT16*) src;
+
+	if (schan != rchan)
+	{
+		if (srate == rrate)
+		{
+			if (!dsp_resampled_ensure_capacity(context, sframes * rchan * 2))
+				return FALSE;
+
+			dsp_convert_channels(prims, mixed, schan, (INT16*) context->resampled_buffer, rchan, sframes);
+			context->resampled_frames = sframes;
+			context->resampled_size = sframes * rchan * 2;
+			return TRUE;
+		}
+
+		if (!dsp_resampler_configure(context, rchan, srate, rrate))
+			return FALSE;
+
+		resampler = context->resampler;
+
+		if (!dsp_ensure_capacity((void**) &resampler->mixed, &resampler->mixedLength,
+				sframes * rchan, sizeof(INT16)))
+			return FALSE;
+
+		dsp_convert_channels(prims, mixed, schan, resampler->mixed, rchan, sframes);
+		mixed = resampler->mixed;
+	}
+	else if (srate == rrate)
+	{
+		if (!dsp_resampled_ensure_capacity(context, sframes * rchan * 2))
+			return FALSE;
+
+		CopyMemory(context->resampled_buffer, src, sframes * rchan * 2);
+		context->resampled_frames = sframes;
+		context->resampled_size = sframes * rchan * 2;
+		return TRUE;
+	}
+	else if (!dsp_resampler_configure(context, rchan, srate, rrate))
+		return FALSE;
+
+	resampler = context->resampler;
+	taps = resampler->taps;
+	avail = resampler->history + sframes;
+
+	/* planar input, each channel led by the samples kept from the previous call */
+
+	if (avail > resampler->length)
+	{
+		input = (float*) calloc(avail * rchan, sizeof(float));
+
+		if (!input)
+			return FALSE;
+
+		for (j = 0; j < rchan; j++)
+		{
+			if (resampler->input)
+				CopyMemory(&input[j * avail], &resampler->input[j * resampler->length],
+						resampler->history * sizeof(float));
+		}
+
+		free(resampler->input);
+		resampler->input = input;
+		resampler->length = avail;
+	}
+
+	input = resampler->input;
+
+	if (rchan == 1)
+	{
+		prims->s16_to_f32(mixed, &input[resampler->history], sframes);
+	}
+	else
+	{
+		for (i = 0; i < sframes; i++)
+		{
+			for (j = 0; j < rchan; j++)
+				input[j * resampler->length + resampler->history + i] = mixed[i * rchan + j] / 32768.0f;
+		}
+	}
+
+	maxframes = (int) (((UINT64) avail * resampler->L) / resampler->M) + 2;
+
+	if (!dsp_ensure_capacity((void**) &resampler->output, &resampler->outputLength,
+			maxframes * rchan, sizeof(float)))
+		return FALSE;
+
+	output = resampler->output;
+	rframes = 0;
+	index = 0;
+	phase = resampler->phase;
+
+	while (index + taps <= avail)
+	{
+		if (resampler->phases == resampler->L)
+			row = phase;
+		else
+			row = (UINT32) (((UINT64) phase * resampler->phases) / resampler->L);
+
+		coefficients = &resampler->bank[row * taps];
+
+		for (j = 0; j < rchan; j++)
+			output[rframes * rchan + j] = prims->dot(&input[j * resampler->length + index], coefficients, taps);
+
+		rframes++;
+		phase += resampler->M;
+		index += phase / resampler->L;
+		phase %= resampler->L;
+	}
+
+	/* keep the samples the next output still needs */
+
+	resampler->phase = phase;
+	resampler->history = avail - index;
+
+	for (j = 0; j < rchan; j++)
+	{
+		MoveMemory(&input[j * resampler->length], &input[j * resampler->length + index],
+				resampler->history * sizeof(float));
+	}
+
+	if (!dsp_resampled_ensure_capacity(context, rframes * rchan * 2))
+		return FALSE;
+
+	prims->f32_to_s16(output, (INT16*) context->resampled_buffer, rframes * rchan);
+
+	context->resampled_frames = rframes;
+	context->resampled_size = rframes * rchan * 2;
+	return TRUE;
+}
+
+void freerdp_dsp_context_set_quality(FREERDP_DSP_CONTEXT* context, int quality)
+{
+	if (quality < FREERDP_DSP_QUALITY_LOW)
+		quality = FREERDP_DSP_QUALITY_LOW;
+
+	if (quality > FREERDP_DSP_QUALITY_HIGH)
+		quality = FREERDP_DSP_QUALITY_HIGH;
+
+	context->quality = quality;
+}
+
+void freerdp_dsp_context_reset_resampler(FREERDP_DSP_CONTEXT* context)
+{
+	if (context->resampler)
+		context->resampler->srate = 0;
+}
+
 /**
  * Microsoft IMA ADPCM specification:
  *
@@ -681,6 +1280,8 @@ FREERDP_DSP_CONTEXT* freerdp_dsp_context_new(void)
 	if (!context)
 		return NULL;
 
+	context->quality = FREERDP_DSP_QUALITY_MEDIUM;
+
 	context->resample = freerdp_dsp_resample;
 	context->decode_ima_adpcm = freerdp_dsp_decode_ima_adpcm;
 	context->encode_ima_adpcm = freerdp_dsp_encode_ima_adpcm;
@@ -700,6 +1301,8 @@ void freerdp_dsp_context_free(FREERDP_DSP_CONTEXT* context)
 		if (context->adpcm_buffer)
 			free(context->adpcm_buffer);
 
+		dsp_resampler_free(context->resampler);
+
 		free(context);
 	}
 }
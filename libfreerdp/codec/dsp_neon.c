@@ -0,0 +1,208 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Digital Sound Processing - NEON Optimizations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#if defined(__ARM_NEON__)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arm_neon.h>
+#include <winpr/sysinfo.h>
+
+#include "dsp_types.h"
+#include "dsp_neon.h"
+
+static float dsp_dot_NEON(const float* src, const float* taps, int count)
+{
+	int i;
+	float32x2_t sum;
+	float32x4_t acc0 = vdupq_n_f32(0.0f);
+	float32x4_t acc1 = vdupq_n_f32(0.0f);
+
+	for (i = 0; i + 8 <= count; i += 8)
+	{
+		acc0 = vmlaq_f32(acc0, vld1q_f32(&src[i]), vld1q_f32(&taps[i]));
+		acc1 = vmlaq_f32(acc1, vld1q_f32(&src[i + 4]), vld1q_f32(&taps[i + 4]));
+	}
+
+	if (i < count)
+		acc0 = vmlaq_f32(acc0, vld1q_f32(&src[i]), vld1q_f32(&taps[i]));
+
+	acc0 = vaddq_f32(acc0, acc1);
+	sum = vadd_f32(vget_low_f32(acc0), vget_high_f32(acc0));
+	sum = vpadd_f32(sum, sum);
+
+	return vget_lane_f32(sum, 0);
+}
+
+static void dsp_s16_to_f32_NEON(const INT16* src, float* dst, int samples)
+{
+	int i;
+	int16x8_t v;
+
+	for (i = 0; i + 8 <= samples; i += 8)
+	{
+		v = vld1q_s16(&src[i]);
+		vst1q_f32(&dst[i], vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(v))), 1.0f / 32768.0f));
+		vst1q_f32(&dst[i + 4], vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(v))), 1.0f / 32768.0f));
+	}
+
+	for (; i < samples; i++)
+		dst[i] = src[i] / 32768.0f;
+}
+
+static INLINE int16x4_t dsp_f32_to_s16_block_NEON(const float* src)
+{
+	float32x4_t v;
+	float32x4_t half;
+
+	v = vmulq_n_f32(vld1q_f32(src), 32768.0f);
+	v = vminq_f32(vmaxq_f32(v, vdupq_n_f32(-32768.0f)), vdupq_n_f32(32767.0f));
+
+	/* vcvtq truncates towards zero: round half away from zero first */
+	half = vbslq_f32(vcltq_f32(v, vdupq_n_f32(0.0f)), vdupq_n_f32(-0.5f), vdupq_n_f32(0.5f));
+
+	return vqmovn_s32(vcvtq_s32_f32(vaddq_f32(v, half)));
+}
+
+static void dsp_f32_to_s16_NEON(const float* src, INT16* dst, int samples)
+{
+	int i;
+	float sample;
+
+	for (i = 0; i + 8 <= samples; i += 8)
+	{
+		vst1q_s16(&dst[i], vcombine_s16(dsp_f32_to_s16_block_NEON(&src[i]),
+				dsp_f32_to_s16_block_NEON(&src[i + 4])));
+	}
+
+	for (; i < samples; i++)
+	{
+		sample = src[i] * 32768.0f;
+
+		if (sample >= 32767.0f)
+			dst[i] = 32767;
+		else if (sample <= -32768.0f)
+			dst[i] = -32768;
+		else
+			dst[i] = (INT16) (sample < 0.0f ? sample - 0.5f : sample + 0.5f);
+	}
+}
+
+static void dsp_mono_to_stereo_NEON(const INT16* src, INT16* dst, int frames)
+{
+	int i;
+	int16x8x2_t v;
+
+	for (i = 0; i + 8 <= frames; i += 8)
+	{
+		v.val[0] = vld1q_s16(&src[i]);
+		v.val[1] = v.val[0];
+		vst2q_s16(&dst[i * 2], v);
+	}
+
+	for (; i < frames; i++)
+	{
+		dst[i * 2] = src[i];
+		dst[i * 2 + 1] = src[i];
+	}
+}
+
+static void dsp_stereo_to_mono_NEON(const INT16* src, INT16* dst, int frames)
+{
+	int i;
+	int16x8x2_t v;
+
+	for (i = 0; i + 8 <= frames; i += 8)
+	{
+		v = vld2q_s16(&src[i * 2]);
+		vst1q_s16(&dst[i], vhaddq_s16(v.val[0], v.val[1]));
+	}
+
+	for (; i < frames; i++)
+		dst[i] = (INT16) ((src[i * 2] + src[i * 2 + 1]) >> 1);
+}
+
+/**
+ * Loading four frames as triplets leaves FL LFE, FR SL and FC SR alternating
+ * in the three registers, which unzip into per-channel halves.
+ */
+
+static void dsp_downmix_51_to_stereo_NEON(const INT16* src, INT16* dst, int frames)
+{
+	int i;
+	INT32 left, right;
+	int16x8x3_t v;
+	int16x8x2_t front;
+	int16x8x2_t center;
+	int16x4_t side[2];
+	int32x4_t acc;
+	int16x4x2_t out;
+
+	for (i = 0; i + 4 <= frames; i += 4)
+	{
+		v = vld3q_s16(&src[i * 6]);
+
+		front = vuzpq_s16(v.val[0], v.val[1]); /* FL FR, LFE SL */
+		center = vuzpq_s16(v.val[2], v.val[2]); /* FC FC, SR SR */
+
+		side[0] = vget_high_s16(front.val[1]);
+		side[1] = vget_high_s16(center.val[1]);
+
+		acc = vmull_n_s16(vget_low_s16(front.val[0]), DSP_DOWNMIX_FRONT);
+		acc = vmlal_n_s16(acc, vget_low_s16(center.val[0]), DSP_DOWNMIX_SIDE);
+		acc = vmlal_n_s16(acc, side[0], DSP_DOWNMIX_SIDE);
+		out.val[0] = vqrshrn_n_s32(acc, 15);
+
+		acc = vmull_n_s16(vget_high_s16(front.val[0]), DSP_DOWNMIX_FRONT);
+		acc = vmlal_n_s16(acc, vget_low_s16(center.val[0]), DSP_DOWNMIX_SIDE);
+		acc = vmlal_n_s16(acc, side[1], DSP_DOWNMIX_SIDE);
+		out.val[1] = vqrshrn_n_s32(acc, 15);
+
+		vst2_s16(&dst[i * 2], out);
+	}
+
+	for (; i < frames; i++)
+	{
+		left = (src[i * 6] * DSP_DOWNMIX_FRONT + src[i * 6 + 2] * DSP_DOWNMIX_SIDE +
+				src[i * 6 + 4] * DSP_DOWNMIX_SIDE + (1 << 14)) >> 15;
+		right = (src[i * 6 + 1] * DSP_DOWNMIX_FRONT + src[i * 6 + 2] * DSP_DOWNMIX_SIDE +
+				src[i * 6 + 5] * DSP_DOWNMIX_SIDE + (1 << 14)) >> 15;
+
+		dst[i * 2] = (INT16) ((left > 32767) ? 32767 : ((left < -32768) ? -32768 : left));
+		dst[i * 2 + 1] = (INT16) ((right > 32767) ? 32767 : ((right < -32768) ? -32768 : right));
+	}
+}
+
+void dsp_init_neon(FREERDP_DSP_PRIMITIVES* prims)
+{
+	if (!IsProcessorFeaturePresent(PF_ARM_NEON_INSTRUCTIONS_AVAILABLE))
+		return;
+
+	prims->dot = dsp_dot_NEON;
+	prims->s16_to_f32 = dsp_s16_to_f32_NEON;
+	prims->f32_to_s16 = dsp_f32_to_s16_NEON;
+	prims->mono_to_stereo = dsp_mono_to_stereo_NEON;
+	prims->stereo_to_mono = dsp_stereo_to_mono_NEON;
+	prims->downmix_51_to_stereo = dsp_downmix_51_to_stereo_NEON;
+}
+
+#endif /* __ARM_NEON__ */
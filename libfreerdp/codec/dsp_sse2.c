@@ -0,0 +1,208 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Digital Sound Processing - SSE2 Optimizations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <winpr/sysinfo.h>
+
+#include <xmmintrin.h>
+#include <emmintrin.h>
+
+#include "dsp_types.h"
+#include "dsp_sse2.h"
+
+static float dsp_dot_sse2(const float* src, const float* taps, int count)
+{
+	int i;
+	float result;
+	__m128 acc0 = _mm_setzero_ps();
+	__m128 acc1 = _mm_setzero_ps();
+
+	for (i = 0; i + 8 <= count; i += 8)
+	{
+		acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(&src[i]), _mm_load_ps(&taps[i])));
+		acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(&src[i + 4]), _mm_load_ps(&taps[i + 4])));
+	}
+
+	if (i < count)
+		acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(&src[i]), _mm_load_ps(&taps[i])));
+
+	acc0 = _mm_add_ps(acc0, acc1);
+	acc0 = _mm_add_ps(acc0, _mm_movehl_ps(acc0, acc0));
+	acc0 = _mm_add_ss(acc0, _mm_shuffle_ps(acc0, acc0, 1));
+	_mm_store_ss(&result, acc0);
+
+	return result;
+}
+
+static void dsp_s16_to_f32_sse2(const INT16* src, float* dst, int samples)
+{
+	int i;
+	__m128i v;
+	const __m128 scale = _mm_set1_ps(1.0f / 32768.0f);
+
+	for (i = 0; i + 8 <= samples; i += 8)
+	{
+		v = _mm_loadu_si128((const __m128i*) &src[i]);
+
+		_mm_storeu_ps(&dst[i], _mm_mul_ps(scale,
+				_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16))));
+		_mm_storeu_ps(&dst[i + 4], _mm_mul_ps(scale,
+				_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16))));
+	}
+
+	for (; i < samples; i++)
+		dst[i] = src[i] / 32768.0f;
+}
+
+static void dsp_f32_to_s16_sse2(const float* src, INT16* dst, int samples)
+{
+	int i;
+	__m128i lo, hi;
+	float sample;
+	const __m128 scale = _mm_set1_ps(32768.0f);
+	const __m128 min = _mm_set1_ps(-32768.0f);
+	const __m128 max = _mm_set1_ps(32767.0f);
+
+	for (i = 0; i + 8 <= samples; i += 8)
+	{
+		lo = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(&src[i]), scale), min), max));
+		hi = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(&src[i + 4]), scale), min), max));
+		_mm_storeu_si128((__m128i*) &dst[i], _mm_packs_epi32(lo, hi));
+	}
+
+	for (; i < samples; i++)
+	{
+		sample = src[i] * 32768.0f;
+
+		if (sample >= 32767.0f)
+			dst[i] = 32767;
+		else if (sample <= -32768.0f)
+			dst[i] = -32768;
+		else
+			dst[i] = (INT16) (sample < 0.0f ? sample - 0.5f : sample + 0.5f);
+	}
+}
+
+static void dsp_mono_to_stereo_sse2(const INT16* src, INT16* dst, int frames)
+{
+	int i;
+	__m128i v;
+
+	for (i = 0; i + 8 <= frames; i += 8)
+	{
+		v = _mm_loadu_si128((const __m128i*) &src[i]);
+		_mm_storeu_si128((__m128i*) &dst[i * 2], _mm_unpacklo_epi16(v, v));
+		_mm_storeu_si128((__m128i*) &dst[i * 2 + 8], _mm_unpackhi_epi16(v, v));
+	}
+
+	for (; i < frames; i++)
+	{
+		dst[i * 2] = src[i];
+		dst[i * 2 + 1] = src[i];
+	}
+}
+
+static void dsp_stereo_to_mono_sse2(const INT16* src, INT16* dst, int frames)
+{
+	int i;
+	__m128i lo, hi;
+	const __m128i ones = _mm_set1_epi16(1);
+
+	for (i = 0; i + 8 <= frames; i += 8)
+	{
+		lo = _mm_madd_epi16(_mm_loadu_si128((const __m128i*) &src[i * 2]), ones);
+		hi = _mm_madd_epi16(_mm_loadu_si128((const __m128i*) &src[i * 2 + 8]), ones);
+		_mm_storeu_si128((__m128i*) &dst[i],
+				_mm_packs_epi32(_mm_srai_epi32(lo, 1), _mm_srai_epi32(hi, 1)));
+	}
+
+	for (; i < frames; i++)
+		dst[i] = (INT16) ((src[i * 2] + src[i * 2 + 1]) >> 1);
+}
+
+/**
+ * Reorders a frame to FL FC FR FC SL x SR x, so that a single multiply-add
+ * against the downmix coefficients leaves the front and side sums of each
+ * output channel in adjacent 32-bit lanes.
+ */
+
+static INLINE __m128i dsp_downmix_frame_sse2(const INT16* src, const __m128i coefficients)
+{
+	__m128i v;
+
+	v = _mm_loadu_si128((const __m128i*) src);
+	v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 1, 2, 0));
+	v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(3, 1, 2, 0));
+	v = _mm_madd_epi16(v, coefficients);
+
+	return _mm_add_epi32(v, _mm_srli_si128(v, 8));
+}
+
+static void dsp_downmix_51_to_stereo_sse2(const INT16* src, INT16* dst, int frames)
+{
+	int i;
+	INT32 left, right;
+	__m128i f0, f1, f2, f3;
+	const __m128i round = _mm_set1_epi32(1 << 14);
+	const __m128i coefficients = _mm_setr_epi16(DSP_DOWNMIX_FRONT, DSP_DOWNMIX_SIDE,
+			DSP_DOWNMIX_FRONT, DSP_DOWNMIX_SIDE, DSP_DOWNMIX_SIDE, 0, DSP_DOWNMIX_SIDE, 0);
+
+	/* each frame load reads two samples of the next frame */
+
+	for (i = 0; i + 4 < frames; i += 4)
+	{
+		f0 = dsp_downmix_frame_sse2(&src[i * 6], coefficients);
+		f1 = dsp_downmix_frame_sse2(&src[i * 6 + 6], coefficients);
+		f2 = dsp_downmix_frame_sse2(&src[i * 6 + 12], coefficients);
+		f3 = dsp_downmix_frame_sse2(&src[i * 6 + 18], coefficients);
+
+		f0 = _mm_srai_epi32(_mm_add_epi32(_mm_unpacklo_epi64(f0, f1), round), 15);
+		f2 = _mm_srai_epi32(_mm_add_epi32(_mm_unpacklo_epi64(f2, f3), round), 15);
+
+		_mm_storeu_si128((__m128i*) &dst[i * 2], _mm_packs_epi32(f0, f2));
+	}
+
+	for (; i < frames; i++)
+	{
+		left = (src[i * 6] * DSP_DOWNMIX_FRONT + src[i * 6 + 2] * DSP_DOWNMIX_SIDE +
+				src[i * 6 + 4] * DSP_DOWNMIX_SIDE + (1 << 14)) >> 15;
+		right = (src[i * 6 + 1] * DSP_DOWNMIX_FRONT + src[i * 6 + 2] * DSP_DOWNMIX_SIDE +
+				src[i * 6 + 5] * DSP_DOWNMIX_SIDE + (1 << 14)) >> 15;
+
+		dst[i * 2] = (INT16) ((left > 32767) ? 32767 : ((left < -32768) ? -32768 : left));
+		dst[i * 2 + 1] = (INT16) ((right > 32767) ? 32767 : ((right < -32768) ? -32768 : right));
+	}
+}
+
+void dsp_init_sse2(FREERDP_DSP_PRIMITIVES* prims)
+{
+	if (!IsProcessorFeaturePresent(PF_XMMI64_INSTRUCTIONS_AVAILABLE))
+		return;
+
+	prims->dot = dsp_dot_sse2;
+	prims->s16_to_f32 = dsp_s16_to_f32_sse2;
+	prims->f32_to_s16 = dsp_f32_to_s16_sse2;
+	prims->mono_to_stereo = dsp_mono_to_stereo_sse2;
+	prims->stereo_to_mono = dsp_stereo_to_mono_sse2;
+	prims->downmix_51_to_stereo = dsp_downmix_51_to_stereo_sse2;
+}
@@ -0,0 +1,52 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Digital Sound Processing
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __DSP_TYPES_H
+#define __DSP_TYPES_H
+
+#include <freerdp/types.h>
+#include <freerdp/codec/dsp.h>
+
+/**
+ * 5.1 to stereo downmix coefficients in Q15: each front channel is mixed
+ * with the center and its surround channel at -3 dB, and the sum is scaled
+ * by 1 / (1 + 2 * 0.7071) so that full scale input does not clip.
+ * The low frequency channel is dropped.
+ */
+
+#define DSP_DOWNMIX_FRONT	13573
+#define DSP_DOWNMIX_SIDE	9598
+
+/**
+ * Sample processing kernels, replaced by SSE2 or NEON versions when available.
+ * The filter taps passed to dot are a multiple of 4 and 16 byte aligned.
+ */
+
+struct _FREERDP_DSP_PRIMITIVES
+{
+	float (*dot)(const float* src, const float* taps, int count);
+
+	void (*s16_to_f32)(const INT16* src, float* dst, int samples);
+	void (*f32_to_s16)(const float* src, INT16* dst, int samples);
+
+	void (*mono_to_stereo)(const INT16* src, INT16* dst, int frames);
+	void (*stereo_to_mono)(const INT16* src, INT16* dst, int frames);
+	void (*downmix_51_to_stereo)(const INT16* src, INT16* dst, int frames);
+};
+typedef struct _FREERDP_DSP_PRIMITIVES FREERDP_DSP_PRIMITIVES;
+
+#endif /* __DSP_TYPES_H */
@@ -21,17 +21,27 @@
 #include "config.h"
 #endif
 
+#include <winpr/crt.h>
+#include <winpr/pool.h>
 #include <winpr/stream.h>
+#include <winpr/sysinfo.h>
 
+#include <freerdp/log.h>
 #include <freerdp/codec/color.h>
+#include <freerdp/utils/profiler.h>
 
 #include <freerdp/codec/jpeg.h>
 
+#define TAG FREERDP_TAG("codec.jpeg")
+
 #ifdef WITH_JPEG
 
+#include <setjmp.h>
+
 #define XMD_H
 
 #include <jpeglib.h>
+#include <jerror.h>
 
 struct mydata_decomp
 {
@@ -148,6 +158,574 @@ BOOL jpeg_decompress(BYTE* input, BYTE* output, int width, int height, int size,
 	return 1;
 }
 
+/**
+ * Encoder
+ *
+ * A bitmap is cut into horizontal slices of whole MCU rows, compressed in
+ * parallel by compress objects which are kept from one bitmap to the next.
+ * Every MCU row is a restart interval, so the slices can be joined into a
+ * single image: the headers of the first slice, then the entropy coded data
+ * of all of them separated by restart markers, renumbered to follow each
+ * other. The result is the image a single compress object would write.
+ */
+
+#define JPEG_MAX_SLICES		16
+#define JPEG_SLICE_MIN_SIZE	(128 * 128)
+
+#define JPEG_MARKER_SOF0	0xC0
+#define JPEG_MARKER_RST0	0xD0
+#define JPEG_MARKER_EOI		0xD9
+#define JPEG_MARKER_SOS		0xDA
+
+struct _JPEG_ERROR_MGR
+{
+	struct jpeg_error_mgr pub;
+	jmp_buf jump;
+};
+typedef struct _JPEG_ERROR_MGR JPEG_ERROR_MGR;
+
+struct _JPEG_SLICE
+{
+	struct jpeg_compress_struct cinfo;
+	struct jpeg_destination_mgr dest;
+	JPEG_ERROR_MGR err;
+	BOOL initialized;
+	J_COLOR_SPACE colorSpace;
+	int quality;
+
+	BYTE* buffer;
+	UINT32 capacity;
+	UINT32 size;
+
+	const BYTE* pSrcData;
+	int nSrcStep;
+	int width;
+	int height;
+	BYTE* row;
+	int status;
+};
+typedef struct _JPEG_SLICE JPEG_SLICE;
+
+struct _JPEG_CONTEXT
+{
+	int quality;
+	int maxSlices;
+	BOOL UseThreads;
+
+	JPEG_SLICE slices[JPEG_MAX_SLICES];
+
+	BYTE* buffer;
+	UINT32 capacity;
+};
+
+static void jpeg_encoder_error_exit(j_common_ptr cinfo)
+{
+	char message[JMSG_LENGTH_MAX];
+	JPEG_ERROR_MGR* err = (JPEG_ERROR_MGR*) cinfo->err;
+
+	(*cinfo->err->format_message)(cinfo, message);
+	WLog_ERR(TAG, "%s", message);
+
+	longjmp(err->jump, 1);
+}
+
+static void jpeg_encoder_output_message(j_common_ptr cinfo)
+{
+
+}
+
+static void jpeg_encoder_init_destination(j_compress_ptr cinfo)
+{
+	JPEG_SLICE* slice = (JPEG_SLICE*) cinfo->client_data;
+
+	slice->dest.next_output_byte = slice->buffer;
+	slice->dest.free_in_buffer = slice->capacity;
+}
+
+static boolean jpeg_encoder_empty_output_buffer(j_compress_ptr cinfo)
+{
+	BYTE* buffer;
+	UINT32 capacity;
+	JPEG_SLICE* slice = (JPEG_SLICE*) cinfo->client_data;
+
+	/* called with the whole buffer full */
+	capacity = slice->capacity * 2;
+	buffer = (BYTE*) realloc(slice->buffer, capacity);
+
+	if (!buffer)
+		ERREXIT(cinfo, JERR_OUT_OF_MEMORY);
+
+	slice->dest.next_output_byte = &buffer[slice->capacity];
+	slice->dest.free_in_buffer = capacity - slice->capacity;
+	slice->buffer = buffer;
+	slice->capacity = capacity;
+
+	return TRUE;
+}
+
+static void jpeg_encoder_term_destination(j_compress_ptr cinfo)
+{
+	JPEG_SLICE* slice = (JPEG_SLICE*) cinfo->client_data;
+
+	slice->size = slice->capacity - (UINT32) slice->dest.free_in_buffer;
+}
+
+static BOOL jpeg_slice_init(JPEG_SLICE* slice)
+{
+	slice->capacity = 64 * 1024;
+	slice->buffer = (BYTE*) malloc(slice->capacity);
+
+	if (!slice->buffer)
+		return FALSE;
+
+	slice->cinfo.err = jpeg_std_error(&slice->err.pub);
+	slice->err.pub.error_exit = jpeg_encoder_error_exit;
+	slice->err.pub.output_message = jpeg_encoder_output_message;
+
+	if (setjmp(slice->err.jump))
+	{
+		jpeg_destroy_compress(&slice->cinfo);
+		return FALSE;
+	}
+
+	jpeg_create_compress(&slice->cinfo);
+
+	slice->dest.init_destination = jpeg_encoder_init_destination;
+	slice->dest.empty_output_buffer = jpeg_encoder_empty_output_buffer;
+	slice->dest.term_destination = jpeg_encoder_term_destination;
+
+	slice->cinfo.dest = &slice->dest;
+	slice->cinfo.client_data = slice;
+	slice->colorSpace = JCS_UNKNOWN;
+	slice->initialized = TRUE;
+
+	return TRUE;
+}
+
+static void jpeg_slice_uninit(JPEG_SLICE* slice)
+{
+	if (slice->initialized)
+		jpeg_destroy_compress(&slice->cinfo);
+
+	free(slice->buffer);
+	free(slice->row);
+
+	ZeroMemory(slice, sizeof(JPEG_SLICE));
+}
+
+/**
+ * The parameters only change with the pixel format or the quality. Every
+ * MCU row is a restart interval, and the standard Huffman tables are used:
+ * the slices must share them.
+ */
+
+static BOOL jpeg_slice_setup(JPEG_SLICE* slice, J_COLOR_SPACE colorSpace, int quality)
+{
+	struct jpeg_compress_struct* cinfo = &slice->cinfo;
+
+	if ((slice->colorSpace == colorSpace) && (slice->quality == quality))
+		return TRUE;
+
+	if (setjmp(slice->err.jump))
+	{
+		slice->colorSpace = JCS_UNKNOWN;
+		return FALSE;
+	}
+
+	cinfo->in_color_space = colorSpace;
+	cinfo->input_components = (colorSpace == JCS_RGB) ? 3 : 4;
+
+	jpeg_set_defaults(cinfo);
+	jpeg_set_quality(cinfo, quality, TRUE);
+
+	cinfo->optimize_coding = FALSE;
+	cinfo->restart_in_rows = 1;
+
+	slice->colorSpace = colorSpace;
+	slice->quality = quality;
+
+	return TRUE;
+}
+
+static void jpeg_slice_compress(JPEG_SLICE* slice)
+{
+	int i;
+	int count;
+	JSAMPROW rows[16];
+	struct jpeg_compress_struct* cinfo = &slice->cinfo;
+
+	slice->status = -1;
+
+	if (setjmp(slice->err.jump))
+	{
+		jpeg_abort_compress(cinfo);
+		return;
+	}
+
+	cinfo->image_width = slice->width;
+	cinfo->image_height = slice->height;
+
+	jpeg_start_compress(cinfo, TRUE);
+
+	while (cinfo->next_scanline < cinfo->image_height)
+	{
+#ifdef JCS_EXTENSIONS
+		count = cinfo->image_height - cinfo->next_scanline;
+
+		if (count > 16)
+			count = 16;
+
+		for (i = 0; i < count; i++)
+			rows[i] = (JSAMPROW) &slice->pSrcData[(cinfo->next_scanline + i) * slice->nSrcStep];
+#else
+		const BYTE* src = &slice->pSrcData[cinfo->next_scanline * slice->nSrcStep];
+
+		/* B8G8R8X8 to R8G8B8 */
+		for (i = 0; i < slice->width; i++)
+		{
+			slice->row[i * 3 + 0] = src[i * 4 + 2];
+			slice->row[i * 3 + 1] = src[i * 4 + 1];
+			slice->row[i * 3 + 2] = src[i * 4 + 0];
+		}
+
+		rows[0] = slice->row;
+		count = 1;
+#endif
+
+		jpeg_write_scanlines(cinfo, rows, count);
+	}
+
+	jpeg_finish_compress(cinfo);
+
+	slice->status = 1;
+}
+
+static void CALLBACK jpeg_slice_work_callback(PTP_CALLBACK_INSTANCE instance, void* context, PTP_WORK work)
+{
+	jpeg_slice_compress((JPEG_SLICE*) context);
+}
+
+/**
+ * Finds the entropy coded data of a slice, between the end of the start of
+ * scan segment and the end of image marker.
+ */
+
+static BOOL jpeg_slice_find_scan(JPEG_SLICE* slice, UINT32* scanOffset, UINT32* scanLength)
+{
+	UINT32 offset = 2;
+	UINT32 length;
+	BYTE* data = slice->buffer;
+
+	if ((slice->size < 4) || (data[0] != 0xFF) || (data[slice->size - 2] != 0xFF) ||
+			(data[slice->size - 1] != JPEG_MARKER_EOI))
+		return FALSE;
+
+	while (offset + 4 <= slice->size)
+	{
+		if (data[offset] != 0xFF)
+			return FALSE;
+
+		length = (data[offset + 2] << 8) | data[offset + 3];
+
+		if (data[offset + 1] == JPEG_MARKER_SOS)
+		{
+			*scanOffset = offset + 2 + length;
+			*scanLength = (slice->size - 2) - *scanOffset;
+			return (*scanOffset <= slice->size - 2) ? TRUE : FALSE;
+		}
+
+		offset += 2 + length;
+	}
+
+	return FALSE;
+}
+
+/**
+ * Copies the entropy coded data of a slice, restarting the restart marker
+ * numbering at the given index.
+ */
+
+static BYTE* jpeg_copy_scan(BYTE* dst, const BYTE* src, UINT32 length, int* restartIndex)
+{
+	UINT32 i;
+
+	for (i = 0; i < length; i++)
+	{
+		*dst++ = src[i];
+
+		if ((src[i] == 0xFF) && (i + 1 < length) &&
+				((src[i + 1] & 0xF8) == JPEG_MARKER_RST0))
+		{
+			*dst++ = JPEG_MARKER_RST0 | (*restartIndex & 7);
+			*restartIndex += 1;
+			i++;
+		}
+	}
+
+	return dst;
+}
+
+static int jpeg_join_slices(JPEG_CONTEXT* jpeg, int numSlices, int height, BYTE** ppDstData, UINT32* pDstSize)
+{
+	int i;
+	UINT32 size;
+	UINT32 offset;
+	UINT32 length;
+	UINT32 scanOffset[JPEG_MAX_SLICES];
+	UINT32 scanLength[JPEG_MAX_SLICES];
+	int restartIndex = 0;
+	BYTE* data = jpeg->slices[0].buffer;
+	BYTE* dst;
+
+	size = 2;
+
+	for (i = 0; i < numSlices; i++)
+	{
+		if (!jpeg_slice_find_scan(&jpeg->slices[i], &scanOffset[i], &scanLength[i]))
+			return -1;
+
+		size += scanLength[i] + ((i == 0) ? scanOffset[0] : 2);
+	}
+
+	if (size > jpeg->capacity)
+	{
+		dst = (BYTE*) realloc(jpeg->buffer, size);
+
+		if (!dst)
+			return -1;
+
+		jpeg->buffer = dst;
+		jpeg->capacity = size;
+	}
+
+	dst = jpeg->buffer;
+	CopyMemory(dst, data, scanOffset[0]);
+
+	/* the frame header of the first slice gets the height of the bitmap */
+	for (offset = 2; offset + 9 <= scanOffset[0]; offset += 2 + length)
+	{
+		length = (dst[offset + 2] << 8) | dst[offset + 3];
+
+		if (dst[offset + 1] == JPEG_MARKER_SOF0)
+		{
+			dst[offset + 5] = (BYTE) (height >> 8);
+			dst[offset + 6] = (BYTE) (height & 0xFF);
+			break;
+		}
+	}
+
+	dst += scanOffset[0];
+
+	for (i = 0; i < numSlices; i++)
+	{
+		if (i > 0)
+		{
+			*dst++ = 0xFF;
+			*dst++ = JPEG_MARKER_RST0 | (restartIndex & 7);
+			restartIndex++;
+		}
+
+		dst = jpeg_copy_scan(dst, &jpeg->slices[i].buffer[scanOffset[i]], scanLength[i], &restartIndex);
+	}
+
+	*dst++ = 0xFF;
+	*dst++ = JPEG_MARKER_EOI;
+
+	*ppDstData = jpeg->buffer;
+	*pDstSize = (UINT32) (dst - jpeg->buffer);
+
+	return 1;
+}
+
+/**
+ * Compresses a 32bpp bitmap into a JFIF image. The output buffer belongs to
+ * the context and remains valid until the next call.
+ */
+
+int jpeg_compress(JPEG_CONTEXT* jpeg, const BYTE* pSrcData, UINT32 SrcFormat, int nSrcStep,
+		int nWidth, int nHeight, BYTE** ppDstData, UINT32* pDstSize)
+{
+	int i;
+	int status = 1;
+	int mcuHeight;
+	int mcuRows;
+	int numSlices;
+	int sliceRows;
+	int y = 0;
+	JPEG_SLICE* slice;
+	J_COLOR_SPACE colorSpace;
+	PTP_WORK works[JPEG_MAX_SLICES];
+
+	if ((nWidth <= 0) || (nHeight <= 0) || (nWidth > 65535) || (nHeight > 65535))
+		return -1;
+
+#ifdef JCS_EXTENSIONS
+	if ((SrcFormat == PIXEL_FORMAT_XRGB32) || (SrcFormat == PIXEL_FORMAT_ARGB32))
+		colorSpace = JCS_EXT_BGRX;
+	else if ((SrcFormat == PIXEL_FORMAT_XBGR32) || (SrcFormat == PIXEL_FORMAT_ABGR32))
+		colorSpace = JCS_EXT_RGBX;
+	else
+		return -1;
+#else
+	if ((SrcFormat != PIXEL_FORMAT_XRGB32) && (SrcFormat != PIXEL_FORMAT_ARGB32))
+		return -1;
+
+	colorSpace = JCS_RGB;
+#endif
+
+	slice = &jpeg->slices[0];
+
+	if (!jpeg_slice_setup(slice, colorSpace, jpeg->quality))
+		return -1;
+
+	mcuHeight = slice->cinfo.comp_info[0].v_samp_factor * DCTSIZE;
+	mcuRows = (nHeight + mcuHeight - 1) / mcuHeight;
+	numSlices = 1;
+
+	if ((jpeg->maxSlices > 1) && (nWidth * nHeight >= 2 * JPEG_SLICE_MIN_SIZE))
+	{
+		numSlices = (nWidth * nHeight) / (JPEG_SLICE_MIN_SIZE);
+
+		if (numSlices > jpeg->maxSlices)
+			numSlices = jpeg->maxSlices;
+
+		if (numSlices > mcuRows)
+			numSlices = mcuRows;
+	}
+
+	sliceRows = (mcuRows + numSlices - 1) / numSlices;
+	numSlices = (mcuRows + sliceRows - 1) / sliceRows;
+
+	PROFILER_BEGIN("jpeg_compress");
+
+	for (i = 0; i < numSlices; i++)
+	{
+		slice = &jpeg->slices[i];
+
+		if ((!slice->initialized && !jpeg_slice_init(slice)) ||
+				!jpeg_slice_setup(slice, colorSpace, jpeg->quality))
+		{
+			numSlices = i;
+			status = -1;
+			break;
+		}
+
+#ifndef JCS_EXTENSIONS
+		if (!slice->row || (slice->width < nWidth))
+		{
+			free(slice->row);
+			slice->row = (BYTE*) malloc(nWidth * 3);
+
+			if (!slice->row)
+			{
+				numSlices = i;
+				status = -1;
+				break;
+			}
+		}
+#endif
+
+		slice->pSrcData = &pSrcData[y * nSrcStep];
+		slice->nSrcStep = nSrcStep;
+		slice->width = nWidth;
+		slice->height = ((y + sliceRows * mcuHeight) < nHeight) ? sliceRows * mcuHeight : nHeight - y;
+		y += slice->height;
+
+		works[i] = NULL;
+
+		if (jpeg->UseThreads && (numSlices > 1))
+		{
+			works[i] = CreateThreadpoolWork(jpeg_slice_work_callback, (void*) slice, NULL);
+
+			if (works[i])
+				SubmitThreadpoolWork(works[i]);
+		}
+
+		if (!works[i])
+			jpeg_slice_compress(slice);
+	}
+
+	for (i = 0; i < numSlices; i++)
+	{
+		if (works[i])
+		{
+			WaitForThreadpoolWorkCallbacks(works[i], FALSE);
+			CloseThreadpoolWork(works[i]);
+		}
+
+		if (jpeg->slices[i].status < 0)
+			status = -1;
+	}
+
+	if (status > 0)
+		status = jpeg_join_slices(jpeg, numSlices, nHeight, ppDstData, pDstSize);
+
+	PROFILER_END("jpeg_compress");
+
+	return status;
+}
+
+void jpeg_context_set_quality(JPEG_CONTEXT* jpeg, int quality)
+{
+	if (quality < 1)
+		quality = 1;
+
+	if (quality > 100)
+		quality = 100;
+
+	jpeg->quality = quality;
+}
+
+void jpeg_context_set_max_slices(JPEG_CONTEXT* jpeg, int maxSlices)
+{
+	if (maxSlices < 1)
+		maxSlices = 1;
+
+	if (maxSlices > JPEG_MAX_SLICES)
+		maxSlices = JPEG_MAX_SLICES;
+
+	jpeg->maxSlices = maxSlices;
+}
+
+JPEG_CONTEXT* jpeg_context_new(void)
+{
+	SYSTEM_INFO sysinfo;
+	JPEG_CONTEXT* jpeg;
+
+	jpeg = (JPEG_CONTEXT*) calloc(1, sizeof(JPEG_CONTEXT));
+
+	if (!jpeg)
+		return NULL;
+
+	if (!jpeg_slice_init(&jpeg->slices[0]))
+	{
+		free(jpeg);
+		return NULL;
+	}
+
+	GetNativeSystemInfo(&sysinfo);
+
+	jpeg->quality = 75;
+	jpeg->UseThreads = (sysinfo.dwNumberOfProcessors > 1) ? TRUE : FALSE;
+	jpeg_context_set_max_slices(jpeg, sysinfo.dwNumberOfProcessors);
+
+	return jpeg;
+}
+
+void jpeg_context_free(JPEG_CONTEXT* jpeg)
+{
+	int i;
+
+	if (!jpeg)
+		return;
+
+	for (i = 0; i < JPEG_MAX_SLICES; i++)
+		jpeg_slice_uninit(&jpeg->slices[i]);
+
+	free(jpeg->buffer);
+	free(jpeg);
+}
+
 #else
 
 BOOL jpeg_decompress(BYTE* input, BYTE* output, int width, int height, int size, int bpp)
@@ -155,4 +733,31 @@ BOOL jpeg_decompress(BYTE* input, BYTE* output, int width, int height, int size,
 	return 0;
 }
 
+int jpeg_compress(JPEG_CONTEXT* jpeg, const BYTE* pSrcData, UINT32 SrcFormat, int nSrcStep,
+		int nWidth, int nHeight, BYTE** ppDstData, UINT32* pDstSize)
+{
+	return -1;
+}
+
+void jpeg_context_set_quality(JPEG_CONTEXT* jpeg, int quality)
+{
+
+}
+
+void jpeg_context_set_max_slices(JPEG_CONTEXT* jpeg, int maxSlices)
+{
+
+}
+
+JPEG_CONTEXT* jpeg_context_new(void)
+{
+	WLog_ERR(TAG, "JPEG support was not built in");
+	return NULL;
+}
+
+void jpeg_context_free(JPEG_CONTEXT* jpeg)
+{
+
+}
+
 #endif
@@ -240,18 +240,6 @@ static void nsc_context_initialize(NSC_CONTEXT* context, wStream* s)
 	}
 }
 
-static void nsc_profiler_print(NSC_CONTEXT* context)
-{
-	PROFILER_PRINT_HEADER;
-
-	PROFILER_PRINT(context->priv->prof_nsc_rle_decompress_data);
-	PROFILER_PRINT(context->priv->prof_nsc_decode);
-	PROFILER_PRINT(context->priv->prof_nsc_rle_compress_data);
-	PROFILER_PRINT(context->priv->prof_nsc_encode);
-
-	PROFILER_PRINT_FOOTER;
-}
-
 int nsc_context_reset(NSC_CONTEXT* context)
 {
 	return 1;
@@ -315,7 +303,6 @@ void nsc_context_free(NSC_CONTEXT* context)
 
 	BufferPool_Free(context->priv->PlanePool);
 
-	nsc_profiler_print(context);
 	PROFILER_FREE(context->priv->prof_nsc_rle_decompress_data);
 	PROFILER_FREE(context->priv->prof_nsc_decode);
 	PROFILER_FREE(context->priv->prof_nsc_rle_compress_data);
@@ -369,6 +356,8 @@ int nsc_process_message(NSC_CONTEXT* context, UINT16 bpp, UINT16 width, UINT16 h
 	if (!s)
 		return -1;
 
+	PROFILER_BEGIN("nsc_process_message");
+
 	context->bpp = bpp;
 	context->width = width;
 	context->height = height;
@@ -385,5 +374,7 @@ int nsc_process_message(NSC_CONTEXT* context, UINT16 bpp, UINT16 width, UINT16 h
 	context->decode(context);
 	PROFILER_EXIT(context->priv->prof_nsc_decode);
 
+	PROFILER_END("nsc_process_message");
+
 	return 1;
 }
@@ -24,13 +24,29 @@
 #include <winpr/crt.h>
 #include <winpr/print.h>
 
+#include <winpr/pool.h>
+#include <winpr/sysinfo.h>
+
 #include <freerdp/primitives.h>
 #include <freerdp/log.h>
 #include <freerdp/codec/bitmap.h>
 #include <freerdp/codec/planar.h>
 
+#include "planar_sse2.h"
+
 #define TAG FREERDP_TAG("codec")
 
+#ifndef PLANAR_INIT_SIMD
+#define PLANAR_INIT_SIMD(_context) do { } while (0)
+#endif
+
+/* planes of at least this many pixels are run length encoded in parallel */
+#define PLANAR_THREADS_MIN_SIZE		(128 * 128)
+
+/* bound of a run length encoded plane: a control byte every 15 raw bytes */
+#define PLANAR_RLE_PLANE_SIZE(_width, _height) \
+	(((_width) * (_height)) + (((_width) * (_height)) / 8) + ((_height) * 4))
+
 static int planar_skip_plane_rle(const BYTE* pSrcData, UINT32 SrcSize, int nWidth, int nHeight)
 {
 	int x, y;
@@ -1004,6 +1020,282 @@ int freerdp_bitmap_planar_delta_encode_planes(BYTE* inPlanes[4], int width, int
 	return 0;
 }
 
+static void planar_split_planes_generic(const BYTE* pSrcData, UINT32 format, int width, int height,
+		int scanline, BYTE* planes[4])
+{
+	freerdp_split_color_planes((BYTE*) pSrcData, format, width, height, scanline, planes);
+}
+
+/**
+ * Splits the color planes and delta encodes them in a single pass, each
+ * delta being computed from the source pixels of the previous scanline:
+ * the planes are stored bottom-up, so the previous scanline of the plane
+ * is the next one of the bitmap.
+ */
+
+static void planar_split_delta_planes_generic(const BYTE* pSrcData, UINT32 format, int width, int height,
+		int scanline, BYTE* deltaPlanes[4], BOOL skipAlpha)
+{
+	int x, y;
+	int shift;
+	int plane;
+	INT8 delta;
+	const UINT32* pixel;
+	const UINT32* prevPixel;
+	BYTE* pDst;
+	BOOL alpha = (FREERDP_PIXEL_FORMAT_BPP(format) == 32) ? TRUE : FALSE;
+
+	if ((width < 1) || (height < 1))
+		return;
+
+	for (plane = skipAlpha ? 1 : 0; plane < 4; plane++)
+	{
+		shift = (3 - plane) * 8;
+		pDst = deltaPlanes[plane];
+
+		if (!plane && !alpha)
+		{
+			FillMemory(pDst, width, 0xFF);
+			ZeroMemory(&pDst[width], width * (height - 1));
+			continue;
+		}
+
+		pixel = (const UINT32*) &pSrcData[scanline * (height - 1)];
+
+		for (x = 0; x < width; x++)
+			*pDst++ = (BYTE) (pixel[x] >> shift);
+
+		for (y = height - 2; y >= 0; y--)
+		{
+			prevPixel = pixel;
+			pixel = (const UINT32*) &pSrcData[scanline * y];
+
+			for (x = 0; x < width; x++)
+			{
+				delta = (INT8) ((BYTE) (pixel[x] >> shift) - (BYTE) (prevPixel[x] >> shift));
+				*pDst++ = (delta >= 0) ? (BYTE) (delta << 1) : (BYTE) ((-delta << 1) - 1);
+			}
+		}
+	}
+}
+
+/**
+ * Returns the first position from index (at least 1) where a byte repeats
+ * the previous one, and the number of repetitions there.
+ */
+
+static int planar_scan_run_generic(const BYTE* pSrcData, int index, int width, int* runLength)
+{
+	int start;
+
+	while ((index < width) && (pSrcData[index] != pSrcData[index - 1]))
+		index++;
+
+	start = index;
+
+	while ((index < width) && (pSrcData[index] == pSrcData[start - 1]))
+		index++;
+
+	*runLength = index - start;
+
+	return start;
+}
+
+/**
+ * Produces the same segments as freerdp_bitmap_planar_encode_rle_bytes(), but
+ * jumps from run to run instead of going through the scanline byte by byte:
+ * runs shorter than 3 bytes are left in the raw bytes.
+ */
+
+static int planar_encode_rle_scanline(BITMAP_PLANAR_CONTEXT* context, const BYTE* pSrcData, int width,
+		BYTE* pDstData, int dstSize)
+{
+	int index = 0;
+	int rawStart = 0;
+	int start;
+	int runLength;
+	int nBytesWritten;
+	int nTotalBytesWritten = 0;
+
+	while (index < width)
+	{
+		if (!index)
+		{
+			/* the first byte repeats the implicit zero before the scanline */
+			for (runLength = 0; (runLength < width) && !pSrcData[runLength]; runLength++);
+
+			start = 0;
+
+			if (!runLength)
+			{
+				index = 1;
+				continue;
+			}
+		}
+		else
+		{
+			start = context->scan_run(pSrcData, index, width, &runLength);
+		}
+
+		if (runLength >= 3)
+		{
+			nBytesWritten = freerdp_bitmap_planar_write_rle_bytes((BYTE*) &pSrcData[rawStart],
+					start - rawStart, runLength, &pDstData[nTotalBytesWritten], dstSize - nTotalBytesWritten);
+
+			if (!nBytesWritten)
+				return -1;
+
+			nTotalBytesWritten += nBytesWritten;
+			rawStart = start + runLength;
+		}
+
+		index = start + runLength;
+	}
+
+	if (rawStart < width)
+	{
+		nBytesWritten = freerdp_bitmap_planar_write_rle_bytes((BYTE*) &pSrcData[rawStart],
+				width - rawStart, 0, &pDstData[nTotalBytesWritten], dstSize - nTotalBytesWritten);
+
+		if (!nBytesWritten)
+			return -1;
+
+		nTotalBytesWritten += nBytesWritten;
+	}
+
+	return nTotalBytesWritten;
+}
+
+static int planar_encode_plane_rle(BITMAP_PLANAR_CONTEXT* context, const BYTE* pSrcData, int width, int height,
+		BYTE* pDstData, int dstSize)
+{
+	int y;
+	int status;
+	int nTotalBytesWritten = 0;
+
+	for (y = 0; y < height; y++)
+	{
+		status = planar_encode_rle_scanline(context, &pSrcData[y * width], width,
+				&pDstData[nTotalBytesWritten], dstSize - nTotalBytesWritten);
+
+		if (status < 0)
+			return -1;
+
+		nTotalBytesWritten += status;
+	}
+
+	return nTotalBytesWritten;
+}
+
+struct _PLANAR_RLE_WORK_PARAM
+{
+	BITMAP_PLANAR_CONTEXT* context;
+	const BYTE* pSrcData;
+	BYTE* pDstData;
+	int dstSize;
+	int width;
+	int height;
+	int status;
+};
+typedef struct _PLANAR_RLE_WORK_PARAM PLANAR_RLE_WORK_PARAM;
+
+static void CALLBACK planar_encode_plane_rle_work_callback(PTP_CALLBACK_INSTANCE instance, void* context, PTP_WORK work)
+{
+	PLANAR_RLE_WORK_PARAM* param = (PLANAR_RLE_WORK_PARAM*) context;
+
+	param->status = planar_encode_plane_rle(param->context, param->pSrcData,
+			param->width, param->height, param->pDstData, param->dstSize);
+}
+
+/**
+ * Run length encodes the delta planes, each one in its own slot of the
+ * output buffer, in parallel when the bitmap is large. The result is used
+ * only when the planes fit strictly in the budget of
+ * freerdp_bitmap_planar_compress_planes_rle() (four raw planes): the output
+ * is then identical. Otherwise that function decides, on the split planes.
+ */
+
+static int planar_compress_planes_rle(BITMAP_PLANAR_CONTEXT* context, const BYTE* data, UINT32 format,
+		int width, int height, int scanline, int* dstSizes)
+{
+	int i;
+	int offset;
+	int total = 0;
+	int first = context->AllowSkipAlpha ? 1 : 0;
+	int slotSize = PLANAR_RLE_PLANE_SIZE(context->maxWidth, context->maxHeight);
+	PTP_WORK works[4];
+	PLANAR_RLE_WORK_PARAM params[4];
+	BOOL useThreads = (context->UseThreads && (width * height >= PLANAR_THREADS_MIN_SIZE)) ? TRUE : FALSE;
+
+	context->split_delta_planes(data, format, width, height, scanline,
+			context->deltaPlanes, context->AllowSkipAlpha);
+
+	dstSizes[0] = 0;
+
+	for (i = first; i < 4; i++)
+	{
+		params[i].context = context;
+		params[i].pSrcData = context->deltaPlanes[i];
+		params[i].pDstData = &context->rlePlanesBuffer[slotSize * i];
+		params[i].dstSize = slotSize;
+		params[i].width = width;
+		params[i].height = height;
+		params[i].status = -1;
+		works[i] = NULL;
+
+		if (useThreads && (i < 3))
+		{
+			works[i] = CreateThreadpoolWork(planar_encode_plane_rle_work_callback, (void*) &params[i], NULL);
+
+			if (works[i])
+				SubmitThreadpoolWork(works[i]);
+		}
+
+		if (!works[i])
+			planar_encode_plane_rle_work_callback(NULL, (void*) &params[i], NULL);
+	}
+
+	for (i = first; i < 4; i++)
+	{
+		if (works[i])
+		{
+			WaitForThreadpoolWorkCallbacks(works[i], FALSE);
+			CloseThreadpoolWork(works[i]);
+		}
+
+		if (params[i].status < 0)
+			total = -1;
+		else if (total >= 0)
+			total += params[i].status;
+	}
+
+	if ((total >= 0) && (total < width * height * 4))
+	{
+		for (i = first; i < 4; i++)
+		{
+			dstSizes[i] = params[i].status;
+			context->rlePlanes[i] = params[i].pDstData;
+		}
+
+		return 1;
+	}
+
+	context->split_planes(data, format, width, height, scanline, context->planes);
+	freerdp_bitmap_planar_delta_encode_planes(context->planes, width, height, context->deltaPlanes);
+
+	if (freerdp_bitmap_planar_compress_planes_rle(context->deltaPlanes, width, height,
+			context->rlePlanesBuffer, dstSizes, context->AllowSkipAlpha) <= 0)
+		return 0;
+
+	for (i = 0, offset = 0; i < 4; i++)
+	{
+		context->rlePlanes[i] = &context->rlePlanesBuffer[offset];
+		offset += dstSizes[i];
+	}
+
+	return 1;
+}
+
 BYTE* freerdp_bitmap_compress_planar(BITMAP_PLANAR_CONTEXT* context, BYTE* data, UINT32 format,
 		int width, int height, int scanline, BYTE* dstData, int* pDstSize)
 {
@@ -1018,38 +1310,18 @@ BYTE* freerdp_bitmap_compress_planar(BITMAP_PLANAR_CONTEXT* context, BYTE* data,
 
 	planeSize = width * height;
 
-	if (freerdp_split_color_planes(data, format, width, height, scanline, context->planes) < 0)
-	{
+	if ((FREERDP_PIXEL_FORMAT_BPP(format) != 32) && (FREERDP_PIXEL_FORMAT_BPP(format) != 24))
 		return NULL;
-	}
 
 	if (context->AllowRunLengthEncoding)
 	{
-		freerdp_bitmap_planar_delta_encode_planes(context->planes, width, height, context->deltaPlanes);
-
-		if (freerdp_bitmap_planar_compress_planes_rle(context->deltaPlanes, width, height,
-				context->rlePlanesBuffer, (int*) &dstSizes, context->AllowSkipAlpha) > 0)
-		{
-			int offset = 0;
-
+		if (planar_compress_planes_rle(context, data, format, width, height, scanline, dstSizes) > 0)
 			FormatHeader |= PLANAR_FORMAT_HEADER_RLE;
-
-			context->rlePlanes[0] = &context->rlePlanesBuffer[offset];
-			offset += dstSizes[0];
-
-			context->rlePlanes[1] = &context->rlePlanesBuffer[offset];
-			offset += dstSizes[1];
-
-			context->rlePlanes[2] = &context->rlePlanesBuffer[offset];
-			offset += dstSizes[2];
-
-			context->rlePlanes[3] = &context->rlePlanesBuffer[offset];
-			offset += dstSizes[3];
-			//WLog_DBG(TAG, "R: [%d/%d] G: [%d/%d] B: [%d/%d]",
-			//		dstSizes[1], planeSize, dstSizes[2], planeSize, dstSizes[3], planeSize);
-		}
 	}
 
+	if (!(FormatHeader & PLANAR_FORMAT_HEADER_RLE))
+		context->split_planes(data, format, width, height, scanline, context->planes);
+
 	if (!dstData)
 	{
 		size = 1;
@@ -1155,6 +1427,7 @@ int freerdp_bitmap_planar_context_reset(BITMAP_PLANAR_CONTEXT* context)
 
 BITMAP_PLANAR_CONTEXT* freerdp_bitmap_planar_context_new(DWORD flags, int maxWidth, int maxHeight)
 {
+	SYSTEM_INFO sysinfo;
 	BITMAP_PLANAR_CONTEXT* context;
 
 	context = (BITMAP_PLANAR_CONTEXT*) malloc(sizeof(BITMAP_PLANAR_CONTEXT));
@@ -1194,7 +1467,16 @@ BITMAP_PLANAR_CONTEXT* freerdp_bitmap_planar_context_new(DWORD flags, int maxWid
 	context->deltaPlanes[2] = &context->deltaPlanesBuffer[context->maxPlaneSize * 2];
 	context->deltaPlanes[3] = &context->deltaPlanesBuffer[context->maxPlaneSize * 3];
 
-	context->rlePlanesBuffer = malloc(context->maxPlaneSize * 4);
+	context->rlePlanesBuffer = malloc(PLANAR_RLE_PLANE_SIZE(context->maxWidth, context->maxHeight) * 4);
+
+	GetNativeSystemInfo(&sysinfo);
+	context->UseThreads = (sysinfo.dwNumberOfProcessors > 1) ? TRUE : FALSE;
+
+	context->split_planes = planar_split_planes_generic;
+	context->split_delta_planes = planar_split_delta_planes_generic;
+	context->scan_run = planar_scan_run_generic;
+
+	PLANAR_INIT_SIMD(context);
 
 	return context;
 }
@@ -0,0 +1,260 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * RDP6 Planar Codec - SSE2 Optimizations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <xmmintrin.h>
+#include <emmintrin.h>
+
+#include <winpr/crt.h>
+#include <winpr/sysinfo.h>
+
+#include "planar_sse2.h"
+
+/* index of the lowest bit set in a non-zero movemask */
+#define PLANAR_MASK_INDEX(_mask)	(31 - __lzcnt((_mask) & -(_mask)))
+
+/**
+ * Splits 16 pixels into their alpha, red, green and blue bytes.
+ */
+
+static INLINE void planar_split_pixels_sse2(const BYTE* pSrc, __m128i planes[4])
+{
+	__m128i p0, p1, p2, p3;
+	const __m128i mask = _mm_set1_epi32(0xFF);
+
+	p0 = _mm_loadu_si128((const __m128i*) &pSrc[0]);
+	p1 = _mm_loadu_si128((const __m128i*) &pSrc[16]);
+	p2 = _mm_loadu_si128((const __m128i*) &pSrc[32]);
+	p3 = _mm_loadu_si128((const __m128i*) &pSrc[48]);
+
+	planes[0] = _mm_packus_epi16(
+			_mm_packs_epi32(_mm_srli_epi32(p0, 24), _mm_srli_epi32(p1, 24)),
+			_mm_packs_epi32(_mm_srli_epi32(p2, 24), _mm_srli_epi32(p3, 24)));
+
+	planes[1] = _mm_packus_epi16(
+			_mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, 16), mask), _mm_and_si128(_mm_srli_epi32(p1, 16), mask)),
+			_mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p2, 16), mask), _mm_and_si128(_mm_srli_epi32(p3, 16), mask)));
+
+	planes[2] = _mm_packus_epi16(
+			_mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, 8), mask), _mm_and_si128(_mm_srli_epi32(p1, 8), mask)),
+			_mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p2, 8), mask), _mm_and_si128(_mm_srli_epi32(p3, 8), mask)));
+
+	planes[3] = _mm_packus_epi16(
+			_mm_packs_epi32(_mm_and_si128(p0, mask), _mm_and_si128(p1, mask)),
+			_mm_packs_epi32(_mm_and_si128(p2, mask), _mm_and_si128(p3, mask)));
+}
+
+static void planar_split_planes_sse2(const BYTE* pSrcData, UINT32 format, int width, int height,
+		int scanline, BYTE* planes[4])
+{
+	int x, y, k;
+	int plane;
+	UINT32 pixel;
+	const BYTE* pSrc;
+	__m128i values[4];
+	BOOL alpha = (FREERDP_PIXEL_FORMAT_BPP(format) == 32) ? TRUE : FALSE;
+
+	for (y = height - 1, k = 0; y >= 0; y--)
+	{
+		pSrc = &pSrcData[scanline * y];
+
+		for (x = 0; x + 16 <= width; x += 16, k += 16)
+		{
+			planar_split_pixels_sse2(&pSrc[x * 4], values);
+
+			for (plane = alpha ? 0 : 1; plane < 4; plane++)
+				_mm_storeu_si128((__m128i*) &planes[plane][k], values[plane]);
+		}
+
+		for (; x < width; x++, k++)
+		{
+			pixel = ((const UINT32*) pSrc)[x];
+			planes[0][k] = (BYTE) (pixel >> 24);
+			planes[1][k] = (BYTE) (pixel >> 16);
+			planes[2][k] = (BYTE) (pixel >> 8);
+			planes[3][k] = (BYTE) pixel;
+		}
+	}
+
+	if (!alpha)
+		FillMemory(planes[0], width * height, 0xFF);
+}
+
+/**
+ * Splits and delta encodes the planes in a single pass over the bitmap: each
+ * scanline is split once for itself and once more, still in cache, as the
+ * reference of the following one. The delta is stored as (d << 1) ^ (d >> 7),
+ * the sign folding of freerdp_bitmap_planar_delta_encode_plane().
+ */
+
+static void planar_split_delta_planes_sse2(const BYTE* pSrcData, UINT32 format, int width, int height,
+		int scanline, BYTE* deltaPlanes[4], BOOL skipAlpha)
+{
+	int x, y, k;
+	int plane;
+	int first;
+	INT8 delta;
+	UINT32 pixel;
+	UINT32 prevPixel;
+	const BYTE* pSrc;
+	const BYTE* pPrev;
+	__m128i d;
+	__m128i values[4];
+	__m128i prevValues[4];
+	const __m128i zero = _mm_setzero_si128();
+	BOOL alpha = (FREERDP_PIXEL_FORMAT_BPP(format) == 32) ? TRUE : FALSE;
+
+	if ((width < 1) || (height < 1))
+		return;
+
+	first = (skipAlpha || !alpha) ? 1 : 0;
+
+	if (!skipAlpha && !alpha)
+	{
+		FillMemory(deltaPlanes[0], width, 0xFF);
+		ZeroMemory(&deltaPlanes[0][width], width * (height - 1));
+	}
+
+	pSrc = &pSrcData[scanline * (height - 1)];
+
+	for (x = 0, k = 0; x + 16 <= width; x += 16, k += 16)
+	{
+		planar_split_pixels_sse2(&pSrc[x * 4], values);
+
+		for (plane = first; plane < 4; plane++)
+			_mm_storeu_si128((__m128i*) &deltaPlanes[plane][k], values[plane]);
+	}
+
+	for (; x < width; x++, k++)
+	{
+		pixel = ((const UINT32*) pSrc)[x];
+
+		for (plane = first; plane < 4; plane++)
+			deltaPlanes[plane][k] = (BYTE) (pixel >> ((3 - plane) * 8));
+	}
+
+	for (y = height - 2; y >= 0; y--)
+	{
+		pPrev = pSrc;
+		pSrc = &pSrcData[scanline * y];
+
+		for (x = 0; x + 16 <= width; x += 16, k += 16)
+		{
+			planar_split_pixels_sse2(&pSrc[x * 4], values);
+			planar_split_pixels_sse2(&pPrev[x * 4], prevValues);
+
+			for (plane = first; plane < 4; plane++)
+			{
+				d = _mm_sub_epi8(values[plane], prevValues[plane]);
+				d = _mm_xor_si128(_mm_add_epi8(d, d), _mm_cmpgt_epi8(zero, d));
+				_mm_storeu_si128((__m128i*) &deltaPlanes[plane][k], d);
+			}
+		}
+
+		for (; x < width; x++, k++)
+		{
+			pixel = ((const UINT32*) pSrc)[x];
+			prevPixel = ((const UINT32*) pPrev)[x];
+
+			for (plane = first; plane < 4; plane++)
+			{
+				delta = (INT8) ((BYTE) (pixel >> ((3 - plane) * 8)) - (BYTE) (prevPixel >> ((3 - plane) * 8)));
+				deltaPlanes[plane][k] = (delta >= 0) ? (BYTE) (delta << 1) : (BYTE) ((-delta << 1) - 1);
+			}
+		}
+	}
+}
+
+/**
+ * Looks for the next repeated byte 16 positions at a time, comparing the
+ * scanline with itself shifted by one, then measures the run the same way.
+ */
+
+static int planar_scan_run_sse2(const BYTE* pSrcData, int index, int width, int* runLength)
+{
+	int mask;
+	int start;
+	BYTE value;
+	__m128i values;
+
+	while (index + 16 <= width)
+	{
+		mask = _mm_movemask_epi8(_mm_cmpeq_epi8(
+				_mm_loadu_si128((const __m128i*) &pSrcData[index]),
+				_mm_loadu_si128((const __m128i*) &pSrcData[index - 1])));
+
+		if (mask)
+			break;
+
+		index += 16;
+	}
+
+	if (index + 16 <= width)
+	{
+		index += PLANAR_MASK_INDEX(mask);
+	}
+	else
+	{
+		while ((index < width) && (pSrcData[index] != pSrcData[index - 1]))
+			index++;
+	}
+
+	start = index;
+
+	if (start < width)
+	{
+		value = pSrcData[start - 1];
+		values = _mm_set1_epi8((char) value);
+
+		while (index + 16 <= width)
+		{
+			mask = _mm_movemask_epi8(_mm_cmpeq_epi8(
+					_mm_loadu_si128((const __m128i*) &pSrcData[index]), values)) ^ 0xFFFF;
+
+			if (mask)
+			{
+				index += PLANAR_MASK_INDEX(mask);
+				break;
+			}
+
+			index += 16;
+		}
+
+		if (index + 16 > width)
+		{
+			while ((index < width) && (pSrcData[index] == value))
+				index++;
+		}
+	}
+
+	*runLength = index - start;
+
+	return start;
+}
+
+void planar_init_sse2(BITMAP_PLANAR_CONTEXT* context)
+{
+	if (!IsProcessorFeaturePresent(PF_XMMI64_INSTRUCTIONS_AVAILABLE))
+		return;
+
+	context->split_planes = planar_split_planes_sse2;
+	context->split_delta_planes = planar_split_delta_planes_sse2;
+	context->scan_run = planar_scan_run_sse2;
+}
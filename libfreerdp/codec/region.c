@@ -125,11 +125,6 @@ const RECTANGLE_16 *region16_extents(const REGION16 *region)
 	return &region->extents;
 }
 
-static RECTANGLE_16 *region16_extents_noconst(REGION16 *region)
-{
-	return &region->extents;
-}
-
 BOOL rectangle_is_empty(const RECTANGLE_16 *rect)
 {
 	return (rect->left + rect->top + rect->right + rect->bottom) ? TRUE : FALSE;
@@ -247,95 +242,6 @@ void region16_print(const REGION16 *region)
 	}
 }
 
-void region16_copy_band_with_union(RECTANGLE_16 *dst,
-		const RECTANGLE_16 *src, const RECTANGLE_16 *end,
-		UINT16 newTop, UINT16 newBottom,
-		const RECTANGLE_16 *unionRect,
-		int *dstCounter,
-		const RECTANGLE_16 **srcPtr, RECTANGLE_16 **dstPtr)
-{
-	UINT16 refY = src->top;
-	const RECTANGLE_16 *startOverlap, *endOverlap;
-
-	/* merges a band with the given rect
-	 * Input:
-	 *                   unionRect
-	 *               |               |
-	 *               |               |
-	 * ==============+===============+================================
-	 *   |Item1|  |Item2| |Item3|  |Item4|    |Item5|            Band
-	 * ==============+===============+================================
-	 *    before     |    overlap    |          after
-	 *
-	 * Resulting band:
-	 *   +-----+  +----------------------+    +-----+
-	 *   |Item1|  |      Item2           |    |Item3|
-	 *   +-----+  +----------------------+    +-----+
-	 *
-	 *  We first copy as-is items that are before Item2, the first overlapping
-	 *  item.
-	 *  Then we find the last one that overlap unionRect to agregate Item2, Item3
-	 *  and Item4 to create Item2.
-	 *  Finally Item5 is copied as Item3.
-	 *
-	 *  When no unionRect is provided, we skip the two first steps to just copy items
-	 */
-
-	if (unionRect)
-	{
-		/* items before unionRect */
-		while ((src < end) && (src->top == refY) && (src->right < unionRect->left))
-		{
-			dst->top = newTop;
-			dst->bottom = newBottom;
-			dst->right = src->right;
-			dst->left = src->left;
-
-			src++; dst++; *dstCounter += 1;
-		}
-
-		/* treat items overlapping with unionRect */
-		startOverlap = unionRect;
-		endOverlap = unionRect;
-
-		if ((src < end) && (src->top == refY) && (src->left < unionRect->left))
-			startOverlap = src;
-
-		while ((src < end) && (src->top == refY) && (src->right < unionRect->right))
-		{
-			src++;
-		}
-
-		if ((src < end) && (src->top == refY) && (src->left < unionRect->right))
-		{
-			endOverlap = src;
-			src++;
-		}
-
-		dst->bottom = newBottom;
-		dst->top = newTop;
-		dst->left = startOverlap->left;
-		dst->right = endOverlap->right;
-		dst++; *dstCounter += 1;
-	}
-
-	/* treat remaining items on the same band */
-	while ((src < end) && (src->top == refY))
-	{
-		dst->top = newTop;
-		dst->bottom = newBottom;
-		dst->right = src->right;
-		dst->left = src->left;
-
-		src++; dst++; *dstCounter += 1;
-	}
-
-	if (srcPtr)
-		*srcPtr = src;
-
-	*dstPtr = dst;
-}
-
 static RECTANGLE_16* next_band(RECTANGLE_16* band1, RECTANGLE_16* endPtr, int* nbItems)
 {
 	UINT16 refY = band1->top;
@@ -371,33 +277,6 @@ static BOOL band_match(const RECTANGLE_16* band1, const RECTANGLE_16* band2, REC
 	return (band2 == endPtr) || (band2->top != refBand2);
 }
 
-/** compute if the rectangle is fully included in the band
- * @param band a pointer on the beginning of the band
- * @param endPtr end of the region
- * @param rect the rectangle to test
- * @return if rect is fully included in an item of the band
- */
-static BOOL rectangle_contained_in_band(const RECTANGLE_16 *band, const RECTANGLE_16 *endPtr,
-		const RECTANGLE_16 *rect)
-{
-	UINT16 refY = band->top;
-
-	if ((band->top > rect->top) || (rect->bottom > band->bottom))
-		return FALSE;
-
-	/* note: as the band is sorted from left to right, once we've seen an item
-	 * 		that is after rect->left we're sure that the result is False.
-	 */
-	while( (band < endPtr) && (band->top == refY) && (band->left <= rect->left))
-	{
-		if (rect->right <= band->right)
-			return TRUE;
-
-		band++;
-	}
-	return FALSE;
-}
-
 BOOL region16_simplify_bands(REGION16 *region)
 {
 	/** Simplify consecutive bands that touch and have the same items
@@ -476,215 +355,6 @@ BOOL region16_simplify_bands(REGION16 *region)
 	return TRUE;
 }
 
-BOOL region16_union_rect(REGION16 *dst, const REGION16 *src, const RECTANGLE_16 *rect)
-{
-	const RECTANGLE_16* srcExtents;
-	RECTANGLE_16* dstExtents;
-	const RECTANGLE_16 *currentBand, *endSrcRect, *nextBand;
-	REGION16_DATA* newItems = NULL;
-	RECTANGLE_16* dstRect = NULL;
-	int usedRects, srcNbRects;
-	UINT16 topInterBand;
-
-	assert(src);
-	assert(src->data);
-	assert(dst);
-
-	srcExtents = region16_extents(src);
-	dstExtents = region16_extents_noconst(dst);
-
-	if (!region16_n_rects(src))
-	{
-		/* source is empty, so the union is rect */
-		dst->extents = *rect;
-		dst->data = allocateRegion(1);
-
-		if (!dst->data)
-			return FALSE;
-
-		dstRect = region16_rects_noconst(dst);
-
-		dstRect->top = rect->top;
-		dstRect->left = rect->left;
-		dstRect->right = rect->right;
-		dstRect->bottom = rect->bottom;
-
-		return TRUE;
-	}
-
-	newItems = allocateRegion((1 + region16_n_rects(src)) * 4);
-
-	if (!newItems)
-		return FALSE;
-
-	dstRect = (RECTANGLE_16*) (&newItems[1]);
-	usedRects = 0;
-
-	/* adds the piece of rect that is on the top of src */
-	if (rect->top < srcExtents->top)
-	{
-		dstRect->top = rect->top;
-		dstRect->left = rect->left;
-		dstRect->right = rect->right;
-		dstRect->bottom = srcExtents->top;
-
-		usedRects++;
-		dstRect++;
-	}
-
-	/* treat possibly overlapping region */
-	currentBand = region16_rects(src, &srcNbRects);
-	endSrcRect = currentBand + srcNbRects;
-
-	while (currentBand < endSrcRect)
-	{
-		if ((currentBand->bottom <= rect->top) || (rect->bottom <= currentBand->top) ||
-			rectangle_contained_in_band(currentBand, endSrcRect, rect))
-		{
-			/* no overlap between rect and the band, rect is totally below or totally above
-			 * the current band, or rect is already covered by an item of the band.
-			 * let's copy all the rectangles from this band
-						+----+
-						|    |   rect (case 1)
-						+----+
-
-			   =================
-                   band of srcRect
-			   =================
-						+----+
-						|    |   rect (case 2)
-						+----+
-			 */
-			region16_copy_band_with_union(dstRect,
-					currentBand, endSrcRect,
-					currentBand->top, currentBand->bottom,
-					NULL, &usedRects,
-					&nextBand, &dstRect);
-			topInterBand = rect->top;
-		}
-		else
-		{
-
-			/* rect overlaps the band:
-		                           |    |  |    |
-             ====^=================|    |==|    |=========================== band
-                 |   top split     |    |  |    |
-                 v                 | 1  |  | 2  |
-                 ^                 |    |  |    |  +----+   +----+
-                 |   merge zone    |    |  |    |  |    |   | 4  |
-                 v                 +----+  |    |  |    |   +----+
-                 ^                         |    |  | 3  |
-                 |   bottom split          |    |  |    |
-             ====v=========================|    |==|    |===================
-                                           |    |  |    |
-
-			 possible cases:
-			 1) no top split, merge zone then a bottom split. The band will be splitted
-			  in two
-			 2) not band split, only the merge zone, band merged with rect but not splitted
-			 3) a top split, the merge zone and no bottom split. The band will be split
-			 in two
-			 4) a top split, the merge zone and also a bottom split. The band will be
-			 splitted in 3, but the coalesce algorithm may merge the created bands
-			 */
-			UINT16 mergeTop = currentBand->top;
-			UINT16 mergeBottom = currentBand->bottom;
-
-			/* test if we need a top split, case 3 and 4 */
-			if (rect->top > currentBand->top)
-			{
-				region16_copy_band_with_union(dstRect,
-						currentBand, endSrcRect,
-						currentBand->top, rect->top,
-						NULL, &usedRects,
-						&nextBand, &dstRect);
-				mergeTop = rect->top;
-			}
-
-			/* do the merge zone (all cases) */
-			if (rect->bottom < currentBand->bottom)
-				mergeBottom = rect->bottom;
-
-			region16_copy_band_with_union(dstRect,
-					currentBand, endSrcRect,
-					mergeTop, mergeBottom,
-					rect, &usedRects,
-					&nextBand, &dstRect);
-
-			/* test if we need a bottom split, case 1 and 4 */
-			if (rect->bottom < currentBand->bottom)
-			{
-				region16_copy_band_with_union(dstRect,
-						currentBand, endSrcRect,
-						mergeBottom, currentBand->bottom,
-						NULL, &usedRects,
-						&nextBand, &dstRect);
-			}
-			topInterBand = currentBand->bottom;
-		}
-
-		/* test if a piece of rect should be inserted as a new band between
-		 * the current band and the next one. band n and n+1 shouldn't touch.
-		 *
-		 * ==============================================================
-		 *                                                        band n
-		 *            +------+                    +------+
-		 * ===========| rect |====================|      |===============
-		 *            |      |    +------+        |      |
-		 *            +------+    | rect |        | rect |
-		 *                        +------+        |      |
-		 * =======================================|      |================
-		 *                                        +------+         band n+1
-		 * ===============================================================
-		 *
-		 */
-		if ((nextBand < endSrcRect) && (nextBand->top != currentBand->bottom) &&
-				(rect->bottom > currentBand->bottom) && (rect->top < nextBand->top))
-		{
-			dstRect->right = rect->right;
-			dstRect->left = rect->left;
-			dstRect->top = topInterBand;
-			dstRect->bottom = MIN(nextBand->top, rect->bottom);
-			dstRect++; usedRects++;
-		}
-
-		currentBand = nextBand;
-	}
-
-	/* adds the piece of rect that is below src */
-	if (srcExtents->bottom < rect->bottom)
-	{
-		dstRect->top = MAX(srcExtents->bottom, rect->top);
-		dstRect->left = rect->left;
-		dstRect->right = rect->right;
-		dstRect->bottom = rect->bottom;
-
-		usedRects++;
-		dstRect++;
-	}
-
-	if ((src == dst) && (src->data->size))
-		free(src->data);
-
-	dstExtents->top = MIN(rect->top, srcExtents->top);
-	dstExtents->left = MIN(rect->left, srcExtents->left);
-	dstExtents->bottom = MAX(rect->bottom, srcExtents->bottom);
-	dstExtents->right = MAX(rect->right, srcExtents->right);
-
-	newItems->size = sizeof(REGION16_DATA) + (usedRects * sizeof(RECTANGLE_16));
-	dst->data = realloc(newItems, newItems->size);
-
-	if (!dst->data)
-	{
-		free(newItems);
-		return FALSE;
-	}
-
-	dst->data->nbRects = usedRects;
-
-	return region16_simplify_bands(dst);
-}
-
 BOOL region16_intersects_rect(const REGION16 *src, const RECTANGLE_16 *arg2)
 {
 	const RECTANGLE_16 *rect, *endPtr, *srcExtents;
@@ -795,6 +465,583 @@ BOOL region16_intersect_rect(REGION16 *dst, const REGION16 *src, const RECTANGLE
 	return region16_simplify_bands(dst);
 }
 
+/*
+ * The operations below share a builder that emits the banded rectangles in
+ * order: rectangles of a band are appended left to right, touching ones being
+ * merged, and a finished band is coalesced with the previous one when they touch
+ * and have the same horizontal layout. The result is directly in canonical form,
+ * so no region16_simplify_bands() pass is needed.
+ */
+
+struct _REGION16_BUILDER
+{
+	REGION16_DATA* data;
+	long capacity;
+	long bandStart;
+	long prevBand;
+};
+typedef struct _REGION16_BUILDER REGION16_BUILDER;
+
+static BOOL region16_builder_init(REGION16_BUILDER* builder, long capacity)
+{
+	if (capacity < 16)
+		capacity = 16;
+
+	builder->data = allocateRegion(capacity);
+
+	if (!builder->data)
+		return FALSE;
+
+	builder->data->nbRects = 0;
+	builder->capacity = capacity;
+	builder->bandStart = 0;
+	builder->prevBand = -1;
+
+	return TRUE;
+}
+
+static BOOL region16_builder_add(REGION16_BUILDER* builder, UINT16 left, UINT16 top, UINT16 right, UINT16 bottom)
+{
+	RECTANGLE_16* rects;
+	REGION16_DATA* data = builder->data;
+
+	rects = (RECTANGLE_16*) &data[1];
+
+	if ((data->nbRects > builder->bandStart) && (rects[data->nbRects - 1].right >= left))
+	{
+		if (rects[data->nbRects - 1].right < right)
+			rects[data->nbRects - 1].right = right;
+
+		return TRUE;
+	}
+
+	if (data->nbRects == builder->capacity)
+	{
+		long capacity = builder->capacity * 2;
+
+		data = (REGION16_DATA*) realloc(data, sizeof(REGION16_DATA) + (capacity * sizeof(RECTANGLE_16)));
+
+		if (!data)
+			return FALSE;
+
+		builder->data = data;
+		builder->capacity = capacity;
+		rects = (RECTANGLE_16*) &data[1];
+	}
+
+	rects[data->nbRects].left = left;
+	rects[data->nbRects].top = top;
+	rects[data->nbRects].right = right;
+	rects[data->nbRects].bottom = bottom;
+	data->nbRects++;
+
+	return TRUE;
+}
+
+static void region16_builder_end_band(REGION16_BUILDER* builder)
+{
+	long i;
+	long count;
+	RECTANGLE_16* prev;
+	RECTANGLE_16* band;
+	REGION16_DATA* data = builder->data;
+
+	count = data->nbRects - builder->bandStart;
+
+	if (!count)
+		return;
+
+	band = &((RECTANGLE_16*) &data[1])[builder->bandStart];
+
+	if ((builder->prevBand >= 0) && (builder->bandStart - builder->prevBand == count))
+	{
+		prev = &((RECTANGLE_16*) &data[1])[builder->prevBand];
+
+		if (prev->bottom == band->top)
+		{
+			for (i = 0; i < count; i++)
+			{
+				if ((prev[i].left != band[i].left) || (prev[i].right != band[i].right))
+					break;
+			}
+
+			if (i == count)
+			{
+				for (i = 0; i < count; i++)
+					prev[i].bottom = band->bottom;
+
+				data->nbRects = builder->bandStart;
+				return;
+			}
+		}
+	}
+
+	builder->prevBand = builder->bandStart;
+	builder->bandStart = data->nbRects;
+}
+
+static BOOL region16_builder_finish(REGION16_BUILDER* builder, REGION16* dst)
+{
+	long i;
+	RECTANGLE_16* rects;
+	RECTANGLE_16 extents;
+	REGION16_DATA* data = builder->data;
+
+	if (!data->nbRects)
+	{
+		free(data);
+		region16_clear(dst);
+		return TRUE;
+	}
+
+	rects = (RECTANGLE_16*) &data[1];
+
+	extents.top = rects[0].top;
+	extents.bottom = rects[data->nbRects - 1].bottom;
+	extents.left = rects[0].left;
+	extents.right = rects[0].right;
+
+	for (i = 1; i < data->nbRects; i++)
+	{
+		extents.left = MIN(extents.left, rects[i].left);
+		extents.right = MAX(extents.right, rects[i].right);
+	}
+
+	data->size = sizeof(REGION16_DATA) + (data->nbRects * sizeof(RECTANGLE_16));
+
+	if (data->nbRects < builder->capacity)
+	{
+		REGION16_DATA* shrunk = (REGION16_DATA*) realloc(data, data->size);
+
+		if (shrunk)
+			data = shrunk;
+	}
+
+	if (dst->data && dst->data->size)
+		free(dst->data);
+
+	dst->data = data;
+	dst->extents = extents;
+
+	return TRUE;
+}
+
+static const RECTANGLE_16* region16_band_end(const RECTANGLE_16* band, const RECTANGLE_16* endPtr)
+{
+	const RECTANGLE_16* ptr = band;
+
+	while ((ptr < endPtr) && (ptr->top == band->top))
+		ptr++;
+
+	return ptr;
+}
+
+/* operations are truth tables indexed by (inSrc1 << 1) | inSrc2 */
+#define REGION16_OP_UNION		0x0E
+#define REGION16_OP_INTERSECT		0x08
+#define REGION16_OP_SUBTRACT		0x04
+#define REGION16_OP_XOR			0x06
+
+static BOOL region16_op_band(REGION16_BUILDER* builder, int op, UINT16 top, UINT16 bottom,
+		const RECTANGLE_16* a, const RECTANGLE_16* aEnd, const RECTANGLE_16* b, const RECTANGLE_16* bEnd)
+{
+	UINT32 x, xa, xb;
+	UINT32 start = 0;
+	BOOL inA = FALSE;
+	BOOL inB = FALSE;
+	BOOL keep = FALSE;
+	BOOL keeping = FALSE;
+
+	/* walks the interval edges of both bands left to right */
+	while ((a < aEnd) || (b < bEnd))
+	{
+		xa = (a < aEnd) ? (inA ? a->right : a->left) : 0x10000;
+		xb = (b < bEnd) ? (inB ? b->right : b->left) : 0x10000;
+		x = MIN(xa, xb);
+
+		if (xa == x)
+		{
+			if (inA)
+				a++;
+
+			inA = !inA;
+		}
+
+		if (xb == x)
+		{
+			if (inB)
+				b++;
+
+			inB = !inB;
+		}
+
+		keep = (op >> ((inA << 1) | inB)) & 1;
+
+		if (keep && !keeping)
+		{
+			start = x;
+			keeping = TRUE;
+		}
+		else if (!keep && keeping)
+		{
+			if (!region16_builder_add(builder, start, top, x, bottom))
+				return FALSE;
+
+			keeping = FALSE;
+		}
+	}
+
+	region16_builder_end_band(builder);
+
+	return TRUE;
+}
+
+static BOOL region16_op(REGION16* dst, const REGION16* src1, const REGION16* src2, int op)
+{
+	int nbA, nbB;
+	UINT32 y = 0;
+	UINT32 top, bottom;
+	UINT32 aTop, bTop;
+	BOOL inA, inB;
+	REGION16_BUILDER builder;
+	const RECTANGLE_16 *a, *aBandEnd, *aEnd;
+	const RECTANGLE_16 *b, *bBandEnd, *bEnd;
+
+	assert(dst);
+	assert(src1);
+	assert(src1->data);
+	assert(src2);
+	assert(src2->data);
+
+	a = region16_rects(src1, &nbA);
+	b = region16_rects(src2, &nbB);
+	aEnd = a + nbA;
+	bEnd = b + nbB;
+
+	if (!region16_builder_init(&builder, nbA + nbB))
+		return FALSE;
+
+	aBandEnd = region16_band_end(a, aEnd);
+	bBandEnd = region16_band_end(b, bEnd);
+
+	/*
+	 * cuts the plane in horizontal slices at every band boundary of both
+	 * regions, each slice combining at most one band of each region
+	 */
+	while ((a < aEnd) || (b < bEnd))
+	{
+		aTop = (a < aEnd) ? MAX(a->top, y) : 0x10000;
+		bTop = (b < bEnd) ? MAX(b->top, y) : 0x10000;
+		top = MIN(aTop, bTop);
+
+		inA = (a < aEnd) && (aTop == top);
+		inB = (b < bEnd) && (bTop == top);
+
+		bottom = 0x10000;
+
+		if (a < aEnd)
+			bottom = MIN(bottom, inA ? a->bottom : a->top);
+
+		if (b < bEnd)
+			bottom = MIN(bottom, inB ? b->bottom : b->top);
+
+		if (!region16_op_band(&builder, op, top, bottom,
+				a, inA ? aBandEnd : a, b, inB ? bBandEnd : b))
+		{
+			free(builder.data);
+			return FALSE;
+		}
+
+		y = bottom;
+
+		if ((a < aEnd) && (a->bottom <= y))
+		{
+			a = aBandEnd;
+			aBandEnd = region16_band_end(a, aEnd);
+		}
+
+		if ((b < bEnd) && (b->bottom <= y))
+		{
+			b = bBandEnd;
+			bBandEnd = region16_band_end(b, bEnd);
+		}
+	}
+
+	return region16_builder_finish(&builder, dst);
+}
+
+BOOL region16_union(REGION16 *dst, const REGION16 *src1, const REGION16 *src2)
+{
+	return region16_op(dst, src1, src2, REGION16_OP_UNION);
+}
+
+BOOL region16_intersect(REGION16 *dst, const REGION16 *src1, const REGION16 *src2)
+{
+	return region16_op(dst, src1, src2, REGION16_OP_INTERSECT);
+}
+
+BOOL region16_subtract(REGION16 *dst, const REGION16 *src1, const REGION16 *src2)
+{
+	return region16_op(dst, src1, src2, REGION16_OP_SUBTRACT);
+}
+
+BOOL region16_xor(REGION16 *dst, const REGION16 *src1, const REGION16 *src2)
+{
+	return region16_op(dst, src1, src2, REGION16_OP_XOR);
+}
+
+/* a region made of a single rectangle, without any allocation */
+struct _REGION16_RECT
+{
+	REGION16_DATA header;
+	RECTANGLE_16 rect;
+};
+typedef struct _REGION16_RECT REGION16_RECT;
+
+static BOOL region16_op_rect(REGION16* dst, const REGION16* src, const RECTANGLE_16* rect, int op)
+{
+	REGION16 region;
+	REGION16_RECT single;
+
+	assert(rect);
+
+	if ((rect->left >= rect->right) || (rect->top >= rect->bottom))
+	{
+		if (op == REGION16_OP_INTERSECT)
+		{
+			region16_clear(dst);
+			return TRUE;
+		}
+
+		return region16_copy(dst, src);
+	}
+
+	single.header.size = 0;
+	single.header.nbRects = 1;
+	single.rect = *rect;
+
+	region.extents = *rect;
+	region.data = &single.header;
+
+	return region16_op(dst, src, &region, op);
+}
+
+BOOL region16_union_rect(REGION16 *dst, const REGION16 *src, const RECTANGLE_16 *rect)
+{
+	return region16_op_rect(dst, src, rect, REGION16_OP_UNION);
+}
+
+BOOL region16_subtract_rect(REGION16 *dst, const REGION16 *src, const RECTANGLE_16 *rect)
+{
+	return region16_op_rect(dst, src, rect, REGION16_OP_SUBTRACT);
+}
+
+static int region16_compare_top(const void* a, const void* b)
+{
+	return (int) ((const RECTANGLE_16*) a)->top - (int) ((const RECTANGLE_16*) b)->top;
+}
+
+static int region16_compare_y(const void* a, const void* b)
+{
+	return (int) *((const UINT16*) a) - (int) *((const UINT16*) b);
+}
+
+BOOL region16_union_rects(REGION16 *dst, const REGION16 *src, const RECTANGLE_16 *rects, int count)
+{
+	int i, k;
+	int nbSrc;
+	int nbItems = 0;
+	int nbYs = 0;
+	int nbActive = 0;
+	int next = 0;
+	int low, high;
+	UINT16 top, bottom;
+	UINT16 left, right;
+	BOOL status = FALSE;
+	RECTANGLE_16* items;
+	RECTANGLE_16** active = NULL;
+	UINT16* ys = NULL;
+	const RECTANGLE_16* srcRects;
+	REGION16_BUILDER builder;
+
+	assert(dst);
+	assert(src);
+	assert(src->data);
+	assert(rects || !count);
+
+	srcRects = region16_rects(src, &nbSrc);
+
+	items = (RECTANGLE_16*) malloc((nbSrc + count + 1) * sizeof(RECTANGLE_16));
+
+	if (!items)
+		return FALSE;
+
+	CopyMemory(items, srcRects, nbSrc * sizeof(RECTANGLE_16));
+	nbItems = nbSrc;
+
+	for (i = 0; i < count; i++)
+	{
+		if ((rects[i].left < rects[i].right) && (rects[i].top < rects[i].bottom))
+			items[nbItems++] = rects[i];
+	}
+
+	ys = (UINT16*) malloc((nbItems * 2 + 1) * sizeof(UINT16));
+	active = (RECTANGLE_16**) malloc((nbItems + 1) * sizeof(RECTANGLE_16*));
+
+	if (!ys || !active || !region16_builder_init(&builder, nbItems))
+		goto out;
+
+	qsort(items, nbItems, sizeof(RECTANGLE_16), region16_compare_top);
+
+	for (i = 0; i < nbItems; i++)
+	{
+		ys[nbYs++] = items[i].top;
+		ys[nbYs++] = items[i].bottom;
+	}
+
+	qsort(ys, nbYs, sizeof(UINT16), region16_compare_y);
+
+	for (i = 1, k = 0; i < nbYs; i++)
+	{
+		if (ys[i] != ys[k])
+			ys[++k] = ys[i];
+	}
+
+	nbYs = nbYs ? k + 1 : 0;
+
+	/*
+	 * sweeps the edges top to bottom, keeping the rectangles crossing the
+	 * current slice sorted by their left side so a slice is a single merge pass
+	 */
+	for (k = 0; k + 1 < nbYs; k++)
+	{
+		top = ys[k];
+		bottom = ys[k + 1];
+
+		for (i = 0, high = 0; i < nbActive; i++)
+		{
+			if (active[i]->bottom > top)
+				active[high++] = active[i];
+		}
+
+		nbActive = high;
+
+		for (; (next < nbItems) && (items[next].top <= top); next++)
+		{
+			low = 0;
+			high = nbActive;
+
+			while (low < high)
+			{
+				i = (low + high) / 2;
+
+				if (active[i]->left <= items[next].left)
+					low = i + 1;
+				else
+					high = i;
+			}
+
+			MoveMemory(&active[low + 1], &active[low], (nbActive - low) * sizeof(RECTANGLE_16*));
+			active[low] = &items[next];
+			nbActive++;
+		}
+
+		if (!nbActive)
+			continue;
+
+		left = active[0]->left;
+		right = active[0]->right;
+
+		for (i = 1; i < nbActive; i++)
+		{
+			if (active[i]->left > right)
+			{
+				if (!region16_builder_add(&builder, left, top, right, bottom))
+					goto out_builder;
+
+				left = active[i]->left;
+			}
+
+			if (active[i]->right > right)
+				right = active[i]->right;
+		}
+
+		if (!region16_builder_add(&builder, left, top, right, bottom))
+			goto out_builder;
+
+		region16_builder_end_band(&builder);
+	}
+
+	status = region16_builder_finish(&builder, dst);
+	goto out;
+
+out_builder:
+	free(builder.data);
+out:
+	free(items);
+	free(ys);
+	free(active);
+	return status;
+}
+
+BOOL region16_from_tile_bitmap(REGION16 *dst, const BYTE *bitmap, UINT32 stride,
+		UINT32 tilesX, UINT32 tilesY, UINT32 tileWidth, UINT32 tileHeight)
+{
+	UINT32 x, y;
+	UINT32 start;
+	UINT32 top, bottom;
+	const BYTE* row;
+	REGION16_BUILDER builder;
+
+	assert(dst);
+	assert(bitmap);
+
+	if (!region16_builder_init(&builder, tilesY))
+		return FALSE;
+
+	for (y = 0; y < tilesY; y++)
+	{
+		row = &bitmap[y * stride];
+		top = MIN(y * tileHeight, 0xFFFF);
+		bottom = MIN((y + 1) * tileHeight, 0xFFFF);
+
+		if (top >= bottom)
+			break;
+
+		for (x = 0; x < tilesX; )
+		{
+			/* skips whole clean bytes */
+			if (!(x & 7) && !row[x >> 3])
+			{
+				x += 8;
+				continue;
+			}
+
+			if (!(row[x >> 3] & (1 << (x & 7))))
+			{
+				x++;
+				continue;
+			}
+
+			for (start = x; (x < tilesX) && (row[x >> 3] & (1 << (x & 7))); x++);
+
+			if (MIN(start * tileWidth, 0xFFFF) >= MIN(x * tileWidth, 0xFFFF))
+				break;
+
+			if (!region16_builder_add(&builder, MIN(start * tileWidth, 0xFFFF), top,
+					MIN(x * tileWidth, 0xFFFF), bottom))
+			{
+				free(builder.data);
+				return FALSE;
+			}
+		}
+
+		region16_builder_end_band(&builder);
+	}
+
+	return region16_builder_finish(&builder, dst);
+}
+
 void region16_uninit(REGION16 *region)
 {
 	assert(region);
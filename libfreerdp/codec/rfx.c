@@ -118,31 +118,6 @@ static void rfx_profiler_free(RFX_CONTEXT* context)
 	PROFILER_FREE(context->priv->prof_rfx_encode_format_rgb);
 }
 
-static void rfx_profiler_print(RFX_CONTEXT* context)
-{
-	PROFILER_PRINT_HEADER;
-
-	PROFILER_PRINT(context->priv->prof_rfx_decode_rgb);
-	PROFILER_PRINT(context->priv->prof_rfx_decode_component);
-	PROFILER_PRINT(context->priv->prof_rfx_rlgr_decode);
-	PROFILER_PRINT(context->priv->prof_rfx_differential_decode);
-	PROFILER_PRINT(context->priv->prof_rfx_quantization_decode);
-	PROFILER_PRINT(context->priv->prof_rfx_dwt_2d_decode);
-	PROFILER_PRINT(context->priv->prof_rfx_ycbcr_to_rgb);
-	PROFILER_PRINT(context->priv->prof_rfx_decode_format_rgb);
-
-	PROFILER_PRINT(context->priv->prof_rfx_encode_rgb);
-	PROFILER_PRINT(context->priv->prof_rfx_encode_component);
-	PROFILER_PRINT(context->priv->prof_rfx_rlgr_encode);
-	PROFILER_PRINT(context->priv->prof_rfx_differential_encode);
-	PROFILER_PRINT(context->priv->prof_rfx_quantization_encode);
-	PROFILER_PRINT(context->priv->prof_rfx_dwt_2d_encode);
-	PROFILER_PRINT(context->priv->prof_rfx_rgb_to_ycbcr);
-	PROFILER_PRINT(context->priv->prof_rfx_encode_format_rgb);
-
-	PROFILER_PRINT_FOOTER;
-}
-
 void rfx_tile_init(RFX_TILE* tile)
 {
 	if (tile)
@@ -364,7 +339,6 @@ void rfx_context_free(RFX_CONTEXT* context)
 
 	ObjectPool_Free(priv->TilePool);
 
-	rfx_profiler_print(context);
 	rfx_profiler_free(context);
 
 	if (priv->UseThreads)
@@ -376,10 +350,6 @@ void rfx_context_free(RFX_CONTEXT* context)
 			free(priv->workObjects);
 		if (priv->tileWorkParams)
 			free(priv->tileWorkParams);
-
-#ifdef WITH_PROFILER
-		WLog_VRB(TAG,  "WARNING: Profiling results probably unusable with multithreaded RemoteFX codec!");
-#endif
 	}
 
 	BufferPool_Free(context->priv->BufferPool);
@@ -418,10 +388,57 @@ void rfx_context_set_pixel_format(RFX_CONTEXT* context, RDP_PIXEL_FORMAT pixel_f
 	}
 }
 
+/**
+ * Adaptive quantization replaces the caller's quantization values with a
+ * set of tables chosen per tile from its content, coarsened by a
+ * quantization scale: the one set by rfx_context_set_quant_scale(), or a
+ * coarser one if a target frame size is set and the frames exceed it.
+ */
+
+void rfx_context_set_adaptive_quantization(RFX_CONTEXT* context, BOOL enabled)
+{
+	if (context->priv->AdaptiveQuant == enabled)
+		return;
+
+	context->priv->AdaptiveQuant = enabled;
+	context->priv->RateScale = 0.0;
+
+	/* the next frame sets up its quantization values again */
+	context->numQuant = 0;
+	context->quantIdxY = 0;
+	context->quantIdxCb = 0;
+	context->quantIdxCr = 0;
+}
+
+void rfx_context_set_quant_scale(RFX_CONTEXT* context, int scale)
+{
+	if (scale < 0)
+		scale = 0;
+
+	if (scale > RFX_QUANT_SCALE_MAX)
+		scale = RFX_QUANT_SCALE_MAX;
+
+	context->priv->QuantScale = scale;
+}
+
+int rfx_context_get_quant_scale(RFX_CONTEXT* context)
+{
+	return rfx_encode_get_quant_scale(context);
+}
+
+void rfx_context_set_target_frame_size(RFX_CONTEXT* context, UINT32 frameSize)
+{
+	context->priv->TargetFrameSize = frameSize;
+
+	if (!frameSize)
+		context->priv->RateScale = 0.0;
+}
+
 int rfx_context_reset(RFX_CONTEXT* context)
 {
 	context->state = RFX_STATE_SEND_HEADERS;
 	context->frameIdx = 0;
+	context->priv->RateScale = 0.0;
 	return 1;
 }
 
@@ -673,7 +690,11 @@ typedef struct _RFX_TILE_PROCESS_WORK_PARAM RFX_TILE_PROCESS_WORK_PARAM;
 void CALLBACK rfx_process_message_tile_work_callback(PTP_CALLBACK_INSTANCE instance, void* context, PTP_WORK work)
 {
 	RFX_TILE_PROCESS_WORK_PARAM* param = (RFX_TILE_PROCESS_WORK_PARAM*) context;
+
+	PROFILER_BEGIN("rfx_tile_work");
+	PROFILER_FLOW_END("rfx_tile", (UINT64) (size_t) param);
 	rfx_decode_rgb(param->context, param->tile, param->tile->data, 64 * 4);
+	PROFILER_END("rfx_tile_work");
 }
 
 static BOOL rfx_process_message_tileset(RFX_CONTEXT* context, RFX_MESSAGE* message, wStream* s)
@@ -855,6 +876,9 @@ static BOOL rfx_process_message_tileset(RFX_CONTEXT* context, RFX_MESSAGE* messa
 			work_objects[i] = CreateThreadpoolWork((PTP_WORK_CALLBACK) rfx_process_message_tile_work_callback,
 					(void*) &params[i], &context->priv->ThreadPoolEnv);
 
+			/* ties the decoding of the tile on a worker thread to this message */
+			PROFILER_FLOW_BEGIN("rfx_tile", (UINT64) (size_t) &params[i]);
+
 			SubmitThreadpoolWork(work_objects[i]);
 			close_cnt = i + 1;
 		}
@@ -903,6 +927,8 @@ RFX_MESSAGE* rfx_process_message(RFX_CONTEXT* context, BYTE* data, UINT32 length
 
 	message->freeRects = TRUE;
 
+	PROFILER_BEGIN("rfx_process_message");
+
 	s = Stream_New(data, length);
 
 	while (Stream_GetRemainingLength(s) > 6)
@@ -984,6 +1010,8 @@ RFX_MESSAGE* rfx_process_message(RFX_CONTEXT* context, BYTE* data, UINT32 length
 
 	Stream_Free(s, FALSE);
 
+	PROFILER_END("rfx_process_message");
+
 	return message;
 }
 
@@ -1159,21 +1187,29 @@ void CALLBACK rfx_compose_message_tile_work_callback(PTP_CALLBACK_INSTANCE insta
 static BOOL computeRegion(const RFX_RECT* rects, int numRects, REGION16 *region, int width, int height)
 {
 	int i;
+	BOOL status;
+	RECTANGLE_16* rects16;
 	const RFX_RECT *rect = rects;
 	const RECTANGLE_16 mainRect = { 0, 0, width, height };
 
-	for(i = 0; i < numRects; i++, rect++) {
-		RECTANGLE_16 rect16;
+	rects16 = (RECTANGLE_16*) malloc((numRects + 1) * sizeof(RECTANGLE_16));
 
-		rect16.left = rect->x;
-		rect16.top = rect->y;
-		rect16.right = rect->x + rect->width;
-		rect16.bottom = rect->y + rect->height;
+	if (!rects16)
+		return FALSE;
 
-		if (!region16_union_rect(region, region, &rect16))
-			return FALSE;
+	for(i = 0; i < numRects; i++, rect++) {
+		rects16[i].left = rect->x;
+		rects16[i].top = rect->y;
+		rects16[i].right = rect->x + rect->width;
+		rects16[i].bottom = rect->y + rect->height;
 	}
 
+	status = region16_union_rects(region, region, rects16, numRects);
+	free(rects16);
+
+	if (!status)
+		return FALSE;
+
 	return region16_intersect_rect(region, region, &mainRect);
 }
 
@@ -1234,10 +1270,28 @@ RFX_MESSAGE* rfx_encode_message(RFX_CONTEXT* context, const RFX_RECT* rects, int
 
 	message->frameIdx = context->frameIdx++;
 
-	if (!context->numQuant)
+	if (context->priv->AdaptiveQuant)
 	{
+		if (!rfx_encode_adaptive_quants(context))
+		{
+			free(message);
+			return NULL;
+		}
+	}
+	else if (!context->numQuant)
+	{
+		UINT32* quants;
+
+		quants = (UINT32*) realloc(context->quants, sizeof(rfx_default_quantization_values));
+
+		if (!quants)
+		{
+			free(message);
+			return NULL;
+		}
+
+		context->quants = quants;
 		context->numQuant = 1;
-		context->quants = (UINT32*) malloc(sizeof(rfx_default_quantization_values));
 		CopyMemory(context->quants, &rfx_default_quantization_values, sizeof(rfx_default_quantization_values));
 		context->quantIdxY = 0;
 		context->quantIdxCb = 0;
@@ -1418,6 +1472,7 @@ RFX_MESSAGE* rfx_encode_message(RFX_CONTEXT* context, const RFX_RECT* rects, int
 		message->tilesDataSize += rfx_tile_length(tile);
 	}
 
+	rfx_encode_rate_control(context, message->tilesDataSize);
 
 	region16_uninit(&rectsRegion);
 	return message;
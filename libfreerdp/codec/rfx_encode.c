@@ -25,6 +25,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 
 #include <winpr/crt.h>
 #include <winpr/collections.h>
@@ -41,8 +42,218 @@
 
 #define MINMAX(_v,_l,_h) ((_v) < (_l) ? (_l) : ((_v) > (_h) ? (_h) : (_v)))
 
+/**
+ * Adaptive quantization: a luma and a chroma table for each tile class,
+ * coarsened by the quantization scale. Text keeps its high frequency bands,
+ * the edges are what makes it readable, while smooth tiles have little high
+ * frequency content worth spending bits on.
+ *
+ * LL3, LH3, HL3, HH3, LH2, HL2, HH2, LH1, HL1, HH1
+ */
+
+static const UINT32 rfx_adaptive_quantization_values[RFX_TILE_CLASS_COUNT][2][10] =
+{
+	/* RFX_TILE_CLASS_TEXT */
+	{
+		{ 6, 6, 6, 6, 6, 6, 7, 7, 7, 8 },
+		{ 6, 6, 6, 6, 7, 7, 8, 8, 8, 9 }
+	},
+	/* RFX_TILE_CLASS_NATURAL */
+	{
+		{ 6, 6, 6, 6, 7, 7, 8, 8, 8, 9 },
+		{ 6, 6, 6, 6, 7, 7, 8, 9, 9, 10 }
+	},
+	/* RFX_TILE_CLASS_SMOOTH */
+	{
+		{ 6, 6, 6, 6, 7, 7, 8, 9, 9, 10 },
+		{ 6, 6, 6, 6, 8, 8, 9, 10, 10, 11 }
+	}
+};
+
+/* luma differences between neighbours which count as a sharp edge */
+#define RFX_EDGE_THRESHOLD	64
+
+/* mean absolute luma gradient below which a tile is smooth */
+#define RFX_SMOOTH_GRADIENT	8
+
+/* luma variance below which a tile is flat */
+#define RFX_FLAT_VARIANCE	16
+
+#define RFX_RATE_GAIN		1.5
+#define RFX_RATE_DEADBAND	0.15
+
+/**
+ * Tile statistics on an approximated luma, (R + 2G + B) / 4, over the
+ * pixels of the tile which are not padding. Each pixel is compared with its
+ * left and upper neighbours, the missing neighbours of the first row and
+ * column count as equal.
+ */
+
+static void rfx_encode_tile_stats(const INT16* r_buf, const INT16* g_buf, const INT16* b_buf,
+	int width, int height, RFX_TILE_STATS* stats)
+{
+	int x, y;
+	int dx, dy;
+	int luma, left;
+	UINT32 count;
+	UINT32 edges = 0;
+	UINT32 flat = 0;
+	UINT32 sum = 0;
+	UINT64 sumSq = 0;
+	UINT32 gradient = 0;
+	INT16 above[64];
+
+	count = width * height;
+
+	if (!count)
+	{
+		ZeroMemory(stats, sizeof(RFX_TILE_STATS));
+		return;
+	}
+
+	for (y = 0; y < height; y++)
+	{
+		left = (r_buf[0] + (g_buf[0] << 1) + b_buf[0]) >> 2;
+
+		if (y == 0)
+			above[0] = left;
+
+		for (x = 0; x < width; x++)
+		{
+			luma = (r_buf[x] + (g_buf[x] << 1) + b_buf[x]) >> 2;
+
+			if (y == 0)
+				above[x] = luma;
+
+			sum += luma;
+			sumSq += luma * luma;
+
+			dx = abs(luma - left);
+			dy = abs(luma - above[x]);
+
+			gradient += dx + dy;
+			edges += (dx >= RFX_EDGE_THRESHOLD) + (dy >= RFX_EDGE_THRESHOLD);
+			flat += (dx == 0) + (dy == 0);
+
+			above[x] = left = luma;
+		}
+
+		r_buf += 64;
+		g_buf += 64;
+		b_buf += 64;
+	}
+
+	stats->variance = (UINT32) ((sumSq - ((UINT64) sum * sum) / count) / count);
+	stats->edgeEnergy = gradient / count;
+	stats->edgeCount = edges;
+	stats->flatCount = flat;
+	stats->pairCount = count * 2;
+}
+
+/**
+ * Text and other synthetic content: sharp edges over a mostly flat
+ * background. Smooth: gradients and nearly flat tiles, without any sharp
+ * edge. Everything else, photos and video, is natural.
+ */
+
+int rfx_encode_classify_tile(const RFX_TILE_STATS* stats)
+{
+	if (stats->variance < RFX_FLAT_VARIANCE)
+		return RFX_TILE_CLASS_SMOOTH;
+
+	if ((stats->edgeCount * 64 >= stats->pairCount) && (stats->flatCount * 2 >= stats->pairCount))
+		return RFX_TILE_CLASS_TEXT;
+
+	if (!stats->edgeCount && (stats->edgeEnergy < RFX_SMOOTH_GRADIENT))
+		return RFX_TILE_CLASS_SMOOTH;
+
+	return RFX_TILE_CLASS_NATURAL;
+}
+
+int rfx_encode_get_quant_scale(RFX_CONTEXT* context)
+{
+	int rateScale = (int) (context->priv->RateScale + 0.5);
+
+	return (rateScale > context->priv->QuantScale) ? rateScale : context->priv->QuantScale;
+}
+
+/**
+ * Fills context->quants with the adaptive tables for the current
+ * quantization scale, before a frame is encoded. Text is coarsened at half
+ * the rate of the other classes, and LL3 for all of them.
+ */
+
+BOOL rfx_encode_adaptive_quants(RFX_CONTEXT* context)
+{
+	int i, j, k;
+	int scale;
+	int offset;
+	UINT32* quants;
+
+	if (context->numQuant != RFX_TILE_CLASS_COUNT * 2)
+	{
+		quants = (UINT32*) realloc(context->quants, RFX_TILE_CLASS_COUNT * 2 * 10 * sizeof(UINT32));
+
+		if (!quants)
+			return FALSE;
+
+		context->quants = quants;
+		context->numQuant = RFX_TILE_CLASS_COUNT * 2;
+	}
+
+	scale = rfx_encode_get_quant_scale(context);
+	quants = context->quants;
+
+	for (i = 0; i < 2; i++)
+	{
+		for (j = 0; j < RFX_TILE_CLASS_COUNT; j++)
+		{
+			offset = (j == RFX_TILE_CLASS_TEXT) ? scale / 2 : scale;
+
+			for (k = 0; k < 10; k++)
+			{
+				*quants = rfx_adaptive_quantization_values[j][i][k] + ((k == 0) ? offset / 2 : offset);
+
+				if (*quants > 15)
+					*quants = 15;
+
+				quants++;
+			}
+		}
+	}
+
+	PROFILER_COUNTER("rfx_quant_scale", scale);
+
+	return TRUE;
+}
+
+/**
+ * Rate control: moves the quantization scale by the log2 of the ratio of
+ * the last frame size to the target, one step roughly halving the size of
+ * the high frequency bands. Small errors are ignored, the scale would
+ * otherwise flip between two steps.
+ */
+
+void rfx_encode_rate_control(RFX_CONTEXT* context, UINT32 frameSize)
+{
+	double error;
+	RFX_CONTEXT_PRIV* priv = context->priv;
+
+	if (!priv->AdaptiveQuant || !priv->TargetFrameSize || !frameSize)
+		return;
+
+	error = log((double) frameSize / (double) priv->TargetFrameSize) / log(2.0);
+
+	if (fabs(error) < RFX_RATE_DEADBAND)
+		return;
+
+	priv->RateScale += RFX_RATE_GAIN * error;
+	priv->RateScale = MINMAX(priv->RateScale, 0.0, (double) RFX_QUANT_SCALE_MAX);
+}
+
 static void rfx_encode_format_rgb(const BYTE* rgb_data, int width, int height, int rowstride,
-	RDP_PIXEL_FORMAT pixel_format, const BYTE* palette, INT16* r_buf, INT16* g_buf, INT16* b_buf)
+	RDP_PIXEL_FORMAT pixel_format, const BYTE* palette, INT16* r_buf, INT16* g_buf, INT16* b_buf,
+	RFX_TILE_STATS* stats)
 {
 	int x, y;
 	int x_exceed;
@@ -50,6 +261,9 @@ static void rfx_encode_format_rgb(const BYTE* rgb_data, int width, int height, i
 	const BYTE* src;
 	INT16 r, g, b;
 	INT16 *r_last, *g_last, *b_last;
+	const INT16* r_first = r_buf;
+	const INT16* g_first = g_buf;
+	const INT16* b_first = b_buf;
 
 	x_exceed = 64 - width;
 	y_exceed = 64 - height;
@@ -165,6 +379,10 @@ static void rfx_encode_format_rgb(const BYTE* rgb_data, int width, int height, i
 		}
 	}
 
+	/* the statistics are taken while the tile is still in the cache */
+	if (stats)
+		rfx_encode_tile_stats(r_first, g_first, b_first, width, height, stats);
+
 	/* Fill the vertical region outside of 64x64 tile size with the last line. */
 	if (y_exceed > 0)
 	{
@@ -221,15 +439,15 @@ void rfx_encode_rgb(RFX_CONTEXT* context, RFX_TILE* tile)
 {
 	BYTE* pBuffer;
 	INT16* pSrcDst[3];
+	int tileClass;
 	int YLen, CbLen, CrLen;
+	RFX_TILE_STATS stats;
 	UINT32 *YQuant, *CbQuant, *CrQuant;
+	BOOL adaptive = context->priv->AdaptiveQuant;
 	primitives_t* prims = primitives_get();
 	static const prim_size_t roi_64x64 = { 64, 64 };
 
 	YLen = CbLen = CrLen = 0;
-	YQuant = context->quants + (tile->quantIdxY * 10);
-	CbQuant = context->quants + (tile->quantIdxCb * 10);
-	CrQuant = context->quants + (tile->quantIdxCr * 10);
 
 	pBuffer = (BYTE*) BufferPool_Take(context->priv->BufferPool, -1);
 	pSrcDst[0] = (INT16*)((BYTE*)(&pBuffer[((8192 + 32) * 0) + 16])); /* y_r_buffer */
@@ -240,9 +458,22 @@ void rfx_encode_rgb(RFX_CONTEXT* context, RFX_TILE* tile)
 
 	PROFILER_ENTER(context->priv->prof_rfx_encode_format_rgb);
 		rfx_encode_format_rgb(tile->data, tile->width, tile->height, tile->scanline,
-			context->pixel_format, context->palette, pSrcDst[0], pSrcDst[1], pSrcDst[2]);
+			context->pixel_format, context->palette, pSrcDst[0], pSrcDst[1], pSrcDst[2],
+			adaptive ? &stats : NULL);
 	PROFILER_EXIT(context->priv->prof_rfx_encode_format_rgb);
 
+	if (adaptive)
+	{
+		tileClass = rfx_encode_classify_tile(&stats);
+		tile->quantIdxY = tileClass;
+		tile->quantIdxCb = RFX_TILE_CLASS_COUNT + tileClass;
+		tile->quantIdxCr = RFX_TILE_CLASS_COUNT + tileClass;
+	}
+
+	YQuant = context->quants + (tile->quantIdxY * 10);
+	CbQuant = context->quants + (tile->quantIdxCb * 10);
+	CrQuant = context->quants + (tile->quantIdxCr * 10);
+
 	PROFILER_ENTER(context->priv->prof_rfx_rgb_to_ycbcr);
 		prims->RGBToYCbCr_16s16s_P3P3((const INT16**) pSrcDst, 64 * sizeof(INT16),
 			pSrcDst, 64 * sizeof(INT16), &roi_64x64);
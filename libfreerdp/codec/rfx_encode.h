@@ -22,7 +22,30 @@
 
 #include <freerdp/codec/rfx.h>
 
+enum _RFX_TILE_CLASS
+{
+	RFX_TILE_CLASS_TEXT = 0,
+	RFX_TILE_CLASS_NATURAL,
+	RFX_TILE_CLASS_SMOOTH,
+	RFX_TILE_CLASS_COUNT
+};
+
+struct _RFX_TILE_STATS
+{
+	UINT32 variance;
+	UINT32 edgeEnergy; /* mean absolute luma gradient */
+	UINT32 edgeCount; /* neighbour pairs across a sharp edge */
+	UINT32 flatCount; /* neighbour pairs of equal luma */
+	UINT32 pairCount;
+};
+typedef struct _RFX_TILE_STATS RFX_TILE_STATS;
+
 void rfx_encode_rgb(RFX_CONTEXT* context, RFX_TILE* tile);
 
+int rfx_encode_classify_tile(const RFX_TILE_STATS* stats);
+int rfx_encode_get_quant_scale(RFX_CONTEXT* context);
+BOOL rfx_encode_adaptive_quants(RFX_CONTEXT* context);
+void rfx_encode_rate_control(RFX_CONTEXT* context, UINT32 frameSize);
+
 #endif
 
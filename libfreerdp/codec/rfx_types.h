@@ -58,6 +58,12 @@ struct _RFX_CONTEXT_PRIV
  
 	wBufferPool* BufferPool;
 
+	/* adaptive quantization */
+	BOOL AdaptiveQuant;
+	int QuantScale;
+	double RateScale;
+	UINT32 TargetFrameSize;
+
 	/* profilers */
 	PROFILER_DEFINE(prof_rfx_decode_rgb);
 	PROFILER_DEFINE(prof_rfx_decode_component);
@@ -0,0 +1,453 @@
+
+#include <stdio.h>
+#include <math.h>
+
+#include <winpr/crt.h>
+#include <winpr/sysinfo.h>
+
+#include <freerdp/codec/dsp.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define TEST_SECONDS		20
+#define TEST_CHUNK		441
+
+static const char* test_quality_names[] = { "low", "medium", "high" };
+
+static UINT32 test_random(UINT32* seed)
+{
+	*seed = (*seed * 1103515245) + 12345;
+	return (*seed >> 8);
+}
+
+/**
+ * The conversion kernels must match the scalar definitions exactly,
+ * including the tails that do not fill a whole vector.
+ */
+
+static int test_dsp_conversions(void)
+{
+	int i;
+	int frames = 1003;
+	UINT32 seed = 1;
+	INT32 left, right;
+	INT16* src;
+	INT16* dst;
+	float* f32;
+
+	src = (INT16*) calloc(frames * 6, sizeof(INT16));
+	dst = (INT16*) calloc(frames * 6, sizeof(INT16));
+	f32 = (float*) calloc(frames * 6, sizeof(float));
+
+	if (!src || !dst || !f32)
+		return -1;
+
+	for (i = 0; i < frames * 6; i++)
+		src[i] = (INT16) test_random(&seed);
+
+	src[0] = -32768;
+	src[1] = 32767;
+
+	freerdp_dsp_s16_to_f32(src, f32, frames * 6);
+	freerdp_dsp_f32_to_s16(f32, dst, frames * 6);
+
+	for (i = 0; i < frames * 6; i++)
+	{
+		if ((dst[i] != src[i]) || (f32[i] != src[i] / 32768.0f))
+		{
+			printf("s16/f32 round trip mismatch at %d: %d -> %f -> %d\n", i, src[i], f32[i], dst[i]);
+			return -1;
+		}
+	}
+
+	f32[0] = 2.0f;
+	f32[1] = -2.0f;
+	f32[frames - 1] = 1.5f;
+	freerdp_dsp_f32_to_s16(f32, dst, frames);
+
+	if ((dst[0] != 32767) || (dst[1] != -32768) || (dst[frames - 1] != 32767))
+	{
+		printf("f32 to s16 does not saturate\n");
+		return -1;
+	}
+
+	freerdp_dsp_mono_to_stereo(src, dst, frames);
+
+	for (i = 0; i < frames; i++)
+	{
+		if ((dst[i * 2] != src[i]) || (dst[i * 2 + 1] != src[i]))
+		{
+			printf("mono to stereo mismatch at frame %d\n", i);
+			return -1;
+		}
+	}
+
+	freerdp_dsp_stereo_to_mono(src, dst, frames);
+
+	for (i = 0; i < frames; i++)
+	{
+		if (dst[i] != (INT16) ((src[i * 2] + src[i * 2 + 1]) >> 1))
+		{
+			printf("stereo to mono mismatch at frame %d\n", i);
+			return -1;
+		}
+	}
+
+	freerdp_dsp_downmix_51_to_stereo(src, dst, frames);
+
+	for (i = 0; i < frames; i++)
+	{
+		left = (src[i * 6] * 13573 + src[i * 6 + 2] * 9598 + src[i * 6 + 4] * 9598 + (1 << 14)) >> 15;
+		right = (src[i * 6 + 1] * 13573 + src[i * 6 + 2] * 9598 + src[i * 6 + 5] * 9598 + (1 << 14)) >> 15;
+		left = (left > 32767) ? 32767 : ((left < -32768) ? -32768 : left);
+		right = (right > 32767) ? 32767 : ((right < -32768) ? -32768 : right);
+
+		if ((dst[i * 2] != left) || (dst[i * 2 + 1] != right))
+		{
+			printf("5.1 downmix mismatch at frame %d: %d %d, expected %d %d\n",
+					i, dst[i * 2], dst[i * 2 + 1], left, right);
+			return -1;
+		}
+	}
+
+	free(src);
+	free(dst);
+	free(f32);
+
+	return 0;
+}
+
+static INT16* test_dsp_sine(UINT32 rate, UINT32 channels, double frequency, double amplitude, int frames)
+{
+	int i;
+	UINT32 j;
+	INT16* samples;
+
+	samples = (INT16*) calloc(frames * channels, sizeof(INT16));
+
+	if (!samples)
+		return NULL;
+
+	for (i = 0; i < frames; i++)
+	{
+		for (j = 0; j < channels; j++)
+			samples[i * channels + j] = (INT16) floor(32767.0 * amplitude * sin(2.0 * M_PI * frequency * i / rate) + 0.5);
+	}
+
+	return samples;
+}
+
+/**
+ * Resamples the input in chunks, as the audio channels do, and collects the
+ * first channel of the output.
+ */
+
+static int test_dsp_run(FREERDP_DSP_CONTEXT* context, const INT16* src, UINT32 schan, UINT32 srate,
+	int sframes, UINT32 rchan, UINT32 rrate, double* dst, int* rframes)
+{
+	int i;
+	int chunk;
+	int offset;
+	const INT16* resampled;
+
+	*rframes = 0;
+	freerdp_dsp_context_reset_resampler(context);
+
+	for (offset = 0; offset < sframes; offset += chunk)
+	{
+		/* vary the chunk size so that the filter history crosses calls at every phase */
+
+		chunk = TEST_CHUNK + (offset % 7) * 13;
+
+		if (chunk > sframes - offset)
+			chunk = sframes - offset;
+
+		if (!context->resample(context, (const BYTE*) &src[offset * schan], 2, schan, srate, chunk, rchan, rrate))
+			return -1;
+
+		resampled = (const INT16*) context->resampled_buffer;
+
+		if (context->resampled_size != context->resampled_frames * rchan * 2)
+			return -1;
+
+		for (i = 0; i < (int) context->resampled_frames; i++)
+		{
+			if (dst)
+				dst[*rframes] = resampled[i * rchan] / 32768.0;
+
+			(*rframes)++;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Fits a sine at the expected frequency to the output by least squares and
+ * returns the ratio of its power to the power of everything else, in dB.
+ */
+
+static double test_dsp_snr(const double* y, int first, int count, double frequency, UINT32 rate)
+{
+	int n;
+	double s, c, r;
+	double ss = 0.0, sc = 0.0, cc = 0.0;
+	double ys = 0.0, yc = 0.0;
+	double a, b, det;
+	double signal = 0.0;
+	double noise = 0.0;
+
+	for (n = first; n < first + count; n++)
+	{
+		s = sin(2.0 * M_PI * frequency * n / rate);
+		c = cos(2.0 * M_PI * frequency * n / rate);
+		ss += s * s;
+		sc += s * c;
+		cc += c * c;
+		ys += y[n] * s;
+		yc += y[n] * c;
+	}
+
+	det = ss * cc - sc * sc;
+	a = (ys * cc - yc * sc) / det;
+	b = (yc * ss - ys * sc) / det;
+
+	for (n = first; n < first + count; n++)
+	{
+		s = a * sin(2.0 * M_PI * frequency * n / rate) + b * cos(2.0 * M_PI * frequency * n / rate);
+		r = y[n] - s;
+		signal += s * s;
+		noise += r * r;
+	}
+
+	if (noise <= 0.0)
+		return 200.0;
+
+	return 10.0 * log10(signal / noise);
+}
+
+static double test_dsp_power(const double* y, int first, int count)
+{
+	int n;
+	double power = 0.0;
+
+	for (n = first; n < first + count; n++)
+		power += y[n] * y[n];
+
+	return power / count;
+}
+
+/**
+ * Sweeps a sine through the passband of each conversion and checks the
+ * worst signal to noise ratio against the floor of each quality level.
+ */
+
+struct _TEST_DSP_RATES
+{
+	UINT32 schan;
+	UINT32 srate;
+	UINT32 rchan;
+	UINT32 rrate;
+};
+typedef struct _TEST_DSP_RATES TEST_DSP_RATES;
+
+static const TEST_DSP_RATES test_rates[] =
+{
+	{ 2, 44100, 2, 48000 },
+	{ 2, 48000, 2, 44100 },
+	{ 1, 22050, 2, 44100 },
+	{ 2, 48000, 1, 22050 },
+	{ 6, 48000, 2, 44100 },
+	{ 1, 8000, 1, 44100 }
+};
+
+static const double test_snr_floor[] = { 40.0, 60.0, 75.0 };
+
+static int test_dsp_sweep(FREERDP_DSP_CONTEXT* context, int quality)
+{
+	int i;
+	int step;
+	int sframes;
+	int rframes;
+	int expected;
+	UINT32 nyquist;
+	double snr;
+	double worst;
+	double frequency;
+	INT16* src;
+	double* dst;
+	const TEST_DSP_RATES* rates;
+
+	freerdp_dsp_context_set_quality(context, quality);
+
+	for (i = 0; i < (int) (sizeof(test_rates) / sizeof(test_rates[0])); i++)
+	{
+		rates = &test_rates[i];
+		sframes = rates->srate / 2;
+		nyquist = ((rates->srate < rates->rrate) ? rates->srate : rates->rrate) / 2;
+		dst = (double*) calloc(sframes * rates->rrate / rates->srate + 64, sizeof(double));
+
+		if (!dst)
+			return -1;
+
+		worst = 200.0;
+
+		for (step = 1; step <= 7; step++)
+		{
+			/* 1/8 to 7/10 of the lower Nyquist rate */
+
+			frequency = nyquist * (0.125 + (0.7 - 0.125) * (step - 1) / 6.0);
+			src = test_dsp_sine(rates->srate, rates->schan, frequency, 0.25, sframes);
+
+			if (!src)
+				return -1;
+
+			if (test_dsp_run(context, src, rates->schan, rates->srate, sframes,
+					rates->rchan, rates->rrate, dst, &rframes) < 0)
+				return -1;
+
+			free(src);
+
+			/* every input sample but the ones still held by the filter comes out */
+
+			expected = (int) ((double) sframes * rates->rrate / rates->srate);
+
+			if ((rframes > expected + 1) || (rframes < expected - 300))
+			{
+				printf("%d Hz -> %d Hz: %d frames out, expected about %d\n",
+						rates->srate, rates->rrate, rframes, expected);
+				return -1;
+			}
+
+			snr = test_dsp_snr(dst, 512, rframes - 1024, frequency, rates->rrate);
+
+			if (snr < worst)
+				worst = snr;
+		}
+
+		printf("%-6s %5d Hz %d ch -> %5d Hz %d ch: worst SNR %6.1f dB\n", test_quality_names[quality],
+				rates->srate, rates->schan, rates->rrate, rates->rchan, worst);
+
+		free(dst);
+
+		if (worst < test_snr_floor[quality])
+		{
+			printf("SNR below %.0f dB\n", test_snr_floor[quality]);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * A tone above the output Nyquist rate must be filtered out rather than
+ * folded back into the audible band.
+ */
+
+static const double test_alias_floor[] = { -25.0, -45.0, -60.0 };
+
+static int test_dsp_aliasing(FREERDP_DSP_CONTEXT* context, int quality)
+{
+	int sframes = 48000;
+	int rframes;
+	double input;
+	double output;
+	double attenuation;
+	INT16* src;
+	double* dst;
+
+	freerdp_dsp_context_set_quality(context, quality);
+
+	src = test_dsp_sine(48000, 1, 15000.0, 0.5, sframes);
+	dst = (double*) calloc(sframes, sizeof(double));
+
+	if (!src || !dst)
+		return -1;
+
+	if (test_dsp_run(context, src, 1, 48000, sframes, 1, 22050, dst, &rframes) < 0)
+		return -1;
+
+	input = 0.5 * 0.5 / 2.0;
+	output = test_dsp_power(dst, 512, rframes - 1024);
+	attenuation = 10.0 * log10((output + 1e-20) / input);
+
+	printf("%-6s 15 kHz tone at 48000 Hz -> 22050 Hz: %6.1f dB\n", test_quality_names[quality], attenuation);
+
+	free(src);
+	free(dst);
+
+	if (attenuation > test_alias_floor[quality])
+	{
+		printf("alias above %.0f dB\n", test_alias_floor[quality]);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int test_dsp_throughput(FREERDP_DSP_CONTEXT* context, int quality)
+{
+	int rframes;
+	int sframes = 44100 * TEST_SECONDS;
+	UINT64 start;
+	UINT64 elapsed;
+	INT16* src;
+
+	freerdp_dsp_context_set_quality(context, quality);
+
+	src = test_dsp_sine(44100, 2, 1000.0, 0.5, sframes);
+
+	if (!src)
+		return -1;
+
+	start = GetTickCount64();
+
+	if (test_dsp_run(context, src, 2, 44100, sframes, 2, 48000, NULL, &rframes) < 0)
+		return -1;
+
+	elapsed = GetTickCount64() - start;
+
+	if (!elapsed)
+		elapsed = 1;
+
+	printf("%-6s 44100 Hz -> 48000 Hz stereo: %10.0f frames/s (%.0fx real time)\n",
+			test_quality_names[quality], rframes / (elapsed / 1000.0),
+			(TEST_SECONDS * 1000.0) / elapsed);
+
+	free(src);
+
+	return 0;
+}
+
+int TestFreeRDPCodecDsp(int argc, char* argv[])
+{
+	int quality;
+	FREERDP_DSP_CONTEXT* context;
+
+	if (test_dsp_conversions() < 0)
+		return -1;
+
+	context = freerdp_dsp_context_new();
+
+	if (!context)
+		return -1;
+
+	for (quality = FREERDP_DSP_QUALITY_LOW; quality <= FREERDP_DSP_QUALITY_HIGH; quality++)
+	{
+		if (test_dsp_sweep(context, quality) < 0)
+			return -1;
+
+		if (test_dsp_aliasing(context, quality) < 0)
+			return -1;
+
+		if (test_dsp_throughput(context, quality) < 0)
+			return -1;
+	}
+
+	freerdp_dsp_context_free(context);
+
+	return 0;
+}
@@ -0,0 +1,284 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <winpr/crt.h>
+#include <winpr/stream.h>
+#include <winpr/sysinfo.h>
+
+#include <freerdp/codec/jpeg.h>
+#include <freerdp/codec/nsc.h>
+#include <freerdp/codec/color.h>
+
+#define BENCHMARK_WIDTH		1024
+#define BENCHMARK_HEIGHT	768
+#define BENCHMARK_FRAMES	20
+
+#define MIN_PSNR		30.0
+
+static UINT32 g_Seed = 1;
+
+static UINT32 test_rand(void)
+{
+	g_Seed = g_Seed * 1103515245 + 12345;
+	return (g_Seed >> 16) & 0x7FFF;
+}
+
+static BYTE test_clamp(int value)
+{
+	return (BYTE) ((value < 0) ? 0 : ((value > 255) ? 255 : value));
+}
+
+/* smooth shapes, soft edges and sensor noise, as in a photo */
+static BYTE* test_create_photo(int width, int height)
+{
+	int x, y;
+	int noise;
+	double fx, fy;
+	BYTE* data;
+	BYTE* p;
+
+	data = (BYTE*) malloc(width * height * 4);
+
+	if (!data)
+		return NULL;
+
+	g_Seed = 1;
+
+	for (y = 0; y < height; y++)
+	{
+		p = &data[y * width * 4];
+		fy = (double) y / height;
+
+		for (x = 0; x < width; x++)
+		{
+			fx = (double) x / width;
+			noise = (int) (test_rand() % 9) - 4;
+
+			*p++ = test_clamp((int) (128 + 90 * sin(fx * 7.0 + fy * 3.0)) + noise);
+			*p++ = test_clamp((int) (120 + 80 * cos(fx * 4.0 - fy * 9.0) * sin(fy * 5.0)) + noise);
+			*p++ = test_clamp((int) (140 + 100 * sin((fx - 0.5) * (fy - 0.5) * 40.0)) + noise);
+			*p++ = 0xFF;
+		}
+	}
+
+	return data;
+}
+
+/* the decoder writes R, G, B triplets */
+static double test_psnr(const BYTE* image, const BYTE* decoded, int width, int height)
+{
+	int i;
+	int diff;
+	UINT64 error = 0;
+
+	for (i = 0; i < width * height; i++)
+	{
+		diff = image[i * 4 + 2] - decoded[i * 3 + 0];
+		error += diff * diff;
+		diff = image[i * 4 + 1] - decoded[i * 3 + 1];
+		error += diff * diff;
+		diff = image[i * 4 + 0] - decoded[i * 3 + 2];
+		error += diff * diff;
+	}
+
+	if (!error)
+		return 99.0;
+
+	return 10.0 * log10((255.0 * 255.0 * width * height * 3) / (double) error);
+}
+
+static int test_round_trip(JPEG_CONTEXT* jpeg, int width, int height)
+{
+	int status = -1;
+	double psnr;
+	BYTE* image;
+	BYTE* decoded;
+	BYTE* pDstData = NULL;
+	UINT32 DstSize = 0;
+
+	image = test_create_photo(width, height);
+	decoded = (BYTE*) malloc(width * height * 3);
+
+	if (!image || !decoded)
+		goto out;
+
+	if (jpeg_compress(jpeg, image, PIXEL_FORMAT_XRGB32, width * 4, width, height, &pDstData, &DstSize) < 0)
+	{
+		printf("jpeg_compress failed for %dx%d\n", width, height);
+		goto out;
+	}
+
+	if (!jpeg_decompress(pDstData, decoded, width, height, DstSize, 24))
+	{
+		printf("jpeg_decompress failed for %dx%d\n", width, height);
+		goto out;
+	}
+
+	psnr = test_psnr(image, decoded, width, height);
+	printf("%dx%d: %u bytes, %.2f dB\n", width, height, DstSize, psnr);
+
+	if (psnr < MIN_PSNR)
+	{
+		printf("the decoded image is too far from the original\n");
+		goto out;
+	}
+
+	status = 1;
+
+out:
+	free(image);
+	free(decoded);
+	return status;
+}
+
+/**
+ * The slices are joined into the image a single compress object writes:
+ * the restart intervals are the same, and so is every byte.
+ */
+
+static int test_slices(JPEG_CONTEXT* jpeg)
+{
+	int status = -1;
+	BYTE* image;
+	BYTE* single = NULL;
+	BYTE* pDstData;
+	UINT32 singleSize;
+	UINT32 DstSize;
+
+	image = test_create_photo(BENCHMARK_WIDTH, BENCHMARK_HEIGHT);
+
+	if (!image)
+		return -1;
+
+	jpeg_context_set_max_slices(jpeg, 1);
+
+	if (jpeg_compress(jpeg, image, PIXEL_FORMAT_XRGB32, BENCHMARK_WIDTH * 4,
+			BENCHMARK_WIDTH, BENCHMARK_HEIGHT, &pDstData, &singleSize) < 0)
+		goto out;
+
+	single = (BYTE*) malloc(singleSize);
+
+	if (!single)
+		goto out;
+
+	CopyMemory(single, pDstData, singleSize);
+
+	jpeg_context_set_max_slices(jpeg, 7);
+
+	if (jpeg_compress(jpeg, image, PIXEL_FORMAT_XRGB32, BENCHMARK_WIDTH * 4,
+			BENCHMARK_WIDTH, BENCHMARK_HEIGHT, &pDstData, &DstSize) < 0)
+		goto out;
+
+	if ((DstSize != singleSize) || (memcmp(pDstData, single, DstSize) != 0))
+	{
+		printf("the sliced image differs from the single slice one: %u/%u bytes\n", DstSize, singleSize);
+		goto out;
+	}
+
+	status = 1;
+
+out:
+	free(image);
+	free(single);
+	return status;
+}
+
+static int test_benchmark(JPEG_CONTEXT* jpeg)
+{
+	int i;
+	int status = -1;
+	wStream* s;
+	BYTE* image;
+	BYTE* pDstData;
+	UINT32 DstSize = 0;
+	DWORD start;
+	DWORD elapsedJpeg;
+	DWORD elapsedNsc;
+	NSC_CONTEXT* nsc;
+	double megapixels = (double) BENCHMARK_WIDTH * BENCHMARK_HEIGHT * BENCHMARK_FRAMES / 1000000.0;
+
+	image = test_create_photo(BENCHMARK_WIDTH, BENCHMARK_HEIGHT);
+	nsc = nsc_context_new();
+	s = Stream_New(NULL, 1024);
+
+	if (!image || !nsc || !s)
+		goto out;
+
+	nsc_context_set_pixel_format(nsc, RDP_PIXEL_FORMAT_B8G8R8A8);
+	nsc->ColorLossLevel = 3;
+	nsc->ChromaSubsamplingLevel = 1;
+
+	start = GetTickCount();
+
+	for (i = 0; i < BENCHMARK_FRAMES; i++)
+	{
+		if (jpeg_compress(jpeg, image, PIXEL_FORMAT_XRGB32, BENCHMARK_WIDTH * 4,
+				BENCHMARK_WIDTH, BENCHMARK_HEIGHT, &pDstData, &DstSize) < 0)
+			goto out;
+	}
+
+	elapsedJpeg = GetTickCount() - start;
+	start = GetTickCount();
+
+	for (i = 0; i < BENCHMARK_FRAMES; i++)
+	{
+		Stream_SetPosition(s, 0);
+		nsc_compose_message(nsc, s, image, BENCHMARK_WIDTH, BENCHMARK_HEIGHT, BENCHMARK_WIDTH * 4);
+	}
+
+	elapsedNsc = GetTickCount() - start;
+
+	printf("photo %dx%d x%d: jpeg %u bytes %u ms (%.1f MP/s), nscodec %u bytes %u ms (%.1f MP/s)\n",
+			BENCHMARK_WIDTH, BENCHMARK_HEIGHT, BENCHMARK_FRAMES,
+			DstSize, elapsedJpeg, megapixels * 1000.0 / (elapsedJpeg ? elapsedJpeg : 1),
+			(UINT32) Stream_GetPosition(s), elapsedNsc, megapixels * 1000.0 / (elapsedNsc ? elapsedNsc : 1));
+
+	status = 1;
+
+out:
+	if (s)
+		Stream_Free(s, TRUE);
+
+	if (nsc)
+		nsc_context_free(nsc);
+
+	free(image);
+	return status;
+}
+
+int TestFreeRDPCodecJpeg(int argc, char* argv[])
+{
+	int status = -1;
+	JPEG_CONTEXT* jpeg;
+
+	jpeg = jpeg_context_new();
+
+	if (!jpeg)
+	{
+		printf("no JPEG support, skipping\n");
+		return 0;
+	}
+
+	jpeg_context_set_quality(jpeg, 85);
+
+	if ((test_round_trip(jpeg, 64, 64) < 0) ||
+			(test_round_trip(jpeg, 100, 37) < 0) ||
+			(test_round_trip(jpeg, 1, 1) < 0) ||
+			(test_round_trip(jpeg, BENCHMARK_WIDTH, BENCHMARK_HEIGHT) < 0))
+		goto out;
+
+	if (test_slices(jpeg) < 0)
+		goto out;
+
+	jpeg_context_set_max_slices(jpeg, 16);
+
+	if (test_benchmark(jpeg) < 0)
+		goto out;
+
+	status = 0;
+
+out:
+	jpeg_context_free(jpeg);
+	return status;
+}
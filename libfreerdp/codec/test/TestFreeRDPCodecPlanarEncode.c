@@ -0,0 +1,343 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <winpr/crt.h>
+#include <winpr/sysinfo.h>
+
+#include <freerdp/codec/planar.h>
+
+#define IMAGE_KINDS	7
+
+/**
+ * The planar encoder as it was before the fused split and delta pass and
+ * the run scanner: split the planes, delta encode them, then run length
+ * encode them one after the other in a budget of four raw planes.
+ */
+
+static int reference_compress(DWORD flags, const BYTE* data, UINT32 format, int width, int height,
+		int scanline, BYTE* dstData)
+{
+	int i;
+	int budget;
+	int offset = 0;
+	int dstSizes[4];
+	int planeSize = width * height;
+	BYTE* planes[4];
+	BYTE* deltaPlanes[4];
+	BYTE* rlePlanes;
+	BYTE* dstp = dstData;
+	BYTE FormatHeader = 0;
+	BOOL skipAlpha = (flags & PLANAR_FORMAT_HEADER_NA) ? TRUE : FALSE;
+
+	rlePlanes = (BYTE*) malloc(planeSize * 4);
+
+	for (i = 0; i < 4; i++)
+	{
+		planes[i] = (BYTE*) malloc(planeSize);
+		deltaPlanes[i] = (BYTE*) malloc(planeSize);
+	}
+
+	if (skipAlpha)
+		FormatHeader |= PLANAR_FORMAT_HEADER_NA;
+
+	freerdp_split_color_planes((BYTE*) data, format, width, height, scanline, planes);
+
+	if (flags & PLANAR_FORMAT_HEADER_RLE)
+	{
+		freerdp_bitmap_planar_delta_encode_planes(planes, width, height, deltaPlanes);
+
+		budget = planeSize * 4;
+		FormatHeader |= PLANAR_FORMAT_HEADER_RLE;
+		dstSizes[0] = 0;
+
+		for (i = skipAlpha ? 1 : 0; i < 4; i++)
+		{
+			dstSizes[i] = budget;
+
+			if (!freerdp_bitmap_planar_compress_plane_rle(deltaPlanes[i], width, height,
+					&rlePlanes[offset], &dstSizes[i]))
+			{
+				FormatHeader &= ~PLANAR_FORMAT_HEADER_RLE;
+				break;
+			}
+
+			offset += dstSizes[i];
+			budget -= dstSizes[i];
+		}
+	}
+
+	*dstp++ = FormatHeader;
+
+	for (i = skipAlpha ? 1 : 0, offset = 0; i < 4; i++)
+	{
+		if (FormatHeader & PLANAR_FORMAT_HEADER_RLE)
+		{
+			CopyMemory(dstp, &rlePlanes[offset], dstSizes[i]);
+			dstp += dstSizes[i];
+			offset += dstSizes[i];
+		}
+		else
+		{
+			CopyMemory(dstp, planes[i], planeSize);
+			dstp += planeSize;
+		}
+	}
+
+	if (!(FormatHeader & PLANAR_FORMAT_HEADER_RLE))
+		*dstp++ = 0;
+
+	for (i = 0; i < 4; i++)
+	{
+		free(planes[i]);
+		free(deltaPlanes[i]);
+	}
+
+	free(rlePlanes);
+
+	return (int) (dstp - dstData);
+}
+
+static UINT32 test_rand(UINT32* seed)
+{
+	*seed = (*seed * 1103515245) + 12345;
+	return (*seed >> 8);
+}
+
+/**
+ * Synthetic content: flat areas, gradients, noise, sparse text-like
+ * strokes on a background, stripes of every run length, translucent
+ * content and runs of zero at the start of the scanlines.
+ */
+
+static void fill_image(BYTE* data, int kind, int width, int height, int scanline, UINT32 seed)
+{
+	int x, y;
+	UINT32 r;
+	UINT32* pixel;
+
+	for (y = 0; y < height; y++)
+	{
+		pixel = (UINT32*) &data[y * scanline];
+
+		for (x = 0; x < width; x++)
+		{
+			r = test_rand(&seed);
+
+			switch (kind)
+			{
+				case 0:
+					pixel[x] = 0xFF3A6EA5;
+					break;
+
+				case 1:
+					pixel[x] = 0xFF000000 | ((x * 255 / width) << 16) | ((y * 255 / height) << 8) | ((x + y) & 0xFF);
+					break;
+
+				case 2:
+					pixel[x] = r ^ (test_rand(&seed) << 16);
+					break;
+
+				case 3:
+					pixel[x] = ((r % 29) == 0) ? 0xFF000000 | (r & 0x3F3F3F) : 0xFFFFFFFF;
+					break;
+
+				case 4:
+					pixel[x] = 0xFF000000 | (((x / (1 + (y % 7))) & 1) ? 0x00C0C0C0 : 0x00101010);
+					break;
+
+				case 5:
+					pixel[x] = ((x * 7 + y) << 24) | (((r & 3) == 0) ? (r & 0xFFFFFF) : 0x00804020);
+					break;
+
+				default:
+					pixel[x] = (x < (y % 9)) ? 0 : ((r & 1) ? 0x01010101 : 0);
+					break;
+			}
+		}
+	}
+}
+
+static int test_bit_exact(void)
+{
+	int i, k, f, c;
+	int kind;
+	int width, height, scanline;
+	int dstSize;
+	int refSize;
+	int count = 0;
+	BYTE* data;
+	BYTE* buffer;
+	BYTE* reference;
+	BYTE* compressed;
+	BITMAP_PLANAR_CONTEXT* planar;
+	static const int sizes[][2] = {
+		{ 1, 1 }, { 3, 5 }, { 15, 17 }, { 16, 16 }, { 17, 3 }, { 31, 33 },
+		{ 64, 64 }, { 100, 37 }, { 257, 129 }, { 640, 480 }
+	};
+	static const DWORD flags[] = {
+		PLANAR_FORMAT_HEADER_RLE | PLANAR_FORMAT_HEADER_NA,
+		PLANAR_FORMAT_HEADER_RLE,
+		PLANAR_FORMAT_HEADER_NA,
+		0
+	};
+	static const UINT32 formats[] = {
+		PIXEL_FORMAT_ARGB32, PIXEL_FORMAT_XRGB32, PIXEL_FORMAT_RGB24
+	};
+
+	for (i = 0; i < (int) (sizeof(sizes) / sizeof(sizes[0])); i++)
+	{
+		width = sizes[i][0];
+		height = sizes[i][1];
+		scanline = (width + (i & 1) * 3) * 4;
+
+		data = (BYTE*) calloc(height, scanline);
+		buffer = (BYTE*) malloc((width * height * 4) + 2);
+		reference = (BYTE*) malloc((width * height * 4) + 2);
+
+		if (!data || !buffer || !reference)
+			return -1;
+
+		for (f = 0; f < (int) (sizeof(flags) / sizeof(flags[0])); f++)
+		{
+			planar = freerdp_bitmap_planar_context_new(flags[f], width, height);
+
+			if (!planar)
+				return -1;
+
+			/* runs the thread pool path even on a single processor */
+			planar->UseThreads = TRUE;
+
+			for (kind = 0; kind < IMAGE_KINDS; kind++)
+			{
+				for (c = 0; c < (int) (sizeof(formats) / sizeof(formats[0])); c++)
+				{
+					fill_image(data, kind, width, height, scanline, (i * 31) + (kind * 7) + c);
+
+					refSize = reference_compress(flags[f], data, formats[c], width, height, scanline, reference);
+
+					/* twice, to catch state left over from the previous bitmap */
+					for (k = 0; k < 2; k++)
+					{
+						compressed = freerdp_bitmap_compress_planar(planar, data, formats[c],
+								width, height, scanline, buffer, &dstSize);
+
+						if (!compressed || (dstSize != refSize) || (memcmp(compressed, reference, refSize) != 0))
+						{
+							fprintf(stderr, "planar output differs for %dx%d, image %d, flags 0x%02X, format %d: "
+									"%d bytes instead of %d\n", width, height, kind, (int) flags[f], c,
+									dstSize, refSize);
+							return -1;
+						}
+					}
+
+					count++;
+				}
+			}
+
+			freerdp_bitmap_planar_context_free(planar);
+		}
+
+		free(data);
+		free(buffer);
+		free(reference);
+	}
+
+	printf("planar encoder bit-exact on %d bitmaps\n", count);
+
+	return 0;
+}
+
+/**
+ * Desktop-like 1920x1080 content, encoded as the shadow server does in
+ * 64x64 tiles, and as a single bitmap.
+ */
+
+static int test_throughput(void)
+{
+	int x, y;
+	int pass;
+	int dstSize;
+	int iterations;
+	int width = 1920;
+	int height = 1080;
+	int scanline = width * 4;
+	UINT32 start;
+	UINT32 elapsed[2][2];
+	BYTE* data;
+	BYTE* buffer;
+	BITMAP_PLANAR_CONTEXT* tiles;
+	BITMAP_PLANAR_CONTEXT* whole;
+	DWORD flags = PLANAR_FORMAT_HEADER_RLE | PLANAR_FORMAT_HEADER_NA;
+
+	data = (BYTE*) malloc(height * scanline);
+	buffer = (BYTE*) malloc((width * height * 4) + 2);
+	tiles = freerdp_bitmap_planar_context_new(flags, 64, 64);
+	whole = freerdp_bitmap_planar_context_new(flags, width, height);
+
+	if (!data || !buffer || !tiles || !whole)
+		return -1;
+
+	fill_image(data, 3, width, height / 2, scanline, 1);
+	fill_image(&data[(height / 2) * scanline], 1, width, height - (height / 2), scanline, 2);
+
+	iterations = 4;
+
+	for (pass = 0; pass < 2; pass++)
+	{
+		start = GetTickCount();
+
+		for (x = 0; x < iterations; x++)
+		{
+			for (y = 0; y + 64 <= height; y += 64)
+			{
+				int tx;
+
+				for (tx = 0; tx < width; tx += 64)
+				{
+					if (pass)
+						freerdp_bitmap_compress_planar(tiles, &data[(y * scanline) + (tx * 4)],
+								PIXEL_FORMAT_XRGB32, 64, 64, scanline, buffer, &dstSize);
+					else
+						reference_compress(flags, &data[(y * scanline) + (tx * 4)],
+								PIXEL_FORMAT_XRGB32, 64, 64, scanline, buffer);
+				}
+			}
+		}
+
+		elapsed[pass][0] = GetTickCount() - start;
+		start = GetTickCount();
+
+		for (x = 0; x < iterations; x++)
+		{
+			if (pass)
+				freerdp_bitmap_compress_planar(whole, data, PIXEL_FORMAT_XRGB32,
+						width, height, scanline, buffer, &dstSize);
+			else
+				reference_compress(flags, data, PIXEL_FORMAT_XRGB32, width, height, scanline, buffer);
+		}
+
+		elapsed[pass][1] = GetTickCount() - start;
+	}
+
+	printf("planar 1920x1080 x%d: 64x64 tiles %u ms (reference %u ms), whole bitmap %u ms (reference %u ms)\n",
+			iterations, elapsed[1][0], elapsed[0][0], elapsed[1][1], elapsed[0][1]);
+
+	free(data);
+	free(buffer);
+	freerdp_bitmap_planar_context_free(tiles);
+	freerdp_bitmap_planar_context_free(whole);
+
+	return 0;
+}
+
+int TestFreeRDPCodecPlanarEncode(int argc, char* argv[])
+{
+	if (test_bit_exact() < 0)
+		return -1;
+
+	if (test_throughput() < 0)
+		return -1;
+
+	return 0;
+}
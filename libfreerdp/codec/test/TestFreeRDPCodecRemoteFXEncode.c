@@ -0,0 +1,474 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <winpr/crt.h>
+#include <winpr/stream.h>
+#include <winpr/sysinfo.h>
+
+#include <freerdp/codec/rfx.h>
+
+#define IMAGE_WIDTH		256
+#define IMAGE_HEIGHT		256
+#define IMAGE_SCANLINE		(IMAGE_WIDTH * 4)
+
+#define TIMING_FRAMES		50
+#define RATE_FRAMES		12
+
+#define MINMAX(_v,_l,_h)	((_v) < (_l) ? (_l) : ((_v) > (_h) ? (_h) : (_v)))
+
+struct _TEST_RESULT
+{
+	UINT32 bytes;
+	double psnr;
+};
+typedef struct _TEST_RESULT TEST_RESULT;
+
+static UINT32 g_Seed = 1;
+
+static UINT32 test_rand(void)
+{
+	g_Seed = g_Seed * 1103515245 + 12345;
+	return (g_Seed >> 16) & 0x7FFF;
+}
+
+static void test_fill(BYTE* image, BYTE r, BYTE g, BYTE b)
+{
+	int x, y;
+	BYTE* p;
+
+	for (y = 0; y < IMAGE_HEIGHT; y++)
+	{
+		p = &image[y * IMAGE_SCANLINE];
+
+		for (x = 0; x < IMAGE_WIDTH; x++)
+		{
+			*p++ = b;
+			*p++ = g;
+			*p++ = r;
+			*p++ = 0xFF;
+		}
+	}
+}
+
+/* lines of 5x7 pseudo glyphs, dark on a light background, as in a terminal */
+static void test_draw_text(BYTE* image)
+{
+	int x, y;
+	int cx, cy;
+	UINT32 glyph;
+	BYTE* p;
+
+	g_Seed = 1;
+	test_fill(image, 0xF0, 0xF0, 0xF0);
+
+	for (cy = 4; cy + 7 <= IMAGE_HEIGHT; cy += 12)
+	{
+		for (cx = 2; cx + 5 <= IMAGE_WIDTH; cx += 7)
+		{
+			glyph = (test_rand() << 15) | test_rand();
+
+			for (y = 0; y < 7; y++)
+			{
+				for (x = 0; x < 5; x++)
+				{
+					if (!(glyph & (1 << ((y * 5 + x) % 30))))
+						continue;
+
+					p = &image[(cy + y) * IMAGE_SCANLINE + (cx + x) * 4];
+					p[0] = 0x20;
+					p[1] = 0x20;
+					p[2] = 0x20;
+				}
+			}
+		}
+	}
+}
+
+/* a dithered two dimensional color gradient, as in a desktop background */
+static void test_draw_gradient(BYTE* image)
+{
+	int x, y;
+	int dither;
+	BYTE* p;
+
+	g_Seed = 2;
+
+	for (y = 0; y < IMAGE_HEIGHT; y++)
+	{
+		p = &image[y * IMAGE_SCANLINE];
+
+		for (x = 0; x < IMAGE_WIDTH; x++)
+		{
+			dither = (int) (test_rand() % 7) - 3;
+
+			*p++ = (BYTE) MINMAX(((x + y) / 2) + dither, 0, 255);
+			*p++ = (BYTE) MINMAX((y / 2) + 64 + dither, 0, 255);
+			*p++ = (BYTE) MINMAX((x / 2) + 96 + dither, 0, 255);
+			*p++ = 0xFF;
+		}
+	}
+}
+
+static RFX_CONTEXT* test_encoder_new(BOOL adaptive)
+{
+	RFX_CONTEXT* context;
+
+	context = rfx_context_new(TRUE);
+
+	if (!context)
+		return NULL;
+
+	context->mode = RLGR3;
+	context->width = IMAGE_WIDTH;
+	context->height = IMAGE_HEIGHT;
+	rfx_context_set_pixel_format(context, RDP_PIXEL_FORMAT_B8G8R8A8);
+	rfx_context_set_adaptive_quantization(context, adaptive);
+
+	return context;
+}
+
+static double test_psnr(const BYTE* image, const BYTE* decoded)
+{
+	int x, y, c;
+	int diff;
+	UINT64 error = 0;
+	const BYTE* p;
+	const BYTE* q;
+
+	for (y = 0; y < IMAGE_HEIGHT; y++)
+	{
+		p = &image[y * IMAGE_SCANLINE];
+		q = &decoded[y * IMAGE_SCANLINE];
+
+		for (x = 0; x < IMAGE_WIDTH; x++)
+		{
+			for (c = 0; c < 3; c++)
+			{
+				diff = p[c] - q[c];
+				error += diff * diff;
+			}
+
+			p += 4;
+			q += 4;
+		}
+	}
+
+	if (!error)
+		return 99.0;
+
+	return 10.0 * log10((255.0 * 255.0 * IMAGE_WIDTH * IMAGE_HEIGHT * 3) / (double) error);
+}
+
+/**
+ * Encodes a frame and, with a decoder, decodes it back to measure its
+ * quality. The size is the one of the tile data, without the headers.
+ */
+
+static int test_encode_frame(RFX_CONTEXT* encoder, RFX_CONTEXT* decoder, BYTE* image,
+	BYTE* decoded, TEST_RESULT* result)
+{
+	int i, y;
+	wStream* s;
+	RFX_TILE* tile;
+	RFX_MESSAGE* message;
+	RFX_RECT rect = { 0, 0, IMAGE_WIDTH, IMAGE_HEIGHT };
+
+	message = rfx_encode_message(encoder, &rect, 1, image, IMAGE_WIDTH, IMAGE_HEIGHT, IMAGE_SCANLINE);
+
+	if (!message)
+		return -1;
+
+	result->bytes = message->tilesDataSize;
+
+	if (!decoder)
+	{
+		rfx_message_free(encoder, message);
+		return 1;
+	}
+
+	s = Stream_New(NULL, 1024 * 1024);
+
+	if (!s)
+		return -1;
+
+	rfx_write_message(encoder, s, message);
+	rfx_message_free(encoder, message);
+
+	message = rfx_process_message(decoder, Stream_Buffer(s), Stream_GetPosition(s));
+	Stream_Free(s, TRUE);
+
+	if (!message || (message->numTiles != (IMAGE_WIDTH / 64) * (IMAGE_HEIGHT / 64)))
+	{
+		printf("failed to decode the frame\n");
+		rfx_message_free(decoder, message);
+		return -1;
+	}
+
+	for (i = 0; i < message->numTiles; i++)
+	{
+		tile = message->tiles[i];
+
+		for (y = 0; y < 64; y++)
+			CopyMemory(&decoded[(tile->y + y) * IMAGE_SCANLINE + tile->x * 4], &tile->data[y * 64 * 4], 64 * 4);
+	}
+
+	rfx_message_free(decoder, message);
+
+	result->psnr = test_psnr(image, decoded);
+
+	return 1;
+}
+
+static int test_encode_image(BYTE* image, BOOL adaptive, TEST_RESULT* result)
+{
+	int status = -1;
+	BYTE* decoded;
+	RFX_CONTEXT* encoder;
+	RFX_CONTEXT* decoder;
+
+	decoded = (BYTE*) calloc(1, IMAGE_SCANLINE * IMAGE_HEIGHT);
+	encoder = test_encoder_new(adaptive);
+	decoder = rfx_context_new(FALSE);
+
+	if (decoded && encoder && decoder)
+		status = test_encode_frame(encoder, decoder, image, decoded, result);
+
+	if (decoder)
+		rfx_context_free(decoder);
+
+	if (encoder)
+		rfx_context_free(encoder);
+
+	free(decoded);
+	return status;
+}
+
+/**
+ * Adaptive quantization against the default quantization values: text
+ * must come out sharper, the gradient smaller for about the same quality.
+ */
+
+static int test_quality(BYTE* text, BYTE* gradient)
+{
+	TEST_RESULT fixedText, adaptiveText;
+	TEST_RESULT fixedGradient, adaptiveGradient;
+
+	if ((test_encode_image(text, FALSE, &fixedText) < 0) ||
+			(test_encode_image(text, TRUE, &adaptiveText) < 0) ||
+			(test_encode_image(gradient, FALSE, &fixedGradient) < 0) ||
+			(test_encode_image(gradient, TRUE, &adaptiveGradient) < 0))
+		return -1;
+
+	printf("text: fixed %u bytes %.2f dB, adaptive %u bytes %.2f dB\n",
+			fixedText.bytes, fixedText.psnr, adaptiveText.bytes, adaptiveText.psnr);
+	printf("gradient: fixed %u bytes %.2f dB, adaptive %u bytes %.2f dB\n",
+			fixedGradient.bytes, fixedGradient.psnr, adaptiveGradient.bytes, adaptiveGradient.psnr);
+
+	if (adaptiveText.psnr < fixedText.psnr + 1.0)
+	{
+		printf("adaptive quantization does not improve text\n");
+		return -1;
+	}
+
+	if ((adaptiveGradient.bytes > fixedGradient.bytes - fixedGradient.bytes / 10) ||
+			(adaptiveGradient.psnr < fixedGradient.psnr - 0.5))
+	{
+		printf("adaptive quantization wastes bits on the gradient\n");
+		return -1;
+	}
+
+	return 1;
+}
+
+/**
+ * The rate controller must bring the frames near the target, and coarsen
+ * the quantization no more than needed for a generous target.
+ */
+
+static int test_rate_control(BYTE* text)
+{
+	int i;
+	int status = -1;
+	UINT32 target;
+	UINT32 total = 0;
+	TEST_RESULT result;
+	RFX_CONTEXT* encoder;
+
+	if (test_encode_image(text, TRUE, &result) < 0)
+		return -1;
+
+	target = (result.bytes * 2) / 3;
+	encoder = test_encoder_new(TRUE);
+
+	if (!encoder)
+		return -1;
+
+	rfx_context_set_target_frame_size(encoder, target);
+
+	for (i = 0; i < RATE_FRAMES; i++)
+	{
+		if (test_encode_frame(encoder, NULL, text, NULL, &result) < 0)
+			goto out;
+
+		if (i >= RATE_FRAMES - 4)
+			total += result.bytes;
+	}
+
+	printf("rate control: target %u bytes, %u bytes per frame at scale %d\n",
+			target, total / 4, rfx_context_get_quant_scale(encoder));
+
+	if ((total / 4 > target + target / 3) || (total / 4 < target - target / 3))
+	{
+		printf("the frames are not near the target\n");
+		goto out;
+	}
+
+	rfx_context_set_target_frame_size(encoder, result.bytes * 4);
+
+	for (i = 0; i < RATE_FRAMES; i++)
+	{
+		if (test_encode_frame(encoder, NULL, text, NULL, &result) < 0)
+			goto out;
+	}
+
+	if (rfx_context_get_quant_scale(encoder) != 0)
+	{
+		printf("the quantization scale stays at %d under a generous target\n",
+				rfx_context_get_quant_scale(encoder));
+		goto out;
+	}
+
+	rfx_context_set_quant_scale(encoder, 3);
+
+	if (rfx_context_get_quant_scale(encoder) != 3)
+	{
+		printf("the rate controller overrides the quantization scale\n");
+		goto out;
+	}
+
+	status = 1;
+
+out:
+	rfx_context_free(encoder);
+	return status;
+}
+
+/**
+ * Switching the adaptive quantization off and on again must bring back the
+ * same frames as an encoder created in either mode.
+ */
+
+static int test_switch_quantization(BYTE* text)
+{
+	int status = -1;
+	TEST_RESULT fixed, adaptive;
+	TEST_RESULT result;
+	RFX_CONTEXT* encoder;
+
+	if ((test_encode_image(text, FALSE, &fixed) < 0) || (test_encode_image(text, TRUE, &adaptive) < 0))
+		return -1;
+
+	encoder = test_encoder_new(TRUE);
+
+	if (!encoder)
+		return -1;
+
+	if (test_encode_frame(encoder, NULL, text, NULL, &result) < 0)
+		goto out;
+
+	rfx_context_set_adaptive_quantization(encoder, FALSE);
+
+	if ((test_encode_frame(encoder, NULL, text, NULL, &result) < 0) ||
+			(encoder->numQuant != 1) || (result.bytes != fixed.bytes))
+	{
+		printf("the fixed quantization is not restored: %u bytes, expected %u\n", result.bytes, fixed.bytes);
+		goto out;
+	}
+
+	rfx_context_set_adaptive_quantization(encoder, TRUE);
+
+	if ((test_encode_frame(encoder, NULL, text, NULL, &result) < 0) || (result.bytes != adaptive.bytes))
+	{
+		printf("the adaptive quantization is not restored: %u bytes, expected %u\n", result.bytes, adaptive.bytes);
+		goto out;
+	}
+
+	status = 1;
+
+out:
+	rfx_context_free(encoder);
+	return status;
+}
+
+static int test_encode_time(BYTE* text, BYTE* gradient)
+{
+	int i;
+	int pass;
+	DWORD start;
+	DWORD elapsed[2];
+	TEST_RESULT result;
+	RFX_CONTEXT* encoder;
+
+	for (pass = 0; pass < 2; pass++)
+	{
+		encoder = test_encoder_new(pass ? TRUE : FALSE);
+
+		if (!encoder)
+			return -1;
+
+		start = GetTickCount();
+
+		for (i = 0; i < TIMING_FRAMES; i++)
+		{
+			if (test_encode_frame(encoder, NULL, (i & 1) ? gradient : text, NULL, &result) < 0)
+			{
+				rfx_context_free(encoder);
+				return -1;
+			}
+		}
+
+		elapsed[pass] = GetTickCount() - start;
+		rfx_context_free(encoder);
+	}
+
+	printf("%dx%d x%d: fixed quantization %u ms, adaptive quantization %u ms\n",
+			IMAGE_WIDTH, IMAGE_HEIGHT, TIMING_FRAMES, elapsed[0], elapsed[1]);
+
+	return 1;
+}
+
+int TestFreeRDPCodecRemoteFXEncode(int argc, char* argv[])
+{
+	int status = -1;
+	BYTE* text;
+	BYTE* gradient;
+
+	text = (BYTE*) malloc(IMAGE_SCANLINE * IMAGE_HEIGHT);
+	gradient = (BYTE*) malloc(IMAGE_SCANLINE * IMAGE_HEIGHT);
+
+	if (!text || !gradient)
+		goto out;
+
+	test_draw_text(text);
+	test_draw_gradient(gradient);
+
+	if (test_quality(text, gradient) < 0)
+		goto out;
+
+	if (test_rate_control(text) < 0)
+		goto out;
+
+	if (test_switch_quantization(text) < 0)
+		goto out;
+
+	if (test_encode_time(text, gradient) < 0)
+		goto out;
+
+	status = 0;
+
+out:
+	free(text);
+	free(gradient);
+	return status;
+}
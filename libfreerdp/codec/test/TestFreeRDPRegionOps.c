@@ -0,0 +1,481 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <winpr/crt.h>
+#include <winpr/sysinfo.h>
+
+#include <freerdp/codec/region.h>
+
+#define MASK_SIZE	64
+#define FUZZ_ROUNDS	2000
+
+#define BENCH_RECTS	10000
+
+typedef BYTE MASK[MASK_SIZE][MASK_SIZE];
+
+static void random_rect(RECTANGLE_16* rect, int size, int maxExtent)
+{
+	int w = 1 + (rand() % maxExtent);
+	int h = 1 + (rand() % maxExtent);
+
+	rect->left = rand() % size;
+	rect->top = rand() % size;
+	rect->right = MIN(rect->left + w, size);
+	rect->bottom = MIN(rect->top + h, size);
+}
+
+static void mask_fill(MASK mask, const RECTANGLE_16* rect)
+{
+	int x, y;
+
+	for (y = rect->top; y < rect->bottom; y++)
+	{
+		for (x = rect->left; x < rect->right; x++)
+			mask[y][x] = 1;
+	}
+}
+
+static void mask_from_region(MASK mask, const REGION16* region)
+{
+	int i, nbRects;
+	const RECTANGLE_16* rects;
+
+	ZeroMemory(mask, sizeof(MASK));
+	rects = region16_rects(region, &nbRects);
+
+	for (i = 0; i < nbRects; i++)
+		mask_fill(mask, &rects[i]);
+}
+
+/**
+ * Checks the canonical y-x-banded form: bands sorted and not overlapping,
+ * rectangles of a band sorted and not touching, touching bands not mergeable,
+ * and exact extents.
+ */
+
+static BOOL region_is_canonical(const REGION16* region)
+{
+	int i, j, nbRects;
+	int bandStart = 0;
+	int prevBand = -1;
+	int prevCount = 0;
+	RECTANGLE_16 extents;
+	const RECTANGLE_16* rects;
+
+	rects = region16_rects(region, &nbRects);
+
+	if (!nbRects)
+	{
+		extents = *region16_extents(region);
+		return (extents.left | extents.top | extents.right | extents.bottom) ? FALSE : TRUE;
+	}
+
+	extents = rects[0];
+
+	for (i = 0; i <= nbRects; i++)
+	{
+		if (i < nbRects)
+		{
+			if ((rects[i].left >= rects[i].right) || (rects[i].top >= rects[i].bottom))
+				return FALSE;
+
+			extents.left = MIN(extents.left, rects[i].left);
+			extents.right = MAX(extents.right, rects[i].right);
+			extents.bottom = MAX(extents.bottom, rects[i].bottom);
+
+			if (i > bandStart)
+			{
+				if ((rects[i].top != rects[bandStart].top) && (rects[i].top < rects[bandStart].bottom))
+					return FALSE;
+
+				if (rects[i].top == rects[bandStart].top)
+				{
+					if (rects[i].bottom != rects[bandStart].bottom)
+						return FALSE;
+
+					if (rects[i].left <= rects[i - 1].right)
+						return FALSE;
+
+					continue;
+				}
+			}
+			else
+			{
+				continue;
+			}
+		}
+
+		/* band [bandStart, i) is complete */
+		if ((prevBand >= 0) && (prevCount == i - bandStart) &&
+				(rects[prevBand].bottom == rects[bandStart].top))
+		{
+			for (j = 0; j < prevCount; j++)
+			{
+				if ((rects[prevBand + j].left != rects[bandStart + j].left) ||
+						(rects[prevBand + j].right != rects[bandStart + j].right))
+					break;
+			}
+
+			if (j == prevCount)
+				return FALSE;
+		}
+
+		prevBand = bandStart;
+		prevCount = i - bandStart;
+		bandStart = i;
+	}
+
+	return rectangles_equal(&extents, region16_extents(region));
+}
+
+static BOOL random_region(REGION16* region, MASK mask, int count)
+{
+	int i;
+	RECTANGLE_16 rect;
+
+	ZeroMemory(mask, sizeof(MASK));
+	region16_clear(region);
+
+	for (i = 0; i < count; i++)
+	{
+		random_rect(&rect, MASK_SIZE, MASK_SIZE / 2);
+		mask_fill(mask, &rect);
+
+		if (!region16_union_rect(region, region, &rect))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static int check_result(const char* name, int round, const REGION16* result, MASK expected)
+{
+	MASK actual;
+
+	if (!region_is_canonical(result))
+	{
+		fprintf(stderr, "%s: round %d produced a non canonical region\n", name, round);
+		region16_print(result);
+		return -1;
+	}
+
+	mask_from_region(actual, result);
+
+	if (memcmp(actual, expected, sizeof(MASK)) != 0)
+	{
+		fprintf(stderr, "%s: round %d does not match the pixel model\n", name, round);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int test_fuzz_ops(void)
+{
+	int round;
+	int x, y, i;
+	int count;
+	int retCode = -1;
+	MASK maskA, maskB, expected;
+	RECTANGLE_16 rect;
+	RECTANGLE_16 rects[32];
+	REGION16 a, b, result;
+
+	region16_init(&a);
+	region16_init(&b);
+	region16_init(&result);
+
+	for (round = 0; round < FUZZ_ROUNDS; round++)
+	{
+		if (!random_region(&a, maskA, rand() % 12) || !random_region(&b, maskB, rand() % 12))
+			goto out;
+
+		if (!region16_union(&result, &a, &b))
+			goto out;
+
+		for (y = 0; y < MASK_SIZE; y++)
+			for (x = 0; x < MASK_SIZE; x++)
+				expected[y][x] = maskA[y][x] | maskB[y][x];
+
+		if (check_result("union", round, &result, expected) < 0)
+			goto out;
+
+		if (!region16_intersect(&result, &a, &b))
+			goto out;
+
+		for (y = 0; y < MASK_SIZE; y++)
+			for (x = 0; x < MASK_SIZE; x++)
+				expected[y][x] = maskA[y][x] & maskB[y][x];
+
+		if (check_result("intersect", round, &result, expected) < 0)
+			goto out;
+
+		if (!region16_subtract(&result, &a, &b))
+			goto out;
+
+		for (y = 0; y < MASK_SIZE; y++)
+			for (x = 0; x < MASK_SIZE; x++)
+				expected[y][x] = maskA[y][x] & !maskB[y][x];
+
+		if (check_result("subtract", round, &result, expected) < 0)
+			goto out;
+
+		if (!region16_xor(&result, &a, &b))
+			goto out;
+
+		for (y = 0; y < MASK_SIZE; y++)
+			for (x = 0; x < MASK_SIZE; x++)
+				expected[y][x] = maskA[y][x] ^ maskB[y][x];
+
+		if (check_result("xor", round, &result, expected) < 0)
+			goto out;
+
+		/* in place, with dst aliasing the first source */
+		random_rect(&rect, MASK_SIZE, MASK_SIZE / 2);
+
+		if (!region16_copy(&result, &a) || !region16_subtract_rect(&result, &result, &rect))
+			goto out;
+
+		CopyMemory(expected, maskA, sizeof(MASK));
+
+		for (y = rect.top; y < rect.bottom; y++)
+			for (x = rect.left; x < rect.right; x++)
+				expected[y][x] = 0;
+
+		if (check_result("subtract_rect", round, &result, expected) < 0)
+			goto out;
+
+		count = rand() % 32;
+		CopyMemory(expected, maskB, sizeof(MASK));
+
+		for (i = 0; i < count; i++)
+		{
+			random_rect(&rects[i], MASK_SIZE, (i & 1) ? 4 : MASK_SIZE);
+			mask_fill(expected, &rects[i]);
+		}
+
+		if (!region16_union_rects(&b, &b, rects, count))
+			goto out;
+
+		if (check_result("union_rects", round, &b, expected) < 0)
+			goto out;
+	}
+
+	retCode = 0;
+out:
+	region16_uninit(&a);
+	region16_uninit(&b);
+	region16_uninit(&result);
+	return retCode;
+}
+
+static int test_fuzz_tile_bitmap(void)
+{
+	int round;
+	int x, y;
+	int tilesX, tilesY;
+	int retCode = -1;
+	BYTE bitmap[16 * 2];
+	MASK expected;
+	RECTANGLE_16 tile;
+	REGION16 region;
+
+	region16_init(&region);
+
+	for (round = 0; round < FUZZ_ROUNDS; round++)
+	{
+		tilesX = 1 + (rand() % 16);
+		tilesY = 1 + (rand() % 16);
+		ZeroMemory(expected, sizeof(MASK));
+
+		for (y = 0; y < 16; y++)
+		{
+			/* rows often repeat so that bands get coalesced */
+			if (!y || (rand() % 3))
+			{
+				bitmap[y * 2] = (round & 1) ? 0xFF : rand();
+				bitmap[y * 2 + 1] = rand();
+			}
+			else
+			{
+				bitmap[y * 2] = bitmap[y * 2 - 2];
+				bitmap[y * 2 + 1] = bitmap[y * 2 - 1];
+			}
+		}
+
+		for (y = 0; y < tilesY; y++)
+		{
+			for (x = 0; x < tilesX; x++)
+			{
+				if (bitmap[y * 2 + (x >> 3)] & (1 << (x & 7)))
+				{
+					tile.left = x * 4;
+					tile.top = y * 4;
+					tile.right = tile.left + 4;
+					tile.bottom = tile.top + 4;
+					mask_fill(expected, &tile);
+				}
+			}
+		}
+
+		if (!region16_from_tile_bitmap(&region, bitmap, 2, tilesX, tilesY, 4, 4))
+			goto out;
+
+		if (check_result("from_tile_bitmap", round, &region, expected) < 0)
+			goto out;
+	}
+
+	retCode = 0;
+out:
+	region16_uninit(&region);
+	return retCode;
+}
+
+static BOOL regions_equal(const REGION16* r1, const REGION16* r2)
+{
+	int nb1, nb2;
+	const RECTANGLE_16* rects1 = region16_rects(r1, &nb1);
+	const RECTANGLE_16* rects2 = region16_rects(r2, &nb2);
+
+	if (nb1 != nb2)
+		return FALSE;
+
+	return (memcmp(rects1, rects2, nb1 * sizeof(RECTANGLE_16)) == 0) ? TRUE : FALSE;
+}
+
+/**
+ * Damage of 10k small rectangles, and of a 100x100 grid of 16x16 tiles:
+ * the batched constructions must give the same region as the incremental
+ * one, and not take longer.
+ */
+
+static int test_bench(void)
+{
+	int i, x, y;
+	int retCode = -1;
+	UINT32 start;
+	UINT32 incremental, batched, tiles, ops;
+	BYTE* bitmap = NULL;
+	RECTANGLE_16* rects;
+	REGION16 reference, region, other;
+
+	region16_init(&reference);
+	region16_init(&region);
+	region16_init(&other);
+
+	rects = (RECTANGLE_16*) calloc(BENCH_RECTS, sizeof(RECTANGLE_16));
+	bitmap = (BYTE*) calloc(100, 13);
+
+	if (!rects || !bitmap)
+		goto out;
+
+	for (i = 0; i < BENCH_RECTS; i++)
+	{
+		random_rect(&rects[i], 1920, 48);
+		rects[i].bottom = MIN(rects[i].bottom, 1080);
+	}
+
+	start = GetTickCount();
+
+	for (i = 0; i < BENCH_RECTS; i++)
+	{
+		if (!region16_union_rect(&reference, &reference, &rects[i]))
+			goto out;
+	}
+
+	incremental = GetTickCount() - start;
+	start = GetTickCount();
+
+	if (!region16_union_rects(&region, &region, rects, BENCH_RECTS))
+		goto out;
+
+	batched = GetTickCount() - start;
+
+	if (!regions_equal(&reference, &region))
+	{
+		fprintf(stderr, "union_rects differs from repeated union_rect\n");
+		goto out;
+	}
+
+	/* the same checkerboard-ish damage as tiles */
+	for (i = 0; i < BENCH_RECTS; i++)
+	{
+		x = i % 100;
+		y = i / 100;
+
+		rects[i].left = x * 16;
+		rects[i].top = y * 16;
+		rects[i].right = rects[i].left + 16;
+		rects[i].bottom = rects[i].top + 16;
+
+		if ((rand() % 3) || ((x / 10 + y / 10) & 1))
+			bitmap[y * 13 + (x >> 3)] |= (1 << (x & 7));
+		else
+			rects[i].right = rects[i].left;
+	}
+
+	start = GetTickCount();
+
+	if (!region16_from_tile_bitmap(&region, bitmap, 13, 100, 100, 16, 16))
+		goto out;
+
+	tiles = GetTickCount() - start;
+
+	if (!region16_union_rects(&other, &other, rects, BENCH_RECTS))
+		goto out;
+
+	if (!regions_equal(&other, &region))
+	{
+		fprintf(stderr, "from_tile_bitmap differs from union_rects\n");
+		goto out;
+	}
+
+	start = GetTickCount();
+
+	for (i = 0; i < 100; i++)
+	{
+		if (!region16_xor(&other, &reference, &region) ||
+				!region16_subtract(&other, &other, &region) ||
+				!region16_union(&other, &other, &region))
+			goto out;
+	}
+
+	ops = GetTickCount() - start;
+
+	fprintf(stderr, "%d rects: union_rect %u ms, union_rects %u ms; %d tiles: %u ms; "
+			"100 xor+subtract+union of %d and %d rects: %u ms\n",
+			BENCH_RECTS, incremental, batched, BENCH_RECTS, tiles,
+			region16_n_rects(&reference), region16_n_rects(&region), ops);
+
+	if (batched > incremental + 10)
+	{
+		fprintf(stderr, "batched union slower than the incremental one\n");
+		goto out;
+	}
+
+	retCode = 0;
+out:
+	free(rects);
+	free(bitmap);
+	region16_uninit(&reference);
+	region16_uninit(&region);
+	region16_uninit(&other);
+	return retCode;
+}
+
+int TestFreeRDPRegionOps(int argc, char* argv[])
+{
+	srand(1234);
+
+	if (test_fuzz_ops() < 0)
+		return -1;
+
+	if (test_fuzz_tile_bitmap() < 0)
+		return -1;
+
+	if (test_bench() < 0)
+		return -1;
+
+	return 0;
+}
@@ -877,6 +877,9 @@ BOOL freerdp_get_param_bool(rdpSettings* settings, int id)
 		case FreeRDP_PlayRemoteFx:
 			return settings->PlayRemoteFx;
 
+		case FreeRDP_SessionRecording:
+			return settings->SessionRecording;
+
 		case FreeRDP_GatewayUseSameCredentials:
 			return settings->GatewayUseSameCredentials;
 
@@ -967,6 +970,9 @@ BOOL freerdp_get_param_bool(rdpSettings* settings, int id)
 		case FreeRDP_FrameMarkerCommandEnabled:
 			return settings->FrameMarkerCommandEnabled;
 
+		case FreeRDP_SurfaceFrameMarkerEnabled:
+			return settings->SurfaceFrameMarkerEnabled;
+
 		case FreeRDP_RemoteFxOnly:
 			return settings->RemoteFxOnly;
 
@@ -1334,6 +1340,10 @@ int freerdp_set_param_bool(rdpSettings* settings, int id, BOOL param)
 			settings->PlayRemoteFx = param;
 			break;
 
+		case FreeRDP_SessionRecording:
+			settings->SessionRecording = param;
+			break;
+
 		case FreeRDP_GatewayUseSameCredentials:
 			settings->GatewayUseSameCredentials = param;
 			break;
@@ -1454,6 +1464,10 @@ int freerdp_set_param_bool(rdpSettings* settings, int id, BOOL param)
 			settings->FrameMarkerCommandEnabled = param;
 			break;
 
+		case FreeRDP_SurfaceFrameMarkerEnabled:
+			settings->SurfaceFrameMarkerEnabled = param;
+			break;
+
 		case FreeRDP_RemoteFxOnly:
 			settings->RemoteFxOnly = param;
 			break;
@@ -1629,6 +1643,15 @@ UINT32 freerdp_get_param_uint32(rdpSettings* settings, int id)
 		case FreeRDP_EarlyCapabilityFlags:
 			return settings->EarlyCapabilityFlags;
 
+		case FreeRDP_HeartbeatPeriod:
+			return settings->HeartbeatPeriod;
+
+		case FreeRDP_HeartbeatWarningCount:
+			return settings->HeartbeatWarningCount;
+
+		case FreeRDP_HeartbeatReconnectCount:
+			return settings->HeartbeatReconnectCount;
+
 		case FreeRDP_EncryptionMethods:
 			return settings->EncryptionMethods;
 
@@ -1795,6 +1818,9 @@ UINT32 freerdp_get_param_uint32(rdpSettings* settings, int id)
 		case FreeRDP_RemoteFxCodecMode:
 			return settings->RemoteFxCodecMode;
 
+		case FreeRDP_RemoteFxImageCodecId:
+			return settings->RemoteFxImageCodecId;
+
 		case FreeRDP_NSCodecId:
 			return settings->NSCodecId;
 
@@ -1893,6 +1919,18 @@ int freerdp_set_param_uint32(rdpSettings* settings, int id, UINT32 param)
 			settings->EarlyCapabilityFlags = param;
 			break;
 
+		case FreeRDP_HeartbeatPeriod:
+			settings->HeartbeatPeriod = param;
+			break;
+
+		case FreeRDP_HeartbeatWarningCount:
+			settings->HeartbeatWarningCount = param;
+			break;
+
+		case FreeRDP_HeartbeatReconnectCount:
+			settings->HeartbeatReconnectCount = param;
+			break;
+
 		case FreeRDP_EncryptionMethods:
 			settings->EncryptionMethods = param;
 			break;
@@ -2113,6 +2151,10 @@ int freerdp_set_param_uint32(rdpSettings* settings, int id, UINT32 param)
 			settings->RemoteFxCodecMode = param;
 			break;
 
+		case FreeRDP_RemoteFxImageCodecId:
+			settings->RemoteFxImageCodecId = param;
+			break;
+
 		case FreeRDP_NSCodecId:
 			settings->NSCodecId = param;
 			break;
@@ -2315,6 +2357,9 @@ char* freerdp_get_param_string(rdpSettings* settings, int id)
 		case FreeRDP_PlayRemoteFxFile:
 			return settings->PlayRemoteFxFile;
 
+		case FreeRDP_SessionRecordingFile:
+			return settings->SessionRecordingFile;
+
 		case FreeRDP_GatewayHostname:
 			return settings->GatewayHostname;
 
@@ -2345,6 +2390,9 @@ char* freerdp_get_param_string(rdpSettings* settings, int id)
 		case FreeRDP_RemoteApplicationCmdLine:
 			return settings->RemoteApplicationCmdLine;
 
+		case FreeRDP_BitmapCachePersistFile:
+			return settings->BitmapCachePersistFile;
+
 		case FreeRDP_ImeFileName:
 			return settings->ImeFileName;
 
@@ -2526,6 +2574,11 @@ int freerdp_set_param_string(rdpSettings* settings, int id, const char* param)
 			settings->PlayRemoteFxFile = _strdup(param);
 			break;
 
+		case FreeRDP_SessionRecordingFile:
+			free(settings->SessionRecordingFile);
+			settings->SessionRecordingFile = _strdup(param);
+			break;
+
 		case FreeRDP_GatewayHostname:
 			free(settings->GatewayHostname);
 			settings->GatewayHostname = _strdup(param);
@@ -2576,6 +2629,11 @@ int freerdp_set_param_string(rdpSettings* settings, int id, const char* param)
 			settings->RemoteApplicationCmdLine = _strdup(param);
 			break;
 
+		case FreeRDP_BitmapCachePersistFile:
+			free(settings->BitmapCachePersistFile);
+			settings->BitmapCachePersistFile = _strdup(param);
+			break;
+
 		case FreeRDP_ImeFileName:
 			free(settings->ImeFileName);
 			settings->ImeFileName = _strdup(param);
@@ -23,6 +23,13 @@
 
 #include "activation.h"
 
+#include <winpr/crt.h>
+
+#include <freerdp/log.h>
+#include <freerdp/cache/persistent.h>
+
+#define TAG FREERDP_TAG("core.activation")
+
 /*
 static const char* const CTRLACTION_STRINGS[] =
 {
@@ -178,33 +185,117 @@ void rdp_write_persistent_list_entry(wStream* s, UINT32 key1, UINT32 key2)
 	Stream_Write_UINT32(s, key2); /* key2 (4 bytes) */
 }
 
-void rdp_write_client_persistent_key_list_pdu(wStream* s, rdpSettings* settings)
+void rdp_write_client_persistent_key_list_pdu(wStream* s, UINT16* numEntries, UINT16* totalEntries, BYTE bitMask)
 {
-	Stream_Write_UINT16(s, 0); /* numEntriesCache0 (2 bytes) */
-	Stream_Write_UINT16(s, 0); /* numEntriesCache1 (2 bytes) */
-	Stream_Write_UINT16(s, 0); /* numEntriesCache2 (2 bytes) */
-	Stream_Write_UINT16(s, 0); /* numEntriesCache3 (2 bytes) */
-	Stream_Write_UINT16(s, 0); /* numEntriesCache4 (2 bytes) */
-	Stream_Write_UINT16(s, 0); /* totalEntriesCache0 (2 bytes) */
-	Stream_Write_UINT16(s, 0); /* totalEntriesCache1 (2 bytes) */
-	Stream_Write_UINT16(s, 0); /* totalEntriesCache2 (2 bytes) */
-	Stream_Write_UINT16(s, 0); /* totalEntriesCache3 (2 bytes) */
-	Stream_Write_UINT16(s, 0); /* totalEntriesCache4 (2 bytes) */
-	Stream_Write_UINT8(s, PERSIST_FIRST_PDU | PERSIST_LAST_PDU); /* bBitMask (1 byte) */
+	Stream_Write_UINT16(s, numEntries[0]); /* numEntriesCache0 (2 bytes) */
+	Stream_Write_UINT16(s, numEntries[1]); /* numEntriesCache1 (2 bytes) */
+	Stream_Write_UINT16(s, numEntries[2]); /* numEntriesCache2 (2 bytes) */
+	Stream_Write_UINT16(s, numEntries[3]); /* numEntriesCache3 (2 bytes) */
+	Stream_Write_UINT16(s, numEntries[4]); /* numEntriesCache4 (2 bytes) */
+	Stream_Write_UINT16(s, totalEntries[0]); /* totalEntriesCache0 (2 bytes) */
+	Stream_Write_UINT16(s, totalEntries[1]); /* totalEntriesCache1 (2 bytes) */
+	Stream_Write_UINT16(s, totalEntries[2]); /* totalEntriesCache2 (2 bytes) */
+	Stream_Write_UINT16(s, totalEntries[3]); /* totalEntriesCache3 (2 bytes) */
+	Stream_Write_UINT16(s, totalEntries[4]); /* totalEntriesCache4 (2 bytes) */
+	Stream_Write_UINT8(s, bitMask); /* bBitMask (1 byte) */
 	Stream_Write_UINT8(s, 0); /* pad1 (1 byte) */
 	Stream_Write_UINT16(s, 0); /* pad3 (2 bytes) */
-
-	/* entries */
 }
 
+/**
+ * The keys of the persistent bitmap cache are announced in cell order,
+ * PERSIST_LIST_MAX_ENTRIES at a time. The server assigns cache indices in
+ * the order in which the keys are received.
+ */
+
 BOOL rdp_send_client_persistent_key_list_pdu(rdpRdp* rdp)
 {
+	int i, j;
 	wStream* s;
+	BYTE bitMask;
+	UINT64 key64;
+	UINT32 count;
+	UINT32 sent = 0;
+	UINT32 total = 0;
+	UINT32 cell = 0;
+	UINT32 index = 0;
+	UINT16 numEntries[5];
+	UINT16 totalEntries[5];
+	rdpPersistentCache* persistent = NULL;
+	rdpSettings* settings = rdp->settings;
+
+	ZeroMemory(totalEntries, sizeof(totalEntries));
+
+	if (persistent_cache_enabled(settings))
+	{
+		persistent = persistent_cache_new(settings);
 
-	s = rdp_data_pdu_init(rdp);
-	rdp_write_client_persistent_key_list_pdu(s, rdp->settings);
+		if (persistent && (persistent_cache_open(persistent, NULL, FALSE) < 1))
+			persistent_cache_close(persistent);
+	}
+
+	if (persistent)
+	{
+		for (i = 0; (i < 5) && (i < (int) settings->BitmapCacheV2NumCells); i++)
+		{
+			totalEntries[i] = (UINT16) MIN(persistent_cache_get_count(persistent, i), 0xFFFF);
+			total += totalEntries[i];
+		}
+	}
+
+	if (total > PERSIST_LIST_MAX_TOTAL)
+	{
+		WLog_WARN(TAG, "persistent key list too large, not announcing any keys");
+		ZeroMemory(totalEntries, sizeof(totalEntries));
+		total = 0;
+	}
+
+	do
+	{
+		ZeroMemory(numEntries, sizeof(numEntries));
+		count = 0;
 
-	return rdp_send_data_pdu(rdp, s, DATA_PDU_TYPE_BITMAP_CACHE_PERSISTENT_LIST, rdp->mcs->userId);
+		for (i = cell, j = index; (i < 5) && (count < PERSIST_LIST_MAX_ENTRIES); i++, j = 0)
+		{
+			numEntries[i] = (UINT16) MIN((UINT32) (totalEntries[i] - j), PERSIST_LIST_MAX_ENTRIES - count);
+			count += numEntries[i];
+		}
+
+		bitMask = (sent == 0) ? PERSIST_FIRST_PDU : 0;
+
+		if (sent + count >= total)
+			bitMask |= PERSIST_LAST_PDU;
+
+		s = rdp_data_pdu_init(rdp);
+		rdp_write_client_persistent_key_list_pdu(s, numEntries, totalEntries, bitMask);
+
+		for (i = 0; i < (int) count; i++)
+		{
+			while (index >= totalEntries[cell])
+			{
+				cell++;
+				index = 0;
+			}
+
+			if (!persistent_cache_get_key(persistent, cell, index++, &key64))
+				key64 = 0;
+
+			rdp_write_persistent_list_entry(s, (UINT32) (key64 & 0xFFFFFFFF), (UINT32) (key64 >> 32));
+		}
+
+		sent += count;
+
+		if (!rdp_send_data_pdu(rdp, s, DATA_PDU_TYPE_BITMAP_CACHE_PERSISTENT_LIST, rdp->mcs->userId))
+		{
+			persistent_cache_free(persistent);
+			return FALSE;
+		}
+	}
+	while (sent < total);
+
+	persistent_cache_free(persistent);
+
+	return TRUE;
 }
 
 BOOL rdp_recv_client_font_list_pdu(wStream* s)
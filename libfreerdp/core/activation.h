@@ -34,6 +34,9 @@
 #define PERSIST_FIRST_PDU		0x01
 #define PERSIST_LAST_PDU		0x02
 
+#define PERSIST_LIST_MAX_ENTRIES	169
+#define PERSIST_LIST_MAX_TOTAL		262144
+
 #define FONTLIST_FIRST			0x0001
 #define FONTLIST_LAST			0x0002
 
@@ -21,6 +21,8 @@
 #include "config.h"
 #endif
 
+#include <freerdp/utils/profiler.h>
+
 #include "bulk.h"
 
 #define TAG "com.freerdp.core"
@@ -120,6 +122,8 @@ int bulk_decompress(rdpBulk* bulk, BYTE* pSrcData, UINT32 SrcSize, BYTE** ppDstD
 
 	if (flags & BULK_COMPRESSION_FLAGS_MASK)
 	{
+		PROFILER_BEGIN("bulk_decompress");
+
 		switch (type)
 		{
 			case PACKET_COMPR_TYPE_8K:
@@ -144,6 +148,8 @@ int bulk_decompress(rdpBulk* bulk, BYTE* pSrcData, UINT32 SrcSize, BYTE** ppDstD
 				status = -1;
 				break;
 		}
+
+		PROFILER_END("bulk_decompress");
 	}
 	else
 	{
@@ -2567,6 +2567,7 @@ BOOL rdp_read_bitmap_codecs_capability_set(wStream* s, UINT16 length, rdpSetting
 	BYTE bitmapCodecCount;
 	UINT16 codecPropertiesLength;
 	UINT16 remainingLength;
+	BOOL guidJpeg = FALSE;
 	BOOL guidNSCodec = FALSE;
 	BOOL guidRemoteFx = FALSE;
 	BOOL guidRemoteFxImage = FALSE;
@@ -2695,8 +2696,26 @@ BOOL rdp_read_bitmap_codecs_capability_set(wStream* s, UINT16 length, rdpSetting
 				/* Microsoft RDP servers ignore CODEC_GUID_IMAGE_REMOTEFX codec properties */
 
 				guidRemoteFxImage = TRUE;
+				settings->RemoteFxImageCodecId = codecId;
 				Stream_Seek(s, codecPropertiesLength); /* codecProperties */
 			}
+			else if (UuidEqual(&codecGuid, &CODEC_GUID_JPEG, &rpc_status))
+			{
+				BYTE quality;
+
+				guidJpeg = TRUE;
+				settings->JpegCodecId = codecId;
+
+				if (codecPropertiesLength >= 1)
+				{
+					Stream_Read_UINT8(s, quality); /* quality (1 byte) */
+
+					if ((quality >= 1) && (quality <= 100))
+						settings->JpegQuality = quality;
+
+					Stream_Seek(s, codecPropertiesLength - 1);
+				}
+			}
 			else if (UuidEqual(&codecGuid, &CODEC_GUID_NSCODEC, &rpc_status))
 			{
 				BYTE colorLossLevel;
@@ -2753,7 +2772,7 @@ BOOL rdp_read_bitmap_codecs_capability_set(wStream* s, UINT16 length, rdpSetting
 		settings->RemoteFxCodec = settings->RemoteFxCodec && guidRemoteFx;
 		settings->RemoteFxImageCodec = settings->RemoteFxImageCodec && guidRemoteFxImage;
 		settings->NSCodec = settings->NSCodec && guidNSCodec;
-		settings->JpegCodec = FALSE;
+		settings->JpegCodec = settings->JpegCodec && guidJpeg;
 	}
 
 	return TRUE;
@@ -3743,6 +3762,7 @@ BOOL rdp_recv_confirm_active(rdpRdp* rdp, wStream* s)
 		/* client does not support bitmap codecs */
 
 		settings->RemoteFxCodec = FALSE;
+		settings->RemoteFxImageCodec = FALSE;
 		settings->NSCodec = FALSE;
 		settings->JpegCodec = FALSE;
 	}
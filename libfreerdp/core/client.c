@@ -85,7 +85,7 @@ rdpChannels* freerdp_channels_new(void)
 	if (!channels)
 		return NULL;
 
-	channels->queue = MessageQueue_New(NULL);
+	channels->queue = MessageQueue_NewEx(NULL, WMQ_FLAG_MPSC, 0);
 
 	if (!g_OpenHandles)
 	{
@@ -281,6 +281,17 @@ BOOL rdp_client_connect(rdpRdp* rdp)
 			settings->AutoLogonEnabled = TRUE;
 	}
 
+	if (settings->SessionRecording && !rdp->transport->recorder)
+	{
+		rdp->transport->recorder = recorder_new(settings->SessionRecordingFile);
+
+		if (!rdp->transport->recorder)
+			return FALSE;
+	}
+
+	if (rdp->transport->recorder && !recorder_start(rdp->transport->recorder, settings))
+		return FALSE;
+
 	rdp_set_blocking_mode(rdp, FALSE);
 
 	rdp_client_transition_to_state(rdp, CONNECTION_STATE_NEGO);
@@ -1270,6 +1281,9 @@ int rdp_server_transition_to_state(rdpRdp* rdp, int state)
 
 					if (!client->activated)
 						return -1;
+
+					if (!heartbeat_start(rdp))
+						return -1;
 				}
 			}
 
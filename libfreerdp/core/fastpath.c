@@ -32,6 +32,7 @@
 #include <freerdp/api.h>
 #include <freerdp/log.h>
 #include <freerdp/crypto/per.h>
+#include <freerdp/utils/profiler.h>
 
 #include "orders.h"
 #include "update.h"
@@ -259,17 +260,20 @@ static int fastpath_recv_update(rdpFastPath* fastpath, BYTE updateCode, UINT32 s
 		updateCode < ARRAYSIZE(FASTPATH_UPDATETYPE_STRINGS) ? FASTPATH_UPDATETYPE_STRINGS[updateCode] : "???", updateCode, size);
 #endif
 
+	/* lets the update proxy reference the payloads instead of copying them */
+	update->recvStream = s;
+
 	switch (updateCode)
 	{
 		case FASTPATH_UPDATETYPE_ORDERS:
 			if (!fastpath_recv_orders(fastpath, s))
-				return -1;
+				status = -1;
 			break;
 
 		case FASTPATH_UPDATETYPE_BITMAP:
 		case FASTPATH_UPDATETYPE_PALETTE:
 			if (!fastpath_recv_update_common(fastpath, s))
-				return -1;
+				status = -1;
 			break;
 
 		case FASTPATH_UPDATETYPE_SYNCHRONIZE:
@@ -296,25 +300,37 @@ static int fastpath_recv_update(rdpFastPath* fastpath, BYTE updateCode, UINT32 s
 
 		case FASTPATH_UPDATETYPE_PTR_POSITION:
 			if (!update_read_pointer_position(s, &pointer->pointer_position))
-				return -1;
+			{
+				status = -1;
+				break;
+			}
 			IFCALL(pointer->PointerPosition, context, &pointer->pointer_position);
 			break;
 
 		case FASTPATH_UPDATETYPE_COLOR:
 			if (!update_read_pointer_color(s, &pointer->pointer_color, 24))
-				return -1;
+			{
+				status = -1;
+				break;
+			}
 			IFCALL(pointer->PointerColor, context, &pointer->pointer_color);
 			break;
 
 		case FASTPATH_UPDATETYPE_CACHED:
 			if (!update_read_pointer_cached(s, &pointer->pointer_cached))
-				return -1;
+			{
+				status = -1;
+				break;
+			}
 			IFCALL(pointer->PointerCached, context, &pointer->pointer_cached);
 			break;
 
 		case FASTPATH_UPDATETYPE_POINTER:
 			if (!update_read_pointer_new(s, &pointer->pointer_new))
-				return -1;
+			{
+				status = -1;
+				break;
+			}
 			IFCALL(pointer->PointerNew, context, &pointer->pointer_new);
 			break;
 
@@ -323,6 +339,8 @@ static int fastpath_recv_update(rdpFastPath* fastpath, BYTE updateCode, UINT32 s
 			break;
 	}
 
+	update->recvStream = NULL;
+
 	return status;
 }
 
@@ -518,7 +536,9 @@ int fastpath_recv_updates(rdpFastPath* fastpath, wStream* s)
 			return -1;
 	}
 
+	PROFILER_BEGIN("update_present");
 	IFCALL(update->EndPaint, update->context);
+	PROFILER_END("update_present");
 
 	return status;
 }
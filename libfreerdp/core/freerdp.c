@@ -43,6 +43,7 @@
 #include <freerdp/channels/channels.h>
 #include <freerdp/version.h>
 #include <freerdp/log.h>
+#include <freerdp/utils/profiler.h>
 
 #define TAG FREERDP_TAG("core")
 
@@ -201,11 +202,29 @@ BOOL freerdp_connect(freerdp* instance)
 
 BOOL freerdp_get_fds(freerdp* instance, void** rfds, int* rcount, void** wfds, int* wcount)
 {
+
+	void* pfd;
 	rdpRdp* rdp;
 
 	rdp = instance->context->rdp;
 	transport_get_fds(rdp->transport, rfds, rcount);
 
+	pfd = GetEventWaitObject(multitransport_get_event_handle(rdp->multitransport));
+
+	if (pfd)
+	{
+		rfds[*rcount] = pfd;
+		(*rcount)++;
+	}
+
+	pfd = GetEventWaitObject(heartbeat_get_event_handle(rdp->heartbeat));
+
+	if (pfd)
+	{
+		rfds[*rcount] = pfd;
+		(*rcount)++;
+	}
+
 	return TRUE;
 }
 
@@ -227,6 +246,12 @@ BOOL freerdp_check_fds(freerdp* instance)
 
 	status = rdp_check_fds(rdp);
 
+	if (status >= 0)
+		status = multitransport_check_fds(rdp->multitransport);
+
+	if (status >= 0)
+		status = heartbeat_check(rdp);
+
 	if (status < 0)
 	{
 		TerminateEventArgs e;
@@ -248,6 +273,14 @@ DWORD freerdp_get_event_handles(rdpContext* context, HANDLE* events)
 
 	nCount += transport_get_event_handles(context->rdp->transport, events);
 
+	if (events)
+		events[nCount] = multitransport_get_event_handle(context->rdp->multitransport);
+	nCount++;
+
+	if (events)
+		events[nCount] = heartbeat_get_event_handle(context->rdp->heartbeat);
+	nCount++;
+
 	if (events)
 		events[nCount] = freerdp_channels_get_event_handle(context->instance);
 	nCount++;
@@ -454,6 +487,8 @@ int freerdp_context_new(freerdp* instance)
 	context->pubSub = PubSub_New(TRUE);
 	PubSub_AddEventTypes(context->pubSub, FreeRDP_Events, sizeof(FreeRDP_Events) / sizeof(wEventType));
 
+	profiler_init();
+
 	context->metrics = metrics_new(context);
 	context->codecs = codecs_new(context);
 
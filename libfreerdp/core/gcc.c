@@ -519,8 +519,9 @@ void gcc_write_server_data_blocks(wStream* s, rdpMcs* mcs)
 	gcc_write_server_security_data(s, mcs); /* serverSecurityData */
 	gcc_write_server_message_channel_data(s, mcs); /* serverMessageChannelData */
 
-	/* TODO: Send these GCC data blocks only when the client sent them */
-	//gcc_write_server_multitransport_channel_data(s, settings); /* serverMultitransportChannelData */
+	/* Only sent when the client sent a multitransport block we can honour */
+	if (mcs->settings->SupportMultitransport && mcs->settings->MultitransportFlags)
+		gcc_write_server_multitransport_channel_data(s, mcs); /* serverMultitransportChannelData */
 }
 
 BOOL gcc_read_user_data_header(wStream* s, UINT16* type, UINT16* length)
@@ -1755,12 +1756,22 @@ void gcc_write_server_message_channel_data(wStream* s, rdpMcs* mcs)
 BOOL gcc_read_client_multitransport_channel_data(wStream* s, rdpMcs* mcs, UINT16 blockLength)
 {
 	UINT32 flags;
+	rdpSettings* settings = mcs->settings;
 
 	if (blockLength < 4)
 		return FALSE;
 
 	Stream_Read_UINT32(s, flags);
 
+	/* keep the transports both sides support, all of the client's if the server did not restrict them */
+
+	if (!settings->SupportMultitransport)
+		settings->MultitransportFlags = 0;
+	else if (settings->MultitransportFlags)
+		settings->MultitransportFlags &= flags;
+	else
+		settings->MultitransportFlags = flags;
+
 	return TRUE;
 }
 
@@ -1797,7 +1808,7 @@ BOOL gcc_read_server_multitransport_channel_data(wStream* s, rdpMcs* mcs)
 
 void gcc_write_server_multitransport_channel_data(wStream* s, rdpMcs* mcs)
 {
-	UINT32 flags = 0;
+	UINT32 flags = mcs->settings->MultitransportFlags;
 
 	gcc_write_user_data_header(s, SC_MULTITRANSPORT, 8);
 
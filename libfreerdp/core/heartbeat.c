@@ -21,16 +21,98 @@
 #include "config.h"
 #endif
 
+#include <winpr/crt.h>
+#include <winpr/sysinfo.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#endif
+
+#ifdef HAVE_TIMERFD_H
+#include <sys/timerfd.h>
+#endif
+
 #define WITH_DEBUG_HEARTBEAT
 
 #include "heartbeat.h"
 
+/**
+ * The heartbeat timer is a timerfd wrapped in an event, so that it can be
+ * waited on with the other handles of a connection as well as selected.
+ * Without timerfd, a timer queue timer signals a plain event instead.
+ */
+
+static VOID CALLBACK heartbeat_timer_callback(PVOID lpParameter, BOOLEAN TimerOrWaitFired)
+{
+	rdpHeartbeat* heartbeat = (rdpHeartbeat*) lpParameter;
+
+	SetEvent(heartbeat->event);
+}
+
+static BOOL heartbeat_set_timer(rdpHeartbeat* heartbeat, UINT32 interval)
+{
+#ifdef HAVE_TIMERFD_H
+	struct itimerspec spec;
+
+	if (heartbeat->timerfd >= 0)
+	{
+		ZeroMemory(&spec, sizeof(spec));
+		spec.it_value.tv_sec = interval / 1000;
+		spec.it_value.tv_nsec = (interval % 1000) * 1000000;
+		spec.it_interval = spec.it_value;
+
+		return (timerfd_settime(heartbeat->timerfd, 0, &spec, NULL) == 0) ? TRUE : FALSE;
+	}
+#endif
+
+	if (heartbeat->timer)
+	{
+		DeleteTimerQueueTimer(heartbeat->timerQueue, heartbeat->timer, NULL);
+		heartbeat->timer = NULL;
+	}
+
+	if (!interval)
+		return TRUE;
+
+	if (!heartbeat->timerQueue)
+		heartbeat->timerQueue = CreateTimerQueue();
+
+	if (!heartbeat->timerQueue)
+		return FALSE;
+
+	return CreateTimerQueueTimer(&heartbeat->timer, heartbeat->timerQueue,
+			heartbeat_timer_callback, heartbeat, interval, interval, 0);
+}
+
+static void heartbeat_clear_timer(rdpHeartbeat* heartbeat)
+{
+#ifdef HAVE_TIMERFD_H
+	UINT64 expirations;
+
+	if (heartbeat->timerfd >= 0)
+	{
+		/* nothing to read when the timer was rearmed in between */
+		if (read(heartbeat->timerfd, &expirations, sizeof(expirations)) < 0)
+			WLog_DBG(HEARTBEAT_TAG, "no heartbeat timer expiration to read");
+
+		return;
+	}
+#endif
+
+	ResetEvent(heartbeat->event);
+}
+
 int rdp_recv_heartbeat_packet(rdpRdp* rdp, wStream* s)
 {
 	BYTE reserved;
 	BYTE period;
 	BYTE count1;
 	BYTE count2;
+	BOOL status = TRUE;
+	rdpHeartbeat* heartbeat = rdp->heartbeat;
 
 	if (Stream_GetRemainingLength(s) < 4)
 		return -1;
@@ -42,16 +124,253 @@ int rdp_recv_heartbeat_packet(rdpRdp* rdp, wStream* s)
 
 	WLog_DBG(HEARTBEAT_TAG, "received Heartbeat PDU -> period=%u, count1=%u, count2=%u", period, count1, count2);
 
+	/* the watchdog wakes up every half period, a heartbeat is missed half a period after it was due */
+	if (period != heartbeat->period)
+		heartbeat_set_timer(heartbeat, period ? (period * 1000) / 2 : 0);
+
+	if (heartbeat->missed && heartbeat->count1 && (heartbeat->missed >= heartbeat->count1))
+	{
+		WLog_INFO(HEARTBEAT_TAG, "heartbeats received again after %u missed", heartbeat->missed);
+
+		if (rdp->instance)
+			IFCALLRET(rdp->instance->HeartbeatMissed, status, rdp->instance, 0, FALSE);
+	}
+
+	heartbeat->period = period;
+	heartbeat->count1 = count1;
+	heartbeat->count2 = count2;
+	heartbeat->lastReceived = GetTickCount();
+	heartbeat->missed = 0;
+
+	return 0;
+}
+
+BOOL rdp_send_heartbeat_packet(rdpRdp* rdp, BYTE period, BYTE count1, BYTE count2)
+{
+	wStream* s;
+
+	if (!rdp->mcs->messageChannelId)
+		return FALSE;
+
+	s = rdp_message_channel_pdu_init(rdp);
+
+	if (!s)
+		return FALSE;
+
+	WLog_DBG(HEARTBEAT_TAG, "sending Heartbeat PDU -> period=%u, count1=%u, count2=%u", period, count1, count2);
+
+	Stream_Write_UINT8(s, 0); /* reserved (1 byte) */
+	Stream_Write_UINT8(s, period); /* period (1 byte) */
+	Stream_Write_UINT8(s, count1); /* count1 (1 byte) */
+	Stream_Write_UINT8(s, count2); /* count2 (1 byte) */
+
+	return rdp_send_message_channel_pdu(rdp, s, SEC_HEARTBEAT);
+}
+
+BOOL freerdp_heartbeat_send_heartbeat_pdu(freerdp_peer* peer, BYTE period, BYTE count1, BYTE count2)
+{
+	if (!peer || !peer->context)
+		return FALSE;
+
+	return rdp_send_heartbeat_packet(peer->context->rdp, period, count1, count2);
+}
+
+/**
+ * Starts the heartbeats of an activated server connection, every
+ * HeartbeatPeriod seconds. Half-open connections are caught by the TCP
+ * user timeout, since a heartbeat left unacknowledged for
+ * HeartbeatReconnectCount periods fails the socket. Clients which do
+ * network auto-detection are also probed with an RTT request whenever
+ * they were silent for a period, which catches a stalled peer.
+ */
+
+BOOL heartbeat_start(rdpRdp* rdp)
+{
+	rdpSettings* settings = rdp->settings;
+	rdpHeartbeat* heartbeat = rdp->heartbeat;
+#ifdef TCP_USER_TIMEOUT
+	unsigned int timeout;
+#endif
+
+	if (!settings->HeartbeatPeriod || heartbeat->started)
+		return TRUE;
+
+	if (!heartbeat_set_timer(heartbeat, settings->HeartbeatPeriod * 1000))
+	{
+		WLog_WARN(HEARTBEAT_TAG, "unable to create the heartbeat timer, heartbeats are disabled");
+		return TRUE;
+	}
+
+	heartbeat->started = TRUE;
+	heartbeat->activity = TRUE;
+	heartbeat->probesMissed = 0;
+
+#ifdef TCP_USER_TIMEOUT
+	if (rdp->transport && rdp->transport->TcpIn && (rdp->transport->TcpIn->sockfd >= 0))
+	{
+		timeout = settings->HeartbeatPeriod * MAX(settings->HeartbeatReconnectCount, 1) * 1000;
+
+		if (setsockopt(rdp->transport->TcpIn->sockfd, IPPROTO_TCP, TCP_USER_TIMEOUT,
+				(void*) &timeout, sizeof(timeout)) < 0)
+			WLog_WARN(HEARTBEAT_TAG, "unable to set the TCP user timeout");
+	}
+#endif
+
+	if (settings->SupportHeartbeatPdu)
+	{
+		return rdp_send_heartbeat_packet(rdp, (BYTE) MIN(settings->HeartbeatPeriod, 0xFF),
+				(BYTE) MIN(settings->HeartbeatWarningCount, 0xFF),
+				(BYTE) MIN(settings->HeartbeatReconnectCount, 0xFF));
+	}
+
+	return TRUE;
+}
+
+/**
+ * Called by the server for everything it receives from the client.
+ */
+
+void heartbeat_activity(rdpHeartbeat* heartbeat)
+{
+	heartbeat->activity = TRUE;
+}
+
+HANDLE heartbeat_get_event_handle(rdpHeartbeat* heartbeat)
+{
+	return heartbeat->event;
+}
+
+static int heartbeat_check_server(rdpRdp* rdp)
+{
+	rdpSettings* settings = rdp->settings;
+	rdpHeartbeat* heartbeat = rdp->heartbeat;
+	rdpAutoDetect* autodetect = rdp->autodetect;
+
+	if (!heartbeat->started)
+		return 0;
+
+	if (settings->SupportHeartbeatPdu)
+	{
+		if (!rdp_send_heartbeat_packet(rdp, (BYTE) MIN(settings->HeartbeatPeriod, 0xFF),
+				(BYTE) MIN(settings->HeartbeatWarningCount, 0xFF),
+				(BYTE) MIN(settings->HeartbeatReconnectCount, 0xFF)))
+			return -1;
+	}
+
+	if (!settings->NetworkAutoDetect || !autodetect || !autodetect->RTTMeasureRequest ||
+			!rdp->mcs->messageChannelId)
+		return 0;
+
+	if (heartbeat->activity)
+	{
+		heartbeat->activity = FALSE;
+		heartbeat->probesMissed = 0;
+		return 0;
+	}
+
+	if (settings->HeartbeatReconnectCount && (heartbeat->probesMissed >= settings->HeartbeatReconnectCount))
+	{
+		WLog_WARN(HEARTBEAT_TAG, "peer did not answer %u heartbeat probes, closing the connection",
+				heartbeat->probesMissed);
+		return -1;
+	}
+
+	heartbeat->probesMissed++;
+	heartbeat->probeSequence = (heartbeat->probeSequence + 1) & (HEARTBEAT_PROBE_SEQUENCE - 1);
+
+	if (!autodetect->RTTMeasureRequest(rdp->context, HEARTBEAT_PROBE_SEQUENCE | heartbeat->probeSequence))
+		return -1;
+
 	return 0;
 }
 
+/**
+ * Client watchdog: reports the heartbeats missed from count1 on and, from
+ * count2 on, fails the connection so that the client reconnects, if auto
+ * reconnection is enabled and the HeartbeatMissed callback does not veto it.
+ */
+
+static int heartbeat_check_client(rdpRdp* rdp)
+{
+	UINT32 missed;
+	UINT32 elapsed;
+	UINT32 interval;
+	BOOL reconnect;
+	BOOL status = TRUE;
+	rdpHeartbeat* heartbeat = rdp->heartbeat;
+
+	if (!heartbeat->period)
+		return 0;
+
+	interval = heartbeat->period * 1000;
+	elapsed = GetTickCount() - heartbeat->lastReceived;
+	missed = (elapsed > interval / 2) ? (elapsed - interval / 2) / interval : 0;
+
+	if (missed <= heartbeat->missed)
+		return 0;
+
+	heartbeat->missed = missed;
+
+	if (!heartbeat->count1 || (missed < heartbeat->count1))
+		return 0;
+
+	reconnect = (heartbeat->count2 && (missed >= heartbeat->count2)) ? TRUE : FALSE;
+
+	WLog_WARN(HEARTBEAT_TAG, "%u heartbeats missed", missed);
+
+	if (rdp->instance)
+		IFCALLRET(rdp->instance->HeartbeatMissed, status, rdp->instance, missed, reconnect);
+
+	if (!reconnect || !status || !rdp->settings->AutoReconnectionEnabled)
+		return 0;
+
+	/* the watchdog rests until the next heartbeat */
+	heartbeat->period = 0;
+	heartbeat_set_timer(heartbeat, 0);
+
+	WLog_ERR(HEARTBEAT_TAG, "server unresponsive, reconnecting");
+
+	return -1;
+}
+
+int heartbeat_check(rdpRdp* rdp)
+{
+	rdpHeartbeat* heartbeat = rdp->heartbeat;
+
+	if (WaitForSingleObject(heartbeat->event, 0) != WAIT_OBJECT_0)
+		return 0;
+
+	heartbeat_clear_timer(heartbeat);
+
+	if (rdp->settings->ServerMode)
+		return heartbeat_check_server(rdp);
+
+	return heartbeat_check_client(rdp);
+}
+
 rdpHeartbeat* heartbeat_new(void)
 {
 	rdpHeartbeat* heartbeat = (rdpHeartbeat*) calloc(1, sizeof(rdpHeartbeat));
 
 	if (heartbeat)
 	{
+		heartbeat->timerfd = -1;
 
+#ifdef HAVE_TIMERFD_H
+		heartbeat->timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+		if (heartbeat->timerfd >= 0)
+			heartbeat->event = CreateFileDescriptorEvent(NULL, TRUE, FALSE, heartbeat->timerfd);
+#endif
+
+		if (!heartbeat->event)
+			heartbeat->event = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+		if (!heartbeat->event)
+		{
+			heartbeat_free(heartbeat);
+			return NULL;
+		}
 	}
 	
 	return heartbeat;
@@ -59,5 +378,23 @@ rdpHeartbeat* heartbeat_new(void)
 
 void heartbeat_free(rdpHeartbeat* heartbeat)
 {
+	if (!heartbeat)
+		return;
+
+	if (heartbeat->timer)
+		DeleteTimerQueueTimer(heartbeat->timerQueue, heartbeat->timer, NULL);
+
+	/* waits for a callback still running */
+	if (heartbeat->timerQueue)
+		DeleteTimerQueueEx(heartbeat->timerQueue, INVALID_HANDLE_VALUE);
+
+	if (heartbeat->event)
+		CloseHandle(heartbeat->event);
+
+#ifdef HAVE_TIMERFD_H
+	if (heartbeat->timerfd >= 0)
+		close(heartbeat->timerfd);
+#endif
+
 	free(heartbeat);
 }
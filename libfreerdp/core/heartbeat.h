@@ -25,16 +25,44 @@ typedef struct rdp_heartbeat rdpHeartbeat;
 #include "rdp.h"
 
 #include <freerdp/freerdp.h>
+#include <freerdp/heartbeat.h>
 #include <freerdp/log.h>
 
+#include <winpr/synch.h>
 #include <winpr/stream.h>
 
+/* RTT probes of the server use the upper half of the sequence numbers */
+#define HEARTBEAT_PROBE_SEQUENCE		0x8000
+
 struct rdp_heartbeat
 {
-	UINT32 placeholder;
+	/* client: the schedule announced by the server */
+	BYTE period;
+	BYTE count1;
+	BYTE count2;
+	UINT32 lastReceived;
+	UINT32 missed;
+
+	/* server */
+	BOOL started;
+	BOOL activity;
+	UINT32 probesMissed;
+	UINT16 probeSequence;
+
+	int timerfd;
+	HANDLE timer;
+	HANDLE timerQueue;
+	HANDLE event;
 };
 
 int rdp_recv_heartbeat_packet(rdpRdp* rdp, wStream* s);
+BOOL rdp_send_heartbeat_packet(rdpRdp* rdp, BYTE period, BYTE count1, BYTE count2);
+
+BOOL heartbeat_start(rdpRdp* rdp);
+void heartbeat_activity(rdpHeartbeat* heartbeat);
+
+HANDLE heartbeat_get_event_handle(rdpHeartbeat* heartbeat);
+int heartbeat_check(rdpRdp* rdp);
 
 rdpHeartbeat* heartbeat_new(void);
 void heartbeat_free(rdpHeartbeat* heartbeat);
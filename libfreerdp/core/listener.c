@@ -178,7 +178,33 @@ static BOOL freerdp_listener_open(freerdp_listener* instance, const char* bind_a
 
 	freeaddrinfo(res);
 
-	return (listener->num_sockfds > 0 ? TRUE : FALSE);
+	if (listener->num_sockfds < 1)
+		return FALSE;
+
+	return TRUE;
+}
+
+/**
+ * Opens the UDP socket the tunnels requested with
+ * freerdp_peer_initiate_multitransport() connect to, usually on the TCP port.
+ */
+
+static BOOL freerdp_listener_open_multitransport(freerdp_listener* instance, const char* bind_address, UINT16 port)
+{
+	rdpListener* listener = (rdpListener*) instance->listener;
+
+	if (listener->udpListener)
+		return TRUE;
+
+	listener->udpListener = multitransport_listener_new(bind_address, port);
+
+	if (!listener->udpListener)
+	{
+		WLog_ERR(TAG, "failed to open the multitransport listener on port %d", port);
+		return FALSE;
+	}
+
+	return TRUE;
 }
 
 static BOOL freerdp_listener_open_local(freerdp_listener* instance, const char* path)
@@ -244,6 +270,9 @@ static void freerdp_listener_close(freerdp_listener* instance)
 	}
 
 	listener->num_sockfds = 0;
+
+	multitransport_listener_free(listener->udpListener);
+	listener->udpListener = NULL;
 }
 
 static BOOL freerdp_listener_get_fds(freerdp_listener* instance, void** rfds, int* rcount)
@@ -359,6 +388,7 @@ freerdp_listener* freerdp_listener_new(void)
 
 	instance->Open = freerdp_listener_open;
 	instance->OpenLocal = freerdp_listener_open_local;
+	instance->OpenMultitransport = freerdp_listener_open_multitransport;
 	instance->GetFileDescriptor = freerdp_listener_get_fds;
 	instance->GetEventHandles = freerdp_listener_get_event_handles;
 	instance->CheckFileDescriptor = freerdp_listener_check_fds;
@@ -384,6 +414,10 @@ void freerdp_listener_free(freerdp_listener* instance)
 	rdpListener* listener;
 
 	listener = (rdpListener*) instance->listener;
+
+	if (listener)
+		multitransport_listener_free(listener->udpListener);
+
 	free(listener);
 
 	free(instance);
@@ -23,6 +23,7 @@
 typedef struct rdp_listener rdpListener;
 
 #include "rdp.h"
+#include "multitransport.h"
 
 #include <winpr/crt.h>
 #include <winpr/synch.h>
@@ -38,6 +39,8 @@ struct rdp_listener
 	int num_sockfds;
  	int sockfds[MAX_LISTENER_HANDLES];
  	HANDLE events[MAX_LISTENER_HANDLES];
+
+	rdpUdpListener* udpListener;
 };
 
 #endif
@@ -25,7 +25,6 @@
 
 #include "rdp.h"
 #include "message.h"
-#include "transport.h"
 
 #include <freerdp/log.h>
 #include <freerdp/freerdp.h>
@@ -35,7 +34,80 @@
 #include <winpr/collections.h>
 
 #define TAG FREERDP_TAG("core.message")
-#define WITH_STREAM_POOL	1
+
+/**
+ * Update payloads are parsed in place and point into the stream the PDU
+ * was received in. Instead of copying a payload, the queued update takes
+ * a reference on that stream, released when the message is freed, and the
+ * update structure shares one allocation with that reference. Payloads
+ * that do not lie in a pooled received stream are copied at the end of
+ * the same allocation.
+ */
+
+struct _UPDATE_MESSAGE_REF
+{
+	wStream* s;
+	void* reserved; /* keeps the update that follows 16-byte aligned */
+};
+typedef struct _UPDATE_MESSAGE_REF UPDATE_MESSAGE_REF;
+
+static BOOL update_message_in_stream(wStream* s, const BYTE* data, size_t length)
+{
+	if (!s || !s->pool || !data)
+		return FALSE;
+
+	if ((data < Stream_Buffer(s)) || ((data + length) > (Stream_Buffer(s) + Stream_Capacity(s))))
+		return FALSE;
+
+	return TRUE;
+}
+
+static void* update_message_new(size_t size, size_t extra, wStream* s)
+{
+	UPDATE_MESSAGE_REF* ref;
+
+	ref = (UPDATE_MESSAGE_REF*) malloc(sizeof(UPDATE_MESSAGE_REF) + size + extra);
+
+	if (!ref)
+		return NULL;
+
+	ref->s = s;
+
+	if (s)
+		Stream_AddRef(s);
+
+	return (void*) &ref[1];
+}
+
+static void update_message_free(void* param)
+{
+	UPDATE_MESSAGE_REF* ref;
+
+	if (!param)
+		return;
+
+	ref = &((UPDATE_MESSAGE_REF*) param)[-1];
+
+	if (ref->s)
+		Stream_Release(ref->s);
+
+	free(ref);
+}
+
+/**
+ * Points *data at its payload, in the referenced stream when it lies there,
+ * or in a copy at *tail otherwise.
+ */
+
+static void update_message_payload(wStream* s, BYTE** data, size_t length, BYTE** tail)
+{
+	if (!*data || !length || update_message_in_stream(s, *data, length))
+		return;
+
+	CopyMemory(*tail, *data, length);
+	*data = *tail;
+	*tail += length;
+}
 
 /* Update */
 
@@ -79,26 +151,42 @@ static void update_message_DesktopResize(rdpContext* context)
 
 static void update_message_BitmapUpdate(rdpContext* context, BITMAP_UPDATE* bitmap)
 {
+	BYTE* tail;
 	UINT32 index;
+	size_t extra;
+	wStream* s = NULL;
+	BITMAP_DATA* rectangle;
 	BITMAP_UPDATE* wParam;
 
-	wParam = (BITMAP_UPDATE*) malloc(sizeof(BITMAP_UPDATE));
+	extra = sizeof(BITMAP_DATA) * bitmap->number;
+
+	for (index = 0; index < bitmap->number; index++)
+	{
+		rectangle = &bitmap->rectangles[index];
+
+		if (update_message_in_stream(context->update->recvStream, rectangle->bitmapDataStream, rectangle->bitmapLength))
+			s = context->update->recvStream;
+		else if (rectangle->bitmapDataStream)
+			extra += rectangle->bitmapLength;
+	}
 
-	wParam->number = bitmap->number;
+	wParam = (BITMAP_UPDATE*) update_message_new(sizeof(BITMAP_UPDATE), extra, s);
+
+	if (!wParam)
+		return;
+
+	CopyMemory(wParam, bitmap, sizeof(BITMAP_UPDATE));
 	wParam->count = wParam->number;
 
-	wParam->rectangles = (BITMAP_DATA*) malloc(sizeof(BITMAP_DATA) * wParam->number);
+	wParam->rectangles = (BITMAP_DATA*) &wParam[1];
 	CopyMemory(wParam->rectangles, bitmap->rectangles, sizeof(BITMAP_DATA) * wParam->number);
 
+	tail = (BYTE*) &wParam->rectangles[wParam->number];
+
 	for (index = 0; index < wParam->number; index++)
 	{
-#ifdef WITH_STREAM_POOL
-		StreamPool_AddRef(context->rdp->transport->ReceivePool, bitmap->rectangles[index].bitmapDataStream);
-#else
-		wParam->rectangles[index].bitmapDataStream = (BYTE*) malloc(wParam->rectangles[index].bitmapLength);
-		CopyMemory(wParam->rectangles[index].bitmapDataStream, bitmap->rectangles[index].bitmapDataStream,
-				wParam->rectangles[index].bitmapLength);
-#endif
+		rectangle = &wParam->rectangles[index];
+		update_message_payload(s, &rectangle->bitmapDataStream, rectangle->bitmapLength, &tail);
 	}
 
 	MessageQueue_Post(context->update->queue, (void*) context,
@@ -160,13 +248,30 @@ static void update_message_SuppressOutput(rdpContext* context, BYTE allow, RECTA
 
 static void update_message_SurfaceCommand(rdpContext* context, wStream* s)
 {
+	BYTE* tail;
+	size_t length;
 	wStream* wParam;
+	BYTE* data = Stream_Pointer(s);
+
+	length = Stream_GetRemainingLength(s);
+
+	if (update_message_in_stream(s, data, length))
+		wParam = (wStream*) update_message_new(sizeof(wStream), 0, s);
+	else
+		wParam = (wStream*) update_message_new(sizeof(wStream), length, NULL);
+
+	if (!wParam)
+		return;
 
-	wParam = (wStream*) malloc(sizeof(wStream));
+	tail = (BYTE*) &wParam[1];
+	update_message_payload(s, &data, length, &tail);
 
-	wParam->capacity = Stream_Capacity(s);
-	wParam->buffer = (BYTE*) malloc(wParam->capacity);
-	wParam->pointer = wParam->buffer;
+	wParam->buffer = data;
+	wParam->pointer = data;
+	wParam->capacity = length;
+	wParam->length = length;
+	wParam->count = 0;
+	wParam->pool = NULL;
 
 	MessageQueue_Post(context->update->queue, (void*) context,
 			MakeMessageId(Update, SurfaceCommand), (void*) wParam, NULL);
@@ -174,17 +279,23 @@ static void update_message_SurfaceCommand(rdpContext* context, wStream* s)
 
 static void update_message_SurfaceBits(rdpContext* context, SURFACE_BITS_COMMAND* surfaceBitsCommand)
 {
+	BYTE* tail;
 	SURFACE_BITS_COMMAND* wParam;
+	wStream* s = context->update->recvStream;
+
+	if (!update_message_in_stream(s, surfaceBitsCommand->bitmapData, surfaceBitsCommand->bitmapDataLength))
+		s = NULL;
+
+	wParam = (SURFACE_BITS_COMMAND*) update_message_new(sizeof(SURFACE_BITS_COMMAND),
+			s ? 0 : surfaceBitsCommand->bitmapDataLength, s);
+
+	if (!wParam)
+		return;
 
-	wParam = (SURFACE_BITS_COMMAND*) malloc(sizeof(SURFACE_BITS_COMMAND));
 	CopyMemory(wParam, surfaceBitsCommand, sizeof(SURFACE_BITS_COMMAND));
 
-#ifdef WITH_STREAM_POOL
-	StreamPool_AddRef(context->rdp->transport->ReceivePool, surfaceBitsCommand->bitmapData);
-#else
-	wParam->bitmapData = (BYTE*) malloc(wParam->bitmapDataLength);
-	CopyMemory(wParam->bitmapData, surfaceBitsCommand->bitmapData, wParam->bitmapDataLength);
-#endif
+	tail = (BYTE*) &wParam[1];
+	update_message_payload(s, &wParam->bitmapData, wParam->bitmapDataLength, &tail);
 
 	MessageQueue_Post(context->update->queue, (void*) context,
 			MakeMessageId(Update, SurfaceBits), (void*) wParam, NULL);
@@ -488,13 +599,23 @@ static void update_message_EllipseCB(rdpContext* context, ELLIPSE_CB_ORDER* elli
 
 static void update_message_CacheBitmap(rdpContext* context, CACHE_BITMAP_ORDER* cacheBitmapOrder)
 {
+	BYTE* tail;
 	CACHE_BITMAP_ORDER* wParam;
+	wStream* s = context->update->recvStream;
+
+	if (!update_message_in_stream(s, cacheBitmapOrder->bitmapDataStream, cacheBitmapOrder->bitmapLength))
+		s = NULL;
+
+	wParam = (CACHE_BITMAP_ORDER*) update_message_new(sizeof(CACHE_BITMAP_ORDER),
+			s ? 0 : cacheBitmapOrder->bitmapLength, s);
+
+	if (!wParam)
+		return;
 
-	wParam = (CACHE_BITMAP_ORDER*) malloc(sizeof(CACHE_BITMAP_ORDER));
 	CopyMemory(wParam, cacheBitmapOrder, sizeof(CACHE_BITMAP_ORDER));
 
-	wParam->bitmapDataStream = (BYTE*) malloc(wParam->bitmapLength);
-	CopyMemory(wParam->bitmapDataStream, cacheBitmapOrder, wParam->bitmapLength);
+	tail = (BYTE*) &wParam[1];
+	update_message_payload(s, &wParam->bitmapDataStream, wParam->bitmapLength, &tail);
 
 	MessageQueue_Post(context->update->queue, (void*) context,
 			MakeMessageId(SecondaryUpdate, CacheBitmap), (void*) wParam, NULL);
@@ -502,13 +623,23 @@ static void update_message_CacheBitmap(rdpContext* context, CACHE_BITMAP_ORDER*
 
 static void update_message_CacheBitmapV2(rdpContext* context, CACHE_BITMAP_V2_ORDER* cacheBitmapV2Order)
 {
+	BYTE* tail;
 	CACHE_BITMAP_V2_ORDER* wParam;
+	wStream* s = context->update->recvStream;
+
+	if (!update_message_in_stream(s, cacheBitmapV2Order->bitmapDataStream, cacheBitmapV2Order->bitmapLength))
+		s = NULL;
+
+	wParam = (CACHE_BITMAP_V2_ORDER*) update_message_new(sizeof(CACHE_BITMAP_V2_ORDER),
+			s ? 0 : cacheBitmapV2Order->bitmapLength, s);
+
+	if (!wParam)
+		return;
 
-	wParam = (CACHE_BITMAP_V2_ORDER*) malloc(sizeof(CACHE_BITMAP_V2_ORDER));
 	CopyMemory(wParam, cacheBitmapV2Order, sizeof(CACHE_BITMAP_V2_ORDER));
 
-	wParam->bitmapDataStream = (BYTE*) malloc(wParam->bitmapLength);
-	CopyMemory(wParam->bitmapDataStream, cacheBitmapV2Order->bitmapDataStream, wParam->bitmapLength);
+	tail = (BYTE*) &wParam[1];
+	update_message_payload(s, &wParam->bitmapDataStream, wParam->bitmapLength, &tail);
 
 	MessageQueue_Post(context->update->queue, (void*) context,
 			MakeMessageId(SecondaryUpdate, CacheBitmapV2), (void*) wParam, NULL);
@@ -516,13 +647,23 @@ static void update_message_CacheBitmapV2(rdpContext* context, CACHE_BITMAP_V2_OR
 
 static void update_message_CacheBitmapV3(rdpContext* context, CACHE_BITMAP_V3_ORDER* cacheBitmapV3Order)
 {
+	BYTE* tail;
 	CACHE_BITMAP_V3_ORDER* wParam;
+	wStream* s = context->update->recvStream;
+
+	if (!update_message_in_stream(s, cacheBitmapV3Order->bitmapData.data, cacheBitmapV3Order->bitmapData.length))
+		s = NULL;
+
+	wParam = (CACHE_BITMAP_V3_ORDER*) update_message_new(sizeof(CACHE_BITMAP_V3_ORDER),
+			s ? 0 : cacheBitmapV3Order->bitmapData.length, s);
+
+	if (!wParam)
+		return;
 
-	wParam = (CACHE_BITMAP_V3_ORDER*) malloc(sizeof(CACHE_BITMAP_V3_ORDER));
 	CopyMemory(wParam, cacheBitmapV3Order, sizeof(CACHE_BITMAP_V3_ORDER));
 
-	wParam->bitmapData.data = (BYTE*) malloc(wParam->bitmapData.length);
-	CopyMemory(wParam->bitmapData.data, cacheBitmapV3Order->bitmapData.data, wParam->bitmapData.length);
+	tail = (BYTE*) &wParam[1];
+	update_message_payload(s, &wParam->bitmapData.data, wParam->bitmapData.length, &tail);
 
 	MessageQueue_Post(context->update->queue, (void*) context,
 			MakeMessageId(SecondaryUpdate, CacheBitmapV3), (void*) wParam, NULL);
@@ -1005,23 +1146,7 @@ static int update_message_free_update_class(wMessage* msg, int type)
 			break;
 
 		case Update_BitmapUpdate:
-			{
-				UINT32 index;
-				BITMAP_UPDATE* wParam = (BITMAP_UPDATE*) msg->wParam;
-
-				for (index = 0; index < wParam->number; index++)
-				{
-#ifdef WITH_STREAM_POOL
-					rdpContext* context = (rdpContext*) msg->context;
-					StreamPool_Release(context->rdp->transport->ReceivePool, wParam->rectangles[index].bitmapDataStream);
-#else
-					free(wParam->rectangles[index].bitmapDataStream);
-#endif
-				}
-
-				free(wParam->rectangles);
-				free(wParam);
-			}
+			update_message_free(msg->wParam);
 			break;
 
 		case Update_Palette:
@@ -1042,24 +1167,8 @@ static int update_message_free_update_class(wMessage* msg, int type)
 			break;
 
 		case Update_SurfaceCommand:
-			{
-				wStream* s = (wStream*) msg->wParam;
-				Stream_Free(s, TRUE);
-			}
-			break;
-
 		case Update_SurfaceBits:
-			{
-#ifdef WITH_STREAM_POOL
-				rdpContext* context = (rdpContext*) msg->context;
-				SURFACE_BITS_COMMAND* wParam = (SURFACE_BITS_COMMAND*) msg->wParam;
-				StreamPool_Release(context->rdp->transport->ReceivePool, wParam->bitmapData);
-#else
-				SURFACE_BITS_COMMAND* wParam = (SURFACE_BITS_COMMAND*) msg->wParam;
-				free(wParam->bitmapData);
-				free(wParam);
-#endif
-			}
+			update_message_free(msg->wParam);
 			break;
 
 		case Update_SurfaceFrameMarker:
@@ -1387,30 +1496,9 @@ static int update_message_free_secondary_update_class(wMessage* msg, int type)
 	switch (type)
 	{
 		case SecondaryUpdate_CacheBitmap:
-			{
-				CACHE_BITMAP_ORDER* wParam = (CACHE_BITMAP_ORDER*) msg->wParam;
-
-				free(wParam->bitmapDataStream);
-				free(wParam);
-			}
-			break;
-
 		case SecondaryUpdate_CacheBitmapV2:
-			{
-				CACHE_BITMAP_V2_ORDER* wParam = (CACHE_BITMAP_V2_ORDER*) msg->wParam;
-
-				free(wParam->bitmapDataStream);
-				free(wParam);
-			}
-			break;
-
 		case SecondaryUpdate_CacheBitmapV3:
-			{
-				CACHE_BITMAP_V3_ORDER* wParam = (CACHE_BITMAP_V3_ORDER*) msg->wParam;
-
-				free(wParam->bitmapData.data);
-				free(wParam);
-			}
+			update_message_free(msg->wParam);
 			break;
 
 		case SecondaryUpdate_CacheColorTable:
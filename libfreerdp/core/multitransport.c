@@ -21,14 +21,152 @@
 #include "config.h"
 #endif
 
+#include <winpr/crt.h>
+#include <winpr/thread.h>
+
+#include <freerdp/log.h>
+#include <freerdp/svc.h>
+#include <freerdp/crypto/crypto.h>
+
 #include "multitransport.h"
 
+#define TAG FREERDP_TAG("core.multitransport")
+
+/**
+ * Dynamic virtual channels carried by the tunnels once they are up, by name.
+ * The channels keep the transport they started with: a channel opened before
+ * the tunnel stays on the main connection.
+ */
+
+struct _MULTITRANSPORT_ROUTE
+{
+	const char* name;
+	UINT16 protocol;
+};
+typedef struct _MULTITRANSPORT_ROUTE MULTITRANSPORT_ROUTE;
+
+static const MULTITRANSPORT_ROUTE g_MultitransportRoutes[] =
+{
+	{ "Microsoft::Windows::RDS::Graphics", TRANSPORT_TYPE_UDP_FECR },
+	{ "AUDIO_PLAYBACK_DVC", TRANSPORT_TYPE_UDP_FECR },
+	{ "AUDIO_PLAYBACK_LOSSY_DVC", TRANSPORT_TYPE_UDP_FECL }
+};
+
+/* the server sessions waiting for tunnels, and the tunnels not matched yet */
+static wArrayList* g_Multitransports = NULL;
+static wArrayList* g_Tunnels = NULL;
+
+struct _MULTITRANSPORT_CONNECT_PARAM
+{
+	rdpMultitransport* multitransport;
+	UINT32 requestId;
+	UINT16 requestedProtocol;
+	BYTE securityCookie[16];
+};
+typedef struct _MULTITRANSPORT_CONNECT_PARAM MULTITRANSPORT_CONNECT_PARAM;
+
+static int multitransport_get_index(UINT16 protocol)
+{
+	return (protocol == TRANSPORT_TYPE_UDP_FECL) ? MULTITRANSPORT_LOSSY : MULTITRANSPORT_RELIABLE;
+}
+
+/**
+ * Initiate Multitransport Response PDU
+ * msdn{dn393560}
+ */
+
+static BOOL rdp_send_multitransport_response(rdpRdp* rdp, UINT32 requestId, UINT32 hrResponse)
+{
+	wStream* s;
+
+	s = rdp_message_channel_pdu_init(rdp);
+
+	if (!s)
+		return FALSE;
+
+	Stream_Write_UINT32(s, requestId); /* requestId (4 bytes) */
+	Stream_Write_UINT32(s, hrResponse); /* hrResponse (4 bytes) */
+
+	return rdp_send_message_channel_pdu(rdp, s, SEC_TRANSPORT_RSP);
+}
+
+static void multitransport_tunnel_receive(rdpTunnel* tunnel, const BYTE* data, int length, void* param)
+{
+	wStream* s;
+	rdpMultitransport* multitransport = (rdpMultitransport*) param;
+
+	s = Stream_New(NULL, length);
+
+	if (!s)
+		return;
+
+	Stream_Write(s, data, length);
+	Stream_SealLength(s);
+
+	MessageQueue_Post(multitransport->queue, (void*) multitransport, MULTITRANSPORT_MESSAGE_DATA, (void*) s, NULL);
+}
+
+static void* multitransport_connect_thread(void* arg)
+{
+	int index;
+	BOOL connected;
+	rdpTls* tls;
+	rdpTunnel* tunnel;
+	MULTITRANSPORT_CONNECT_PARAM* param = (MULTITRANSPORT_CONNECT_PARAM*) arg;
+	rdpMultitransport* multitransport = param->multitransport;
+	rdpRdp* rdp = multitransport->rdp;
+	rdpSettings* settings = rdp->settings;
+
+	index = multitransport_get_index(param->requestedProtocol);
+	tls = rdp->transport->TlsIn;
+
+	tunnel = tunnel_new(FALSE, (index == MULTITRANSPORT_LOSSY) ? TRUE : FALSE,
+			multitransport_tunnel_receive, NULL, (void*) multitransport);
+
+	connected = tunnel && tunnel_connect(tunnel, settings->ServerHostname, (UINT16) settings->ServerPort,
+			param->requestId, param->securityCookie, tls ? tls->PublicKey : NULL,
+			tls ? tls->PublicKeyLength : 0, MULTITRANSPORT_CONNECT_TIMEOUT);
+
+	if (connected)
+	{
+		WLog_INFO(TAG, "%s tunnel %u connected", (index == MULTITRANSPORT_LOSSY) ? "lossy" : "reliable",
+				param->requestId);
+
+		EnterCriticalSection(&multitransport->lock);
+		multitransport->tunnels[index] = tunnel;
+		LeaveCriticalSection(&multitransport->lock);
+	}
+	else
+	{
+		WLog_WARN(TAG, "tunnel %u failed, staying on the main connection", param->requestId);
+		tunnel_free(tunnel);
+
+		/* the response is sent from the thread of the connection */
+		MessageQueue_Post(multitransport->queue, (void*) multitransport, MULTITRANSPORT_MESSAGE_FAILED,
+				NULL, (void*) (size_t) param->requestId);
+	}
+
+	free(param);
+
+	ExitThread(0);
+	return NULL;
+}
+
+/**
+ * Initiate Multitransport Request PDU
+ * msdn{dn393558}
+ */
+
 int rdp_recv_multitransport_packet(rdpRdp* rdp, wStream* s)
 {
+	int index;
 	UINT32 requestId;
 	UINT16 requestedProtocol;
 	UINT16 reserved;
 	BYTE securityCookie[16];
+	rdpSettings* settings = rdp->settings;
+	rdpMultitransport* multitransport = rdp->multitransport;
+	MULTITRANSPORT_CONNECT_PARAM* param;
 
 	if (Stream_GetRemainingLength(s) < 24)
 		return -1;
@@ -38,21 +176,468 @@ int rdp_recv_multitransport_packet(rdpRdp* rdp, wStream* s)
 	Stream_Read_UINT16(s, reserved); /* reserved (2 bytes) */
 	Stream_Read(s, securityCookie, 16); /* securityCookie (16 bytes) */
 
+	index = multitransport_get_index(requestedProtocol);
+
+	if (!settings->SupportMultitransport || !(settings->MultitransportFlags & requestedProtocol) ||
+			((requestedProtocol != TRANSPORT_TYPE_UDP_FECR) && (requestedProtocol != TRANSPORT_TYPE_UDP_FECL)) ||
+			multitransport->threads[index])
+	{
+		return rdp_send_multitransport_response(rdp, requestId, E_ABORT) ? 0 : -1;
+	}
+
+	param = (MULTITRANSPORT_CONNECT_PARAM*) calloc(1, sizeof(MULTITRANSPORT_CONNECT_PARAM));
+
+	if (!param)
+		return -1;
+
+	param->multitransport = multitransport;
+	param->requestId = requestId;
+	param->requestedProtocol = requestedProtocol;
+	CopyMemory(param->securityCookie, securityCookie, 16);
+
+	multitransport->threads[index] = CreateThread(NULL, 0,
+			(LPTHREAD_START_ROUTINE) multitransport_connect_thread, (void*) param, 0, NULL);
+
+	if (!multitransport->threads[index])
+	{
+		free(param);
+		return rdp_send_multitransport_response(rdp, requestId, E_ABORT) ? 0 : -1;
+	}
+
+	return 0;
+}
+
+int rdp_recv_multitransport_response(rdpRdp* rdp, wStream* s)
+{
+	int index;
+	UINT32 requestId;
+	UINT32 hrResponse;
+	rdpMultitransport* multitransport = rdp->multitransport;
+
+	if (Stream_GetRemainingLength(s) < 8)
+		return -1;
+
+	Stream_Read_UINT32(s, requestId); /* requestId (4 bytes) */
+	Stream_Read_UINT32(s, hrResponse); /* hrResponse (4 bytes) */
+
+	if (hrResponse == S_OK)
+		return 0;
+
+	WLog_DBG(TAG, "multitransport request %u refused: 0x%08X", requestId, hrResponse);
+
+	EnterCriticalSection(&multitransport->lock);
+
+	for (index = 0; index < 2; index++)
+	{
+		if (multitransport->pending[index] && (multitransport->requestIds[index] == requestId))
+			multitransport->pending[index] = FALSE;
+	}
+
+	LeaveCriticalSection(&multitransport->lock);
+
+	return 0;
+}
+
+/**
+ * Asks the client to connect a tunnel to the RDP-UDP listener of the server,
+ * which is open on the port of the RDP listener.
+ */
+
+BOOL rdp_send_multitransport_request(rdpRdp* rdp, UINT16 requestedProtocol)
+{
+	int index;
+	wStream* s;
+	UINT32 requestId;
+	BYTE securityCookie[16];
+	static LONG nextRequestId = 0;
+	rdpMultitransport* multitransport = rdp->multitransport;
+
+	if (!g_Multitransports || !rdp->mcs->messageChannelId ||
+			!(rdp->settings->MultitransportFlags & requestedProtocol))
+		return FALSE;
+
+	index = multitransport_get_index(requestedProtocol);
+	requestId = (UINT32) InterlockedIncrement(&nextRequestId);
+	crypto_nonce(securityCookie, sizeof(securityCookie));
+
+	EnterCriticalSection(&multitransport->lock);
+
+	if (multitransport->tunnels[index] || multitransport->pending[index])
+	{
+		LeaveCriticalSection(&multitransport->lock);
+		return FALSE;
+	}
+
+	multitransport->pending[index] = TRUE;
+	multitransport->requestIds[index] = requestId;
+	CopyMemory(multitransport->securityCookies[index], securityCookie, 16);
+
+	LeaveCriticalSection(&multitransport->lock);
+
+	if (!ArrayList_Contains(g_Multitransports, multitransport))
+		ArrayList_Add(g_Multitransports, multitransport);
+
+	s = rdp_message_channel_pdu_init(rdp);
+
+	if (!s)
+	{
+		EnterCriticalSection(&multitransport->lock);
+		multitransport->pending[index] = FALSE;
+		LeaveCriticalSection(&multitransport->lock);
+		return FALSE;
+	}
+
+	Stream_Write_UINT32(s, requestId); /* requestId (4 bytes) */
+	Stream_Write_UINT16(s, requestedProtocol); /* requestedProtocol (2 bytes) */
+	Stream_Write_UINT16(s, 0); /* reserved (2 bytes) */
+	Stream_Write(s, securityCookie, 16); /* securityCookie (16 bytes) */
+
+	return rdp_send_message_channel_pdu(rdp, s, SEC_TRANSPORT_REQ);
+}
+
+HANDLE multitransport_get_event_handle(rdpMultitransport* multitransport)
+{
+	return MessageQueue_Event(multitransport->queue);
+}
+
+static UINT16 multitransport_get_drdynvc_channel_id(rdpMultitransport* multitransport)
+{
+	UINT32 index;
+	rdpMcs* mcs = multitransport->rdp->mcs;
+
+	for (index = 0; index < mcs->channelCount; index++)
+	{
+		if (strncmp(mcs->channels[index].Name, "drdynvc", 7) == 0)
+			return mcs->channels[index].ChannelId;
+	}
+
 	return 0;
 }
 
-rdpMultitransport* multitransport_new(void)
+/**
+ * Hands the data received on the tunnels to the dynamic virtual channels,
+ * on the thread of the connection.
+ */
+
+int multitransport_check_fds(rdpMultitransport* multitransport)
 {
-	rdpMultitransport* multitransport = (rdpMultitransport*)malloc(sizeof(rdpMultitransport));
-	if (multitransport)
+	wStream* s;
+	UINT16 channelId;
+	wMessage message;
+	rdpRdp* rdp = multitransport->rdp;
+	freerdp* instance = rdp->instance;
+
+	while (MessageQueue_Peek(multitransport->queue, &message, TRUE))
 	{
-		memset(multitransport, 0, sizeof(rdpMultitransport));
+		if (message.id == MULTITRANSPORT_MESSAGE_DATA)
+		{
+			s = (wStream*) message.wParam;
+			channelId = multitransport_get_drdynvc_channel_id(multitransport);
+
+			if (channelId && instance)
+			{
+				IFCALL(instance->ReceiveChannelData, instance, channelId, Stream_Buffer(s),
+						(int) Stream_Length(s), CHANNEL_FLAG_FIRST | CHANNEL_FLAG_LAST, (int) Stream_Length(s));
+			}
+
+			Stream_Free(s, TRUE);
+		}
+		else if (message.id == MULTITRANSPORT_MESSAGE_FAILED)
+		{
+			if (!rdp_send_multitransport_response(rdp, (UINT32) (size_t) message.lParam, E_ABORT))
+				return -1;
+		}
 	}
-	
+
+	return 0;
+}
+
+UINT16 multitransport_get_channel_route(rdpMultitransport* multitransport, const char* name)
+{
+	int index;
+
+	for (index = 0; index < (int) (sizeof(g_MultitransportRoutes) / sizeof(g_MultitransportRoutes[0])); index++)
+	{
+		if (strcmp(g_MultitransportRoutes[index].name, name) == 0)
+			return g_MultitransportRoutes[index].protocol;
+	}
+
+	return 0;
+}
+
+BOOL multitransport_is_connected(rdpMultitransport* multitransport, UINT16 protocol)
+{
+	BOOL connected;
+	rdpTunnel* tunnel;
+
+	EnterCriticalSection(&multitransport->lock);
+	tunnel = multitransport->tunnels[multitransport_get_index(protocol)];
+	connected = (tunnel && (tunnel->state == TUNNEL_STATE_CONNECTED)) ? TRUE : FALSE;
+	LeaveCriticalSection(&multitransport->lock);
+
+	return connected;
+}
+
+int multitransport_get_max_payload(rdpMultitransport* multitransport, UINT16 protocol)
+{
+	int maxPayload = 0;
+	rdpTunnel* tunnel;
+
+	EnterCriticalSection(&multitransport->lock);
+	tunnel = multitransport->tunnels[multitransport_get_index(protocol)];
+
+	if (tunnel)
+		maxPayload = tunnel_get_max_payload(tunnel);
+
+	LeaveCriticalSection(&multitransport->lock);
+
+	return maxPayload;
+}
+
+/**
+ * Sends data on a tunnel, returns -1 when the tunnel is not connected.
+ */
+
+int multitransport_write(rdpMultitransport* multitransport, UINT16 protocol, const BYTE* data, int length)
+{
+	int status = -1;
+	rdpTunnel* tunnel;
+
+	EnterCriticalSection(&multitransport->lock);
+	tunnel = multitransport->tunnels[multitransport_get_index(protocol)];
+
+	if (tunnel)
+		status = tunnel_write(tunnel, data, length);
+
+	LeaveCriticalSection(&multitransport->lock);
+
+	return status;
+}
+
+/**
+ * Called on the thread of a tunnel when the client sends its create request:
+ * the tunnel goes to the session which sent this request id and cookie.
+ */
+
+static UINT32 multitransport_tunnel_create(rdpTunnel* tunnel, UINT32 requestId, const BYTE* securityCookie, void* param)
+{
+	int index;
+	int count;
+	int position;
+	UINT32 hrResponse = E_ABORT;
+	rdpMultitransport* multitransport;
+
+	index = tunnel->lossy ? MULTITRANSPORT_LOSSY : MULTITRANSPORT_RELIABLE;
+
+	ArrayList_Lock(g_Multitransports);
+
+	count = ArrayList_Count(g_Multitransports);
+
+	for (position = 0; (position < count) && (hrResponse != S_OK); position++)
+	{
+		multitransport = (rdpMultitransport*) ArrayList_GetItem(g_Multitransports, position);
+
+		EnterCriticalSection(&multitransport->lock);
+
+		if (multitransport->pending[index] && (multitransport->requestIds[index] == requestId) &&
+				(memcmp(multitransport->securityCookies[index], securityCookie, 16) == 0))
+		{
+			multitransport->pending[index] = FALSE;
+			multitransport->tunnels[index] = tunnel;
+			ArrayList_Remove(g_Tunnels, tunnel);
+			hrResponse = S_OK;
+		}
+
+		LeaveCriticalSection(&multitransport->lock);
+	}
+
+	ArrayList_Unlock(g_Multitransports);
+
+	if (hrResponse != S_OK)
+		WLog_WARN(TAG, "no session is waiting for tunnel %u", requestId);
+
+	return hrResponse;
+}
+
+/**
+ * A client completed the RDP-UDP handshake. The DTLS server presents the
+ * certificate of a session waiting for a tunnel: the sessions of a listener
+ * share their certificate.
+ */
+
+static void multitransport_listener_accepted(rdpUdpListener* listener, rdpUdp* udp, void* param)
+{
+	int index;
+	int count;
+	rdpTunnel* tunnel;
+	rdpSettings* settings = NULL;
+	rdpMultitransport* multitransport;
+	wArrayList* failed;
+
+	ArrayList_Lock(g_Multitransports);
+
+	count = ArrayList_Count(g_Multitransports);
+
+	for (index = count - 1; (index >= 0) && !settings; index--)
+	{
+		multitransport = (rdpMultitransport*) ArrayList_GetItem(g_Multitransports, index);
+
+		if (multitransport->pending[MULTITRANSPORT_RELIABLE] || multitransport->pending[MULTITRANSPORT_LOSSY])
+			settings = multitransport->rdp->settings;
+	}
+
+	tunnel = tunnel_new(TRUE, udp->lossy, NULL, multitransport_tunnel_create, NULL);
+
+	if (tunnel)
+	{
+		if (!settings || !tunnel_accept(tunnel, udp, settings->CertificateFile, settings->PrivateKeyFile))
+			WLog_WARN(TAG, "refusing an unexpected tunnel");
+
+		/* the tunnel owns the connection from now on, even if it failed */
+		tunnel->udp = udp;
+		ArrayList_Add(g_Tunnels, tunnel);
+	}
+
+	ArrayList_Unlock(g_Multitransports);
+
+	/* close the tunnels which failed before being matched */
+	failed = ArrayList_New(FALSE);
+
+	if (!failed)
+		return;
+
+	ArrayList_Lock(g_Tunnels);
+
+	for (index = ArrayList_Count(g_Tunnels) - 1; index >= 0; index--)
+	{
+		tunnel = (rdpTunnel*) ArrayList_GetItem(g_Tunnels, index);
+
+		if ((tunnel->udp != udp) && (tunnel->state == TUNNEL_STATE_FAILED))
+		{
+			ArrayList_RemoveAt(g_Tunnels, index);
+			ArrayList_Add(failed, tunnel);
+		}
+	}
+
+	ArrayList_Unlock(g_Tunnels);
+
+	for (index = 0; index < ArrayList_Count(failed); index++)
+		tunnel_free((rdpTunnel*) ArrayList_GetItem(failed, index));
+
+	ArrayList_Free(failed);
+}
+
+/**
+ * Opens the RDP-UDP listener of the server, on the port of its RDP listener.
+ */
+
+rdpUdpListener* multitransport_listener_new(const char* bind_address, UINT16 port)
+{
+	if (!g_Multitransports)
+		g_Multitransports = ArrayList_New(TRUE);
+
+	if (!g_Tunnels)
+		g_Tunnels = ArrayList_New(TRUE);
+
+	if (!g_Multitransports || !g_Tunnels)
+		return NULL;
+
+	return rdpudp_listener_new(bind_address, port, multitransport_listener_accepted, NULL);
+}
+
+void multitransport_listener_free(rdpUdpListener* listener)
+{
+	int index;
+	rdpTunnel* tunnel;
+	wArrayList* unmatched;
+
+	if (!listener)
+		return;
+
+	unmatched = ArrayList_New(FALSE);
+
+	if (unmatched)
+	{
+		ArrayList_Lock(g_Tunnels);
+
+		for (index = ArrayList_Count(g_Tunnels) - 1; index >= 0; index--)
+		{
+			tunnel = (rdpTunnel*) ArrayList_GetItem(g_Tunnels, index);
+
+			if (tunnel->udp && (tunnel->udp->listener == listener))
+			{
+				ArrayList_RemoveAt(g_Tunnels, index);
+				ArrayList_Add(unmatched, tunnel);
+			}
+		}
+
+		ArrayList_Unlock(g_Tunnels);
+
+		/* outside of the lock, which their threads may be waiting for */
+		for (index = 0; index < ArrayList_Count(unmatched); index++)
+			tunnel_free((rdpTunnel*) ArrayList_GetItem(unmatched, index));
+
+		ArrayList_Free(unmatched);
+	}
+
+	rdpudp_listener_free(listener);
+}
+
+rdpMultitransport* multitransport_new(rdpRdp* rdp)
+{
+	rdpMultitransport* multitransport;
+
+	multitransport = (rdpMultitransport*) calloc(1, sizeof(rdpMultitransport));
+
+	if (!multitransport)
+		return NULL;
+
+	multitransport->rdp = rdp;
+	multitransport->queue = MessageQueue_New(NULL);
+
+	if (!multitransport->queue)
+	{
+		free(multitransport);
+		return NULL;
+	}
+
+	InitializeCriticalSectionAndSpinCount(&multitransport->lock, 4000);
+
 	return multitransport;
 }
 
 void multitransport_free(rdpMultitransport* multitransport)
 {
+	int index;
+	wMessage message;
+
+	if (!multitransport)
+		return;
+
+	/* no tunnel can be matched to the session from now on */
+	if (g_Multitransports)
+		ArrayList_Remove(g_Multitransports, multitransport);
+
+	for (index = 0; index < 2; index++)
+	{
+		if (multitransport->threads[index])
+		{
+			WaitForSingleObject(multitransport->threads[index], INFINITE);
+			CloseHandle(multitransport->threads[index]);
+		}
+
+		tunnel_free(multitransport->tunnels[index]);
+	}
+
+	while (MessageQueue_Peek(multitransport->queue, &message, TRUE))
+	{
+		if (message.id == MULTITRANSPORT_MESSAGE_DATA)
+			Stream_Free((wStream*) message.wParam, TRUE);
+	}
+
+	MessageQueue_Free(multitransport->queue);
+
+	DeleteCriticalSection(&multitransport->lock);
+
 	free(multitransport);
 }
@@ -23,19 +23,57 @@
 typedef struct rdp_multitransport rdpMultitransport;
 
 #include "rdp.h"
+#include "rdpudp.h"
+#include "tunnel.h"
 
 #include <freerdp/freerdp.h>
 
 #include <winpr/stream.h>
+#include <winpr/collections.h>
+
+#define MULTITRANSPORT_RELIABLE			0
+#define MULTITRANSPORT_LOSSY			1
+
+#define MULTITRANSPORT_CONNECT_TIMEOUT		5000
+
+enum MULTITRANSPORT_MESSAGE
+{
+	MULTITRANSPORT_MESSAGE_DATA = 1,
+	MULTITRANSPORT_MESSAGE_FAILED
+};
 
 struct rdp_multitransport
 {
-	UINT32 placeholder;
+	rdpRdp* rdp;
+	CRITICAL_SECTION lock;
+	rdpTunnel* tunnels[2];
+
+	/* server */
+	BOOL pending[2];
+	UINT32 requestIds[2];
+	BYTE securityCookies[2][16];
+
+	/* client */
+	HANDLE threads[2];
+	wMessageQueue* queue;
 };
 
 int rdp_recv_multitransport_packet(rdpRdp* rdp, wStream* s);
+int rdp_recv_multitransport_response(rdpRdp* rdp, wStream* s);
+BOOL rdp_send_multitransport_request(rdpRdp* rdp, UINT16 requestedProtocol);
+
+HANDLE multitransport_get_event_handle(rdpMultitransport* multitransport);
+int multitransport_check_fds(rdpMultitransport* multitransport);
+
+UINT16 multitransport_get_channel_route(rdpMultitransport* multitransport, const char* name);
+BOOL multitransport_is_connected(rdpMultitransport* multitransport, UINT16 protocol);
+int multitransport_get_max_payload(rdpMultitransport* multitransport, UINT16 protocol);
+int multitransport_write(rdpMultitransport* multitransport, UINT16 protocol, const BYTE* data, int length);
+
+rdpUdpListener* multitransport_listener_new(const char* bind_address, UINT16 port);
+void multitransport_listener_free(rdpUdpListener* listener);
 
-rdpMultitransport* multitransport_new(void);
+rdpMultitransport* multitransport_new(rdpRdp* rdp);
 void multitransport_free(rdpMultitransport* multitransport);
 
 #endif /* __MULTITRANSPORT_H */
@@ -239,11 +239,11 @@ static INLINE BOOL update_write_color(wStream* s, UINT32 color)
 {
 	BYTE byte;
 
-	byte = (color & 0xFF);
+	byte = ((color >> 16) & 0xFF);
 	Stream_Write_UINT8(s, byte);
 	byte = ((color >> 8) & 0xFF);
 	Stream_Write_UINT8(s, byte);
-	byte = ((color >> 16) & 0xFF);
+	byte = (color & 0xFF);
 	Stream_Write_UINT8(s, byte);
 
 	return TRUE;
@@ -262,6 +262,14 @@ static INLINE void update_read_colorref(wStream* s, UINT32* color)
 	Stream_Seek_UINT8(s);
 }
 
+static INLINE void update_write_colorref(wStream* s, UINT32 color)
+{
+	Stream_Write_UINT8(s, color & 0xFF);
+	Stream_Write_UINT8(s, (color >> 8) & 0xFF);
+	Stream_Write_UINT8(s, (color >> 16) & 0xFF);
+	Stream_Write_UINT8(s, 0);
+}
+
 static INLINE void update_read_color_quad(wStream* s, UINT32* color)
 {
 	BYTE byte;
@@ -279,12 +287,13 @@ static INLINE void update_write_color_quad(wStream* s, UINT32 color)
 {
 	BYTE byte;
 
-	byte = (color << 16) & 0xFF;
+	byte = (color >> 16) & 0xFF;
 	Stream_Write_UINT8(s, byte);
-	byte = (color << 8) & 0xFF;
+	byte = (color >> 8) & 0xFF;
 	Stream_Write_UINT8(s, byte);
 	byte = color & 0xFF;
 	Stream_Write_UINT8(s, byte);
+	Stream_Write_UINT8(s, 0);
 }
 
 static INLINE BOOL update_read_2byte_unsigned(wStream* s, UINT32* value)
@@ -518,6 +527,25 @@ static INLINE BOOL update_read_delta(wStream* s, INT32* value)
 	return TRUE;
 }
 
+static INLINE BOOL update_write_delta(wStream* s, INT32 value)
+{
+	if ((value >= -64) && (value <= 63))
+	{
+		Stream_Write_UINT8(s, value & 0x7F);
+	}
+	else if ((value >= -8192) && (value <= 8191))
+	{
+		Stream_Write_UINT8(s, ((value >> 8) & 0x7F) | 0x80);
+		Stream_Write_UINT8(s, value & 0xFF);
+	}
+	else
+	{
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
 #if 0
 static INLINE void update_read_glyph_delta(wStream* s, UINT16* value)
 {
@@ -746,6 +774,132 @@ static INLINE BOOL update_read_delta_points(wStream* s, DELTA_POINT* points, int
 	return TRUE;
 }
 
+/**
+ * Write the cbData field followed by the zero bits and delta encoded rectangles.
+ * Rectangles are stored at indices 1 to number, as filled by update_read_delta_rects.
+ * The first rectangle is encoded against an all-zero base; index 0 is not read.
+ */
+
+static INLINE BOOL update_write_delta_rects(wStream* s, DELTA_RECT* rectangles, int number, UINT32* cbData)
+{
+	int i;
+	BYTE flags;
+	BYTE* zeroBits;
+	int position;
+	UINT32 zeroBitsSize;
+	DELTA_RECT zero;
+	DELTA_RECT* previous;
+
+	if ((number < 0) || (number > 45))
+		return FALSE;
+
+	zeroBitsSize = ((number + 1) / 2);
+
+	Stream_EnsureRemainingCapacity(s, 2 + zeroBitsSize + (number * 8));
+
+	position = Stream_GetPosition(s);
+	Stream_Seek_UINT16(s); /* cbData (2 bytes) */
+
+	Stream_GetPointer(s, zeroBits);
+	Stream_Zero(s, zeroBitsSize);
+
+	ZeroMemory(&zero, sizeof(DELTA_RECT));
+	previous = &zero;
+
+	for (i = 1; i < number + 1; i++)
+	{
+		flags = 0;
+
+		if (rectangles[i].left == previous->left)
+			flags |= 0x80;
+		else if (!update_write_delta(s, rectangles[i].left - previous->left))
+			return FALSE;
+
+		if (rectangles[i].top == previous->top)
+			flags |= 0x40;
+		else if (!update_write_delta(s, rectangles[i].top - previous->top))
+			return FALSE;
+
+		if (rectangles[i].width == previous->width)
+			flags |= 0x20;
+		else if (!update_write_delta(s, rectangles[i].width))
+			return FALSE;
+
+		if (rectangles[i].height == previous->height)
+			flags |= 0x10;
+		else if (!update_write_delta(s, rectangles[i].height))
+			return FALSE;
+
+		zeroBits[(i - 1) / 2] |= ((i - 1) % 2 == 0) ? flags : (flags >> 4);
+		previous = &rectangles[i];
+	}
+
+	*cbData = Stream_GetPosition(s) - position - 2;
+
+	Stream_SetPosition(s, position);
+	Stream_Write_UINT16(s, *cbData);
+	Stream_Seek(s, *cbData);
+
+	return TRUE;
+}
+
+/**
+ * Write the cbData field followed by the zero bits and delta encoded points.
+ */
+
+static INLINE BOOL update_write_delta_points(wStream* s, DELTA_POINT* points, int number, UINT32* cbData)
+{
+	int i;
+	BYTE flags;
+	BYTE* zeroBits;
+	int position;
+	UINT32 zeroBitsSize;
+
+	if (number < 0)
+		return FALSE;
+
+	zeroBitsSize = ((number + 3) / 4);
+
+	Stream_EnsureRemainingCapacity(s, 1 + zeroBitsSize + (number * 4));
+
+	position = Stream_GetPosition(s);
+	Stream_Seek_UINT8(s); /* cbData (1 byte) */
+
+	Stream_GetPointer(s, zeroBits);
+	Stream_Zero(s, zeroBitsSize);
+
+	for (i = 0; i < number; i++)
+	{
+		flags = 0;
+
+		if (points[i].x == 0)
+			flags |= 0x80;
+		else if (!update_write_delta(s, points[i].x))
+			return FALSE;
+
+		if (points[i].y == 0)
+			flags |= 0x40;
+		else if (!update_write_delta(s, points[i].y))
+			return FALSE;
+
+		zeroBits[i / 4] |= (flags >> ((i % 4) * 2));
+	}
+
+	*cbData = Stream_GetPosition(s) - position - 1;
+
+	if (*cbData > 0xFF)
+	{
+		WLog_ERR(TAG, "delta point list too long: %d bytes", *cbData);
+		return FALSE;
+	}
+
+	Stream_SetPosition(s, position);
+	Stream_Write_UINT8(s, *cbData);
+	Stream_Seek(s, *cbData);
+
+	return TRUE;
+}
+
 
 #define ORDER_FIELD_BYTE(NO, TARGET) \
 	do {\
@@ -1029,7 +1183,7 @@ BOOL update_write_opaque_rect_order(wStream* s, ORDER_INFO* orderInfo, OPAQUE_RE
 	update_write_coord(s, opaque_rect->nHeight);
 
 	orderInfo->fieldFlags |= ORDER_FIELD_05;
-	byte = opaque_rect->color & 0x000000FF;
+	byte = (opaque_rect->color & 0x00FF0000) >> 16;
 	Stream_Write_UINT8(s, byte);
 
 	orderInfo->fieldFlags |= ORDER_FIELD_06;
@@ -1037,7 +1191,7 @@ BOOL update_write_opaque_rect_order(wStream* s, ORDER_INFO* orderInfo, OPAQUE_RE
 	Stream_Write_UINT8(s, byte);
 
 	orderInfo->fieldFlags |= ORDER_FIELD_07;
-	byte = (opaque_rect->color & 0x00FF0000) >> 16;
+	byte = opaque_rect->color & 0x000000FF;
 	Stream_Write_UINT8(s, byte);
 
 	return TRUE;
@@ -1061,6 +1215,25 @@ int update_approximate_draw_nine_grid_order(ORDER_INFO* orderInfo, DRAW_NINE_GRI
 
 BOOL update_write_draw_nine_grid_order(wStream* s, ORDER_INFO* orderInfo, DRAW_NINE_GRID_ORDER* draw_nine_grid)
 {
+	orderInfo->fieldFlags = 0;
+
+	Stream_EnsureRemainingCapacity(s, update_approximate_draw_nine_grid_order(orderInfo, draw_nine_grid));
+
+	orderInfo->fieldFlags |= ORDER_FIELD_01;
+	update_write_coord(s, draw_nine_grid->srcLeft);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_02;
+	update_write_coord(s, draw_nine_grid->srcTop);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_03;
+	update_write_coord(s, draw_nine_grid->srcRight);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_04;
+	update_write_coord(s, draw_nine_grid->srcBottom);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_05;
+	Stream_Write_UINT16(s, draw_nine_grid->bitmapId);
+
 	return TRUE;
 }
 
@@ -1088,12 +1261,35 @@ BOOL update_read_multi_dstblt_order(wStream* s, ORDER_INFO* orderInfo, MULTI_DST
 
 int update_approximate_multi_dstblt_order(ORDER_INFO* orderInfo, MULTI_DSTBLT_ORDER* multi_dstblt)
 {
-	return 32;
+	return 32 + 2 + ((multi_dstblt->numRectangles + 1) / 2) + (multi_dstblt->numRectangles * 8);
 }
 
 BOOL update_write_multi_dstblt_order(wStream* s, ORDER_INFO* orderInfo, MULTI_DSTBLT_ORDER* multi_dstblt)
 {
-	return TRUE;
+	orderInfo->fieldFlags = 0;
+
+	Stream_EnsureRemainingCapacity(s, update_approximate_multi_dstblt_order(orderInfo, multi_dstblt));
+
+	orderInfo->fieldFlags |= ORDER_FIELD_01;
+	update_write_coord(s, multi_dstblt->nLeftRect);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_02;
+	update_write_coord(s, multi_dstblt->nTopRect);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_03;
+	update_write_coord(s, multi_dstblt->nWidth);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_04;
+	update_write_coord(s, multi_dstblt->nHeight);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_05;
+	Stream_Write_UINT8(s, multi_dstblt->bRop);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_06;
+	Stream_Write_UINT8(s, multi_dstblt->numRectangles);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_07;
+	return update_write_delta_rects(s, multi_dstblt->rectangles, multi_dstblt->numRectangles, &multi_dstblt->cbData);
 }
 
 BOOL update_read_multi_patblt_order(wStream* s, ORDER_INFO* orderInfo, MULTI_PATBLT_ORDER* multi_patblt)
@@ -1126,12 +1322,48 @@ BOOL update_read_multi_patblt_order(wStream* s, ORDER_INFO* orderInfo, MULTI_PAT
 
 int update_approximate_multi_patblt_order(ORDER_INFO* orderInfo, MULTI_PATBLT_ORDER* multi_patblt)
 {
-	return 32;
+	return 32 + 2 + ((multi_patblt->numRectangles + 1) / 2) + (multi_patblt->numRectangles * 8);
 }
 
 BOOL update_write_multi_patblt_order(wStream* s, ORDER_INFO* orderInfo, MULTI_PATBLT_ORDER* multi_patblt)
 {
-	return TRUE;
+	orderInfo->fieldFlags = 0;
+
+	Stream_EnsureRemainingCapacity(s, update_approximate_multi_patblt_order(orderInfo, multi_patblt));
+
+	orderInfo->fieldFlags |= ORDER_FIELD_01;
+	update_write_coord(s, multi_patblt->nLeftRect);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_02;
+	update_write_coord(s, multi_patblt->nTopRect);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_03;
+	update_write_coord(s, multi_patblt->nWidth);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_04;
+	update_write_coord(s, multi_patblt->nHeight);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_05;
+	Stream_Write_UINT8(s, multi_patblt->bRop);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_06;
+	update_write_color(s, multi_patblt->backColor);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_07;
+	update_write_color(s, multi_patblt->foreColor);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_08;
+	orderInfo->fieldFlags |= ORDER_FIELD_09;
+	orderInfo->fieldFlags |= ORDER_FIELD_10;
+	orderInfo->fieldFlags |= ORDER_FIELD_11;
+	orderInfo->fieldFlags |= ORDER_FIELD_12;
+	update_write_brush(s, &multi_patblt->brush, orderInfo->fieldFlags >> 7);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_13;
+	Stream_Write_UINT8(s, multi_patblt->numRectangles);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_14;
+	return update_write_delta_rects(s, multi_patblt->rectangles, multi_patblt->numRectangles, &multi_patblt->cbData);
 }
 
 BOOL update_read_multi_scrblt_order(wStream* s, ORDER_INFO* orderInfo, MULTI_SCRBLT_ORDER* multi_scrblt)
@@ -1156,14 +1388,43 @@ BOOL update_read_multi_scrblt_order(wStream* s, ORDER_INFO* orderInfo, MULTI_SCR
 	return TRUE;
 }
 
-int update_approximate_multi_scrblt_order(wStream* s, ORDER_INFO* orderInfo, MULTI_SCRBLT_ORDER* multi_scrblt)
+int update_approximate_multi_scrblt_order(ORDER_INFO* orderInfo, MULTI_SCRBLT_ORDER* multi_scrblt)
 {
-	return 32;
+	return 32 + 2 + ((multi_scrblt->numRectangles + 1) / 2) + (multi_scrblt->numRectangles * 8);
 }
 
 BOOL update_write_multi_scrblt_order(wStream* s, ORDER_INFO* orderInfo, MULTI_SCRBLT_ORDER* multi_scrblt)
 {
-	return TRUE;
+	orderInfo->fieldFlags = 0;
+
+	Stream_EnsureRemainingCapacity(s, update_approximate_multi_scrblt_order(orderInfo, multi_scrblt));
+
+	orderInfo->fieldFlags |= ORDER_FIELD_01;
+	update_write_coord(s, multi_scrblt->nLeftRect);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_02;
+	update_write_coord(s, multi_scrblt->nTopRect);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_03;
+	update_write_coord(s, multi_scrblt->nWidth);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_04;
+	update_write_coord(s, multi_scrblt->nHeight);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_05;
+	Stream_Write_UINT8(s, multi_scrblt->bRop);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_06;
+	update_write_coord(s, multi_scrblt->nXSrc);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_07;
+	update_write_coord(s, multi_scrblt->nYSrc);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_08;
+	Stream_Write_UINT8(s, multi_scrblt->numRectangles);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_09;
+	return update_write_delta_rects(s, multi_scrblt->rectangles, multi_scrblt->numRectangles, &multi_scrblt->cbData);
 }
 
 BOOL update_read_multi_opaque_rect_order(wStream* s, ORDER_INFO* orderInfo, MULTI_OPAQUE_RECT_ORDER* multi_opaque_rect)
@@ -1217,12 +1478,46 @@ BOOL update_read_multi_opaque_rect_order(wStream* s, ORDER_INFO* orderInfo, MULT
 
 int update_approximate_multi_opaque_rect_order(ORDER_INFO* orderInfo, MULTI_OPAQUE_RECT_ORDER* multi_opaque_rect)
 {
-	return 32;
+	return 32 + 2 + ((multi_opaque_rect->numRectangles + 1) / 2) + (multi_opaque_rect->numRectangles * 8);
 }
 
 BOOL update_write_multi_opaque_rect_order(wStream* s, ORDER_INFO* orderInfo, MULTI_OPAQUE_RECT_ORDER* multi_opaque_rect)
 {
-	return TRUE;
+	BYTE byte;
+
+	orderInfo->fieldFlags = 0;
+
+	Stream_EnsureRemainingCapacity(s, update_approximate_multi_opaque_rect_order(orderInfo, multi_opaque_rect));
+
+	orderInfo->fieldFlags |= ORDER_FIELD_01;
+	update_write_coord(s, multi_opaque_rect->nLeftRect);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_02;
+	update_write_coord(s, multi_opaque_rect->nTopRect);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_03;
+	update_write_coord(s, multi_opaque_rect->nWidth);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_04;
+	update_write_coord(s, multi_opaque_rect->nHeight);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_05;
+	byte = (multi_opaque_rect->color >> 16) & 0xFF;
+	Stream_Write_UINT8(s, byte);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_06;
+	byte = (multi_opaque_rect->color >> 8) & 0xFF;
+	Stream_Write_UINT8(s, byte);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_07;
+	byte = multi_opaque_rect->color & 0xFF;
+	Stream_Write_UINT8(s, byte);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_08;
+	Stream_Write_UINT8(s, multi_opaque_rect->numRectangles);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_09;
+	return update_write_delta_rects(s, multi_opaque_rect->rectangles, multi_opaque_rect->numRectangles, &multi_opaque_rect->cbData);
 }
 
 BOOL update_read_multi_draw_nine_grid_order(wStream* s, ORDER_INFO* orderInfo, MULTI_DRAW_NINE_GRID_ORDER* multi_draw_nine_grid)
@@ -1237,6 +1532,7 @@ BOOL update_read_multi_draw_nine_grid_order(wStream* s, ORDER_INFO* orderInfo, M
 	if (orderInfo->fieldFlags & ORDER_FIELD_07)
 	{
 		FIELD_SKIP_BUFFER16(s, multi_draw_nine_grid->cbData);
+		multi_draw_nine_grid->codeDeltaList = Stream_Pointer(s) - multi_draw_nine_grid->cbData;
 	}
 
 	return TRUE;
@@ -1244,11 +1540,37 @@ BOOL update_read_multi_draw_nine_grid_order(wStream* s, ORDER_INFO* orderInfo, M
 
 int update_approximate_multi_draw_nine_grid_order(ORDER_INFO* orderInfo, MULTI_DRAW_NINE_GRID_ORDER* multi_draw_nine_grid)
 {
-	return 32;
+	return 32 + multi_draw_nine_grid->cbData;
 }
 
 BOOL update_write_multi_draw_nine_grid_order(wStream* s, ORDER_INFO* orderInfo, MULTI_DRAW_NINE_GRID_ORDER* multi_draw_nine_grid)
 {
+	orderInfo->fieldFlags = 0;
+
+	Stream_EnsureRemainingCapacity(s, update_approximate_multi_draw_nine_grid_order(orderInfo, multi_draw_nine_grid));
+
+	orderInfo->fieldFlags |= ORDER_FIELD_01;
+	update_write_coord(s, multi_draw_nine_grid->srcLeft);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_02;
+	update_write_coord(s, multi_draw_nine_grid->srcTop);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_03;
+	update_write_coord(s, multi_draw_nine_grid->srcRight);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_04;
+	update_write_coord(s, multi_draw_nine_grid->srcBottom);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_05;
+	Stream_Write_UINT16(s, multi_draw_nine_grid->bitmapId);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_06;
+	Stream_Write_UINT8(s, multi_draw_nine_grid->nDeltaEntries);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_07;
+	Stream_Write_UINT16(s, multi_draw_nine_grid->cbData);
+	Stream_Write(s, multi_draw_nine_grid->codeDeltaList, multi_draw_nine_grid->cbData);
+
 	return TRUE;
 }
 
@@ -1341,12 +1663,35 @@ BOOL update_read_polyline_order(wStream* s, ORDER_INFO* orderInfo, POLYLINE_ORDE
 
 int update_approximate_polyline_order(ORDER_INFO* orderInfo, POLYLINE_ORDER* polyline)
 {
-	return 32;
+	return 32 + 1 + ((polyline->numDeltaEntries + 3) / 4) + (polyline->numDeltaEntries * 4);
 }
 
 BOOL update_write_polyline_order(wStream* s, ORDER_INFO* orderInfo, POLYLINE_ORDER* polyline)
 {
-	return TRUE;
+	orderInfo->fieldFlags = 0;
+
+	Stream_EnsureRemainingCapacity(s, update_approximate_polyline_order(orderInfo, polyline));
+
+	orderInfo->fieldFlags |= ORDER_FIELD_01;
+	update_write_coord(s, polyline->xStart);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_02;
+	update_write_coord(s, polyline->yStart);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_03;
+	Stream_Write_UINT8(s, polyline->bRop2);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_04;
+	Stream_Write_UINT16(s, 0); /* brushCacheEntry (2 bytes) */
+
+	orderInfo->fieldFlags |= ORDER_FIELD_05;
+	update_write_color(s, polyline->penColor);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_06;
+	Stream_Write_UINT8(s, polyline->numDeltaEntries);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_07;
+	return update_write_delta_points(s, polyline->points, polyline->numDeltaEntries, &polyline->cbData);
 }
 
 BOOL update_read_memblt_order(wStream* s, ORDER_INFO* orderInfo, MEMBLT_ORDER* memblt)
@@ -1442,6 +1787,54 @@ int update_approximate_mem3blt_order(ORDER_INFO* orderInfo, MEM3BLT_ORDER* mem3b
 
 BOOL update_write_mem3blt_order(wStream* s, ORDER_INFO* orderInfo, MEM3BLT_ORDER* mem3blt)
 {
+	UINT16 cacheId;
+
+	orderInfo->fieldFlags = 0;
+
+	Stream_EnsureRemainingCapacity(s, update_approximate_mem3blt_order(orderInfo, mem3blt));
+
+	cacheId = (mem3blt->cacheId & 0xFF) | ((mem3blt->colorIndex & 0xFF) << 8);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_01;
+	Stream_Write_UINT16(s, cacheId);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_02;
+	update_write_coord(s, mem3blt->nLeftRect);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_03;
+	update_write_coord(s, mem3blt->nTopRect);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_04;
+	update_write_coord(s, mem3blt->nWidth);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_05;
+	update_write_coord(s, mem3blt->nHeight);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_06;
+	Stream_Write_UINT8(s, mem3blt->bRop);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_07;
+	update_write_coord(s, mem3blt->nXSrc);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_08;
+	update_write_coord(s, mem3blt->nYSrc);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_09;
+	update_write_color(s, mem3blt->backColor);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_10;
+	update_write_color(s, mem3blt->foreColor);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_11;
+	orderInfo->fieldFlags |= ORDER_FIELD_12;
+	orderInfo->fieldFlags |= ORDER_FIELD_13;
+	orderInfo->fieldFlags |= ORDER_FIELD_14;
+	orderInfo->fieldFlags |= ORDER_FIELD_15;
+	update_write_brush(s, &mem3blt->brush, orderInfo->fieldFlags >> 10);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_16;
+	Stream_Write_UINT16(s, mem3blt->cacheIndex);
+
 	return TRUE;
 }
 
@@ -1456,13 +1849,35 @@ BOOL update_read_save_bitmap_order(wStream* s, ORDER_INFO* orderInfo, SAVE_BITMA
 	return TRUE;
 }
 
-int update_approximate_save_bitmap_order(ORDER_INFO* orderInfo, SAVE_BITMAP_ORDER* save_bitmap)
-{
-	return 32;
-}
+int update_approximate_save_bitmap_order(ORDER_INFO* orderInfo, SAVE_BITMAP_ORDER* save_bitmap)
+{
+	return 32;
+}
+
+BOOL update_write_save_bitmap_order(wStream* s, ORDER_INFO* orderInfo, SAVE_BITMAP_ORDER* save_bitmap)
+{
+	orderInfo->fieldFlags = 0;
+
+	Stream_EnsureRemainingCapacity(s, update_approximate_save_bitmap_order(orderInfo, save_bitmap));
+
+	orderInfo->fieldFlags |= ORDER_FIELD_01;
+	Stream_Write_UINT32(s, save_bitmap->savedBitmapPosition);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_02;
+	update_write_coord(s, save_bitmap->nLeftRect);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_03;
+	update_write_coord(s, save_bitmap->nTopRect);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_04;
+	update_write_coord(s, save_bitmap->nRightRect);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_05;
+	update_write_coord(s, save_bitmap->nBottomRect);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_06;
+	Stream_Write_UINT8(s, save_bitmap->operation);
 
-BOOL update_write_save_bitmap_order(wStream* s, ORDER_INFO* orderInfo, SAVE_BITMAP_ORDER* save_bitmap)
-{
 	return TRUE;
 }
 
@@ -1615,11 +2030,62 @@ BOOL update_read_fast_index_order(wStream* s, ORDER_INFO* orderInfo, FAST_INDEX_
 
 int update_approximate_fast_index_order(ORDER_INFO* orderInfo, FAST_INDEX_ORDER* fast_index)
 {
-	return 32;
+	return 64 + fast_index->cbData;
 }
 
 BOOL update_write_fast_index_order(wStream* s, ORDER_INFO* orderInfo, FAST_INDEX_ORDER* fast_index)
 {
+	orderInfo->fieldFlags = 0;
+
+	Stream_EnsureRemainingCapacity(s, update_approximate_fast_index_order(orderInfo, fast_index));
+
+	orderInfo->fieldFlags |= ORDER_FIELD_01;
+	Stream_Write_UINT8(s, fast_index->cacheId);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_02;
+	Stream_Write_UINT8(s, fast_index->ulCharInc);
+	Stream_Write_UINT8(s, fast_index->flAccel);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_03;
+	update_write_color(s, fast_index->backColor);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_04;
+	update_write_color(s, fast_index->foreColor);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_05;
+	update_write_coord(s, fast_index->bkLeft);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_06;
+	update_write_coord(s, fast_index->bkTop);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_07;
+	update_write_coord(s, fast_index->bkRight);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_08;
+	update_write_coord(s, fast_index->bkBottom);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_09;
+	update_write_coord(s, fast_index->opLeft);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_10;
+	update_write_coord(s, fast_index->opTop);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_11;
+	update_write_coord(s, fast_index->opRight);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_12;
+	update_write_coord(s, fast_index->opBottom);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_13;
+	update_write_coord(s, fast_index->x);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_14;
+	update_write_coord(s, fast_index->y);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_15;
+	Stream_Write_UINT8(s, fast_index->cbData);
+	Stream_Write(s, fast_index->data, fast_index->cbData);
+
 	return TRUE;
 }
 
@@ -1691,11 +2157,93 @@ BOOL update_read_fast_glyph_order(wStream* s, ORDER_INFO* orderInfo, FAST_GLYPH_
 
 int update_approximate_fast_glyph_order(ORDER_INFO* orderInfo, FAST_GLYPH_ORDER* fast_glyph)
 {
-	return 32;
+	return 64 + 256;
 }
 
 BOOL update_write_fast_glyph_order(wStream* s, ORDER_INFO* orderInfo, FAST_GLYPH_ORDER* fast_glyph)
 {
+	int position;
+	GLYPH_DATA_V2* glyph = &fast_glyph->glyphData;
+
+	orderInfo->fieldFlags = 0;
+
+	Stream_EnsureRemainingCapacity(s, update_approximate_fast_glyph_order(orderInfo, fast_glyph));
+
+	orderInfo->fieldFlags |= ORDER_FIELD_01;
+	Stream_Write_UINT8(s, fast_glyph->cacheId);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_02;
+	Stream_Write_UINT8(s, fast_glyph->ulCharInc);
+	Stream_Write_UINT8(s, fast_glyph->flAccel);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_03;
+	update_write_color(s, fast_glyph->backColor);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_04;
+	update_write_color(s, fast_glyph->foreColor);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_05;
+	update_write_coord(s, fast_glyph->bkLeft);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_06;
+	update_write_coord(s, fast_glyph->bkTop);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_07;
+	update_write_coord(s, fast_glyph->bkRight);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_08;
+	update_write_coord(s, fast_glyph->bkBottom);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_09;
+	update_write_coord(s, fast_glyph->opLeft);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_10;
+	update_write_coord(s, fast_glyph->opTop);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_11;
+	update_write_coord(s, fast_glyph->opRight);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_12;
+	update_write_coord(s, fast_glyph->opBottom);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_13;
+	update_write_coord(s, fast_glyph->x);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_14;
+	update_write_coord(s, fast_glyph->y);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_15;
+	position = Stream_GetPosition(s);
+	Stream_Seek_UINT8(s); /* cbData (1 byte) */
+
+	Stream_Write_UINT8(s, glyph->cacheIndex);
+
+	if (glyph->aj)
+	{
+		/* optional glyph data */
+		if (!update_write_2byte_signed(s, glyph->x) ||
+			!update_write_2byte_signed(s, glyph->y) ||
+			!update_write_2byte_unsigned(s, glyph->cx) ||
+			!update_write_2byte_unsigned(s, glyph->cy))
+			return FALSE;
+
+		glyph->cb = ((glyph->cx + 7) / 8) * glyph->cy;
+		glyph->cb += ((glyph->cb % 4) > 0) ? 4 - (glyph->cb % 4) : 0;
+		Stream_Write(s, glyph->aj, glyph->cb);
+	}
+
+	fast_glyph->cbData = Stream_GetPosition(s) - position - 1;
+
+	if (fast_glyph->cbData > 0xFF)
+	{
+		WLog_ERR(TAG, "fast glyph data too long: %d bytes", fast_glyph->cbData);
+		return FALSE;
+	}
+
+	Stream_SetPosition(s, position);
+	Stream_Write_UINT8(s, fast_glyph->cbData);
+	Stream_Seek(s, fast_glyph->cbData);
+
 	return TRUE;
 }
 
@@ -1728,12 +2276,35 @@ BOOL update_read_polygon_sc_order(wStream* s, ORDER_INFO* orderInfo, POLYGON_SC_
 
 int update_approximate_polygon_sc_order(ORDER_INFO* orderInfo, POLYGON_SC_ORDER* polygon_sc)
 {
-	return 32;
+	return 32 + 1 + ((polygon_sc->numPoints + 3) / 4) + (polygon_sc->numPoints * 4);
 }
 
 BOOL update_write_polygon_sc_order(wStream* s, ORDER_INFO* orderInfo, POLYGON_SC_ORDER* polygon_sc)
 {
-	return TRUE;
+	orderInfo->fieldFlags = 0;
+
+	Stream_EnsureRemainingCapacity(s, update_approximate_polygon_sc_order(orderInfo, polygon_sc));
+
+	orderInfo->fieldFlags |= ORDER_FIELD_01;
+	update_write_coord(s, polygon_sc->xStart);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_02;
+	update_write_coord(s, polygon_sc->yStart);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_03;
+	Stream_Write_UINT8(s, polygon_sc->bRop2);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_04;
+	Stream_Write_UINT8(s, polygon_sc->fillMode);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_05;
+	update_write_color(s, polygon_sc->brushColor);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_06;
+	Stream_Write_UINT8(s, polygon_sc->numPoints);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_07;
+	return update_write_delta_points(s, polygon_sc->points, polygon_sc->numPoints, &polygon_sc->cbData);
 }
 
 BOOL update_read_polygon_cb_order(wStream* s, ORDER_INFO* orderInfo, POLYGON_CB_ORDER* polygon_cb)
@@ -1774,12 +2345,52 @@ BOOL update_read_polygon_cb_order(wStream* s, ORDER_INFO* orderInfo, POLYGON_CB_
 
 int update_approximate_polygon_cb_order(ORDER_INFO* orderInfo, POLYGON_CB_ORDER* polygon_cb)
 {
-	return 32;
+	return 32 + 1 + ((polygon_cb->numPoints + 3) / 4) + (polygon_cb->numPoints * 4);
 }
 
 BOOL update_write_polygon_cb_order(wStream* s, ORDER_INFO* orderInfo, POLYGON_CB_ORDER* polygon_cb)
 {
-	return TRUE;
+	BYTE bRop2;
+
+	orderInfo->fieldFlags = 0;
+
+	Stream_EnsureRemainingCapacity(s, update_approximate_polygon_cb_order(orderInfo, polygon_cb));
+
+	bRop2 = (polygon_cb->bRop2 & 0x1F);
+
+	if (polygon_cb->backMode == BACKMODE_TRANSPARENT)
+		bRop2 |= 0x80;
+
+	orderInfo->fieldFlags |= ORDER_FIELD_01;
+	update_write_coord(s, polygon_cb->xStart);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_02;
+	update_write_coord(s, polygon_cb->yStart);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_03;
+	Stream_Write_UINT8(s, bRop2);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_04;
+	Stream_Write_UINT8(s, polygon_cb->fillMode);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_05;
+	update_write_color(s, polygon_cb->backColor);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_06;
+	update_write_color(s, polygon_cb->foreColor);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_07;
+	orderInfo->fieldFlags |= ORDER_FIELD_08;
+	orderInfo->fieldFlags |= ORDER_FIELD_09;
+	orderInfo->fieldFlags |= ORDER_FIELD_10;
+	orderInfo->fieldFlags |= ORDER_FIELD_11;
+	update_write_brush(s, &polygon_cb->brush, orderInfo->fieldFlags >> 6);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_12;
+	Stream_Write_UINT8(s, polygon_cb->numPoints);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_13;
+	return update_write_delta_points(s, polygon_cb->points, polygon_cb->numPoints, &polygon_cb->cbData);
 }
 
 BOOL update_read_ellipse_sc_order(wStream* s, ORDER_INFO* orderInfo, ELLIPSE_SC_ORDER* ellipse_sc)
@@ -1801,6 +2412,31 @@ int update_approximate_ellipse_sc_order(ORDER_INFO* orderInfo, ELLIPSE_SC_ORDER*
 
 BOOL update_write_ellipse_sc_order(wStream* s, ORDER_INFO* orderInfo, ELLIPSE_SC_ORDER* ellipse_sc)
 {
+	orderInfo->fieldFlags = 0;
+
+	Stream_EnsureRemainingCapacity(s, update_approximate_ellipse_sc_order(orderInfo, ellipse_sc));
+
+	orderInfo->fieldFlags |= ORDER_FIELD_01;
+	update_write_coord(s, ellipse_sc->leftRect);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_02;
+	update_write_coord(s, ellipse_sc->topRect);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_03;
+	update_write_coord(s, ellipse_sc->rightRect);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_04;
+	update_write_coord(s, ellipse_sc->bottomRect);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_05;
+	Stream_Write_UINT8(s, ellipse_sc->bRop2);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_06;
+	Stream_Write_UINT8(s, ellipse_sc->fillMode);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_07;
+	update_write_color(s, ellipse_sc->color);
+
 	return TRUE;
 }
 
@@ -1824,6 +2460,41 @@ int update_approximate_ellipse_cb_order(ORDER_INFO* orderInfo, ELLIPSE_CB_ORDER*
 
 BOOL update_write_ellipse_cb_order(wStream* s, ORDER_INFO* orderInfo, ELLIPSE_CB_ORDER* ellipse_cb)
 {
+	orderInfo->fieldFlags = 0;
+
+	Stream_EnsureRemainingCapacity(s, update_approximate_ellipse_cb_order(orderInfo, ellipse_cb));
+
+	orderInfo->fieldFlags |= ORDER_FIELD_01;
+	update_write_coord(s, ellipse_cb->leftRect);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_02;
+	update_write_coord(s, ellipse_cb->topRect);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_03;
+	update_write_coord(s, ellipse_cb->rightRect);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_04;
+	update_write_coord(s, ellipse_cb->bottomRect);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_05;
+	Stream_Write_UINT8(s, ellipse_cb->bRop2);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_06;
+	Stream_Write_UINT8(s, ellipse_cb->fillMode);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_07;
+	update_write_color(s, ellipse_cb->backColor);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_08;
+	update_write_color(s, ellipse_cb->foreColor);
+
+	orderInfo->fieldFlags |= ORDER_FIELD_09;
+	orderInfo->fieldFlags |= ORDER_FIELD_10;
+	orderInfo->fieldFlags |= ORDER_FIELD_11;
+	orderInfo->fieldFlags |= ORDER_FIELD_12;
+	orderInfo->fieldFlags |= ORDER_FIELD_13;
+	update_write_brush(s, &ellipse_cb->brush, orderInfo->fieldFlags >> 8);
+
 	return TRUE;
 }
 
@@ -2250,7 +2921,13 @@ BOOL update_read_cache_glyph_order(wStream* s, CACHE_GLYPH_ORDER* cache_glyph_or
 
 int update_approximate_cache_glyph_order(CACHE_GLYPH_ORDER* cache_glyph, UINT16* flags)
 {
-	return 2 + cache_glyph->cGlyphs * 32;
+	int i;
+	int length = 2 + cache_glyph->cGlyphs * 2;
+
+	for (i = 0; i < (int) cache_glyph->cGlyphs; i++)
+		length += 10 + (((cache_glyph->glyphData[i].cx + 7) / 8) * cache_glyph->glyphData[i].cy) + 3;
+
+	return length;
 }
 
 BOOL update_write_cache_glyph_order(wStream* s, CACHE_GLYPH_ORDER* cache_glyph, UINT16* flags)
@@ -2339,7 +3016,13 @@ BOOL update_read_cache_glyph_v2_order(wStream* s, CACHE_GLYPH_V2_ORDER* cache_gl
 
 int update_approximate_cache_glyph_v2_order(CACHE_GLYPH_V2_ORDER* cache_glyph_v2, UINT16* flags)
 {
-	return 8 + cache_glyph_v2->cGlyphs * 32;
+	int i;
+	int length = 8 + cache_glyph_v2->cGlyphs * 2;
+
+	for (i = 0; i < (int) cache_glyph_v2->cGlyphs; i++)
+		length += 9 + (((cache_glyph_v2->glyphData[i].cx + 7) / 8) * cache_glyph_v2->glyphData[i].cy) + 3;
+
+	return length;
 }
 
 BOOL update_write_cache_glyph_v2_order(wStream* s, CACHE_GLYPH_V2_ORDER* cache_glyph_v2, UINT16* flags)
@@ -2391,7 +3074,7 @@ BOOL update_decompress_brush(wStream* s, BYTE* output, BYTE bpp)
 	palette = Stream_Pointer(s) + 16;
 	bytesPerPixel = ((bpp + 1) / 8);
 
-	if (Stream_GetRemainingLength(s) < 16) // 64 / 4
+	if (Stream_GetRemainingLength(s) < 16 + (4 * bytesPerPixel)) // 64 / 4
 		return FALSE;
 
 	for (y = 7; y >= 0; y--)
@@ -2410,12 +3093,58 @@ BOOL update_decompress_brush(wStream* s, BYTE* output, BYTE bpp)
 		}
 	}
 
+	Stream_Seek(s, 4 * bytesPerPixel); /* palette */
+
 	return TRUE;
 }
 
 BOOL update_compress_brush(wStream* s, BYTE* input, BYTE bpp)
 {
-	return FALSE;
+	int index;
+	int x, y;
+	BYTE* pixel;
+	int count = 0;
+	BYTE indices[16];
+	BYTE palette[4 * 4];
+	int bytesPerPixel;
+
+	bytesPerPixel = ((bpp + 1) / 8);
+
+	ZeroMemory(indices, sizeof(indices));
+	ZeroMemory(palette, sizeof(palette));
+
+	/* the compressed format can only describe brushes of at most four colors */
+
+	for (y = 7; y >= 0; y--)
+	{
+		for (x = 0; x < 8; x++)
+		{
+			pixel = &input[(y * 8 + x) * bytesPerPixel];
+
+			for (index = 0; index < count; index++)
+			{
+				if (memcmp(&palette[index * bytesPerPixel], pixel, bytesPerPixel) == 0)
+					break;
+			}
+
+			if (index == count)
+			{
+				if (count == 4)
+					return FALSE;
+
+				CopyMemory(&palette[count * bytesPerPixel], pixel, bytesPerPixel);
+				count++;
+			}
+
+			indices[((7 - y) * 2) + (x / 4)] |= (index << ((3 - (x % 4)) * 2));
+		}
+	}
+
+	Stream_EnsureRemainingCapacity(s, 16 + 4 * bytesPerPixel);
+	Stream_Write(s, indices, 16);
+	Stream_Write(s, palette, 4 * bytesPerPixel);
+
+	return TRUE;
 }
 
 BOOL update_read_cache_brush_order(wStream* s, CACHE_BRUSH_ORDER* cache_brush, UINT16 flags)
@@ -2495,7 +3224,7 @@ BOOL update_read_cache_brush_order(wStream* s, CACHE_BRUSH_ORDER* cache_brush, U
 
 int update_approximate_cache_brush_order(CACHE_BRUSH_ORDER* cache_brush, UINT16* flags)
 {
-	return 64;
+	return 64 + (8 * 8 * 4);
 }
 
 BOOL update_write_cache_brush_order(wStream* s, CACHE_BRUSH_ORDER* cache_brush, UINT16* flags)
@@ -2709,6 +3438,26 @@ BOOL update_read_create_nine_grid_bitmap_order(wStream* s, CREATE_NINE_GRID_BITM
 	return TRUE;
 }
 
+BOOL update_write_create_nine_grid_bitmap_order(wStream* s, CREATE_NINE_GRID_BITMAP_ORDER* create_nine_grid_bitmap)
+{
+	NINE_GRID_BITMAP_INFO* nineGridInfo;
+
+	Stream_EnsureRemainingCapacity(s, 19);
+
+	Stream_Write_UINT8(s, create_nine_grid_bitmap->bitmapBpp); /* bitmapBpp (1 byte) */
+	Stream_Write_UINT16(s, create_nine_grid_bitmap->bitmapId); /* bitmapId (2 bytes) */
+
+	nineGridInfo = &(create_nine_grid_bitmap->nineGridInfo);
+	Stream_Write_UINT32(s, nineGridInfo->flFlags); /* flFlags (4 bytes) */
+	Stream_Write_UINT16(s, nineGridInfo->ulLeftWidth); /* ulLeftWidth (2 bytes) */
+	Stream_Write_UINT16(s, nineGridInfo->ulRightWidth); /* ulRightWidth (2 bytes) */
+	Stream_Write_UINT16(s, nineGridInfo->ulTopHeight); /* ulTopHeight (2 bytes) */
+	Stream_Write_UINT16(s, nineGridInfo->ulBottomHeight); /* ulBottomHeight (2 bytes) */
+	update_write_colorref(s, nineGridInfo->crTransparent); /* crTransparent (4 bytes) */
+
+	return TRUE;
+}
+
 BOOL update_read_frame_marker_order(wStream* s, FRAME_MARKER_ORDER* frame_marker)
 {
 	if (Stream_GetRemainingLength(s) < 4)
@@ -2721,6 +3470,10 @@ BOOL update_read_frame_marker_order(wStream* s, FRAME_MARKER_ORDER* frame_marker
 
 BOOL update_write_frame_marker_order(wStream* s, FRAME_MARKER_ORDER* frame_marker)
 {
+	Stream_EnsureRemainingCapacity(s, 4);
+
+	Stream_Write_UINT32(s, frame_marker->action); /* action (4 bytes) */
+
 	return TRUE;
 }
 
@@ -2757,12 +3510,29 @@ BOOL update_read_stream_bitmap_first_order(wStream* s, STREAM_BITMAP_FIRST_ORDER
 	}
 
 	FIELD_SKIP_BUFFER16(s, stream_bitmap_first->bitmapBlockSize); /* bitmapBlockSize(2 bytes) + bitmapBlock */
+	stream_bitmap_first->bitmapBlock = Stream_Pointer(s) - stream_bitmap_first->bitmapBlockSize;
 
 	return TRUE;
 }
 
 BOOL update_write_stream_bitmap_first_order(wStream* s, STREAM_BITMAP_FIRST_ORDER* stream_bitmap_first)
 {
+	Stream_EnsureRemainingCapacity(s, 14 + stream_bitmap_first->bitmapBlockSize);
+
+	Stream_Write_UINT8(s, stream_bitmap_first->bitmapFlags); /* bitmapFlags (1 byte) */
+	Stream_Write_UINT8(s, stream_bitmap_first->bitmapBpp); /* bitmapBpp (1 byte) */
+	Stream_Write_UINT16(s, stream_bitmap_first->bitmapType); /* bitmapType (2 bytes) */
+	Stream_Write_UINT16(s, stream_bitmap_first->bitmapWidth); /* bitmapWidth (2 bytes) */
+	Stream_Write_UINT16(s, stream_bitmap_first->bitmapHeight); /* bitmapHeigth (2 bytes) */
+
+	if (stream_bitmap_first->bitmapFlags & STREAM_BITMAP_V2)
+		Stream_Write_UINT32(s, stream_bitmap_first->bitmapSize); /* bitmapSize (4 bytes) */
+	else
+		Stream_Write_UINT16(s, stream_bitmap_first->bitmapSize); /* bitmapSize (2 bytes) */
+
+	Stream_Write_UINT16(s, stream_bitmap_first->bitmapBlockSize); /* bitmapBlockSize (2 bytes) */
+	Stream_Write(s, stream_bitmap_first->bitmapBlock, stream_bitmap_first->bitmapBlockSize); /* bitmapBlock */
+
 	return TRUE;
 }
 
@@ -2774,12 +3544,20 @@ BOOL update_read_stream_bitmap_next_order(wStream* s, STREAM_BITMAP_NEXT_ORDER*
 	Stream_Read_UINT8(s, stream_bitmap_next->bitmapFlags); /* bitmapFlags (1 byte) */
 	Stream_Read_UINT16(s, stream_bitmap_next->bitmapType); /* bitmapType (2 bytes) */
 	FIELD_SKIP_BUFFER16(s, stream_bitmap_next->bitmapBlockSize); /* bitmapBlockSize(2 bytes) + bitmapBlock */
+	stream_bitmap_next->bitmapBlock = Stream_Pointer(s) - stream_bitmap_next->bitmapBlockSize;
 
 	return TRUE;
 }
 
 BOOL update_write_stream_bitmap_next_order(wStream* s, STREAM_BITMAP_NEXT_ORDER* stream_bitmap_next)
 {
+	Stream_EnsureRemainingCapacity(s, 5 + stream_bitmap_next->bitmapBlockSize);
+
+	Stream_Write_UINT8(s, stream_bitmap_next->bitmapFlags); /* bitmapFlags (1 byte) */
+	Stream_Write_UINT16(s, stream_bitmap_next->bitmapType); /* bitmapType (2 bytes) */
+	Stream_Write_UINT16(s, stream_bitmap_next->bitmapBlockSize); /* bitmapBlockSize (2 bytes) */
+	Stream_Write(s, stream_bitmap_next->bitmapBlock, stream_bitmap_next->bitmapBlockSize); /* bitmapBlock */
+
 	return TRUE;
 }
 
@@ -2793,11 +3571,21 @@ BOOL update_read_draw_gdiplus_first_order(wStream* s, DRAW_GDIPLUS_FIRST_ORDER*
 	Stream_Read_UINT32(s, draw_gdiplus_first->cbTotalSize); /* cbTotalSize (4 bytes) */
 	Stream_Read_UINT32(s, draw_gdiplus_first->cbTotalEmfSize); /* cbTotalEmfSize (4 bytes) */
 
+	draw_gdiplus_first->emfRecords = Stream_Pointer(s);
+
 	return Stream_SafeSeek(s, draw_gdiplus_first->cbSize); /* emfRecords */
 }
 
 BOOL update_write_draw_gdiplus_first_order(wStream* s, DRAW_GDIPLUS_FIRST_ORDER* draw_gdiplus_first)
 {
+	Stream_EnsureRemainingCapacity(s, 11 + draw_gdiplus_first->cbSize);
+
+	Stream_Write_UINT8(s, 0); /* pad1Octet (1 byte) */
+	Stream_Write_UINT16(s, draw_gdiplus_first->cbSize); /* cbSize (2 bytes) */
+	Stream_Write_UINT32(s, draw_gdiplus_first->cbTotalSize); /* cbTotalSize (4 bytes) */
+	Stream_Write_UINT32(s, draw_gdiplus_first->cbTotalEmfSize); /* cbTotalEmfSize (4 bytes) */
+	Stream_Write(s, draw_gdiplus_first->emfRecords, draw_gdiplus_first->cbSize); /* emfRecords */
+
 	return TRUE;
 }
 
@@ -2808,12 +3596,19 @@ BOOL update_read_draw_gdiplus_next_order(wStream* s, DRAW_GDIPLUS_NEXT_ORDER* dr
 
 	Stream_Seek_UINT8(s); /* pad1Octet (1 byte) */
 	FIELD_SKIP_BUFFER16(s, draw_gdiplus_next->cbSize); /* cbSize(2 bytes) + emfRecords */
+	draw_gdiplus_next->emfRecords = Stream_Pointer(s) - draw_gdiplus_next->cbSize;
 
 	return TRUE;
 }
 
 BOOL update_write_draw_gdiplus_next_order(wStream* s, DRAW_GDIPLUS_NEXT_ORDER* draw_gdiplus_next)
 {
+	Stream_EnsureRemainingCapacity(s, 3 + draw_gdiplus_next->cbSize);
+
+	Stream_Write_UINT8(s, 0); /* pad1Octet (1 byte) */
+	Stream_Write_UINT16(s, draw_gdiplus_next->cbSize); /* cbSize (2 bytes) */
+	Stream_Write(s, draw_gdiplus_next->emfRecords, draw_gdiplus_next->cbSize); /* emfRecords */
+
 	return TRUE;
 }
 
@@ -2827,11 +3622,21 @@ BOOL update_read_draw_gdiplus_end_order(wStream* s, DRAW_GDIPLUS_END_ORDER* draw
 	Stream_Read_UINT32(s, draw_gdiplus_end->cbTotalSize); /* cbTotalSize (4 bytes) */
 	Stream_Read_UINT32(s, draw_gdiplus_end->cbTotalEmfSize); /* cbTotalEmfSize (4 bytes) */
 
+	draw_gdiplus_end->emfRecords = Stream_Pointer(s);
+
 	return Stream_SafeSeek(s, draw_gdiplus_end->cbSize); /* emfRecords */
 }
 
 BOOL update_write_draw_gdiplus_end_order(wStream* s, DRAW_GDIPLUS_END_ORDER* draw_gdiplus_end)
 {
+	Stream_EnsureRemainingCapacity(s, 11 + draw_gdiplus_end->cbSize);
+
+	Stream_Write_UINT8(s, 0); /* pad1Octet (1 byte) */
+	Stream_Write_UINT16(s, draw_gdiplus_end->cbSize); /* cbSize (2 bytes) */
+	Stream_Write_UINT32(s, draw_gdiplus_end->cbTotalSize); /* cbTotalSize (4 bytes) */
+	Stream_Write_UINT32(s, draw_gdiplus_end->cbTotalEmfSize); /* cbTotalEmfSize (4 bytes) */
+	Stream_Write(s, draw_gdiplus_end->emfRecords, draw_gdiplus_end->cbSize); /* emfRecords */
+
 	return TRUE;
 }
 
@@ -2846,11 +3651,22 @@ BOOL update_read_draw_gdiplus_cache_first_order(wStream* s, DRAW_GDIPLUS_CACHE_F
 	Stream_Read_UINT16(s, draw_gdiplus_cache_first->cbSize); /* cbSize (2 bytes) */
 	Stream_Read_UINT32(s, draw_gdiplus_cache_first->cbTotalSize); /* cbTotalSize (4 bytes) */
 
+	draw_gdiplus_cache_first->emfRecords = Stream_Pointer(s);
+
 	return Stream_SafeSeek(s, draw_gdiplus_cache_first->cbSize); /* emfRecords */
 }
 
 BOOL update_write_draw_gdiplus_cache_first_order(wStream* s, DRAW_GDIPLUS_CACHE_FIRST_ORDER* draw_gdiplus_cache_first)
 {
+	Stream_EnsureRemainingCapacity(s, 11 + draw_gdiplus_cache_first->cbSize);
+
+	Stream_Write_UINT8(s, draw_gdiplus_cache_first->flags); /* flags (1 byte) */
+	Stream_Write_UINT16(s, draw_gdiplus_cache_first->cacheType); /* cacheType (2 bytes) */
+	Stream_Write_UINT16(s, draw_gdiplus_cache_first->cacheIndex); /* cacheIndex (2 bytes) */
+	Stream_Write_UINT16(s, draw_gdiplus_cache_first->cbSize); /* cbSize (2 bytes) */
+	Stream_Write_UINT32(s, draw_gdiplus_cache_first->cbTotalSize); /* cbTotalSize (4 bytes) */
+	Stream_Write(s, draw_gdiplus_cache_first->emfRecords, draw_gdiplus_cache_first->cbSize); /* emfRecords */
+
 	return TRUE;
 }
 
@@ -2863,12 +3679,21 @@ BOOL update_read_draw_gdiplus_cache_next_order(wStream* s, DRAW_GDIPLUS_CACHE_NE
 	Stream_Read_UINT16(s, draw_gdiplus_cache_next->cacheType); /* cacheType (2 bytes) */
 	Stream_Read_UINT16(s, draw_gdiplus_cache_next->cacheIndex); /* cacheIndex (2 bytes) */
 	FIELD_SKIP_BUFFER16(s, draw_gdiplus_cache_next->cbSize); /* cbSize(2 bytes) + emfRecords */
+	draw_gdiplus_cache_next->emfRecords = Stream_Pointer(s) - draw_gdiplus_cache_next->cbSize;
 
 	return TRUE;
 }
 
 BOOL update_write_draw_gdiplus_cache_next_order(wStream* s, DRAW_GDIPLUS_CACHE_NEXT_ORDER* draw_gdiplus_cache_next)
 {
+	Stream_EnsureRemainingCapacity(s, 7 + draw_gdiplus_cache_next->cbSize);
+
+	Stream_Write_UINT8(s, draw_gdiplus_cache_next->flags); /* flags (1 byte) */
+	Stream_Write_UINT16(s, draw_gdiplus_cache_next->cacheType); /* cacheType (2 bytes) */
+	Stream_Write_UINT16(s, draw_gdiplus_cache_next->cacheIndex); /* cacheIndex (2 bytes) */
+	Stream_Write_UINT16(s, draw_gdiplus_cache_next->cbSize); /* cbSize (2 bytes) */
+	Stream_Write(s, draw_gdiplus_cache_next->emfRecords, draw_gdiplus_cache_next->cbSize); /* emfRecords */
+
 	return TRUE;
 }
 
@@ -2883,11 +3708,22 @@ BOOL update_read_draw_gdiplus_cache_end_order(wStream* s, DRAW_GDIPLUS_CACHE_END
 	Stream_Read_UINT16(s, draw_gdiplus_cache_end->cbSize); /* cbSize (2 bytes) */
 	Stream_Read_UINT32(s, draw_gdiplus_cache_end->cbTotalSize); /* cbTotalSize (4 bytes) */
 
+	draw_gdiplus_cache_end->emfRecords = Stream_Pointer(s);
+
 	return Stream_SafeSeek(s, draw_gdiplus_cache_end->cbSize); /* emfRecords */
 }
 
 BOOL update_write_draw_gdiplus_cache_end_order(wStream* s, DRAW_GDIPLUS_CACHE_END_ORDER* draw_gdiplus_cache_end)
 {
+	Stream_EnsureRemainingCapacity(s, 11 + draw_gdiplus_cache_end->cbSize);
+
+	Stream_Write_UINT8(s, draw_gdiplus_cache_end->flags); /* flags (1 byte) */
+	Stream_Write_UINT16(s, draw_gdiplus_cache_end->cacheType); /* cacheType (2 bytes) */
+	Stream_Write_UINT16(s, draw_gdiplus_cache_end->cacheIndex); /* cacheIndex (2 bytes) */
+	Stream_Write_UINT16(s, draw_gdiplus_cache_end->cbSize); /* cbSize (2 bytes) */
+	Stream_Write_UINT32(s, draw_gdiplus_cache_end->cbTotalSize); /* cbTotalSize (4 bytes) */
+	Stream_Write(s, draw_gdiplus_cache_end->emfRecords, draw_gdiplus_cache_end->cbSize); /* emfRecords */
+
 	return TRUE;
 }
 
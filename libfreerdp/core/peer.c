@@ -29,6 +29,7 @@
 #include "certificate.h"
 
 #include <freerdp/log.h>
+#include <freerdp/utils/profiler.h>
 
 #include "peer.h"
 
@@ -229,9 +230,20 @@ static BOOL freerdp_peer_initialize(freerdp_peer* client)
 
 static BOOL freerdp_peer_get_fds(freerdp_peer* client, void** rfds, int* rcount)
 {
-	rfds[*rcount] = (void*)(long)(client->context->rdp->transport->TcpIn->sockfd);
+	void* pfd;
+	rdpRdp* rdp = client->context->rdp;
+
+	rfds[*rcount] = (void*)(long)(rdp->transport->TcpIn->sockfd);
 	(*rcount)++;
 
+	pfd = GetEventWaitObject(heartbeat_get_event_handle(rdp->heartbeat));
+
+	if (pfd)
+	{
+		rfds[*rcount] = pfd;
+		(*rcount)++;
+	}
+
 	return TRUE;
 }
 
@@ -240,6 +252,21 @@ static HANDLE freerdp_peer_get_event_handle(freerdp_peer* client)
 	return client->context->rdp->transport->TcpIn->event;
 }
 
+/**
+ * The handles CheckFileDescriptor services: the socket and the heartbeat timer.
+ */
+
+static DWORD freerdp_peer_get_event_handles(freerdp_peer* client, HANDLE* events)
+{
+	DWORD nCount = 0;
+	rdpRdp* rdp = client->context->rdp;
+
+	events[nCount++] = rdp->transport->TcpIn->event;
+	events[nCount++] = heartbeat_get_event_handle(rdp->heartbeat);
+
+	return nCount;
+}
+
 static BOOL freerdp_peer_check_fds(freerdp_peer* peer)
 {
 	int status;
@@ -249,6 +276,9 @@ static BOOL freerdp_peer_check_fds(freerdp_peer* peer)
 
 	status = rdp_check_fds(rdp);
 
+	if (status >= 0)
+		status = heartbeat_check(rdp);
+
 	if (status < 0)
 		return FALSE;
 
@@ -445,6 +475,8 @@ static int peer_recv_callback(rdpTransport* transport, wStream* s, void* extra)
 	freerdp_peer* client = (freerdp_peer*) extra;
 	rdpRdp* rdp = client->context->rdp;
 
+	heartbeat_activity(rdp->heartbeat);
+
 	switch (rdp->state)
 	{
 		case CONNECTION_STATE_INITIAL:
@@ -604,6 +636,22 @@ static int freerdp_peer_drain_output_buffer(freerdp_peer* peer)
 	return tranport_drain_output_buffer(transport);
 }
 
+/**
+ * Sends an Initiate Multitransport Request for protocol (TRANSPORT_TYPE_UDP_FECR
+ * or TRANSPORT_TYPE_UDP_FECL); the client answers by connecting a tunnel to the
+ * UDP port opened by the OpenMultitransport() function of the listener.
+ */
+
+BOOL freerdp_peer_initiate_multitransport(freerdp_peer* client, UINT16 protocol)
+{
+	rdpRdp* rdp = client->context->rdp;
+
+	if (!rdp->settings->SupportMultitransport)
+		return FALSE;
+
+	return rdp_send_multitransport_request(rdp, protocol);
+}
+
 void freerdp_peer_context_new(freerdp_peer* client)
 {
 	rdpRdp* rdp;
@@ -612,6 +660,8 @@ void freerdp_peer_context_new(freerdp_peer* client)
 
 	client->context->ServerMode = TRUE;
 
+	profiler_init();
+
 	client->context->metrics = metrics_new(client->context);
 
 	rdp = rdp_new(client->context);
@@ -677,6 +727,7 @@ freerdp_peer* freerdp_peer_new(int sockfd)
 		client->Initialize = freerdp_peer_initialize;
 		client->GetFileDescriptor = freerdp_peer_get_fds;
 		client->GetEventHandle = freerdp_peer_get_event_handle;
+		client->GetEventHandles = freerdp_peer_get_event_handles;
 		client->CheckFileDescriptor = freerdp_peer_check_fds;
 		client->Close = freerdp_peer_close;
 		client->Disconnect = freerdp_peer_disconnect;
@@ -699,7 +750,11 @@ void freerdp_peer_free(freerdp_peer* client)
 	if (!client)
 		return;
 
-	rdp_free(client->context->rdp);
-	free(client->context);
+	if (client->context)
+	{
+		rdp_free(client->context->rdp);
+		free(client->context);
+	}
+
 	free(client);
 }
@@ -888,6 +888,12 @@ int rdp_recv_message_channel_pdu(rdpRdp* rdp, wStream* s)
 		return rdp_recv_multitransport_packet(rdp, s);
 	}
 
+	if (securityFlags & SEC_TRANSPORT_RSP)
+	{
+		/* Initiate Multitransport Response PDU */
+		return rdp_recv_multitransport_response(rdp, s);
+	}
+
 	return -1;
 }
 
@@ -1377,7 +1383,7 @@ rdpRdp* rdp_new(rdpContext* context)
 	if (!rdp->heartbeat)
 		goto out_free_autodetect;
 
-	rdp->multitransport = multitransport_new();
+	rdp->multitransport = multitransport_new(rdp);
 	if (!rdp->multitransport)
 		goto out_free_heartbeat;
 
@@ -0,0 +1,1449 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * UDP Transport Extension (MS-RDPEUDP)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+#include <winpr/thread.h>
+#include <winpr/sysinfo.h>
+
+#include <freerdp/log.h>
+#include <freerdp/crypto/crypto.h>
+
+#ifndef _WIN32
+#include <netdb.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#endif
+
+#include "rdpudp.h"
+
+#define TAG FREERDP_TAG("core.rdpudp")
+
+#define SEQ_LT(_a, _b)		(((INT32) ((_a) - (_b))) < 0)
+#define SEQ_LE(_a, _b)		(((INT32) ((_a) - (_b))) <= 0)
+#define SEQ_GT(_a, _b)		(((INT32) ((_a) - (_b))) > 0)
+#define SEQ_GE(_a, _b)		(((INT32) ((_a) - (_b))) >= 0)
+
+#define RDPUDP_SLOT(_seq)	((_seq) % RDPUDP_WINDOW_SIZE)
+
+/**
+ * The transport follows MS-RDPEUDP for the datagram layouts, all fields in
+ * network byte order: an RDPUDP_FEC_HEADER, then the SYN data, the ACK
+ * vector and the source payload when the matching flags are set.
+ *
+ * The ACK vector describes the datagrams following the cumulative
+ * snSourceAck, as runs of received and not yet received datagrams.
+ * The sender retransmits on timeout or after three ACK vectors showing
+ * later datagrams received (reliable mode), or gives the datagram up
+ * (lossy mode), and announces the oldest datagram it still has in flight
+ * in snCoveredSeq so that the receiver of a lossy connection can move on.
+ * Both modes use the same window based congestion control: slow start,
+ * then one datagram per window, and half the window on loss.
+ */
+
+static void rdpudp_set_state(rdpUdp* udp, int state)
+{
+	if (udp->state == state)
+		return;
+
+	udp->state = state;
+
+	if ((state == RDPUDP_STATE_ESTABLISHED) || (state == RDPUDP_STATE_FAILED) ||
+			(state == RDPUDP_STATE_CLOSED))
+		SetEvent(udp->connectEvent);
+}
+
+static int rdpudp_send(rdpUdp* udp, const BYTE* data, int length)
+{
+	int status;
+
+	if (udp->ownSocket)
+		status = send(udp->sockfd, (const char*) data, length, 0);
+	else
+		status = sendto(udp->sockfd, (const char*) data, length, 0,
+				(struct sockaddr*) &udp->peerAddress, udp->peerAddressLength);
+
+	if (status < 0)
+	{
+		WLog_DBG(TAG, "send: %s", strerror(errno));
+		return -1;
+	}
+
+	udp->DatagramsSent++;
+
+	return status;
+}
+
+static void rdpudp_write_fec_header(rdpUdp* udp, wStream* s, UINT32 snSourceAck, UINT16 uFlags)
+{
+	Stream_Write_UINT32_BE(s, snSourceAck); /* snSourceAck (4 bytes) */
+	Stream_Write_UINT16_BE(s, RDPUDP_WINDOW_SIZE); /* uReceiveWindowSize (2 bytes) */
+	Stream_Write_UINT16_BE(s, uFlags); /* uFlags (2 bytes) */
+}
+
+static int rdpudp_send_syn(rdpUdp* udp)
+{
+	int status;
+	UINT16 uFlags;
+	UINT32 snSourceAck;
+	BYTE buffer[RDPUDP_MTU];
+	wStream* s;
+
+	ZeroMemory(buffer, sizeof(buffer));
+	s = Stream_New(buffer, sizeof(buffer));
+
+	if (!s)
+		return -1;
+
+	uFlags = RDPUDP_FLAG_SYN;
+
+	if (udp->lossy)
+		uFlags |= RDPUDP_FLAG_SYNLOSSY;
+
+	if (udp->server)
+	{
+		uFlags |= RDPUDP_FLAG_ACK;
+		snSourceAck = udp->remoteInitialSequence;
+	}
+	else
+	{
+		snSourceAck = 0xFFFFFFFF;
+	}
+
+	rdpudp_write_fec_header(udp, s, snSourceAck, uFlags);
+
+	Stream_Write_UINT32_BE(s, udp->localInitialSequence); /* snInitialSequenceNumber (4 bytes) */
+	Stream_Write_UINT16_BE(s, RDPUDP_MTU); /* uUpStreamMtu (2 bytes) */
+	Stream_Write_UINT16_BE(s, RDPUDP_MTU); /* uDownStreamMtu (2 bytes) */
+
+	/* SYN datagrams are padded to the MTU */
+	status = rdpudp_send(udp, buffer, sizeof(buffer));
+
+	Stream_Free(s, FALSE);
+
+	udp->synTime = GetTickCount();
+
+	return status;
+}
+
+static void rdpudp_write_ack_vector(rdpUdp* udp, wStream* s)
+{
+	int run;
+	int count = 0;
+	BOOL state;
+	UINT32 seq;
+	BYTE elements[RDPUDP_MAX_ACK_VECTOR_SIZE];
+
+	seq = udp->receiveBase;
+
+	while (SEQ_LE(seq, udp->highestReceived) && (count < RDPUDP_MAX_ACK_VECTOR_SIZE))
+	{
+		state = udp->received[RDPUDP_SLOT(seq)];
+
+		for (run = 1; (run < 64) && SEQ_LE(seq + run, udp->highestReceived); run++)
+		{
+			if (udp->received[RDPUDP_SLOT(seq + run)] != state)
+				break;
+		}
+
+		elements[count++] = ((state ? DATAGRAM_RECEIVED : DATAGRAM_NOT_YET_RECEIVED) << 6) | (run - 1);
+		seq += run;
+	}
+
+	Stream_Write_UINT16_BE(s, count); /* uAckVectorSize (2 bytes) */
+	Stream_Write(s, elements, count); /* AckVectorElement (variable) */
+	Stream_Zero(s, (4 - ((2 + count) % 4)) % 4); /* padding */
+}
+
+static int rdpudp_send_datagram(rdpUdp* udp, rdpUdpDatagram* datagram)
+{
+	int status;
+	UINT16 uFlags;
+	BYTE buffer[RDPUDP_MTU];
+	wStream* s;
+
+	s = Stream_New(buffer, sizeof(buffer));
+
+	if (!s)
+		return -1;
+
+	uFlags = RDPUDP_FLAG_ACK;
+
+	if (datagram)
+		uFlags |= RDPUDP_FLAG_DATA;
+
+	rdpudp_write_fec_header(udp, s, udp->receiveBase - 1, uFlags);
+	rdpudp_write_ack_vector(udp, s);
+
+	if (datagram)
+	{
+		Stream_Write_UINT32_BE(s, udp->sendBase); /* snCoveredSeq (4 bytes) */
+		Stream_Write_UINT32_BE(s, datagram->sequenceNumber); /* snSourceStart (4 bytes) */
+		Stream_Write(s, datagram->data, datagram->length);
+
+		datagram->sentTime = GetTickCount();
+		datagram->transmissions++;
+		datagram->missingReports = 0;
+	}
+
+	status = rdpudp_send(udp, buffer, (int) Stream_GetPosition(s));
+
+	udp->ackPending = FALSE;
+
+	Stream_Free(s, FALSE);
+
+	return status;
+}
+
+static void rdpudp_update_rtt(rdpUdp* udp, UINT32 rtt)
+{
+	UINT32 delta;
+
+	if (!udp->srtt)
+	{
+		udp->srtt = rtt ? rtt : 1;
+		udp->rttvar = rtt / 2;
+	}
+	else
+	{
+		delta = (udp->srtt > rtt) ? (udp->srtt - rtt) : (rtt - udp->srtt);
+		udp->rttvar = ((3 * udp->rttvar) + delta) / 4;
+		udp->srtt = ((7 * udp->srtt) + rtt) / 8;
+	}
+
+	udp->rto = udp->srtt + MAX(1, 4 * udp->rttvar);
+	udp->rto = MAX(udp->rto, RDPUDP_MIN_RTO);
+	udp->rto = MIN(udp->rto, RDPUDP_MAX_RTO);
+}
+
+static void rdpudp_congestion_event(rdpUdp* udp)
+{
+	UINT32 inflight;
+
+	/* one reaction per window of data */
+	if (udp->inRecovery && SEQ_LE(udp->sendBase, udp->recoverySequence))
+		return;
+
+	inflight = udp->nextSequence - udp->sendBase;
+	udp->ssthresh = MAX(inflight / 2, 2);
+	udp->cwnd = udp->ssthresh;
+	udp->cwndCounter = 0;
+	udp->inRecovery = TRUE;
+	udp->recoverySequence = udp->nextSequence - 1;
+}
+
+static void rdpudp_datagram_done(rdpUdp* udp, rdpUdpDatagram* datagram, BOOL acknowledged)
+{
+	UINT32 now = GetTickCount();
+
+	if (acknowledged)
+	{
+		/* Karn: only the datagrams sent once give a round trip time */
+		if (datagram->transmissions == 1)
+			rdpudp_update_rtt(udp, now - datagram->sentTime);
+
+		if (udp->cwnd < udp->ssthresh)
+		{
+			udp->cwnd++;
+		}
+		else if (++udp->cwndCounter >= udp->cwnd)
+		{
+			udp->cwnd++;
+			udp->cwndCounter = 0;
+		}
+
+		udp->cwnd = MIN(udp->cwnd, RDPUDP_WINDOW_SIZE);
+	}
+	else
+	{
+		udp->DatagramsLost++;
+	}
+
+	free(datagram->data);
+	datagram->data = NULL;
+	datagram->acknowledged = TRUE;
+}
+
+static void rdpudp_advance_send_base(rdpUdp* udp)
+{
+	rdpUdpDatagram* datagram;
+
+	while (SEQ_LT(udp->sendBase, udp->nextSequence))
+	{
+		datagram = &udp->window[RDPUDP_SLOT(udp->sendBase)];
+
+		if (!datagram->acknowledged)
+			break;
+
+		ZeroMemory(datagram, sizeof(rdpUdpDatagram));
+		udp->sendBase++;
+	}
+
+	if (udp->inRecovery && SEQ_GT(udp->sendBase, udp->recoverySequence))
+		udp->inRecovery = FALSE;
+}
+
+static rdpUdpDatagram* rdpudp_get_datagram(rdpUdp* udp, UINT32 seq)
+{
+	rdpUdpDatagram* datagram;
+
+	if (SEQ_LT(seq, udp->sendBase) || SEQ_GE(seq, udp->nextSequence))
+		return NULL;
+
+	datagram = &udp->window[RDPUDP_SLOT(seq)];
+
+	if (datagram->acknowledged || (datagram->sequenceNumber != seq))
+		return NULL;
+
+	return datagram;
+}
+
+static BOOL rdpudp_process_ack(rdpUdp* udp, UINT32 snSourceAck, const BYTE* elements, int count)
+{
+	int i, j;
+	int run;
+	int state;
+	UINT32 seq;
+	UINT32 highest;
+	BOOL loss = FALSE;
+	rdpUdpDatagram* datagram;
+
+	/* cumulative part */
+	for (seq = udp->sendBase; SEQ_LE(seq, snSourceAck) && SEQ_LT(seq, udp->nextSequence); seq++)
+	{
+		datagram = rdpudp_get_datagram(udp, seq);
+
+		if (datagram)
+			rdpudp_datagram_done(udp, datagram, TRUE);
+	}
+
+	/* the last datagram the vector reports as received */
+	for (i = 0, highest = snSourceAck, seq = snSourceAck + 1; i < count; i++)
+	{
+		run = (elements[i] & 0x3F) + 1;
+		seq += run;
+
+		if ((elements[i] >> 6) == DATAGRAM_RECEIVED)
+			highest = seq - 1;
+	}
+
+	for (i = 0, seq = snSourceAck + 1; i < count; i++)
+	{
+		state = elements[i] >> 6;
+		run = (elements[i] & 0x3F) + 1;
+
+		for (j = 0; j < run; j++, seq++)
+		{
+			datagram = rdpudp_get_datagram(udp, seq);
+
+			if (!datagram)
+				continue;
+
+			if (state == DATAGRAM_RECEIVED)
+			{
+				rdpudp_datagram_done(udp, datagram, TRUE);
+			}
+			else if (SEQ_LT(seq, highest) && (++datagram->missingReports >= RDPUDP_DUPACK_THRESHOLD))
+			{
+				loss = TRUE;
+
+				if (udp->lossy)
+				{
+					rdpudp_datagram_done(udp, datagram, FALSE);
+				}
+				else
+				{
+					udp->Retransmissions++;
+					rdpudp_send_datagram(udp, datagram);
+				}
+			}
+		}
+	}
+
+	if (loss)
+		rdpudp_congestion_event(udp);
+
+	rdpudp_advance_send_base(udp);
+
+	return TRUE;
+}
+
+/**
+ * The received data is handed to the callback by the connection thread once
+ * it has released the lock, so that the callback may write.
+ */
+
+static BOOL rdpudp_deliver(rdpUdp* udp, const BYTE* data, int length)
+{
+	wStream* s;
+
+	if (length < 1)
+		return TRUE;
+
+	s = Stream_New(NULL, length);
+
+	if (!s)
+		return FALSE;
+
+	Stream_Write(s, data, length);
+	Stream_SealLength(s);
+
+	return Queue_Enqueue(udp->deliveries, s);
+}
+
+static BOOL rdpudp_process_data(rdpUdp* udp, UINT32 snCoveredSeq, UINT32 snSourceStart,
+		const BYTE* data, int length)
+{
+	UINT32 slot;
+	UINT32 index;
+	UINT32 count;
+	UINT32 coveredSeq;
+	wStream* payload;
+
+	udp->ackPending = TRUE;
+
+	/* the sender gave up the datagrams before snCoveredSeq, up to this one: both come */
+	/* from the peer, so jump there directly and clear no more slots than the window */
+	if (udp->lossy)
+	{
+		coveredSeq = SEQ_LT(snCoveredSeq, snSourceStart + 1) ? snCoveredSeq : snSourceStart + 1;
+
+		if (SEQ_GT(coveredSeq, udp->receiveBase))
+		{
+			count = coveredSeq - udp->receiveBase;
+
+			if (count > RDPUDP_WINDOW_SIZE)
+				count = RDPUDP_WINDOW_SIZE;
+
+			for (index = 0; index < count; index++)
+				udp->received[RDPUDP_SLOT(udp->receiveBase + index)] = FALSE;
+
+			udp->receiveBase = coveredSeq;
+		}
+
+		if (SEQ_LT(udp->highestReceived, udp->receiveBase - 1))
+			udp->highestReceived = udp->receiveBase - 1;
+	}
+
+	if (SEQ_LT(snSourceStart, udp->receiveBase))
+	{
+		udp->Duplicates++;
+		return TRUE;
+	}
+
+	if ((snSourceStart - udp->receiveBase) >= RDPUDP_WINDOW_SIZE)
+		return TRUE;
+
+	slot = RDPUDP_SLOT(snSourceStart);
+
+	if (udp->received[slot])
+	{
+		udp->Duplicates++;
+		return TRUE;
+	}
+
+	udp->received[slot] = TRUE;
+	udp->DatagramsReceived++;
+
+	if (SEQ_GT(snSourceStart, udp->highestReceived))
+		udp->highestReceived = snSourceStart;
+
+	if (udp->lossy)
+	{
+		if (!rdpudp_deliver(udp, data, length))
+			return FALSE;
+	}
+	else
+	{
+		payload = Stream_New(NULL, length ? length : 1);
+
+		if (!payload)
+			return FALSE;
+
+		Stream_Write(payload, data, length);
+		Stream_SealLength(payload);
+		udp->reorder[slot] = payload;
+	}
+
+	while (udp->received[RDPUDP_SLOT(udp->receiveBase)])
+	{
+		slot = RDPUDP_SLOT(udp->receiveBase);
+		payload = udp->reorder[slot];
+
+		if (payload)
+		{
+			if (Stream_Length(payload) > 0)
+				Queue_Enqueue(udp->deliveries, payload);
+			else
+				Stream_Free(payload, TRUE);
+
+			udp->reorder[slot] = NULL;
+		}
+
+		udp->received[slot] = FALSE;
+		udp->receiveBase++;
+	}
+
+	return TRUE;
+}
+
+static BOOL rdpudp_process_syn(rdpUdp* udp, wStream* s, UINT32 snSourceAck, UINT16 uFlags)
+{
+	UINT32 snInitialSequenceNumber;
+	UINT16 uUpStreamMtu;
+	UINT16 uDownStreamMtu;
+
+	if (Stream_GetRemainingLength(s) < RDPUDP_SYNDATA_PAYLOAD_LENGTH)
+		return FALSE;
+
+	Stream_Read_UINT32_BE(s, snInitialSequenceNumber); /* snInitialSequenceNumber (4 bytes) */
+	Stream_Read_UINT16_BE(s, uUpStreamMtu); /* uUpStreamMtu (2 bytes) */
+	Stream_Read_UINT16_BE(s, uDownStreamMtu); /* uDownStreamMtu (2 bytes) */
+
+	if ((uUpStreamMtu < RDPUDP_MTU) || (uDownStreamMtu < RDPUDP_MTU))
+	{
+		WLog_ERR(TAG, "unsupported MTU %d/%d", uUpStreamMtu, uDownStreamMtu);
+		return FALSE;
+	}
+
+	if (udp->server)
+	{
+		if (udp->state == RDPUDP_STATE_SYN_RECEIVED)
+		{
+			/* our SYN+ACK was lost */
+			rdpudp_send_syn(udp);
+			return TRUE;
+		}
+
+		if (udp->state != RDPUDP_STATE_CLOSED)
+			return TRUE;
+
+		udp->lossy = (uFlags & RDPUDP_FLAG_SYNLOSSY) ? TRUE : FALSE;
+		udp->remoteInitialSequence = snInitialSequenceNumber;
+		udp->receiveBase = snInitialSequenceNumber + 1;
+		udp->highestReceived = snInitialSequenceNumber;
+
+		rdpudp_set_state(udp, RDPUDP_STATE_SYN_RECEIVED);
+		rdpudp_send_syn(udp);
+
+		return TRUE;
+	}
+
+	if ((udp->state != RDPUDP_STATE_SYN_SENT) || !(uFlags & RDPUDP_FLAG_ACK) ||
+			(snSourceAck != udp->localInitialSequence))
+		return TRUE;
+
+	udp->remoteInitialSequence = snInitialSequenceNumber;
+	udp->receiveBase = snInitialSequenceNumber + 1;
+	udp->highestReceived = snInitialSequenceNumber;
+	udp->rto = RDPUDP_INITIAL_RTO;
+
+	rdpudp_send_datagram(udp, NULL);
+	rdpudp_set_state(udp, RDPUDP_STATE_ESTABLISHED);
+
+	return TRUE;
+}
+
+static BOOL rdpudp_process_datagram(rdpUdp* udp, const BYTE* data, int length)
+{
+	BOOL status = TRUE;
+	UINT32 snSourceAck;
+	UINT16 uReceiveWindowSize;
+	UINT16 uFlags;
+	UINT16 uAckVectorSize;
+	UINT32 snCoveredSeq;
+	UINT32 snSourceStart;
+	const BYTE* elements;
+	wStream* s;
+
+	if (length < RDPUDP_FEC_HEADER_LENGTH)
+		return FALSE;
+
+	s = Stream_New((BYTE*) data, length);
+
+	if (!s)
+		return FALSE;
+
+	Stream_Read_UINT32_BE(s, snSourceAck); /* snSourceAck (4 bytes) */
+	Stream_Read_UINT16_BE(s, uReceiveWindowSize); /* uReceiveWindowSize (2 bytes) */
+	Stream_Read_UINT16_BE(s, uFlags); /* uFlags (2 bytes) */
+
+	if (uFlags & RDPUDP_FLAG_SYN)
+	{
+		udp->remoteWindow = uReceiveWindowSize;
+		status = rdpudp_process_syn(udp, s, snSourceAck, uFlags);
+		goto out;
+	}
+
+	if (uFlags & RDPUDP_FLAG_FIN)
+	{
+		if (udp->state == RDPUDP_STATE_ESTABLISHED)
+			rdpudp_set_state(udp, RDPUDP_STATE_CLOSED);
+
+		goto out;
+	}
+
+	if (udp->server && (udp->state == RDPUDP_STATE_SYN_RECEIVED) && (uFlags & RDPUDP_FLAG_ACK))
+	{
+		udp->rto = RDPUDP_INITIAL_RTO;
+		rdpudp_set_state(udp, RDPUDP_STATE_ESTABLISHED);
+	}
+
+	if (udp->state != RDPUDP_STATE_ESTABLISHED)
+		goto out;
+
+	udp->remoteWindow = uReceiveWindowSize;
+
+	if (uFlags & RDPUDP_FLAG_ACK)
+	{
+		if (Stream_GetRemainingLength(s) < 2)
+		{
+			status = FALSE;
+			goto out;
+		}
+
+		Stream_Read_UINT16_BE(s, uAckVectorSize); /* uAckVectorSize (2 bytes) */
+
+		if ((uAckVectorSize > RDPUDP_MAX_ACK_VECTOR_SIZE) ||
+				(Stream_GetRemainingLength(s) < (size_t) (uAckVectorSize + ((4 - ((2 + uAckVectorSize) % 4)) % 4))))
+		{
+			status = FALSE;
+			goto out;
+		}
+
+		elements = Stream_Pointer(s);
+		Stream_Seek(s, uAckVectorSize + ((4 - ((2 + uAckVectorSize) % 4)) % 4));
+
+		rdpudp_process_ack(udp, snSourceAck, elements, uAckVectorSize);
+	}
+
+	if (uFlags & RDPUDP_FLAG_DATA)
+	{
+		if (Stream_GetRemainingLength(s) < RDPUDP_SOURCE_PAYLOAD_HEADER_LENGTH)
+		{
+			status = FALSE;
+			goto out;
+		}
+
+		Stream_Read_UINT32_BE(s, snCoveredSeq); /* snCoveredSeq (4 bytes) */
+		Stream_Read_UINT32_BE(s, snSourceStart); /* snSourceStart (4 bytes) */
+
+		status = rdpudp_process_data(udp, snCoveredSeq, snSourceStart,
+				Stream_Pointer(s), (int) Stream_GetRemainingLength(s));
+	}
+
+out:
+	Stream_Free(s, FALSE);
+
+	return status;
+}
+
+static void rdpudp_flush(rdpUdp* udp)
+{
+	UINT32 seq;
+	UINT32 limit;
+	UINT32 outstanding = 0;
+	wStream* s;
+	rdpUdpDatagram* datagram;
+
+	if (udp->state != RDPUDP_STATE_ESTABLISHED)
+		return;
+
+	/**
+	 * The congestion window bounds the datagrams still in the network, the
+	 * ones the ACK vector reported are not, even behind a hole.
+	 */
+	for (seq = udp->sendBase; SEQ_LT(seq, udp->nextSequence); seq++)
+	{
+		if (!udp->window[RDPUDP_SLOT(seq)].acknowledged)
+			outstanding++;
+	}
+
+	limit = MIN(udp->remoteWindow, RDPUDP_WINDOW_SIZE);
+
+	while (((udp->nextSequence - udp->sendBase) < limit) && (outstanding < udp->cwnd) &&
+			(Queue_Count(udp->sendQueue) > 0))
+	{
+		s = (wStream*) Queue_Dequeue(udp->sendQueue);
+
+		seq = udp->nextSequence++;
+		datagram = &udp->window[RDPUDP_SLOT(seq)];
+
+		ZeroMemory(datagram, sizeof(rdpUdpDatagram));
+		datagram->sequenceNumber = seq;
+		datagram->length = (int) Stream_Length(s);
+		datagram->data = Stream_Buffer(s);
+		Stream_Free(s, FALSE);
+
+		rdpudp_send_datagram(udp, datagram);
+		outstanding++;
+	}
+
+	if (udp->ackPending)
+		rdpudp_send_datagram(udp, NULL);
+}
+
+static void rdpudp_check_timers(rdpUdp* udp)
+{
+	UINT32 seq;
+	BOOL expired = FALSE;
+	UINT32 now = GetTickCount();
+	rdpUdpDatagram* datagram;
+
+	if ((udp->state == RDPUDP_STATE_SYN_SENT) || (udp->state == RDPUDP_STATE_SYN_RECEIVED))
+	{
+		if ((now - udp->synTime) < udp->rto)
+			return;
+
+		if (++udp->synRetries > RDPUDP_SYN_RETRIES)
+		{
+			WLog_DBG(TAG, "no answer to the SYN datagram");
+			rdpudp_set_state(udp, RDPUDP_STATE_FAILED);
+			return;
+		}
+
+		udp->rto = MIN(udp->rto * 2, RDPUDP_MAX_RTO);
+		rdpudp_send_syn(udp);
+		return;
+	}
+
+	if (udp->state != RDPUDP_STATE_ESTABLISHED)
+		return;
+
+	for (seq = udp->sendBase; SEQ_LT(seq, udp->nextSequence); seq++)
+	{
+		datagram = rdpudp_get_datagram(udp, seq);
+
+		if (!datagram || ((now - datagram->sentTime) < udp->rto))
+			continue;
+
+		if (!expired)
+		{
+			rdpudp_congestion_event(udp);
+			expired = TRUE;
+		}
+
+		if (udp->lossy)
+		{
+			rdpudp_datagram_done(udp, datagram, FALSE);
+			continue;
+		}
+
+		if (datagram->transmissions > RDPUDP_MAX_RETRANSMISSIONS)
+		{
+			WLog_ERR(TAG, "datagram %u not acknowledged after %d transmissions",
+					datagram->sequenceNumber, datagram->transmissions);
+			rdpudp_set_state(udp, RDPUDP_STATE_FAILED);
+			return;
+		}
+
+		udp->Retransmissions++;
+		rdpudp_send_datagram(udp, datagram);
+	}
+
+	if (expired && !udp->lossy)
+	{
+		/* nothing came back for a whole timeout: start over from one datagram */
+		udp->rto = MIN(udp->rto * 2, RDPUDP_MAX_RTO);
+		udp->cwnd = 1;
+		udp->cwndCounter = 0;
+	}
+
+	rdpudp_advance_send_base(udp);
+}
+
+static DWORD rdpudp_get_timeout(rdpUdp* udp)
+{
+	UINT32 seq;
+	UINT32 elapsed;
+	UINT32 oldest = 0;
+	BOOL pending = FALSE;
+	UINT32 now = GetTickCount();
+	rdpUdpDatagram* datagram;
+
+	if ((udp->state == RDPUDP_STATE_SYN_SENT) || (udp->state == RDPUDP_STATE_SYN_RECEIVED))
+	{
+		elapsed = now - udp->synTime;
+		return (elapsed < udp->rto) ? (udp->rto - elapsed) : 0;
+	}
+
+	if (udp->state != RDPUDP_STATE_ESTABLISHED)
+		return INFINITE;
+
+	for (seq = udp->sendBase; SEQ_LT(seq, udp->nextSequence); seq++)
+	{
+		datagram = rdpudp_get_datagram(udp, seq);
+
+		if (datagram && (!pending || SEQ_LT(datagram->sentTime, oldest)))
+		{
+			oldest = datagram->sentTime;
+			pending = TRUE;
+		}
+	}
+
+	if (!pending)
+		return INFINITE;
+
+	elapsed = now - oldest;
+
+	return (elapsed < udp->rto) ? (udp->rto - elapsed) : 0;
+}
+
+/**
+ * Called by the connection thread without the lock held: the listener
+ * accepted callback first, so that it can set the other callbacks.
+ */
+
+static void rdpudp_dispatch(rdpUdp* udp, int previousState, int state)
+{
+	wStream* s;
+	rdpUdpListener* listener = udp->listener;
+
+	if (state != previousState)
+	{
+		if (udp->server && (state == RDPUDP_STATE_ESTABLISHED) && listener && listener->Accepted)
+			listener->Accepted(listener, udp, listener->param);
+
+		if (udp->StateChange)
+			udp->StateChange(udp, state, udp->param);
+	}
+
+	while ((s = (wStream*) Queue_Dequeue(udp->deliveries)))
+	{
+		if (udp->Receive)
+			udp->Receive(udp, Stream_Buffer(s), (int) Stream_Length(s), udp->param);
+
+		Stream_Free(s, TRUE);
+	}
+}
+
+static void* rdpudp_thread(void* arg)
+{
+	int status;
+	int state;
+	int previousState;
+	DWORD nCount;
+	DWORD timeout;
+	HANDLE events[2];
+	wMessage message;
+	BYTE buffer[RDPUDP_MTU];
+	rdpUdp* udp = (rdpUdp*) arg;
+
+	nCount = 0;
+	events[nCount++] = udp->stopEvent;
+	events[nCount++] = udp->ownSocket ? udp->socketEvent : MessageQueue_Event(udp->input);
+
+	while (1)
+	{
+		EnterCriticalSection(&udp->lock);
+		timeout = rdpudp_get_timeout(udp);
+		LeaveCriticalSection(&udp->lock);
+
+		WaitForMultipleObjects(nCount, events, FALSE, timeout);
+
+		if (WaitForSingleObject(udp->stopEvent, 0) == WAIT_OBJECT_0)
+			break;
+
+		EnterCriticalSection(&udp->lock);
+
+		previousState = udp->state;
+
+		if (udp->ownSocket)
+		{
+			while ((status = recv(udp->sockfd, (char*) buffer, sizeof(buffer), 0)) > 0)
+				rdpudp_process_datagram(udp, buffer, status);
+		}
+		else
+		{
+			while (MessageQueue_Peek(udp->input, &message, TRUE))
+			{
+				rdpudp_process_datagram(udp, (BYTE*) message.wParam, (int) (size_t) message.lParam);
+				free(message.wParam);
+			}
+		}
+
+		rdpudp_check_timers(udp);
+		rdpudp_flush(udp);
+
+		state = udp->state;
+
+		LeaveCriticalSection(&udp->lock);
+
+		rdpudp_dispatch(udp, previousState, state);
+	}
+
+	ExitThread(0);
+	return NULL;
+}
+
+static BOOL rdpudp_start(rdpUdp* udp)
+{
+	udp->thread = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE) rdpudp_thread, (void*) udp, 0, NULL);
+
+	return udp->thread ? TRUE : FALSE;
+}
+
+static BOOL rdpudp_set_nonblocking(int sockfd)
+{
+#ifndef _WIN32
+	int flags = fcntl(sockfd, F_GETFL);
+
+	if (flags == -1)
+		return FALSE;
+
+	return (fcntl(sockfd, F_SETFL, flags | O_NONBLOCK) != -1) ? TRUE : FALSE;
+#else
+	u_long arg = 1;
+
+	return (ioctlsocket(sockfd, FIONBIO, &arg) == 0) ? TRUE : FALSE;
+#endif
+}
+
+/**
+ * Connects to a server, waiting at most timeout milliseconds for the
+ * handshake to complete.
+ */
+
+BOOL rdpudp_connect(rdpUdp* udp, const char* hostname, UINT16 port, DWORD timeout)
+{
+	int status;
+	char servname[16];
+	struct addrinfo* ai;
+	struct addrinfo* result;
+	struct addrinfo hints = { 0 };
+
+	if (udp->state != RDPUDP_STATE_CLOSED)
+		return FALSE;
+
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_DGRAM;
+
+	sprintf_s(servname, sizeof(servname), "%d", port);
+	status = getaddrinfo(hostname, servname, &hints, &result);
+
+	if (status != 0)
+	{
+		WLog_ERR(TAG, "getaddrinfo: %s", gai_strerror(status));
+		return FALSE;
+	}
+
+	for (ai = result; ai; ai = ai->ai_next)
+	{
+		udp->sockfd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+
+		if (udp->sockfd < 0)
+			continue;
+
+		if (connect(udp->sockfd, ai->ai_addr, ai->ai_addrlen) == 0)
+		{
+			CopyMemory(&udp->peerAddress, ai->ai_addr, ai->ai_addrlen);
+			udp->peerAddressLength = ai->ai_addrlen;
+			break;
+		}
+
+		closesocket(udp->sockfd);
+		udp->sockfd = -1;
+	}
+
+	freeaddrinfo(result);
+
+	if (udp->sockfd < 0)
+	{
+		WLog_ERR(TAG, "unable to connect to %s:%d", hostname, port);
+		return FALSE;
+	}
+
+	udp->ownSocket = TRUE;
+	rdpudp_set_nonblocking(udp->sockfd);
+	udp->socketEvent = CreateFileDescriptorEvent(NULL, FALSE, FALSE, udp->sockfd);
+
+	if (!udp->socketEvent)
+		return FALSE;
+
+	EnterCriticalSection(&udp->lock);
+	udp->rto = RDPUDP_INITIAL_RTO;
+	rdpudp_set_state(udp, RDPUDP_STATE_SYN_SENT);
+	rdpudp_send_syn(udp);
+	LeaveCriticalSection(&udp->lock);
+
+	if (!rdpudp_start(udp))
+		return FALSE;
+
+	WaitForSingleObject(udp->connectEvent, timeout);
+
+	return (udp->state == RDPUDP_STATE_ESTABLISHED) ? TRUE : FALSE;
+}
+
+/**
+ * Queues data for sending. A reliable connection delivers it in order, in
+ * datagrams of at most RDPUDP_MAX_PAYLOAD bytes; a lossy connection sends
+ * each write as a single datagram, which may not arrive.
+ */
+
+int rdpudp_write(rdpUdp* udp, const BYTE* data, int length)
+{
+	int offset;
+	int chunk;
+	wStream* s;
+
+	if ((length < 1) || (udp->lossy && (length > RDPUDP_MAX_PAYLOAD)))
+		return -1;
+
+	EnterCriticalSection(&udp->lock);
+
+	if (udp->state != RDPUDP_STATE_ESTABLISHED)
+	{
+		LeaveCriticalSection(&udp->lock);
+		return -1;
+	}
+
+	for (offset = 0; offset < length; offset += chunk)
+	{
+		chunk = MIN(length - offset, RDPUDP_MAX_PAYLOAD);
+		s = Stream_New(NULL, chunk);
+
+		if (!s)
+		{
+			LeaveCriticalSection(&udp->lock);
+			return -1;
+		}
+
+		Stream_Write(s, &data[offset], chunk);
+		Stream_SealLength(s);
+		Queue_Enqueue(udp->sendQueue, s);
+	}
+
+	rdpudp_flush(udp);
+
+	LeaveCriticalSection(&udp->lock);
+
+	return length;
+}
+
+/**
+ * Datagrams written but not sent yet, held back by the congestion window.
+ */
+
+int rdpudp_get_send_queue_length(rdpUdp* udp)
+{
+	return Queue_Count(udp->sendQueue);
+}
+
+rdpUdp* rdpudp_new(BOOL lossy, pRdpUdpReceive receive, pRdpUdpStateChange stateChange, void* param)
+{
+	rdpUdp* udp;
+
+	udp = (rdpUdp*) calloc(1, sizeof(rdpUdp));
+
+	if (!udp)
+		return NULL;
+
+	udp->lossy = lossy;
+	udp->sockfd = -1;
+	udp->Receive = receive;
+	udp->StateChange = stateChange;
+	udp->param = param;
+
+	udp->cwnd = 4;
+	udp->ssthresh = RDPUDP_WINDOW_SIZE;
+	udp->rto = RDPUDP_INITIAL_RTO;
+	udp->remoteWindow = RDPUDP_WINDOW_SIZE;
+
+	crypto_nonce((BYTE*) &udp->localInitialSequence, sizeof(udp->localInitialSequence));
+	udp->nextSequence = udp->sendBase = udp->localInitialSequence + 1;
+
+	InitializeCriticalSectionAndSpinCount(&udp->lock, 4000);
+
+	udp->stopEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+	udp->connectEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+	udp->sendQueue = Queue_New(FALSE, -1, -1);
+	udp->deliveries = Queue_New(FALSE, -1, -1);
+
+	if (!udp->stopEvent || !udp->connectEvent || !udp->sendQueue || !udp->deliveries)
+	{
+		rdpudp_free(udp);
+		return NULL;
+	}
+
+	return udp;
+}
+
+/**
+ * Closes the connection. Must not be called from the callbacks, which run on
+ * the connection thread.
+ */
+
+void rdpudp_free(rdpUdp* udp)
+{
+	int i;
+	wStream* s;
+	wMessage message;
+	BYTE buffer[RDPUDP_FEC_HEADER_LENGTH];
+
+	if (!udp)
+		return;
+
+	if (udp->listener)
+		ArrayList_Remove(udp->listener->connections, udp);
+
+	if (udp->state == RDPUDP_STATE_ESTABLISHED)
+	{
+		s = Stream_New(buffer, sizeof(buffer));
+
+		if (s)
+		{
+			EnterCriticalSection(&udp->lock);
+			rdpudp_write_fec_header(udp, s, udp->receiveBase - 1, RDPUDP_FLAG_FIN);
+			rdpudp_send(udp, buffer, sizeof(buffer));
+			LeaveCriticalSection(&udp->lock);
+			Stream_Free(s, FALSE);
+		}
+	}
+
+	if (udp->thread)
+	{
+		SetEvent(udp->stopEvent);
+		WaitForSingleObject(udp->thread, INFINITE);
+		CloseHandle(udp->thread);
+	}
+
+	if (udp->input)
+	{
+		while (MessageQueue_Peek(udp->input, &message, TRUE))
+			free(message.wParam);
+
+		MessageQueue_Free(udp->input);
+	}
+
+	if (udp->sendQueue)
+	{
+		while ((s = (wStream*) Queue_Dequeue(udp->sendQueue)))
+			Stream_Free(s, TRUE);
+
+		Queue_Free(udp->sendQueue);
+	}
+
+	if (udp->deliveries)
+	{
+		while ((s = (wStream*) Queue_Dequeue(udp->deliveries)))
+			Stream_Free(s, TRUE);
+
+		Queue_Free(udp->deliveries);
+	}
+
+	for (i = 0; i < RDPUDP_WINDOW_SIZE; i++)
+	{
+		free(udp->window[i].data);
+
+		if (udp->reorder[i])
+			Stream_Free(udp->reorder[i], TRUE);
+	}
+
+	if (udp->socketEvent)
+		CloseHandle(udp->socketEvent);
+
+	if (udp->ownSocket && (udp->sockfd >= 0))
+		closesocket(udp->sockfd);
+
+	if (udp->stopEvent)
+		CloseHandle(udp->stopEvent);
+
+	if (udp->connectEvent)
+		CloseHandle(udp->connectEvent);
+
+	DeleteCriticalSection(&udp->lock);
+
+	free(udp);
+}
+
+static rdpUdp* rdpudp_listener_find(rdpUdpListener* listener, struct sockaddr_storage* address, socklen_t length)
+{
+	int index;
+	int count;
+	rdpUdp* udp;
+
+	count = ArrayList_Count(listener->connections);
+
+	for (index = 0; index < count; index++)
+	{
+		udp = (rdpUdp*) ArrayList_GetItem(listener->connections, index);
+
+		if ((udp->peerAddressLength == length) && (memcmp(&udp->peerAddress, address, length) == 0))
+			return udp;
+	}
+
+	return NULL;
+}
+
+static rdpUdp* rdpudp_listener_connection_new(rdpUdpListener* listener, struct sockaddr_storage* address,
+		socklen_t length)
+{
+	rdpUdp* udp;
+
+	udp = rdpudp_new(FALSE, NULL, NULL, NULL);
+
+	if (!udp)
+		return NULL;
+
+	udp->server = TRUE;
+	udp->listener = listener;
+	udp->sockfd = listener->sockfd;
+	udp->ownSocket = FALSE;
+	CopyMemory(&udp->peerAddress, address, length);
+	udp->peerAddressLength = length;
+
+	udp->input = MessageQueue_New(NULL);
+
+	if (!udp->input)
+	{
+		udp->listener = NULL;
+		rdpudp_free(udp);
+		return NULL;
+	}
+
+	ArrayList_Add(listener->connections, udp);
+
+	if (!rdpudp_start(udp))
+	{
+		rdpudp_free(udp);
+		return NULL;
+	}
+
+	return udp;
+}
+
+/**
+ * Hands the datagrams to the connection of their source address, and makes
+ * a new connection for each SYN datagram from an unknown address.
+ */
+
+static void* rdpudp_listener_thread(void* arg)
+{
+	int status;
+	BYTE* copy;
+	UINT16 uFlags;
+	HANDLE events[2];
+	rdpUdp* udp;
+	socklen_t length;
+	struct sockaddr_storage address;
+	BYTE buffer[RDPUDP_MTU];
+	rdpUdpListener* listener = (rdpUdpListener*) arg;
+
+	events[0] = listener->stopEvent;
+	events[1] = listener->socketEvent;
+
+	while (1)
+	{
+		WaitForMultipleObjects(2, events, FALSE, INFINITE);
+
+		if (WaitForSingleObject(listener->stopEvent, 0) == WAIT_OBJECT_0)
+			break;
+
+		while (1)
+		{
+			length = sizeof(address);
+			status = recvfrom(listener->sockfd, (char*) buffer, sizeof(buffer), 0,
+					(struct sockaddr*) &address, &length);
+
+			if (status <= 0)
+				break;
+
+			if (status < RDPUDP_FEC_HEADER_LENGTH)
+				continue;
+
+			ArrayList_Lock(listener->connections);
+
+			udp = rdpudp_listener_find(listener, &address, length);
+
+			if (!udp)
+			{
+				uFlags = (buffer[6] << 8) | buffer[7];
+
+				if ((uFlags & RDPUDP_FLAG_SYN) && !(uFlags & RDPUDP_FLAG_ACK))
+					udp = rdpudp_listener_connection_new(listener, &address, length);
+			}
+
+			if (udp && (copy = (BYTE*) malloc(status)))
+			{
+				CopyMemory(copy, buffer, status);
+				MessageQueue_Post(udp->input, (void*) udp, 0, (void*) copy, (void*) (size_t) status);
+			}
+
+			ArrayList_Unlock(listener->connections);
+		}
+	}
+
+	ExitThread(0);
+	return NULL;
+}
+
+/**
+ * Listens for RDP-UDP connections. The accepted callback is called on the
+ * thread of the new connection once its handshake is complete, and may set
+ * the callbacks of the connection, which is then closed with rdpudp_free().
+ */
+
+rdpUdpListener* rdpudp_listener_new(const char* bind_address, UINT16 port, pRdpUdpAccepted accepted, void* param)
+{
+	int status;
+	char servname[16];
+	struct addrinfo* ai;
+	struct addrinfo* result;
+	struct addrinfo hints = { 0 };
+	rdpUdpListener* listener;
+
+	listener = (rdpUdpListener*) calloc(1, sizeof(rdpUdpListener));
+
+	if (!listener)
+		return NULL;
+
+	listener->sockfd = -1;
+	listener->Accepted = accepted;
+	listener->param = param;
+
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_DGRAM;
+
+	if (!bind_address)
+		hints.ai_flags = AI_PASSIVE;
+
+	sprintf_s(servname, sizeof(servname), "%d", port);
+	status = getaddrinfo(bind_address, servname, &hints, &result);
+
+	if (status != 0)
+	{
+		WLog_ERR(TAG, "getaddrinfo: %s", gai_strerror(status));
+		free(listener);
+		return NULL;
+	}
+
+	for (ai = result; ai; ai = ai->ai_next)
+	{
+		if ((ai->ai_family != AF_INET) && (ai->ai_family != AF_INET6))
+			continue;
+
+		listener->sockfd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+
+		if (listener->sockfd < 0)
+			continue;
+
+		if (bind(listener->sockfd, ai->ai_addr, ai->ai_addrlen) == 0)
+			break;
+
+		closesocket(listener->sockfd);
+		listener->sockfd = -1;
+	}
+
+	freeaddrinfo(result);
+
+	if (listener->sockfd < 0)
+	{
+		WLog_ERR(TAG, "unable to bind UDP port %d", port);
+		free(listener);
+		return NULL;
+	}
+
+	rdpudp_set_nonblocking(listener->sockfd);
+
+	listener->connections = ArrayList_New(TRUE);
+	listener->stopEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+	listener->socketEvent = CreateFileDescriptorEvent(NULL, FALSE, FALSE, listener->sockfd);
+
+	if (!listener->connections || !listener->stopEvent || !listener->socketEvent)
+	{
+		rdpudp_listener_free(listener);
+		return NULL;
+	}
+
+	listener->thread = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE) rdpudp_listener_thread,
+			(void*) listener, 0, NULL);
+
+	if (!listener->thread)
+	{
+		rdpudp_listener_free(listener);
+		return NULL;
+	}
+
+	return listener;
+}
+
+void rdpudp_listener_free(rdpUdpListener* listener)
+{
+	rdpUdp* udp;
+
+	if (!listener)
+		return;
+
+	if (listener->thread)
+	{
+		SetEvent(listener->stopEvent);
+		WaitForSingleObject(listener->thread, INFINITE);
+		CloseHandle(listener->thread);
+	}
+
+	if (listener->connections)
+	{
+		/**
+		 * The connections that never completed their handshake are closed,
+		 * the others belong to the accepted callback: they are detached,
+		 * without a socket to send on.
+		 */
+		while (ArrayList_Count(listener->connections) > 0)
+		{
+			udp = (rdpUdp*) ArrayList_GetItem(listener->connections, 0);
+			ArrayList_RemoveAt(listener->connections, 0);
+
+			SetEvent(udp->stopEvent);
+			WaitForSingleObject(udp->thread, INFINITE);
+			CloseHandle(udp->thread);
+			udp->thread = NULL;
+
+			EnterCriticalSection(&udp->lock);
+			udp->listener = NULL;
+			udp->sockfd = -1;
+			LeaveCriticalSection(&udp->lock);
+
+			if (udp->state != RDPUDP_STATE_ESTABLISHED)
+				rdpudp_free(udp);
+		}
+
+		ArrayList_Free(listener->connections);
+	}
+
+	if (listener->socketEvent)
+		CloseHandle(listener->socketEvent);
+
+	if (listener->stopEvent)
+		CloseHandle(listener->stopEvent);
+
+	if (listener->sockfd >= 0)
+		closesocket(listener->sockfd);
+
+	free(listener);
+}
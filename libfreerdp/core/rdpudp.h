@@ -0,0 +1,186 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * UDP Transport Extension (MS-RDPEUDP)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __RDPUDP_H
+#define __RDPUDP_H
+
+typedef struct rdp_udp rdpUdp;
+typedef struct rdp_udp_datagram rdpUdpDatagram;
+typedef struct rdp_udp_listener rdpUdpListener;
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+#include <winpr/thread.h>
+#include <winpr/stream.h>
+#include <winpr/winsock.h>
+#include <winpr/collections.h>
+
+#include <freerdp/api.h>
+#include <freerdp/types.h>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#endif
+
+/* RDPUDP_FEC_HEADER uFlags */
+#define RDPUDP_FLAG_SYN				0x0001
+#define RDPUDP_FLAG_FIN				0x0002
+#define RDPUDP_FLAG_ACK				0x0004
+#define RDPUDP_FLAG_DATA			0x0008
+#define RDPUDP_FLAG_FEC				0x0010
+#define RDPUDP_FLAG_CN				0x0020
+#define RDPUDP_FLAG_CWR				0x0040
+#define RDPUDP_FLAG_SACK_OPTION			0x0080
+#define RDPUDP_FLAG_ACK_OF_ACKS			0x0100
+#define RDPUDP_FLAG_SYNLOSSY			0x0200
+#define RDPUDP_FLAG_ACKDELAYED			0x0400
+#define RDPUDP_FLAG_CORRELATION_ID		0x0800
+#define RDPUDP_FLAG_SYNEX			0x1000
+
+/* ACK vector element states */
+#define DATAGRAM_RECEIVED			0
+#define DATAGRAM_NOT_YET_RECEIVED		3
+
+#define RDPUDP_FEC_HEADER_LENGTH		8
+#define RDPUDP_SYNDATA_PAYLOAD_LENGTH		8
+#define RDPUDP_SOURCE_PAYLOAD_HEADER_LENGTH	8
+
+/* MTU of every datagram, SYN datagrams are padded to it */
+#define RDPUDP_MTU				1232
+
+/* ACK vectors describe at most this many runs, padded to four bytes */
+#define RDPUDP_MAX_ACK_VECTOR_SIZE		64
+#define RDPUDP_ACK_VECTOR_HEADER_LENGTH		(2 + RDPUDP_MAX_ACK_VECTOR_SIZE + 2)
+
+#define RDPUDP_MAX_PAYLOAD			(RDPUDP_MTU - RDPUDP_FEC_HEADER_LENGTH - \
+						RDPUDP_ACK_VECTOR_HEADER_LENGTH - RDPUDP_SOURCE_PAYLOAD_HEADER_LENGTH)
+
+/* datagrams, in both directions */
+#define RDPUDP_WINDOW_SIZE			256
+
+#define RDPUDP_INITIAL_RTO			500
+#define RDPUDP_MIN_RTO				100
+#define RDPUDP_MAX_RTO				4000
+#define RDPUDP_SYN_RETRIES			5
+#define RDPUDP_MAX_RETRANSMISSIONS		10
+#define RDPUDP_DUPACK_THRESHOLD			3
+
+enum RDPUDP_STATE
+{
+	RDPUDP_STATE_CLOSED = 0,
+	RDPUDP_STATE_SYN_SENT,
+	RDPUDP_STATE_SYN_RECEIVED,
+	RDPUDP_STATE_ESTABLISHED,
+	RDPUDP_STATE_FAILED
+};
+
+typedef void (*pRdpUdpReceive)(rdpUdp* udp, const BYTE* data, int length, void* param);
+typedef void (*pRdpUdpStateChange)(rdpUdp* udp, int state, void* param);
+typedef void (*pRdpUdpAccepted)(rdpUdpListener* listener, rdpUdp* udp, void* param);
+
+struct rdp_udp_datagram
+{
+	UINT32 sequenceNumber;
+	UINT32 sentTime;
+	int transmissions;
+	int missingReports;
+	BOOL acknowledged;
+	int length;
+	BYTE* data;
+};
+
+struct rdp_udp
+{
+	BOOL server;
+	BOOL lossy;
+	int state;
+
+	int sockfd;
+	BOOL ownSocket;
+	struct sockaddr_storage peerAddress;
+	socklen_t peerAddressLength;
+	rdpUdpListener* listener;
+	wMessageQueue* input;
+
+	HANDLE thread;
+	HANDLE stopEvent;
+	HANDLE socketEvent;
+	HANDLE connectEvent;
+	CRITICAL_SECTION lock;
+
+	UINT32 synTime;
+	int synRetries;
+	UINT32 localInitialSequence;
+	UINT32 remoteInitialSequence;
+
+	/* sender */
+	UINT32 nextSequence;
+	UINT32 sendBase;
+	UINT32 remoteWindow;
+	UINT32 cwnd;
+	UINT32 cwndCounter;
+	UINT32 ssthresh;
+	BOOL inRecovery;
+	UINT32 recoverySequence;
+	UINT32 srtt;
+	UINT32 rttvar;
+	UINT32 rto;
+	rdpUdpDatagram window[RDPUDP_WINDOW_SIZE];
+	wQueue* sendQueue;
+
+	/* receiver */
+	UINT32 receiveBase;
+	UINT32 highestReceived;
+	BOOL received[RDPUDP_WINDOW_SIZE];
+	wStream* reorder[RDPUDP_WINDOW_SIZE];
+	wQueue* deliveries;
+	BOOL ackPending;
+
+	UINT32 DatagramsSent;
+	UINT32 DatagramsReceived;
+	UINT32 Retransmissions;
+	UINT32 DatagramsLost;
+	UINT32 Duplicates;
+
+	pRdpUdpReceive Receive;
+	pRdpUdpStateChange StateChange;
+	void* param;
+};
+
+struct rdp_udp_listener
+{
+	int sockfd;
+	HANDLE thread;
+	HANDLE stopEvent;
+	HANDLE socketEvent;
+	wArrayList* connections;
+
+	pRdpUdpAccepted Accepted;
+	void* param;
+};
+
+BOOL rdpudp_connect(rdpUdp* udp, const char* hostname, UINT16 port, DWORD timeout);
+int rdpudp_write(rdpUdp* udp, const BYTE* data, int length);
+int rdpudp_get_send_queue_length(rdpUdp* udp);
+
+rdpUdp* rdpudp_new(BOOL lossy, pRdpUdpReceive receive, pRdpUdpStateChange stateChange, void* param);
+void rdpudp_free(rdpUdp* udp);
+
+rdpUdpListener* rdpudp_listener_new(const char* bind_address, UINT16 port, pRdpUdpAccepted accepted, void* param);
+void rdpudp_listener_free(rdpUdpListener* listener);
+
+#endif /* __RDPUDP_H */
@@ -0,0 +1,620 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Server Peer Reactor
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+
+#include <winpr/crt.h>
+#include <winpr/thread.h>
+#include <winpr/interlocked.h>
+
+#include <freerdp/log.h>
+
+#include "reactor.h"
+
+#ifdef FREERDP_PEER_REACTOR
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#endif
+
+#define TAG FREERDP_TAG("core.reactor")
+
+/**
+ * The reactor serves many peers with a few threads: each of its loops
+ * owns the sockets and timers of a share of the peers in an epoll set,
+ * and hands the events they report to a thread pool. All descriptors are
+ * one-shot, and the work item of a peer is never queued twice, so the
+ * callbacks of a peer are serialized and it needs no locking of its own.
+ *
+ * A peer leaves the reactor when CheckFileDescriptor or its ReactorEvent
+ * callback fail, or when it is detached. Its ReactorEvent callback is then
+ * called one last time with FREERDP_PEER_EVENT_CLOSED, after which the
+ * reactor does not touch the peer anymore and the application may free it.
+ */
+
+#ifdef FREERDP_PEER_REACTOR
+
+static void reactor_peer_post(rdpReactorPeer* entry, UINT32 events)
+{
+	LONG value;
+
+	do
+	{
+		value = entry->events;
+	}
+	while (InterlockedCompareExchange(&entry->events, value | (LONG) events, value) != value);
+
+	if (InterlockedCompareExchange(&entry->running, 1, 0) == 0)
+		SubmitThreadpoolWork(entry->work);
+}
+
+static BOOL reactor_peer_arm(rdpReactorPeer* entry, int fd, rdpReactorSource* source, UINT32 mask)
+{
+	struct epoll_event event;
+
+	ZeroMemory(&event, sizeof(event));
+	event.events = mask | EPOLLONESHOT;
+	event.data.ptr = source;
+
+	return (epoll_ctl(entry->loop->epollfd, EPOLL_CTL_MOD, fd, &event) == 0);
+}
+
+static void reactor_peer_unlink(rdpReactorPeer* entry)
+{
+	rdpReactor* reactor = entry->loop->reactor;
+
+	EnterCriticalSection(&reactor->lock);
+
+	if (entry->prev)
+		entry->prev->next = entry->next;
+	else
+		reactor->peers = entry->next;
+
+	if (entry->next)
+		entry->next->prev = entry->prev;
+
+	LeaveCriticalSection(&reactor->lock);
+}
+
+static void reactor_peer_close(rdpReactorPeer* entry)
+{
+	uint64_t value = 1;
+	freerdp_peer* client = entry->client;
+	rdpReactorLoop* loop = entry->loop;
+	rdpReactor* reactor = loop->reactor;
+
+	epoll_ctl(loop->epollfd, EPOLL_CTL_DEL, entry->sockfd, NULL);
+	epoll_ctl(loop->epollfd, EPOLL_CTL_DEL, entry->timerfd, NULL);
+	close(entry->timerfd);
+
+	reactor_peer_unlink(entry);
+	client->reactor = NULL;
+	IFCALL(client->ReactorEvent, client, FREERDP_PEER_EVENT_CLOSED);
+
+	/**
+	 * The loop may still be holding an event for this peer that it fetched
+	 * before the descriptors were removed, so it frees the entry itself once
+	 * it is done with its current batch. The entry stays marked as running,
+	 * which keeps such events from submitting the work item again.
+	 */
+
+	EnterCriticalSection(&loop->lock);
+	entry->next = loop->closed;
+	loop->closed = entry;
+	LeaveCriticalSection(&loop->lock);
+
+	if (write(loop->wakefd, &value, sizeof(value)) < 0)
+		WLog_ERR(TAG, "failed to wake reactor loop");
+
+	EnterCriticalSection(&reactor->lock);
+
+	if (--reactor->peerCount == 0)
+		SetEvent(reactor->idleEvent);
+
+	LeaveCriticalSection(&reactor->lock);
+}
+
+static BOOL reactor_peer_dispatch(rdpReactorPeer* entry, UINT32 events)
+{
+	BOOL blocked;
+	uint64_t expirations;
+	freerdp_peer* client = entry->client;
+
+	if (events & REACTOR_EVENT_DETACH)
+		return FALSE;
+
+	if (events & FREERDP_PEER_EVENT_READ)
+	{
+		if (!client->CheckFileDescriptor(client))
+			return FALSE;
+	}
+
+	if (events & FREERDP_PEER_EVENT_TIMER)
+	{
+		if (read(entry->timerfd, &expirations, sizeof(expirations)) < 0)
+		{
+			if (errno != EAGAIN)
+				return FALSE;
+		}
+
+		if (!reactor_peer_arm(entry, entry->timerfd, &entry->timerSource, EPOLLIN))
+			return FALSE;
+	}
+
+	if (events & (FREERDP_PEER_EVENT_READ | FREERDP_PEER_EVENT_TIMER | FREERDP_PEER_EVENT_SIGNAL))
+	{
+		if (client->ReactorEvent)
+		{
+			if (!client->ReactorEvent(client, events & (FREERDP_PEER_EVENT_READ |
+					FREERDP_PEER_EVENT_TIMER | FREERDP_PEER_EVENT_SIGNAL)))
+				return FALSE;
+		}
+	}
+
+	blocked = client->IsWriteBlocked(client);
+
+	if (blocked)
+	{
+		if (client->DrainOutputBuffer(client) < 0)
+			return FALSE;
+
+		blocked = client->IsWriteBlocked(client);
+	}
+
+	/* the socket is disarmed after reporting, or needs to report writability */
+
+	if ((events & (FREERDP_PEER_EVENT_READ | REACTOR_EVENT_WRITE)) || (blocked != entry->writeArmed))
+	{
+		if (!reactor_peer_arm(entry, entry->sockfd, &entry->socketSource,
+				EPOLLIN | EPOLLRDHUP | (blocked ? EPOLLOUT : 0)))
+			return FALSE;
+
+		entry->writeArmed = blocked;
+	}
+
+	return TRUE;
+}
+
+static VOID CALLBACK reactor_peer_work(PTP_CALLBACK_INSTANCE instance, PVOID context, PTP_WORK work)
+{
+	UINT32 events;
+	rdpReactorPeer* entry = (rdpReactorPeer*) context;
+
+	for (;;)
+	{
+		events = (UINT32) InterlockedExchange(&entry->events, 0);
+
+		if (!events)
+		{
+			InterlockedExchange(&entry->running, 0);
+
+			/* events posted just before running was cleared did not submit the work */
+
+			if (!entry->events || (InterlockedCompareExchange(&entry->running, 1, 0) != 0))
+				return;
+
+			continue;
+		}
+
+		if (!reactor_peer_dispatch(entry, events))
+		{
+			reactor_peer_close(entry);
+			return;
+		}
+	}
+}
+
+static void reactor_loop_collect(rdpReactorLoop* loop)
+{
+	rdpReactorPeer* entry;
+	rdpReactorPeer* next;
+
+	EnterCriticalSection(&loop->lock);
+	entry = loop->closed;
+	loop->closed = NULL;
+	LeaveCriticalSection(&loop->lock);
+
+	while (entry)
+	{
+		next = entry->next;
+		CloseThreadpoolWork(entry->work);
+		free(entry);
+		entry = next;
+	}
+}
+
+static void* reactor_loop_thread(void* arg)
+{
+	int index;
+	int count;
+	UINT32 events;
+	uint64_t value;
+	rdpReactorSource* source;
+	rdpReactorLoop* loop = (rdpReactorLoop*) arg;
+	struct epoll_event epollEvents[REACTOR_MAX_EVENTS];
+
+	while (!loop->terminate)
+	{
+		count = epoll_wait(loop->epollfd, epollEvents, REACTOR_MAX_EVENTS, -1);
+
+		if (count < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			WLog_ERR(TAG, "epoll_wait failure: %s", strerror(errno));
+			break;
+		}
+
+		for (index = 0; index < count; index++)
+		{
+			source = (rdpReactorSource*) epollEvents[index].data.ptr;
+
+			if (!source)
+			{
+				if (read(loop->wakefd, &value, sizeof(value)) < 0)
+					WLog_DBG(TAG, "spurious reactor loop wakeup");
+
+				continue;
+			}
+
+			events = source->event;
+
+			if (events == FREERDP_PEER_EVENT_READ)
+			{
+				events = 0;
+
+				if (epollEvents[index].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+					events |= FREERDP_PEER_EVENT_READ;
+
+				if (epollEvents[index].events & EPOLLOUT)
+					events |= REACTOR_EVENT_WRITE;
+			}
+
+			reactor_peer_post(source->entry, events);
+		}
+
+		reactor_loop_collect(loop);
+	}
+
+	ExitThread(0);
+	return NULL;
+}
+
+static BOOL reactor_loop_init(rdpReactorLoop* loop, rdpReactor* reactor)
+{
+	struct epoll_event event;
+
+	loop->reactor = reactor;
+	loop->epollfd = epoll_create1(EPOLL_CLOEXEC);
+	loop->wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+	InitializeCriticalSectionAndSpinCount(&loop->lock, 4000);
+
+	if ((loop->epollfd < 0) || (loop->wakefd < 0))
+		return FALSE;
+
+	ZeroMemory(&event, sizeof(event));
+	event.events = EPOLLIN;
+	event.data.ptr = NULL;
+
+	if (epoll_ctl(loop->epollfd, EPOLL_CTL_ADD, loop->wakefd, &event) < 0)
+		return FALSE;
+
+	loop->thread = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE) reactor_loop_thread, loop, 0, NULL);
+
+	return (loop->thread != NULL);
+}
+
+static void reactor_loop_uninit(rdpReactorLoop* loop)
+{
+	uint64_t value = 1;
+
+	if (loop->thread)
+	{
+		loop->terminate = TRUE;
+
+		if (write(loop->wakefd, &value, sizeof(value)) < 0)
+			WLog_ERR(TAG, "failed to wake reactor loop");
+
+		WaitForSingleObject(loop->thread, INFINITE);
+		CloseHandle(loop->thread);
+	}
+
+	if (loop->epollfd >= 0)
+		close(loop->epollfd);
+
+	if (loop->wakefd >= 0)
+		close(loop->wakefd);
+}
+
+rdpReactor* freerdp_reactor_new(int loops, int threads)
+{
+	int index;
+	rdpReactor* reactor;
+
+	if ((loops < 1) || (threads < 1))
+		return NULL;
+
+	reactor = (rdpReactor*) calloc(1, sizeof(rdpReactor));
+
+	if (!reactor)
+		return NULL;
+
+	reactor->loops = (rdpReactorLoop*) calloc(loops, sizeof(rdpReactorLoop));
+
+	if (!reactor->loops)
+	{
+		free(reactor);
+		return NULL;
+	}
+
+	InitializeCriticalSectionAndSpinCount(&reactor->lock, 4000);
+	reactor->idleEvent = CreateEvent(NULL, TRUE, TRUE, NULL);
+
+	reactor->pool = CreateThreadpool(NULL);
+
+	if (!reactor->idleEvent || !reactor->pool)
+		goto fail;
+
+	SetThreadpoolThreadMinimum(reactor->pool, threads);
+	SetThreadpoolThreadMaximum(reactor->pool, threads);
+
+	InitializeThreadpoolEnvironment(&reactor->environment);
+	SetThreadpoolCallbackPool(&reactor->environment, reactor->pool);
+
+	for (index = 0; index < loops; index++)
+	{
+		reactor->loops[index].epollfd = -1;
+		reactor->loops[index].wakefd = -1;
+	}
+
+	for (index = 0; index < loops; index++)
+	{
+		reactor->loopCount++;
+
+		if (!reactor_loop_init(&reactor->loops[index], reactor))
+		{
+			WLog_ERR(TAG, "failed to start reactor loop %d", index);
+			goto fail;
+		}
+	}
+
+	return reactor;
+
+fail:
+	freerdp_reactor_free(reactor);
+	return NULL;
+}
+
+/**
+ * Detaches the peers that are still attached and waits until all of them
+ * have been reported closed before stopping the loops.
+ */
+
+void freerdp_reactor_free(rdpReactor* reactor)
+{
+	int index;
+	rdpReactorPeer* entry;
+
+	if (!reactor)
+		return;
+
+	EnterCriticalSection(&reactor->lock);
+
+	for (entry = reactor->peers; entry; entry = entry->next)
+		reactor_peer_post(entry, REACTOR_EVENT_DETACH);
+
+	LeaveCriticalSection(&reactor->lock);
+
+	if (reactor->idleEvent)
+		WaitForSingleObject(reactor->idleEvent, INFINITE);
+
+	for (index = 0; index < reactor->loopCount; index++)
+		reactor_loop_uninit(&reactor->loops[index]);
+
+	if (reactor->pool)
+	{
+		DestroyThreadpoolEnvironment(&reactor->environment);
+		CloseThreadpool(reactor->pool);
+	}
+
+	/* the workers are gone, nothing refers to the closed entries anymore */
+
+	for (index = 0; index < reactor->loopCount; index++)
+	{
+		reactor_loop_collect(&reactor->loops[index]);
+		DeleteCriticalSection(&reactor->loops[index].lock);
+	}
+
+	if (reactor->idleEvent)
+		CloseHandle(reactor->idleEvent);
+
+	DeleteCriticalSection(&reactor->lock);
+	free(reactor->loops);
+	free(reactor);
+}
+
+BOOL freerdp_peer_attach_reactor(freerdp_peer* client, rdpReactor* reactor)
+{
+	int rcount = 0;
+	void* rfds[8];
+	LONG index;
+	rdpReactorLoop* loop;
+	rdpReactorPeer* entry;
+	struct epoll_event event;
+
+	if (!client || !reactor || client->reactor)
+		return FALSE;
+
+	if (!client->GetFileDescriptor(client, rfds, &rcount) || (rcount < 1))
+		return FALSE;
+
+	entry = (rdpReactorPeer*) calloc(1, sizeof(rdpReactorPeer));
+
+	if (!entry)
+		return FALSE;
+
+	index = InterlockedIncrement(&reactor->nextLoop);
+	loop = &reactor->loops[((UINT32) index) % reactor->loopCount];
+
+	entry->client = client;
+	entry->loop = loop;
+	entry->sockfd = (int)(long) rfds[0];
+	entry->timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	entry->work = CreateThreadpoolWork(reactor_peer_work, entry, &reactor->environment);
+
+	entry->socketSource.entry = entry;
+	entry->socketSource.event = FREERDP_PEER_EVENT_READ;
+	entry->timerSource.entry = entry;
+	entry->timerSource.event = FREERDP_PEER_EVENT_TIMER;
+
+	if ((entry->timerfd < 0) || !entry->work)
+		goto fail;
+
+	ZeroMemory(&event, sizeof(event));
+	event.events = EPOLLIN | EPOLLONESHOT;
+	event.data.ptr = &entry->timerSource;
+
+	if (epoll_ctl(loop->epollfd, EPOLL_CTL_ADD, entry->timerfd, &event) < 0)
+		goto fail;
+
+	client->reactor = entry;
+
+	EnterCriticalSection(&reactor->lock);
+
+	entry->next = reactor->peers;
+
+	if (entry->next)
+		entry->next->prev = entry;
+
+	reactor->peers = entry;
+
+	if (reactor->peerCount++ == 0)
+		ResetEvent(reactor->idleEvent);
+
+	LeaveCriticalSection(&reactor->lock);
+
+	/* from here on the peer may be dispatched */
+
+	event.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+	event.data.ptr = &entry->socketSource;
+
+	if (epoll_ctl(loop->epollfd, EPOLL_CTL_ADD, entry->sockfd, &event) < 0)
+	{
+		WLog_ERR(TAG, "failed to add peer socket %d: %s", entry->sockfd, strerror(errno));
+
+		/* the timer is not set, so nothing could have dispatched the peer */
+
+		epoll_ctl(loop->epollfd, EPOLL_CTL_DEL, entry->timerfd, NULL);
+		reactor_peer_unlink(entry);
+		client->reactor = NULL;
+
+		EnterCriticalSection(&reactor->lock);
+
+		if (--reactor->peerCount == 0)
+			SetEvent(reactor->idleEvent);
+
+		LeaveCriticalSection(&reactor->lock);
+		goto fail;
+	}
+
+	return TRUE;
+
+fail:
+	if (entry->timerfd >= 0)
+		close(entry->timerfd);
+
+	if (entry->work)
+		CloseThreadpoolWork(entry->work);
+
+	free(entry);
+	return FALSE;
+}
+
+void freerdp_peer_detach_reactor(freerdp_peer* client)
+{
+	rdpReactorPeer* entry = (rdpReactorPeer*) client->reactor;
+
+	if (entry)
+		reactor_peer_post(entry, REACTOR_EVENT_DETACH);
+}
+
+BOOL freerdp_peer_set_reactor_timer(freerdp_peer* client, UINT32 dueTime, UINT32 period)
+{
+	struct itimerspec spec;
+	rdpReactorPeer* entry = (rdpReactorPeer*) client->reactor;
+
+	if (!entry)
+		return FALSE;
+
+	ZeroMemory(&spec, sizeof(spec));
+	spec.it_value.tv_sec = dueTime / 1000;
+	spec.it_value.tv_nsec = (dueTime % 1000) * 1000000;
+	spec.it_interval.tv_sec = period / 1000;
+	spec.it_interval.tv_nsec = (period % 1000) * 1000000;
+
+	return (timerfd_settime(entry->timerfd, 0, &spec, NULL) == 0);
+}
+
+void freerdp_peer_signal_reactor(freerdp_peer* client)
+{
+	rdpReactorPeer* entry = (rdpReactorPeer*) client->reactor;
+
+	if (entry)
+		reactor_peer_post(entry, FREERDP_PEER_EVENT_SIGNAL);
+}
+
+#else
+
+rdpReactor* freerdp_reactor_new(int loops, int threads)
+{
+	WLog_ERR(TAG, "the peer reactor is not supported on this platform");
+	return NULL;
+}
+
+void freerdp_reactor_free(rdpReactor* reactor)
+{
+
+}
+
+BOOL freerdp_peer_attach_reactor(freerdp_peer* client, rdpReactor* reactor)
+{
+	return FALSE;
+}
+
+void freerdp_peer_detach_reactor(freerdp_peer* client)
+{
+
+}
+
+BOOL freerdp_peer_set_reactor_timer(freerdp_peer* client, UINT32 dueTime, UINT32 period)
+{
+	return FALSE;
+}
+
+void freerdp_peer_signal_reactor(freerdp_peer* client)
+{
+
+}
+
+#endif
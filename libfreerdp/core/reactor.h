@@ -0,0 +1,95 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Server Peer Reactor
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __REACTOR_H
+#define __REACTOR_H
+
+#include <winpr/crt.h>
+#include <winpr/pool.h>
+#include <winpr/synch.h>
+
+#include <freerdp/peer.h>
+
+#if !defined(_WIN32) && defined(HAVE_SYS_EPOLL_H) && defined(HAVE_TIMERFD_H)
+#define FREERDP_PEER_REACTOR	1
+#endif
+
+#define REACTOR_MAX_EVENTS	256
+
+/* internal events, never reported to the application */
+#define REACTOR_EVENT_WRITE	0x00010000
+#define REACTOR_EVENT_DETACH	0x00020000
+
+typedef struct rdp_reactor_loop rdpReactorLoop;
+typedef struct rdp_reactor_peer rdpReactorPeer;
+typedef struct rdp_reactor_source rdpReactorSource;
+
+struct rdp_reactor_source
+{
+	rdpReactorPeer* entry;
+	UINT32 event;
+};
+
+struct rdp_reactor_peer
+{
+	freerdp_peer* client;
+	rdpReactorLoop* loop;
+	PTP_WORK work;
+
+	int sockfd;
+	int timerfd;
+	BOOL writeArmed;
+
+	LONG volatile events;
+	LONG volatile running;
+
+	rdpReactorSource socketSource;
+	rdpReactorSource timerSource;
+
+	rdpReactorPeer* prev;
+	rdpReactorPeer* next;
+};
+
+struct rdp_reactor_loop
+{
+	rdpReactor* reactor;
+
+	int epollfd;
+	int wakefd;
+	HANDLE thread;
+	BOOL terminate;
+
+	CRITICAL_SECTION lock;
+	rdpReactorPeer* closed;
+};
+
+struct rdp_reactor
+{
+	int loopCount;
+	rdpReactorLoop* loops;
+	LONG volatile nextLoop;
+
+	PTP_POOL pool;
+	TP_CALLBACK_ENVIRON environment;
+
+	CRITICAL_SECTION lock;
+	rdpReactorPeer* peers;
+	int peerCount;
+	HANDLE idleEvent;
+};
+
+#endif /* __REACTOR_H */
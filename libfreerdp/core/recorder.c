@@ -0,0 +1,288 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Session Recording
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <winpr/crt.h>
+#include <winpr/sysinfo.h>
+
+#include <freerdp/log.h>
+#include <freerdp/crypto/per.h>
+
+#include "recorder.h"
+#include "tpkt.h"
+#include "tpdu.h"
+#include "mcs.h"
+#include "nego.h"
+
+#define TAG FREERDP_TAG("core.recorder")
+
+/**
+ * The settings a recording is replayed with: everything the client
+ * advertised that changes what the server sends or how it is decoded.
+ */
+
+static const struct
+{
+	UINT16 id;
+	UINT16 type;
+} recorder_settings[] =
+{
+	{ FreeRDP_RequestedProtocols, RECORDER_SETTING_UINT32 },
+	{ FreeRDP_SelectedProtocol, RECORDER_SETTING_UINT32 },
+	{ FreeRDP_NegotiationFlags, RECORDER_SETTING_UINT32 },
+	{ FreeRDP_UseRdpSecurityLayer, RECORDER_SETTING_BOOL },
+	{ FreeRDP_DesktopWidth, RECORDER_SETTING_UINT32 },
+	{ FreeRDP_DesktopHeight, RECORDER_SETTING_UINT32 },
+	{ FreeRDP_ColorDepth, RECORDER_SETTING_UINT32 },
+	{ FreeRDP_DesktopResize, RECORDER_SETTING_BOOL },
+	{ FreeRDP_CompressionEnabled, RECORDER_SETTING_BOOL },
+	{ FreeRDP_CompressionLevel, RECORDER_SETTING_UINT32 },
+	{ FreeRDP_FastPathOutput, RECORDER_SETTING_BOOL },
+	{ FreeRDP_MultifragMaxRequestSize, RECORDER_SETTING_UINT32 },
+	{ FreeRDP_FrameMarkerCommandEnabled, RECORDER_SETTING_BOOL },
+	{ FreeRDP_SurfaceFrameMarkerEnabled, RECORDER_SETTING_BOOL },
+	{ FreeRDP_RemoteFxCodec, RECORDER_SETTING_BOOL },
+	{ FreeRDP_NSCodec, RECORDER_SETTING_BOOL },
+	{ FreeRDP_JpegCodec, RECORDER_SETTING_BOOL },
+	{ FreeRDP_BitmapCacheEnabled, RECORDER_SETTING_BOOL },
+	{ FreeRDP_BitmapCacheVersion, RECORDER_SETTING_UINT32 },
+	{ FreeRDP_BitmapCacheV3Enabled, RECORDER_SETTING_BOOL },
+	{ FreeRDP_AllowCacheWaitingList, RECORDER_SETTING_BOOL },
+	{ FreeRDP_BitmapCacheV2NumCells, RECORDER_SETTING_UINT32 },
+	{ FreeRDP_OffscreenSupportLevel, RECORDER_SETTING_UINT32 },
+	{ FreeRDP_OffscreenCacheSize, RECORDER_SETTING_UINT32 },
+	{ FreeRDP_OffscreenCacheEntries, RECORDER_SETTING_UINT32 },
+	{ FreeRDP_GlyphSupportLevel, RECORDER_SETTING_UINT32 },
+	{ FreeRDP_SupportGraphicsPipeline, RECORDER_SETTING_BOOL }
+};
+
+static BOOL recorder_write_header(rdpRecorder* recorder, rdpSettings* settings)
+{
+	UINT32 index;
+	UINT32 value;
+	wStream* s = recorder->buffer;
+	UINT32 count = sizeof(recorder_settings) / sizeof(recorder_settings[0]);
+
+	Stream_SetPosition(s, 0);
+	Stream_EnsureRemainingCapacity(s, RECORDER_HEADER_LENGTH + 4 + (count * RECORDER_SETTING_LENGTH) +
+			(settings->ChannelCount * RECORDER_CHANNEL_LENGTH));
+
+	Stream_Write_UINT32(s, RECORDER_SIGNATURE); /* signature (4 bytes) */
+	Stream_Write_UINT16(s, RECORDER_VERSION); /* version (2 bytes) */
+	Stream_Write_UINT16(s, 0); /* reserved (2 bytes) */
+	Stream_Write_UINT16(s, count); /* settingCount (2 bytes) */
+
+	for (index = 0; index < count; index++)
+	{
+		if (recorder_settings[index].type == RECORDER_SETTING_BOOL)
+			value = freerdp_get_param_bool(settings, recorder_settings[index].id) ? 1 : 0;
+		else
+			value = freerdp_get_param_uint32(settings, recorder_settings[index].id);
+
+		Stream_Write_UINT16(s, recorder_settings[index].id); /* id (2 bytes) */
+		Stream_Write_UINT16(s, recorder_settings[index].type); /* type (2 bytes) */
+		Stream_Write_UINT32(s, value); /* value (4 bytes) */
+	}
+
+	Stream_Write_UINT32(s, settings->ChannelCount); /* channelCount (4 bytes) */
+
+	for (index = 0; index < settings->ChannelCount; index++)
+	{
+		Stream_Write(s, settings->ChannelDefArray[index].name, 8); /* name (8 bytes) */
+		Stream_Write_UINT32(s, settings->ChannelDefArray[index].options); /* options (4 bytes) */
+	}
+
+	return (fwrite(Stream_Buffer(s), Stream_GetPosition(s), 1, recorder->fp) == 1) ? TRUE : FALSE;
+}
+
+/**
+ * Starts recording a connection, once the security layer is negotiated.
+ * A reconnection, redirected or automatic, ends the recording: the replay
+ * covers a single connection sequence.
+ */
+
+BOOL recorder_start(rdpRecorder* recorder, rdpSettings* settings)
+{
+	if (recorder->started)
+	{
+		if (recorder->fp)
+		{
+			WLog_INFO(TAG, "reconnecting, the recording of %s ends after %u PDUs",
+					recorder->filename, recorder->count);
+			fclose(recorder->fp);
+			recorder->fp = NULL;
+		}
+
+		return TRUE;
+	}
+
+	recorder->started = TRUE;
+
+	if (settings->SelectedProtocol == PROTOCOL_RDP)
+	{
+		/* standard RDP security encrypts with a client random which cannot be replayed */
+		WLog_WARN(TAG, "sessions without TLS or NLA security cannot be recorded");
+		return TRUE;
+	}
+
+	recorder->fp = fopen(recorder->filename, "wb");
+
+	if (!recorder->fp)
+	{
+		WLog_ERR(TAG, "failed to create the session recording %s", recorder->filename);
+		return FALSE;
+	}
+
+	recorder->start = GetTickCount64();
+
+	if (!recorder_write_header(recorder, settings))
+	{
+		WLog_ERR(TAG, "failed to write the session recording %s", recorder->filename);
+		fclose(recorder->fp);
+		recorder->fp = NULL;
+		return FALSE;
+	}
+
+	WLog_INFO(TAG, "recording the session to %s", recorder->filename);
+
+	return TRUE;
+}
+
+/**
+ * Peeks at the channel a PDU was received on: fast-path output always
+ * goes to the I/O channel, slow-path PDUs carry the MCS channel id.
+ * Connection sequence PDUs other than MCS data are recorded on channel 0.
+ */
+
+static UINT16 recorder_get_channel_id(wStream* pdu, UINT16* flags)
+{
+	BYTE li;
+	BYTE code;
+	BYTE choice;
+	UINT16 initiator;
+	UINT16 channelId = 0;
+	wStream* s;
+
+	*flags = 0;
+
+	if (Stream_Length(pdu) < 1)
+		return 0;
+
+	if (Stream_Buffer(pdu)[0] != 0x03)
+	{
+		*flags |= RECORDER_PDU_FASTPATH;
+		return MCS_GLOBAL_CHANNEL_ID;
+	}
+
+	s = Stream_New(Stream_Buffer(pdu), Stream_Length(pdu));
+
+	if (!s)
+		return 0;
+
+	if (tpkt_verify_header(s) && (Stream_GetRemainingLength(s) >= 4))
+	{
+		tpkt_read_header(s);
+
+		if (tpdu_read_header(s, &code, &li) && (code == X224_TPDU_DATA) && per_read_choice(s, &choice) &&
+				((choice >> 2) == DomainMCSPDU_SendDataIndication) && (Stream_GetRemainingLength(s) >= 4))
+		{
+			per_read_integer16(s, &initiator, MCS_BASE_CHANNEL_ID); /* initiator (UserId) */
+			per_read_integer16(s, &channelId, 0); /* channelId */
+		}
+	}
+
+	Stream_Free(s, FALSE);
+
+	return channelId;
+}
+
+/**
+ * Called by the transport for every PDU received, TLS already removed.
+ */
+
+BOOL recorder_write_pdu(rdpRecorder* recorder, wStream* pdu)
+{
+	UINT16 flags;
+	UINT16 channelId;
+	UINT32 length;
+	wStream* s = recorder->buffer;
+
+	if (!recorder->fp)
+		return TRUE;
+
+	length = (UINT32) Stream_Length(pdu);
+	channelId = recorder_get_channel_id(pdu, &flags);
+
+	Stream_SetPosition(s, 0);
+	Stream_Write_UINT32(s, (UINT32) (GetTickCount64() - recorder->start)); /* timestamp (4 bytes) */
+	Stream_Write_UINT16(s, channelId); /* channelId (2 bytes) */
+	Stream_Write_UINT16(s, flags); /* flags (2 bytes) */
+	Stream_Write_UINT32(s, length); /* length (4 bytes) */
+
+	if ((fwrite(Stream_Buffer(s), RECORDER_RECORD_LENGTH, 1, recorder->fp) != 1) ||
+			(length && (fwrite(Stream_Buffer(pdu), length, 1, recorder->fp) != 1)))
+	{
+		WLog_ERR(TAG, "failed to write the session recording %s, recording stopped", recorder->filename);
+		fclose(recorder->fp);
+		recorder->fp = NULL;
+		return FALSE;
+	}
+
+	recorder->count++;
+
+	return TRUE;
+}
+
+rdpRecorder* recorder_new(const char* filename)
+{
+	rdpRecorder* recorder;
+
+	if (!filename)
+		return NULL;
+
+	recorder = (rdpRecorder*) calloc(1, sizeof(rdpRecorder));
+
+	if (!recorder)
+		return NULL;
+
+	recorder->filename = _strdup(filename);
+	recorder->buffer = Stream_New(NULL, 1024);
+
+	if (!recorder->filename || !recorder->buffer)
+	{
+		recorder_free(recorder);
+		return NULL;
+	}
+
+	return recorder;
+}
+
+void recorder_free(rdpRecorder* recorder)
+{
+	if (!recorder)
+		return;
+
+	if (recorder->fp)
+		fclose(recorder->fp);
+
+	Stream_Free(recorder->buffer, TRUE);
+	free(recorder->filename);
+	free(recorder);
+}
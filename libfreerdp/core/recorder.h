@@ -0,0 +1,75 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Session Recording
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __RECORDER_H
+#define __RECORDER_H
+
+typedef struct rdp_recorder rdpRecorder;
+
+#include <stdio.h>
+
+#include <winpr/crt.h>
+#include <winpr/stream.h>
+
+#include <freerdp/types.h>
+#include <freerdp/settings.h>
+
+/**
+ * Recording file layout, all fields little endian:
+ *
+ * header:  signature (4 bytes), version (2 bytes), reserved (2 bytes),
+ *          settingCount (2 bytes), settingCount * { id (2 bytes),
+ *          type (2 bytes), value (4 bytes) }, channelCount (4 bytes),
+ *          channelCount * { name (8 bytes), options (4 bytes) }
+ *
+ * record:  timestamp in ms since the start (4 bytes), channelId (2 bytes),
+ *          flags (2 bytes), length (4 bytes), PDU (length bytes)
+ */
+
+#define RECORDER_SIGNATURE		0x43455246 /* "FREC" */
+#define RECORDER_VERSION		1
+
+#define RECORDER_HEADER_LENGTH		10
+#define RECORDER_SETTING_LENGTH		8
+#define RECORDER_CHANNEL_LENGTH		12
+#define RECORDER_RECORD_LENGTH		12
+
+/* the TPKT length field bounds slow-path PDUs, fast-path ones are at most 0x8000 bytes */
+#define RECORDER_PDU_MAX_LENGTH		0xFFFF
+
+#define RECORDER_SETTING_BOOL		0
+#define RECORDER_SETTING_UINT32		1
+
+#define RECORDER_PDU_FASTPATH		0x0001
+
+struct rdp_recorder
+{
+	FILE* fp;
+	char* filename;
+	UINT64 start;
+	BOOL started;
+	UINT32 count;
+	wStream* buffer;
+};
+
+BOOL recorder_start(rdpRecorder* recorder, rdpSettings* settings);
+BOOL recorder_write_pdu(rdpRecorder* recorder, wStream* s);
+
+rdpRecorder* recorder_new(const char* filename);
+void recorder_free(rdpRecorder* recorder);
+
+#endif /* __RECORDER_H */
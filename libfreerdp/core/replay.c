@@ -0,0 +1,656 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Session Replay
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+#include <winpr/sysinfo.h>
+
+#ifndef _WIN32
+#include <time.h>
+#endif
+
+#include <openssl/bio.h>
+
+#include <freerdp/log.h>
+#include <freerdp/replay.h>
+#include <freerdp/gdi/gdi.h>
+#include <freerdp/cache/cache.h>
+
+#include "rdp.h"
+#include "update.h"
+#include "recorder.h"
+#include "connection.h"
+
+#define TAG FREERDP_TAG("core.replay")
+
+/**
+ * A recording is replayed into a client instance which has no network
+ * connection: the recorded PDUs are handed to the receive callback of its
+ * transport, as they were when they came off the wire, and whatever the
+ * client sends is written to a null BIO. The connection sequence is
+ * replayed as well, so the client ends up with exactly the state it had,
+ * and the software GDI renders the session once it is activated.
+ */
+
+struct rdp_replay_hooks
+{
+	pBitmapUpdate BitmapUpdate;
+	pSurfaceBits SurfaceBits;
+
+	pDstBlt DstBlt;
+	pPatBlt PatBlt;
+	pScrBlt ScrBlt;
+	pOpaqueRect OpaqueRect;
+	pDrawNineGrid DrawNineGrid;
+	pMultiDstBlt MultiDstBlt;
+	pMultiPatBlt MultiPatBlt;
+	pMultiScrBlt MultiScrBlt;
+	pMultiOpaqueRect MultiOpaqueRect;
+	pMultiDrawNineGrid MultiDrawNineGrid;
+	pLineTo LineTo;
+	pPolyline Polyline;
+	pMemBlt MemBlt;
+	pMem3Blt Mem3Blt;
+	pSaveBitmap SaveBitmap;
+	pGlyphIndex GlyphIndex;
+	pFastIndex FastIndex;
+	pFastGlyph FastGlyph;
+	pPolygonSC PolygonSC;
+	pPolygonCB PolygonCB;
+	pEllipseSC EllipseSC;
+	pEllipseCB EllipseCB;
+	pCreateOffscreenBitmap CreateOffscreenBitmap;
+	pSwitchSurface SwitchSurface;
+
+	pCacheBitmap CacheBitmap;
+	pCacheBitmapV2 CacheBitmapV2;
+	pCacheBitmapV3 CacheBitmapV3;
+	pCacheColorTable CacheColorTable;
+	pCacheGlyph CacheGlyph;
+	pCacheGlyphV2 CacheGlyphV2;
+	pCacheBrush CacheBrush;
+
+	pReceiveChannelData ReceiveChannelData;
+};
+
+struct rdp_replay
+{
+	FILE* fp;
+	char* filename;
+	freerdp* instance;
+	BIO* bio;
+	BOOL activated;
+	int depth;
+	struct rdp_replay_hooks hooks;
+	rdpReplayStats stats;
+};
+
+struct rdp_replay_context
+{
+	rdpContext _p;
+
+	rdpReplay* replay;
+};
+typedef struct rdp_replay_context rdpReplayContext;
+
+static const char* const REPLAY_STAGE_NAMES[REPLAY_STAGE_COUNT] =
+{
+	"protocol",
+	"surface",
+	"bitmap",
+	"orders",
+	"cache",
+	"channels"
+};
+
+static UINT64 replay_get_time(void)
+{
+#ifndef _WIN32
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (((UINT64) ts.tv_sec) * 1000000) + (ts.tv_nsec / 1000);
+#else
+	return GetTickCount64() * 1000;
+#endif
+}
+
+/**
+ * Stage accounting: a hook that runs inside another one is accounted to the
+ * outer stage only.
+ */
+
+static UINT64 replay_stage_begin(rdpReplay* replay)
+{
+	replay->depth++;
+	return replay_get_time();
+}
+
+static void replay_stage_end(rdpReplay* replay, int stage, UINT64 begin)
+{
+	replay->depth--;
+
+	if (replay->depth)
+		return;
+
+	replay->stats.calls[stage]++;
+	replay->stats.times[stage] += replay_get_time() - begin;
+}
+
+#define REPLAY_HOOK(_stage, _name, _type) \
+	static void replay_##_name(rdpContext* context, _type* order) \
+	{ \
+		rdpReplay* replay = ((rdpReplayContext*) context)->replay; \
+		UINT64 begin = replay_stage_begin(replay); \
+		replay->hooks._name(context, order); \
+		replay_stage_end(replay, _stage, begin); \
+	}
+
+#define REPLAY_INSTALL(_update, _name) \
+	replay->hooks._name = (_update)->_name; \
+	if (replay->hooks._name) \
+		(_update)->_name = replay_##_name
+
+REPLAY_HOOK(REPLAY_STAGE_BITMAP, BitmapUpdate, BITMAP_UPDATE)
+REPLAY_HOOK(REPLAY_STAGE_SURFACE, SurfaceBits, SURFACE_BITS_COMMAND)
+
+REPLAY_HOOK(REPLAY_STAGE_ORDERS, DstBlt, DSTBLT_ORDER)
+REPLAY_HOOK(REPLAY_STAGE_ORDERS, PatBlt, PATBLT_ORDER)
+REPLAY_HOOK(REPLAY_STAGE_ORDERS, ScrBlt, SCRBLT_ORDER)
+REPLAY_HOOK(REPLAY_STAGE_ORDERS, OpaqueRect, OPAQUE_RECT_ORDER)
+REPLAY_HOOK(REPLAY_STAGE_ORDERS, DrawNineGrid, DRAW_NINE_GRID_ORDER)
+REPLAY_HOOK(REPLAY_STAGE_ORDERS, MultiDstBlt, MULTI_DSTBLT_ORDER)
+REPLAY_HOOK(REPLAY_STAGE_ORDERS, MultiPatBlt, MULTI_PATBLT_ORDER)
+REPLAY_HOOK(REPLAY_STAGE_ORDERS, MultiScrBlt, MULTI_SCRBLT_ORDER)
+REPLAY_HOOK(REPLAY_STAGE_ORDERS, MultiOpaqueRect, MULTI_OPAQUE_RECT_ORDER)
+REPLAY_HOOK(REPLAY_STAGE_ORDERS, MultiDrawNineGrid, MULTI_DRAW_NINE_GRID_ORDER)
+REPLAY_HOOK(REPLAY_STAGE_ORDERS, LineTo, LINE_TO_ORDER)
+REPLAY_HOOK(REPLAY_STAGE_ORDERS, Polyline, POLYLINE_ORDER)
+REPLAY_HOOK(REPLAY_STAGE_ORDERS, MemBlt, MEMBLT_ORDER)
+REPLAY_HOOK(REPLAY_STAGE_ORDERS, Mem3Blt, MEM3BLT_ORDER)
+REPLAY_HOOK(REPLAY_STAGE_ORDERS, SaveBitmap, SAVE_BITMAP_ORDER)
+REPLAY_HOOK(REPLAY_STAGE_ORDERS, GlyphIndex, GLYPH_INDEX_ORDER)
+REPLAY_HOOK(REPLAY_STAGE_ORDERS, FastIndex, FAST_INDEX_ORDER)
+REPLAY_HOOK(REPLAY_STAGE_ORDERS, FastGlyph, FAST_GLYPH_ORDER)
+REPLAY_HOOK(REPLAY_STAGE_ORDERS, PolygonSC, POLYGON_SC_ORDER)
+REPLAY_HOOK(REPLAY_STAGE_ORDERS, PolygonCB, POLYGON_CB_ORDER)
+REPLAY_HOOK(REPLAY_STAGE_ORDERS, EllipseSC, ELLIPSE_SC_ORDER)
+REPLAY_HOOK(REPLAY_STAGE_ORDERS, EllipseCB, ELLIPSE_CB_ORDER)
+REPLAY_HOOK(REPLAY_STAGE_ORDERS, CreateOffscreenBitmap, CREATE_OFFSCREEN_BITMAP_ORDER)
+REPLAY_HOOK(REPLAY_STAGE_ORDERS, SwitchSurface, SWITCH_SURFACE_ORDER)
+
+REPLAY_HOOK(REPLAY_STAGE_CACHE, CacheBitmap, CACHE_BITMAP_ORDER)
+REPLAY_HOOK(REPLAY_STAGE_CACHE, CacheBitmapV2, CACHE_BITMAP_V2_ORDER)
+REPLAY_HOOK(REPLAY_STAGE_CACHE, CacheBitmapV3, CACHE_BITMAP_V3_ORDER)
+REPLAY_HOOK(REPLAY_STAGE_CACHE, CacheColorTable, CACHE_COLOR_TABLE_ORDER)
+REPLAY_HOOK(REPLAY_STAGE_CACHE, CacheGlyph, CACHE_GLYPH_ORDER)
+REPLAY_HOOK(REPLAY_STAGE_CACHE, CacheGlyphV2, CACHE_GLYPH_V2_ORDER)
+REPLAY_HOOK(REPLAY_STAGE_CACHE, CacheBrush, CACHE_BRUSH_ORDER)
+
+static int replay_ReceiveChannelData(freerdp* instance, UINT16 channelId, BYTE* data, int size, int flags, int totalSize)
+{
+	int status;
+	rdpReplay* replay = ((rdpReplayContext*) instance->context)->replay;
+	UINT64 begin = replay_stage_begin(replay);
+
+	status = replay->hooks.ReceiveChannelData(instance, channelId, data, size, flags, totalSize);
+
+	replay_stage_end(replay, REPLAY_STAGE_CHANNELS, begin);
+
+	return status;
+}
+
+static void replay_desktop_resize(rdpContext* context)
+{
+	gdi_resize(context->gdi, context->settings->DesktopWidth, context->settings->DesktopHeight);
+}
+
+static void replay_install_hooks(rdpReplay* replay)
+{
+	freerdp* instance = replay->instance;
+	rdpUpdate* update = instance->update;
+
+	REPLAY_INSTALL(update, BitmapUpdate);
+	REPLAY_INSTALL(update, SurfaceBits);
+
+	REPLAY_INSTALL(update->primary, DstBlt);
+	REPLAY_INSTALL(update->primary, PatBlt);
+	REPLAY_INSTALL(update->primary, ScrBlt);
+	REPLAY_INSTALL(update->primary, OpaqueRect);
+	REPLAY_INSTALL(update->primary, DrawNineGrid);
+	REPLAY_INSTALL(update->primary, MultiDstBlt);
+	REPLAY_INSTALL(update->primary, MultiPatBlt);
+	REPLAY_INSTALL(update->primary, MultiScrBlt);
+	REPLAY_INSTALL(update->primary, MultiOpaqueRect);
+	REPLAY_INSTALL(update->primary, MultiDrawNineGrid);
+	REPLAY_INSTALL(update->primary, LineTo);
+	REPLAY_INSTALL(update->primary, Polyline);
+	REPLAY_INSTALL(update->primary, MemBlt);
+	REPLAY_INSTALL(update->primary, Mem3Blt);
+	REPLAY_INSTALL(update->primary, SaveBitmap);
+	REPLAY_INSTALL(update->primary, GlyphIndex);
+	REPLAY_INSTALL(update->primary, FastIndex);
+	REPLAY_INSTALL(update->primary, FastGlyph);
+	REPLAY_INSTALL(update->primary, PolygonSC);
+	REPLAY_INSTALL(update->primary, PolygonCB);
+	REPLAY_INSTALL(update->primary, EllipseSC);
+	REPLAY_INSTALL(update->primary, EllipseCB);
+	REPLAY_INSTALL(update->altsec, CreateOffscreenBitmap);
+	REPLAY_INSTALL(update->altsec, SwitchSurface);
+
+	REPLAY_INSTALL(update->secondary, CacheBitmap);
+	REPLAY_INSTALL(update->secondary, CacheBitmapV2);
+	REPLAY_INSTALL(update->secondary, CacheBitmapV3);
+	REPLAY_INSTALL(update->secondary, CacheColorTable);
+	REPLAY_INSTALL(update->secondary, CacheGlyph);
+	REPLAY_INSTALL(update->secondary, CacheGlyphV2);
+	REPLAY_INSTALL(update->secondary, CacheBrush);
+
+	REPLAY_INSTALL(instance, ReceiveChannelData);
+}
+
+static BOOL replay_read_header(rdpReplay* replay)
+{
+	UINT16 id;
+	UINT16 type;
+	UINT32 value;
+	UINT32 index;
+	UINT16 version;
+	UINT32 signature;
+	UINT16 settingCount;
+	UINT32 channelCount;
+	BYTE buffer[RECORDER_CHANNEL_LENGTH];
+	wStream* s;
+	rdpSettings* settings = replay->instance->settings;
+
+	s = Stream_New(buffer, sizeof(buffer));
+
+	if (!s)
+		return FALSE;
+
+	if (fread(buffer, RECORDER_HEADER_LENGTH, 1, replay->fp) != 1)
+		goto fail;
+
+	Stream_Read_UINT32(s, signature); /* signature (4 bytes) */
+	Stream_Read_UINT16(s, version); /* version (2 bytes) */
+	Stream_Seek_UINT16(s); /* reserved (2 bytes) */
+	Stream_Read_UINT16(s, settingCount); /* settingCount (2 bytes) */
+
+	if ((signature != RECORDER_SIGNATURE) || (version != RECORDER_VERSION))
+	{
+		WLog_ERR(TAG, "%s is not a session recording", replay->filename);
+		goto fail;
+	}
+
+	for (index = 0; index < settingCount; index++)
+	{
+		Stream_SetPosition(s, 0);
+
+		if (fread(buffer, RECORDER_SETTING_LENGTH, 1, replay->fp) != 1)
+			goto fail;
+
+		Stream_Read_UINT16(s, id); /* id (2 bytes) */
+		Stream_Read_UINT16(s, type); /* type (2 bytes) */
+		Stream_Read_UINT32(s, value); /* value (4 bytes) */
+
+		if (type == RECORDER_SETTING_BOOL)
+			freerdp_set_param_bool(settings, id, value ? TRUE : FALSE);
+		else if (type == RECORDER_SETTING_UINT32)
+			freerdp_set_param_uint32(settings, id, value);
+	}
+
+	Stream_SetPosition(s, 0);
+
+	if (fread(buffer, 4, 1, replay->fp) != 1)
+		goto fail;
+
+	Stream_Read_UINT32(s, channelCount); /* channelCount (4 bytes) */
+
+	if (channelCount > settings->ChannelDefArraySize)
+		goto fail;
+
+	for (index = 0; index < channelCount; index++)
+	{
+		Stream_SetPosition(s, 0);
+
+		if (fread(buffer, RECORDER_CHANNEL_LENGTH, 1, replay->fp) != 1)
+			goto fail;
+
+		ZeroMemory(&settings->ChannelDefArray[index], sizeof(CHANNEL_DEF));
+		Stream_Read(s, settings->ChannelDefArray[index].name, 8); /* name (8 bytes) */
+		Stream_Read_UINT32(s, settings->ChannelDefArray[index].options); /* options (4 bytes) */
+		settings->ChannelDefArray[index].name[7] = '\0';
+	}
+
+	settings->ChannelCount = channelCount;
+
+	Stream_Free(s, FALSE);
+	return TRUE;
+
+fail:
+	WLog_ERR(TAG, "invalid session recording header in %s", replay->filename);
+	Stream_Free(s, FALSE);
+	return FALSE;
+}
+
+/**
+ * Reads the next record, returns 1 if one was read, 0 at the end of the
+ * recording and -1 on a truncated or invalid record.
+ */
+
+static int replay_read_record(rdpReplay* replay, wStream* header, wStream** pdu, UINT32* timestamp)
+{
+	UINT32 length;
+	wStream* s;
+	rdpTransport* transport = replay->instance->context->rdp->transport;
+
+	Stream_SetPosition(header, 0);
+
+	if (fread(Stream_Buffer(header), RECORDER_RECORD_LENGTH, 1, replay->fp) != 1)
+		return feof(replay->fp) ? 0 : -1;
+
+	Stream_Read_UINT32(header, *timestamp); /* timestamp (4 bytes) */
+	Stream_Seek_UINT16(header); /* channelId (2 bytes) */
+	Stream_Seek_UINT16(header); /* flags (2 bytes) */
+	Stream_Read_UINT32(header, length); /* length (4 bytes) */
+
+	if (length > RECORDER_PDU_MAX_LENGTH)
+	{
+		WLog_ERR(TAG, "invalid record length %u in %s", length, replay->filename);
+		return -1;
+	}
+
+	s = StreamPool_Take(transport->ReceivePool, length);
+
+	if (!s)
+		return -1;
+
+	if (length && (fread(Stream_Buffer(s), length, 1, replay->fp) != 1))
+	{
+		Stream_Release(s);
+		return -1;
+	}
+
+	Stream_SetLength(s, length);
+	Stream_SetPosition(s, 0);
+	*pdu = s;
+
+	return 1;
+}
+
+static BOOL replay_connect(rdpReplay* replay)
+{
+	rdpRdp* rdp = replay->instance->context->rdp;
+	rdpTransport* transport = rdp->transport;
+
+	replay->bio = BIO_new(BIO_s_null());
+
+	if (!replay->bio)
+		return FALSE;
+
+	transport->frontBio = replay->bio;
+	transport->TcpOut = transport->TcpIn;
+
+	rdp->nego->SelectedProtocol = rdp->settings->SelectedProtocol;
+	rdp_set_blocking_mode(rdp, FALSE);
+
+	rdp_client_transition_to_state(rdp, CONNECTION_STATE_NEGO);
+	rdp->finalize_sc_pdus = 0;
+
+	return mcs_send_connect_initial(rdp->mcs);
+}
+
+static BOOL replay_post_connect(rdpReplay* replay)
+{
+	freerdp* instance = replay->instance;
+
+	if (gdi_init(instance, CLRCONV_ALPHA | CLRBUF_32BPP, NULL) < 0)
+		return FALSE;
+
+	replay_install_hooks(replay);
+	instance->update->DesktopResize = replay_desktop_resize;
+
+	update_post_connect(instance->update);
+	replay->activated = TRUE;
+
+	return TRUE;
+}
+
+/**
+ * Replays the whole recording, either as fast as possible or at the pace
+ * it was recorded at, and accounts the time spent to the stages.
+ */
+
+int freerdp_replay_run(rdpReplay* replay, BOOL realtime)
+{
+	int index;
+	int status;
+	UINT64 now;
+	UINT64 start;
+	UINT64 begin;
+	UINT64 staged = 0;
+	UINT32 timestamp;
+	wStream* pdu = NULL;
+	wStream* header;
+	rdpRdp* rdp = replay->instance->context->rdp;
+	rdpTransport* transport = rdp->transport;
+
+	header = Stream_New(NULL, RECORDER_RECORD_LENGTH);
+
+	if (!header)
+		return -1;
+
+	if (!replay_connect(replay))
+	{
+		WLog_ERR(TAG, "failed to start the replay of %s", replay->filename);
+		Stream_Free(header, TRUE);
+		return -1;
+	}
+
+	start = replay_get_time();
+
+	while ((status = replay_read_record(replay, header, &pdu, &timestamp)) > 0)
+	{
+		if (realtime)
+		{
+			now = replay_get_time();
+
+			if ((now - start) < ((UINT64) timestamp * 1000))
+				Sleep((DWORD) ((((UINT64) timestamp * 1000) - (now - start)) / 1000));
+		}
+
+		replay->stats.pdus++;
+		replay->stats.bytes += Stream_Length(pdu);
+
+		begin = replay_get_time();
+		status = transport->ReceiveCallback(transport, pdu, transport->ReceiveExtra);
+		replay->stats.busy += replay_get_time() - begin;
+
+		Stream_Release(pdu);
+
+		if (status < 0)
+		{
+			WLog_ERR(TAG, "replay of PDU %u failed", replay->stats.pdus);
+			break;
+		}
+
+		if (status == 1)
+		{
+			WLog_ERR(TAG, "PDU %u redirects the session, which cannot be replayed", replay->stats.pdus);
+			status = -1;
+			break;
+		}
+
+		if (!replay->activated && (rdp->state == CONNECTION_STATE_ACTIVE))
+		{
+			if (!replay_post_connect(replay))
+			{
+				status = -1;
+				break;
+			}
+		}
+	}
+
+	if (status < 0)
+		WLog_ERR(TAG, "replay of %s stopped at PDU %u", replay->filename, replay->stats.pdus);
+
+	replay->stats.elapsed = replay_get_time() - start;
+
+	for (index = REPLAY_STAGE_PROTOCOL + 1; index < REPLAY_STAGE_COUNT; index++)
+		staged += replay->stats.times[index];
+
+	replay->stats.calls[REPLAY_STAGE_PROTOCOL] = replay->stats.pdus;
+	replay->stats.times[REPLAY_STAGE_PROTOCOL] = (replay->stats.busy > staged) ? replay->stats.busy - staged : 0;
+
+	Stream_Free(header, TRUE);
+
+	return (status < 0) ? -1 : 0;
+}
+
+freerdp* freerdp_replay_get_instance(rdpReplay* replay)
+{
+	return replay->instance;
+}
+
+const rdpReplayStats* freerdp_replay_get_stats(rdpReplay* replay)
+{
+	return &replay->stats;
+}
+
+const char* freerdp_replay_get_stage_name(int stage)
+{
+	if ((stage < 0) || (stage >= REPLAY_STAGE_COUNT))
+		return "unknown";
+
+	return REPLAY_STAGE_NAMES[stage];
+}
+
+void freerdp_replay_print_stats(rdpReplay* replay)
+{
+	int index;
+	rdpReplayStats* stats = &replay->stats;
+
+	WLog_INFO(TAG, "%s: %u PDUs, %llu bytes, %llu.%03llu ms elapsed, %llu.%03llu ms busy",
+			replay->filename, stats->pdus, (unsigned long long) stats->bytes,
+			(unsigned long long) (stats->elapsed / 1000), (unsigned long long) (stats->elapsed % 1000),
+			(unsigned long long) (stats->busy / 1000), (unsigned long long) (stats->busy % 1000));
+
+	for (index = 0; index < REPLAY_STAGE_COUNT; index++)
+	{
+		WLog_INFO(TAG, "%-10s %8u calls %8llu.%03llu ms %5.1f%%", REPLAY_STAGE_NAMES[index], stats->calls[index],
+				(unsigned long long) (stats->times[index] / 1000), (unsigned long long) (stats->times[index] % 1000),
+				stats->busy ? (100.0 * stats->times[index]) / stats->busy : 0.0);
+	}
+}
+
+rdpReplay* freerdp_replay_new(const char* filename)
+{
+	rdpReplay* replay;
+	rdpSettings* settings;
+
+	replay = (rdpReplay*) calloc(1, sizeof(rdpReplay));
+
+	if (!replay)
+		return NULL;
+
+	replay->filename = _strdup(filename);
+	replay->fp = fopen(filename, "rb");
+
+	if (!replay->filename || !replay->fp)
+	{
+		WLog_ERR(TAG, "failed to open the session recording %s", filename);
+		goto fail;
+	}
+
+	replay->instance = freerdp_new();
+
+	if (!replay->instance)
+		goto fail;
+
+	replay->instance->ContextSize = sizeof(rdpReplayContext);
+
+	if (freerdp_context_new(replay->instance) < 0)
+		goto fail;
+
+	((rdpReplayContext*) replay->instance->context)->replay = replay;
+
+	if (!replay_read_header(replay))
+		goto fail;
+
+	/* nothing the replayed client does may reach the network */
+	settings = replay->instance->settings;
+	settings->SupportMultitransport = FALSE;
+	settings->AutoReconnectionEnabled = FALSE;
+	settings->AsyncUpdate = FALSE;
+	settings->AsyncInput = FALSE;
+	settings->AsyncChannels = FALSE;
+	settings->AsyncTransport = FALSE;
+	settings->SoftwareGdi = TRUE;
+
+	return replay;
+
+fail:
+	freerdp_replay_free(replay);
+	return NULL;
+}
+
+void freerdp_replay_free(rdpReplay* replay)
+{
+	freerdp* instance;
+
+	if (!replay)
+		return;
+
+	instance = replay->instance;
+
+	if (instance)
+	{
+		if (instance->context)
+		{
+			if (instance->context->gdi)
+				gdi_free(instance);
+
+			if (instance->context->cache)
+			{
+				cache_free(instance->context->cache);
+				instance->context->cache = NULL;
+			}
+
+			/* the null BIO belongs to the replay, not to the transport */
+			instance->context->rdp->transport->frontBio = NULL;
+			freerdp_context_free(instance);
+		}
+
+		freerdp_free(instance);
+	}
+
+	if (replay->bio)
+		BIO_free(replay->bio);
+
+	if (replay->fp)
+		fclose(replay->fp);
+
+	free(replay->filename);
+	free(replay);
+}
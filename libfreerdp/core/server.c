@@ -992,6 +992,7 @@ HANDLE WINAPI FreeRDP_WTSVirtualChannelOpenEx(DWORD SessionId, LPSTR pVirtualNam
 	channel->queue = MessageQueue_New(NULL);
 
 	channel->channelId = InterlockedIncrement(&vcm->dvc_channel_id_seq);
+	channel->tunnelProtocol = multitransport_get_channel_route(client->context->rdp->multitransport, pVirtualName);
 	ArrayList_Add(vcm->dynamicVirtualChannels, channel);
 
 	s = Stream_New(NULL, 64);
@@ -1097,6 +1098,8 @@ BOOL WINAPI FreeRDP_WTSVirtualChannelWrite(HANDLE hChannelHandle, PCHAR Buffer,
 	BYTE* buffer;
 	UINT32 length;
 	UINT32 written;
+	UINT32 chunkSize;
+	rdpMultitransport* multitransport;
 	rdpPeerChannel* channel = (rdpPeerChannel*) hChannelHandle;
 
 	if (!channel)
@@ -1118,10 +1121,32 @@ BOOL WINAPI FreeRDP_WTSVirtualChannelWrite(HANDLE hChannelHandle, PCHAR Buffer,
 	else
 	{
 		first = TRUE;
+		chunkSize = channel->client->settings->VirtualChannelChunkSize;
+		multitransport = channel->client->context->rdp->multitransport;
+
+		/**
+		 * The route is chosen once, at the first write after the channel opened,
+		 * so that the messages of a channel never overtake each other.
+		 */
+
+		if (!channel->tunnelDecided && (channel->dvc_open_state == DVC_OPEN_STATE_SUCCEEDED))
+		{
+			channel->tunnelDecided = TRUE;
+			channel->tunnelRouted = channel->tunnelProtocol &&
+					multitransport_is_connected(multitransport, channel->tunnelProtocol);
+		}
+
+		if (channel->tunnelRouted)
+		{
+			length = (UINT32) multitransport_get_max_payload(multitransport, channel->tunnelProtocol);
+
+			if (length < chunkSize)
+				chunkSize = length;
+		}
 
 		while (Length > 0)
 		{
-			s = Stream_New(NULL, channel->client->settings->VirtualChannelChunkSize);
+			s = Stream_New(NULL, chunkSize);
 			buffer = Stream_Buffer(s);
 
 			Stream_Seek_UINT8(s);
@@ -1150,6 +1175,18 @@ BOOL WINAPI FreeRDP_WTSVirtualChannelWrite(HANDLE hChannelHandle, PCHAR Buffer,
 			Length -= written;
 			Buffer += written;
 
+			if (channel->tunnelRouted)
+			{
+				if (multitransport_write(multitransport, channel->tunnelProtocol, buffer, length) >= 0)
+				{
+					free(buffer);
+					continue;
+				}
+
+				WLog_WARN(TAG, "multitransport write failed, channel %d falls back to TCP", channel->channelId);
+				channel->tunnelRouted = FALSE;
+			}
+
 			wts_queue_send_item(channel->vcm->drdynvc_channel, buffer, length);
 		}
 	}
@@ -78,6 +78,10 @@ struct rdp_peer_channel
 	BYTE dvc_open_state;
 	UINT32 dvc_total_length;
 	rdpMcsChannel* mcsChannel;
+
+	UINT16 tunnelProtocol;
+	BOOL tunnelDecided;
+	BOOL tunnelRouted;
 };
 
 struct WTSVirtualChannelManager
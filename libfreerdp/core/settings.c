@@ -409,6 +409,11 @@ rdpSettings* freerdp_settings_new(DWORD flags)
 		settings->AutoReconnectionEnabled = FALSE;
 		settings->AutoReconnectMaxRetries = 20;
 
+		/* servers send no heartbeat unless a period (in seconds) is set */
+		settings->HeartbeatPeriod = 0;
+		settings->HeartbeatWarningCount = 3;
+		settings->HeartbeatReconnectCount = 6;
+
 		settings->GfxThinClient = TRUE;
 		settings->GfxSmallCache = FALSE;
 		settings->GfxProgressive = FALSE;
@@ -501,6 +506,7 @@ rdpSettings* freerdp_settings_clone(rdpSettings* settings)
 		_settings->CurrentPath = _strdup(settings->CurrentPath); /* 1794 */
 		_settings->DumpRemoteFxFile = _strdup(settings->DumpRemoteFxFile); /* 1858 */
 		_settings->PlayRemoteFxFile = _strdup(settings->PlayRemoteFxFile); /* 1859 */
+		_settings->SessionRecordingFile = _strdup(settings->SessionRecordingFile); /* 1861 */
 		_settings->GatewayHostname = _strdup(settings->GatewayHostname); /* 1986 */
 		_settings->GatewayUsername = _strdup(settings->GatewayUsername); /* 1987 */
 		_settings->GatewayPassword = _strdup(settings->GatewayPassword); /* 1988 */
@@ -511,6 +517,7 @@ rdpSettings* freerdp_settings_clone(rdpSettings* settings)
 		_settings->RemoteApplicationFile = _strdup(settings->RemoteApplicationFile); /* 2116 */
 		_settings->RemoteApplicationGuid = _strdup(settings->RemoteApplicationGuid); /* 2117 */
 		_settings->RemoteApplicationCmdLine = _strdup(settings->RemoteApplicationCmdLine); /* 2118 */
+		_settings->BitmapCachePersistFile = _strdup(settings->BitmapCachePersistFile); /* 2503 */
 		_settings->ImeFileName = _strdup(settings->ImeFileName); /* 2628 */
 		_settings->DrivesToRedirect = _strdup(settings->DrivesToRedirect); /* 4290 */
 
@@ -673,6 +680,7 @@ void freerdp_settings_free(rdpSettings* settings)
 		free(settings->ServerAutoReconnectCookie);
 		free(settings->ClientTimeZone);
 		free(settings->BitmapCacheV2CellInfo);
+		free(settings->BitmapCachePersistFile);
 		free(settings->GlyphCache);
 		free(settings->FragCache);
 		key_free(settings->RdpServerRsaKey);
@@ -693,6 +701,7 @@ void freerdp_settings_free(rdpSettings* settings)
 		free(settings->GatewayUsername);
 		free(settings->GatewayPassword);
 		free(settings->GatewayDomain);
+		free(settings->SessionRecordingFile);
 		freerdp_target_net_addresses_free(settings);
 		freerdp_device_collection_free(settings);
 		freerdp_static_channel_collection_free(settings);
@@ -0,0 +1,390 @@
+
+#include <stdio.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+#include <winpr/sysinfo.h>
+#include <winpr/collections.h>
+
+#include <freerdp/freerdp.h>
+#include <freerdp/autodetect.h>
+
+#include "heartbeat.h"
+
+#define TEST_PERIOD		1
+#define TEST_WARNING_COUNT	1
+#define TEST_RECONNECT_COUNT	2
+
+#define TEST_SLICE		50
+
+#define TEST_HEALTHY_TIME	2500
+#define TEST_CLIENT_TIMEOUT	3500
+#define TEST_RECOVERY_TIMEOUT	1500
+#define TEST_SERVER_TIMEOUT	5000
+
+/**
+ * A server and a client connection are emulated in-process: the message
+ * channel PDUs of each side are posted to the other side's wire queue, and
+ * a side is paused by no longer servicing its wire and its heartbeat timer,
+ * which is what a stopped peer looks like from the other end.
+ */
+
+struct test_side
+{
+	rdpRdp rdp;
+	rdpMcs mcs;
+	rdpContext context;
+	rdpSettings* settings;
+	rdpAutoDetect autodetect;
+	freerdp instance;
+	wMessageQueue* wire;
+	BOOL paused;
+	BOOL dead;
+};
+
+struct test_report
+{
+	UINT32 missed;
+	BOOL reconnect;
+	UINT32 time;
+};
+
+static struct test_side g_Server;
+static struct test_side g_Client;
+
+static struct test_report g_Reports[16];
+static int g_ReportCount = 0;
+
+wStream* rdp_message_channel_pdu_init(rdpRdp* rdp)
+{
+	return Stream_New(NULL, 64);
+}
+
+BOOL rdp_send_message_channel_pdu(rdpRdp* rdp, wStream* s, UINT16 sec_flags)
+{
+	struct test_side* peer = (rdp == &g_Server.rdp) ? &g_Client : &g_Server;
+
+	Stream_SealLength(s);
+	Stream_SetPosition(s, 0);
+
+	MessageQueue_Post(peer->wire, NULL, 0, (void*) s, (void*) (size_t) sec_flags);
+
+	return TRUE;
+}
+
+static BOOL test_rtt_measure_request(rdpContext* context, UINT16 sequenceNumber)
+{
+	wStream* s = rdp_message_channel_pdu_init(context->rdp);
+
+	if (!s)
+		return FALSE;
+
+	Stream_Write_UINT16(s, sequenceNumber);
+
+	return rdp_send_message_channel_pdu(context->rdp, s, SEC_AUTODETECT_REQ);
+}
+
+static BOOL test_heartbeat_missed(freerdp* instance, UINT32 missed, BOOL reconnect)
+{
+	if (g_ReportCount < 16)
+	{
+		g_Reports[g_ReportCount].missed = missed;
+		g_Reports[g_ReportCount].reconnect = reconnect;
+		g_Reports[g_ReportCount].time = GetTickCount();
+		g_ReportCount++;
+	}
+
+	return TRUE;
+}
+
+/**
+ * Swaps the timerfd for the timer queue timer used where there is no timerfd.
+ */
+
+static BOOL test_use_timer_queue(rdpHeartbeat* heartbeat)
+{
+	if (heartbeat->timerfd < 0)
+		return TRUE;
+
+	CloseHandle(heartbeat->event);
+#ifndef _WIN32
+	close(heartbeat->timerfd);
+#endif
+	heartbeat->timerfd = -1;
+	heartbeat->event = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+	return heartbeat->event ? TRUE : FALSE;
+}
+
+static BOOL test_side_init(struct test_side* side, BOOL server, BOOL timerQueue)
+{
+	rdpSettings* settings;
+
+	side->settings = settings = (rdpSettings*) calloc(1, sizeof(rdpSettings));
+	side->wire = MessageQueue_New(NULL);
+	side->rdp.heartbeat = heartbeat_new();
+
+	if (!settings || !side->wire || !side->rdp.heartbeat)
+		return FALSE;
+
+	if (timerQueue && !test_use_timer_queue(side->rdp.heartbeat))
+		return FALSE;
+
+	side->mcs.messageChannelId = 1007;
+	side->context.rdp = &side->rdp;
+	side->instance.context = &side->context;
+	side->instance.HeartbeatMissed = test_heartbeat_missed;
+
+	side->rdp.settings = settings;
+	side->rdp.mcs = &side->mcs;
+	side->rdp.context = &side->context;
+
+	settings->ServerMode = server;
+	settings->HeartbeatPeriod = TEST_PERIOD;
+	settings->HeartbeatWarningCount = TEST_WARNING_COUNT;
+	settings->HeartbeatReconnectCount = TEST_RECONNECT_COUNT;
+	settings->SupportHeartbeatPdu = TRUE;
+	settings->NetworkAutoDetect = TRUE;
+	settings->AutoReconnectionEnabled = TRUE;
+
+	if (server)
+	{
+		side->autodetect.RTTMeasureRequest = test_rtt_measure_request;
+		side->rdp.autodetect = &side->autodetect;
+	}
+	else
+	{
+		side->rdp.instance = &side->instance;
+	}
+
+	return TRUE;
+}
+
+static void test_side_uninit(struct test_side* side)
+{
+	wMessage message;
+
+	if (side->wire)
+	{
+		while (MessageQueue_Peek(side->wire, &message, TRUE))
+			Stream_Free((wStream*) message.wParam, TRUE);
+
+		MessageQueue_Free(side->wire);
+	}
+
+	heartbeat_free(side->rdp.heartbeat);
+	free(side->settings);
+	ZeroMemory(side, sizeof(struct test_side));
+}
+
+static int test_side_service(struct test_side* side)
+{
+	wStream* s;
+	UINT16 flags;
+	UINT16 sequenceNumber;
+	wMessage message;
+	wStream* response;
+	int status = 0;
+
+	while (MessageQueue_Peek(side->wire, &message, TRUE))
+	{
+		s = (wStream*) message.wParam;
+		flags = (UINT16) (size_t) message.lParam;
+
+		if (side->rdp.settings->ServerMode)
+		{
+			heartbeat_activity(side->rdp.heartbeat);
+		}
+		else if (flags & SEC_HEARTBEAT)
+		{
+			if (rdp_recv_heartbeat_packet(&side->rdp, s) < 0)
+				status = -1;
+		}
+		else if (flags & SEC_AUTODETECT_REQ)
+		{
+			Stream_Read_UINT16(s, sequenceNumber);
+			response = rdp_message_channel_pdu_init(&side->rdp);
+
+			if (response)
+			{
+				Stream_Write_UINT16(response, sequenceNumber);
+				rdp_send_message_channel_pdu(&side->rdp, response, SEC_AUTODETECT_RSP);
+			}
+		}
+
+		Stream_Free(s, TRUE);
+	}
+
+	if (heartbeat_check(&side->rdp) < 0)
+		status = -1;
+
+	return status;
+}
+
+/**
+ * Runs both sides until the deadline or until the predicate holds,
+ * returns the time it took or -1 on timeout.
+ */
+
+static int test_run(UINT32 timeout, BOOL (*done)(void))
+{
+	DWORD nCount;
+	HANDLE events[4];
+	struct test_side* side;
+	struct test_side* sides[2] = { &g_Server, &g_Client };
+	UINT32 start = GetTickCount();
+	int index;
+
+	while ((GetTickCount() - start) < timeout)
+	{
+		if (done && done())
+			return (int) (GetTickCount() - start);
+
+		nCount = 0;
+
+		for (index = 0; index < 2; index++)
+		{
+			side = sides[index];
+
+			if (side->paused)
+				continue;
+
+			events[nCount++] = MessageQueue_Event(side->wire);
+			events[nCount++] = heartbeat_get_event_handle(side->rdp.heartbeat);
+		}
+
+		if (nCount)
+			WaitForMultipleObjects(nCount, events, FALSE, TEST_SLICE);
+		else
+			Sleep(TEST_SLICE);
+
+		for (index = 0; index < 2; index++)
+		{
+			side = sides[index];
+
+			if (!side->paused && (test_side_service(side) < 0))
+				side->dead = TRUE;
+		}
+	}
+
+	if (done && done())
+		return (int) (GetTickCount() - start);
+
+	return done ? -1 : (int) timeout;
+}
+
+static BOOL test_client_reconnecting(void)
+{
+	return g_Client.dead;
+}
+
+static BOOL test_client_recovered(void)
+{
+	return (g_ReportCount > 0) && (g_Reports[g_ReportCount - 1].missed == 0);
+}
+
+static BOOL test_server_dropped(void)
+{
+	return g_Server.dead;
+}
+
+static int test_heartbeat(BOOL timerQueue)
+{
+	int status = -1;
+	int elapsed;
+	UINT32 pausedAt;
+
+	g_ReportCount = 0;
+	printf("%s:\n", timerQueue ? "timer queue" : "native timer");
+
+	if (!test_side_init(&g_Server, TRUE, timerQueue) || !test_side_init(&g_Client, FALSE, timerQueue))
+	{
+		printf("initialization failed\n");
+		goto out;
+	}
+
+	if (!heartbeat_start(&g_Server.rdp))
+	{
+		printf("heartbeat_start failed\n");
+		goto out;
+	}
+
+	/* a healthy connection: no warning and neither side gives up */
+	test_run(TEST_HEALTHY_TIME, NULL);
+
+	if (g_ReportCount || g_Server.dead || g_Client.dead)
+	{
+		printf("healthy connection: %d reports, server dead %d, client dead %d\n",
+				g_ReportCount, g_Server.dead, g_Client.dead);
+		goto out;
+	}
+
+	/* stalled server: the client warns after count1 periods and reconnects after count2 */
+	g_Server.paused = TRUE;
+	pausedAt = GetTickCount();
+	elapsed = test_run(TEST_CLIENT_TIMEOUT, test_client_reconnecting);
+
+	if (elapsed < 0)
+	{
+		printf("client did not detect the stalled server\n");
+		goto out;
+	}
+
+	if ((g_ReportCount != 2) || (g_Reports[0].missed != TEST_WARNING_COUNT) || g_Reports[0].reconnect ||
+			(g_Reports[1].missed != TEST_RECONNECT_COUNT) || !g_Reports[1].reconnect)
+	{
+		printf("unexpected client reports (%d)\n", g_ReportCount);
+		goto out;
+	}
+
+	printf("stalled server: warning after %u ms, reconnect after %d ms\n",
+			g_Reports[0].time - pausedAt, elapsed);
+
+	/* the server comes back: the client reports the recovery */
+	g_Server.paused = FALSE;
+	g_Client.dead = FALSE;
+	elapsed = test_run(TEST_RECOVERY_TIMEOUT, test_client_recovered);
+
+	if ((elapsed < 0) || g_Server.dead)
+	{
+		printf("client did not recover\n");
+		goto out;
+	}
+
+	printf("server resumed: recovery reported after %d ms\n", elapsed);
+
+	/* stalled client: the server closes the connection after the unanswered probes */
+	g_ReportCount = 0;
+	g_Client.paused = TRUE;
+	elapsed = test_run(TEST_SERVER_TIMEOUT, test_server_dropped);
+
+	if (elapsed < 0)
+	{
+		printf("server did not detect the stalled client\n");
+		goto out;
+	}
+
+	printf("stalled client: dropped after %d ms\n", elapsed);
+
+	status = 0;
+
+out:
+	test_side_uninit(&g_Client);
+	test_side_uninit(&g_Server);
+	return status;
+}
+
+int TestCoreHeartbeat(int argc, char* argv[])
+{
+	if (test_heartbeat(FALSE) < 0)
+		return -1;
+
+	if (test_heartbeat(TRUE) < 0)
+		return -1;
+
+	return 0;
+}
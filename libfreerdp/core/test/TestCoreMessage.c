@@ -0,0 +1,210 @@
+#include <stdio.h>
+
+#include <winpr/crt.h>
+#include <winpr/stream.h>
+#include <winpr/interlocked.h>
+#include <winpr/collections.h>
+
+#include "message.h"
+#include "surface.h"
+
+#define TEST_CHECK(_expr) \
+	do { \
+		if (!(_expr)) { \
+			fprintf(stderr, "%s:%d: check failed: %s\n", __FUNCTION__, __LINE__, #_expr); \
+			return -1; \
+		} \
+	} while (0)
+
+#define TEST_FRAMES		256
+#define TEST_PAYLOAD		65536
+
+/**
+ * message.c is built into this test with malloc mapped to this function,
+ * so that the allocations made by the update proxy can be counted.
+ */
+
+static LONG g_Allocations = 0;
+static LONG g_AllocatedBytes = 0;
+
+void* test_message_malloc(size_t size)
+{
+	InterlockedIncrement(&g_Allocations);
+	InterlockedExchangeAdd(&g_AllocatedBytes, (LONG) size);
+
+	return malloc(size);
+}
+
+struct _TEST_MESSAGE_RUN
+{
+	rdpContext context;
+	rdpUpdate update;
+	LONG frames;
+	LONG corrupted;
+};
+typedef struct _TEST_MESSAGE_RUN TEST_MESSAGE_RUN;
+
+static TEST_MESSAGE_RUN g_Run;
+
+/**
+ * Consumer side, on the proxy thread: checks that the payload
+ * still holds what was received for this frame.
+ */
+
+static void test_surface_bits(rdpContext* context, SURFACE_BITS_COMMAND* cmd)
+{
+	BYTE frame = (BYTE) cmd->destLeft;
+
+	if ((cmd->bitmapDataLength != TEST_PAYLOAD) ||
+			(cmd->bitmapData[0] != frame) || (cmd->bitmapData[TEST_PAYLOAD - 1] != frame))
+		InterlockedIncrement(&g_Run.corrupted);
+
+	InterlockedIncrement(&g_Run.frames);
+}
+
+static void test_surface_frame_marker(rdpContext* context, SURFACE_FRAME_MARKER* marker)
+{
+
+}
+
+/**
+ * Writes a frame as a RemoteFX server sends it: a begin frame marker,
+ * one stream surface bits command and an end frame marker.
+ */
+
+static void test_write_frame(wStream* s, int frame)
+{
+	Stream_Write_UINT16(s, CMDTYPE_FRAME_MARKER);
+	Stream_Write_UINT16(s, SURFACECMD_FRAMEACTION_BEGIN);
+	Stream_Write_UINT32(s, frame);
+
+	Stream_Write_UINT16(s, CMDTYPE_STREAM_SURFACE_BITS);
+	Stream_Write_UINT16(s, frame & 0xFF); /* destLeft */
+	Stream_Write_UINT16(s, 0); /* destTop */
+	Stream_Write_UINT16(s, 64); /* destRight */
+	Stream_Write_UINT16(s, 64); /* destBottom */
+	Stream_Write_UINT8(s, 32); /* bpp */
+	Stream_Write_UINT8(s, 0); /* reserved1 */
+	Stream_Write_UINT8(s, 0); /* reserved2 */
+	Stream_Write_UINT8(s, RDP_CODEC_ID_REMOTEFX); /* codecID */
+	Stream_Write_UINT16(s, 64); /* width */
+	Stream_Write_UINT16(s, 64); /* height */
+	Stream_Write_UINT32(s, TEST_PAYLOAD); /* bitmapDataLength */
+	FillMemory(Stream_Pointer(s), TEST_PAYLOAD, frame & 0xFF);
+	Stream_Seek(s, TEST_PAYLOAD);
+
+	Stream_Write_UINT16(s, CMDTYPE_FRAME_MARKER);
+	Stream_Write_UINT16(s, SURFACECMD_FRAMEACTION_END);
+	Stream_Write_UINT32(s, frame);
+}
+
+/**
+ * Feeds the frames through the update proxy, as the fast-path receive code
+ * does, either from pooled streams that the queued updates may reference or
+ * from plain streams whose payload they must copy.
+ */
+
+static int test_message_frames(const char* name, BOOL pooled, size_t maxBytesPerFrame, size_t minBytesPerFrame)
+{
+	int frame;
+	size_t length;
+	wStream* s;
+	wObject cb;
+	wStreamPool* pool;
+	LONG allocations;
+	LONG bytes;
+	wPoolStatistics statistics;
+	rdpUpdate* update = &g_Run.update;
+
+	ZeroMemory(&g_Run, sizeof(TEST_MESSAGE_RUN));
+
+	g_Run.context.update = update;
+	update->context = &g_Run.context;
+	update->log = WLog_Get("com.freerdp.core.test");
+
+	update->primary = (rdpPrimaryUpdate*) calloc(1, sizeof(rdpPrimaryUpdate));
+	update->secondary = (rdpSecondaryUpdate*) calloc(1, sizeof(rdpSecondaryUpdate));
+	update->altsec = (rdpAltSecUpdate*) calloc(1, sizeof(rdpAltSecUpdate));
+	update->window = (rdpWindowUpdate*) calloc(1, sizeof(rdpWindowUpdate));
+	update->pointer = (rdpPointerUpdate*) calloc(1, sizeof(rdpPointerUpdate));
+
+	ZeroMemory(&cb, sizeof(wObject));
+	cb.fnObjectFree = (OBJECT_FREE_FN) update_message_queue_free_message;
+	update->queue = MessageQueue_NewEx(&cb, WMQ_FLAG_MPSC, 0);
+
+	update->SurfaceBits = test_surface_bits;
+	update->SurfaceFrameMarker = test_surface_frame_marker;
+
+	update->proxy = update_message_proxy_new(update);
+	TEST_CHECK(update->proxy);
+
+	pool = StreamPool_New(TRUE, 4096);
+	length = 2 * 8 + 2 + 20 + TEST_PAYLOAD;
+
+	allocations = g_Allocations;
+	bytes = g_AllocatedBytes;
+
+	for (frame = 0; frame < TEST_FRAMES; frame++)
+	{
+		s = pooled ? StreamPool_Take(pool, length) : Stream_New(NULL, length);
+		TEST_CHECK(s);
+
+		test_write_frame(s, frame);
+		Stream_SealLength(s);
+		Stream_SetPosition(s, 0);
+
+		update->recvStream = s;
+		TEST_CHECK(update_recv_surfcmds(update, (UINT32) length, s) == 0);
+		update->recvStream = NULL;
+
+		if (pooled)
+			Stream_Release(s);
+		else
+			Stream_Free(s, TRUE);
+	}
+
+	allocations = g_Allocations - allocations;
+	bytes = g_AllocatedBytes - bytes;
+
+	update_message_proxy_free(update->proxy);
+
+	printf("%-8s %d frames: %.1f allocations and %.0f bytes allocated per frame\n", name, TEST_FRAMES,
+			(double) allocations / TEST_FRAMES, (double) bytes / TEST_FRAMES);
+
+	TEST_CHECK(g_Run.frames == TEST_FRAMES);
+	TEST_CHECK(g_Run.corrupted == 0);
+
+	TEST_CHECK(((size_t) bytes / TEST_FRAMES) <= maxBytesPerFrame);
+	TEST_CHECK(((size_t) bytes / TEST_FRAMES) >= minBytesPerFrame);
+
+	/* every reference taken by a queued update was released by the consumer */
+
+	StreamPool_GetStatistics(pool, &statistics);
+	TEST_CHECK(statistics.itemsInUse == 0);
+
+	StreamPool_Free(pool);
+	MessageQueue_Free(update->queue);
+
+	free(update->primary);
+	free(update->secondary);
+	free(update->altsec);
+	free(update->window);
+	free(update->pointer);
+
+	return 0;
+}
+
+int TestCoreMessage(int argc, char* argv[])
+{
+	/* queued updates reference the pooled stream: no payload bytes are allocated */
+
+	if (test_message_frames("pooled", TRUE, 1024, 0) < 0)
+		return -1;
+
+	/* updates read from streams that are not pooled still get a copy */
+
+	if (test_message_frames("copied", FALSE, TEST_PAYLOAD + 1024, TEST_PAYLOAD) < 0)
+		return -1;
+
+	return 0;
+}
@@ -0,0 +1,960 @@
+
+#include <stdio.h>
+
+#include <winpr/crt.h>
+#include <winpr/stream.h>
+
+#include "orders.h"
+
+#define TEST_CHECK(_expr) \
+	do { \
+		if (!(_expr)) { \
+			fprintf(stderr, "%s:%d: check failed: %s\n", __FUNCTION__, __LINE__, #_expr); \
+			return -1; \
+		} \
+	} while (0)
+
+/**
+ * Rewind a stream written by an order encoder so that it can be handed to the matching decoder.
+ */
+
+static void test_rewind(wStream* s)
+{
+	Stream_SealLength(s);
+	Stream_SetPosition(s, 0);
+}
+
+static void test_fill_brush(rdpBrush* brush)
+{
+	int i;
+
+	brush->x = 3;
+	brush->y = 5;
+	brush->style = 0x03;
+	brush->hatch = 0xAA;
+
+	for (i = 1; i < 8; i++)
+		brush->p8x8[i] = 0x11 * i;
+}
+
+static BOOL test_brush_equal(rdpBrush* b1, rdpBrush* b2)
+{
+	if ((b1->x != b2->x) || (b1->y != b2->y) || (b1->style != b2->style) || (b1->hatch != b2->hatch))
+		return FALSE;
+
+	return (memcmp(&b1->p8x8[1], &b2->p8x8[1], 7) == 0) ? TRUE : FALSE;
+}
+
+static void test_fill_delta_rects(DELTA_RECT* rectangles, int number)
+{
+	int i;
+
+	ZeroMemory(rectangles, sizeof(DELTA_RECT) * (number + 1));
+
+	for (i = 1; i < number + 1; i++)
+	{
+		rectangles[i].left = (i % 3) ? i * 70 : rectangles[i - 1].left;
+		rectangles[i].top = (i % 4) ? 1000 - i * 5 : rectangles[i - 1].top;
+		rectangles[i].width = (i % 2) ? i * 3 : rectangles[i - 1].width;
+		rectangles[i].height = (i % 5) ? 300 + i : rectangles[i - 1].height;
+	}
+}
+
+static BOOL test_delta_rects_equal(DELTA_RECT* r1, DELTA_RECT* r2, int number)
+{
+	return (memcmp(&r1[1], &r2[1], sizeof(DELTA_RECT) * number) == 0) ? TRUE : FALSE;
+}
+
+static void test_fill_delta_points(DELTA_POINT* points, int number)
+{
+	int i;
+
+	for (i = 0; i < number; i++)
+	{
+		points[i].x = (i % 3) ? (i * 37) - 200 : 0;
+		points[i].y = (i % 4) ? 5000 - (i * 91) : 0;
+	}
+}
+
+static int test_dstblt_family(wStream* s)
+{
+	ORDER_INFO orderInfo;
+	DRAW_NINE_GRID_ORDER nineGrid, nineGridOut;
+	MULTI_DSTBLT_ORDER multiDstBlt, multiDstBltOut;
+	MULTI_PATBLT_ORDER multiPatBlt, multiPatBltOut;
+	MULTI_SCRBLT_ORDER multiScrBlt, multiScrBltOut;
+	MULTI_OPAQUE_RECT_ORDER multiOpaqueRect, multiOpaqueRectOut;
+	OPAQUE_RECT_ORDER opaqueRect, opaqueRectOut;
+
+	ZeroMemory(&orderInfo, sizeof(ORDER_INFO));
+
+	/* OpaqueRect */
+	ZeroMemory(&opaqueRect, sizeof(opaqueRect));
+	ZeroMemory(&opaqueRectOut, sizeof(opaqueRectOut));
+	opaqueRect.nLeftRect = 10;
+	opaqueRect.nTopRect = 20;
+	opaqueRect.nWidth = 300;
+	opaqueRect.nHeight = 400;
+	opaqueRect.color = 0x00123456;
+	Stream_SetPosition(s, 0);
+	TEST_CHECK(update_write_opaque_rect_order(s, &orderInfo, &opaqueRect));
+	test_rewind(s);
+	TEST_CHECK(update_read_opaque_rect_order(s, &orderInfo, &opaqueRectOut));
+	TEST_CHECK(Stream_GetRemainingLength(s) == 0);
+	TEST_CHECK(memcmp(&opaqueRect, &opaqueRectOut, sizeof(opaqueRect)) == 0);
+
+	/* DrawNineGrid */
+	ZeroMemory(&nineGrid, sizeof(nineGrid));
+	ZeroMemory(&nineGridOut, sizeof(nineGridOut));
+	nineGrid.srcLeft = 1;
+	nineGrid.srcTop = 2;
+	nineGrid.srcRight = 640;
+	nineGrid.srcBottom = 480;
+	nineGrid.bitmapId = 0x1234;
+	Stream_SetPosition(s, 0);
+	TEST_CHECK(update_write_draw_nine_grid_order(s, &orderInfo, &nineGrid));
+	test_rewind(s);
+	TEST_CHECK(update_read_draw_nine_grid_order(s, &orderInfo, &nineGridOut));
+	TEST_CHECK(Stream_GetRemainingLength(s) == 0);
+	TEST_CHECK(memcmp(&nineGrid, &nineGridOut, sizeof(nineGrid)) == 0);
+
+	/* MultiDstBlt */
+	ZeroMemory(&multiDstBlt, sizeof(multiDstBlt));
+	ZeroMemory(&multiDstBltOut, sizeof(multiDstBltOut));
+	multiDstBlt.nLeftRect = 5;
+	multiDstBlt.nTopRect = 6;
+	multiDstBlt.nWidth = 700;
+	multiDstBlt.nHeight = 800;
+	multiDstBlt.bRop = 0x55;
+	multiDstBlt.numRectangles = 45;
+	test_fill_delta_rects(multiDstBlt.rectangles, multiDstBlt.numRectangles);
+	Stream_SetPosition(s, 0);
+	TEST_CHECK(update_write_multi_dstblt_order(s, &orderInfo, &multiDstBlt));
+	TEST_CHECK(Stream_GetPosition(s) <= (size_t) update_approximate_multi_dstblt_order(&orderInfo, &multiDstBlt));
+	test_rewind(s);
+	TEST_CHECK(update_read_multi_dstblt_order(s, &orderInfo, &multiDstBltOut));
+	TEST_CHECK(Stream_GetRemainingLength(s) == 0);
+	TEST_CHECK(multiDstBltOut.cbData == multiDstBlt.cbData);
+	TEST_CHECK(multiDstBltOut.bRop == multiDstBlt.bRop);
+	TEST_CHECK(multiDstBltOut.nHeight == multiDstBlt.nHeight);
+	TEST_CHECK(multiDstBltOut.numRectangles == multiDstBlt.numRectangles);
+	TEST_CHECK(test_delta_rects_equal(multiDstBlt.rectangles, multiDstBltOut.rectangles, multiDstBlt.numRectangles));
+
+	/* MultiPatBlt */
+	ZeroMemory(&multiPatBlt, sizeof(multiPatBlt));
+	ZeroMemory(&multiPatBltOut, sizeof(multiPatBltOut));
+	multiPatBlt.nLeftRect = 15;
+	multiPatBlt.nTopRect = 16;
+	multiPatBlt.nWidth = 17;
+	multiPatBlt.nHeight = 18;
+	multiPatBlt.bRop = 0xF0;
+	multiPatBlt.backColor = 0x00ABCDEF;
+	multiPatBlt.foreColor = 0x00FEDCBA;
+	test_fill_brush(&multiPatBlt.brush);
+	multiPatBlt.numRectangles = 7;
+	test_fill_delta_rects(multiPatBlt.rectangles, multiPatBlt.numRectangles);
+	Stream_SetPosition(s, 0);
+	TEST_CHECK(update_write_multi_patblt_order(s, &orderInfo, &multiPatBlt));
+	test_rewind(s);
+	TEST_CHECK(update_read_multi_patblt_order(s, &orderInfo, &multiPatBltOut));
+	TEST_CHECK(Stream_GetRemainingLength(s) == 0);
+	TEST_CHECK(multiPatBltOut.backColor == multiPatBlt.backColor);
+	TEST_CHECK(multiPatBltOut.foreColor == multiPatBlt.foreColor);
+	TEST_CHECK(test_brush_equal(&multiPatBlt.brush, &multiPatBltOut.brush));
+	TEST_CHECK(multiPatBltOut.numRectangles == multiPatBlt.numRectangles);
+	TEST_CHECK(test_delta_rects_equal(multiPatBlt.rectangles, multiPatBltOut.rectangles, multiPatBlt.numRectangles));
+
+	/* MultiScrBlt */
+	ZeroMemory(&multiScrBlt, sizeof(multiScrBlt));
+	ZeroMemory(&multiScrBltOut, sizeof(multiScrBltOut));
+	multiScrBlt.nLeftRect = 25;
+	multiScrBlt.nTopRect = 26;
+	multiScrBlt.nWidth = 27;
+	multiScrBlt.nHeight = 28;
+	multiScrBlt.bRop = 0xCC;
+	multiScrBlt.nXSrc = 100;
+	multiScrBlt.nYSrc = 200;
+	multiScrBlt.numRectangles = 1;
+	test_fill_delta_rects(multiScrBlt.rectangles, multiScrBlt.numRectangles);
+	Stream_SetPosition(s, 0);
+	TEST_CHECK(update_write_multi_scrblt_order(s, &orderInfo, &multiScrBlt));
+	test_rewind(s);
+	TEST_CHECK(update_read_multi_scrblt_order(s, &orderInfo, &multiScrBltOut));
+	TEST_CHECK(Stream_GetRemainingLength(s) == 0);
+	TEST_CHECK(multiScrBltOut.nXSrc == multiScrBlt.nXSrc);
+	TEST_CHECK(multiScrBltOut.nYSrc == multiScrBlt.nYSrc);
+	TEST_CHECK(test_delta_rects_equal(multiScrBlt.rectangles, multiScrBltOut.rectangles, multiScrBlt.numRectangles));
+
+	/* MultiOpaqueRect */
+	ZeroMemory(&multiOpaqueRect, sizeof(multiOpaqueRect));
+	ZeroMemory(&multiOpaqueRectOut, sizeof(multiOpaqueRectOut));
+	multiOpaqueRect.nLeftRect = 35;
+	multiOpaqueRect.nTopRect = 36;
+	multiOpaqueRect.nWidth = 37;
+	multiOpaqueRect.nHeight = 38;
+	multiOpaqueRect.color = 0x00102030;
+	multiOpaqueRect.numRectangles = 20;
+	test_fill_delta_rects(multiOpaqueRect.rectangles, multiOpaqueRect.numRectangles);
+	Stream_SetPosition(s, 0);
+	TEST_CHECK(update_write_multi_opaque_rect_order(s, &orderInfo, &multiOpaqueRect));
+	test_rewind(s);
+	TEST_CHECK(update_read_multi_opaque_rect_order(s, &orderInfo, &multiOpaqueRectOut));
+	TEST_CHECK(Stream_GetRemainingLength(s) == 0);
+	TEST_CHECK(multiOpaqueRectOut.color == multiOpaqueRect.color);
+	TEST_CHECK(test_delta_rects_equal(multiOpaqueRect.rectangles, multiOpaqueRectOut.rectangles, multiOpaqueRect.numRectangles));
+
+	/* the delta base is always zero, whatever the caller left in slot 0, which is left alone */
+	ZeroMemory(&multiOpaqueRectOut, sizeof(multiOpaqueRectOut));
+	multiOpaqueRect.numRectangles = 3;
+	test_fill_delta_rects(multiOpaqueRect.rectangles, multiOpaqueRect.numRectangles);
+	multiOpaqueRect.rectangles[0].left = 123;
+	multiOpaqueRect.rectangles[0].top = 456;
+	multiOpaqueRect.rectangles[0].width = multiOpaqueRect.rectangles[1].width;
+	multiOpaqueRect.rectangles[0].height = 789;
+	Stream_SetPosition(s, 0);
+	TEST_CHECK(update_write_multi_opaque_rect_order(s, &orderInfo, &multiOpaqueRect));
+	test_rewind(s);
+	TEST_CHECK(update_read_multi_opaque_rect_order(s, &orderInfo, &multiOpaqueRectOut));
+	TEST_CHECK(Stream_GetRemainingLength(s) == 0);
+	TEST_CHECK(multiOpaqueRectOut.numRectangles == 3);
+	TEST_CHECK(test_delta_rects_equal(multiOpaqueRect.rectangles, multiOpaqueRectOut.rectangles, multiOpaqueRect.numRectangles));
+	TEST_CHECK((multiOpaqueRect.rectangles[0].left == 123) && (multiOpaqueRect.rectangles[0].height == 789));
+
+	return 0;
+}
+
+static int test_polyline_family(wStream* s)
+{
+	BYTE codeDeltaList[6] = { 1, 2, 3, 4, 5, 6 };
+	ORDER_INFO orderInfo;
+	POLYLINE_ORDER polyline, polylineOut;
+	POLYGON_SC_ORDER polygonSC, polygonSCOut;
+	POLYGON_CB_ORDER polygonCB, polygonCBOut;
+	ELLIPSE_SC_ORDER ellipseSC, ellipseSCOut;
+	ELLIPSE_CB_ORDER ellipseCB, ellipseCBOut;
+	MULTI_DRAW_NINE_GRID_ORDER multiNineGrid, multiNineGridOut;
+	DELTA_POINT points[32];
+
+	ZeroMemory(&orderInfo, sizeof(ORDER_INFO));
+	test_fill_delta_points(points, 32);
+
+	/* Polyline */
+	ZeroMemory(&polyline, sizeof(polyline));
+	ZeroMemory(&polylineOut, sizeof(polylineOut));
+	polyline.xStart = 10;
+	polyline.yStart = 20;
+	polyline.bRop2 = 0x0D;
+	polyline.penColor = 0x00FF8000;
+	polyline.numDeltaEntries = 32;
+	polyline.points = points;
+	Stream_SetPosition(s, 0);
+	TEST_CHECK(update_write_polyline_order(s, &orderInfo, &polyline));
+	test_rewind(s);
+	TEST_CHECK(update_read_polyline_order(s, &orderInfo, &polylineOut));
+	TEST_CHECK(Stream_GetRemainingLength(s) == 0);
+	TEST_CHECK(polylineOut.cbData == polyline.cbData);
+	TEST_CHECK(polylineOut.penColor == polyline.penColor);
+	TEST_CHECK(polylineOut.bRop2 == polyline.bRop2);
+	TEST_CHECK(polylineOut.numDeltaEntries == polyline.numDeltaEntries);
+	TEST_CHECK(memcmp(polylineOut.points, points, sizeof(DELTA_POINT) * 32) == 0);
+	free(polylineOut.points);
+
+	/* PolygonSC */
+	ZeroMemory(&polygonSC, sizeof(polygonSC));
+	ZeroMemory(&polygonSCOut, sizeof(polygonSCOut));
+	polygonSC.xStart = 100;
+	polygonSC.yStart = 200;
+	polygonSC.bRop2 = 0x07;
+	polygonSC.fillMode = 2;
+	polygonSC.brushColor = 0x00010203;
+	polygonSC.numPoints = 5;
+	polygonSC.points = points;
+	Stream_SetPosition(s, 0);
+	TEST_CHECK(update_write_polygon_sc_order(s, &orderInfo, &polygonSC));
+	test_rewind(s);
+	TEST_CHECK(update_read_polygon_sc_order(s, &orderInfo, &polygonSCOut));
+	TEST_CHECK(Stream_GetRemainingLength(s) == 0);
+	TEST_CHECK(polygonSCOut.fillMode == polygonSC.fillMode);
+	TEST_CHECK(polygonSCOut.brushColor == polygonSC.brushColor);
+	TEST_CHECK(memcmp(polygonSCOut.points, points, sizeof(DELTA_POINT) * 5) == 0);
+	free(polygonSCOut.points);
+
+	/* PolygonCB */
+	ZeroMemory(&polygonCB, sizeof(polygonCB));
+	ZeroMemory(&polygonCBOut, sizeof(polygonCBOut));
+	polygonCB.xStart = 300;
+	polygonCB.yStart = 400;
+	polygonCB.bRop2 = 0x0B;
+	polygonCB.backMode = BACKMODE_TRANSPARENT;
+	polygonCB.fillMode = 1;
+	polygonCB.backColor = 0x00112233;
+	polygonCB.foreColor = 0x00445566;
+	test_fill_brush(&polygonCB.brush);
+	polygonCB.numPoints = 9;
+	polygonCB.points = points;
+	Stream_SetPosition(s, 0);
+	TEST_CHECK(update_write_polygon_cb_order(s, &orderInfo, &polygonCB));
+	test_rewind(s);
+	TEST_CHECK(update_read_polygon_cb_order(s, &orderInfo, &polygonCBOut));
+	TEST_CHECK(Stream_GetRemainingLength(s) == 0);
+	TEST_CHECK(polygonCBOut.bRop2 == polygonCB.bRop2);
+	TEST_CHECK(polygonCBOut.backMode == polygonCB.backMode);
+	TEST_CHECK(polygonCBOut.foreColor == polygonCB.foreColor);
+	TEST_CHECK(test_brush_equal(&polygonCB.brush, &polygonCBOut.brush));
+	TEST_CHECK(memcmp(polygonCBOut.points, points, sizeof(DELTA_POINT) * 9) == 0);
+	free(polygonCBOut.points);
+
+	/* EllipseSC */
+	ZeroMemory(&ellipseSC, sizeof(ellipseSC));
+	ZeroMemory(&ellipseSCOut, sizeof(ellipseSCOut));
+	ellipseSC.leftRect = 1;
+	ellipseSC.topRect = 2;
+	ellipseSC.rightRect = 3;
+	ellipseSC.bottomRect = 4;
+	ellipseSC.bRop2 = 5;
+	ellipseSC.fillMode = 1;
+	ellipseSC.color = 0x00778899;
+	Stream_SetPosition(s, 0);
+	TEST_CHECK(update_write_ellipse_sc_order(s, &orderInfo, &ellipseSC));
+	test_rewind(s);
+	TEST_CHECK(update_read_ellipse_sc_order(s, &orderInfo, &ellipseSCOut));
+	TEST_CHECK(Stream_GetRemainingLength(s) == 0);
+	TEST_CHECK(memcmp(&ellipseSC, &ellipseSCOut, sizeof(ellipseSC)) == 0);
+
+	/* EllipseCB */
+	ZeroMemory(&ellipseCB, sizeof(ellipseCB));
+	ZeroMemory(&ellipseCBOut, sizeof(ellipseCBOut));
+	ellipseCB.leftRect = 10;
+	ellipseCB.topRect = 20;
+	ellipseCB.rightRect = 30;
+	ellipseCB.bottomRect = 40;
+	ellipseCB.bRop2 = 6;
+	ellipseCB.fillMode = 2;
+	ellipseCB.backColor = 0x00AABBCC;
+	ellipseCB.foreColor = 0x00DDEEFF;
+	test_fill_brush(&ellipseCB.brush);
+	Stream_SetPosition(s, 0);
+	TEST_CHECK(update_write_ellipse_cb_order(s, &orderInfo, &ellipseCB));
+	test_rewind(s);
+	TEST_CHECK(update_read_ellipse_cb_order(s, &orderInfo, &ellipseCBOut));
+	TEST_CHECK(Stream_GetRemainingLength(s) == 0);
+	TEST_CHECK(ellipseCBOut.bottomRect == ellipseCB.bottomRect);
+	TEST_CHECK(ellipseCBOut.foreColor == ellipseCB.foreColor);
+	TEST_CHECK(test_brush_equal(&ellipseCB.brush, &ellipseCBOut.brush));
+
+	/* MultiDrawNineGrid */
+	ZeroMemory(&multiNineGrid, sizeof(multiNineGrid));
+	ZeroMemory(&multiNineGridOut, sizeof(multiNineGridOut));
+	multiNineGrid.srcLeft = 4;
+	multiNineGrid.srcTop = 3;
+	multiNineGrid.srcRight = 2;
+	multiNineGrid.srcBottom = 1;
+	multiNineGrid.bitmapId = 77;
+	multiNineGrid.nDeltaEntries = 3;
+	multiNineGrid.cbData = sizeof(codeDeltaList);
+	multiNineGrid.codeDeltaList = codeDeltaList;
+	Stream_SetPosition(s, 0);
+	TEST_CHECK(update_write_multi_draw_nine_grid_order(s, &orderInfo, &multiNineGrid));
+	test_rewind(s);
+	TEST_CHECK(update_read_multi_draw_nine_grid_order(s, &orderInfo, &multiNineGridOut));
+	TEST_CHECK(Stream_GetRemainingLength(s) == 0);
+	TEST_CHECK(multiNineGridOut.bitmapId == multiNineGrid.bitmapId);
+	TEST_CHECK(multiNineGridOut.nDeltaEntries == multiNineGrid.nDeltaEntries);
+	TEST_CHECK(multiNineGridOut.cbData == multiNineGrid.cbData);
+	TEST_CHECK(memcmp(multiNineGridOut.codeDeltaList, codeDeltaList, sizeof(codeDeltaList)) == 0);
+
+	return 0;
+}
+
+static int test_blt_and_glyph_family(wStream* s)
+{
+	BYTE aj[8] = { 0x81, 0x42, 0x24, 0x18, 0x18, 0x24, 0x42, 0x81 };
+	ORDER_INFO orderInfo;
+	MEM3BLT_ORDER mem3blt, mem3bltOut;
+	SAVE_BITMAP_ORDER saveBitmap, saveBitmapOut;
+	FAST_INDEX_ORDER fastIndex, fastIndexOut;
+	FAST_GLYPH_ORDER fastGlyph, fastGlyphOut;
+
+	ZeroMemory(&orderInfo, sizeof(ORDER_INFO));
+
+	/* Mem3Blt */
+	ZeroMemory(&mem3blt, sizeof(mem3blt));
+	ZeroMemory(&mem3bltOut, sizeof(mem3bltOut));
+	mem3blt.cacheId = 2;
+	mem3blt.colorIndex = 1;
+	mem3blt.nLeftRect = 11;
+	mem3blt.nTopRect = 12;
+	mem3blt.nWidth = 64;
+	mem3blt.nHeight = 64;
+	mem3blt.bRop = 0xB8;
+	mem3blt.nXSrc = 13;
+	mem3blt.nYSrc = 14;
+	mem3blt.backColor = 0x00102030;
+	mem3blt.foreColor = 0x00405060;
+	test_fill_brush(&mem3blt.brush);
+	mem3blt.cacheIndex = 0x1FF;
+	Stream_SetPosition(s, 0);
+	TEST_CHECK(update_write_mem3blt_order(s, &orderInfo, &mem3blt));
+	test_rewind(s);
+	TEST_CHECK(update_read_mem3blt_order(s, &orderInfo, &mem3bltOut));
+	TEST_CHECK(Stream_GetRemainingLength(s) == 0);
+	TEST_CHECK(mem3bltOut.cacheId == mem3blt.cacheId);
+	TEST_CHECK(mem3bltOut.colorIndex == mem3blt.colorIndex);
+	TEST_CHECK(mem3bltOut.nYSrc == mem3blt.nYSrc);
+	TEST_CHECK(mem3bltOut.backColor == mem3blt.backColor);
+	TEST_CHECK(mem3bltOut.cacheIndex == mem3blt.cacheIndex);
+	TEST_CHECK(test_brush_equal(&mem3blt.brush, &mem3bltOut.brush));
+
+	/* SaveBitmap */
+	ZeroMemory(&saveBitmap, sizeof(saveBitmap));
+	ZeroMemory(&saveBitmapOut, sizeof(saveBitmapOut));
+	saveBitmap.savedBitmapPosition = 0x12345678;
+	saveBitmap.nLeftRect = 1;
+	saveBitmap.nTopRect = 2;
+	saveBitmap.nRightRect = 300;
+	saveBitmap.nBottomRect = 400;
+	saveBitmap.operation = 1;
+	Stream_SetPosition(s, 0);
+	TEST_CHECK(update_write_save_bitmap_order(s, &orderInfo, &saveBitmap));
+	test_rewind(s);
+	TEST_CHECK(update_read_save_bitmap_order(s, &orderInfo, &saveBitmapOut));
+	TEST_CHECK(Stream_GetRemainingLength(s) == 0);
+	TEST_CHECK(memcmp(&saveBitmap, &saveBitmapOut, sizeof(saveBitmap)) == 0);
+
+	/* FastIndex */
+	ZeroMemory(&fastIndex, sizeof(fastIndex));
+	ZeroMemory(&fastIndexOut, sizeof(fastIndexOut));
+	fastIndex.cacheId = 7;
+	fastIndex.ulCharInc = 0;
+	fastIndex.flAccel = 3;
+	fastIndex.backColor = 0x00FFFFFF;
+	fastIndex.foreColor = 0x00000000;
+	fastIndex.bkLeft = 10;
+	fastIndex.bkTop = 20;
+	fastIndex.bkRight = 110;
+	fastIndex.bkBottom = 40;
+	fastIndex.opLeft = 10;
+	fastIndex.opTop = 20;
+	fastIndex.opRight = 110;
+	fastIndex.opBottom = 40;
+	fastIndex.x = 10;
+	fastIndex.y = 36;
+	fastIndex.cbData = 6;
+	CopyMemory(fastIndex.data, "\x01\x08\x02\x08\x03\x08", 6);
+	Stream_SetPosition(s, 0);
+	TEST_CHECK(update_write_fast_index_order(s, &orderInfo, &fastIndex));
+	test_rewind(s);
+	TEST_CHECK(update_read_fast_index_order(s, &orderInfo, &fastIndexOut));
+	TEST_CHECK(Stream_GetRemainingLength(s) == 0);
+	TEST_CHECK(memcmp(&fastIndex, &fastIndexOut, sizeof(fastIndex)) == 0);
+
+	/* FastGlyph */
+	ZeroMemory(&fastGlyph, sizeof(fastGlyph));
+	ZeroMemory(&fastGlyphOut, sizeof(fastGlyphOut));
+	fastGlyph.cacheId = 3;
+	fastGlyph.ulCharInc = 8;
+	fastGlyph.flAccel = 1;
+	fastGlyph.backColor = 0x00123456;
+	fastGlyph.foreColor = 0x00654321;
+	fastGlyph.bkLeft = 5;
+	fastGlyph.bkTop = 6;
+	fastGlyph.bkRight = 7;
+	fastGlyph.bkBottom = 8;
+	fastGlyph.opLeft = 9;
+	fastGlyph.opTop = 10;
+	fastGlyph.opRight = 11;
+	fastGlyph.opBottom = 12;
+	fastGlyph.x = 13;
+	fastGlyph.y = 14;
+	fastGlyph.glyphData.cacheIndex = 42;
+	fastGlyph.glyphData.x = -2;
+	fastGlyph.glyphData.y = -7;
+	fastGlyph.glyphData.cx = 8;
+	fastGlyph.glyphData.cy = 8;
+	fastGlyph.glyphData.aj = aj;
+	Stream_SetPosition(s, 0);
+	TEST_CHECK(update_write_fast_glyph_order(s, &orderInfo, &fastGlyph));
+	test_rewind(s);
+	TEST_CHECK(update_read_fast_glyph_order(s, &orderInfo, &fastGlyphOut));
+	TEST_CHECK(Stream_GetRemainingLength(s) == 0);
+	TEST_CHECK(fastGlyphOut.cbData == fastGlyph.cbData);
+	TEST_CHECK(fastGlyphOut.foreColor == fastGlyph.foreColor);
+	TEST_CHECK(fastGlyphOut.y == fastGlyph.y);
+	TEST_CHECK(fastGlyphOut.glyphData.cacheIndex == 42);
+	TEST_CHECK(fastGlyphOut.glyphData.x == -2);
+	TEST_CHECK(fastGlyphOut.glyphData.y == -7);
+	TEST_CHECK(fastGlyphOut.glyphData.cx == 8);
+	TEST_CHECK(fastGlyphOut.glyphData.cy == 8);
+	TEST_CHECK(memcmp(fastGlyphOut.glyphData.aj, aj, sizeof(aj)) == 0);
+	free(fastGlyphOut.glyphData.aj);
+
+	return 0;
+}
+
+static int test_secondary_orders(wStream* s)
+{
+	int i;
+	UINT16 flags;
+	BYTE bitmapData[64];
+	BYTE glyphBits[12];
+	CACHE_BITMAP_ORDER cacheBitmap, cacheBitmapOut;
+	CACHE_BITMAP_V2_ORDER cacheBitmapV2, cacheBitmapV2Out;
+	CACHE_BITMAP_V3_ORDER cacheBitmapV3, cacheBitmapV3Out;
+	CACHE_COLOR_TABLE_ORDER* colorTable;
+	CACHE_COLOR_TABLE_ORDER* colorTableOut;
+	CACHE_GLYPH_ORDER* cacheGlyph;
+	CACHE_GLYPH_ORDER* cacheGlyphOut;
+	CACHE_GLYPH_V2_ORDER* cacheGlyphV2;
+	CACHE_GLYPH_V2_ORDER* cacheGlyphV2Out;
+	CACHE_BRUSH_ORDER cacheBrush, cacheBrushOut;
+
+	for (i = 0; i < (int) sizeof(bitmapData); i++)
+		bitmapData[i] = i * 3;
+
+	for (i = 0; i < (int) sizeof(glyphBits); i++)
+		glyphBits[i] = 0xF0 ^ i;
+
+	/* CacheBitmap */
+	ZeroMemory(&cacheBitmap, sizeof(cacheBitmap));
+	ZeroMemory(&cacheBitmapOut, sizeof(cacheBitmapOut));
+	cacheBitmap.cacheId = 1;
+	cacheBitmap.bitmapWidth = 4;
+	cacheBitmap.bitmapHeight = 4;
+	cacheBitmap.bitmapBpp = 32;
+	cacheBitmap.bitmapLength = sizeof(bitmapData);
+	cacheBitmap.cacheIndex = 99;
+	cacheBitmap.bitmapDataStream = bitmapData;
+	Stream_SetPosition(s, 0);
+	TEST_CHECK(update_write_cache_bitmap_order(s, &cacheBitmap, FALSE, &flags));
+	test_rewind(s);
+	TEST_CHECK(update_read_cache_bitmap_order(s, &cacheBitmapOut, FALSE, flags));
+	TEST_CHECK(Stream_GetRemainingLength(s) == 0);
+	TEST_CHECK(cacheBitmapOut.cacheIndex == cacheBitmap.cacheIndex);
+	TEST_CHECK(cacheBitmapOut.bitmapLength == cacheBitmap.bitmapLength);
+	TEST_CHECK(memcmp(cacheBitmapOut.bitmapDataStream, bitmapData, sizeof(bitmapData)) == 0);
+
+	/* CacheBitmapV2 */
+	ZeroMemory(&cacheBitmapV2, sizeof(cacheBitmapV2));
+	ZeroMemory(&cacheBitmapV2Out, sizeof(cacheBitmapV2Out));
+	cacheBitmapV2.cacheId = 2;
+	cacheBitmapV2.flags = CBR2_PERSISTENT_KEY_PRESENT | CBR2_NO_BITMAP_COMPRESSION_HDR;
+	cacheBitmapV2.key1 = 0xAABBCCDD;
+	cacheBitmapV2.key2 = 0x11223344;
+	cacheBitmapV2.bitmapBpp = 16;
+	cacheBitmapV2.bitmapWidth = 200;
+	cacheBitmapV2.bitmapHeight = 3;
+	cacheBitmapV2.bitmapLength = sizeof(bitmapData);
+	cacheBitmapV2.cacheIndex = 1000;
+	cacheBitmapV2.bitmapDataStream = bitmapData;
+	Stream_SetPosition(s, 0);
+	TEST_CHECK(update_write_cache_bitmap_v2_order(s, &cacheBitmapV2, TRUE, &flags));
+	test_rewind(s);
+	TEST_CHECK(update_read_cache_bitmap_v2_order(s, &cacheBitmapV2Out, TRUE, flags));
+	TEST_CHECK(Stream_GetRemainingLength(s) == 0);
+	TEST_CHECK(cacheBitmapV2Out.cacheId == cacheBitmapV2.cacheId);
+	TEST_CHECK(cacheBitmapV2Out.flags == cacheBitmapV2.flags);
+	TEST_CHECK(cacheBitmapV2Out.key2 == cacheBitmapV2.key2);
+	TEST_CHECK(cacheBitmapV2Out.bitmapBpp == cacheBitmapV2.bitmapBpp);
+	TEST_CHECK(cacheBitmapV2Out.bitmapWidth == cacheBitmapV2.bitmapWidth);
+	TEST_CHECK(cacheBitmapV2Out.bitmapHeight == cacheBitmapV2.bitmapHeight);
+	TEST_CHECK(cacheBitmapV2Out.cacheIndex == cacheBitmapV2.cacheIndex);
+	TEST_CHECK(memcmp(cacheBitmapV2Out.bitmapDataStream, bitmapData, sizeof(bitmapData)) == 0);
+
+	/* CacheBitmapV3 */
+	ZeroMemory(&cacheBitmapV3, sizeof(cacheBitmapV3));
+	ZeroMemory(&cacheBitmapV3Out, sizeof(cacheBitmapV3Out));
+	cacheBitmapV3.cacheId = 1;
+	cacheBitmapV3.bpp = 32;
+	cacheBitmapV3.cacheIndex = 4321;
+	cacheBitmapV3.key1 = 5;
+	cacheBitmapV3.key2 = 6;
+	cacheBitmapV3.bitmapData.bpp = 32;
+	cacheBitmapV3.bitmapData.codecID = 3;
+	cacheBitmapV3.bitmapData.width = 64;
+	cacheBitmapV3.bitmapData.height = 32;
+	cacheBitmapV3.bitmapData.length = sizeof(bitmapData);
+	cacheBitmapV3.bitmapData.data = bitmapData;
+	Stream_SetPosition(s, 0);
+	TEST_CHECK(update_write_cache_bitmap_v3_order(s, &cacheBitmapV3, &flags));
+	test_rewind(s);
+	TEST_CHECK(update_read_cache_bitmap_v3_order(s, &cacheBitmapV3Out, flags));
+	TEST_CHECK(Stream_GetRemainingLength(s) == 0);
+	TEST_CHECK(cacheBitmapV3Out.bpp == cacheBitmapV3.bpp);
+	TEST_CHECK(cacheBitmapV3Out.cacheIndex == cacheBitmapV3.cacheIndex);
+	TEST_CHECK(cacheBitmapV3Out.bitmapData.codecID == cacheBitmapV3.bitmapData.codecID);
+	TEST_CHECK(cacheBitmapV3Out.bitmapData.height == cacheBitmapV3.bitmapData.height);
+	TEST_CHECK(memcmp(cacheBitmapV3Out.bitmapData.data, bitmapData, sizeof(bitmapData)) == 0);
+	free(cacheBitmapV3Out.bitmapData.data);
+
+	/* CacheColorTable */
+	colorTable = (CACHE_COLOR_TABLE_ORDER*) calloc(1, sizeof(CACHE_COLOR_TABLE_ORDER));
+	colorTableOut = (CACHE_COLOR_TABLE_ORDER*) calloc(1, sizeof(CACHE_COLOR_TABLE_ORDER));
+	TEST_CHECK(colorTable && colorTableOut);
+	colorTable->cacheIndex = 3;
+	colorTable->numberColors = 256;
+
+	for (i = 0; i < 256; i++)
+		colorTable->colorTable[i] = (i << 16) | ((255 - i) << 8) | (i ^ 0x5A);
+
+	Stream_SetPosition(s, 0);
+	TEST_CHECK(update_write_cache_color_table_order(s, colorTable, &flags));
+	test_rewind(s);
+	TEST_CHECK(update_read_cache_color_table_order(s, colorTableOut, flags));
+	TEST_CHECK(Stream_GetRemainingLength(s) == 0);
+	TEST_CHECK(memcmp(colorTable, colorTableOut, sizeof(CACHE_COLOR_TABLE_ORDER)) == 0);
+	free(colorTable);
+	free(colorTableOut);
+
+	/* CacheGlyph */
+	cacheGlyph = (CACHE_GLYPH_ORDER*) calloc(1, sizeof(CACHE_GLYPH_ORDER));
+	cacheGlyphOut = (CACHE_GLYPH_ORDER*) calloc(1, sizeof(CACHE_GLYPH_ORDER));
+	TEST_CHECK(cacheGlyph && cacheGlyphOut);
+	cacheGlyph->cacheId = 4;
+	cacheGlyph->cGlyphs = 2;
+	cacheGlyph->glyphData[0].cacheIndex = 10;
+	cacheGlyph->glyphData[0].x = -1;
+	cacheGlyph->glyphData[0].y = -12;
+	cacheGlyph->glyphData[0].cx = 9;
+	cacheGlyph->glyphData[0].cy = 6;
+	cacheGlyph->glyphData[0].aj = glyphBits;
+	cacheGlyph->glyphData[1].cacheIndex = 11;
+	cacheGlyph->glyphData[1].cx = 4;
+	cacheGlyph->glyphData[1].cy = 4;
+	cacheGlyph->glyphData[1].aj = glyphBits;
+	flags = 0;
+	Stream_SetPosition(s, 0);
+	TEST_CHECK(update_write_cache_glyph_order(s, cacheGlyph, &flags));
+	test_rewind(s);
+	TEST_CHECK(update_read_cache_glyph_order(s, cacheGlyphOut, flags));
+	TEST_CHECK(Stream_GetRemainingLength(s) == 0);
+	TEST_CHECK(cacheGlyphOut->cGlyphs == 2);
+	TEST_CHECK(cacheGlyphOut->glyphData[0].y == -12);
+	TEST_CHECK(cacheGlyphOut->glyphData[0].cb == 12);
+	TEST_CHECK(memcmp(cacheGlyphOut->glyphData[0].aj, glyphBits, 12) == 0);
+	TEST_CHECK(cacheGlyphOut->glyphData[1].cacheIndex == 11);
+	TEST_CHECK(cacheGlyphOut->glyphData[1].cb == 4);
+	free(cacheGlyphOut->glyphData[0].aj);
+	free(cacheGlyphOut->glyphData[1].aj);
+	free(cacheGlyph);
+	free(cacheGlyphOut);
+
+	/* CacheGlyphV2 */
+	cacheGlyphV2 = (CACHE_GLYPH_V2_ORDER*) calloc(1, sizeof(CACHE_GLYPH_V2_ORDER));
+	cacheGlyphV2Out = (CACHE_GLYPH_V2_ORDER*) calloc(1, sizeof(CACHE_GLYPH_V2_ORDER));
+	TEST_CHECK(cacheGlyphV2 && cacheGlyphV2Out);
+	cacheGlyphV2->cacheId = 5;
+	cacheGlyphV2->cGlyphs = 1;
+	cacheGlyphV2->glyphData[0].cacheIndex = 200;
+	cacheGlyphV2->glyphData[0].x = 100;
+	cacheGlyphV2->glyphData[0].y = -100;
+	cacheGlyphV2->glyphData[0].cx = 9;
+	cacheGlyphV2->glyphData[0].cy = 6;
+	cacheGlyphV2->glyphData[0].aj = glyphBits;
+	Stream_SetPosition(s, 0);
+	TEST_CHECK(update_write_cache_glyph_v2_order(s, cacheGlyphV2, &flags));
+	test_rewind(s);
+	TEST_CHECK(update_read_cache_glyph_v2_order(s, cacheGlyphV2Out, flags));
+	TEST_CHECK(Stream_GetRemainingLength(s) == 0);
+	TEST_CHECK(cacheGlyphV2Out->cacheId == 5);
+	TEST_CHECK(cacheGlyphV2Out->cGlyphs == 1);
+	TEST_CHECK(cacheGlyphV2Out->glyphData[0].cacheIndex == 200);
+	TEST_CHECK(cacheGlyphV2Out->glyphData[0].x == 100);
+	TEST_CHECK(cacheGlyphV2Out->glyphData[0].y == -100);
+	TEST_CHECK(memcmp(cacheGlyphV2Out->glyphData[0].aj, glyphBits, 12) == 0);
+	free(cacheGlyphV2Out->glyphData[0].aj);
+	free(cacheGlyphV2);
+	free(cacheGlyphV2Out);
+
+	/* CacheBrush, monochrome */
+	ZeroMemory(&cacheBrush, sizeof(cacheBrush));
+	ZeroMemory(&cacheBrushOut, sizeof(cacheBrushOut));
+	cacheBrush.index = 1;
+	cacheBrush.bpp = 1;
+	cacheBrush.cx = 8;
+	cacheBrush.cy = 8;
+	cacheBrush.length = 8;
+	CopyMemory(cacheBrush.data, bitmapData, 8);
+	Stream_SetPosition(s, 0);
+	TEST_CHECK(update_write_cache_brush_order(s, &cacheBrush, &flags));
+	test_rewind(s);
+	TEST_CHECK(update_read_cache_brush_order(s, &cacheBrushOut, flags));
+	TEST_CHECK(Stream_GetRemainingLength(s) == 0);
+	TEST_CHECK(memcmp(&cacheBrush, &cacheBrushOut, sizeof(cacheBrush)) == 0);
+
+	/* CacheBrush, compressed 16bpp (four colors) */
+	ZeroMemory(&cacheBrush, sizeof(cacheBrush));
+	ZeroMemory(&cacheBrushOut, sizeof(cacheBrushOut));
+	cacheBrush.index = 2;
+	cacheBrush.bpp = 16;
+	cacheBrush.cx = 8;
+	cacheBrush.cy = 8;
+	cacheBrush.length = 24;
+
+	for (i = 0; i < 64; i++)
+	{
+		cacheBrush.data[i * 2] = (i % 4) * 0x11;
+		cacheBrush.data[(i * 2) + 1] = ((i / 8) % 2) ? 0xF8 : 0x07;
+	}
+
+	Stream_SetPosition(s, 0);
+	TEST_CHECK(!update_write_cache_brush_order(s, &cacheBrush, &flags));
+
+	for (i = 0; i < 64; i++)
+		cacheBrush.data[(i * 2) + 1] = 0x07;
+
+	Stream_SetPosition(s, 0);
+	TEST_CHECK(update_write_cache_brush_order(s, &cacheBrush, &flags));
+	TEST_CHECK(Stream_GetPosition(s) == 6 + 24);
+	test_rewind(s);
+	TEST_CHECK(update_read_cache_brush_order(s, &cacheBrushOut, flags));
+	TEST_CHECK(Stream_GetRemainingLength(s) == 0);
+	TEST_CHECK(memcmp(&cacheBrush, &cacheBrushOut, sizeof(cacheBrush)) == 0);
+
+	/* CacheBrush, uncompressed 16bpp */
+	ZeroMemory(&cacheBrush, sizeof(cacheBrush));
+	ZeroMemory(&cacheBrushOut, sizeof(cacheBrushOut));
+	cacheBrush.index = 3;
+	cacheBrush.bpp = 16;
+	cacheBrush.cx = 8;
+	cacheBrush.cy = 8;
+	cacheBrush.length = 128;
+
+	for (i = 0; i < 128; i++)
+		cacheBrush.data[i] = i;
+
+	Stream_SetPosition(s, 0);
+	TEST_CHECK(update_write_cache_brush_order(s, &cacheBrush, &flags));
+	test_rewind(s);
+	TEST_CHECK(update_read_cache_brush_order(s, &cacheBrushOut, flags));
+	TEST_CHECK(Stream_GetRemainingLength(s) == 0);
+	TEST_CHECK(memcmp(&cacheBrush, &cacheBrushOut, sizeof(cacheBrush)) == 0);
+
+	return 0;
+}
+
+static int test_altsec_orders(wStream* s)
+{
+	BYTE payload[37];
+	UINT16 indices[3] = { 7, 8, 9 };
+	CREATE_OFFSCREEN_BITMAP_ORDER offscreen, offscreenOut;
+	SWITCH_SURFACE_ORDER switchSurface, switchSurfaceOut;
+	CREATE_NINE_GRID_BITMAP_ORDER nineGrid, nineGridOut;
+	FRAME_MARKER_ORDER frameMarker, frameMarkerOut;
+	STREAM_BITMAP_FIRST_ORDER bitmapFirst, bitmapFirstOut;
+	STREAM_BITMAP_NEXT_ORDER bitmapNext, bitmapNextOut;
+	DRAW_GDIPLUS_FIRST_ORDER gdiFirst, gdiFirstOut;
+	DRAW_GDIPLUS_NEXT_ORDER gdiNext, gdiNextOut;
+	DRAW_GDIPLUS_END_ORDER gdiEnd, gdiEndOut;
+	DRAW_GDIPLUS_CACHE_FIRST_ORDER cacheFirst, cacheFirstOut;
+	DRAW_GDIPLUS_CACHE_NEXT_ORDER cacheNext, cacheNextOut;
+	DRAW_GDIPLUS_CACHE_END_ORDER cacheEnd, cacheEndOut;
+
+	FillMemory(payload, sizeof(payload), 0xA5);
+
+	/* CreateOffscreenBitmap */
+	ZeroMemory(&offscreen, sizeof(offscreen));
+	ZeroMemory(&offscreenOut, sizeof(offscreenOut));
+	offscreen.id = 0x123;
+	offscreen.cx = 640;
+	offscreen.cy = 480;
+	offscreen.deleteList.cIndices = 3;
+	offscreen.deleteList.sIndices = 3;
+	offscreen.deleteList.indices = indices;
+	Stream_SetPosition(s, 0);
+	TEST_CHECK(update_write_create_offscreen_bitmap_order(s, &offscreen));
+	test_rewind(s);
+	TEST_CHECK(update_read_create_offscreen_bitmap_order(s, &offscreenOut));
+	TEST_CHECK(Stream_GetRemainingLength(s) == 0);
+	TEST_CHECK(offscreenOut.id == offscreen.id);
+	TEST_CHECK(offscreenOut.cy == offscreen.cy);
+	TEST_CHECK(offscreenOut.deleteList.cIndices == 3);
+	TEST_CHECK(memcmp(offscreenOut.deleteList.indices, indices, sizeof(indices)) == 0);
+	free(offscreenOut.deleteList.indices);
+
+	/* SwitchSurface */
+	switchSurface.bitmapId = 0xFFFF;
+	Stream_SetPosition(s, 0);
+	TEST_CHECK(update_write_switch_surface_order(s, &switchSurface));
+	test_rewind(s);
+	TEST_CHECK(update_read_switch_surface_order(s, &switchSurfaceOut));
+	TEST_CHECK(Stream_GetRemainingLength(s) == 0);
+	TEST_CHECK(switchSurfaceOut.bitmapId == switchSurface.bitmapId);
+
+	/* CreateNineGridBitmap */
+	ZeroMemory(&nineGrid, sizeof(nineGrid));
+	ZeroMemory(&nineGridOut, sizeof(nineGridOut));
+	nineGrid.bitmapBpp = 32;
+	nineGrid.bitmapId = 12;
+	nineGrid.nineGridInfo.flFlags = 0x00000003;
+	nineGrid.nineGridInfo.ulLeftWidth = 4;
+	nineGrid.nineGridInfo.ulRightWidth = 5;
+	nineGrid.nineGridInfo.ulTopHeight = 6;
+	nineGrid.nineGridInfo.ulBottomHeight = 7;
+	nineGrid.nineGridInfo.crTransparent = 0x00FF00FF;
+	Stream_SetPosition(s, 0);
+	TEST_CHECK(update_write_create_nine_grid_bitmap_order(s, &nineGrid));
+	test_rewind(s);
+	TEST_CHECK(update_read_create_nine_grid_bitmap_order(s, &nineGridOut));
+	TEST_CHECK(Stream_GetRemainingLength(s) == 0);
+	TEST_CHECK(memcmp(&nineGrid, &nineGridOut, sizeof(nineGrid)) == 0);
+
+	/* FrameMarker */
+	frameMarker.action = 1;
+	Stream_SetPosition(s, 0);
+	TEST_CHECK(update_write_frame_marker_order(s, &frameMarker));
+	test_rewind(s);
+	TEST_CHECK(update_read_frame_marker_order(s, &frameMarkerOut));
+	TEST_CHECK(Stream_GetRemainingLength(s) == 0);
+	TEST_CHECK(frameMarkerOut.action == frameMarker.action);
+
+	/* StreamBitmapFirst */
+	ZeroMemory(&bitmapFirst, sizeof(bitmapFirst));
+	ZeroMemory(&bitmapFirstOut, sizeof(bitmapFirstOut));
+	bitmapFirst.bitmapFlags = STREAM_BITMAP_V2;
+	bitmapFirst.bitmapBpp = 32;
+	bitmapFirst.bitmapType = 1;
+	bitmapFirst.bitmapWidth = 100;
+	bitmapFirst.bitmapHeight = 200;
+	bitmapFirst.bitmapSize = 80000;
+	bitmapFirst.bitmapBlockSize = sizeof(payload);
+	bitmapFirst.bitmapBlock = payload;
+	Stream_SetPosition(s, 0);
+	TEST_CHECK(update_write_stream_bitmap_first_order(s, &bitmapFirst));
+	test_rewind(s);
+	TEST_CHECK(update_read_stream_bitmap_first_order(s, &bitmapFirstOut));
+	TEST_CHECK(Stream_GetRemainingLength(s) == 0);
+	TEST_CHECK(bitmapFirstOut.bitmapSize == bitmapFirst.bitmapSize);
+	TEST_CHECK(bitmapFirstOut.bitmapHeight == bitmapFirst.bitmapHeight);
+	TEST_CHECK(bitmapFirstOut.bitmapBlockSize == bitmapFirst.bitmapBlockSize);
+	TEST_CHECK(memcmp(bitmapFirstOut.bitmapBlock, payload, sizeof(payload)) == 0);
+
+	/* StreamBitmapNext */
+	ZeroMemory(&bitmapNext, sizeof(bitmapNext));
+	ZeroMemory(&bitmapNextOut, sizeof(bitmapNextOut));
+	bitmapNext.bitmapFlags = 0x04;
+	bitmapNext.bitmapType = 1;
+	bitmapNext.bitmapBlockSize = sizeof(payload);
+	bitmapNext.bitmapBlock = payload;
+	Stream_SetPosition(s, 0);
+	TEST_CHECK(update_write_stream_bitmap_next_order(s, &bitmapNext));
+	test_rewind(s);
+	TEST_CHECK(update_read_stream_bitmap_next_order(s, &bitmapNextOut));
+	TEST_CHECK(Stream_GetRemainingLength(s) == 0);
+	TEST_CHECK(bitmapNextOut.bitmapFlags == bitmapNext.bitmapFlags);
+	TEST_CHECK(memcmp(bitmapNextOut.bitmapBlock, payload, sizeof(payload)) == 0);
+
+	/* DrawGdiPlusFirst */
+	gdiFirst.cbSize = sizeof(payload);
+	gdiFirst.cbTotalSize = 1000;
+	gdiFirst.cbTotalEmfSize = 900;
+	gdiFirst.emfRecords = payload;
+	Stream_SetPosition(s, 0);
+	TEST_CHECK(update_write_draw_gdiplus_first_order(s, &gdiFirst));
+	test_rewind(s);
+	TEST_CHECK(update_read_draw_gdiplus_first_order(s, &gdiFirstOut));
+	TEST_CHECK(Stream_GetRemainingLength(s) == 0);
+	TEST_CHECK(gdiFirstOut.cbTotalEmfSize == gdiFirst.cbTotalEmfSize);
+	TEST_CHECK(memcmp(gdiFirstOut.emfRecords, payload, sizeof(payload)) == 0);
+
+	/* DrawGdiPlusNext */
+	gdiNext.cbSize = sizeof(payload);
+	gdiNext.emfRecords = payload;
+	Stream_SetPosition(s, 0);
+	TEST_CHECK(update_write_draw_gdiplus_next_order(s, &gdiNext));
+	test_rewind(s);
+	TEST_CHECK(update_read_draw_gdiplus_next_order(s, &gdiNextOut));
+	TEST_CHECK(Stream_GetRemainingLength(s) == 0);
+	TEST_CHECK(gdiNextOut.cbSize == gdiNext.cbSize);
+	TEST_CHECK(memcmp(gdiNextOut.emfRecords, payload, sizeof(payload)) == 0);
+
+	/* DrawGdiPlusEnd */
+	gdiEnd.cbSize = sizeof(payload);
+	gdiEnd.cbTotalSize = 2000;
+	gdiEnd.cbTotalEmfSize = 1900;
+	gdiEnd.emfRecords = payload;
+	Stream_SetPosition(s, 0);
+	TEST_CHECK(update_write_draw_gdiplus_end_order(s, &gdiEnd));
+	test_rewind(s);
+	TEST_CHECK(update_read_draw_gdiplus_end_order(s, &gdiEndOut));
+	TEST_CHECK(Stream_GetRemainingLength(s) == 0);
+	TEST_CHECK(gdiEndOut.cbTotalSize == gdiEnd.cbTotalSize);
+	TEST_CHECK(memcmp(gdiEndOut.emfRecords, payload, sizeof(payload)) == 0);
+
+	/* DrawGdiPlusCacheFirst */
+	cacheFirst.flags = 1;
+	cacheFirst.cacheType = 2;
+	cacheFirst.cacheIndex = 3;
+	cacheFirst.cbSize = sizeof(payload);
+	cacheFirst.cbTotalSize = 4000;
+	cacheFirst.emfRecords = payload;
+	Stream_SetPosition(s, 0);
+	TEST_CHECK(update_write_draw_gdiplus_cache_first_order(s, &cacheFirst));
+	test_rewind(s);
+	TEST_CHECK(update_read_draw_gdiplus_cache_first_order(s, &cacheFirstOut));
+	TEST_CHECK(Stream_GetRemainingLength(s) == 0);
+	TEST_CHECK(cacheFirstOut.cacheType == cacheFirst.cacheType);
+	TEST_CHECK(cacheFirstOut.cacheIndex == cacheFirst.cacheIndex);
+	TEST_CHECK(cacheFirstOut.cbTotalSize == cacheFirst.cbTotalSize);
+	TEST_CHECK(memcmp(cacheFirstOut.emfRecords, payload, sizeof(payload)) == 0);
+
+	/* DrawGdiPlusCacheNext */
+	cacheNext.flags = 0;
+	cacheNext.cacheType = 4;
+	cacheNext.cacheIndex = 5;
+	cacheNext.cbSize = sizeof(payload);
+	cacheNext.emfRecords = payload;
+	Stream_SetPosition(s, 0);
+	TEST_CHECK(update_write_draw_gdiplus_cache_next_order(s, &cacheNext));
+	test_rewind(s);
+	TEST_CHECK(update_read_draw_gdiplus_cache_next_order(s, &cacheNextOut));
+	TEST_CHECK(Stream_GetRemainingLength(s) == 0);
+	TEST_CHECK(cacheNextOut.cacheIndex == cacheNext.cacheIndex);
+	TEST_CHECK(memcmp(cacheNextOut.emfRecords, payload, sizeof(payload)) == 0);
+
+	/* DrawGdiPlusCacheEnd */
+	cacheEnd.flags = 1;
+	cacheEnd.cacheType = 6;
+	cacheEnd.cacheIndex = 7;
+	cacheEnd.cbSize = sizeof(payload);
+	cacheEnd.cbTotalSize = 8000;
+	cacheEnd.emfRecords = payload;
+	Stream_SetPosition(s, 0);
+	TEST_CHECK(update_write_draw_gdiplus_cache_end_order(s, &cacheEnd));
+	test_rewind(s);
+	TEST_CHECK(update_read_draw_gdiplus_cache_end_order(s, &cacheEndOut));
+	TEST_CHECK(Stream_GetRemainingLength(s) == 0);
+	TEST_CHECK(cacheEndOut.cbTotalSize == cacheEnd.cbTotalSize);
+	TEST_CHECK(memcmp(cacheEndOut.emfRecords, payload, sizeof(payload)) == 0);
+
+	return 0;
+}
+
+int TestCoreOrders(int argc, char* argv[])
+{
+	int status = 0;
+	wStream* s;
+
+	s = Stream_New(NULL, 16);
+
+	if (!s)
+		return -1;
+
+	if (test_dstblt_family(s) < 0)
+		status = -1;
+
+	if (test_polyline_family(s) < 0)
+		status = -1;
+
+	if (test_blt_and_glyph_family(s) < 0)
+		status = -1;
+
+	if (test_secondary_orders(s) < 0)
+		status = -1;
+
+	if (test_altsec_orders(s) < 0)
+		status = -1;
+
+	Stream_Free(s, TRUE);
+
+	return status;
+}
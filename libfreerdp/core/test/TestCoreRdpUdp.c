@@ -0,0 +1,922 @@
+
+#include <stdio.h>
+#include <errno.h>
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+#include <winpr/thread.h>
+#include <winpr/winsock.h>
+#include <winpr/interlocked.h>
+
+#include <freerdp/freerdp.h>
+
+#include "rdpudp.h"
+#include "tunnel.h"
+
+#ifndef _WIN32
+#include <time.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#endif
+
+#define TEST_HOST		"127.0.0.1"
+
+#define TEST_TRANSFER_SIZE	(1024 * 1024)
+#define TEST_TRANSFER_TIMEOUT	30000
+
+#define TEST_FRAMES		200
+#define TEST_FRAME_SIZE		1000
+#define TEST_FRAME_INTERVAL	5
+
+/* one way delay in ms and loss in per mille of the emulated link */
+#define TEST_DELAY		10
+#define TEST_LOSS		20
+
+#define TEST_RELAY_PACKETS	4096
+
+struct test_packet
+{
+	UINT64 due;
+	BOOL toServer;
+	int length;
+	BYTE data[RDPUDP_MTU];
+};
+
+struct test_relay
+{
+	int frontfd;
+	int backfd;
+	UINT16 port;
+
+	struct sockaddr_storage client;
+	socklen_t clientLength;
+
+	int loss;
+	UINT32 delay;
+	UINT32 seed;
+
+	struct test_packet* packets;
+	int head;
+	int count;
+
+	HANDLE thread;
+	LONG volatile stop;
+	LONG dropped;
+};
+
+struct test_sink
+{
+	const BYTE* expected;
+	size_t length;
+	size_t received;
+	BOOL mismatch;
+
+	INT64 latencies[TEST_FRAMES];
+	int frames;
+	int duplicates;
+
+	int sockfd;
+	HANDLE event;
+};
+
+static rdpUdp* g_ServerUdp = NULL;
+static rdpTunnel* g_ServerTunnels[8];
+static int g_ServerTunnelCount = 0;
+static BYTE g_Cookie[16];
+static CRITICAL_SECTION g_Lock;
+
+static UINT64 test_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ((UINT64) ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
+}
+
+static UINT32 test_random(UINT32* seed)
+{
+	*seed = (*seed * 1103515245) + 12345;
+
+	return (*seed >> 16) & 0x7FFF;
+}
+
+static UINT16 test_get_port(int sockfd)
+{
+	struct sockaddr_in addr;
+	socklen_t length = sizeof(addr);
+
+	if (getsockname(sockfd, (struct sockaddr*) &addr, &length) != 0)
+		return 0;
+
+	return ntohs(addr.sin_port);
+}
+
+static int test_socket(int type, UINT16 port)
+{
+	int sockfd;
+	struct sockaddr_in addr;
+
+	sockfd = socket(AF_INET, type, 0);
+
+	if (sockfd < 0)
+		return -1;
+
+	ZeroMemory(&addr, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if (bind(sockfd, (struct sockaddr*) &addr, sizeof(addr)) != 0)
+	{
+		close(sockfd);
+		return -1;
+	}
+
+	return sockfd;
+}
+
+static int test_connect(int sockfd, UINT16 port)
+{
+	struct sockaddr_in addr;
+
+	ZeroMemory(&addr, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	return connect(sockfd, (struct sockaddr*) &addr, sizeof(addr));
+}
+
+/**
+ * UDP relay between the client and the listener, emulating a link with a fixed
+ * delay and random loss. SYN datagrams are never dropped so that the handshake
+ * does not wait for its retransmission timer.
+ */
+
+static void test_relay_receive(struct test_relay* relay, int sockfd, BOOL toServer)
+{
+	int length;
+	UINT16 uFlags;
+	struct test_packet* packet;
+	struct sockaddr_storage address;
+	socklen_t addressLength;
+
+	while (1)
+	{
+		packet = &relay->packets[(relay->head + relay->count) % TEST_RELAY_PACKETS];
+		addressLength = sizeof(address);
+
+		length = recvfrom(sockfd, packet->data, sizeof(packet->data), 0,
+				(struct sockaddr*) &address, &addressLength);
+
+		if (length < 0)
+			return;
+
+		if (toServer)
+		{
+			CopyMemory(&relay->client, &address, addressLength);
+			relay->clientLength = addressLength;
+		}
+
+		uFlags = (length >= 8) ? ((packet->data[6] << 8) | packet->data[7]) : 0;
+
+		if (!(uFlags & RDPUDP_FLAG_SYN) && ((int) (test_random(&relay->seed) % 1000) < relay->loss))
+		{
+			relay->dropped++;
+			continue;
+		}
+
+		if (relay->count >= TEST_RELAY_PACKETS)
+			continue;
+
+		packet->due = test_now() + (relay->delay * 1000);
+		packet->toServer = toServer;
+		packet->length = length;
+		relay->count++;
+	}
+}
+
+static void* test_relay_thread(void* arg)
+{
+	int timeout;
+	UINT64 now;
+	struct pollfd pfds[2];
+	struct test_packet* packet;
+	struct test_relay* relay = (struct test_relay*) arg;
+
+	pfds[0].fd = relay->frontfd;
+	pfds[0].events = POLLIN;
+	pfds[1].fd = relay->backfd;
+	pfds[1].events = POLLIN;
+
+	while (!relay->stop)
+	{
+		now = test_now();
+
+		while (relay->count > 0)
+		{
+			packet = &relay->packets[relay->head];
+
+			if (packet->due > now)
+				break;
+
+			if (packet->toServer)
+				send(relay->backfd, packet->data, packet->length, 0);
+			else if (relay->clientLength)
+				sendto(relay->frontfd, packet->data, packet->length, 0,
+						(struct sockaddr*) &relay->client, relay->clientLength);
+
+			relay->head = (relay->head + 1) % TEST_RELAY_PACKETS;
+			relay->count--;
+		}
+
+		timeout = (relay->count > 0) ? 1 : 10;
+
+		if (poll(pfds, 2, timeout) <= 0)
+			continue;
+
+		if (pfds[0].revents & POLLIN)
+			test_relay_receive(relay, relay->frontfd, TRUE);
+
+		if (pfds[1].revents & POLLIN)
+			test_relay_receive(relay, relay->backfd, FALSE);
+	}
+
+	return NULL;
+}
+
+static struct test_relay* test_relay_new(UINT16 serverPort, UINT32 delay, int loss)
+{
+	struct test_relay* relay;
+
+	relay = (struct test_relay*) calloc(1, sizeof(struct test_relay));
+
+	if (!relay)
+		return NULL;
+
+	relay->delay = delay;
+	relay->loss = loss;
+	relay->seed = 0x4C4F5353;
+	relay->packets = (struct test_packet*) calloc(TEST_RELAY_PACKETS, sizeof(struct test_packet));
+	relay->frontfd = test_socket(SOCK_DGRAM, 0);
+	relay->backfd = test_socket(SOCK_DGRAM, 0);
+
+	if (!relay->packets || (relay->frontfd < 0) || (relay->backfd < 0) ||
+			(test_connect(relay->backfd, serverPort) != 0))
+		return NULL;
+
+	fcntl(relay->frontfd, F_SETFL, O_NONBLOCK);
+	fcntl(relay->backfd, F_SETFL, O_NONBLOCK);
+
+	relay->port = test_get_port(relay->frontfd);
+	relay->thread = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE) test_relay_thread, relay, 0, NULL);
+
+	return relay;
+}
+
+static void test_relay_free(struct test_relay* relay)
+{
+	if (!relay)
+		return;
+
+	if (relay->thread)
+	{
+		InterlockedExchange(&relay->stop, 1);
+		WaitForSingleObject(relay->thread, INFINITE);
+		CloseHandle(relay->thread);
+	}
+
+	close(relay->frontfd);
+	close(relay->backfd);
+	free(relay->packets);
+	free(relay);
+}
+
+static void test_sink_receive(struct test_sink* sink, const BYTE* data, int length)
+{
+	UINT32 sequence;
+	UINT64 timestamp;
+
+	if (sink->expected)
+	{
+		if ((sink->received + length > sink->length) ||
+				(memcmp(&sink->expected[sink->received], data, length) != 0))
+			sink->mismatch = TRUE;
+
+		sink->received += length;
+
+		if (sink->mismatch || (sink->received >= sink->length))
+			SetEvent(sink->event);
+
+		return;
+	}
+
+	if (length < 12)
+		return;
+
+	CopyMemory(&timestamp, data, 8);
+	CopyMemory(&sequence, &data[8], 4);
+
+	if (sequence >= TEST_FRAMES)
+		return;
+
+	if (sink->latencies[sequence] >= 0)
+	{
+		sink->duplicates++;
+		return;
+	}
+
+	sink->latencies[sequence] = (INT64) (test_now() - timestamp);
+	sink->frames++;
+
+	if (sink->frames >= TEST_FRAMES)
+		SetEvent(sink->event);
+}
+
+static void test_udp_receive(rdpUdp* udp, const BYTE* data, int length, void* param)
+{
+	test_sink_receive((struct test_sink*) param, data, length);
+}
+
+static void test_udp_accepted(rdpUdpListener* listener, rdpUdp* udp, void* param)
+{
+	udp->Receive = test_udp_receive;
+	udp->param = param;
+	g_ServerUdp = udp;
+}
+
+static void test_sink_reset(struct test_sink* sink)
+{
+	int index;
+
+	sink->expected = NULL;
+	sink->length = sink->received = 0;
+	sink->mismatch = FALSE;
+	sink->frames = sink->duplicates = 0;
+
+	for (index = 0; index < TEST_FRAMES; index++)
+		sink->latencies[index] = -1;
+
+	ResetEvent(sink->event);
+}
+
+static int test_compare(const void* a, const void* b)
+{
+	INT64 x = *((const INT64*) a);
+	INT64 y = *((const INT64*) b);
+
+	return (x < y) ? -1 : ((x > y) ? 1 : 0);
+}
+
+/* percentiles in microseconds of the frames received */
+static void test_percentiles(struct test_sink* sink, INT64* p50, INT64* p95)
+{
+	int index;
+	int count = 0;
+	INT64 values[TEST_FRAMES];
+
+	for (index = 0; index < TEST_FRAMES; index++)
+	{
+		if (sink->latencies[index] >= 0)
+			values[count++] = sink->latencies[index];
+	}
+
+	*p50 = *p95 = 0;
+
+	if (count < 1)
+		return;
+
+	qsort(values, count, sizeof(INT64), test_compare);
+
+	*p50 = values[(count * 50) / 100];
+	*p95 = values[MIN(count - 1, (count * 95) / 100)];
+}
+
+static void test_make_frame(BYTE* frame, UINT32 sequence)
+{
+	UINT64 timestamp = test_now();
+
+	ZeroMemory(frame, TEST_FRAME_SIZE);
+	CopyMemory(frame, &timestamp, 8);
+	CopyMemory(&frame[8], &sequence, 4);
+}
+
+/**
+ * Connects a client through a relay to the listener and runs one scenario:
+ * a byte exact bulk transfer when sink->expected is set, paced frames otherwise.
+ */
+
+static int test_udp_scenario(rdpUdpListener* listener, struct test_sink* sink, BOOL lossy,
+		UINT32 delay, int loss, const char* name)
+{
+	int status = -1;
+	UINT32 index;
+	size_t offset;
+	INT64 p50, p95;
+	UINT64 start;
+	rdpUdp* udp = NULL;
+	struct test_relay* relay;
+	BYTE frame[TEST_FRAME_SIZE];
+
+	g_ServerUdp = NULL;
+	relay = test_relay_new(test_get_port(listener->sockfd), delay, loss);
+
+	if (!relay)
+	{
+		printf("%s: relay failed\n", name);
+		return -1;
+	}
+
+	udp = rdpudp_new(lossy, NULL, NULL, NULL);
+
+	if (!udp || !rdpudp_connect(udp, TEST_HOST, relay->port, 5000))
+	{
+		printf("%s: connect failed\n", name);
+		goto out;
+	}
+
+	start = test_now();
+
+	if (sink->expected)
+	{
+		for (offset = 0; offset < sink->length; offset += 0x10000)
+		{
+			if (rdpudp_write(udp, &sink->expected[offset], (int) MIN(0x10000, sink->length - offset)) < 0)
+				goto out;
+		}
+
+		if (WaitForSingleObject(sink->event, TEST_TRANSFER_TIMEOUT) != WAIT_OBJECT_0 || sink->mismatch)
+		{
+			printf("%s: received %d of %d bytes%s\n", name, (int) sink->received,
+					(int) sink->length, sink->mismatch ? ", corrupted" : "");
+			goto out;
+		}
+
+		printf("%s: %d bytes in %d ms, %u datagrams, %u retransmissions, %d dropped by the link\n",
+				name, (int) sink->length, (int) ((test_now() - start) / 1000),
+				udp->DatagramsSent, udp->Retransmissions, (int) relay->dropped);
+	}
+	else
+	{
+		for (index = 0; index < TEST_FRAMES; index++)
+		{
+			test_make_frame(frame, index);
+
+			if (rdpudp_write(udp, frame, TEST_FRAME_SIZE) < 0)
+				goto out;
+
+			Sleep(TEST_FRAME_INTERVAL);
+		}
+
+		WaitForSingleObject(sink->event, lossy ? (delay * 4 + 500) : TEST_TRANSFER_TIMEOUT);
+		test_percentiles(sink, &p50, &p95);
+
+		printf("%s: %d/%d frames, %d duplicates, p50 %d.%03d ms, p95 %d.%03d ms\n",
+				name, sink->frames, TEST_FRAMES, sink->duplicates,
+				(int) (p50 / 1000), (int) (p50 % 1000), (int) (p95 / 1000), (int) (p95 % 1000));
+	}
+
+	status = 0;
+
+out:
+	rdpudp_free(udp);
+	rdpudp_free(g_ServerUdp);
+	g_ServerUdp = NULL;
+	test_relay_free(relay);
+
+	return status;
+}
+
+/**
+ * TCP baseline: the frames cross a relay adding the same delay. Loss cannot be
+ * emulated on a loopback TCP connection without root, so only delay applies.
+ */
+
+struct test_tcp_relay
+{
+	int infd;
+	int outfd;
+	UINT32 delay;
+	LONG volatile stop;
+};
+
+struct test_tcp_chunk
+{
+	UINT64 due;
+	int length;
+	BYTE data[TEST_FRAME_SIZE];
+};
+
+static void* test_tcp_relay_thread(void* arg)
+{
+	int length;
+	int count = 0;
+	int head = 0;
+	UINT64 now;
+	struct pollfd pfd;
+	struct test_tcp_chunk* chunk;
+	struct test_tcp_chunk* chunks;
+	struct test_tcp_relay* relay = (struct test_tcp_relay*) arg;
+
+	chunks = (struct test_tcp_chunk*) calloc(TEST_RELAY_PACKETS, sizeof(struct test_tcp_chunk));
+
+	if (!chunks)
+		return NULL;
+
+	pfd.fd = relay->infd;
+	pfd.events = POLLIN;
+
+	while (!relay->stop)
+	{
+		now = test_now();
+
+		while ((count > 0) && (chunks[head].due <= now))
+		{
+			send(relay->outfd, chunks[head].data, chunks[head].length, 0);
+			head = (head + 1) % TEST_RELAY_PACKETS;
+			count--;
+		}
+
+		if ((poll(&pfd, 1, 1) <= 0) || (count >= TEST_RELAY_PACKETS))
+			continue;
+
+		chunk = &chunks[(head + count) % TEST_RELAY_PACKETS];
+		length = recv(relay->infd, chunk->data, sizeof(chunk->data), 0);
+
+		if (length <= 0)
+			break;
+
+		chunk->due = test_now() + (relay->delay * 1000);
+		chunk->length = length;
+		count++;
+	}
+
+	free(chunks);
+
+	return NULL;
+}
+
+static void* test_tcp_receive_thread(void* arg)
+{
+	int length;
+	int offset;
+	BYTE frame[TEST_FRAME_SIZE];
+	struct test_sink* sink = (struct test_sink*) arg;
+
+	while (sink->frames < TEST_FRAMES)
+	{
+		for (offset = 0; offset < TEST_FRAME_SIZE; offset += length)
+		{
+			length = recv(sink->sockfd, &frame[offset], TEST_FRAME_SIZE - offset, 0);
+
+			if (length <= 0)
+				return NULL;
+		}
+
+		test_sink_receive(sink, frame, TEST_FRAME_SIZE);
+	}
+
+	return NULL;
+}
+
+static int test_tcp_scenario(struct test_sink* sink, UINT32 delay)
+{
+	int value = 1;
+	int status = -1;
+	UINT32 index;
+	INT64 p50, p95;
+	int senderfd = -1;
+	int receiverfd = -1;
+	int listenfd[2] = { -1, -1 };
+	HANDLE threads[2] = { NULL, NULL };
+	struct test_tcp_relay relay = { -1, -1, delay, 0 };
+	BYTE frame[TEST_FRAME_SIZE];
+
+	listenfd[0] = test_socket(SOCK_STREAM, 0);
+	listenfd[1] = test_socket(SOCK_STREAM, 0);
+	senderfd = socket(AF_INET, SOCK_STREAM, 0);
+	relay.outfd = socket(AF_INET, SOCK_STREAM, 0);
+
+	if ((listenfd[0] < 0) || (listenfd[1] < 0) || (senderfd < 0) || (relay.outfd < 0) ||
+			(listen(listenfd[0], 1) != 0) || (listen(listenfd[1], 1) != 0))
+		goto out;
+
+	if ((test_connect(senderfd, test_get_port(listenfd[0])) != 0) ||
+			((relay.infd = accept(listenfd[0], NULL, NULL)) < 0) ||
+			(test_connect(relay.outfd, test_get_port(listenfd[1])) != 0) ||
+			((receiverfd = accept(listenfd[1], NULL, NULL)) < 0))
+		goto out;
+
+	setsockopt(senderfd, IPPROTO_TCP, TCP_NODELAY, (void*) &value, sizeof(value));
+	setsockopt(relay.outfd, IPPROTO_TCP, TCP_NODELAY, (void*) &value, sizeof(value));
+
+	sink->sockfd = receiverfd;
+	threads[0] = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE) test_tcp_relay_thread, &relay, 0, NULL);
+	threads[1] = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE) test_tcp_receive_thread, sink, 0, NULL);
+
+	for (index = 0; index < TEST_FRAMES; index++)
+	{
+		test_make_frame(frame, index);
+
+		if (send(senderfd, frame, TEST_FRAME_SIZE, 0) != TEST_FRAME_SIZE)
+			goto out;
+
+		Sleep(TEST_FRAME_INTERVAL);
+	}
+
+	WaitForSingleObject(sink->event, TEST_TRANSFER_TIMEOUT);
+	test_percentiles(sink, &p50, &p95);
+
+	printf("tcp, %d ms delay: %d/%d frames, p50 %d.%03d ms, p95 %d.%03d ms\n",
+			delay, sink->frames, TEST_FRAMES,
+			(int) (p50 / 1000), (int) (p50 % 1000), (int) (p95 / 1000), (int) (p95 % 1000));
+
+	status = (sink->frames == TEST_FRAMES) ? 0 : -1;
+
+out:
+	InterlockedExchange(&relay.stop, 1);
+
+	if (senderfd >= 0)
+		shutdown(senderfd, SHUT_RDWR);
+
+	if (receiverfd >= 0)
+		shutdown(receiverfd, SHUT_RDWR);
+
+	for (index = 0; index < 2; index++)
+	{
+		if (threads[index])
+		{
+			WaitForSingleObject(threads[index], INFINITE);
+			CloseHandle(threads[index]);
+		}
+
+		if (listenfd[index] >= 0)
+			close(listenfd[index]);
+	}
+
+	if (senderfd >= 0)
+		close(senderfd);
+
+	if (receiverfd >= 0)
+		close(receiverfd);
+
+	if (relay.infd >= 0)
+		close(relay.infd);
+
+	if (relay.outfd >= 0)
+		close(relay.outfd);
+
+	return status;
+}
+
+static UINT32 test_tunnel_create(rdpTunnel* tunnel, UINT32 requestId, const BYTE* securityCookie, void* param)
+{
+	return (memcmp(securityCookie, g_Cookie, 16) == 0) ? S_OK : E_ABORT;
+}
+
+static void test_tunnel_receive(rdpTunnel* tunnel, const BYTE* data, int length, void* param)
+{
+	test_sink_receive((struct test_sink*) param, data, length);
+}
+
+static void test_tunnel_accepted(rdpUdpListener* listener, rdpUdp* udp, void* param)
+{
+	rdpTunnel* tunnel;
+
+	tunnel = tunnel_new(TRUE, udp->lossy, NULL, test_tunnel_create, NULL);
+
+	if (!tunnel)
+		return;
+
+	EnterCriticalSection(&g_Lock);
+
+	if (g_ServerTunnelCount < 8)
+		g_ServerTunnels[g_ServerTunnelCount++] = tunnel;
+
+	LeaveCriticalSection(&g_Lock);
+
+	tunnel_accept(tunnel, udp, TEST_CERTIFICATE_DIR "/server.crt", TEST_CERTIFICATE_DIR "/server.key");
+}
+
+static rdpTunnel* test_tunnel_get_server(int index)
+{
+	int retries;
+	rdpTunnel* tunnel = NULL;
+
+	for (retries = 0; retries < 100; retries++)
+	{
+		EnterCriticalSection(&g_Lock);
+		tunnel = (index < g_ServerTunnelCount) ? g_ServerTunnels[index] : NULL;
+		LeaveCriticalSection(&g_Lock);
+
+		if (tunnel && (tunnel->state == TUNNEL_STATE_CONNECTED))
+			return tunnel;
+
+		Sleep(10);
+	}
+
+	return NULL;
+}
+
+static int test_tunnels(struct test_sink* sink)
+{
+	int status = -1;
+	UINT32 index;
+	UINT16 port;
+	rdpTunnel* client = NULL;
+	rdpTunnel* server;
+	rdpUdpListener* listener;
+	BYTE wrongCookie[16];
+	BYTE wrongKey[16];
+	BYTE frame[TEST_FRAME_SIZE];
+
+	listener = rdpudp_listener_new(TEST_HOST, 0, test_tunnel_accepted, NULL);
+
+	if (!listener)
+		return -1;
+
+	port = test_get_port(listener->sockfd);
+
+	for (index = 0; index < 16; index++)
+	{
+		g_Cookie[index] = (BYTE) (index * 7 + 3);
+		wrongCookie[index] = (BYTE) ~g_Cookie[index];
+		wrongKey[index] = (BYTE) index;
+	}
+
+	/* a tunnel carrying data from the server to the client, over DTLS */
+
+	test_sink_reset(sink);
+	client = tunnel_new(FALSE, FALSE, test_tunnel_receive, NULL, sink);
+
+	if (!client || !tunnel_connect(client, TEST_HOST, port, 1, g_Cookie, NULL, 0, 5000))
+	{
+		printf("tunnel: connect failed\n");
+		goto out;
+	}
+
+	if (!client->dtls->PublicKey || (client->dtls->PublicKeyLength < 1))
+	{
+		printf("tunnel: no server public key\n");
+		goto out;
+	}
+
+	server = test_tunnel_get_server(0);
+
+	if (!server || (server->requestId != 1))
+	{
+		printf("tunnel: server end not connected\n");
+		goto out;
+	}
+
+	for (index = 0; index < TEST_FRAMES; index++)
+	{
+		test_make_frame(frame, index);
+
+		if (tunnel_write(server, frame, TEST_FRAME_SIZE) < 0)
+		{
+			printf("tunnel: write failed\n");
+			goto out;
+		}
+	}
+
+	if ((WaitForSingleObject(sink->event, 5000) != WAIT_OBJECT_0) || sink->duplicates)
+	{
+		printf("tunnel: received %d of %d frames\n", sink->frames, TEST_FRAMES);
+		goto out;
+	}
+
+	tunnel_free(client);
+
+	/* a security cookie the server did not issue is refused */
+
+	client = tunnel_new(FALSE, FALSE, NULL, NULL, NULL);
+
+	if (!client || tunnel_connect(client, TEST_HOST, port, 2, wrongCookie, NULL, 0, 5000))
+	{
+		printf("tunnel: wrong cookie accepted\n");
+		goto out;
+	}
+
+	tunnel_free(client);
+
+	/* so is a server which does not own the key of the main connection */
+
+	client = tunnel_new(FALSE, TRUE, NULL, NULL, NULL);
+
+	if (!client || tunnel_connect(client, TEST_HOST, port, 3, g_Cookie, wrongKey, sizeof(wrongKey), 5000))
+	{
+		printf("tunnel: wrong public key accepted\n");
+		goto out;
+	}
+
+	printf("tunnel: %d frames over DTLS, wrong cookie and public key refused\n", TEST_FRAMES);
+	status = 0;
+
+out:
+	tunnel_free(client);
+
+	for (index = 0; index < (UINT32) g_ServerTunnelCount; index++)
+		tunnel_free(g_ServerTunnels[index]);
+
+	g_ServerTunnelCount = 0;
+	rdpudp_listener_free(listener);
+
+	return status;
+}
+
+int TestCoreRdpUdp(int argc, char* argv[])
+{
+	int status = -1;
+	BYTE* data = NULL;
+	UINT32 index;
+	UINT32 seed = 0x5EED;
+	INT64 p50, p95;
+	rdpUdpListener* listener = NULL;
+	struct test_sink* sink;
+
+	sink = (struct test_sink*) calloc(1, sizeof(struct test_sink));
+	data = (BYTE*) malloc(TEST_TRANSFER_SIZE);
+
+	if (!sink || !data)
+		return -1;
+
+	InitializeCriticalSection(&g_Lock);
+	sink->event = CreateEvent(NULL, TRUE, FALSE, NULL);
+	listener = rdpudp_listener_new(TEST_HOST, 0, test_udp_accepted, sink);
+
+	if (!listener)
+	{
+		printf("listener failed\n");
+		goto out;
+	}
+
+	for (index = 0; index < TEST_TRANSFER_SIZE; index++)
+		data[index] = (BYTE) test_random(&seed);
+
+	/* reliable: every byte arrives, in order, despite the loss */
+
+	test_sink_reset(sink);
+	sink->expected = data;
+	sink->length = TEST_TRANSFER_SIZE;
+
+	if (test_udp_scenario(listener, sink, FALSE, 2, TEST_LOSS, "reliable transfer") < 0)
+		goto out;
+
+	/* frame latencies, TCP with delay against UDP with delay and loss */
+
+	test_sink_reset(sink);
+
+	if (test_tcp_scenario(sink, TEST_DELAY) < 0)
+		goto out;
+
+	test_sink_reset(sink);
+
+	if (test_udp_scenario(listener, sink, FALSE, TEST_DELAY, TEST_LOSS, "udp reliable") < 0)
+		goto out;
+
+	if (sink->frames != TEST_FRAMES || sink->duplicates)
+	{
+		printf("reliable: frames lost or duplicated\n");
+		goto out;
+	}
+
+	test_sink_reset(sink);
+
+	if (test_udp_scenario(listener, sink, TRUE, TEST_DELAY, TEST_LOSS, "udp lossy") < 0)
+		goto out;
+
+	/* lossy: no duplicates, nothing retransmitted late, about (1 - loss) delivered */
+
+	test_percentiles(sink, &p50, &p95);
+
+	if (sink->duplicates || (sink->frames < (TEST_FRAMES * 90) / 100) ||
+			(p95 > (TEST_DELAY + 50) * 1000))
+	{
+		printf("lossy: unexpected delivery\n");
+		goto out;
+	}
+
+	rdpudp_listener_free(listener);
+	listener = NULL;
+
+	if (test_tunnels(sink) < 0)
+		goto out;
+
+	status = 0;
+
+out:
+	rdpudp_listener_free(listener);
+	CloseHandle(sink->event);
+	DeleteCriticalSection(&g_Lock);
+	free(sink);
+	free(data);
+
+	return status;
+}
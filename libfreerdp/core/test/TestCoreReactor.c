@@ -0,0 +1,543 @@
+
+#include <stdio.h>
+#include <errno.h>
+
+#include <winpr/crt.h>
+#include <winpr/wlog.h>
+#include <winpr/synch.h>
+#include <winpr/thread.h>
+#include <winpr/winsock.h>
+#include <winpr/interlocked.h>
+
+#include <freerdp/freerdp.h>
+#include <freerdp/peer.h>
+
+#ifndef _WIN32
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#endif
+
+#define TEST_PEERS		1000
+#define TEST_FDS_PER_PEER	8
+#define TEST_TIMER_DUE		50
+#define TEST_LOOPS		2
+#define TEST_THREADS		4
+
+#define TEST_MESSAGE_SIZE	16
+
+struct test_peer
+{
+	freerdp_peer* client;
+	int sockfd;
+	HANDLE event;
+	UINT64 due;
+	UINT64 fired;
+	UINT64 signaled;
+};
+
+static struct test_peer* g_Peers = NULL;
+static LONG volatile g_Reads = 0;
+static LONG volatile g_Timers = 0;
+static LONG volatile g_Closed = 0;
+static HANDLE g_Event = NULL;
+static LONG g_Expected = 0;
+
+static UINT64 test_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ((UINT64) ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
+}
+
+static size_t test_resident_size(void)
+{
+	long pages = 0;
+	long resident = 0;
+	FILE* fp = fopen("/proc/self/statm", "r");
+
+	if (!fp)
+		return 0;
+
+	if (fscanf(fp, "%ld %ld", &pages, &resident) != 2)
+		resident = 0;
+
+	fclose(fp);
+
+	return (size_t) resident * sysconf(_SC_PAGESIZE);
+}
+
+static int test_compare(const void* a, const void* b)
+{
+	UINT64 x = *((const UINT64*) a);
+	UINT64 y = *((const UINT64*) b);
+
+	return (x < y) ? -1 : ((x > y) ? 1 : 0);
+}
+
+static void test_report(const char* name, UINT64* samples, int count)
+{
+	int index;
+	UINT64 total = 0;
+
+	qsort(samples, count, sizeof(UINT64), test_compare);
+
+	for (index = 0; index < count; index++)
+		total += samples[index];
+
+	printf("%s: mean %d us, median %d us, p99 %d us, max %d us\n", name,
+			(int) (total / count), (int) samples[count / 2],
+			(int) samples[(count * 99) / 100], (int) samples[count - 1]);
+}
+
+/**
+ * The peers speak a scripted protocol on their raw sockets, so the test
+ * measures the reactor and not the RDP stack: every message the client
+ * sends is echoed back, and end of file disconnects.
+ */
+
+static BOOL test_peer_get_fds(freerdp_peer* client, void** rfds, int* rcount)
+{
+	rfds[*rcount] = (void*)(long) client->sockfd;
+	(*rcount)++;
+
+	return TRUE;
+}
+
+static HANDLE test_peer_get_event_handle(freerdp_peer* client)
+{
+	return ((struct test_peer*) client->ContextExtra)->event;
+}
+
+static BOOL test_peer_check_fds(freerdp_peer* client)
+{
+	int status;
+	BYTE buffer[TEST_MESSAGE_SIZE * 8];
+
+	for (;;)
+	{
+		status = recv(client->sockfd, buffer, sizeof(buffer), MSG_DONTWAIT);
+
+		if (status == 0)
+			return FALSE;
+
+		if (status < 0)
+			return (errno == EAGAIN) || (errno == EWOULDBLOCK);
+
+		if (send(client->sockfd, buffer, status, 0) != status)
+			return FALSE;
+	}
+}
+
+static BOOL test_peer_is_write_blocked(freerdp_peer* client)
+{
+	return FALSE;
+}
+
+static int test_peer_drain_output_buffer(freerdp_peer* client)
+{
+	return 0;
+}
+
+static BOOL test_peer_event(freerdp_peer* client, UINT32 events)
+{
+	struct test_peer* peer = (struct test_peer*) client->ContextExtra;
+
+	if (events & FREERDP_PEER_EVENT_READ)
+		InterlockedIncrement(&g_Reads);
+
+	if (events & FREERDP_PEER_EVENT_TIMER)
+	{
+		peer->fired = test_now();
+
+		if (InterlockedIncrement(&g_Timers) == g_Expected)
+			SetEvent(g_Event);
+	}
+
+	if (events & FREERDP_PEER_EVENT_SIGNAL)
+	{
+		peer->signaled = test_now();
+		SetEvent(g_Event);
+	}
+
+	if (events & FREERDP_PEER_EVENT_CLOSED)
+	{
+		close(client->sockfd);
+		freerdp_peer_free(client);
+		peer->client = NULL;
+
+		if (InterlockedIncrement(&g_Closed) == g_Expected)
+			SetEvent(g_Event);
+	}
+
+	return TRUE;
+}
+
+static int test_peers_connect(int listenfd, int count)
+{
+	int index;
+	int sockfd;
+	int option = 1;
+	socklen_t length;
+	struct timeval timeout;
+	struct sockaddr_in addr;
+	freerdp_peer* client;
+
+	length = sizeof(addr);
+
+	if (getsockname(listenfd, (struct sockaddr*) &addr, &length) < 0)
+		return -1;
+
+	timeout.tv_sec = 5;
+	timeout.tv_usec = 0;
+
+	for (index = 0; index < count; index++)
+	{
+		g_Peers[index].sockfd = socket(AF_INET, SOCK_STREAM, 0);
+
+		if ((g_Peers[index].sockfd < 0) ||
+				(connect(g_Peers[index].sockfd, (struct sockaddr*) &addr, sizeof(addr)) < 0))
+			return -1;
+
+		setsockopt(g_Peers[index].sockfd, IPPROTO_TCP, TCP_NODELAY, &option, sizeof(option));
+		setsockopt(g_Peers[index].sockfd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+		sockfd = accept(listenfd, NULL, NULL);
+
+		if (sockfd < 0)
+			return -1;
+
+		client = freerdp_peer_new(sockfd);
+
+		if (!client)
+			return -1;
+
+		client->ContextExtra = &g_Peers[index];
+		client->GetFileDescriptor = test_peer_get_fds;
+		client->GetEventHandle = test_peer_get_event_handle;
+		client->CheckFileDescriptor = test_peer_check_fds;
+		client->IsWriteBlocked = test_peer_is_write_blocked;
+		client->DrainOutputBuffer = test_peer_drain_output_buffer;
+		client->ReactorEvent = test_peer_event;
+
+		g_Peers[index].client = client;
+		g_Peers[index].event = CreateFileDescriptorEvent(NULL, TRUE, FALSE, sockfd);
+
+		if (!g_Peers[index].event)
+			return -1;
+	}
+
+	return 0;
+}
+
+static void* test_idle_thread(void* arg)
+{
+	HANDLE events[2];
+	freerdp_peer* client = (freerdp_peer*) arg;
+
+	events[0] = g_Event;
+	events[1] = client->GetEventHandle(client);
+
+	WaitForMultipleObjects(2, events, FALSE, INFINITE);
+
+	return NULL;
+}
+
+/**
+ * The memory an idle session costs in the thread-per-peer model: one
+ * thread per peer, waiting on its socket.
+ */
+
+static int test_thread_per_peer(int count)
+{
+	int index;
+	size_t before;
+	size_t after;
+	HANDLE* threads;
+
+	threads = (HANDLE*) calloc(count, sizeof(HANDLE));
+
+	if (!threads)
+		return -1;
+
+	ResetEvent(g_Event);
+	before = test_resident_size();
+
+	for (index = 0; index < count; index++)
+	{
+		threads[index] = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE) test_idle_thread,
+				g_Peers[index].client, 0, NULL);
+
+		if (!threads[index])
+			return -1;
+	}
+
+	Sleep(100);
+	after = test_resident_size();
+
+	printf("thread per peer: %d bytes per idle peer\n", (int) ((after - before) / count));
+
+	SetEvent(g_Event);
+
+	for (index = 0; index < count; index++)
+	{
+		WaitForSingleObject(threads[index], INFINITE);
+		CloseHandle(threads[index]);
+	}
+
+	free(threads);
+
+	return 0;
+}
+
+static int test_reactor_echo(int count)
+{
+	int index;
+	BYTE buffer[TEST_MESSAGE_SIZE];
+	UINT64 start;
+	UINT64* samples;
+
+	samples = (UINT64*) calloc(count, sizeof(UINT64));
+
+	if (!samples)
+		return -1;
+
+	/* one message to each peer in turn, answered from a pool thread */
+
+	for (index = 0; index < count; index++)
+	{
+		FillMemory(buffer, sizeof(buffer), (BYTE) index);
+		start = test_now();
+
+		if (send(g_Peers[index].sockfd, buffer, sizeof(buffer), 0) != sizeof(buffer))
+			return -1;
+
+		ZeroMemory(buffer, sizeof(buffer));
+
+		if ((recv(g_Peers[index].sockfd, buffer, sizeof(buffer), MSG_WAITALL) != sizeof(buffer)) ||
+				(buffer[0] != (BYTE) index) || (buffer[TEST_MESSAGE_SIZE - 1] != (BYTE) index))
+		{
+			printf("peer %d: message not echoed\n", index);
+			return -1;
+		}
+
+		samples[index] = test_now() - start;
+	}
+
+	test_report("echo round trip", samples, count);
+
+	if (g_Reads < count)
+	{
+		printf("%d reads reported for %d messages\n", (int) g_Reads, count);
+		return -1;
+	}
+
+	free(samples);
+
+	return 0;
+}
+
+static int test_reactor_events(rdpReactor* reactor, int count)
+{
+	int index;
+	UINT64 start;
+	UINT64* samples;
+
+	samples = (UINT64*) calloc(count, sizeof(UINT64));
+
+	if (!samples)
+		return -1;
+
+	/* every peer's timer is due at once */
+
+	g_Expected = count;
+	ResetEvent(g_Event);
+
+	for (index = 0; index < count; index++)
+	{
+		g_Peers[index].due = test_now() + (TEST_TIMER_DUE * 1000);
+
+		if (!freerdp_peer_set_reactor_timer(g_Peers[index].client, TEST_TIMER_DUE, 0))
+			return -1;
+	}
+
+	if (WaitForSingleObject(g_Event, 5000) != WAIT_OBJECT_0)
+	{
+		printf("%d of %d timers fired\n", (int) g_Timers, count);
+		return -1;
+	}
+
+	for (index = 0; index < count; index++)
+	{
+		if (g_Peers[index].fired + 1000 < g_Peers[index].due)
+		{
+			printf("peer %d: timer fired early\n", index);
+			return -1;
+		}
+
+		samples[index] = g_Peers[index].fired - g_Peers[index].due;
+	}
+
+	test_report("timer lateness, all due at once", samples, count);
+
+	/* signals from another thread */
+
+	for (index = 0; index < count; index++)
+	{
+		ResetEvent(g_Event);
+		start = test_now();
+		freerdp_peer_signal_reactor(g_Peers[index].client);
+
+		if (WaitForSingleObject(g_Event, 5000) != WAIT_OBJECT_0)
+		{
+			printf("peer %d: signal not dispatched\n", index);
+			return -1;
+		}
+
+		samples[index] = g_Peers[index].signaled - start;
+	}
+
+	test_report("signal dispatch", samples, count);
+
+	free(samples);
+
+	return 0;
+}
+
+int TestCoreReactor(int argc, char* argv[])
+{
+#ifndef _WIN32
+	int index;
+	int count;
+	int listenfd;
+	int option = 1;
+	size_t before;
+	size_t after;
+	rdpReactor* reactor;
+	struct sockaddr_in addr;
+	struct rlimit limit;
+
+	WLog_SetLogLevel(WLog_GetRoot(), WLOG_WARN);
+
+	count = TEST_PEERS;
+
+	if (getrlimit(RLIMIT_NOFILE, &limit) == 0)
+	{
+		if (limit.rlim_cur < (rlim_t) (count * TEST_FDS_PER_PEER) + 256)
+		{
+			limit.rlim_cur = (limit.rlim_max < (rlim_t) (count * TEST_FDS_PER_PEER) + 256) ?
+					limit.rlim_max : (rlim_t) (count * TEST_FDS_PER_PEER) + 256;
+			setrlimit(RLIMIT_NOFILE, &limit);
+			getrlimit(RLIMIT_NOFILE, &limit);
+		}
+
+		if (limit.rlim_cur < (rlim_t) (count * TEST_FDS_PER_PEER) + 256)
+			count = ((int) limit.rlim_cur - 256) / TEST_FDS_PER_PEER;
+	}
+
+	g_Peers = (struct test_peer*) calloc(count, sizeof(struct test_peer));
+	g_Event = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+	if (!g_Peers || !g_Event)
+		return -1;
+
+	listenfd = socket(AF_INET, SOCK_STREAM, 0);
+	setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &option, sizeof(option));
+
+	ZeroMemory(&addr, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = 0;
+
+	if ((bind(listenfd, (struct sockaddr*) &addr, sizeof(addr)) < 0) || (listen(listenfd, 128) < 0))
+		return -1;
+
+	before = test_resident_size();
+
+	if (test_peers_connect(listenfd, count) < 0)
+	{
+		printf("failed to connect %d peers\n", count);
+		return -1;
+	}
+
+	after = test_resident_size();
+	printf("%d loopback peers, %d bytes per peer\n", count, (int) ((after - before) / count));
+
+	reactor = freerdp_reactor_new(TEST_LOOPS, TEST_THREADS);
+
+	if (!reactor)
+	{
+		printf("freerdp_reactor_new failure\n");
+		return -1;
+	}
+
+	before = test_resident_size();
+
+	for (index = 0; index < count; index++)
+	{
+		if (!freerdp_peer_attach_reactor(g_Peers[index].client, reactor))
+		{
+			printf("peer %d: freerdp_peer_attach_reactor failure\n", index);
+			return -1;
+		}
+	}
+
+	Sleep(100);
+	after = test_resident_size();
+
+	printf("reactor with %d loops and %d threads: %d bytes per idle peer\n", TEST_LOOPS,
+			TEST_THREADS, (int) ((after - before) / count));
+
+	/* the same idle peers, the same number of them, each with a thread of its own */
+
+	if (test_thread_per_peer(count) < 0)
+		return -1;
+
+	if (test_reactor_echo(count) < 0)
+		return -1;
+
+	if (test_reactor_events(reactor, count) < 0)
+		return -1;
+
+	/* half of the clients hang up, the reactor detaches the others when it is freed */
+
+	g_Expected = count / 2;
+	ResetEvent(g_Event);
+
+	for (index = 0; index < count / 2; index++)
+		close(g_Peers[index].sockfd);
+
+	if (WaitForSingleObject(g_Event, 5000) != WAIT_OBJECT_0)
+	{
+		printf("%d of %d hung up peers closed\n", (int) g_Closed, count / 2);
+		return -1;
+	}
+
+	freerdp_reactor_free(reactor);
+
+	if (g_Closed != count)
+	{
+		printf("%d of %d peers closed\n", (int) g_Closed, count);
+		return -1;
+	}
+
+	for (index = 0; index < count; index++)
+	{
+		if (index >= count / 2)
+			close(g_Peers[index].sockfd);
+
+		CloseHandle(g_Peers[index].event);
+	}
+
+	close(listenfd);
+	CloseHandle(g_Event);
+	free(g_Peers);
+#endif
+	return 0;
+}
@@ -0,0 +1,178 @@
+
+#include <stdio.h>
+
+#include <winpr/crt.h>
+#include <winpr/file.h>
+#include <winpr/path.h>
+
+#include <freerdp/freerdp.h>
+#include <freerdp/replay.h>
+#include <freerdp/gdi/gdi.h>
+
+/**
+ * replay_test.rec is a 256x192 session with RemoteFX surface bits, an
+ * uncompressed bitmap update, opaque rect orders and static channel data,
+ * recorded by a client connected to an in-process server. Its replay has
+ * to render the same frame buffer every time.
+ */
+
+#define TEST_RECORDING		TEST_RECORDING_DIR "/replay_test.rec"
+#define TEST_WIDTH		256
+#define TEST_HEIGHT		192
+#define TEST_FRAMEBUFFER_HASH	0x4E9D28CB
+
+static UINT32 test_fnv1a(const BYTE* data, size_t length)
+{
+	size_t index;
+	UINT32 hash = 0x811C9DC5;
+
+	for (index = 0; index < length; index++)
+	{
+		hash ^= data[index];
+		hash *= 0x01000193;
+	}
+
+	return hash;
+}
+
+static int test_replay(UINT32* hash)
+{
+	int index;
+	int status = -1;
+	rdpGdi* gdi;
+	freerdp* instance;
+	rdpReplay* replay;
+	const rdpReplayStats* stats;
+
+	replay = freerdp_replay_new(TEST_RECORDING);
+
+	if (!replay)
+	{
+		printf("failed to open %s\n", TEST_RECORDING);
+		return -1;
+	}
+
+	if (freerdp_replay_run(replay, FALSE) < 0)
+	{
+		printf("replay failed\n");
+		goto out;
+	}
+
+	instance = freerdp_replay_get_instance(replay);
+	gdi = instance->context->gdi;
+	stats = freerdp_replay_get_stats(replay);
+
+	if (!gdi || (gdi->width != TEST_WIDTH) || (gdi->height != TEST_HEIGHT))
+	{
+		printf("the replayed session was not rendered\n");
+		goto out;
+	}
+
+	if (!stats->calls[REPLAY_STAGE_SURFACE] || !stats->calls[REPLAY_STAGE_BITMAP] ||
+			!stats->calls[REPLAY_STAGE_ORDERS] || !stats->calls[REPLAY_STAGE_CHANNELS])
+	{
+		for (index = 0; index < REPLAY_STAGE_COUNT; index++)
+			printf("%s: %u calls\n", freerdp_replay_get_stage_name(index), stats->calls[index]);
+
+		printf("a stage of the recording was not replayed\n");
+		goto out;
+	}
+
+	*hash = test_fnv1a(gdi->primary_buffer, gdi->width * gdi->height * gdi->bytesPerPixel);
+	freerdp_replay_print_stats(replay);
+	status = 0;
+
+out:
+	freerdp_replay_free(replay);
+	return status;
+}
+
+/**
+ * The recording followed by a record longer than any PDU, which must stop
+ * the replay before anything is allocated for it.
+ */
+
+static int test_replay_invalid_length(void)
+{
+	int status = -1;
+	FILE* in = NULL;
+	FILE* out = NULL;
+	char* path;
+	char* filename;
+	size_t length;
+	BYTE buffer[4096];
+	rdpReplay* replay = NULL;
+	BYTE record[12] = { 0, 0, 0, 0, 0, 0, 0, 0, 0xF0, 0xFF, 0xFF, 0x7F };
+
+	path = GetKnownPath(KNOWN_PATH_TEMP);
+	filename = GetCombinedPath(path, "TestCoreReplay.rec");
+	free(path);
+
+	if (!filename)
+		return -1;
+
+	in = fopen(TEST_RECORDING, "rb");
+	out = fopen(filename, "wb");
+
+	if (!in || !out)
+		goto out;
+
+	while ((length = fread(buffer, 1, sizeof(buffer), in)) > 0)
+	{
+		if (fwrite(buffer, 1, length, out) != length)
+			goto out;
+	}
+
+	if (fwrite(record, sizeof(record), 1, out) != 1)
+		goto out;
+
+	fclose(out);
+	out = NULL;
+
+	replay = freerdp_replay_new(filename);
+
+	if (!replay)
+		goto out;
+
+	if (freerdp_replay_run(replay, FALSE) >= 0)
+	{
+		printf("a record of 0x7FFFFFF0 bytes was replayed\n");
+		goto out;
+	}
+
+	status = 0;
+
+out:
+	freerdp_replay_free(replay);
+
+	if (in)
+		fclose(in);
+
+	if (out)
+		fclose(out);
+
+	DeleteFileA(filename);
+	free(filename);
+	return status;
+}
+
+int TestCoreReplay(int argc, char* argv[])
+{
+	UINT32 first;
+	UINT32 second;
+
+	if ((test_replay(&first) < 0) || (test_replay(&second) < 0))
+		return -1;
+
+	if (test_replay_invalid_length() < 0)
+		return -1;
+
+	if ((first != second) || (first != TEST_FRAMEBUFFER_HASH))
+	{
+		printf("frame buffer hash mismatch: 0x%08X 0x%08X, expected 0x%08X\n",
+				first, second, TEST_FRAMEBUFFER_HASH);
+		return -1;
+	}
+
+	return 0;
+}
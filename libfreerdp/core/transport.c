@@ -32,6 +32,7 @@
 #include <freerdp/log.h>
 #include <freerdp/error.h>
 #include <freerdp/utils/ringbuffer.h>
+#include <freerdp/utils/profiler.h>
 
 #include <openssl/bio.h>
 #include <time.h>
@@ -961,13 +962,22 @@ int transport_check_fds(rdpTransport* transport)
 		 * Note that transport->ReceiveBuffer is replaced after each iteration
 		 * of this loop with a fresh stream instance from a pool.
 		 */
-		if ((status = transport_read_pdu(transport, transport->ReceiveBuffer)) <= 0)
+		PROFILER_BEGIN("transport_read_pdu");
+		status = transport_read_pdu(transport, transport->ReceiveBuffer);
+		PROFILER_END("transport_read_pdu");
+
+		if (status <= 0)
 		{
 			return status;
 		}
 
 		received = transport->ReceiveBuffer;
+		PROFILER_COUNTER("transport_pdu_length", Stream_Length(received));
 		transport->ReceiveBuffer = StreamPool_Take(transport->ReceivePool, 0);
+
+		if (transport->recorder)
+			recorder_write_pdu(transport->recorder, received);
+
 		/**
 		 * status:
 		 * 	-1: error
@@ -1158,6 +1168,7 @@ void transport_free(rdpTransport* transport)
 	if (transport->ReceiveBuffer)
 		Stream_Release(transport->ReceiveBuffer);
 
+	recorder_free(transport->recorder);
 	StreamPool_Free(transport->ReceivePool);
 	CloseHandle(transport->ReceiveEvent);
 	CloseHandle(transport->connectedEvent);
@@ -33,6 +33,7 @@ typedef struct rdp_transport rdpTransport;
 
 #include "tcp.h"
 #include "nla.h"
+#include "recorder.h"
 
 #include "gateway/tsg.h"
 
@@ -83,6 +84,7 @@ struct rdp_transport
 	CRITICAL_SECTION ReadLock;
 	CRITICAL_SECTION WriteLock;
 	void* rdp;
+	rdpRecorder* recorder;
 };
 
 wStream* transport_send_stream_init(rdpTransport* transport, int size);
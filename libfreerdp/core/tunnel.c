@@ -0,0 +1,504 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Multitransport Tunnel (MS-RDPEMT)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <winpr/crt.h>
+#include <winpr/sysinfo.h>
+
+#include <freerdp/log.h>
+
+#include "tunnel.h"
+
+#define TAG FREERDP_TAG("core.tunnel")
+
+/**
+ * A tunnel is a DTLS session over an RDP-UDP connection, carrying the
+ * RDP_TUNNEL_HEADER framed PDUs of MS-RDPEMT: the client authenticates the
+ * tunnel with the request id and security cookie of the Initiate
+ * Multitransport Request, then both sides exchange data PDUs.
+ *
+ * On a reliable connection the PDUs form a stream and may span DTLS
+ * records; on a lossy connection each PDU is a single record.
+ */
+
+static void tunnel_set_state(rdpTunnel* tunnel, int state)
+{
+	tunnel->state = state;
+	SetEvent(tunnel->stateEvent);
+}
+
+static int tunnel_dtls_send(rdpDtls* dtls, const BYTE* data, int length, void* param)
+{
+	rdpTunnel* tunnel = (rdpTunnel*) param;
+
+	return rdpudp_write(tunnel->udp, data, length);
+}
+
+static int tunnel_send_pdu(rdpTunnel* tunnel, BYTE action, const BYTE* payload, int length)
+{
+	int chunk;
+	int offset;
+	int maxPayload;
+	int status = 0;
+	wStream* s;
+
+	if ((length > 0xFFFF) || (tunnel->lossy && (length > tunnel_get_max_payload(tunnel))))
+		return -1;
+
+	s = Stream_New(NULL, RDPTUNNEL_HEADER_LENGTH + length);
+
+	if (!s)
+		return -1;
+
+	Stream_Write_UINT8(s, action & 0x0F); /* Action (4 bits), Flags (4 bits) */
+	Stream_Write_UINT16(s, length); /* PayloadLength (2 bytes) */
+	Stream_Write_UINT8(s, RDPTUNNEL_HEADER_LENGTH); /* HeaderLength (1 byte) */
+	Stream_Write(s, payload, length);
+	Stream_SealLength(s);
+
+	maxPayload = dtls_get_max_payload(tunnel->dtls);
+
+	for (offset = 0; offset < (int) Stream_Length(s); offset += chunk)
+	{
+		chunk = MIN((int) Stream_Length(s) - offset, maxPayload);
+
+		if (dtls_write(tunnel->dtls, &(Stream_Buffer(s)[offset]), chunk) < 0)
+		{
+			status = -1;
+			break;
+		}
+	}
+
+	Stream_Free(s, TRUE);
+
+	return (status < 0) ? -1 : length;
+}
+
+static void tunnel_send_create_request(rdpTunnel* tunnel)
+{
+	BYTE buffer[RDPTUNNEL_CREATEREQUEST_LENGTH];
+	wStream* s;
+
+	s = Stream_New(buffer, sizeof(buffer));
+
+	if (!s)
+		return;
+
+	Stream_Write_UINT32(s, tunnel->requestId); /* RequestID (4 bytes) */
+	Stream_Write_UINT32(s, 0); /* Reserved (4 bytes) */
+	Stream_Write(s, tunnel->securityCookie, 16); /* SecurityCookie (16 bytes) */
+
+	tunnel_send_pdu(tunnel, RDPTUNNEL_ACTION_CREATEREQUEST, buffer, sizeof(buffer));
+
+	Stream_Free(s, FALSE);
+}
+
+static void tunnel_send_create_response(rdpTunnel* tunnel, UINT32 hrResponse)
+{
+	BYTE buffer[RDPTUNNEL_CREATERESPONSE_LENGTH];
+	wStream* s;
+
+	s = Stream_New(buffer, sizeof(buffer));
+
+	if (!s)
+		return;
+
+	Stream_Write_UINT32(s, hrResponse); /* HrResponse (4 bytes) */
+
+	tunnel_send_pdu(tunnel, RDPTUNNEL_ACTION_CREATERESPONSE, buffer, sizeof(buffer));
+
+	Stream_Free(s, FALSE);
+}
+
+/**
+ * The DTLS handshake is complete: the client checks that the tunnel ends at
+ * the server of the main connection, then asks for the tunnel.
+ */
+
+static void tunnel_secured(rdpTunnel* tunnel)
+{
+	rdpDtls* dtls = tunnel->dtls;
+
+	if (tunnel->server)
+	{
+		tunnel_set_state(tunnel, TUNNEL_STATE_CREATING);
+		return;
+	}
+
+	if (tunnel->PublicKey && ((dtls->PublicKeyLength != tunnel->PublicKeyLength) ||
+			(memcmp(dtls->PublicKey, tunnel->PublicKey, tunnel->PublicKeyLength) != 0)))
+	{
+		WLog_ERR(TAG, "the tunnel certificate is not the certificate of the main connection");
+		tunnel_set_state(tunnel, TUNNEL_STATE_FAILED);
+		return;
+	}
+
+	tunnel_send_create_request(tunnel);
+	tunnel_set_state(tunnel, TUNNEL_STATE_CREATING);
+}
+
+static void tunnel_process_pdu(rdpTunnel* tunnel, BYTE action, const BYTE* payload, int length)
+{
+	UINT32 requestId;
+	UINT32 hrResponse;
+	wStream* s;
+
+	switch (action)
+	{
+		case RDPTUNNEL_ACTION_CREATEREQUEST:
+			if (!tunnel->server || (tunnel->state != TUNNEL_STATE_CREATING) ||
+					(length < RDPTUNNEL_CREATEREQUEST_LENGTH))
+				break;
+
+			s = Stream_New((BYTE*) payload, length);
+
+			if (!s)
+				break;
+
+			Stream_Read_UINT32(s, requestId); /* RequestID (4 bytes) */
+			Stream_Seek(s, 4); /* Reserved (4 bytes) */
+			Stream_Read(s, tunnel->securityCookie, 16); /* SecurityCookie (16 bytes) */
+			Stream_Free(s, FALSE);
+
+			tunnel->requestId = requestId;
+			hrResponse = tunnel->Create ? tunnel->Create(tunnel, requestId, tunnel->securityCookie, tunnel->param) : E_ABORT;
+
+			tunnel_send_create_response(tunnel, hrResponse);
+			tunnel_set_state(tunnel, (hrResponse == S_OK) ? TUNNEL_STATE_CONNECTED : TUNNEL_STATE_FAILED);
+			break;
+
+		case RDPTUNNEL_ACTION_CREATERESPONSE:
+			if (tunnel->server || (tunnel->state != TUNNEL_STATE_CREATING) ||
+					(length < RDPTUNNEL_CREATERESPONSE_LENGTH))
+				break;
+
+			s = Stream_New((BYTE*) payload, length);
+
+			if (!s)
+				break;
+
+			Stream_Read_UINT32(s, hrResponse); /* HrResponse (4 bytes) */
+			Stream_Free(s, FALSE);
+
+			if (hrResponse != S_OK)
+				WLog_ERR(TAG, "tunnel %u refused: 0x%08X", tunnel->requestId, hrResponse);
+
+			tunnel_set_state(tunnel, (hrResponse == S_OK) ? TUNNEL_STATE_CONNECTED : TUNNEL_STATE_FAILED);
+			break;
+
+		case RDPTUNNEL_ACTION_DATA:
+			if ((tunnel->state == TUNNEL_STATE_CONNECTED) && tunnel->Receive)
+				tunnel->Receive(tunnel, payload, length, tunnel->param);
+			break;
+
+		default:
+			WLog_DBG(TAG, "unknown tunnel action %d", action);
+			break;
+	}
+}
+
+static void tunnel_process_record(rdpTunnel* tunnel, const BYTE* data, int length)
+{
+	int size;
+	int remaining;
+	BYTE headerLength;
+	UINT16 payloadLength;
+	BYTE* buffer;
+
+	if (tunnel->lossy)
+	{
+		if (length < RDPTUNNEL_HEADER_LENGTH)
+			return;
+
+		payloadLength = data[1] | (data[2] << 8);
+		headerLength = data[3];
+
+		if ((headerLength < RDPTUNNEL_HEADER_LENGTH) || (headerLength + payloadLength > length))
+			return;
+
+		tunnel_process_pdu(tunnel, data[0] & 0x0F, &data[headerLength], payloadLength);
+		return;
+	}
+
+	Stream_EnsureRemainingCapacity(tunnel->receiveBuffer, length);
+	Stream_Write(tunnel->receiveBuffer, data, length);
+
+	buffer = Stream_Buffer(tunnel->receiveBuffer);
+	remaining = (int) Stream_GetPosition(tunnel->receiveBuffer);
+
+	while (remaining >= RDPTUNNEL_HEADER_LENGTH)
+	{
+		payloadLength = buffer[1] | (buffer[2] << 8);
+		headerLength = buffer[3];
+
+		if (headerLength < RDPTUNNEL_HEADER_LENGTH)
+		{
+			WLog_ERR(TAG, "invalid tunnel header length %d", headerLength);
+			tunnel_set_state(tunnel, TUNNEL_STATE_FAILED);
+			remaining = 0;
+			break;
+		}
+
+		size = headerLength + payloadLength;
+
+		if (remaining < size)
+			break;
+
+		tunnel_process_pdu(tunnel, buffer[0] & 0x0F, &buffer[headerLength], payloadLength);
+
+		remaining -= size;
+		MoveMemory(buffer, &buffer[size], remaining);
+	}
+
+	Stream_SetPosition(tunnel->receiveBuffer, remaining);
+}
+
+static void tunnel_udp_receive(rdpUdp* udp, const BYTE* data, int length, void* param)
+{
+	int status;
+	BOOL connected;
+	BYTE buffer[0x4000];
+	rdpTunnel* tunnel = (rdpTunnel*) param;
+
+	EnterCriticalSection(&tunnel->lock);
+
+	if (!tunnel->dtls || (tunnel->state == TUNNEL_STATE_FAILED))
+	{
+		LeaveCriticalSection(&tunnel->lock);
+		return;
+	}
+
+	connected = tunnel->dtls->connected;
+
+	if (dtls_receive(tunnel->dtls, data, length) < 0)
+	{
+		tunnel_set_state(tunnel, TUNNEL_STATE_FAILED);
+		LeaveCriticalSection(&tunnel->lock);
+		return;
+	}
+
+	if (!connected && tunnel->dtls->connected)
+		tunnel_secured(tunnel);
+
+	while ((status = dtls_read(tunnel->dtls, buffer, sizeof(buffer))) > 0)
+		tunnel_process_record(tunnel, buffer, status);
+
+	if (status < 0)
+		tunnel_set_state(tunnel, TUNNEL_STATE_FAILED);
+
+	LeaveCriticalSection(&tunnel->lock);
+}
+
+static void tunnel_udp_state_change(rdpUdp* udp, int state, void* param)
+{
+	rdpTunnel* tunnel = (rdpTunnel*) param;
+
+	if ((state == RDPUDP_STATE_FAILED) || (state == RDPUDP_STATE_CLOSED))
+	{
+		EnterCriticalSection(&tunnel->lock);
+		tunnel_set_state(tunnel, TUNNEL_STATE_FAILED);
+		LeaveCriticalSection(&tunnel->lock);
+	}
+}
+
+/**
+ * Connects the client end of a tunnel: the RDP-UDP connection, the DTLS
+ * handshake, which is expected to present the public key of the main
+ * connection when it is given, then the tunnel creation.
+ */
+
+BOOL tunnel_connect(rdpTunnel* tunnel, const char* hostname, UINT16 port, UINT32 requestId,
+		const BYTE* securityCookie, const BYTE* PublicKey, DWORD PublicKeyLength, DWORD timeout)
+{
+	int state;
+	DWORD wait;
+	UINT32 elapsed;
+	UINT32 start = GetTickCount();
+
+	tunnel->requestId = requestId;
+	CopyMemory(tunnel->securityCookie, securityCookie, 16);
+
+	if (PublicKey && PublicKeyLength)
+	{
+		tunnel->PublicKey = (BYTE*) malloc(PublicKeyLength);
+
+		if (!tunnel->PublicKey)
+			return FALSE;
+
+		CopyMemory(tunnel->PublicKey, PublicKey, PublicKeyLength);
+		tunnel->PublicKeyLength = PublicKeyLength;
+	}
+
+	tunnel->udp = rdpudp_new(tunnel->lossy, tunnel_udp_receive, tunnel_udp_state_change, tunnel);
+	tunnel->dtls = dtls_new(FALSE, RDPUDP_MAX_PAYLOAD, tunnel_dtls_send, tunnel);
+
+	if (!tunnel->udp || !tunnel->dtls)
+		return FALSE;
+
+	if (!rdpudp_connect(tunnel->udp, hostname, port, timeout))
+		return FALSE;
+
+	EnterCriticalSection(&tunnel->lock);
+	tunnel->state = TUNNEL_STATE_SECURING;
+
+	if (dtls_handshake(tunnel->dtls) < 0)
+		tunnel->state = TUNNEL_STATE_FAILED;
+
+	LeaveCriticalSection(&tunnel->lock);
+
+	while (1)
+	{
+		/* reset before reading the state, tunnel_set_state() signals after changing it */
+		ResetEvent(tunnel->stateEvent);
+
+		EnterCriticalSection(&tunnel->lock);
+		state = tunnel->state;
+		wait = (state == TUNNEL_STATE_SECURING) ? dtls_get_timeout(tunnel->dtls) : INFINITE;
+		LeaveCriticalSection(&tunnel->lock);
+
+		elapsed = GetTickCount() - start;
+
+		if (((state != TUNNEL_STATE_SECURING) && (state != TUNNEL_STATE_CREATING)) || (elapsed >= timeout))
+			break;
+
+		wait = MIN(wait, timeout - elapsed);
+
+		if (WaitForSingleObject(tunnel->stateEvent, wait) == WAIT_TIMEOUT)
+		{
+			/* the DTLS handshake retransmissions */
+			EnterCriticalSection(&tunnel->lock);
+
+			if ((tunnel->state == TUNNEL_STATE_SECURING) && (dtls_check_timeout(tunnel->dtls) < 0))
+				tunnel_set_state(tunnel, TUNNEL_STATE_FAILED);
+
+			LeaveCriticalSection(&tunnel->lock);
+		}
+	}
+
+	return (state == TUNNEL_STATE_CONNECTED) ? TRUE : FALSE;
+}
+
+/**
+ * Takes a connection accepted by an RDP-UDP listener as the server end of a
+ * tunnel. Called from the accepted callback of the listener.
+ */
+
+BOOL tunnel_accept(rdpTunnel* tunnel, rdpUdp* udp, const char* cert_file, const char* privatekey_file)
+{
+	EnterCriticalSection(&tunnel->lock);
+
+	tunnel->udp = udp;
+	tunnel->lossy = udp->lossy;
+	tunnel->dtls = dtls_new(TRUE, RDPUDP_MAX_PAYLOAD, tunnel_dtls_send, tunnel);
+
+	if (!tunnel->dtls || !dtls_set_certificate(tunnel->dtls, cert_file, privatekey_file))
+	{
+		tunnel->state = TUNNEL_STATE_FAILED;
+		LeaveCriticalSection(&tunnel->lock);
+		return FALSE;
+	}
+
+	tunnel->state = TUNNEL_STATE_SECURING;
+
+	udp->Receive = tunnel_udp_receive;
+	udp->StateChange = tunnel_udp_state_change;
+	udp->param = (void*) tunnel;
+
+	LeaveCriticalSection(&tunnel->lock);
+
+	return TRUE;
+}
+
+/**
+ * Sends a data PDU, of at most tunnel_get_max_payload() bytes.
+ */
+
+int tunnel_write(rdpTunnel* tunnel, const BYTE* data, int length)
+{
+	int status = -1;
+
+	EnterCriticalSection(&tunnel->lock);
+
+	if (tunnel->state == TUNNEL_STATE_CONNECTED)
+		status = tunnel_send_pdu(tunnel, RDPTUNNEL_ACTION_DATA, data, length);
+
+	LeaveCriticalSection(&tunnel->lock);
+
+	return status;
+}
+
+int tunnel_get_max_payload(rdpTunnel* tunnel)
+{
+	if (!tunnel->lossy)
+		return 0xFFFF;
+
+	return (RDPUDP_MAX_PAYLOAD - DTLS_RECORD_OVERHEAD) - RDPTUNNEL_HEADER_LENGTH;
+}
+
+rdpTunnel* tunnel_new(BOOL server, BOOL lossy, pTunnelReceive receive, pTunnelCreate create, void* param)
+{
+	rdpTunnel* tunnel;
+
+	tunnel = (rdpTunnel*) calloc(1, sizeof(rdpTunnel));
+
+	if (!tunnel)
+		return NULL;
+
+	tunnel->server = server;
+	tunnel->lossy = lossy;
+	tunnel->Receive = receive;
+	tunnel->Create = create;
+	tunnel->param = param;
+
+	InitializeCriticalSectionAndSpinCount(&tunnel->lock, 4000);
+
+	tunnel->stateEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+	tunnel->receiveBuffer = Stream_New(NULL, 0x4000);
+
+	if (!tunnel->stateEvent || !tunnel->receiveBuffer)
+	{
+		tunnel_free(tunnel);
+		return NULL;
+	}
+
+	return tunnel;
+}
+
+void tunnel_free(rdpTunnel* tunnel)
+{
+	if (!tunnel)
+		return;
+
+	/* stops the connection thread, which runs the callbacks */
+	rdpudp_free(tunnel->udp);
+
+	dtls_free(tunnel->dtls);
+
+	if (tunnel->receiveBuffer)
+		Stream_Free(tunnel->receiveBuffer, TRUE);
+
+	if (tunnel->stateEvent)
+		CloseHandle(tunnel->stateEvent);
+
+	DeleteCriticalSection(&tunnel->lock);
+
+	free(tunnel->PublicKey);
+	free(tunnel);
+}
@@ -0,0 +1,85 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Multitransport Tunnel (MS-RDPEMT)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __TUNNEL_H
+#define __TUNNEL_H
+
+typedef struct rdp_tunnel rdpTunnel;
+
+#include "rdpudp.h"
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+#include <winpr/stream.h>
+
+#include <freerdp/types.h>
+#include <freerdp/crypto/dtls.h>
+
+/* RDP_TUNNEL_HEADER Action */
+#define RDPTUNNEL_ACTION_CREATEREQUEST		0x0
+#define RDPTUNNEL_ACTION_CREATERESPONSE		0x1
+#define RDPTUNNEL_ACTION_DATA			0x2
+
+#define RDPTUNNEL_HEADER_LENGTH			4
+#define RDPTUNNEL_CREATEREQUEST_LENGTH		24
+#define RDPTUNNEL_CREATERESPONSE_LENGTH		4
+
+enum TUNNEL_STATE
+{
+	TUNNEL_STATE_NONE = 0,
+	TUNNEL_STATE_SECURING,
+	TUNNEL_STATE_CREATING,
+	TUNNEL_STATE_CONNECTED,
+	TUNNEL_STATE_FAILED
+};
+
+typedef void (*pTunnelReceive)(rdpTunnel* tunnel, const BYTE* data, int length, void* param);
+typedef UINT32 (*pTunnelCreate)(rdpTunnel* tunnel, UINT32 requestId, const BYTE* securityCookie, void* param);
+
+struct rdp_tunnel
+{
+	BOOL server;
+	BOOL lossy;
+	int state;
+
+	UINT32 requestId;
+	BYTE securityCookie[16];
+	BYTE* PublicKey;
+	DWORD PublicKeyLength;
+
+	rdpUdp* udp;
+	rdpDtls* dtls;
+	wStream* receiveBuffer;
+	HANDLE stateEvent;
+	CRITICAL_SECTION lock;
+
+	pTunnelReceive Receive;
+	pTunnelCreate Create;
+	void* param;
+};
+
+BOOL tunnel_connect(rdpTunnel* tunnel, const char* hostname, UINT16 port, UINT32 requestId,
+		const BYTE* securityCookie, const BYTE* PublicKey, DWORD PublicKeyLength, DWORD timeout);
+BOOL tunnel_accept(rdpTunnel* tunnel, rdpUdp* udp, const char* cert_file, const char* privatekey_file);
+
+int tunnel_write(rdpTunnel* tunnel, const BYTE* data, int length);
+int tunnel_get_max_payload(rdpTunnel* tunnel);
+
+rdpTunnel* tunnel_new(BOOL server, BOOL lossy, pTunnelReceive receive, pTunnelCreate create, void* param);
+void tunnel_free(rdpTunnel* tunnel);
+
+#endif /* __TUNNEL_H */
@@ -34,6 +34,7 @@
 #include <freerdp/log.h>
 #include <freerdp/peer.h>
 #include <freerdp/codec/bitmap.h>
+#include <freerdp/utils/profiler.h>
 
 #define TAG FREERDP_TAG("core.update")
 
@@ -475,7 +476,7 @@ BOOL update_recv_pointer(rdpUpdate* update, wStream* s)
 	return TRUE;
 }
 
-BOOL update_recv(rdpUpdate* update, wStream* s)
+static BOOL update_recv_data(rdpUpdate* update, wStream* s)
 {
 	UINT16 updateType;
 	rdpContext* context = update->context;
@@ -516,11 +517,26 @@ BOOL update_recv(rdpUpdate* update, wStream* s)
 			break;
 	}
 
+	PROFILER_BEGIN("update_present");
 	IFCALL(update->EndPaint, context);
+	PROFILER_END("update_present");
 
 	return TRUE;
 }
 
+BOOL update_recv(rdpUpdate* update, wStream* s)
+{
+	BOOL status;
+
+	/* lets the update proxy reference the payloads instead of copying them */
+
+	update->recvStream = s;
+	status = update_recv_data(update, s);
+	update->recvStream = NULL;
+
+	return status;
+}
+
 void update_reset_state(rdpUpdate* update)
 {
 	rdpPrimaryUpdate* primary = update->primary;
@@ -1168,6 +1184,441 @@ static void update_send_glyph_index(rdpContext* context, GLYPH_INDEX_ORDER* glyp
 	update->numberOrders++;
 }
 
+static void update_send_draw_nine_grid(rdpContext* context, DRAW_NINE_GRID_ORDER* draw_nine_grid)
+{
+	wStream* s;
+	int offset;
+	int headerLength;
+	ORDER_INFO orderInfo;
+	rdpUpdate* update = context->update;
+
+	headerLength = update_prepare_order_info(context, &orderInfo, ORDER_TYPE_DRAW_NINE_GRID);
+
+	update_check_flush(context, headerLength + update_approximate_draw_nine_grid_order(&orderInfo, draw_nine_grid));
+
+	s = update->us;
+	offset = Stream_GetPosition(s);
+
+	Stream_EnsureRemainingCapacity(s, headerLength);
+	Stream_Seek(s, headerLength);
+
+	if (!update_write_draw_nine_grid_order(s, &orderInfo, draw_nine_grid))
+	{
+		Stream_SetPosition(s, offset);
+		return;
+	}
+
+	update_write_order_info(context, s, &orderInfo, offset);
+
+	update->numberOrders++;
+}
+
+static void update_send_multi_dstblt(rdpContext* context, MULTI_DSTBLT_ORDER* multi_dstblt)
+{
+	wStream* s;
+	int offset;
+	int headerLength;
+	ORDER_INFO orderInfo;
+	rdpUpdate* update = context->update;
+
+	headerLength = update_prepare_order_info(context, &orderInfo, ORDER_TYPE_MULTI_DSTBLT);
+
+	update_check_flush(context, headerLength + update_approximate_multi_dstblt_order(&orderInfo, multi_dstblt));
+
+	s = update->us;
+	offset = Stream_GetPosition(s);
+
+	Stream_EnsureRemainingCapacity(s, headerLength);
+	Stream_Seek(s, headerLength);
+
+	if (!update_write_multi_dstblt_order(s, &orderInfo, multi_dstblt))
+	{
+		Stream_SetPosition(s, offset);
+		return;
+	}
+
+	update_write_order_info(context, s, &orderInfo, offset);
+
+	update->numberOrders++;
+}
+
+static void update_send_multi_patblt(rdpContext* context, MULTI_PATBLT_ORDER* multi_patblt)
+{
+	wStream* s;
+	int offset;
+	int headerLength;
+	ORDER_INFO orderInfo;
+	rdpUpdate* update = context->update;
+
+	headerLength = update_prepare_order_info(context, &orderInfo, ORDER_TYPE_MULTI_PATBLT);
+
+	update_check_flush(context, headerLength + update_approximate_multi_patblt_order(&orderInfo, multi_patblt));
+
+	s = update->us;
+	offset = Stream_GetPosition(s);
+
+	Stream_EnsureRemainingCapacity(s, headerLength);
+	Stream_Seek(s, headerLength);
+
+	if (!update_write_multi_patblt_order(s, &orderInfo, multi_patblt))
+	{
+		Stream_SetPosition(s, offset);
+		return;
+	}
+
+	update_write_order_info(context, s, &orderInfo, offset);
+
+	update->numberOrders++;
+}
+
+static void update_send_multi_scrblt(rdpContext* context, MULTI_SCRBLT_ORDER* multi_scrblt)
+{
+	wStream* s;
+	int offset;
+	int headerLength;
+	ORDER_INFO orderInfo;
+	rdpUpdate* update = context->update;
+
+	headerLength = update_prepare_order_info(context, &orderInfo, ORDER_TYPE_MULTI_SCRBLT);
+
+	update_check_flush(context, headerLength + update_approximate_multi_scrblt_order(&orderInfo, multi_scrblt));
+
+	s = update->us;
+	offset = Stream_GetPosition(s);
+
+	Stream_EnsureRemainingCapacity(s, headerLength);
+	Stream_Seek(s, headerLength);
+
+	if (!update_write_multi_scrblt_order(s, &orderInfo, multi_scrblt))
+	{
+		Stream_SetPosition(s, offset);
+		return;
+	}
+
+	update_write_order_info(context, s, &orderInfo, offset);
+
+	update->numberOrders++;
+}
+
+static void update_send_multi_opaque_rect(rdpContext* context, MULTI_OPAQUE_RECT_ORDER* multi_opaque_rect)
+{
+	wStream* s;
+	int offset;
+	int headerLength;
+	ORDER_INFO orderInfo;
+	rdpUpdate* update = context->update;
+
+	headerLength = update_prepare_order_info(context, &orderInfo, ORDER_TYPE_MULTI_OPAQUE_RECT);
+
+	update_check_flush(context, headerLength + update_approximate_multi_opaque_rect_order(&orderInfo, multi_opaque_rect));
+
+	s = update->us;
+	offset = Stream_GetPosition(s);
+
+	Stream_EnsureRemainingCapacity(s, headerLength);
+	Stream_Seek(s, headerLength);
+
+	if (!update_write_multi_opaque_rect_order(s, &orderInfo, multi_opaque_rect))
+	{
+		Stream_SetPosition(s, offset);
+		return;
+	}
+
+	update_write_order_info(context, s, &orderInfo, offset);
+
+	update->numberOrders++;
+}
+
+static void update_send_multi_draw_nine_grid(rdpContext* context, MULTI_DRAW_NINE_GRID_ORDER* multi_draw_nine_grid)
+{
+	wStream* s;
+	int offset;
+	int headerLength;
+	ORDER_INFO orderInfo;
+	rdpUpdate* update = context->update;
+
+	headerLength = update_prepare_order_info(context, &orderInfo, ORDER_TYPE_MULTI_DRAW_NINE_GRID);
+
+	update_check_flush(context, headerLength + update_approximate_multi_draw_nine_grid_order(&orderInfo, multi_draw_nine_grid));
+
+	s = update->us;
+	offset = Stream_GetPosition(s);
+
+	Stream_EnsureRemainingCapacity(s, headerLength);
+	Stream_Seek(s, headerLength);
+
+	if (!update_write_multi_draw_nine_grid_order(s, &orderInfo, multi_draw_nine_grid))
+	{
+		Stream_SetPosition(s, offset);
+		return;
+	}
+
+	update_write_order_info(context, s, &orderInfo, offset);
+
+	update->numberOrders++;
+}
+
+static void update_send_polyline(rdpContext* context, POLYLINE_ORDER* polyline)
+{
+	wStream* s;
+	int offset;
+	int headerLength;
+	ORDER_INFO orderInfo;
+	rdpUpdate* update = context->update;
+
+	headerLength = update_prepare_order_info(context, &orderInfo, ORDER_TYPE_POLYLINE);
+
+	update_check_flush(context, headerLength + update_approximate_polyline_order(&orderInfo, polyline));
+
+	s = update->us;
+	offset = Stream_GetPosition(s);
+
+	Stream_EnsureRemainingCapacity(s, headerLength);
+	Stream_Seek(s, headerLength);
+
+	if (!update_write_polyline_order(s, &orderInfo, polyline))
+	{
+		Stream_SetPosition(s, offset);
+		return;
+	}
+
+	update_write_order_info(context, s, &orderInfo, offset);
+
+	update->numberOrders++;
+}
+
+static void update_send_mem3blt(rdpContext* context, MEM3BLT_ORDER* mem3blt)
+{
+	wStream* s;
+	int offset;
+	int headerLength;
+	ORDER_INFO orderInfo;
+	rdpUpdate* update = context->update;
+
+	headerLength = update_prepare_order_info(context, &orderInfo, ORDER_TYPE_MEM3BLT);
+
+	update_check_flush(context, headerLength + update_approximate_mem3blt_order(&orderInfo, mem3blt));
+
+	s = update->us;
+	offset = Stream_GetPosition(s);
+
+	Stream_EnsureRemainingCapacity(s, headerLength);
+	Stream_Seek(s, headerLength);
+
+	if (!update_write_mem3blt_order(s, &orderInfo, mem3blt))
+	{
+		Stream_SetPosition(s, offset);
+		return;
+	}
+
+	update_write_order_info(context, s, &orderInfo, offset);
+
+	update->numberOrders++;
+}
+
+static void update_send_save_bitmap(rdpContext* context, SAVE_BITMAP_ORDER* save_bitmap)
+{
+	wStream* s;
+	int offset;
+	int headerLength;
+	ORDER_INFO orderInfo;
+	rdpUpdate* update = context->update;
+
+	headerLength = update_prepare_order_info(context, &orderInfo, ORDER_TYPE_SAVE_BITMAP);
+
+	update_check_flush(context, headerLength + update_approximate_save_bitmap_order(&orderInfo, save_bitmap));
+
+	s = update->us;
+	offset = Stream_GetPosition(s);
+
+	Stream_EnsureRemainingCapacity(s, headerLength);
+	Stream_Seek(s, headerLength);
+
+	if (!update_write_save_bitmap_order(s, &orderInfo, save_bitmap))
+	{
+		Stream_SetPosition(s, offset);
+		return;
+	}
+
+	update_write_order_info(context, s, &orderInfo, offset);
+
+	update->numberOrders++;
+}
+
+static void update_send_fast_index(rdpContext* context, FAST_INDEX_ORDER* fast_index)
+{
+	wStream* s;
+	int offset;
+	int headerLength;
+	ORDER_INFO orderInfo;
+	rdpUpdate* update = context->update;
+
+	headerLength = update_prepare_order_info(context, &orderInfo, ORDER_TYPE_FAST_INDEX);
+
+	update_check_flush(context, headerLength + update_approximate_fast_index_order(&orderInfo, fast_index));
+
+	s = update->us;
+	offset = Stream_GetPosition(s);
+
+	Stream_EnsureRemainingCapacity(s, headerLength);
+	Stream_Seek(s, headerLength);
+
+	if (!update_write_fast_index_order(s, &orderInfo, fast_index))
+	{
+		Stream_SetPosition(s, offset);
+		return;
+	}
+
+	update_write_order_info(context, s, &orderInfo, offset);
+
+	update->numberOrders++;
+}
+
+static void update_send_fast_glyph(rdpContext* context, FAST_GLYPH_ORDER* fast_glyph)
+{
+	wStream* s;
+	int offset;
+	int headerLength;
+	ORDER_INFO orderInfo;
+	rdpUpdate* update = context->update;
+
+	headerLength = update_prepare_order_info(context, &orderInfo, ORDER_TYPE_FAST_GLYPH);
+
+	update_check_flush(context, headerLength + update_approximate_fast_glyph_order(&orderInfo, fast_glyph));
+
+	s = update->us;
+	offset = Stream_GetPosition(s);
+
+	Stream_EnsureRemainingCapacity(s, headerLength);
+	Stream_Seek(s, headerLength);
+
+	if (!update_write_fast_glyph_order(s, &orderInfo, fast_glyph))
+	{
+		Stream_SetPosition(s, offset);
+		return;
+	}
+
+	update_write_order_info(context, s, &orderInfo, offset);
+
+	update->numberOrders++;
+}
+
+static void update_send_polygon_sc(rdpContext* context, POLYGON_SC_ORDER* polygon_sc)
+{
+	wStream* s;
+	int offset;
+	int headerLength;
+	ORDER_INFO orderInfo;
+	rdpUpdate* update = context->update;
+
+	headerLength = update_prepare_order_info(context, &orderInfo, ORDER_TYPE_POLYGON_SC);
+
+	update_check_flush(context, headerLength + update_approximate_polygon_sc_order(&orderInfo, polygon_sc));
+
+	s = update->us;
+	offset = Stream_GetPosition(s);
+
+	Stream_EnsureRemainingCapacity(s, headerLength);
+	Stream_Seek(s, headerLength);
+
+	if (!update_write_polygon_sc_order(s, &orderInfo, polygon_sc))
+	{
+		Stream_SetPosition(s, offset);
+		return;
+	}
+
+	update_write_order_info(context, s, &orderInfo, offset);
+
+	update->numberOrders++;
+}
+
+static void update_send_polygon_cb(rdpContext* context, POLYGON_CB_ORDER* polygon_cb)
+{
+	wStream* s;
+	int offset;
+	int headerLength;
+	ORDER_INFO orderInfo;
+	rdpUpdate* update = context->update;
+
+	headerLength = update_prepare_order_info(context, &orderInfo, ORDER_TYPE_POLYGON_CB);
+
+	update_check_flush(context, headerLength + update_approximate_polygon_cb_order(&orderInfo, polygon_cb));
+
+	s = update->us;
+	offset = Stream_GetPosition(s);
+
+	Stream_EnsureRemainingCapacity(s, headerLength);
+	Stream_Seek(s, headerLength);
+
+	if (!update_write_polygon_cb_order(s, &orderInfo, polygon_cb))
+	{
+		Stream_SetPosition(s, offset);
+		return;
+	}
+
+	update_write_order_info(context, s, &orderInfo, offset);
+
+	update->numberOrders++;
+}
+
+static void update_send_ellipse_sc(rdpContext* context, ELLIPSE_SC_ORDER* ellipse_sc)
+{
+	wStream* s;
+	int offset;
+	int headerLength;
+	ORDER_INFO orderInfo;
+	rdpUpdate* update = context->update;
+
+	headerLength = update_prepare_order_info(context, &orderInfo, ORDER_TYPE_ELLIPSE_SC);
+
+	update_check_flush(context, headerLength + update_approximate_ellipse_sc_order(&orderInfo, ellipse_sc));
+
+	s = update->us;
+	offset = Stream_GetPosition(s);
+
+	Stream_EnsureRemainingCapacity(s, headerLength);
+	Stream_Seek(s, headerLength);
+
+	if (!update_write_ellipse_sc_order(s, &orderInfo, ellipse_sc))
+	{
+		Stream_SetPosition(s, offset);
+		return;
+	}
+
+	update_write_order_info(context, s, &orderInfo, offset);
+
+	update->numberOrders++;
+}
+
+static void update_send_ellipse_cb(rdpContext* context, ELLIPSE_CB_ORDER* ellipse_cb)
+{
+	wStream* s;
+	int offset;
+	int headerLength;
+	ORDER_INFO orderInfo;
+	rdpUpdate* update = context->update;
+
+	headerLength = update_prepare_order_info(context, &orderInfo, ORDER_TYPE_ELLIPSE_CB);
+
+	update_check_flush(context, headerLength + update_approximate_ellipse_cb_order(&orderInfo, ellipse_cb));
+
+	s = update->us;
+	offset = Stream_GetPosition(s);
+
+	Stream_EnsureRemainingCapacity(s, headerLength);
+	Stream_Seek(s, headerLength);
+
+	if (!update_write_ellipse_cb_order(s, &orderInfo, ellipse_cb))
+	{
+		Stream_SetPosition(s, offset);
+		return;
+	}
+
+	update_write_order_info(context, s, &orderInfo, offset);
+
+	update->numberOrders++;
+}
+
 /*
  * Secondary Drawing Orders
  */
@@ -1496,6 +1947,37 @@ static void update_send_switch_surface_order(rdpContext* context, SWITCH_SURFACE
 	update->numberOrders++;
 }
 
+static void update_send_frame_marker_order(rdpContext* context, FRAME_MARKER_ORDER* frame_marker)
+{
+	wStream* s;
+	int bm, em;
+	BYTE orderType;
+	BYTE controlFlags;
+	int headerLength;
+	rdpUpdate* update = context->update;
+
+	headerLength = 1;
+	orderType = ORDER_TYPE_FRAME_MARKER;
+	controlFlags = ORDER_SECONDARY | (orderType << 2);
+
+	update_check_flush(context, headerLength + 4);
+
+	s = update->us;
+	bm = Stream_GetPosition(s);
+
+	Stream_EnsureRemainingCapacity(s, headerLength);
+	Stream_Seek(s, headerLength);
+
+	update_write_frame_marker_order(s, frame_marker);
+	em = Stream_GetPosition(s);
+
+	Stream_SetPosition(s, bm);
+	Stream_Write_UINT8(s, controlFlags); /* controlFlags (1 byte) */
+	Stream_SetPosition(s, em);
+
+	update->numberOrders++;
+}
+
 static void update_send_pointer_system(rdpContext* context, POINTER_SYSTEM_UPDATE* pointer_system)
 {
 	wStream* s;
@@ -1670,9 +2152,24 @@ void update_register_server_callbacks(rdpUpdate* update)
 	update->primary->PatBlt = update_send_patblt;
 	update->primary->ScrBlt = update_send_scrblt;
 	update->primary->OpaqueRect = update_send_opaque_rect;
+	update->primary->DrawNineGrid = update_send_draw_nine_grid;
+	update->primary->MultiDstBlt = update_send_multi_dstblt;
+	update->primary->MultiPatBlt = update_send_multi_patblt;
+	update->primary->MultiScrBlt = update_send_multi_scrblt;
+	update->primary->MultiOpaqueRect = update_send_multi_opaque_rect;
+	update->primary->MultiDrawNineGrid = update_send_multi_draw_nine_grid;
 	update->primary->LineTo = update_send_line_to;
+	update->primary->Polyline = update_send_polyline;
 	update->primary->MemBlt = update_send_memblt;
+	update->primary->Mem3Blt = update_send_mem3blt;
+	update->primary->SaveBitmap = update_send_save_bitmap;
 	update->primary->GlyphIndex = update_send_glyph_index;
+	update->primary->FastIndex = update_send_fast_index;
+	update->primary->FastGlyph = update_send_fast_glyph;
+	update->primary->PolygonSC = update_send_polygon_sc;
+	update->primary->PolygonCB = update_send_polygon_cb;
+	update->primary->EllipseSC = update_send_ellipse_sc;
+	update->primary->EllipseCB = update_send_ellipse_cb;
 	update->secondary->CacheBitmap = update_send_cache_bitmap;
 	update->secondary->CacheBitmapV2 = update_send_cache_bitmap_v2;
 	update->secondary->CacheBitmapV3 = update_send_cache_bitmap_v3;
@@ -1682,6 +2179,7 @@ void update_register_server_callbacks(rdpUpdate* update)
 	update->secondary->CacheBrush = update_send_cache_brush;
 	update->altsec->CreateOffscreenBitmap = update_send_create_offscreen_bitmap_order;
 	update->altsec->SwitchSurface = update_send_switch_surface_order;
+	update->altsec->FrameMarker = update_send_frame_marker_order;
 	update->pointer->PointerSystem = update_send_pointer_system;
 	update->pointer->PointerPosition = update_send_pointer_position;
 	update->pointer->PointerColor = update_send_pointer_color;
@@ -1744,7 +2242,7 @@ rdpUpdate* update_new(rdpRdp* rdp)
 
 		update->initialState = TRUE;
 
-		update->queue = MessageQueue_New(&cb);
+		update->queue = MessageQueue_NewEx(&cb, WMQ_FLAG_MPSC, 0);
 	}
 
 	return update;
@@ -0,0 +1,360 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Datagram Transport Layer Security
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <winpr/crt.h>
+
+#include <freerdp/log.h>
+#include <freerdp/crypto/dtls.h>
+
+#ifndef _WIN32
+#include <sys/time.h>
+#endif
+
+#define TAG FREERDP_TAG("crypto.dtls")
+
+/**
+ * DTLS over memory BIOs: the owner of the datagram transport feeds the
+ * received datagrams with dtls_receive(), and gets the datagrams to send
+ * through the send callback. The handshake retransmissions are driven with
+ * dtls_get_timeout() and dtls_check_timeout().
+ */
+
+static void dtls_print_error(const char* func)
+{
+	unsigned long error;
+
+	while ((error = ERR_get_error()) != 0)
+		WLog_ERR(TAG, "%s: %s", func, ERR_error_string(error, NULL));
+}
+
+/**
+ * Sends the records OpenSSL has written, several records per datagram when
+ * they fit in the MTU.
+ */
+
+static int dtls_flush(rdpDtls* dtls)
+{
+	int start;
+	int offset;
+	int status = 0;
+	int pending;
+	int recordLength;
+	BYTE* buffer;
+
+	pending = (int) BIO_ctrl_pending(dtls->bioWrite);
+
+	if (pending <= 0)
+		return 0;
+
+	buffer = (BYTE*) malloc(pending);
+
+	if (!buffer)
+		return -1;
+
+	pending = BIO_read(dtls->bioWrite, buffer, pending);
+
+	for (start = offset = 0; offset + DTLS_RECORD_HEADER_LENGTH <= pending; offset += recordLength)
+	{
+		recordLength = DTLS_RECORD_HEADER_LENGTH + ((buffer[offset + 11] << 8) | buffer[offset + 12]);
+
+		if ((offset > start) && (offset + recordLength - start > dtls->mtu))
+		{
+			if (dtls->Send(dtls, &buffer[start], offset - start, dtls->param) < 0)
+				status = -1;
+
+			start = offset;
+		}
+	}
+
+	if ((pending > start) && (dtls->Send(dtls, &buffer[start], pending - start, dtls->param) < 0))
+		status = -1;
+
+	free(buffer);
+
+	return status;
+}
+
+static BOOL dtls_get_peer_public_key(rdpDtls* dtls)
+{
+	BOOL status;
+	struct crypto_cert_struct cert;
+
+	cert.px509 = SSL_get_peer_certificate(dtls->ssl);
+
+	if (!cert.px509)
+	{
+		WLog_ERR(TAG, "failed to get the server DTLS certificate");
+		return FALSE;
+	}
+
+	status = crypto_cert_get_public_key(&cert, &dtls->PublicKey, &dtls->PublicKeyLength);
+
+	X509_free(cert.px509);
+
+	return status;
+}
+
+BOOL dtls_set_certificate(rdpDtls* dtls, const char* cert_file, const char* privatekey_file)
+{
+	if (SSL_use_certificate_file(dtls->ssl, cert_file, SSL_FILETYPE_PEM) <= 0)
+	{
+		WLog_ERR(TAG, "SSL_use_certificate_file failed");
+		dtls_print_error("SSL_use_certificate_file");
+		return FALSE;
+	}
+
+	if (SSL_use_PrivateKey_file(dtls->ssl, privatekey_file, SSL_FILETYPE_PEM) <= 0)
+	{
+		WLog_ERR(TAG, "SSL_use_PrivateKey_file failed");
+		dtls_print_error("SSL_use_PrivateKey_file");
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/**
+ * Starts or continues the handshake: returns 1 once it is complete, 0 while
+ * it waits for the peer and -1 on failure.
+ */
+
+int dtls_handshake(rdpDtls* dtls)
+{
+	int status;
+	int error;
+
+	if (dtls->connected)
+		return 1;
+
+	status = SSL_do_handshake(dtls->ssl);
+
+	if (dtls_flush(dtls) < 0)
+		return -1;
+
+	if (status == 1)
+	{
+		if (!dtls->server && !dtls_get_peer_public_key(dtls))
+			return -1;
+
+		dtls->connected = TRUE;
+		return 1;
+	}
+
+	error = SSL_get_error(dtls->ssl, status);
+
+	if ((error == SSL_ERROR_WANT_READ) || (error == SSL_ERROR_WANT_WRITE))
+		return 0;
+
+	WLog_ERR(TAG, "DTLS handshake failed");
+	dtls_print_error("SSL_do_handshake");
+
+	return -1;
+}
+
+/**
+ * Feeds a datagram received from the peer, continuing the handshake if it is
+ * not complete. The application data is then available from dtls_read().
+ */
+
+int dtls_receive(rdpDtls* dtls, const BYTE* data, int length)
+{
+	if (BIO_write(dtls->bioRead, data, length) != length)
+		return -1;
+
+	if (!dtls->connected)
+		return (dtls_handshake(dtls) < 0) ? -1 : 0;
+
+	return 0;
+}
+
+/**
+ * Returns the data of the next record received, 0 when there is none left
+ * and -1 when the peer closed the connection or on error.
+ */
+
+int dtls_read(rdpDtls* dtls, BYTE* data, int length)
+{
+	int status;
+	int error;
+
+	if (!dtls->connected)
+		return 0;
+
+	status = SSL_read(dtls->ssl, data, length);
+
+	/* alerts, or retransmissions of the last handshake flight */
+	dtls_flush(dtls);
+
+	if (status > 0)
+		return status;
+
+	error = SSL_get_error(dtls->ssl, status);
+
+	if ((error == SSL_ERROR_WANT_READ) || (error == SSL_ERROR_WANT_WRITE))
+		return 0;
+
+	if (error != SSL_ERROR_ZERO_RETURN)
+		dtls_print_error("SSL_read");
+
+	return -1;
+}
+
+/**
+ * Sends data as a single record, of at most dtls_get_max_payload() bytes.
+ */
+
+int dtls_write(rdpDtls* dtls, const BYTE* data, int length)
+{
+	int status;
+
+	if (!dtls->connected || (length > dtls_get_max_payload(dtls)))
+		return -1;
+
+	status = SSL_write(dtls->ssl, data, length);
+
+	if (status <= 0)
+	{
+		dtls_print_error("SSL_write");
+		return -1;
+	}
+
+	if (dtls_flush(dtls) < 0)
+		return -1;
+
+	return status;
+}
+
+int dtls_get_max_payload(rdpDtls* dtls)
+{
+	return dtls->mtu - DTLS_RECORD_OVERHEAD;
+}
+
+/**
+ * Milliseconds until the next handshake retransmission, or INFINITE.
+ */
+
+DWORD dtls_get_timeout(rdpDtls* dtls)
+{
+	struct timeval timeout;
+
+	if (DTLSv1_get_timeout(dtls->ssl, &timeout) <= 0)
+		return INFINITE;
+
+	return (DWORD) ((timeout.tv_sec * 1000) + (timeout.tv_usec / 1000));
+}
+
+int dtls_check_timeout(rdpDtls* dtls)
+{
+	int status;
+
+	status = DTLSv1_handle_timeout(dtls->ssl);
+
+	if (status < 0)
+	{
+		WLog_ERR(TAG, "DTLS handshake timed out");
+		return -1;
+	}
+
+	if (dtls_flush(dtls) < 0)
+		return -1;
+
+	return status;
+}
+
+rdpDtls* dtls_new(BOOL server, int mtu, pDtlsSend send, void* param)
+{
+	rdpDtls* dtls;
+	const SSL_METHOD* method;
+
+	dtls = (rdpDtls*) calloc(1, sizeof(rdpDtls));
+
+	if (!dtls)
+		return NULL;
+
+	dtls->server = server;
+	dtls->mtu = mtu;
+	dtls->Send = send;
+	dtls->param = param;
+
+#if OPENSSL_VERSION_NUMBER >= 0x10002000L
+	method = server ? DTLS_server_method() : DTLS_client_method();
+#else
+	method = server ? DTLSv1_server_method() : DTLSv1_client_method();
+#endif
+
+	dtls->ctx = SSL_CTX_new(method);
+
+	if (!dtls->ctx)
+	{
+		WLog_ERR(TAG, "SSL_CTX_new failed");
+		free(dtls);
+		return NULL;
+	}
+
+	SSL_CTX_set_options(dtls->ctx, SSL_OP_ALL | SSL_OP_NO_QUERY_MTU);
+	SSL_CTX_set_read_ahead(dtls->ctx, 1);
+
+	dtls->ssl = SSL_new(dtls->ctx);
+	dtls->bioRead = BIO_new(BIO_s_mem());
+	dtls->bioWrite = BIO_new(BIO_s_mem());
+
+	if (!dtls->ssl || !dtls->bioRead || !dtls->bioWrite)
+	{
+		if (dtls->bioRead)
+			BIO_free(dtls->bioRead);
+
+		if (dtls->bioWrite)
+			BIO_free(dtls->bioWrite);
+
+		dtls->bioRead = dtls->bioWrite = NULL;
+		dtls_free(dtls);
+		return NULL;
+	}
+
+	BIO_set_mem_eof_return(dtls->bioRead, -1);
+	BIO_set_mem_eof_return(dtls->bioWrite, -1);
+
+	/* the SSL object owns the BIOs from now on */
+	SSL_set_bio(dtls->ssl, dtls->bioRead, dtls->bioWrite);
+	SSL_set_mtu(dtls->ssl, mtu);
+
+	if (server)
+		SSL_set_accept_state(dtls->ssl);
+	else
+		SSL_set_connect_state(dtls->ssl);
+
+	return dtls;
+}
+
+void dtls_free(rdpDtls* dtls)
+{
+	if (!dtls)
+		return;
+
+	if (dtls->ssl)
+		SSL_free(dtls->ssl);
+
+	if (dtls->ctx)
+		SSL_CTX_free(dtls->ctx);
+
+	free(dtls->PublicKey);
+	free(dtls);
+}
@@ -29,6 +29,7 @@
 #include <freerdp/freerdp.h>
 #include <freerdp/gdi/gdi.h>
 #include <freerdp/codec/color.h>
+#include <freerdp/utils/profiler.h>
 
 #include <freerdp/gdi/32bpp.h>
 #include <freerdp/gdi/16bpp.h>
@@ -189,10 +190,15 @@ HGDI_BITMAP gdi_CreateCompatibleBitmap(HGDI_DC hdc, int nWidth, int nHeight)
 
 int gdi_BitBlt(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc, int rop)
 {
+	int status;
 	p_BitBlt _BitBlt = BitBlt_[IBPP(hdcDest->bitsPerPixel)];
 
-	if (_BitBlt != NULL)
-		return _BitBlt(hdcDest, nXDest, nYDest, nWidth, nHeight, hdcSrc, nXSrc, nYSrc, rop);
-	else
+	if (_BitBlt == NULL)
 		return 0;
+
+	PROFILER_BEGIN("gdi_BitBlt");
+	status = _BitBlt(hdcDest, nXDest, nYDest, nWidth, nHeight, hdcSrc, nXSrc, nYSrc, rop);
+	PROFILER_END("gdi_BitBlt");
+
+	return status;
 }
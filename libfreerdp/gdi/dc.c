@@ -79,9 +79,8 @@ HGDI_DC gdi_CreateDC(UINT32 flags, int bpp)
 	hDC->hwnd->invalid = gdi_CreateRectRgn(0, 0, 0, 0);
 	hDC->hwnd->invalid->null = 1;
 
-	hDC->hwnd->count = 32;
-	hDC->hwnd->cinvalid = (HGDI_RGN) malloc(sizeof(GDI_RGN) * hDC->hwnd->count);
-	hDC->hwnd->ninvalid = 0;
+	hDC->hwnd->maxInvalidRects = 32;
+	region16_init(&hDC->hwnd->invalidRegion);
 
 	return hDC;
 }
@@ -221,8 +220,7 @@ int gdi_DeleteDC(HGDI_DC hdc)
 {
 	if (hdc->hwnd)
 	{
-		if (hdc->hwnd->cinvalid != NULL)
-			free(hdc->hwnd->cinvalid);
+		region16_uninit(&hdc->hwnd->invalidRegion);
 
 		if (hdc->hwnd->invalid != NULL)
 			free(hdc->hwnd->invalid);
@@ -36,6 +36,7 @@
 #include <freerdp/codec/bitmap.h>
 #include <freerdp/codec/rfx.h>
 #include <freerdp/codec/nsc.h>
+#include <freerdp/utils/profiler.h>
 
 #include <freerdp/gdi/dc.h>
 #include <freerdp/gdi/pen.h>
@@ -498,15 +499,19 @@ static void gdi_bitmap_update(rdpContext* context, BITMAP_UPDATE* bitmapUpdate)
 			{
 				freerdp_client_codecs_prepare(codecs, FREERDP_CODEC_INTERLEAVED);
 
+				PROFILER_BEGIN("interleaved_decompress");
 				status = interleaved_decompress(codecs->interleaved, pSrcData, SrcSize, bitsPerPixel,
 						&pDstData, gdi->format, -1, 0, 0, nWidth, nHeight, gdi->palette);
+				PROFILER_END("interleaved_decompress");
 			}
 			else
 			{
 				freerdp_client_codecs_prepare(codecs, FREERDP_CODEC_PLANAR);
 
+				PROFILER_BEGIN("planar_decompress");
 				status = planar_decompress(codecs->planar, pSrcData, SrcSize, &pDstData,
 						gdi->format, -1, 0, 0, nWidth, nHeight, TRUE);
+				PROFILER_END("planar_decompress");
 			}
 
 			if (status < 0)
@@ -1089,9 +1094,8 @@ void gdi_init_primary(rdpGdi* gdi)
 	gdi->primary->hdc->hwnd->invalid = gdi_CreateRectRgn(0, 0, 0, 0);
 	gdi->primary->hdc->hwnd->invalid->null = 1;
 
-	gdi->primary->hdc->hwnd->count = 32;
-	gdi->primary->hdc->hwnd->cinvalid = (HGDI_RGN) malloc(sizeof(GDI_RGN) * gdi->primary->hdc->hwnd->count);
-	gdi->primary->hdc->hwnd->ninvalid = 0;
+	gdi->primary->hdc->hwnd->maxInvalidRects = 32;
+	region16_init(&gdi->primary->hdc->hwnd->invalidRegion);
 }
 
 void gdi_resize(rdpGdi* gdi, int width, int height)
@@ -24,6 +24,7 @@
 #include <winpr/crt.h>
 
 #include <freerdp/log.h>
+#include <freerdp/primitives.h>
 #include <freerdp/gdi/dc.h>
 #include <freerdp/gdi/brush.h>
 #include <freerdp/gdi/shape.h>
@@ -32,8 +33,12 @@
 #include <freerdp/codec/jpeg.h>
 #include <freerdp/codec/rfx.h>
 #include <freerdp/codec/nsc.h>
+#include <freerdp/utils/profiler.h>
 #include <freerdp/gdi/drawing.h>
 #include <freerdp/gdi/clipping.h>
+#include <freerdp/gdi/8bpp.h>
+#include <freerdp/gdi/16bpp.h>
+#include <freerdp/gdi/32bpp.h>
 #include <freerdp/codec/color.h>
 #include <freerdp/codec/bitmap.h>
 #include <freerdp/codec/bitmap.h>
@@ -174,15 +179,19 @@ void gdi_Bitmap_Decompress(rdpContext* context, rdpBitmap* bitmap,
 		{
 			freerdp_client_codecs_prepare(gdi->codecs, FREERDP_CODEC_INTERLEAVED);
 
+			PROFILER_BEGIN("interleaved_decompress");
 			status = interleaved_decompress(gdi->codecs->interleaved, pSrcData, SrcSize, bpp,
 					&pDstData, gdi->format, -1, 0, 0, width, height, gdi->palette);
+			PROFILER_END("interleaved_decompress");
 		}
 		else
 		{
 			freerdp_client_codecs_prepare(gdi->codecs, FREERDP_CODEC_PLANAR);
 
+			PROFILER_BEGIN("planar_decompress");
 			status = planar_decompress(gdi->codecs->planar, pSrcData, SrcSize, &pDstData,
 					gdi->format, -1, 0, 0, width, height, TRUE);
+			PROFILER_END("planar_decompress");
 		}
 
 		if (status < 0)
@@ -216,21 +225,118 @@ void gdi_Bitmap_SetSurface(rdpContext* context, rdpBitmap* bitmap, BOOL primary)
 
 /* Glyph Class */
 
+/**
+ * Glyphs are kept at the depth of the drawing surface, each pixel being either
+ * all ones or all zeros. Drawing one is then DSPDxax (D = (S & P) | (~S & D))
+ * with a solid pattern, which the rop3 primitive handles without expanding the
+ * 1bpp glyph again on every draw.
+ */
+
+static BYTE* gdi_glyph_expand(int width, int height, int bytesPerPixel, BYTE* aj)
+{
+	int x, y;
+	BYTE* mask;
+	BYTE* srcp;
+	BYTE* dstp;
+	BYTE* dstData;
+
+	mask = freerdp_glyph_convert(width, height, aj);
+
+	if (!mask || (bytesPerPixel == 1))
+		return mask;
+
+	dstData = (BYTE*) _aligned_malloc(width * height * bytesPerPixel, 16);
+
+	if (dstData)
+	{
+		srcp = mask;
+		dstp = dstData;
+
+		for (y = 0; y < height; y++)
+		{
+			for (x = 0; x < width; x++)
+			{
+				FillMemory(dstp, bytesPerPixel, *srcp++);
+				dstp += bytesPerPixel;
+			}
+		}
+	}
+
+	_aligned_free(mask);
+
+	return dstData;
+}
+
+/**
+ * Expands a glyph again for a drawing surface of another depth, taking the
+ * first byte of each of its pixels as the mask.
+ */
+
+static BOOL gdi_glyph_set_depth(gdiGlyph* gdi_glyph, int bytesPerPixel, int bitsPerPixel)
+{
+	int x, y;
+	BYTE* srcp;
+	BYTE* dstp;
+	BYTE* dstData;
+	HGDI_BITMAP bitmap;
+	HGDI_BITMAP hSrcBmp = gdi_glyph->bitmap;
+
+	dstData = (BYTE*) _aligned_malloc(hSrcBmp->width * hSrcBmp->height * bytesPerPixel, 16);
+
+	if (!dstData)
+		return FALSE;
+
+	dstp = dstData;
+
+	for (y = 0; y < hSrcBmp->height; y++)
+	{
+		srcp = &hSrcBmp->data[y * hSrcBmp->scanline];
+
+		for (x = 0; x < hSrcBmp->width; x++)
+		{
+			FillMemory(dstp, bytesPerPixel, *srcp);
+			srcp += hSrcBmp->bytesPerPixel;
+			dstp += bytesPerPixel;
+		}
+	}
+
+	bitmap = gdi_CreateBitmap(hSrcBmp->width, hSrcBmp->height, bitsPerPixel, dstData);
+
+	if (!bitmap)
+	{
+		_aligned_free(dstData);
+		return FALSE;
+	}
+
+	bitmap->bytesPerPixel = bytesPerPixel;
+	bitmap->bitsPerPixel = bitsPerPixel;
+	bitmap->scanline = hSrcBmp->width * bytesPerPixel;
+
+	gdi_glyph->hdc->bytesPerPixel = bytesPerPixel;
+	gdi_glyph->hdc->bitsPerPixel = bitsPerPixel;
+	gdi_SelectObject(gdi_glyph->hdc, (HGDIOBJECT) bitmap);
+	gdi_DeleteObject((HGDIOBJECT) hSrcBmp);
+	gdi_glyph->bitmap = bitmap;
+
+	return TRUE;
+}
+
 void gdi_Glyph_New(rdpContext* context, rdpGlyph* glyph)
 {
 	BYTE* data;
 	gdiGlyph* gdi_glyph;
+	rdpGdi* gdi = context->gdi;
 
 	gdi_glyph = (gdiGlyph*) glyph;
 
 	gdi_glyph->hdc = gdi_GetDC();
-	gdi_glyph->hdc->bytesPerPixel = 1;
-	gdi_glyph->hdc->bitsPerPixel = 1;
+	gdi_glyph->hdc->bytesPerPixel = gdi->bytesPerPixel;
+	gdi_glyph->hdc->bitsPerPixel = gdi->dstBpp;
 
-	data = freerdp_glyph_convert(glyph->cx, glyph->cy, glyph->aj);
-	gdi_glyph->bitmap = gdi_CreateBitmap(glyph->cx, glyph->cy, 1, data);
-	gdi_glyph->bitmap->bytesPerPixel = 1;
-	gdi_glyph->bitmap->bitsPerPixel = 1;
+	data = gdi_glyph_expand(glyph->cx, glyph->cy, gdi->bytesPerPixel, glyph->aj);
+	gdi_glyph->bitmap = gdi_CreateBitmap(glyph->cx, glyph->cy, gdi->dstBpp, data);
+	gdi_glyph->bitmap->bytesPerPixel = gdi->bytesPerPixel;
+	gdi_glyph->bitmap->bitsPerPixel = gdi->dstBpp;
 
 	gdi_SelectObject(gdi_glyph->hdc, (HGDIOBJECT) gdi_glyph->bitmap);
 	gdi_glyph->org_bitmap = NULL;
@@ -252,19 +358,116 @@ void gdi_Glyph_Free(rdpContext* context, rdpGlyph* glyph)
 
 void gdi_Glyph_Draw(rdpContext* context, rdpGlyph* glyph, int x, int y)
 {
+	int row;
+	int srcX = 0;
+	int srcY = 0;
+	int width, height;
+	int bytesPerPixel;
+	BYTE* srcp;
+	BYTE* dstp;
+	GDI_RECT* clip;
+	GDI_RGN* bounds;
 	gdiGlyph* gdi_glyph;
+	HGDI_BITMAP hDstBmp;
+	HGDI_BITMAP hSrcBmp;
 	rdpGdi* gdi = context->gdi;
+	primitives_t* prims = primitives_get();
 
 	gdi_glyph = (gdiGlyph*) glyph;
+	hSrcBmp = gdi_glyph->bitmap;
+	hDstBmp = (HGDI_BITMAP) gdi->drawing->hdc->selectedObject;
+
+	if (!hSrcBmp->data)
+		return;
+
+	/* a glyph cached for a surface of another depth is expanded again */
+
+	if (hSrcBmp->bytesPerPixel != hDstBmp->bytesPerPixel)
+	{
+		if (!gdi_glyph_set_depth(gdi_glyph, hDstBmp->bytesPerPixel, hDstBmp->bitsPerPixel))
+			return;
+
+		hSrcBmp = gdi_glyph->bitmap;
+	}
+
+	/* the clipping rectangle is computed once per text run in gdi_Glyph_BeginDraw */
 
-	gdi_BitBlt(gdi->drawing->hdc, x, y, gdi_glyph->bitmap->width,
-			gdi_glyph->bitmap->height, gdi_glyph->hdc, 0, 0, GDI_DSPDxax);
+	clip = &gdi->glyphClip;
+	width = hSrcBmp->width;
+	height = hSrcBmp->height;
+
+	if (x < clip->left)
+	{
+		srcX = clip->left - x;
+		width -= srcX;
+		x = clip->left;
+	}
+
+	if (y < clip->top)
+	{
+		srcY = clip->top - y;
+		height -= srcY;
+		y = clip->top;
+	}
+
+	if (x + width > clip->right + 1)
+		width = clip->right + 1 - x;
+
+	if (y + height > clip->bottom + 1)
+		height = clip->bottom + 1 - y;
+
+	if ((width <= 0) || (height <= 0))
+		return;
+
+	bytesPerPixel = hDstBmp->bytesPerPixel;
+
+	for (row = 0; row < height; row++)
+	{
+		srcp = hSrcBmp->data + ((srcY + row) * hSrcBmp->scanline) + (srcX * bytesPerPixel);
+		dstp = hDstBmp->data + ((y + row) * hDstBmp->scanline) + (x * bytesPerPixel);
+
+		prims->rop3_8u(0xE2, srcp, gdi->glyphColor, dstp, width * bytesPerPixel);
+	}
+
+	/* the area drawn by the whole run is invalidated once in gdi_Glyph_EndDraw */
+
+	bounds = &gdi->glyphBounds;
+
+	if (bounds->null)
+	{
+		gdi_SetRgn(bounds, x, y, width, height);
+		bounds->null = 0;
+	}
+	else
+	{
+		if (x < bounds->x)
+		{
+			bounds->w += bounds->x - x;
+			bounds->x = x;
+		}
+
+		if (y < bounds->y)
+		{
+			bounds->h += bounds->y - y;
+			bounds->y = y;
+		}
+
+		if (x + width > bounds->x + bounds->w)
+			bounds->w = x + width - bounds->x;
+
+		if (y + height > bounds->y + bounds->h)
+			bounds->h = y + height - bounds->y;
+	}
 }
 
 void gdi_Glyph_BeginDraw(rdpContext* context, int x, int y, int width, int height, UINT32 bgcolor, UINT32 fgcolor, BOOL fOpRedundant)
 {
+	int k;
 	GDI_RECT rect;
+	GDI_RECT bmp;
+	HGDI_DC hdc;
 	HGDI_BRUSH brush;
+	HGDI_BITMAP hBmp;
 	rdpGdi* gdi = context->gdi;
 
 	/* TODO: handle fOpRedundant! See xf_Glyph_BeginDraw() */
@@ -279,6 +482,49 @@ void gdi_Glyph_BeginDraw(rdpContext* context, int x, int y, int width, int heigh
 	gdi_DeleteObject((HGDIOBJECT) brush);
 
 	gdi->textColor = gdi_SetTextColor(gdi->drawing->hdc, bgcolor);
+
+	/* prepare the run: text color pattern, clipping rectangle and drawn bounds */
+
+	hdc = gdi->drawing->hdc;
+	hBmp = (HGDI_BITMAP) hdc->selectedObject;
+
+	switch (hdc->bytesPerPixel)
+	{
+		case 4:
+			for (k = 0; k < (int) (sizeof(gdi->glyphColor) / 4); k++)
+				((UINT32*) gdi->glyphColor)[k] = gdi_get_color_32bpp(hdc, bgcolor);
+			break;
+
+		case 2:
+			for (k = 0; k < (int) (sizeof(gdi->glyphColor) / 2); k++)
+				((UINT16*) gdi->glyphColor)[k] = gdi_get_color_16bpp(hdc, bgcolor);
+			break;
+
+		default:
+			FillMemory(gdi->glyphColor, sizeof(gdi->glyphColor), gdi_get_color_8bpp(hdc, bgcolor));
+			break;
+	}
+
+	gdi_CRgnToRect(0, 0, hBmp->width, hBmp->height, &gdi->glyphClip);
+
+	if (!hdc->clip->null)
+	{
+		gdi_RgnToRect(hdc->clip, &bmp);
+
+		if (bmp.left > gdi->glyphClip.left)
+			gdi->glyphClip.left = bmp.left;
+
+		if (bmp.top > gdi->glyphClip.top)
+			gdi->glyphClip.top = bmp.top;
+
+		if (bmp.right < gdi->glyphClip.right)
+			gdi->glyphClip.right = bmp.right;
+
+		if (bmp.bottom < gdi->glyphClip.bottom)
+			gdi->glyphClip.bottom = bmp.bottom;
+	}
+
+	gdi->glyphBounds.null = 1;
 }
 
 void gdi_Glyph_EndDraw(rdpContext* context, int x, int y, int width, int height, UINT32 bgcolor, UINT32 fgcolor)
@@ -287,6 +533,13 @@ void gdi_Glyph_EndDraw(rdpContext* context, int x, int y, int width, int height,
 
 	bgcolor = freerdp_convert_gdi_order_color(bgcolor, gdi->srcBpp, gdi->format, gdi->palette);
 	gdi->textColor = gdi_SetTextColor(gdi->drawing->hdc, bgcolor);
+
+	if (!gdi->glyphBounds.null)
+	{
+		gdi_InvalidateRegion(gdi->drawing->hdc, gdi->glyphBounds.x, gdi->glyphBounds.y,
+				gdi->glyphBounds.w, gdi->glyphBounds.h);
+		gdi->glyphBounds.null = 1;
+	}
 }
 
 /* Graphics Module */
@@ -0,0 +1,209 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * GDI BitBlt ROP3 Engine
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* do not include this file directly! */
+
+/**
+ * Rows are combined in chunks of BITBLT_CHUNK pixels so that glyph masks
+ * and overlapping sources can be staged on the stack. The chunk size is a
+ * multiple of the pattern period at every depth, so each chunk starts at
+ * pattern phase zero.
+ */
+
+#ifndef BITBLT_CHUNK
+#define BITBLT_CHUNK		256
+#endif
+
+static int BITBLT_ROP3(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight,
+		HGDI_DC hdcSrc, int nXSrc, int nYSrc, BYTE rop3)
+{
+	int i, k;
+	int x, y;
+	int row, chunk;
+	int count;
+	int dstStep;
+	int srcStep = 0;
+	int xOffset = 0;
+	int yOffset = 0;
+	BOOL useSrc, usePat;
+	BOOL expand = FALSE;
+	BOOL overlap = FALSE;
+	BOOL reverse = FALSE;
+	BYTE* dstp;
+	BYTE* srcp = NULL;
+	const BYTE* patp = NULL;
+	BYTE* srcMask;
+	PIXEL_TYPE color;
+	PIXEL_TYPE* pixel;
+	HGDI_BITMAP hDstBmp;
+	HGDI_BITMAP hSrcBmp = NULL;
+	HGDI_BITMAP hPatBmp = NULL;
+	PIXEL_TYPE stage[BITBLT_CHUNK];
+	BYTE pattern[8][PRIM_ROP3_PATTERN_SIZE];
+	primitives_t* prims = primitives_get();
+
+	useSrc = (((rop3 >> 2) & 0x33) != (rop3 & 0x33)) ? TRUE : FALSE;
+	usePat = (((rop3 >> 4) & 0x0F) != (rop3 & 0x0F)) ? TRUE : FALSE;
+
+	hDstBmp = (HGDI_BITMAP) hdcDest->selectedObject;
+
+	if ((nXDest < 0) || (nYDest < 0) || (nXDest + nWidth > hDstBmp->width) ||
+			(nYDest + nHeight > hDstBmp->height))
+		return 1;
+
+	dstStep = hDstBmp->width * hdcDest->bytesPerPixel;
+
+	if (useSrc)
+	{
+		if (!hdcSrc)
+			return 1;
+
+		hSrcBmp = (HGDI_BITMAP) hdcSrc->selectedObject;
+
+		if ((nXSrc < 0) || (nXSrc + nWidth > hSrcBmp->width))
+		{
+			WLog_ERR(TAG,  "BitBlt: source out of bounds: (%d,%d) %dx%d in %dx%d",
+				nXSrc, nYSrc, nWidth, nHeight, hSrcBmp->width, hSrcBmp->height);
+			return 1;
+		}
+
+		/* one byte per pixel glyph masks are widened to the destination depth */
+
+		if (hdcSrc->bytesPerPixel != hdcDest->bytesPerPixel)
+		{
+			if (hdcSrc->bytesPerPixel != 1)
+			{
+				WLog_ERR(TAG,  "BitBlt: unsupported source depth %d", hdcSrc->bitsPerPixel);
+				return 1;
+			}
+
+			expand = TRUE;
+		}
+
+		srcStep = hSrcBmp->width * hdcSrc->bytesPerPixel;
+
+		if (hSrcBmp == hDstBmp)
+		{
+			overlap = ((nXSrc < nXDest + nWidth) && (nXDest < nXSrc + nWidth) &&
+				(nYSrc < nYDest + nHeight) && (nYDest < nYSrc + nHeight)) ? TRUE : FALSE;
+			reverse = (overlap && (nYSrc == nYDest) && (nXSrc < nXDest)) ? TRUE : FALSE;
+		}
+	}
+
+	if (usePat)
+	{
+		if ((rop3 != 0xE2) && hdcDest->brush &&
+			((hdcDest->brush->style == GDI_BS_PATTERN) || (hdcDest->brush->style == GDI_BS_HATCHED)))
+		{
+			hPatBmp = hdcDest->brush->pattern;
+
+			if ((hPatBmp->width != 8) || (hPatBmp->height != 8) ||
+					(hPatBmp->bytesPerPixel != hdcDest->bytesPerPixel))
+			{
+				WLog_ERR(TAG,  "BitBlt: unsupported %dx%d brush", hPatBmp->width, hPatBmp->height);
+				return 1;
+			}
+
+			/* align pattern to 8x8 grid to make sure transition
+			between different pattern blocks are smooth */
+
+			if (hdcDest->brush->style == GDI_BS_HATCHED)
+			{
+				xOffset = nXDest % 8;
+				yOffset = nYDest % 8 + 2; // +2 added after comparison to mstsc
+			}
+
+			for (y = 0; y < 8; y++)
+			{
+				pixel = (PIXEL_TYPE*) pattern[y];
+
+				for (x = 0; x < 8; x++)
+					pixel[x] = *((PIXEL_TYPE*) gdi_get_brush_pointer(hdcDest, x + xOffset, y + yOffset));
+			}
+		}
+		else
+		{
+			/* DSPDxax is the glyph ROP, its pattern is the text color */
+
+			if ((rop3 == 0xE2) || !hdcDest->brush || (hdcDest->brush->style != GDI_BS_SOLID))
+				color = GDI_GET_COLOR(hdcDest, hdcDest->textColor);
+			else
+				color = GDI_GET_COLOR(hdcDest, hdcDest->brush->color);
+
+			pixel = (PIXEL_TYPE*) pattern[0];
+
+			for (x = 0; x < 8; x++)
+				pixel[x] = color;
+
+			for (y = 1; y < 8; y++)
+				CopyMemory(pattern[y], pattern[0], 8 * sizeof(PIXEL_TYPE));
+		}
+
+		for (y = 0; y < 8; y++)
+		{
+			for (k = 8 * sizeof(PIXEL_TYPE); k < PRIM_ROP3_PATTERN_SIZE; k += 8 * sizeof(PIXEL_TYPE))
+				CopyMemory(&pattern[y][k], pattern[y], 8 * sizeof(PIXEL_TYPE));
+		}
+	}
+
+	for (row = 0; row < nHeight; row++)
+	{
+		/* copy down (bottom to top) when the source is above the destination */
+		y = (overlap && (nYSrc < nYDest)) ? (nHeight - 1 - row) : row;
+
+		dstp = hDstBmp->data + ((nYDest + y) * dstStep) + (nXDest * hdcDest->bytesPerPixel);
+
+		if (useSrc)
+		{
+			if ((nYSrc + y < 0) || (nYSrc + y >= hSrcBmp->height))
+				continue;
+
+			srcp = hSrcBmp->data + ((nYSrc + y) * srcStep) + (nXSrc * hdcSrc->bytesPerPixel);
+		}
+
+		if (usePat)
+			patp = pattern[y % 8];
+
+		if (!useSrc || (!expand && !overlap))
+		{
+			prims->rop3_8u(rop3, srcp, patp, dstp, nWidth * sizeof(PIXEL_TYPE));
+			continue;
+		}
+
+		for (chunk = 0; chunk < nWidth; chunk += BITBLT_CHUNK)
+		{
+			x = reverse ? ((nWidth - 1 - chunk) / BITBLT_CHUNK) * BITBLT_CHUNK : chunk;
+			count = ((nWidth - x) < BITBLT_CHUNK) ? (nWidth - x) : BITBLT_CHUNK;
+
+			if (expand)
+			{
+				srcMask = &srcp[x];
+
+				for (i = 0; i < count; i++)
+					stage[i] = (PIXEL_TYPE) (srcMask[i] * (((PIXEL_TYPE) ~0) / 0xFF));
+			}
+			else
+			{
+				CopyMemory(stage, &srcp[x * sizeof(PIXEL_TYPE)], count * sizeof(PIXEL_TYPE));
+			}
+
+			prims->rop3_8u(rop3, (BYTE*) stage, patp, &dstp[x * sizeof(PIXEL_TYPE)], count * sizeof(PIXEL_TYPE));
+		}
+	}
+
+	return 0;
+}
@@ -353,8 +353,49 @@ INLINE int gdi_PtInRect(HGDI_RECT rc, int x, int y)
 	return 0;
 }
 
+static void gdi_InvalidateRegionRects(HGDI_WND hwnd, int x, int y, int w, int h)
+{
+	int nbRects;
+	RECTANGLE_16 invalidRect;
+	RECTANGLE_16 extents;
+	REGION16* region = &hwnd->invalidRegion;
+
+	if ((x + w <= 0) || (y + h <= 0) || (x > 0xFFFF) || (y > 0xFFFF))
+		return;
+
+	invalidRect.left = (x < 0) ? 0 : x;
+	invalidRect.top = (y < 0) ? 0 : y;
+	invalidRect.right = ((x + w) > 0xFFFF) ? 0xFFFF : (x + w);
+	invalidRect.bottom = ((y + h) > 0xFFFF) ? 0xFFFF : (y + h);
+
+	if ((invalidRect.left >= invalidRect.right) || (invalidRect.top >= invalidRect.bottom))
+		return;
+
+	nbRects = region16_n_rects(region);
+
+	/* once merged into a single rectangle, most damage falls inside of it */
+
+	if ((nbRects == 1) && (invalidRect.left >= region->extents.left) &&
+		(invalidRect.top >= region->extents.top) && (invalidRect.right <= region->extents.right) &&
+		(invalidRect.bottom <= region->extents.bottom))
+		return;
+
+	if (!region16_union_rect(region, region, &invalidRect))
+		return;
+
+	if ((hwnd->maxInvalidRects > 0) && (region16_n_rects(region) > hwnd->maxInvalidRects))
+	{
+		extents = *region16_extents(region);
+		region16_clear(region);
+		region16_union_rect(region, region, &extents);
+	}
+}
+
 /**
  * Invalidate a given region, such that it is redrawn on the next region update.\n
+ * The damage is accumulated both as a bounding rectangle (hwnd->invalid) and as
+ * a coalesced region (hwnd->invalidRegion) which is merged into its bounding
+ * rectangle when it grows beyond hwnd->maxInvalidRects rectangles.
  * @msdn{dd145003}
  * @param hdc device context
  * @param x x1
@@ -369,7 +410,6 @@ INLINE int gdi_InvalidateRegion(HGDI_DC hdc, int x, int y, int w, int h)
 	GDI_RECT inv;
 	GDI_RECT rgn;
 	HGDI_RGN invalid;
-	HGDI_RGN cinvalid;
 
 	if (!hdc->hwnd)
 		return 0;
@@ -380,18 +420,14 @@ INLINE int gdi_InvalidateRegion(HGDI_DC hdc, int x, int y, int w, int h)
 	if (w == 0 || h == 0)
 		return 0;
 
-	cinvalid = hdc->hwnd->cinvalid;
+	invalid = hdc->hwnd->invalid;
 
-	if ((hdc->hwnd->ninvalid + 1) > hdc->hwnd->count)
-	{
-		hdc->hwnd->count *= 2;
-		cinvalid = (HGDI_RGN) realloc(cinvalid, sizeof(GDI_RGN) * (hdc->hwnd->count));
-	}
+	/* a null invalid rectangle starts a new paint cycle */
 
-	gdi_SetRgn(&cinvalid[hdc->hwnd->ninvalid++], x, y, w, h);
-	hdc->hwnd->cinvalid = cinvalid;
+	if (invalid->null)
+		region16_clear(&hdc->hwnd->invalidRegion);
 
-	invalid = hdc->hwnd->invalid;
+	gdi_InvalidateRegionRects(hdc->hwnd, x, y, w, h);
 
 	if (invalid->null)
 	{
@@ -11,6 +11,7 @@
 #include <freerdp/gdi/drawing.h>
 
 #include <winpr/crt.h>
+#include <winpr/sysinfo.h>
 
 /* BitBlt() Test Data */
 
@@ -1397,6 +1398,93 @@ int test_gdi_BitBlt_8bpp(void)
 	return 0;
 }
 
+#define THROUGHPUT_WIDTH	1024
+#define THROUGHPUT_HEIGHT	768
+#define THROUGHPUT_ITERATIONS	100
+
+int test_gdi_BitBlt_throughput(int bitsPerPixel)
+{
+	int i, k;
+	UINT32 start;
+	UINT32 elapsed;
+	double mpixels;
+	HGDI_DC hdcSrc;
+	HGDI_DC hdcDst;
+	HGDI_BRUSH hBrush;
+	HGDI_BITMAP hBmpSrc;
+	HGDI_BITMAP hBmpDst;
+	HGDI_BITMAP hBmpPat;
+	int size;
+
+	struct
+	{
+		const char* name;
+		int rop;
+	} rops[] =
+	{
+		{ "SRCCOPY", GDI_SRCCOPY },
+		{ "PATCOPY", GDI_PATCOPY },
+		{ "DSPDxax", GDI_DSPDxax },
+		{ "SRCAND", GDI_SRCAND },
+		{ "SRCPAINT", GDI_SRCPAINT },
+		{ "PSDPxax", GDI_PSDPxax }
+	};
+
+	hdcSrc = gdi_GetDC();
+	hdcSrc->bytesPerPixel = (bitsPerPixel + 1) / 8;
+	hdcSrc->bitsPerPixel = bitsPerPixel;
+
+	hdcDst = gdi_GetDC();
+	hdcDst->bytesPerPixel = (bitsPerPixel + 1) / 8;
+	hdcDst->bitsPerPixel = bitsPerPixel;
+
+	hBmpSrc = gdi_CreateCompatibleBitmap(hdcSrc, THROUGHPUT_WIDTH, THROUGHPUT_HEIGHT);
+	hBmpDst = gdi_CreateCompatibleBitmap(hdcDst, THROUGHPUT_WIDTH, THROUGHPUT_HEIGHT);
+	hBmpPat = gdi_CreateCompatibleBitmap(hdcDst, 8, 8);
+
+	size = THROUGHPUT_WIDTH * THROUGHPUT_HEIGHT * hdcDst->bytesPerPixel;
+
+	for (k = 0; k < size; k++)
+	{
+		hBmpSrc->data[k] = (BYTE) (k * 7);
+		hBmpDst->data[k] = (BYTE) (k * 13);
+	}
+
+	for (k = 0; k < 64 * hdcDst->bytesPerPixel; k++)
+		hBmpPat->data[k] = (BYTE) (k * 3);
+
+	gdi_SelectObject(hdcSrc, (HGDIOBJECT) hBmpSrc);
+	gdi_SelectObject(hdcDst, (HGDIOBJECT) hBmpDst);
+
+	hBrush = gdi_CreatePatternBrush(hBmpPat);
+	gdi_SelectObject(hdcDst, (HGDIOBJECT) hBrush);
+
+	for (i = 0; i < (int) (sizeof(rops) / sizeof(rops[0])); i++)
+	{
+		start = GetTickCount();
+
+		for (k = 0; k < THROUGHPUT_ITERATIONS; k++)
+		{
+			gdi_BitBlt(hdcDst, 0, 0, THROUGHPUT_WIDTH, THROUGHPUT_HEIGHT,
+				hdcSrc, 0, 0, rops[i].rop);
+		}
+
+		elapsed = GetTickCount() - start;
+		mpixels = ((double) THROUGHPUT_WIDTH * THROUGHPUT_HEIGHT * THROUGHPUT_ITERATIONS) / 1000000.0;
+
+		printf("%2dbpp %-10s %4u ms %10.1f MPixel/s\n", bitsPerPixel, rops[i].name,
+			elapsed, elapsed ? (mpixels * 1000.0 / elapsed) : 0.0);
+	}
+
+	gdi_DeleteObject((HGDIOBJECT) hBrush);
+	gdi_DeleteObject((HGDIOBJECT) hBmpSrc);
+	gdi_DeleteObject((HGDIOBJECT) hBmpDst);
+	gdi_DeleteDC(hdcSrc);
+	gdi_DeleteDC(hdcDst);
+
+	return 0;
+}
+
 int TestGdiBitBlt(int argc, char* argv[])
 {
 	fprintf(stderr, "test_gdi_BitBlt_32bpp()\n");
@@ -1414,5 +1502,16 @@ int TestGdiBitBlt(int argc, char* argv[])
 	if (test_gdi_BitBlt_8bpp() < 0)
 		return -1;
 
+	fprintf(stderr, "test_gdi_BitBlt_throughput()\n");
+
+	if (test_gdi_BitBlt_throughput(32) < 0)
+		return -1;
+
+	if (test_gdi_BitBlt_throughput(16) < 0)
+		return -1;
+
+	if (test_gdi_BitBlt_throughput(8) < 0)
+		return -1;
+
 	return 0;
 }
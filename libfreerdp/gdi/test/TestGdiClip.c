@@ -185,8 +185,8 @@ int test_gdi_InvalidateRegion(void)
 	hdc->hwnd->invalid->null = 1;
 	invalid = hdc->hwnd->invalid;
 
-	hdc->hwnd->count = 16;
-	hdc->hwnd->cinvalid = (HGDI_RGN) malloc(sizeof(GDI_RGN) * hdc->hwnd->count);
+	hdc->hwnd->maxInvalidRects = 16;
+	region16_init(&hdc->hwnd->invalidRegion);
 
 	rgn1 = gdi_CreateRectRgn(0, 0, 0, 0);
 	rgn2 = gdi_CreateRectRgn(0, 0, 0, 0);
@@ -336,6 +336,71 @@ int test_gdi_InvalidateRegion(void)
 	return 0;
 }
 
+int test_gdi_InvalidateRegionRects(void)
+{
+	int i;
+	int nbRects;
+	HGDI_DC hdc;
+	HGDI_BITMAP bmp;
+	const RECTANGLE_16* rects;
+	const RECTANGLE_16* extents;
+
+	hdc = gdi_GetDC();
+	hdc->bytesPerPixel = 4;
+	hdc->bitsPerPixel = 32;
+	bmp = gdi_CreateBitmap(1024, 768, 4, NULL);
+	gdi_SelectObject(hdc, (HGDIOBJECT) bmp);
+	gdi_SetNullClipRgn(hdc);
+
+	hdc->hwnd = (HGDI_WND) malloc(sizeof(GDI_WND));
+	hdc->hwnd->invalid = gdi_CreateRectRgn(0, 0, 0, 0);
+	hdc->hwnd->invalid->null = 1;
+	hdc->hwnd->maxInvalidRects = 4;
+	region16_init(&hdc->hwnd->invalidRegion);
+
+	/* adjacent glyph-sized rectangles coalesce into a single one */
+	for (i = 0; i < 64; i++)
+		gdi_InvalidateRegion(hdc, 100 + (i * 8), 100, 8, 16);
+
+	rects = region16_rects(&hdc->hwnd->invalidRegion, &nbRects);
+
+	if ((nbRects != 1) || (rects[0].left != 100) || (rects[0].top != 100) ||
+		(rects[0].right != 612) || (rects[0].bottom != 116))
+		return -1;
+
+	/* disjoint rectangles are kept apart */
+	gdi_InvalidateRegion(hdc, 0, 300, 10, 10);
+	gdi_InvalidateRegion(hdc, 500, 500, 10, 10);
+
+	if (region16_n_rects(&hdc->hwnd->invalidRegion) != 3)
+		return -1;
+
+	/* exceeding the maximum rectangle count merges into the bounding box */
+	gdi_InvalidateRegion(hdc, 900, 700, 10, 10);
+	gdi_InvalidateRegion(hdc, 50, 600, 10, 10);
+
+	rects = region16_rects(&hdc->hwnd->invalidRegion, &nbRects);
+	extents = region16_extents(&hdc->hwnd->invalidRegion);
+
+	if ((nbRects != 1) || (extents->left != 0) || (extents->top != 100) ||
+		(extents->right != 910) || (extents->bottom != 710))
+		return -1;
+
+	/* a new paint cycle discards the previous damage */
+	hdc->hwnd->invalid->null = 1;
+	gdi_InvalidateRegion(hdc, 10, 10, 20, 20);
+
+	rects = region16_rects(&hdc->hwnd->invalidRegion, &nbRects);
+
+	if ((nbRects != 1) || (rects[0].left != 10) || (rects[0].top != 10) ||
+		(rects[0].right != 30) || (rects[0].bottom != 30))
+		return -1;
+
+	gdi_DeleteDC(hdc);
+
+	return 0;
+}
+
 int TestGdiClip(int argc, char* argv[])
 {
 	if (test_gdi_ClipCoords() < 0)
@@ -344,6 +409,9 @@ int TestGdiClip(int argc, char* argv[])
 	if (test_gdi_InvalidateRegion() < 0)
 		return -1;
 
+	if (test_gdi_InvalidateRegionRects() < 0)
+		return -1;
+
 	return 0;
 }
 
@@ -0,0 +1,268 @@
+
+#include <freerdp/freerdp.h>
+#include <freerdp/gdi/gdi.h>
+
+#include <freerdp/gdi/dc.h>
+#include <freerdp/gdi/bitmap.h>
+#include <freerdp/gdi/region.h>
+#include <freerdp/gdi/clipping.h>
+
+#include <winpr/crt.h>
+
+/* 8x2 glyph: left half set on the first row, right half on the second */
+static const BYTE glyph_aj[2] = { 0xF0, 0x0F };
+
+static UINT32 test_get_pixel(rdpGdi* gdi, int x, int y)
+{
+	return *((UINT32*) &gdi->primary_buffer[(y * gdi->width + x) * 4]);
+}
+
+static int test_gdi_glyph_index(rdpContext* context, BOOL opaque, BOOL clipped)
+{
+	int x, y;
+	BOOL set;
+	UINT32 pixel;
+	UINT32 text = 0;
+	UINT32 back = 0;
+	rdpGdi* gdi = context->gdi;
+	rdpUpdate* update = context->update;
+	GLYPH_INDEX_ORDER glyphIndex;
+	const RECTANGLE_16* extents;
+	HGDI_DC hdc = gdi->primary->hdc;
+
+	ZeroMemory(gdi->primary_buffer, gdi->width * gdi->height * 4);
+
+	hdc->hwnd->invalid->null = 1;
+
+	if (clipped)
+		gdi_SetClipRgn(hdc, 0, 0, 14, 100);
+	else
+		gdi_SetNullClipRgn(hdc);
+
+	ZeroMemory(&glyphIndex, sizeof(GLYPH_INDEX_ORDER));
+	glyphIndex.cacheId = 0;
+	glyphIndex.backColor = 0x0000FF;
+	glyphIndex.foreColor = 0x00FF00;
+	glyphIndex.bkLeft = 10;
+	glyphIndex.bkTop = 10;
+	glyphIndex.bkRight = 18;
+	glyphIndex.bkBottom = 12;
+
+	if (opaque)
+	{
+		glyphIndex.opLeft = 8;
+		glyphIndex.opTop = 8;
+		glyphIndex.opRight = 20;
+		glyphIndex.opBottom = 14;
+	}
+
+	glyphIndex.x = 10;
+	glyphIndex.y = 10;
+	glyphIndex.cbData = 2;
+	glyphIndex.data[0] = 0; /* cache index */
+	glyphIndex.data[1] = 0; /* offset */
+
+	IFCALL(update->primary->GlyphIndex, context, &glyphIndex);
+
+	for (y = 0; y < 32; y++)
+	{
+		for (x = 0; x < 32; x++)
+		{
+			pixel = test_get_pixel(gdi, x, y);
+
+			set = FALSE;
+
+			if ((y == 10) && (x >= 10) && (x < 14))
+				set = TRUE;
+
+			if ((y == 11) && (x >= 14) && (x < 18))
+				set = TRUE;
+
+			if (clipped && (x >= 14))
+				set = FALSE;
+
+			if (set)
+			{
+				if (!text)
+					text = pixel;
+
+				if (!pixel || (pixel != text))
+				{
+					printf("glyph pixel (%d,%d) not drawn: 0x%08X\n", x, y, pixel);
+					return -1;
+				}
+			}
+			else if (opaque && (x >= 8) && (x < 20) && (y >= 8) && (y < 14) && (!clipped || (x < 14)))
+			{
+				if (!back)
+					back = pixel;
+
+				if (!pixel || (pixel != back))
+				{
+					printf("background pixel (%d,%d) not filled: 0x%08X\n", x, y, pixel);
+					return -1;
+				}
+			}
+			else if (pixel)
+			{
+				printf("pixel (%d,%d) outside of the text run modified: 0x%08X\n", x, y, pixel);
+				return -1;
+			}
+		}
+	}
+
+	if (text == back)
+		return -1;
+
+	extents = region16_extents(&hdc->hwnd->invalidRegion);
+
+	if (!opaque)
+	{
+		/* the glyphs drawn by the run are invalidated as one rectangle */
+
+		if ((extents->left != 10) || (extents->top != 10) ||
+			(extents->right != (clipped ? 14 : 18)) || (extents->bottom != 12))
+		{
+			printf("unexpected invalid region %d,%d-%d,%d\n", extents->left,
+					extents->top, extents->right, extents->bottom);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * A glyph cached at the depth of the 32bpp primary surface is drawn on a
+ * 16bpp offscreen surface.
+ */
+
+static int test_gdi_glyph_mixed_depth(rdpContext* context)
+{
+	int x, y;
+	int status = 0;
+	BOOL set;
+	BYTE* data;
+	UINT16 pixel;
+	UINT16 text = 0;
+	gdiBitmap surface;
+	gdiBitmap* drawing;
+	rdpGdi* gdi = context->gdi;
+	GLYPH_INDEX_ORDER glyphIndex;
+
+	data = (BYTE*) _aligned_malloc(32 * 32 * 2, 16);
+
+	if (!data)
+		return -1;
+
+	ZeroMemory(data, 32 * 32 * 2);
+	ZeroMemory(&surface, sizeof(gdiBitmap));
+
+	surface.hdc = gdi_GetDC();
+	surface.hdc->bytesPerPixel = 2;
+	surface.hdc->bitsPerPixel = 16;
+	surface.bitmap = gdi_CreateBitmap(32, 32, 16, data);
+	gdi_SelectObject(surface.hdc, (HGDIOBJECT) surface.bitmap);
+
+	ZeroMemory(&glyphIndex, sizeof(GLYPH_INDEX_ORDER));
+	glyphIndex.cacheId = 0;
+	glyphIndex.backColor = 0x0000FF;
+	glyphIndex.foreColor = 0x00FF00;
+	glyphIndex.bkLeft = 10;
+	glyphIndex.bkTop = 10;
+	glyphIndex.bkRight = 18;
+	glyphIndex.bkBottom = 12;
+	glyphIndex.x = 10;
+	glyphIndex.y = 10;
+	glyphIndex.cbData = 2;
+	glyphIndex.data[0] = 0; /* cache index */
+	glyphIndex.data[1] = 0; /* offset */
+
+	drawing = gdi->drawing;
+	gdi->drawing = &surface;
+	IFCALL(context->update->primary->GlyphIndex, context, &glyphIndex);
+	gdi->drawing = drawing;
+
+	for (y = 0; (y < 32) && !status; y++)
+	{
+		for (x = 0; x < 32; x++)
+		{
+			pixel = ((UINT16*) data)[y * 32 + x];
+			set = ((y == 10) && (x >= 10) && (x < 14)) || ((y == 11) && (x >= 14) && (x < 18));
+
+			if (set && !text)
+				text = pixel;
+
+			if (set ? (!pixel || (pixel != text)) : (pixel != 0))
+			{
+				printf("16bpp surface: unexpected pixel (%d,%d): 0x%04X\n", x, y, pixel);
+				status = -1;
+				break;
+			}
+		}
+	}
+
+	gdi_DeleteObject((HGDIOBJECT) surface.bitmap);
+	gdi_DeleteDC(surface.hdc);
+
+	return status;
+}
+
+int TestGdiGlyph(int argc, char* argv[])
+{
+	int status = 0;
+	freerdp* instance;
+	rdpContext* context;
+	CACHE_GLYPH_ORDER* cacheGlyph;
+
+	instance = freerdp_new();
+
+	if (!instance)
+		return -1;
+
+	freerdp_context_new(instance);
+	context = instance->context;
+
+	context->settings->DesktopWidth = 64;
+	context->settings->DesktopHeight = 64;
+	context->settings->ColorDepth = 32;
+
+	if (gdi_init(instance, CLRBUF_32BPP, NULL) < 0)
+		return -1;
+
+	cacheGlyph = (CACHE_GLYPH_ORDER*) calloc(1, sizeof(CACHE_GLYPH_ORDER));
+
+	if (!cacheGlyph)
+		return -1;
+
+	cacheGlyph->cacheId = 0;
+	cacheGlyph->cGlyphs = 1;
+	cacheGlyph->glyphData[0].cacheIndex = 0;
+	cacheGlyph->glyphData[0].cx = 8;
+	cacheGlyph->glyphData[0].cy = 2;
+	cacheGlyph->glyphData[0].cb = sizeof(glyph_aj);
+	cacheGlyph->glyphData[0].aj = (BYTE*) malloc(sizeof(glyph_aj));
+	CopyMemory(cacheGlyph->glyphData[0].aj, glyph_aj, sizeof(glyph_aj));
+
+	IFCALL(context->update->secondary->CacheGlyph, context, cacheGlyph);
+	free(cacheGlyph);
+
+	if (test_gdi_glyph_index(context, TRUE, FALSE) < 0)
+		status = -1;
+	else if (test_gdi_glyph_index(context, FALSE, FALSE) < 0)
+		status = -1;
+	else if (test_gdi_glyph_index(context, TRUE, TRUE) < 0)
+		status = -1;
+	else if (test_gdi_glyph_index(context, FALSE, TRUE) < 0)
+		status = -1;
+	else if (test_gdi_glyph_mixed_depth(context) < 0)
+		status = -1;
+	else if (test_gdi_glyph_index(context, FALSE, FALSE) < 0)
+		status = -1;
+
+	gdi_free(instance);
+	freerdp_context_free(instance);
+	freerdp_free(instance);
+
+	return status;
+}
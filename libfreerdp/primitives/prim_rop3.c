@@ -0,0 +1,115 @@
+/* FreeRDP: A Remote Desktop Protocol Client
+ * Ternary raster operations.
+ * vi:ts=4 sw=4:
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License. You may obtain
+ * a copy of the License at http://www.apache.org/licenses/LICENSE-2.0.
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+ * or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <freerdp/types.h>
+#include <freerdp/primitives.h>
+
+#include "prim_internal.h"
+#include "prim_rop3.h"
+
+/* ----------------------------------------------------------------------------
+ * Bitwise ternary raster operation over a byte span.
+ *
+ * The ROP3 code is the truth table of the operation, bit ((P << 2) | (S << 1) | D)
+ * holding the result for that combination of pattern, source and destination.
+ * Expanding each table bit into a mask and selecting on D, then S, then P
+ * evaluates any of the 256 codes without a per-code implementation.
+ * Since the operation is bitwise, the pixel depth does not matter here.
+ */
+#define ROP3_SELECT(_m, _a, _b)	(((_m) & (_a)) | (~(_m) & (_b)))
+
+pstatus_t general_rop3_8u(
+	BYTE rop3,
+	const BYTE *pSrc,
+	const BYTE *pPat,
+	BYTE *pDst,
+	INT32 len)
+{
+	int i, k;
+	BYTE m[8];
+	BYTE s, p, d;
+	BYTE f0, f1;
+
+	/* operands the code does not depend on may be omitted */
+	if (!pSrc)
+		pSrc = pDst;
+
+	switch (rop3)
+	{
+		case 0xF0: /* PATCOPY: P */
+			for (i = 0; i < len; i++)
+				pDst[i] = pPat[i & (ROP3_PATTERN_SIZE - 1)];
+			return PRIMITIVES_SUCCESS;
+
+		case 0x88: /* SRCAND: S & D */
+			for (i = 0; i < len; i++)
+				pDst[i] &= pSrc[i];
+			return PRIMITIVES_SUCCESS;
+
+		case 0xEE: /* SRCPAINT: S | D */
+			for (i = 0; i < len; i++)
+				pDst[i] |= pSrc[i];
+			return PRIMITIVES_SUCCESS;
+
+		case 0x66: /* SRCINVERT: S ^ D */
+			for (i = 0; i < len; i++)
+				pDst[i] ^= pSrc[i];
+			return PRIMITIVES_SUCCESS;
+
+		case 0xE2: /* DSPDxax: D ^ (S & (P ^ D)) */
+			for (i = 0; i < len; i++)
+			{
+				d = pDst[i];
+				pDst[i] = d ^ (pSrc[i] & (pPat[i & (ROP3_PATTERN_SIZE - 1)] ^ d));
+			}
+			return PRIMITIVES_SUCCESS;
+	}
+
+	for (k = 0; k < 8; k++)
+		m[k] = (rop3 & (1 << k)) ? 0xFF : 0x00;
+
+	for (i = 0; i < len; i++)
+	{
+		s = pSrc[i];
+		d = pDst[i];
+		p = pPat ? pPat[i & (ROP3_PATTERN_SIZE - 1)] : 0;
+
+		f0 = ROP3_SELECT(s, ROP3_SELECT(d, m[3], m[2]), ROP3_SELECT(d, m[1], m[0]));
+		f1 = ROP3_SELECT(s, ROP3_SELECT(d, m[7], m[6]), ROP3_SELECT(d, m[5], m[4]));
+		pDst[i] = ROP3_SELECT(p, f1, f0);
+	}
+
+	return PRIMITIVES_SUCCESS;
+}
+
+/* ------------------------------------------------------------------------- */
+void primitives_init_rop3(
+	primitives_t *prims)
+{
+	/* Start with the default. */
+	prims->rop3_8u = general_rop3_8u;
+
+	primitives_init_rop3_opt(prims);
+}
+
+/* ------------------------------------------------------------------------- */
+void primitives_deinit_rop3(
+	primitives_t *prims)
+{
+	/* Nothing to do. */
+}
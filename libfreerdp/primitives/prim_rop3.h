@@ -0,0 +1,32 @@
+/* FreeRDP: A Remote Desktop Protocol Client
+ * Ternary raster operations.
+ * vi:ts=4 sw=4
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License. You may obtain
+ * a copy of the License at http://www.apache.org/licenses/LICENSE-2.0.
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+ * or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ *
+ */
+
+#ifdef __GNUC__
+# pragma once
+#endif
+
+#ifndef __PRIM_ROP3_H_INCLUDED__
+#define __PRIM_ROP3_H_INCLUDED__
+
+/* The pattern passed to the rop3 primitives repeats every 32 bytes:
+ * eight pixels at 32bpp, or the 8 pixel brush row replicated at lower depths.
+ */
+#define ROP3_PATTERN_SIZE	PRIM_ROP3_PATTERN_SIZE
+
+pstatus_t general_rop3_8u(BYTE rop3, const BYTE *pSrc, const BYTE *pPat, BYTE *pDst, INT32 len);
+
+void primitives_init_rop3_opt(primitives_t *prims);
+
+#endif /* !__PRIM_ROP3_H_INCLUDED__ */
@@ -0,0 +1,222 @@
+/* FreeRDP: A Remote Desktop Protocol Client
+ * Optimized ternary raster operations.
+ * vi:ts=4 sw=4:
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License. You may obtain
+ * a copy of the License at http://www.apache.org/licenses/LICENSE-2.0.
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+ * or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <freerdp/types.h>
+#include <freerdp/primitives.h>
+#include <winpr/sysinfo.h>
+
+#ifdef WITH_SSE2
+#include <emmintrin.h>
+#elif defined(WITH_NEON)
+#include <arm_neon.h>
+#endif /* WITH_SSE2 else WITH_NEON */
+
+#include "prim_internal.h"
+#include "prim_rop3.h"
+
+#ifdef WITH_SSE2
+/* ------------------------------------------------------------------------- */
+#define SSE2_SELECT(_m, _a, _b) \
+	_mm_or_si128(_mm_and_si128((_m), (_a)), _mm_andnot_si128((_m), (_b)))
+
+pstatus_t sse2_rop3_8u(
+	BYTE rop3,
+	const BYTE *pSrc,
+	const BYTE *pPat,
+	BYTE *pDst,
+	INT32 len)
+{
+	int i, k;
+	int count;
+	__m128i m[8];
+	__m128i s, p, d;
+	__m128i f0, f1;
+	const BYTE* sptr;
+	BYTE* dptr;
+
+	/* If really short, just do it here. */
+	if (len < 32)
+		return general_rop3_8u(rop3, pSrc, pPat, pDst, len);
+
+	if (!pSrc)
+		pSrc = pDst;
+
+	for (k = 0; k < 8; k++)
+		m[k] = _mm_set1_epi8((rop3 & (1 << k)) ? 0xFF : 0x00);
+
+	p = _mm_setzero_si128();
+	sptr = pSrc;
+	dptr = pDst;
+	count = len >> 4;
+
+	/* 16 bytes at a time, the pattern period is a multiple of that */
+	for (i = 0; i < count; i++)
+	{
+		s = _mm_loadu_si128((const __m128i*) sptr);
+		d = _mm_loadu_si128((const __m128i*) dptr);
+
+		if (pPat)
+			p = _mm_loadu_si128((const __m128i*) &pPat[(i & 1) << 4]);
+
+		switch (rop3)
+		{
+			case 0xF0: /* PATCOPY */
+				d = p;
+				break;
+
+			case 0x88: /* SRCAND */
+				d = _mm_and_si128(s, d);
+				break;
+
+			case 0xEE: /* SRCPAINT */
+				d = _mm_or_si128(s, d);
+				break;
+
+			case 0x66: /* SRCINVERT */
+				d = _mm_xor_si128(s, d);
+				break;
+
+			case 0xE2: /* DSPDxax */
+				d = _mm_xor_si128(d, _mm_and_si128(s, _mm_xor_si128(p, d)));
+				break;
+
+			default:
+				f0 = SSE2_SELECT(s, SSE2_SELECT(d, m[3], m[2]), SSE2_SELECT(d, m[1], m[0]));
+				f1 = SSE2_SELECT(s, SSE2_SELECT(d, m[7], m[6]), SSE2_SELECT(d, m[5], m[4]));
+				d = SSE2_SELECT(p, f1, f0);
+				break;
+		}
+
+		_mm_storeu_si128((__m128i*) dptr, d);
+		sptr += 16;
+		dptr += 16;
+	}
+
+	/* Do leftover bytes, keeping the pattern phase. */
+	count <<= 4;
+
+	if (count < len)
+	{
+		general_rop3_8u(rop3, (pSrc == pDst) ? NULL : sptr,
+			pPat ? &pPat[count & (ROP3_PATTERN_SIZE - 1)] : NULL, dptr, len - count);
+	}
+
+	return PRIMITIVES_SUCCESS;
+}
+#endif /* WITH_SSE2 */
+
+#ifdef WITH_NEON
+/* ------------------------------------------------------------------------- */
+pstatus_t neon_rop3_8u(
+	BYTE rop3,
+	const BYTE *pSrc,
+	const BYTE *pPat,
+	BYTE *pDst,
+	INT32 len)
+{
+	int i, k;
+	int count;
+	uint8x16_t m[8];
+	uint8x16_t s, p, d;
+	uint8x16_t f0, f1;
+	const BYTE* sptr;
+	BYTE* dptr;
+
+	if (len < 32)
+		return general_rop3_8u(rop3, pSrc, pPat, pDst, len);
+
+	if (!pSrc)
+		pSrc = pDst;
+
+	for (k = 0; k < 8; k++)
+		m[k] = vdupq_n_u8((rop3 & (1 << k)) ? 0xFF : 0x00);
+
+	p = vdupq_n_u8(0);
+	sptr = pSrc;
+	dptr = pDst;
+	count = len >> 4;
+
+	for (i = 0; i < count; i++)
+	{
+		s = vld1q_u8(sptr);
+		d = vld1q_u8(dptr);
+
+		if (pPat)
+			p = vld1q_u8(&pPat[(i & 1) << 4]);
+
+		switch (rop3)
+		{
+			case 0xF0: /* PATCOPY */
+				d = p;
+				break;
+
+			case 0x88: /* SRCAND */
+				d = vandq_u8(s, d);
+				break;
+
+			case 0xEE: /* SRCPAINT */
+				d = vorrq_u8(s, d);
+				break;
+
+			case 0x66: /* SRCINVERT */
+				d = veorq_u8(s, d);
+				break;
+
+			case 0xE2: /* DSPDxax */
+				d = vbslq_u8(s, p, d);
+				break;
+
+			default:
+				f0 = vbslq_u8(s, vbslq_u8(d, m[3], m[2]), vbslq_u8(d, m[1], m[0]));
+				f1 = vbslq_u8(s, vbslq_u8(d, m[7], m[6]), vbslq_u8(d, m[5], m[4]));
+				d = vbslq_u8(p, f1, f0);
+				break;
+		}
+
+		vst1q_u8(dptr, d);
+		sptr += 16;
+		dptr += 16;
+	}
+
+	count <<= 4;
+
+	if (count < len)
+	{
+		general_rop3_8u(rop3, (pSrc == pDst) ? NULL : sptr,
+			pPat ? &pPat[count & (ROP3_PATTERN_SIZE - 1)] : NULL, dptr, len - count);
+	}
+
+	return PRIMITIVES_SUCCESS;
+}
+#endif /* WITH_NEON */
+
+/* ------------------------------------------------------------------------- */
+void primitives_init_rop3_opt(primitives_t *prims)
+{
+#if defined(WITH_SSE2)
+	if (IsProcessorFeaturePresent(PF_SSE2_INSTRUCTIONS_AVAILABLE))
+	{
+		prims->rop3_8u = sse2_rop3_8u;
+	}
+#elif defined(WITH_NEON)
+	if (IsProcessorFeaturePresent(PF_ARM_NEON_INSTRUCTIONS_AVAILABLE))
+	{
+		prims->rop3_8u = neon_rop3_8u;
+	}
+#endif /* WITH_SSE2 */
+}
@@ -52,6 +52,7 @@ void primitives_init(void)
 	primitives_init_YCoCg(pPrimitives);
 	primitives_init_YUV(pPrimitives);
 	primitives_init_16to32bpp(pPrimitives);
+	primitives_init_rop3(pPrimitives);
 }
 
 /* ------------------------------------------------------------------------- */
@@ -81,6 +82,7 @@ void primitives_deinit(void)
 	primitives_deinit_YCoCg(pPrimitives);
 	primitives_deinit_YUV(pPrimitives);
 	primitives_deinit_16to32bpp(pPrimitives);
+	primitives_deinit_rop3(pPrimitives);
 
 	free((void*) pPrimitives);
 	pPrimitives = NULL;
@@ -0,0 +1,163 @@
+/* test_rop3.c
+ * vi:ts=4 sw=4
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License. You may obtain
+ * a copy of the License at http://www.apache.org/licenses/LICENSE-2.0.
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+ * or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <winpr/sysinfo.h>
+#include "prim_test.h"
+
+#define FUNC_TEST_SIZE	96
+static const int ROP3_PRETEST_ITERATIONS = 100000;
+static const float TEST_TIME = 1.0;
+
+extern BOOL g_TestPrimitivesPerformance;
+
+extern pstatus_t general_rop3_8u(BYTE rop3, const BYTE *pSrc,
+	const BYTE *pPat, BYTE *pDst, INT32 len);
+extern pstatus_t sse2_rop3_8u(BYTE rop3, const BYTE *pSrc,
+	const BYTE *pPat, BYTE *pDst, INT32 len);
+
+/* ------------------------------------------------------------------------- */
+/* Evaluate the truth table one bit at a time. */
+static BYTE rop3_reference(BYTE rop3, BYTE s, BYTE p, BYTE d)
+{
+	int bit;
+	BYTE r = 0;
+
+	for (bit = 0; bit < 8; bit++)
+	{
+		int index = (((p >> bit) & 1) << 2) | (((s >> bit) & 1) << 1) | ((d >> bit) & 1);
+		r |= ((rop3 >> index) & 1) << bit;
+	}
+
+	return r;
+}
+
+/* ------------------------------------------------------------------------- */
+static int check_rop3(const char *name, BYTE rop3, const BYTE *src,
+	const BYTE *pat, const BYTE *orig, const BYTE *dst, int len)
+{
+	int i;
+
+	for (i = 0; i < len; ++i)
+	{
+		BYTE expected = rop3_reference(rop3, src[i], pat[i % 32], orig[i]);
+
+		if (dst[i] != expected)
+		{
+			printf("ROP3-%s FAIL rop3=0x%02X len=%d [%d] expected 0x%02x, got 0x%02x\n",
+				name, rop3, len, i, expected, dst[i]);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/* ------------------------------------------------------------------------- */
+int test_rop3_8u_func(void)
+{
+	BYTE ALIGN(src[FUNC_TEST_SIZE+16]), ALIGN(orig[FUNC_TEST_SIZE+16]);
+	BYTE ALIGN(dst[FUNC_TEST_SIZE+16]), ALIGN(pat[32]);
+	int failed = 0;
+	int rop3, off, len;
+	char testStr[256];
+
+	testStr[0] = '\0';
+	get_random_data(src, sizeof(src));
+	get_random_data(orig, sizeof(orig));
+	get_random_data(pat, sizeof(pat));
+
+	strcat(testStr, " general");
+
+	for (rop3 = 0; rop3 < 256; ++rop3)
+	{
+		for (len = 1; len <= FUNC_TEST_SIZE; len += 5)
+		{
+			memcpy(dst, orig, len);
+			general_rop3_8u(rop3, src, pat, dst, len);
+			failed += check_rop3("general", rop3, src, pat, orig, dst, len);
+		}
+	}
+
+#ifdef WITH_SSE2
+	if (IsProcessorFeaturePresent(PF_SSE2_INSTRUCTIONS_AVAILABLE))
+	{
+		strcat(testStr, " SSE2");
+
+		for (rop3 = 0; rop3 < 256; ++rop3)
+		{
+			for (off = 0; off < 4; ++off)
+			{
+				for (len = 1; len <= FUNC_TEST_SIZE; len += 5)
+				{
+					memcpy(dst + off, orig + off, len);
+					sse2_rop3_8u(rop3, src + off, pat, dst + off, len);
+					failed += check_rop3("SSE2", rop3, src + off, pat,
+						orig + off, dst + off, len);
+				}
+			}
+		}
+	}
+#endif /* i386 */
+
+	if (!failed) printf("All rop3_8u tests passed (%s).\n", testStr);
+	return (failed > 0) ? FAILURE : SUCCESS;
+}
+
+/* ------------------------------------------------------------------------- */
+STD_SPEED_TEST(rop3_8u_speed_test, BYTE, BYTE, dst=dst,
+	TRUE, general_rop3_8u(constant, src1, src2, dst, size),
+#ifdef WITH_SSE2
+	TRUE, sse2_rop3_8u(constant, src1, src2, dst, size), PF_SSE2_INSTRUCTIONS_AVAILABLE, FALSE,
+#else
+	FALSE, PRIM_NOP, 0, FALSE,
+#endif
+	FALSE, PRIM_NOP)
+
+int test_rop3_8u_speed(void)
+{
+	BYTE ALIGN(src[MAX_TEST_SIZE+3]), ALIGN(dst[MAX_TEST_SIZE+3]);
+	BYTE ALIGN(pat[32]);
+	get_random_data(src, sizeof(src));
+	get_random_data(pat, sizeof(pat));
+	rop3_8u_speed_test("rop3_8u", "SRCAND", src, pat, 0x88, dst,
+		test_sizes, NUM_TEST_SIZES, ROP3_PRETEST_ITERATIONS, TEST_TIME);
+	rop3_8u_speed_test("rop3_8u", "DSPDxax", src, pat, 0xE2, dst,
+		test_sizes, NUM_TEST_SIZES, ROP3_PRETEST_ITERATIONS, TEST_TIME);
+	rop3_8u_speed_test("rop3_8u", "PSDPxax", src, pat, 0xB8, dst,
+		test_sizes, NUM_TEST_SIZES, ROP3_PRETEST_ITERATIONS, TEST_TIME);
+	return SUCCESS;
+}
+
+int TestPrimitivesRop3(int argc, char* argv[])
+{
+	int status;
+
+	status = test_rop3_8u_func();
+
+	if (status != SUCCESS)
+		return 1;
+
+	if (g_TestPrimitivesPerformance)
+	{
+		status = test_rop3_8u_speed();
+
+		if (status != SUCCESS)
+			return 1;
+	}
+
+	return 0;
+}
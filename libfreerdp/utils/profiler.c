@@ -24,58 +24,452 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+#include <winpr/thread.h>
+#include <winpr/interlocked.h>
+
+#ifndef _WIN32
+#include <time.h>
+#include <pthread.h>
+#endif
+
 #include <freerdp/utils/profiler.h>
 #include <freerdp/log.h>
 
 #define TAG FREERDP_TAG("utils")
 
-PROFILER* profiler_create(char* name)
+#define PROFILER_EVENT_BEGIN		'B'
+#define PROFILER_EVENT_END		'E'
+#define PROFILER_EVENT_COUNTER		'C'
+#define PROFILER_EVENT_FLOW_BEGIN	's'
+#define PROFILER_EVENT_FLOW_END		'f'
+
+struct _PROFILER_EVENT
 {
-	PROFILER* profiler;
+	UINT64 timestamp;
+	const char* name;
+	UINT64 value;
+	DWORD threadId;
+	char type;
+};
+typedef struct _PROFILER_EVENT PROFILER_EVENT;
 
-	profiler = (PROFILER*) malloc(sizeof(PROFILER));
-	
-	profiler->name = name;
-	profiler->stopwatch = stopwatch_create();
+/**
+ * A ring is written by its thread only, so recording takes no lock. Rings
+ * are never freed: a thread may still be recording while the profiler is
+ * being stopped. The ring of an exited thread is handed to the next new
+ * thread, which appends after the events of the previous one: these are
+ * dumped until they are overwritten, and there are no more rings than
+ * threads ever recording at the same time.
+ */
 
-	return profiler;
+struct _PROFILER_RING
+{
+	DWORD threadId;
+	volatile LONG exited;
+	volatile UINT64 head;
+	struct _PROFILER_RING* next;
+	PROFILER_EVENT events[PROFILER_RING_SIZE];
+};
+typedef struct _PROFILER_RING PROFILER_RING;
+
+volatile BOOL freerdp_profiler_enabled = FALSE;
+
+static BOOL g_ProfilerTlsValid = FALSE;
+#ifdef _WIN32
+static DWORD g_ProfilerTls = FLS_OUT_OF_INDEXES;
+#else
+static pthread_key_t g_ProfilerTls;
+#endif
+static PROFILER_RING* volatile g_ProfilerRings = NULL;
+static INIT_ONCE g_ProfilerOnce = INIT_ONCE_STATIC_INIT;
+static UINT64 g_ProfilerEpoch = 0;
+static char* g_ProfilerFilename = NULL;
+
+static UINT64 profiler_get_time(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER frequency;
+	LARGE_INTEGER counter;
+
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&counter);
+
+	return (UINT64) ((counter.QuadPart / frequency.QuadPart) * 1000000000ULL +
+			((counter.QuadPart % frequency.QuadPart) * 1000000000ULL) / frequency.QuadPart);
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (((UINT64) ts.tv_sec) * 1000000000ULL) + ts.tv_nsec;
+#endif
 }
 
-void profiler_free(PROFILER* profiler)
-{	
-	stopwatch_free(profiler->stopwatch);
-	
-	free(profiler);
+static BOOL profiler_set_filename(const char* filename)
+{
+	char* copy = NULL;
+
+	if (filename)
+	{
+		copy = _strdup(filename);
+
+		if (!copy)
+			return FALSE;
+	}
+
+	free(g_ProfilerFilename);
+	g_ProfilerFilename = copy;
+
+	return TRUE;
+}
+
+static void WINAPI profiler_thread_exit(void* value)
+{
+	PROFILER_RING* ring = (PROFILER_RING*) value;
+
+	if (ring)
+		InterlockedExchange(&ring->exited, TRUE);
+}
+
+static BOOL profiler_tls_alloc(void)
+{
+#ifdef _WIN32
+	g_ProfilerTls = FlsAlloc(profiler_thread_exit);
+	g_ProfilerTlsValid = (g_ProfilerTls != FLS_OUT_OF_INDEXES) ? TRUE : FALSE;
+#else
+	g_ProfilerTlsValid = (pthread_key_create(&g_ProfilerTls, profiler_thread_exit) == 0) ? TRUE : FALSE;
+#endif
+	return g_ProfilerTlsValid;
+}
+
+static INLINE PROFILER_RING* profiler_tls_get_value(void)
+{
+#ifdef _WIN32
+	return (PROFILER_RING*) FlsGetValue(g_ProfilerTls);
+#else
+	return (PROFILER_RING*) pthread_getspecific(g_ProfilerTls);
+#endif
+}
+
+static INLINE void profiler_tls_set_value(PROFILER_RING* ring)
+{
+#ifdef _WIN32
+	FlsSetValue(g_ProfilerTls, ring);
+#else
+	pthread_setspecific(g_ProfilerTls, ring);
+#endif
+}
+
+static void profiler_exit_handler(void)
+{
+	profiler_stop();
+}
+
+static BOOL CALLBACK profiler_init_once(PINIT_ONCE once, PVOID param, PVOID* context)
+{
+	char* filename;
+
+	if (!profiler_tls_alloc())
+		return FALSE;
+
+	g_ProfilerEpoch = profiler_get_time();
+	filename = getenv(PROFILER_ENVIRONMENT_VARIABLE);
+
+	if (filename && *filename && profiler_set_filename(filename))
+	{
+		atexit(profiler_exit_handler);
+		freerdp_profiler_enabled = TRUE;
+		WLog_INFO(TAG, "profiling, the trace is written to %s on exit", filename);
+	}
+
+	return TRUE;
+}
+
+/**
+ * Reads the FREERDP_PROFILER environment variable, called when a context
+ * is created. Calling it again has no effect.
+ */
+
+void profiler_init(void)
+{
+	InitOnceExecuteOnce(&g_ProfilerOnce, profiler_init_once, NULL, NULL);
+}
+
+BOOL profiler_start(const char* filename)
+{
+	profiler_init();
+
+	if (!g_ProfilerTlsValid)
+		return FALSE;
+
+	if (filename && !profiler_set_filename(filename))
+		return FALSE;
+
+	freerdp_profiler_enabled = TRUE;
+
+	return TRUE;
+}
+
+/**
+ * Stops recording and writes the trace to the file given to
+ * profiler_start(), if any.
+ */
+
+BOOL profiler_stop(void)
+{
+	BOOL status = TRUE;
+
+	freerdp_profiler_enabled = FALSE;
+
+	if (g_ProfilerFilename)
+	{
+		status = profiler_dump(g_ProfilerFilename);
+		profiler_set_filename(NULL);
+	}
+
+	return status;
 }
 
-void profiler_enter(PROFILER* profiler)
+/**
+ * Drops the recorded events. The ring heads are not synchronized with the
+ * probes, so this does nothing while the profiler is running.
+ */
+
+void profiler_reset(void)
 {
-	stopwatch_start(profiler->stopwatch);
+	PROFILER_RING* ring;
+
+	if (freerdp_profiler_enabled)
+		return;
+
+	for (ring = g_ProfilerRings; ring; ring = ring->next)
+		ring->head = 0;
 }
 
-void profiler_exit(PROFILER* profiler)
+static PROFILER_RING* profiler_get_ring(void)
 {
-	stopwatch_stop(profiler->stopwatch);
+	PROFILER_RING* ring;
+	PROFILER_RING* head;
+
+	ring = profiler_tls_get_value();
+
+	if (ring)
+		return ring;
+
+	for (ring = g_ProfilerRings; ring; ring = ring->next)
+	{
+		if (ring->exited && (InterlockedCompareExchange(&ring->exited, FALSE, TRUE) == TRUE))
+			break;
+	}
+
+	if (!ring)
+	{
+		ring = (PROFILER_RING*) calloc(1, sizeof(PROFILER_RING));
+
+		if (!ring)
+			return NULL;
+
+		do
+		{
+			head = g_ProfilerRings;
+			ring->next = head;
+		}
+		while (InterlockedCompareExchangePointer((PVOID volatile*) &g_ProfilerRings, ring, head) != head);
+	}
+
+	ring->threadId = GetCurrentThreadId();
+	profiler_tls_set_value(ring);
+
+	return ring;
 }
 
-void profiler_print_header()
+static void profiler_record(char type, const char* name, UINT64 value)
 {
-	WLog_INFO(TAG,  "                                             |-----------------------|");
-	WLog_INFO(TAG,  "                PROFILER                     |    elapsed seconds    |");
-	WLog_INFO(TAG,  "|--------------------------------------------|-----------------------|");
-	WLog_INFO(TAG,  "| code section                  | iterations |     total |      avg. |");
-	WLog_INFO(TAG,  "|-------------------------------|------------|-----------|-----------|");
+	PROFILER_RING* ring;
+	PROFILER_EVENT* event;
+
+	if (!g_ProfilerTlsValid)
+		return;
+
+	ring = profiler_get_ring();
+
+	if (!ring)
+		return;
+
+	event = &ring->events[ring->head & (PROFILER_RING_SIZE - 1)];
+	event->timestamp = profiler_get_time();
+	event->name = name;
+	event->value = value;
+	event->threadId = ring->threadId;
+	event->type = type;
+
+	ring->head++;
 }
 
-void profiler_print(PROFILER* profiler)
+void profiler_begin(const char* name)
 {
-	double elapsed_sec = stopwatch_get_elapsed_time_in_seconds(profiler->stopwatch);
-	double avg_sec = elapsed_sec / (double) profiler->stopwatch->count;
-	WLog_INFO(TAG,  "| %-30.30s| %10du | %9f | %9f |",
-			  profiler->name, profiler->stopwatch->count, elapsed_sec, avg_sec);
+	profiler_record(PROFILER_EVENT_BEGIN, name, 0);
 }
 
-void profiler_print_footer()
+void profiler_end(const char* name)
 {
-	WLog_INFO(TAG,  "|--------------------------------------------------------------------|");
+	profiler_record(PROFILER_EVENT_END, name, 0);
+}
+
+void profiler_counter(const char* name, INT64 value)
+{
+	profiler_record(PROFILER_EVENT_COUNTER, name, (UINT64) value);
+}
+
+void profiler_flow_begin(const char* name, UINT64 id)
+{
+	profiler_record(PROFILER_EVENT_FLOW_BEGIN, name, id);
+}
+
+void profiler_flow_end(const char* name, UINT64 id)
+{
+	profiler_record(PROFILER_EVENT_FLOW_END, name, id);
+}
+
+static void profiler_write_string(FILE* fp, const char* str)
+{
+	fputc('"', fp);
+
+	for (; str && *str; str++)
+	{
+		if ((*str == '"') || (*str == '\\'))
+			fputc('\\', fp);
+
+		if ((BYTE) *str >= 0x20)
+			fputc(*str, fp);
+	}
+
+	fputc('"', fp);
+}
+
+static void profiler_write_event(FILE* fp, DWORD pid, DWORD tid, PROFILER_EVENT* event)
+{
+	UINT64 timestamp = (event->timestamp > g_ProfilerEpoch) ? event->timestamp - g_ProfilerEpoch : 0;
+
+	fprintf(fp, ",\n{\"name\":");
+	profiler_write_string(fp, event->name);
+	fprintf(fp, ",\"cat\":\"freerdp\",\"ph\":\"%c\",\"ts\":%llu.%03u,\"pid\":%u,\"tid\":%u",
+			event->type, (unsigned long long) (timestamp / 1000), (unsigned int) (timestamp % 1000),
+			(unsigned int) pid, (unsigned int) tid);
+
+	switch (event->type)
+	{
+		case PROFILER_EVENT_COUNTER:
+			fprintf(fp, ",\"args\":{\"value\":%lld}", (long long) (INT64) event->value);
+			break;
+
+		case PROFILER_EVENT_FLOW_BEGIN:
+			fprintf(fp, ",\"id\":%llu", (unsigned long long) event->value);
+			break;
+
+		case PROFILER_EVENT_FLOW_END:
+			fprintf(fp, ",\"id\":%llu,\"bp\":\"e\"", (unsigned long long) event->value);
+			break;
+	}
+
+	fprintf(fp, "}");
+}
+
+/**
+ * Writes the rings as a Chrome trace, timestamps in microseconds since the
+ * profiler was initialized. A ring which wrapped around, or was handed over
+ * to another thread, starts in the middle of nested sections, their
+ * unmatched ends are dropped.
+ */
+
+BOOL profiler_dump(const char* filename)
+{
+	FILE* fp;
+	UINT64 head;
+	UINT64 index;
+	UINT64 first;
+	UINT32 depth;
+	DWORD threadId;
+	PROFILER_RING* ring;
+	PROFILER_EVENT* event;
+	DWORD pid = GetCurrentProcessId();
+
+	fp = fopen(filename, "w");
+
+	if (!fp)
+	{
+		WLog_ERR(TAG, "failed to create the trace file %s", filename);
+		return FALSE;
+	}
+
+	fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+	fprintf(fp, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%u,\"tid\":0,\"args\":{\"name\":\"freerdp\"}}",
+			(unsigned int) pid);
+
+	for (ring = g_ProfilerRings; ring; ring = ring->next)
+	{
+		head = ring->head;
+		first = (head > PROFILER_RING_SIZE) ? head - PROFILER_RING_SIZE : 0;
+		depth = 0;
+		threadId = 0;
+
+		for (index = first; index < head; index++)
+		{
+			event = &ring->events[index & (PROFILER_RING_SIZE - 1)];
+
+			if ((index == first) || (event->threadId != threadId))
+			{
+				threadId = event->threadId;
+				depth = 0;
+
+				fprintf(fp, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%u,\"tid\":%u,\"args\":{\"name\":\"thread %u\"}}",
+						(unsigned int) pid, (unsigned int) threadId, (unsigned int) threadId);
+			}
+
+			if (event->type == PROFILER_EVENT_BEGIN)
+			{
+				depth++;
+			}
+			else if (event->type == PROFILER_EVENT_END)
+			{
+				if (!depth)
+					continue;
+
+				depth--;
+			}
+
+			profiler_write_event(fp, pid, event->threadId, event);
+		}
+	}
+
+	fprintf(fp, "\n]}\n");
+
+	if (fclose(fp) != 0)
+	{
+		WLog_ERR(TAG, "failed to write the trace file %s", filename);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+PROFILER* profiler_create(char* name)
+{
+	PROFILER* profiler;
+
+	profiler = (PROFILER*) malloc(sizeof(PROFILER));
+
+	if (!profiler)
+		return NULL;
+
+	profiler->name = name;
+
+	return profiler;
+}
+
+void profiler_free(PROFILER* profiler)
+{
+	free(profiler);
 }
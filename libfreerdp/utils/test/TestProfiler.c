@@ -0,0 +1,359 @@
+
+#include <stdio.h>
+
+#include <winpr/crt.h>
+#include <winpr/file.h>
+#include <winpr/path.h>
+#include <winpr/synch.h>
+#include <winpr/thread.h>
+
+#ifndef _WIN32
+#include <time.h>
+#endif
+
+#include <freerdp/utils/profiler.h>
+
+#define TEST_PROBES		10000000
+#define TEST_RUNS		5
+
+/* generous enough for sanitizer and debug builds on a loaded machine */
+#define TEST_MAX_PROBE_NS	20.0
+
+static volatile UINT32 g_Sink = 0;
+
+static UINT64 test_get_time(void)
+{
+#ifndef _WIN32
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (((UINT64) ts.tv_sec) * 1000000000ULL) + ts.tv_nsec;
+#else
+	return GetTickCount64() * 1000000ULL;
+#endif
+}
+
+/**
+ * The cost of a stopped profiler: a loop with a begin and an end probe
+ * per iteration against the same loop without them, best of a few runs.
+ */
+
+static double test_disabled_probe_cost(void)
+{
+	int run;
+	UINT32 index;
+	UINT64 begin;
+	UINT64 probes;
+	UINT64 baseline;
+	UINT64 bestProbes = (UINT64) -1;
+	UINT64 bestBaseline = (UINT64) -1;
+
+	for (run = 0; run < TEST_RUNS; run++)
+	{
+		begin = test_get_time();
+
+		for (index = 0; index < TEST_PROBES; index++)
+			g_Sink = index;
+
+		baseline = test_get_time() - begin;
+		begin = test_get_time();
+
+		for (index = 0; index < TEST_PROBES; index++)
+		{
+			PROFILER_BEGIN("test_disabled");
+			g_Sink = index;
+			PROFILER_END("test_disabled");
+		}
+
+		probes = test_get_time() - begin;
+
+		if (baseline < bestBaseline)
+			bestBaseline = baseline;
+
+		if (probes < bestProbes)
+			bestProbes = probes;
+	}
+
+	if (bestProbes < bestBaseline)
+		return 0.0;
+
+	return ((double) (bestProbes - bestBaseline)) / (2.0 * TEST_PROBES);
+}
+
+#define TEST_SHORT_THREADS	16
+
+static void* test_short_thread(void* arg)
+{
+	PROFILER_COUNTER("test_short", 1);
+
+	return NULL;
+}
+
+static void* test_worker_thread(void* arg)
+{
+	PROFILER_BEGIN("test_worker");
+	PROFILER_FLOW_END("test_flow", 7);
+	PROFILER_END("test_worker");
+
+	return NULL;
+}
+
+/* more events than a ring holds: the oldest ones, and the unmatched ends, are dropped */
+static void* test_wrap_thread(void* arg)
+{
+	int index;
+
+	PROFILER_BEGIN("test_outer");
+
+	for (index = 0; index < (PROFILER_RING_SIZE / 2); index++)
+	{
+		PROFILER_BEGIN("test_inner");
+		PROFILER_END("test_inner");
+	}
+
+	PROFILER_END("test_outer");
+
+	return NULL;
+}
+
+static int test_count(const char* str, const char* pattern)
+{
+	int count = 0;
+	size_t length = strlen(pattern);
+
+	while ((str = strstr(str, pattern)) != NULL)
+	{
+		count++;
+		str += length;
+	}
+
+	return count;
+}
+
+/* a JSON object with balanced brackets outside of strings */
+static BOOL test_check_json_structure(const char* json)
+{
+	int depth = 0;
+	BOOL string = FALSE;
+
+	if (*json != '{')
+		return FALSE;
+
+	for (; *json; json++)
+	{
+		if (string)
+		{
+			if (*json == '\\')
+				json++;
+			else if (*json == '"')
+				string = FALSE;
+
+			continue;
+		}
+
+		if (*json == '"')
+			string = TRUE;
+		else if ((*json == '{') || (*json == '['))
+			depth++;
+		else if ((*json == '}') || (*json == ']'))
+			depth--;
+
+		if (depth < 0)
+			return FALSE;
+	}
+
+	return (depth == 0) && !string;
+}
+
+static char* test_read_file(const char* filename)
+{
+	FILE* fp;
+	long size;
+	char* data;
+
+	fp = fopen(filename, "rb");
+
+	if (!fp)
+		return NULL;
+
+	fseek(fp, 0, SEEK_END);
+	size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+
+	data = (char*) calloc(1, size + 1);
+
+	if (data && (fread(data, 1, size, fp) != (size_t) size))
+	{
+		free(data);
+		data = NULL;
+	}
+
+	fclose(fp);
+
+	return data;
+}
+
+static int test_check_trace(const char* json)
+{
+	if (!test_check_json_structure(json) || !strstr(json, "\"traceEvents\":["))
+	{
+		printf("the trace is not a Chrome trace JSON object\n");
+		return -1;
+	}
+
+	if (strstr(json, "\"name\":\"test_disabled\""))
+	{
+		printf("a probe recorded while the profiler was stopped\n");
+		return -1;
+	}
+
+	if (test_count(json, "\"name\":\"test_frame\"") != 2)
+	{
+		printf("missing begin/end events\n");
+		return -1;
+	}
+
+	if (!strstr(json, "\"name\":\"test_counter\",\"cat\":\"freerdp\",\"ph\":\"C\"") ||
+			!strstr(json, "\"args\":{\"value\":42}"))
+	{
+		printf("missing counter event\n");
+		return -1;
+	}
+
+	if (!strstr(json, "\"ph\":\"s\"") || !strstr(json, "\"id\":7,\"bp\":\"e\"") ||
+			(test_count(json, "\"name\":\"test_flow\"") != 2))
+	{
+		printf("missing flow events\n");
+		return -1;
+	}
+
+	if (test_count(json, "\"ph\":\"B\"") != test_count(json, "\"ph\":\"E\""))
+	{
+		printf("unbalanced begin/end events: %d begin, %d end\n",
+				test_count(json, "\"ph\":\"B\""), test_count(json, "\"ph\":\"E\""));
+		return -1;
+	}
+
+	if (strstr(json, "\"name\":\"test_outer\""))
+	{
+		printf("the events overwritten in a wrapped ring were dumped\n");
+		return -1;
+	}
+
+	if (test_count(json, "\"name\":\"test_short\"") != TEST_SHORT_THREADS)
+	{
+		printf("the events of exited threads were lost\n");
+		return -1;
+	}
+
+	/* the main thread and the others, which run one after the other and share a ring */
+	if (test_count(json, "\"name\":\"thread_name\"") < 2)
+	{
+		printf("missing thread names\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+int TestProfiler(int argc, char* argv[])
+{
+	int index;
+	int status = -1;
+	char* path;
+	char* json = NULL;
+	char* filename;
+	HANDLE thread;
+	double cost;
+
+	path = GetKnownPath(KNOWN_PATH_TEMP);
+	filename = GetCombinedPath(path, "TestProfiler.json");
+	free(path);
+
+	if (!filename)
+		return -1;
+
+	DeleteFileA(filename);
+
+	profiler_init();
+
+	if (freerdp_profiler_enabled)
+	{
+		printf("the profiler is enabled by the environment, skipping\n");
+		free(filename);
+		return 0;
+	}
+
+	cost = test_disabled_probe_cost();
+	printf("disabled probe: %.3f ns\n", cost);
+
+	if (cost >= TEST_MAX_PROBE_NS)
+	{
+		printf("disabled probes cost %.3f ns, more than %.1f ns\n", cost, TEST_MAX_PROBE_NS);
+		goto out;
+	}
+
+	if (!profiler_start(filename))
+	{
+		printf("profiler_start failed\n");
+		goto out;
+	}
+
+	PROFILER_BEGIN("test_frame");
+	PROFILER_COUNTER("test_counter", 42);
+	PROFILER_FLOW_BEGIN("test_flow", 7);
+
+	/* the rings of exited threads are reused, the wrap thread would overwrite the others */
+	thread = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE) test_wrap_thread, NULL, 0, NULL);
+
+	if (!thread)
+		goto out;
+
+	WaitForSingleObject(thread, INFINITE);
+	CloseHandle(thread);
+
+	thread = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE) test_worker_thread, NULL, 0, NULL);
+
+	if (!thread)
+		goto out;
+
+	WaitForSingleObject(thread, INFINITE);
+	CloseHandle(thread);
+
+	for (index = 0; index < TEST_SHORT_THREADS; index++)
+	{
+		thread = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE) test_short_thread, NULL, 0, NULL);
+
+		if (!thread)
+			goto out;
+
+		WaitForSingleObject(thread, INFINITE);
+		CloseHandle(thread);
+	}
+
+	PROFILER_END("test_frame");
+
+	if (!profiler_stop() || freerdp_profiler_enabled)
+	{
+		printf("profiler_stop failed\n");
+		goto out;
+	}
+
+	json = test_read_file(filename);
+
+	if (!json)
+	{
+		printf("failed to read %s\n", filename);
+		goto out;
+	}
+
+	status = test_check_trace(json);
+
+out:
+	profiler_reset();
+	DeleteFileA(filename);
+	free(filename);
+	free(json);
+	return status;
+}
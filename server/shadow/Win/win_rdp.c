@@ -50,30 +50,23 @@ void shw_begin_paint(rdpContext* context)
 	shw = (shwContext*) context;
 
 	gdi->primary->hdc->hwnd->invalid->null = 1;
-	gdi->primary->hdc->hwnd->ninvalid = 0;
+	region16_clear(&gdi->primary->hdc->hwnd->invalidRegion);
 }
 
 void shw_end_paint(rdpContext* context)
 {
 	int index;
 	int ninvalid;
-	HGDI_RGN cinvalid;
-	RECTANGLE_16 invalidRect;
+	const RECTANGLE_16* cinvalid;
 	rdpGdi* gdi = context->gdi;
 	shwContext* shw = (shwContext*) context;
 	winShadowSubsystem* subsystem = shw->subsystem;
 
-	ninvalid = gdi->primary->hdc->hwnd->ninvalid;
-	cinvalid = gdi->primary->hdc->hwnd->cinvalid;
+	cinvalid = region16_rects(&gdi->primary->hdc->hwnd->invalidRegion, &ninvalid);
 
 	for (index = 0; index < ninvalid; index++)
 	{
-		invalidRect.left = cinvalid[index].x;
-		invalidRect.top = cinvalid[index].y;
-		invalidRect.right = cinvalid[index].x + cinvalid[index].w;
-		invalidRect.bottom = cinvalid[index].y + cinvalid[index].h;
-
-		region16_union_rect(&(subsystem->invalidRegion), &(subsystem->invalidRegion), &invalidRect);
+		region16_union_rect(&(subsystem->invalidRegion), &(subsystem->invalidRegion), &cinvalid[index]);
 	}
 
 	SetEvent(subsystem->RdpUpdateEnterEvent);
@@ -47,10 +47,14 @@ void shadow_client_context_new(freerdp_peer* peer, rdpShadowClient* client)
 	settings->ColorDepth = 32;
 	settings->NSCodec = TRUE;
 	settings->RemoteFxCodec = TRUE;
+	settings->RemoteFxImageCodec = TRUE;
+	settings->JpegCodec = TRUE;
 	settings->BitmapCacheV3Enabled = TRUE;
 	settings->FrameMarkerCommandEnabled = TRUE;
 	settings->SurfaceFrameMarkerEnabled = TRUE;
 	settings->SupportGraphicsPipeline = FALSE;
+	settings->NetworkAutoDetect = TRUE;
+	settings->HeartbeatPeriod = server->heartbeatPeriod;
 
 	settings->DrawAllowSkipAlpha = TRUE;
 	settings->DrawAllowColorSubsampling = TRUE;
@@ -87,6 +91,8 @@ void shadow_client_context_new(freerdp_peer* peer, rdpShadowClient* client)
 
 	client->encoder = shadow_encoder_new(client);
 
+	client->congestion = shadow_congestion_new(0);
+
 	ArrayList_Add(server->clients, (void*) client);
 }
 
@@ -115,6 +121,12 @@ void shadow_client_context_free(freerdp_peer* peer, rdpShadowClient* client)
 		shadow_encoder_free(client->encoder);
 		client->encoder = NULL;
 	}
+
+	if (client->congestion)
+	{
+		shadow_congestion_free(client->congestion);
+		client->congestion = NULL;
+	}
 }
 
 void shadow_client_message_free(wMessage* message)
@@ -281,6 +293,7 @@ void shadow_client_suppress_output(rdpShadowClient* client, BYTE allow, RECTANGL
 
 BOOL shadow_client_activate(freerdp_peer* peer)
 {
+	UINT32 codecs = 0;
 	rdpSettings* settings = peer->settings;
 	rdpShadowClient* client = (rdpShadowClient*) peer->context;
 
@@ -289,13 +302,28 @@ BOOL shadow_client_activate(freerdp_peer* peer)
 		/* Hack for Mac/iOS/Android Microsoft RDP clients */
 
 		settings->RemoteFxCodec = FALSE;
+		settings->RemoteFxImageCodec = FALSE;
 
 		settings->NSCodec = FALSE;
 		settings->NSCodecAllowSubsampling = FALSE;
 
+		settings->JpegCodec = FALSE;
+
 		settings->SurfaceFrameMarkerEnabled = FALSE;
 	}
 
+	if (settings->RemoteFxCodec || settings->RemoteFxImageCodec)
+		codecs |= FREERDP_CODEC_REMOTEFX;
+
+	if (settings->NSCodec)
+		codecs |= FREERDP_CODEC_NSCODEC;
+
+	if (settings->JpegCodec)
+		codecs |= FREERDP_CODEC_JPEG;
+
+	shadow_congestion_set_codecs(client->congestion, codecs);
+	client->congestion->autoDetect = settings->NetworkAutoDetect;
+
 	client->activated = TRUE;
 	client->inLobby = client->mayView ? FALSE : TRUE;
 
@@ -319,6 +347,30 @@ void shadow_client_surface_frame_acknowledge(rdpShadowClient* client, UINT32 fra
 		ListDictionary_Remove(frameList, (void*) (size_t) frameId);
 		free(frame);
 	}
+
+	shadow_congestion_frame_acked(client->congestion, frameId, GetTickCount());
+}
+
+BOOL shadow_client_rtt_measure_response(rdpContext* context, UINT16 sequenceNumber)
+{
+	rdpShadowClient* client = (rdpShadowClient*) context;
+	rdpAutoDetect* autodetect = context->autodetect;
+
+	shadow_congestion_rtt_response(client->congestion, sequenceNumber,
+			autodetect->netCharAverageRTT, GetTickCount());
+
+	return TRUE;
+}
+
+BOOL shadow_client_bandwidth_measure_results(rdpContext* context, UINT16 sequenceNumber)
+{
+	rdpShadowClient* client = (rdpShadowClient*) context;
+	rdpAutoDetect* autodetect = context->autodetect;
+
+	shadow_congestion_bandwidth_results(client->congestion, sequenceNumber,
+			autodetect->bandwidthMeasureTimeDelta, autodetect->bandwidthMeasureByteCount, GetTickCount());
+
+	return TRUE;
 }
 
 int shadow_client_send_surface_frame_marker(rdpShadowClient* client, UINT32 action, UINT32 id)
@@ -345,6 +397,7 @@ int shadow_client_send_surface_bits(rdpShadowClient* client, rdpShadowSurface* s
 	BYTE* pSrcData;
 	int numMessages;
 	UINT32 frameId = 0;
+	UINT32 frameSize = 0;
 	rdpUpdate* update;
 	rdpContext* context;
 	rdpSettings* settings;
@@ -380,7 +433,7 @@ int shadow_client_send_surface_bits(rdpShadowClient* client, rdpShadowSurface* s
 	if (encoder->frameAck)
 		frameId = (UINT32) shadow_encoder_create_frame_id(encoder);
 
-	if (settings->RemoteFxCodec)
+	if (client->congestion->codec == FREERDP_CODEC_REMOTEFX)
 	{
 		RFX_RECT rect;
 		RFX_MESSAGE* messages;
@@ -394,11 +447,15 @@ int shadow_client_send_surface_bits(rdpShadowClient* client, rdpShadowSurface* s
 		rect.width = nWidth;
 		rect.height = nHeight;
 
+		/* image mode: every message stands alone and carries the headers */
+		if (!settings->RemoteFxCodec)
+			encoder->rfx->flags = 0x02; /* CODEC_MODE */
+
 		messages = rfx_encode_messages(encoder->rfx, &rect, 1, pSrcData,
 				surface->width, surface->height, nSrcStep, &numMessages,
 				settings->MultifragMaxRequestSize);
 
-		cmd.codecID = settings->RemoteFxCodecId;
+		cmd.codecID = settings->RemoteFxCodec ? settings->RemoteFxCodecId : settings->RemoteFxImageCodecId;
 
 		cmd.destLeft = 0;
 		cmd.destTop = 0;
@@ -412,11 +469,16 @@ int shadow_client_send_surface_bits(rdpShadowClient* client, rdpShadowSurface* s
 		for (i = 0; i < numMessages; i++)
 		{
 			Stream_SetPosition(s, 0);
+
+			if (!settings->RemoteFxCodec)
+				encoder->rfx->state = RFX_STATE_SEND_HEADERS;
+
 			rfx_write_message(encoder->rfx, s, &messages[i]);
 			rfx_message_free(encoder->rfx, &messages[i]);
 
 			cmd.bitmapDataLength = Stream_GetPosition(s);
 			cmd.bitmapData = Stream_Buffer(s);
+			frameSize += cmd.bitmapDataLength;
 
 			first = (i == 0) ? TRUE : FALSE;
 			last = ((i + 1) == numMessages) ? TRUE : FALSE;
@@ -429,7 +491,41 @@ int shadow_client_send_surface_bits(rdpShadowClient* client, rdpShadowSurface* s
 
 		free(messages);
 	}
-	else if (settings->NSCodec)
+	else if (client->congestion->codec == FREERDP_CODEC_JPEG)
+	{
+		BYTE* pDstData = NULL;
+		UINT32 DstSize = 0;
+
+		shadow_encoder_prepare(encoder, FREERDP_CODEC_JPEG);
+
+		pSrcData = &pSrcData[(nYSrc * nSrcStep) + (nXSrc * 4)];
+
+		if (jpeg_compress(encoder->jpeg, pSrcData, PIXEL_FORMAT_XRGB32, nSrcStep,
+				nWidth, nHeight, &pDstData, &DstSize) < 0)
+			return -1;
+
+		cmd.bpp = 32;
+		cmd.codecID = settings->JpegCodecId;
+		cmd.destLeft = nXSrc;
+		cmd.destTop = nYSrc;
+		cmd.destRight = cmd.destLeft + nWidth;
+		cmd.destBottom = cmd.destTop + nHeight;
+		cmd.width = nWidth;
+		cmd.height = nHeight;
+
+		cmd.bitmapDataLength = DstSize;
+		cmd.bitmapData = pDstData;
+		frameSize += cmd.bitmapDataLength;
+
+		first = TRUE;
+		last = TRUE;
+
+		if (!encoder->frameAck)
+			IFCALL(update->SurfaceBits, update->context, &cmd);
+		else
+			IFCALL(update->SurfaceFrameBits, update->context, &cmd, first, last, frameId);
+	}
+	else if (client->congestion->codec == FREERDP_CODEC_NSCODEC)
 	{
 		shadow_encoder_prepare(encoder, FREERDP_CODEC_NSCODEC);
 
@@ -451,6 +547,7 @@ int shadow_client_send_surface_bits(rdpShadowClient* client, rdpShadowSurface* s
 
 		cmd.bitmapDataLength = Stream_GetPosition(s);
 		cmd.bitmapData = Stream_Buffer(s);
+		frameSize += cmd.bitmapDataLength;
 
 		first = TRUE;
 		last = TRUE;
@@ -461,6 +558,8 @@ int shadow_client_send_surface_bits(rdpShadowClient* client, rdpShadowSurface* s
 			IFCALL(update->SurfaceFrameBits, update->context, &cmd, first, last, frameId);
 	}
 
+	shadow_congestion_frame_sent(client->congestion, frameId, frameSize, GetTickCount());
+
 	return 1;
 }
 
@@ -657,6 +756,8 @@ int shadow_client_send_bitmap_update(rdpShadowClient* client, rdpShadowSurface*
 
 	free(bitmapData);
 
+	shadow_congestion_frame_sent(client->congestion, 0, totalBitmapSize, GetTickCount());
+
 	return 1;
 }
 
@@ -717,7 +818,7 @@ int shadow_client_send_surface_update(rdpShadowClient* client)
 	//WLog_INFO(TAG, "shadow_client_send_surface_update: x: %d y: %d width: %d height: %d right: %d bottom: %d",
 	//	nXSrc, nYSrc, nWidth, nHeight, nXSrc + nWidth, nYSrc + nHeight);
 
-	if (settings->RemoteFxCodec || settings->NSCodec)
+	if (client->congestion->codec)
 	{
 		status = shadow_client_send_surface_bits(client, surface, nXSrc, nYSrc, nWidth, nHeight);
 	}
@@ -733,18 +834,9 @@ int shadow_client_send_surface_update(rdpShadowClient* client)
 
 int shadow_client_surface_update(rdpShadowClient* client, REGION16* region)
 {
-	int index;
-	int numRects = 0;
-	const RECTANGLE_16* rects;
-
 	EnterCriticalSection(&(client->lock));
 
-	rects = region16_rects(region, &numRects);
-
-	for (index = 0; index < numRects; index++)
-	{
-		region16_union_rect(&(client->invalidRegion), &(client->invalidRegion), &rects[index]);
-	}
+	region16_union(&(client->invalidRegion), &(client->invalidRegion), region);
 
 	LeaveCriticalSection(&(client->lock));
 
@@ -897,14 +989,68 @@ int shadow_client_subsystem_process_message(rdpShadowClient* client, wMessage* m
 	return 1;
 }
 
+/**
+ * Sends the auto-detection requests that are due, hands the quality
+ * decisions to the encoder and sends the updates held back until now.
+ * Those may be read from the surface while it is being captured again,
+ * but then the new damage will send them again.
+ */
+
+int shadow_client_check_congestion(rdpShadowClient* client)
+{
+	UINT32 now;
+	UINT32 probes;
+	BOOL pending;
+	rdpContext* context = (rdpContext*) client;
+	rdpAutoDetect* autodetect = context->autodetect;
+	rdpShadowEncoder* encoder = client->encoder;
+	rdpShadowCongestion* congestion = client->congestion;
+
+	now = GetTickCount();
+	probes = shadow_congestion_poll(congestion, now);
+
+	if (probes & SHADOW_CONGESTION_PROBE_RTT)
+		IFCALL(autodetect->RTTMeasureRequest, context, congestion->rttSequenceNumber);
+
+	if (probes & SHADOW_CONGESTION_PROBE_BANDWIDTH_START)
+		IFCALL(autodetect->BandwidthMeasureStart, context, congestion->bandwidthSequenceNumber);
+
+	if (probes & SHADOW_CONGESTION_PROBE_BANDWIDTH_STOP)
+		IFCALL(autodetect->BandwidthMeasureStop, context, congestion->bandwidthSequenceNumber);
+
+	encoder->fps = congestion->fps;
+
+	if (encoder->quality != congestion->level)
+		shadow_encoder_set_quality(encoder, congestion->level);
+
+	/* a frame should not take more than its share of the estimated bandwidth */
+	if (encoder->rfx && congestion->fps)
+		rfx_context_set_target_frame_size(encoder->rfx, congestion->bandwidth / congestion->fps);
+
+	EnterCriticalSection(&(client->lock));
+	pending = region16_is_empty(&(client->invalidRegion)) ? FALSE : TRUE;
+	LeaveCriticalSection(&(client->lock));
+
+	if (pending && shadow_congestion_can_send(congestion, now))
+	{
+		if (shadow_client_send_surface_update(client) < 0)
+			return -1;
+	}
+
+	return 1;
+}
+
 void* shadow_client_thread(rdpShadowClient* client)
 {
 	DWORD status;
 	DWORD nCount;
+	DWORD dwTimeout;
+	BOOL pending;
 	wMessage message;
 	HANDLE events[32];
 	HANDLE StopEvent;
-	HANDLE ClientEvent;
+	DWORD nClientEvents;
+	HANDLE ClientEvents[8];
 	HANDLE ChannelEvent;
 	HANDLE UpdateEvent;
 	freerdp_peer* peer;
@@ -937,9 +1083,12 @@ void* shadow_client_thread(rdpShadowClient* client)
 	peer->update->SuppressOutput = (pSuppressOutput) shadow_client_suppress_output;
 	peer->update->SurfaceFrameAcknowledge = (pSurfaceFrameAcknowledge) shadow_client_surface_frame_acknowledge;
 
+	peer->autodetect->RTTMeasureResponse = shadow_client_rtt_measure_response;
+	peer->autodetect->BandwidthMeasureResults = shadow_client_bandwidth_measure_results;
+
 	StopEvent = client->StopEvent;
 	UpdateEvent = subsystem->updateEvent;
-	ClientEvent = peer->GetEventHandle(peer);
+	nClientEvents = peer->GetEventHandles(peer, ClientEvents);
 	ChannelEvent = WTSVirtualChannelManagerGetEventHandle(client->vcm);
 
 	while (1)
@@ -947,11 +1096,23 @@ void* shadow_client_thread(rdpShadowClient* client)
 		nCount = 0;
 		events[nCount++] = StopEvent;
 		events[nCount++] = UpdateEvent;
-		events[nCount++] = ClientEvent;
+		CopyMemory(&events[nCount], ClientEvents, nClientEvents * sizeof(HANDLE));
+		nCount += nClientEvents;
 		events[nCount++] = ChannelEvent;
 		events[nCount++] = MessageQueue_Event(MsgPipe->Out);
 
-		status = WaitForMultipleObjects(nCount, events, FALSE, INFINITE);
+		dwTimeout = INFINITE;
+
+		if (client->activated)
+		{
+			EnterCriticalSection(&(client->lock));
+			pending = region16_is_empty(&(client->invalidRegion)) ? FALSE : TRUE;
+			LeaveCriticalSection(&(client->lock));
+
+			dwTimeout = shadow_congestion_timeout(client->congestion, GetTickCount(), pending);
+		}
+
+		status = WaitForMultipleObjects(nCount, events, FALSE, dwTimeout);
 
 		if (WaitForSingleObject(StopEvent, 0) == WAIT_OBJECT_0)
 		{
@@ -967,18 +1128,10 @@ void* shadow_client_thread(rdpShadowClient* client)
 		{
 			if (client->activated)
 			{
-				int index;
-				int numRects = 0;
-				const RECTANGLE_16* rects;
+				region16_union(&(client->invalidRegion), &(client->invalidRegion), &(subsystem->invalidRegion));
 
-				rects = region16_rects(&(subsystem->invalidRegion), &numRects);
-
-				for (index = 0; index < numRects; index++)
-				{
-					region16_union_rect(&(client->invalidRegion), &(client->invalidRegion), &rects[index]);
-				}
-
-				shadow_client_send_surface_update(client);
+				if (shadow_congestion_can_send(client->congestion, GetTickCount()))
+					shadow_client_send_surface_update(client);
 			}
 
 			EnterSynchronizationBarrier(&(subsystem->barrier), 0);
@@ -986,7 +1139,7 @@ void* shadow_client_thread(rdpShadowClient* client)
 			while (WaitForSingleObject(UpdateEvent, 0) == WAIT_OBJECT_0);
 		}
 
-		if (WaitForSingleObject(ClientEvent, 0) == WAIT_OBJECT_0)
+		if (WaitForMultipleObjects(nClientEvents, ClientEvents, FALSE, 0) != WAIT_TIMEOUT)
 		{
 			if (!peer->CheckFileDescriptor(peer))
 			{
@@ -1014,6 +1167,15 @@ void* shadow_client_thread(rdpShadowClient* client)
 				shadow_client_subsystem_process_message(client, &message);
 			}
 		}
+
+		if (client->activated)
+		{
+			if (shadow_client_check_congestion(client) < 0)
+			{
+				WLog_ERR(TAG, "Failed to send the pending surface update");
+				break;
+			}
+		}
 	}
 
 	peer->Disconnect(peer);
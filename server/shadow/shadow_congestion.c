@@ -0,0 +1,579 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ *
+ * Copyright 2014 Marc-Andre Moreau <marcandre.moreau@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <winpr/crt.h>
+#include <winpr/sysinfo.h>
+
+#include <freerdp/log.h>
+
+#include "shadow_congestion.h"
+
+#define TAG SERVER_TAG("shadow")
+
+/**
+ * Per-client congestion control
+ *
+ * The delivery rate is sampled each time a surface frame is acknowledged
+ * (bytes acknowledged since the frame was sent, over the time it took) and
+ * by the continuous bandwidth measurements of the network auto-detection.
+ * The bandwidth estimate is the maximum of the recent samples, and bounds
+ * the bytes allowed in flight to what the link drains within the base RTT
+ * plus a small latency margin, so that updates wait in the invalid region
+ * rather than in socket buffers. Frames that cannot be sent, or that are
+ * acknowledged late, make the encoder coarser: first the RemoteFX
+ * quantization, then the frame rate. Quiet intervals undo it the other way
+ * round, and a fast link eventually switches to NSCodec.
+ */
+
+#define SHADOW_CONGESTION_UPDATE_INTERVAL	200
+#define SHADOW_CONGESTION_PROBE_INTERVALS	3
+#define SHADOW_CONGESTION_LOSSLESS_INTERVALS	10
+#define SHADOW_CONGESTION_LATENCY_MARGIN	100
+#define SHADOW_CONGESTION_MIN_WINDOW		16384
+#define SHADOW_CONGESTION_BANDWIDTH_WINDOW	2000
+#define SHADOW_CONGESTION_BASE_RTT_WINDOW	10000
+#define SHADOW_CONGESTION_LOSSLESS_BANDWIDTH	12500000
+#define SHADOW_CONGESTION_RTT_INTERVAL		1000
+#define SHADOW_CONGESTION_BANDWIDTH_INTERVAL	2000
+#define SHADOW_CONGESTION_BANDWIDTH_PERIOD	500
+#define SHADOW_CONGESTION_PROBE_TIMEOUT		5000
+
+static void shadow_congestion_update_window(rdpShadowCongestion* congestion)
+{
+	UINT64 window;
+
+	if (!congestion->bandwidth)
+	{
+		congestion->window = 0;
+		return;
+	}
+
+	window = ((UINT64) congestion->bandwidth * (congestion->baseRTT + SHADOW_CONGESTION_LATENCY_MARGIN)) / 1000;
+
+	if (window < SHADOW_CONGESTION_MIN_WINDOW)
+		window = SHADOW_CONGESTION_MIN_WINDOW;
+
+	congestion->window = (UINT32) window;
+}
+
+static void shadow_congestion_add_sample(rdpShadowCongestion* congestion, UINT32 rate, UINT32 now)
+{
+	int index;
+	UINT32 bandwidth = 0;
+	rdpShadowCongestionSample* sample;
+
+	sample = &congestion->samples[congestion->sampleIndex];
+	congestion->sampleIndex = (congestion->sampleIndex + 1) % SHADOW_CONGESTION_BANDWIDTH_SAMPLES;
+
+	sample->rate = rate;
+	sample->time = now;
+
+	for (index = 0; index < SHADOW_CONGESTION_BANDWIDTH_SAMPLES; index++)
+	{
+		sample = &congestion->samples[index];
+
+		if (!sample->rate || ((now - sample->time) > SHADOW_CONGESTION_BANDWIDTH_WINDOW))
+			continue;
+
+		if (sample->rate > bandwidth)
+			bandwidth = sample->rate;
+	}
+
+	congestion->bandwidth = bandwidth;
+	shadow_congestion_update_window(congestion);
+}
+
+static void shadow_congestion_reset_samples(rdpShadowCongestion* congestion)
+{
+	ZeroMemory(congestion->samples, sizeof(congestion->samples));
+	congestion->sampleIndex = 0;
+}
+
+static void shadow_congestion_rtt_sample(rdpShadowCongestion* congestion, UINT32 rtt, UINT32 now)
+{
+	if (!congestion->baseRTTTime || (rtt <= congestion->baseRTT) ||
+			((now - congestion->baseRTTTime) > SHADOW_CONGESTION_BASE_RTT_WINDOW))
+	{
+		congestion->baseRTT = rtt;
+		congestion->baseRTTTime = now;
+		shadow_congestion_update_window(congestion);
+	}
+}
+
+static void shadow_congestion_select_codec(rdpShadowCongestion* congestion)
+{
+	UINT32 codecs = congestion->codecs;
+
+	if ((codecs & FREERDP_CODEC_NSCODEC) &&
+			(congestion->losslessIntervals >= SHADOW_CONGESTION_LOSSLESS_INTERVALS))
+		congestion->codec = FREERDP_CODEC_NSCODEC;
+	else if (codecs & FREERDP_CODEC_REMOTEFX)
+		congestion->codec = FREERDP_CODEC_REMOTEFX;
+	else if (codecs & FREERDP_CODEC_JPEG)
+		congestion->codec = FREERDP_CODEC_JPEG;
+	else if (codecs & FREERDP_CODEC_NSCODEC)
+		congestion->codec = FREERDP_CODEC_NSCODEC;
+	else
+		congestion->codec = 0;
+}
+
+static void shadow_congestion_update(rdpShadowCongestion* congestion, UINT32 now)
+{
+	int fps;
+	int level;
+	UINT64 rate;
+	UINT32 codec;
+	UINT32 elapsed;
+	BOOL headroom;
+	BOOL congested;
+
+	level = congestion->level;
+	fps = congestion->fps;
+	codec = congestion->codec;
+	elapsed = now - congestion->updateTime;
+
+	congested = (congestion->framesBlocked || congestion->framesLate) ? TRUE : FALSE;
+
+	/* without frame acknowledgement, compare the sending rate with the measured bandwidth */
+
+	if (!congested && congestion->bandwidth && congestion->bytesUntracked && elapsed)
+	{
+		if ((((UINT64) congestion->bytesUntracked * 1000) / elapsed) > congestion->bandwidth)
+			congested = TRUE;
+	}
+
+	if (congested)
+	{
+		congestion->quietIntervals = 0;
+
+		if (congestion->level < (SHADOW_CONGESTION_QUALITY_LEVELS - 1))
+		{
+			congestion->level++;
+		}
+		else
+		{
+			congestion->fps = (congestion->fps * 3) / 4;
+
+			if (congestion->bandwidth && congestion->averageFrameSize)
+			{
+				fps = (int) (congestion->bandwidth / congestion->averageFrameSize);
+
+				if (fps < congestion->fps)
+					congestion->fps = fps;
+			}
+
+			if (congestion->fps < 1)
+				congestion->fps = 1;
+		}
+	}
+	else if (congestion->framesSent)
+	{
+		/* step up at once while the sending rate leaves room, or probe from time to time */
+
+		headroom = FALSE;
+
+		if (congestion->bandwidth && elapsed)
+		{
+			rate = ((UINT64) congestion->bytesSent * 1000) / elapsed;
+			headroom = (((rate * 5) / 4) < congestion->bandwidth) ? TRUE : FALSE;
+		}
+
+		if (headroom || (++congestion->quietIntervals >= SHADOW_CONGESTION_PROBE_INTERVALS))
+		{
+			congestion->quietIntervals = 0;
+
+			if (congestion->fps < congestion->maxFps)
+			{
+				congestion->fps += (congestion->fps / 4) + 1;
+
+				if (congestion->fps > congestion->maxFps)
+					congestion->fps = congestion->maxFps;
+			}
+			else if (congestion->level > 0)
+			{
+				congestion->level--;
+			}
+		}
+	}
+
+	if (!congested && !congestion->level && (congestion->fps == congestion->maxFps) &&
+			(congestion->bandwidth >= SHADOW_CONGESTION_LOSSLESS_BANDWIDTH))
+		congestion->losslessIntervals++;
+	else
+		congestion->losslessIntervals = 0;
+
+	shadow_congestion_select_codec(congestion);
+
+	if ((level != congestion->level) || (fps != congestion->fps) || (codec != congestion->codec))
+	{
+		WLog_DBG(TAG, "quality level %d fps %d codec 0x%04X: bandwidth %u kbps rtt %u ms latency %u ms window %u",
+				congestion->level, congestion->fps, congestion->codec, congestion->bandwidth * 8 / 1000,
+				congestion->baseRTT, congestion->latency, congestion->window);
+	}
+
+	congestion->framesSent = 0;
+	congestion->framesBlocked = 0;
+	congestion->framesLate = 0;
+	congestion->bytesSent = 0;
+	congestion->bytesUntracked = 0;
+	congestion->updateTime = now;
+}
+
+/**
+ * Whether a frame may be sent now: the frame rate interval has elapsed and
+ * the bytes in flight are below the window. Until the bandwidth is known,
+ * at most two frames are in flight. Nothing is sent either while the oldest
+ * frame is overdue, which is the first sign of a bandwidth drop.
+ */
+
+BOOL shadow_congestion_can_send(rdpShadowCongestion* congestion, UINT32 now)
+{
+	UINT32 due;
+	BOOL blocked = FALSE;
+	rdpShadowCongestionFrame* frame;
+
+	if ((now - congestion->lastFrameTime) < (UINT32) (1000 / congestion->fps))
+		return FALSE;
+
+	if (congestion->frameCount >= SHADOW_CONGESTION_MAX_FRAMES)
+		blocked = TRUE;
+	else if (congestion->window)
+		blocked = (congestion->bytesInFlight >= congestion->window) ? TRUE : FALSE;
+	else
+		blocked = (congestion->frameCount >= 2) ? TRUE : FALSE;
+
+	if (!blocked && congestion->frameCount && congestion->bandwidth)
+	{
+		frame = &congestion->frames[congestion->frameHead];
+		due = congestion->baseRTT + SHADOW_CONGESTION_LATENCY_MARGIN +
+				(UINT32) (((UINT64) frame->bytes * 1000) / congestion->bandwidth);
+
+		if ((now - frame->sendTime) > due)
+			blocked = TRUE;
+	}
+
+	if (blocked)
+	{
+		congestion->framesBlocked++;
+		congestion->bandwidthBlocked = TRUE;
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/**
+ * Accounts for a frame of the given encoded size. Frames sent without a
+ * frame identifier are never acknowledged and are not tracked in flight.
+ */
+
+int shadow_congestion_frame_sent(rdpShadowCongestion* congestion, UINT32 frameId, UINT32 bytes, UINT32 now)
+{
+	rdpShadowCongestionFrame* frame;
+
+	congestion->framesSent++;
+	congestion->bytesSent += bytes;
+	congestion->lastFrameTime = now;
+
+	if (!congestion->averageFrameSize)
+		congestion->averageFrameSize = bytes;
+	else
+		congestion->averageFrameSize = ((congestion->averageFrameSize * 7) + bytes) / 8;
+
+	if (!frameId)
+	{
+		congestion->bytesUntracked += bytes;
+		return 1;
+	}
+
+	if (congestion->frameCount >= SHADOW_CONGESTION_MAX_FRAMES)
+	{
+		/* the oldest frame will not be acknowledged anymore */
+
+		frame = &congestion->frames[congestion->frameHead];
+		congestion->bytesInFlight -= frame->bytes;
+		congestion->frameHead = (congestion->frameHead + 1) % SHADOW_CONGESTION_MAX_FRAMES;
+		congestion->frameCount--;
+	}
+
+	if (!congestion->bytesInFlight)
+		congestion->deliveredTime = now;
+
+	frame = &congestion->frames[(congestion->frameHead + congestion->frameCount) % SHADOW_CONGESTION_MAX_FRAMES];
+
+	frame->frameId = frameId;
+	frame->bytes = bytes;
+	frame->sendTime = now;
+	frame->delivered = congestion->delivered;
+	frame->deliveredTime = congestion->deliveredTime;
+	frame->appLimited = (congestion->window && ((congestion->bytesInFlight + bytes) < congestion->window)) ? TRUE : FALSE;
+
+	congestion->bytesInFlight += bytes;
+	congestion->frameCount++;
+
+	return 1;
+}
+
+/**
+ * Acknowledges a frame, and all the frames sent before it. Returns 0 for
+ * an unknown frame identifier.
+ */
+
+int shadow_congestion_frame_acked(rdpShadowCongestion* congestion, UINT32 frameId, UINT32 now)
+{
+	int index;
+	int count;
+	UINT32 rate;
+	UINT32 delay;
+	UINT32 interval;
+	rdpShadowCongestionFrame acked;
+	rdpShadowCongestionFrame* frame;
+
+	for (count = 0; count < congestion->frameCount; count++)
+	{
+		index = (congestion->frameHead + count) % SHADOW_CONGESTION_MAX_FRAMES;
+
+		if (congestion->frames[index].frameId == frameId)
+			break;
+	}
+
+	if (count >= congestion->frameCount)
+		return 0;
+
+	for (count++; count > 0; count--)
+	{
+		frame = &congestion->frames[congestion->frameHead];
+
+		congestion->delivered += frame->bytes;
+		congestion->bytesInFlight -= frame->bytes;
+		congestion->frameHead = (congestion->frameHead + 1) % SHADOW_CONGESTION_MAX_FRAMES;
+		congestion->frameCount--;
+	}
+
+	CopyMemory(&acked, frame, sizeof(rdpShadowCongestionFrame));
+	congestion->deliveredTime = now;
+
+	interval = now - acked.deliveredTime;
+	rate = (UINT32) (((congestion->delivered - acked.delivered) * 1000) / (interval ? interval : 1));
+
+	delay = now - acked.sendTime;
+
+	if (!congestion->latency)
+		congestion->latency = delay;
+	else
+		congestion->latency = ((congestion->latency * 7) + delay) / 8;
+
+	shadow_congestion_rtt_sample(congestion, delay, now);
+
+	if (delay > (congestion->baseRTT + SHADOW_CONGESTION_LATENCY_MARGIN))
+	{
+		/* the frame waited in a queue: the link is slower than estimated */
+
+		congestion->framesLate++;
+
+		if (!acked.appLimited)
+			shadow_congestion_reset_samples(congestion);
+	}
+
+	/* an application limited sample tells how much was sent, and bursts of
+	 * the link may inflate it unless it spans enough data */
+
+	if (!acked.appLimited || ((rate > congestion->bandwidth) &&
+			((congestion->delivered - acked.delivered) >= SHADOW_CONGESTION_MIN_WINDOW)))
+		shadow_congestion_add_sample(congestion, rate, now);
+
+	return 1;
+}
+
+int shadow_congestion_rtt_response(rdpShadowCongestion* congestion, UINT16 sequenceNumber, UINT32 rtt, UINT32 now)
+{
+	if (!congestion->rttPending || (sequenceNumber != congestion->rttSequenceNumber))
+		return 0;
+
+	congestion->rttPending = FALSE;
+	shadow_congestion_rtt_sample(congestion, rtt, now);
+
+	return 1;
+}
+
+/**
+ * Bandwidth measure results, as counted by the client between the start and
+ * stop requests. Measurements during which the window never filled up only
+ * tell how much was sent, and may only raise the estimate.
+ */
+
+int shadow_congestion_bandwidth_results(rdpShadowCongestion* congestion, UINT16 sequenceNumber,
+		UINT32 timeDelta, UINT32 byteCount, UINT32 now)
+{
+	UINT32 rate;
+
+	if (!congestion->bandwidthPending || (sequenceNumber != congestion->bandwidthSequenceNumber))
+		return 0;
+
+	congestion->bandwidthPending = FALSE;
+
+	if (!timeDelta)
+		return 1;
+
+	rate = (UINT32) (((UINT64) byteCount * 1000) / timeDelta);
+
+	if (congestion->bandwidthBlocked || (rate > congestion->bandwidth))
+		shadow_congestion_add_sample(congestion, rate, now);
+
+	return 1;
+}
+
+/**
+ * Updates the quality decisions once per interval and returns the
+ * auto-detection requests that are due, with the sequence numbers to use in
+ * rttSequenceNumber and bandwidthSequenceNumber.
+ */
+
+UINT32 shadow_congestion_poll(rdpShadowCongestion* congestion, UINT32 now)
+{
+	UINT32 probes = 0;
+
+	if (congestion->autoDetect)
+	{
+		if ((!congestion->rttPending && ((now - congestion->rttRequestTime) >= SHADOW_CONGESTION_RTT_INTERVAL)) ||
+				((now - congestion->rttRequestTime) >= SHADOW_CONGESTION_PROBE_TIMEOUT))
+		{
+			congestion->rttSequenceNumber = congestion->sequenceNumber++;
+			congestion->rttRequestTime = now;
+			congestion->rttPending = TRUE;
+			probes |= SHADOW_CONGESTION_PROBE_RTT;
+		}
+
+		if (congestion->bandwidthStarted)
+		{
+			if ((now - congestion->bandwidthTime) >= SHADOW_CONGESTION_BANDWIDTH_PERIOD)
+			{
+				congestion->bandwidthStarted = FALSE;
+				congestion->bandwidthPending = TRUE;
+				congestion->bandwidthTime = now;
+				probes |= SHADOW_CONGESTION_PROBE_BANDWIDTH_STOP;
+			}
+		}
+		else if ((!congestion->bandwidthPending && ((now - congestion->bandwidthTime) >= SHADOW_CONGESTION_BANDWIDTH_INTERVAL)) ||
+				((now - congestion->bandwidthTime) >= SHADOW_CONGESTION_PROBE_TIMEOUT))
+		{
+			congestion->bandwidthSequenceNumber = congestion->sequenceNumber++;
+			congestion->bandwidthStarted = TRUE;
+			congestion->bandwidthPending = FALSE;
+			congestion->bandwidthBlocked = FALSE;
+			congestion->bandwidthTime = now;
+			probes |= SHADOW_CONGESTION_PROBE_BANDWIDTH_START;
+		}
+	}
+
+	if ((now - congestion->updateTime) >= SHADOW_CONGESTION_UPDATE_INTERVAL)
+		shadow_congestion_update(congestion, now);
+
+	return probes;
+}
+
+static UINT32 shadow_congestion_remaining(UINT32 elapsed, UINT32 interval)
+{
+	return (elapsed < interval) ? (interval - elapsed) : 0;
+}
+
+/**
+ * Milliseconds until shadow_congestion_poll has something to do, or until
+ * the next frame may be sent when updates are pending.
+ */
+
+UINT32 shadow_congestion_timeout(rdpShadowCongestion* congestion, UINT32 now, BOOL pending)
+{
+	UINT32 timeout;
+	UINT32 remaining;
+
+	timeout = shadow_congestion_remaining(now - congestion->updateTime, SHADOW_CONGESTION_UPDATE_INTERVAL);
+
+	if (congestion->autoDetect)
+	{
+		remaining = shadow_congestion_remaining(now - congestion->rttRequestTime,
+				congestion->rttPending ? SHADOW_CONGESTION_PROBE_TIMEOUT : SHADOW_CONGESTION_RTT_INTERVAL);
+
+		if (remaining < timeout)
+			timeout = remaining;
+
+		if (congestion->bandwidthStarted)
+			remaining = shadow_congestion_remaining(now - congestion->bandwidthTime, SHADOW_CONGESTION_BANDWIDTH_PERIOD);
+		else
+			remaining = shadow_congestion_remaining(now - congestion->bandwidthTime,
+					congestion->bandwidthPending ? SHADOW_CONGESTION_PROBE_TIMEOUT : SHADOW_CONGESTION_BANDWIDTH_INTERVAL);
+
+		if (remaining < timeout)
+			timeout = remaining;
+	}
+
+	if (pending)
+	{
+		remaining = shadow_congestion_remaining(now - congestion->lastFrameTime, 1000 / congestion->fps);
+
+		if (remaining < timeout)
+			timeout = remaining;
+	}
+
+	return timeout;
+}
+
+void shadow_congestion_set_codecs(rdpShadowCongestion* congestion, UINT32 codecs)
+{
+	congestion->codecs = codecs;
+	congestion->losslessIntervals = 0;
+
+	shadow_congestion_select_codec(congestion);
+}
+
+rdpShadowCongestion* shadow_congestion_new(UINT32 codecs)
+{
+	UINT32 now;
+	rdpShadowCongestion* congestion;
+
+	congestion = (rdpShadowCongestion*) calloc(1, sizeof(rdpShadowCongestion));
+
+	if (!congestion)
+		return NULL;
+
+	now = GetTickCount();
+
+	congestion->fps = 16;
+	congestion->maxFps = 32;
+	congestion->codecs = codecs;
+	congestion->updateTime = now;
+	congestion->lastFrameTime = now - 1000;
+	congestion->rttRequestTime = now - SHADOW_CONGESTION_RTT_INTERVAL;
+	congestion->bandwidthTime = now - SHADOW_CONGESTION_BANDWIDTH_INTERVAL;
+
+	shadow_congestion_select_codec(congestion);
+
+	return congestion;
+}
+
+void shadow_congestion_free(rdpShadowCongestion* congestion)
+{
+	if (!congestion)
+		return;
+
+	free(congestion);
+}
@@ -0,0 +1,130 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ *
+ * Copyright 2014 Marc-Andre Moreau <marcandre.moreau@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FREERDP_SHADOW_SERVER_CONGESTION_H
+#define FREERDP_SHADOW_SERVER_CONGESTION_H
+
+#include <freerdp/server/shadow.h>
+
+#include <winpr/crt.h>
+
+#include <freerdp/codecs.h>
+
+#define SHADOW_CONGESTION_QUALITY_LEVELS	7
+#define SHADOW_CONGESTION_MAX_FRAMES		64
+#define SHADOW_CONGESTION_BANDWIDTH_SAMPLES	16
+
+#define SHADOW_CONGESTION_PROBE_RTT		0x00000001
+#define SHADOW_CONGESTION_PROBE_BANDWIDTH_START	0x00000002
+#define SHADOW_CONGESTION_PROBE_BANDWIDTH_STOP	0x00000004
+
+struct rdp_shadow_congestion_frame
+{
+	UINT32 frameId;
+	UINT32 bytes;
+	UINT32 sendTime;
+	UINT64 delivered;
+	UINT32 deliveredTime;
+	BOOL appLimited;
+};
+typedef struct rdp_shadow_congestion_frame rdpShadowCongestionFrame;
+
+struct rdp_shadow_congestion_sample
+{
+	UINT32 rate;
+	UINT32 time;
+};
+typedef struct rdp_shadow_congestion_sample rdpShadowCongestionSample;
+
+struct rdp_shadow_congestion
+{
+	/* outputs, read by the encoder */
+	int level;
+	int fps;
+	int maxFps;
+	UINT32 codecs;
+	UINT32 codec;
+
+	/* network estimates */
+	UINT32 bandwidth; /* bytes per second */
+	UINT32 baseRTT; /* milliseconds */
+	UINT32 baseRTTTime;
+	UINT32 latency; /* smoothed frame acknowledgement delay, milliseconds */
+	UINT32 window; /* bytes allowed in flight */
+
+	/* frames in flight, oldest first */
+	rdpShadowCongestionFrame frames[SHADOW_CONGESTION_MAX_FRAMES];
+	int frameHead;
+	int frameCount;
+	UINT32 bytesInFlight;
+	UINT64 delivered;
+	UINT32 deliveredTime;
+	UINT32 lastFrameTime;
+	UINT32 averageFrameSize;
+
+	rdpShadowCongestionSample samples[SHADOW_CONGESTION_BANDWIDTH_SAMPLES];
+	int sampleIndex;
+
+	/* statistics of the current update interval */
+	UINT32 updateTime;
+	UINT32 framesSent;
+	UINT32 framesBlocked;
+	UINT32 framesLate;
+	UINT32 bytesSent;
+	UINT32 bytesUntracked;
+	int quietIntervals;
+	int losslessIntervals;
+
+	/* continuous network auto-detection */
+	BOOL autoDetect;
+	UINT16 sequenceNumber;
+	UINT16 rttSequenceNumber;
+	UINT32 rttRequestTime;
+	BOOL rttPending;
+	UINT16 bandwidthSequenceNumber;
+	UINT32 bandwidthTime;
+	BOOL bandwidthStarted;
+	BOOL bandwidthPending;
+	BOOL bandwidthBlocked;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+BOOL shadow_congestion_can_send(rdpShadowCongestion* congestion, UINT32 now);
+int shadow_congestion_frame_sent(rdpShadowCongestion* congestion, UINT32 frameId, UINT32 bytes, UINT32 now);
+int shadow_congestion_frame_acked(rdpShadowCongestion* congestion, UINT32 frameId, UINT32 now);
+
+int shadow_congestion_rtt_response(rdpShadowCongestion* congestion, UINT16 sequenceNumber, UINT32 rtt, UINT32 now);
+int shadow_congestion_bandwidth_results(rdpShadowCongestion* congestion, UINT16 sequenceNumber,
+		UINT32 timeDelta, UINT32 byteCount, UINT32 now);
+
+UINT32 shadow_congestion_poll(rdpShadowCongestion* congestion, UINT32 now);
+UINT32 shadow_congestion_timeout(rdpShadowCongestion* congestion, UINT32 now, BOOL pending);
+
+void shadow_congestion_set_codecs(rdpShadowCongestion* congestion, UINT32 codecs);
+
+rdpShadowCongestion* shadow_congestion_new(UINT32 codecs);
+void shadow_congestion_free(rdpShadowCongestion* congestion);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FREERDP_SHADOW_SERVER_CONGESTION_H */
@@ -24,28 +24,35 @@
 
 #include "shadow_encoder.h"
 
-int shadow_encoder_create_frame_id(rdpShadowEncoder* encoder)
+int shadow_encoder_set_quality(rdpShadowEncoder* encoder, int level)
 {
-	UINT32 frameId;
-	int inFlightFrames;
-	SURFACE_FRAME* frame;
+	RFX_CONTEXT* rfx = encoder->rfx;
 
-	inFlightFrames = ListDictionary_Count(encoder->frameList);
+	if (level < 0)
+		level = 0;
 
-	if (inFlightFrames > encoder->frameAck)
-	{
-		encoder->fps = (100 / (inFlightFrames + 1) * encoder->maxFps) / 100;
-	}
-	else
-	{
-		encoder->fps += 2;
+	if (level >= SHADOW_CONGESTION_QUALITY_LEVELS)
+		level = SHADOW_CONGESTION_QUALITY_LEVELS - 1;
 
-		if (encoder->fps > encoder->maxFps)
-			encoder->fps = encoder->maxFps;
-	}
+	encoder->quality = level;
+
+	/* each quality level takes a tenth off the negotiated JPEG quality */
+	if (encoder->jpeg)
+		jpeg_context_set_quality(encoder->jpeg, encoder->jpegQuality - (encoder->jpegQuality * level) / 10);
+
+	if (!rfx)
+		return 1;
 
-	if (encoder->fps < 1)
-		encoder->fps = 1;
+	/* the quality levels are spread evenly over the RemoteFX quantization scales */
+	rfx_context_set_quant_scale(rfx, level * RFX_QUANT_SCALE_MAX / (SHADOW_CONGESTION_QUALITY_LEVELS - 1));
+
+	return 1;
+}
+
+int shadow_encoder_create_frame_id(rdpShadowEncoder* encoder)
+{
+	UINT32 frameId;
+	SURFACE_FRAME* frame;
 
 	frame = (SURFACE_FRAME*) malloc(sizeof(SURFACE_FRAME));
 
@@ -128,6 +135,10 @@ int shadow_encoder_init_rfx(rdpShadowEncoder* encoder)
 	encoder->rfx->height = encoder->height;
 
 	rfx_context_set_pixel_format(encoder->rfx, RDP_PIXEL_FORMAT_B8G8R8A8);
+	rfx_context_set_adaptive_quantization(encoder->rfx, TRUE);
+
+	if (shadow_encoder_set_quality(encoder, encoder->quality) < 0)
+		return -1;
 
 	if (!encoder->frameList)
 	{
@@ -174,6 +185,36 @@ int shadow_encoder_init_nsc(rdpShadowEncoder* encoder)
 	return 1;
 }
 
+int shadow_encoder_init_jpeg(rdpShadowEncoder* encoder)
+{
+	rdpContext* context = (rdpContext*) encoder->client;
+	rdpSettings* settings = context->settings;
+
+	if (!encoder->jpeg)
+		encoder->jpeg = jpeg_context_new();
+
+	if (!encoder->jpeg)
+		return -1;
+
+	encoder->jpegQuality = settings->JpegQuality ? settings->JpegQuality : 75;
+
+	if (shadow_encoder_set_quality(encoder, encoder->quality) < 0)
+		return -1;
+
+	if (!encoder->frameList)
+	{
+		encoder->fps = 16;
+		encoder->maxFps = 32;
+		encoder->frameId = 0;
+		encoder->frameList = ListDictionary_New(TRUE);
+		encoder->frameAck = settings->SurfaceFrameMarkerEnabled;
+	}
+
+	encoder->codecs |= FREERDP_CODEC_JPEG;
+
+	return 1;
+}
+
 int shadow_encoder_init_planar(rdpShadowEncoder* encoder)
 {
 	DWORD planarFlags = 0;
@@ -266,6 +307,25 @@ int shadow_encoder_uninit_nsc(rdpShadowEncoder* encoder)
 	return 1;
 }
 
+int shadow_encoder_uninit_jpeg(rdpShadowEncoder* encoder)
+{
+	if (encoder->jpeg)
+	{
+		jpeg_context_free(encoder->jpeg);
+		encoder->jpeg = NULL;
+	}
+
+	if (encoder->frameList)
+	{
+		ListDictionary_Free(encoder->frameList);
+		encoder->frameList = NULL;
+	}
+
+	encoder->codecs &= ~FREERDP_CODEC_JPEG;
+
+	return 1;
+}
+
 int shadow_encoder_uninit_planar(rdpShadowEncoder* encoder)
 {
 	if (encoder->planar)
@@ -312,6 +372,11 @@ int shadow_encoder_uninit(rdpShadowEncoder* encoder)
 		shadow_encoder_uninit_nsc(encoder);
 	}
 
+	if (encoder->codecs & FREERDP_CODEC_JPEG)
+	{
+		shadow_encoder_uninit_jpeg(encoder);
+	}
+
 	if (encoder->codecs & FREERDP_CODEC_PLANAR)
 	{
 		shadow_encoder_uninit_planar(encoder);
@@ -368,6 +433,14 @@ int shadow_encoder_prepare(rdpShadowEncoder* encoder, UINT32 codecs)
 			return -1;
 	}
 
+	if ((codecs & FREERDP_CODEC_JPEG) && !(encoder->codecs & FREERDP_CODEC_JPEG))
+	{
+		status = shadow_encoder_init_jpeg(encoder);
+
+		if (status < 0)
+			return -1;
+	}
+
 	if ((codecs & FREERDP_CODEC_PLANAR) && !(encoder->codecs & FREERDP_CODEC_PLANAR))
 	{
 		status = shadow_encoder_init_planar(encoder);
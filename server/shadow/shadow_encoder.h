@@ -47,11 +47,14 @@ struct rdp_shadow_encoder
 
 	RFX_CONTEXT* rfx;
 	NSC_CONTEXT* nsc;
+	JPEG_CONTEXT* jpeg;
 	BITMAP_PLANAR_CONTEXT* planar;
 	BITMAP_INTERLEAVED_CONTEXT* interleaved;
 
 	int fps;
 	int maxFps;
+	int quality;
+	int jpegQuality;
 	BOOL frameAck;
 	UINT32 frameId;
 	wListDictionary* frameList;
@@ -64,6 +67,7 @@ extern "C" {
 int shadow_encoder_reset(rdpShadowEncoder* encoder);
 int shadow_encoder_prepare(rdpShadowEncoder* encoder, UINT32 codecs);
 int shadow_encoder_create_frame_id(rdpShadowEncoder* encoder);
+int shadow_encoder_set_quality(rdpShadowEncoder* encoder, int level);
 
 rdpShadowEncoder* shadow_encoder_new(rdpShadowClient* client);
 void shadow_encoder_free(rdpShadowEncoder* encoder);
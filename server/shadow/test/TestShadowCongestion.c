@@ -0,0 +1,448 @@
+
+#include <winpr/crt.h>
+#include <winpr/sysinfo.h>
+
+#include <freerdp/log.h>
+
+#include "shadow_congestion.h"
+
+#define TEST_MESSAGE_FRAME		1
+#define TEST_MESSAGE_RTT_REQUEST	2
+#define TEST_MESSAGE_BANDWIDTH_START	3
+#define TEST_MESSAGE_BANDWIDTH_STOP	4
+
+#define TEST_MESSAGE_HEADER		24
+#define TEST_CAPTURE_RATE		30
+#define TEST_LINK_DELAY			10
+#define TEST_LINK_BURST			16384
+#define TEST_PHASE_TIME			3000
+#define TEST_SETTLE_TIME		1500
+#define TEST_MAX_LATENCY		400
+#define TEST_MAX_TRANSITION_LATENCY	2000
+#define TEST_MAX_MESSAGES		4096
+#define TEST_MAX_FRAMES			4096
+
+/* link rates of the successive phases, in bytes per second */
+
+static const UINT32 test_link_rates[] = { 2500000, 125000, 1000000 };
+
+/* encoded frame size at each quality level */
+
+static const UINT32 test_frame_sizes[SHADOW_CONGESTION_QUALITY_LEVELS] =
+{
+	40000, 32000, 24000, 16000, 11000, 8000, 6000
+};
+
+struct test_message
+{
+	UINT32 type;
+	UINT32 id;
+	UINT32 level;
+	UINT32 time;
+	UINT32 remaining;
+	UINT32 arrival;
+};
+
+/**
+ * One-way link shaped by a token bucket, with a fixed propagation delay,
+ * advanced a millisecond at a time. Messages go out in order and reach the
+ * client once their last byte has crossed the link.
+ */
+
+struct test_link
+{
+	UINT32 rate;
+	double tokens;
+	int count;
+	int transmitted;
+	int delivered;
+	UINT32 delayLine[TEST_LINK_DELAY];
+	struct test_message messages[TEST_MAX_MESSAGES];
+};
+
+struct test_frame
+{
+	UINT32 sendTime;
+	UINT32 latency;
+	int level;
+};
+
+struct test_client
+{
+	BOOL counting;
+	UINT32 byteCount;
+	UINT32 countStart;
+	int frameCount;
+	struct test_frame frames[TEST_MAX_FRAMES];
+};
+
+static int test_link_send(struct test_link* link, UINT32 type, UINT32 id, UINT32 length, UINT32 level, UINT32 now)
+{
+	struct test_message* message;
+
+	if (link->count >= TEST_MAX_MESSAGES)
+		return -1;
+
+	message = &link->messages[link->count++];
+	message->type = type;
+	message->id = id;
+	message->level = level;
+	message->time = now;
+	message->remaining = TEST_MESSAGE_HEADER + length;
+
+	return 0;
+}
+
+/**
+ * Transmits what the tokens of a millisecond allow, returns the number of
+ * bytes reaching the client in that millisecond.
+ */
+
+static UINT32 test_link_advance(struct test_link* link, UINT32 now)
+{
+	UINT32 length;
+	UINT32 arrived;
+	UINT32 sent = 0;
+	UINT32* slot;
+	struct test_message* message;
+
+	link->tokens += ((double) link->rate) / 1000;
+
+	if (link->tokens > TEST_LINK_BURST)
+		link->tokens = TEST_LINK_BURST;
+
+	while ((link->transmitted < link->count) && (link->tokens >= 1))
+	{
+		message = &link->messages[link->transmitted];
+		length = ((UINT32) link->tokens < message->remaining) ? (UINT32) link->tokens : message->remaining;
+
+		message->remaining -= length;
+		link->tokens -= length;
+		sent += length;
+
+		if (!message->remaining)
+		{
+			message->arrival = now + TEST_LINK_DELAY;
+			link->transmitted++;
+		}
+	}
+
+	slot = &link->delayLine[now % TEST_LINK_DELAY];
+	arrived = *slot;
+	*slot = sent;
+
+	return arrived;
+}
+
+/**
+ * The client side: acknowledges frames, answers RTT requests and counts the
+ * bytes received between the bandwidth measure start and stop requests. Its
+ * answers reach the server without delay.
+ */
+
+static void test_client_receive(struct test_client* client, struct test_link* link,
+		rdpShadowCongestion* congestion, UINT32 arrived, UINT32 now)
+{
+	struct test_frame* frame;
+	struct test_message* message;
+
+	if (client->counting)
+		client->byteCount += arrived;
+
+	while ((link->delivered < link->transmitted) &&
+			((INT32) (now - link->messages[link->delivered].arrival) >= 0))
+	{
+		message = &link->messages[link->delivered++];
+
+		if (message->type == TEST_MESSAGE_FRAME)
+		{
+			if (client->frameCount < TEST_MAX_FRAMES)
+			{
+				frame = &client->frames[client->frameCount++];
+				frame->sendTime = message->time;
+				frame->latency = now - message->time;
+				frame->level = (int) message->level;
+			}
+
+			shadow_congestion_frame_acked(congestion, message->id, now);
+		}
+		else if (message->type == TEST_MESSAGE_RTT_REQUEST)
+		{
+			shadow_congestion_rtt_response(congestion, (UINT16) message->id, now - message->time, now);
+		}
+		else if (message->type == TEST_MESSAGE_BANDWIDTH_START)
+		{
+			client->counting = TRUE;
+			client->byteCount = 0;
+			client->countStart = now;
+		}
+		else if (message->type == TEST_MESSAGE_BANDWIDTH_STOP)
+		{
+			client->counting = FALSE;
+			shadow_congestion_bandwidth_results(congestion, (UINT16) message->id,
+					now - client->countStart, client->byteCount, now);
+		}
+	}
+}
+
+/**
+ * Streams frames captured at a fixed rate through a link whose bandwidth
+ * drops and recovers, on a virtual clock. Once the controller has settled
+ * in each phase, no frame may take longer than TEST_MAX_LATENCY to arrive,
+ * and the quality must follow the bandwidth.
+ */
+
+static int test_congestion_link(void)
+{
+	int status = -1;
+	int phase;
+	int index;
+	int phases;
+	int count[3];
+	int levels[3];
+	UINT32 worst[3];
+	UINT32 peak = 0;
+	UINT32 now;
+	UINT32 size;
+	UINT32 start;
+	UINT32 probes;
+	UINT32 elapsed;
+	UINT32 arrived;
+	UINT32 duration;
+	UINT32 frameId = 0;
+	UINT32 nextCapture;
+	BOOL pending = FALSE;
+	struct test_link* link;
+	struct test_client* client;
+	struct test_frame* frame;
+	rdpShadowCongestion* congestion;
+
+	phases = sizeof(test_link_rates) / sizeof(test_link_rates[0]);
+	duration = phases * TEST_PHASE_TIME;
+
+	link = (struct test_link*) calloc(1, sizeof(struct test_link));
+	client = (struct test_client*) calloc(1, sizeof(struct test_client));
+	congestion = shadow_congestion_new(FREERDP_CODEC_REMOTEFX | FREERDP_CODEC_NSCODEC);
+
+	if (!link || !client || !congestion)
+		goto out;
+
+	congestion->autoDetect = TRUE;
+
+	/* the controller starts from the tick count, the simulation goes on from there */
+
+	start = nextCapture = GetTickCount();
+
+	for (elapsed = 0; elapsed < duration + TEST_MAX_TRANSITION_LATENCY; elapsed++)
+	{
+		now = start + elapsed;
+
+		if (elapsed < duration)
+			link->rate = test_link_rates[elapsed / TEST_PHASE_TIME];
+
+		arrived = test_link_advance(link, now);
+		test_client_receive(client, link, congestion, arrived, now);
+
+		if (elapsed >= duration)
+			continue;
+
+		if ((INT32) (now - nextCapture) >= 0)
+		{
+			pending = TRUE;
+			nextCapture += 1000 / TEST_CAPTURE_RATE;
+		}
+
+		probes = shadow_congestion_poll(congestion, now);
+
+		if (probes & SHADOW_CONGESTION_PROBE_RTT)
+		{
+			if (test_link_send(link, TEST_MESSAGE_RTT_REQUEST, congestion->rttSequenceNumber, 0, 0, now) < 0)
+				goto out;
+		}
+
+		if (probes & SHADOW_CONGESTION_PROBE_BANDWIDTH_START)
+		{
+			if (test_link_send(link, TEST_MESSAGE_BANDWIDTH_START, congestion->bandwidthSequenceNumber, 0, 0, now) < 0)
+				goto out;
+		}
+
+		if (probes & SHADOW_CONGESTION_PROBE_BANDWIDTH_STOP)
+		{
+			if (test_link_send(link, TEST_MESSAGE_BANDWIDTH_STOP, congestion->bandwidthSequenceNumber, 0, 0, now) < 0)
+				goto out;
+		}
+
+		if (pending && shadow_congestion_can_send(congestion, now))
+		{
+			size = test_frame_sizes[congestion->level];
+
+			if (test_link_send(link, TEST_MESSAGE_FRAME, ++frameId, size, congestion->level, now) < 0)
+				goto out;
+
+			shadow_congestion_frame_sent(congestion, frameId, size + TEST_MESSAGE_HEADER, now);
+			pending = FALSE;
+		}
+	}
+
+	ZeroMemory(count, sizeof(count));
+	ZeroMemory(levels, sizeof(levels));
+	ZeroMemory(worst, sizeof(worst));
+
+	for (index = 0; index < client->frameCount; index++)
+	{
+		frame = &client->frames[index];
+
+		if (frame->latency > peak)
+			peak = frame->latency;
+
+		if (((frame->sendTime - start) % TEST_PHASE_TIME) < TEST_SETTLE_TIME)
+			continue;
+
+		phase = (frame->sendTime - start) / TEST_PHASE_TIME;
+
+		if (phase >= phases)
+			continue;
+
+		count[phase]++;
+		levels[phase] += frame->level;
+
+		if (frame->latency > worst[phase])
+			worst[phase] = frame->latency;
+	}
+
+	for (phase = 0; phase < phases; phase++)
+	{
+		printf("%7d kbps: %3d frames/s, quality level %d.%d, latency %3d ms at worst\n",
+				(int) (test_link_rates[phase] * 8 / 1000),
+				count[phase] * 1000 / (TEST_PHASE_TIME - TEST_SETTLE_TIME),
+				count[phase] ? levels[phase] / count[phase] : 0,
+				count[phase] ? ((levels[phase] * 10) / count[phase]) % 10 : 0,
+				(int) worst[phase]);
+	}
+
+	printf("latency %d ms at worst while the bandwidth changes\n", (int) peak);
+
+	if (link->delivered < link->count)
+	{
+		printf("%d messages still on the link\n", link->count - link->delivered);
+		goto out;
+	}
+
+	if (peak > TEST_MAX_TRANSITION_LATENCY)
+	{
+		printf("latency not bounded while the bandwidth changes\n");
+		goto out;
+	}
+
+	for (phase = 0; phase < phases; phase++)
+	{
+		if (!count[phase] || (worst[phase] > TEST_MAX_LATENCY))
+		{
+			printf("latency not bounded at %d kbps\n", (int) (test_link_rates[phase] * 8 / 1000));
+			goto out;
+		}
+	}
+
+	/* the quality follows the bandwidth of the first two phases */
+
+	if ((levels[0] * count[1]) >= (levels[1] * count[0]))
+	{
+		printf("quality did not drop with the bandwidth\n");
+		goto out;
+	}
+
+	status = 0;
+
+out:
+	shadow_congestion_free(congestion);
+	free(client);
+	free(link);
+	return status;
+}
+
+/**
+ * The bandwidth is sampled from the acknowledgements, and bounds the bytes
+ * in flight.
+ */
+
+static int test_congestion_window(void)
+{
+	UINT32 now;
+	rdpShadowCongestion* congestion;
+
+	congestion = shadow_congestion_new(FREERDP_CODEC_REMOTEFX);
+
+	if (!congestion)
+		return -1;
+
+	now = GetTickCount();
+
+	if (congestion->codec != FREERDP_CODEC_REMOTEFX)
+	{
+		printf("unexpected codec 0x%04X\n", (int) congestion->codec);
+		return -1;
+	}
+
+	if (!shadow_congestion_can_send(congestion, now))
+		return -1;
+
+	shadow_congestion_frame_sent(congestion, 1, 10000, now);
+
+	if (shadow_congestion_frame_acked(congestion, 42, now + 100) != 0)
+	{
+		printf("unknown frame acknowledged\n");
+		return -1;
+	}
+
+	shadow_congestion_frame_acked(congestion, 1, now + 100);
+
+	if ((congestion->bandwidth != 100000) || (congestion->baseRTT != 100) || (congestion->window != 20000))
+	{
+		printf("bandwidth %d baseRTT %d window %d\n", (int) congestion->bandwidth,
+				(int) congestion->baseRTT, (int) congestion->window);
+		return -1;
+	}
+
+	if (!shadow_congestion_can_send(congestion, now + 200))
+		return -1;
+
+	shadow_congestion_frame_sent(congestion, 2, 10000, now + 200);
+
+	if (!shadow_congestion_can_send(congestion, now + 300))
+		return -1;
+
+	shadow_congestion_frame_sent(congestion, 3, 10000, now + 300);
+
+	if (shadow_congestion_can_send(congestion, now + 400))
+	{
+		printf("window of %d bytes exceeded\n", (int) congestion->window);
+		return -1;
+	}
+
+	/* acknowledging a frame acknowledges the ones before it */
+
+	shadow_congestion_frame_acked(congestion, 3, now + 420);
+
+	if (congestion->bytesInFlight || congestion->frameCount)
+	{
+		printf("%d bytes still in flight\n", (int) congestion->bytesInFlight);
+		return -1;
+	}
+
+	shadow_congestion_free(congestion);
+
+	return 0;
+}
+
+int TestShadowCongestion(int argc, char* argv[])
+{
+	WLog_SetLogLevel(WLog_GetRoot(), WLOG_WARN);
+
+	if (test_congestion_window() < 0)
+		return -1;
+
+	if (test_congestion_link() < 0)
+		return -1;
+
+	return 0;
+}
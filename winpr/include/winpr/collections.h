@@ -381,31 +381,20 @@ WINPR_API void HashTable_Free(wHashTable* table);
 
 /* BufferPool */
 
-struct _wBufferPoolItem
-{
-	int size;
-	void* buffer;
-};
-typedef struct _wBufferPoolItem wBufferPoolItem;
+/**
+ * The pool only keeps the buffers that have been returned to it: every
+ * buffer taken must be returned before BufferPool_Clear or BufferPool_Free,
+ * which release cached buffers but not the ones still in use.
+ */
 
 struct _wBufferPool
 {
 	int fixedSize;
 	DWORD alignment;
 	BOOL synchronized;
-	CRITICAL_SECTION lock;
-
-	int size;
-	int capacity;
-	void** array;
-
-	int aSize;
-	int aCapacity;
-	wBufferPoolItem* aArray;
+	size_t headerSize;
 
-	int uSize;
-	int uCapacity;
-	wBufferPoolItem* uArray;
+	struct _wPoolCache* cache;
 };
 typedef struct _wBufferPool wBufferPool;
 
@@ -415,6 +404,7 @@ WINPR_API int BufferPool_GetBufferSize(wBufferPool* pool, void* buffer);
 WINPR_API void* BufferPool_Take(wBufferPool* pool, int bufferSize);
 WINPR_API BOOL BufferPool_Return(wBufferPool* pool, void* buffer);
 WINPR_API void BufferPool_Clear(wBufferPool* pool);
+WINPR_API void BufferPool_GetStatistics(wBufferPool* pool, wPoolStatistics* statistics);
 
 WINPR_API wBufferPool* BufferPool_New(BOOL synchronized, int fixedSize, DWORD alignment);
 WINPR_API void BufferPool_Free(wBufferPool* pool);
@@ -457,6 +447,8 @@ struct _wMessage
 	MESSAGE_FREE_FN Free;
 };
 
+typedef struct _wMessageRing wMessageRing;
+
 struct _wMessageQueue
 {
 	int head;
@@ -468,11 +460,23 @@ struct _wMessageQueue
 	HANDLE event;
 
 	wObject object;
+
+	DWORD flags;
+	wMessageRing* ring;
 };
 typedef struct _wMessageQueue wMessageQueue;
 
 #define WMQ_QUIT	0xFFFFFFFF
 
+/**
+ * Lock-free queue variants: messages go through a bounded ring and only
+ * spill into the locked array while the ring is full. They must be read
+ * by a single thread; WMQ_FLAG_SPSC also requires a single writer.
+ */
+
+#define WMQ_FLAG_MPSC	0x00000001
+#define WMQ_FLAG_SPSC	0x00000002
+
 WINPR_API HANDLE MessageQueue_Event(wMessageQueue* queue);
 WINPR_API BOOL MessageQueue_Wait(wMessageQueue* queue);
 WINPR_API int MessageQueue_Size(wMessageQueue* queue);
@@ -510,6 +514,17 @@ WINPR_API int MessageQueue_Clear(wMessageQueue *queue);
  */
 WINPR_API wMessageQueue* MessageQueue_New(const wObject *callback);
 
+/*! \brief Creates a new message queue of the given kind.
+ *
+ * \param callback see 'MessageQueue_New'.
+ * \param flags 0 for a locked queue, or one of WMQ_FLAG_MPSC and WMQ_FLAG_SPSC.
+ * \param capacity the number of messages in the ring, rounded up to a
+ * 				 power of two. 0 selects the default.
+ *
+ * \return A pointer to a newly allocated MessageQueue or NULL.
+ */
+WINPR_API wMessageQueue* MessageQueue_NewEx(const wObject *callback, DWORD flags, int capacity);
+
 /*! \brief Frees resources allocated by a message queue.
  * 				 This function will only free resources allocated
  *				 internally.
@@ -227,19 +227,34 @@ static INLINE BOOL Stream_SafeSeek(wStream* s, size_t size) {
 
 /* StreamPool */
 
-struct _wStreamPool
+/**
+ * Counters of a StreamPool or BufferPool. Hits are takes served from the
+ * cache, misses are takes that had to allocate, trimmed counts the cached
+ * items released to keep the pool below its high water mark.
+ */
+
+struct _wPoolStatistics
 {
-	int aSize;
-	int aCapacity;
-	wStream** aArray;
+	UINT64 hits;
+	UINT64 misses;
+	UINT64 trimmed;
+	size_t bytesHeld;
+	size_t itemsHeld;
+	size_t itemsInUse;
+};
+typedef struct _wPoolStatistics wPoolStatistics;
 
-	int uSize;
-	int uCapacity;
-	wStream** uArray;
+struct _wStreamPool
+{
+	int size;
+	int capacity;
+	wStream** array;
 
 	CRITICAL_SECTION lock;
 	BOOL synchronized;
 	size_t defaultSize;
+
+	struct _wPoolCache* cache;
 };
 
 WINPR_API wStream* StreamPool_Take(wStreamPool* pool, size_t size);
@@ -253,6 +268,7 @@ WINPR_API void StreamPool_AddRef(wStreamPool* pool, BYTE* ptr);
 WINPR_API void StreamPool_Release(wStreamPool* pool, BYTE* ptr);
 
 WINPR_API void StreamPool_Clear(wStreamPool* pool);
+WINPR_API void StreamPool_GetStatistics(wStreamPool* pool, wPoolStatistics* statistics);
 
 WINPR_API wStreamPool* StreamPool_New(BOOL synchronized, size_t defaultSize);
 WINPR_API void StreamPool_Free(wStreamPool* pool);
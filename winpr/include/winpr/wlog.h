@@ -113,6 +113,7 @@ struct _wLogLayout
 #define WLOG_APPENDER_FILE	1
 #define WLOG_APPENDER_BINARY	2
 #define WLOG_APPENDER_CALLBACK	3
+#define WLOG_APPENDER_ASYNC	4
 
 #define WLOG_PACKET_INBOUND	1
 #define WLOG_PACKET_OUTBOUND	2
@@ -196,6 +197,39 @@ struct _wLogCallbackAppender
 };
 typedef struct _wLogCallbackAppender wLogCallbackAppender;
 
+/**
+ * The asynchronous appender formats messages on the calling thread into a
+ * lock-free ring of records, which a background thread writes out in
+ * batches, either every FlushInterval milliseconds or as soon as
+ * FlushThreshold records are pending.
+ */
+
+typedef struct _wLogAsyncRecord wLogAsyncRecord;
+
+struct _wLogAsyncAppender
+{
+	WLOG_APPENDER_COMMON();
+
+	char* FileName;
+	char* FilePath;
+	char* FullFileName;
+	int FileDescriptor;
+
+	DWORD FlushInterval;
+	DWORD FlushThreshold;
+
+	HANDLE Thread;
+	HANDLE Event;
+	BOOL Stopping;
+	LONG volatile Signaled;
+
+	DWORD RecordCount;
+	wLogAsyncRecord* Records;
+	LONG volatile Head;
+	LONG volatile Tail;
+};
+typedef struct _wLogAsyncAppender wLogAsyncAppender;
+
 /**
  * Filter
  */
@@ -228,6 +262,30 @@ struct _wLog
 	DWORD ChildrenSize;
 };
 
+/**
+ * Per call site logger cache, used by the WLog_LVL() family of macros so that
+ * the tag lookup only happens on the first call. The entry is published as a
+ * single pointer and tells tags apart by their address, so a tag must not be
+ * rewritten in place. A call site whose tag changes keeps looking it up.
+ * Entries are freed by WLog_Uninit.
+ */
+
+struct _wLogCacheEntry
+{
+	LPCSTR tag;
+	wLog* log;
+	DWORD generation;
+	struct _wLogCache* cache;
+	struct _wLogCacheEntry* next;
+};
+typedef struct _wLogCacheEntry wLogCacheEntry;
+
+struct _wLogCache
+{
+	wLogCacheEntry* volatile entry;
+};
+typedef struct _wLogCache wLogCache;
+
 WINPR_API void WLog_PrintMessage(wLog* log, wLogMessage* message, ...);
 WINPR_API int WLog_PrintMessageVA(wLog* log, wLogMessage* message, va_list args);
 
@@ -304,13 +362,19 @@ WINPR_API int WLog_PrintMessageVA(wLog* log, wLogMessage* message, va_list args)
 #define WLog_IsLevelActive(_log, _log_level) \
 	(_log_level >= WLog_GetLogLevel(_log))
 
-#define WLog_LVL(tag, lvl, fmt, ...) WLog_Print(WLog_Get(tag), lvl, fmt, ## __VA_ARGS__)
-#define WLog_VRB(tag, fmt, ...) WLog_Print(WLog_Get(tag), WLOG_TRACE, fmt, ## __VA_ARGS__)
-#define WLog_DBG(tag, fmt, ...) WLog_Print(WLog_Get(tag), WLOG_DEBUG, fmt, ## __VA_ARGS__)
-#define WLog_INFO(tag, fmt, ...) WLog_Print(WLog_Get(tag), WLOG_INFO, fmt, ## __VA_ARGS__)
-#define WLog_WARN(tag, fmt, ...) WLog_Print(WLog_Get(tag), WLOG_WARN, fmt, ## __VA_ARGS__)
-#define WLog_ERR(tag, fmt, ...) WLog_Print(WLog_Get(tag), WLOG_ERROR, fmt, ## __VA_ARGS__)
-#define WLog_FATAL(tag, fmt, ...) WLog_Print(WLog_Get(tag), WLOG_FATAL, fmt, ## __VA_ARGS__)
+#define WLog_LVL(tag, lvl, fmt, ...) \
+	do { \
+		static wLogCache _log_cache = { NULL }; \
+		wLog* _log_cached = WLog_GetCached(tag, &_log_cache); \
+		WLog_Print(_log_cached, lvl, fmt, ## __VA_ARGS__); \
+	} while (0)
+
+#define WLog_VRB(tag, fmt, ...) WLog_LVL(tag, WLOG_TRACE, fmt, ## __VA_ARGS__)
+#define WLog_DBG(tag, fmt, ...) WLog_LVL(tag, WLOG_DEBUG, fmt, ## __VA_ARGS__)
+#define WLog_INFO(tag, fmt, ...) WLog_LVL(tag, WLOG_INFO, fmt, ## __VA_ARGS__)
+#define WLog_WARN(tag, fmt, ...) WLog_LVL(tag, WLOG_WARN, fmt, ## __VA_ARGS__)
+#define WLog_ERR(tag, fmt, ...) WLog_LVL(tag, WLOG_ERROR, fmt, ## __VA_ARGS__)
+#define WLog_FATAL(tag, fmt, ...) WLog_LVL(tag, WLOG_FATAL, fmt, ## __VA_ARGS__)
 
 WINPR_API DWORD WLog_GetLogLevel(wLog* log);
 WINPR_API void WLog_SetLogLevel(wLog* log, DWORD logLevel);
@@ -330,11 +394,16 @@ WINPR_API void WLog_CallbackAppender_SetCallbacks(wLog* log, wLogCallbackAppende
 	CallbackAppenderMessage_t msg, CallbackAppenderImage_t img, CallbackAppenderPackage_t pkg,
 	CallbackAppenderData_t data);
 
+WINPR_API void WLog_AsyncAppender_SetOutputFileName(wLog* log, wLogAsyncAppender* appender, const char* filename);
+WINPR_API void WLog_AsyncAppender_SetOutputFilePath(wLog* log, wLogAsyncAppender* appender, const char* filepath);
+WINPR_API void WLog_AsyncAppender_SetFlushPolicy(wLog* log, wLogAsyncAppender* appender, DWORD interval, DWORD threshold);
+
 WINPR_API wLogLayout* WLog_GetLogLayout(wLog* log);
 WINPR_API void WLog_Layout_SetPrefixFormat(wLog* log, wLogLayout* layout, const char* format);
 
 WINPR_API wLog* WLog_GetRoot(void);
 WINPR_API wLog* WLog_Get(LPCSTR name);
+WINPR_API wLog* WLog_GetCached(LPCSTR name, wLogCache* cache);
 
 WINPR_API void WLog_Init(void);
 WINPR_API void WLog_Uninit(void);
@@ -0,0 +1,805 @@
+/**
+ * WinPR: Windows Portable Runtime
+ * Thread Pool API (Dispatcher)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <winpr/crt.h>
+#include <winpr/pool.h>
+#include <winpr/sysinfo.h>
+
+#include "pool.h"
+
+#ifdef WINPR_POOL_DISPATCHER
+
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#include "../handle/handle.h"
+#include "../synch/synch.h"
+#include "../thread/thread.h"
+#include "../pipe/pipe.h"
+
+#include "../log.h"
+#define TAG WINPR_TAG("pool")
+
+/**
+ * Each pool gets one dispatcher thread the first time a timer, wait or I/O
+ * object is created on it. The thread sleeps in epoll_wait on:
+ *
+ * - a timerfd armed for the earliest due time of a binary heap holding the
+ *   set timers and the wait timeouts,
+ * - the descriptors behind the handles that waits and I/O objects are set
+ *   on, registered one-shot so that each signal is reported once,
+ * - an eventfd used to wake it up.
+ *
+ * Expired timers and signaled handles are queued as callback instances to
+ * the pool's worker threads, like submitted work. Cancelling the pending
+ * callbacks of an object bumps its generation, which makes the workers
+ * skip the instances queued before.
+ *
+ * Closed objects are freed by the dispatcher thread once no callback of
+ * theirs is queued or running, as an epoll_wait call may have returned
+ * them just before they were closed.
+ */
+
+#define TP_DISPATCH_EVENTS	128
+
+struct _TP_DISPATCHER
+{
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+
+	int epollfd;
+	int timerfd;
+	int wakefd;
+	BOOL stop;
+	HANDLE thread;
+
+	TP_OBJECT* closed;
+
+	TP_OBJECT** heap;
+	int count;
+	int capacity;
+	UINT64 armed;
+};
+
+static pthread_mutex_t g_DispatcherMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static UINT64 dispatcher_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ((UINT64) ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
+}
+
+/**
+ * Converts a due time to microseconds on the monotonic clock: negative
+ * values are relative, positive ones absolute system times, both in
+ * 100-nanosecond units.
+ */
+
+static UINT64 dispatcher_due_time(PFILETIME pftDueTime)
+{
+	INT64 due;
+	INT64 current;
+	FILETIME now;
+	UINT64 monotonic;
+
+	monotonic = dispatcher_now();
+	due = (INT64) ((((UINT64) pftDueTime->dwHighDateTime) << 32) | pftDueTime->dwLowDateTime);
+
+	if (due < 0)
+		return monotonic + (UINT64) ((-due) / 10);
+
+	if (due == 0)
+		return monotonic;
+
+	GetSystemTimeAsFileTime(&now);
+	current = (INT64) ((((UINT64) now.dwHighDateTime) << 32) | now.dwLowDateTime);
+
+	if (due <= current)
+		return monotonic;
+
+	return monotonic + (UINT64) ((due - current) / 10);
+}
+
+static void dispatcher_arm_timer(TP_DISPATCHER* dispatcher)
+{
+	UINT64 due;
+	struct itimerspec spec;
+
+	due = dispatcher->count ? dispatcher->heap[0]->DueTime : 0;
+
+	if (due == dispatcher->armed)
+		return;
+
+	ZeroMemory(&spec, sizeof(struct itimerspec));
+
+	/* an absolute time of zero would disarm the timer */
+
+	if (due)
+	{
+		spec.it_value.tv_sec = due / 1000000;
+		spec.it_value.tv_nsec = ((due % 1000000) * 1000) + 1;
+	}
+
+	if (timerfd_settime(dispatcher->timerfd, TFD_TIMER_ABSTIME, &spec, NULL) < 0)
+		WLog_ERR(TAG, "timerfd_settime failure [%d] %s", errno, strerror(errno));
+
+	dispatcher->armed = due;
+}
+
+static void dispatcher_heap_swap(TP_DISPATCHER* dispatcher, int a, int b)
+{
+	TP_OBJECT* object = dispatcher->heap[a];
+
+	dispatcher->heap[a] = dispatcher->heap[b];
+	dispatcher->heap[b] = object;
+
+	dispatcher->heap[a]->HeapIndex = a;
+	dispatcher->heap[b]->HeapIndex = b;
+}
+
+static void dispatcher_heap_sift(TP_DISPATCHER* dispatcher, int index)
+{
+	int child;
+	int parent;
+
+	while (index > 0)
+	{
+		parent = (index - 1) / 2;
+
+		if (dispatcher->heap[parent]->DueTime <= dispatcher->heap[index]->DueTime)
+			break;
+
+		dispatcher_heap_swap(dispatcher, parent, index);
+		index = parent;
+	}
+
+	while ((child = (index * 2) + 1) < dispatcher->count)
+	{
+		if ((child + 1 < dispatcher->count) &&
+				(dispatcher->heap[child + 1]->DueTime < dispatcher->heap[child]->DueTime))
+			child++;
+
+		if (dispatcher->heap[index]->DueTime <= dispatcher->heap[child]->DueTime)
+			break;
+
+		dispatcher_heap_swap(dispatcher, index, child);
+		index = child;
+	}
+}
+
+static BOOL dispatcher_heap_insert(TP_DISPATCHER* dispatcher, TP_OBJECT* object, UINT64 due)
+{
+	int capacity;
+	TP_OBJECT** heap;
+
+	if (dispatcher->count >= dispatcher->capacity)
+	{
+		capacity = dispatcher->capacity ? dispatcher->capacity * 2 : 64;
+		heap = (TP_OBJECT**) realloc(dispatcher->heap, capacity * sizeof(TP_OBJECT*));
+
+		if (!heap)
+			return FALSE;
+
+		dispatcher->heap = heap;
+		dispatcher->capacity = capacity;
+	}
+
+	object->DueTime = due;
+	object->HeapIndex = dispatcher->count;
+	dispatcher->heap[dispatcher->count++] = object;
+
+	dispatcher_heap_sift(dispatcher, object->HeapIndex);
+
+	return TRUE;
+}
+
+static void dispatcher_heap_remove(TP_DISPATCHER* dispatcher, TP_OBJECT* object)
+{
+	int index = object->HeapIndex;
+
+	if (index < 0)
+		return;
+
+	object->HeapIndex = -1;
+	dispatcher->count--;
+
+	if (index == dispatcher->count)
+		return;
+
+	dispatcher->heap[index] = dispatcher->heap[dispatcher->count];
+	dispatcher->heap[index]->HeapIndex = index;
+
+	dispatcher_heap_sift(dispatcher, index);
+}
+
+static int dispatcher_handle_fd(HANDLE handle)
+{
+	ULONG Type;
+	PVOID Object;
+
+	if (!winpr_Handle_GetInfo(handle, &Type, &Object))
+		return -1;
+
+	switch (Type)
+	{
+		case HANDLE_TYPE_EVENT:
+			return ((WINPR_EVENT*) Object)->pipe_fd[0];
+
+		case HANDLE_TYPE_SEMAPHORE:
+			return ((WINPR_SEMAPHORE*) Object)->pipe_fd[0];
+
+		case HANDLE_TYPE_TIMER:
+			return ((WINPR_TIMER*) Object)->fd;
+
+		case HANDLE_TYPE_THREAD:
+			return ((WINPR_THREAD*) Object)->pipe_fd[0];
+
+		case HANDLE_TYPE_NAMED_PIPE:
+			return (((WINPR_NAMED_PIPE*) Object)->ServerMode) ?
+					((WINPR_NAMED_PIPE*) Object)->serverfd : ((WINPR_NAMED_PIPE*) Object)->clientfd;
+
+		default:
+			break;
+	}
+
+	return -1;
+}
+
+/**
+ * Registers the descriptor of a handle. epoll refuses a descriptor that is
+ * already registered, so a handle waited on by several objects is
+ * registered through a duplicate.
+ */
+
+static BOOL dispatcher_register(TP_DISPATCHER* dispatcher, TP_OBJECT* object, HANDLE handle)
+{
+	int fd;
+	struct epoll_event event;
+
+	fd = dispatcher_handle_fd(handle);
+
+	if (fd < 0)
+	{
+		WLog_ERR(TAG, "handle %p cannot be waited on by the thread pool", handle);
+		return FALSE;
+	}
+
+	ZeroMemory(&event, sizeof(struct epoll_event));
+	event.events = EPOLLIN | EPOLLONESHOT;
+	event.data.ptr = object;
+
+	object->FdDuplicated = FALSE;
+
+	if (epoll_ctl(dispatcher->epollfd, EPOLL_CTL_ADD, fd, &event) < 0)
+	{
+		if ((errno != EEXIST) || ((fd = dup(fd)) < 0))
+		{
+			WLog_ERR(TAG, "epoll_ctl failure [%d] %s", errno, strerror(errno));
+			return FALSE;
+		}
+
+		if (epoll_ctl(dispatcher->epollfd, EPOLL_CTL_ADD, fd, &event) < 0)
+		{
+			WLog_ERR(TAG, "epoll_ctl failure [%d] %s", errno, strerror(errno));
+			close(fd);
+			return FALSE;
+		}
+
+		object->FdDuplicated = TRUE;
+	}
+
+	object->Fd = fd;
+
+	return TRUE;
+}
+
+static void dispatcher_unregister(TP_DISPATCHER* dispatcher, TP_OBJECT* object)
+{
+	if (object->Fd < 0)
+		return;
+
+	/* fails harmlessly when the handle has been closed meanwhile */
+
+	epoll_ctl(dispatcher->epollfd, EPOLL_CTL_DEL, object->Fd, NULL);
+
+	if (object->FdDuplicated)
+		close(object->Fd);
+
+	object->Fd = -1;
+	object->FdDuplicated = FALSE;
+}
+
+static void dispatcher_release(TP_DISPATCHER* dispatcher)
+{
+	TP_OBJECT* object;
+	TP_OBJECT** link = &dispatcher->closed;
+
+	while ((object = *link) != NULL)
+	{
+		if (object->Pending)
+		{
+			link = &object->Next;
+			continue;
+		}
+
+		*link = object->Next;
+		free(object);
+	}
+}
+
+static void dispatcher_post(TP_OBJECT* object, TP_WAIT_RESULT result)
+{
+	PTP_CALLBACK_INSTANCE instance;
+
+	instance = (PTP_CALLBACK_INSTANCE) calloc(1, sizeof(TP_CALLBACK_INSTANCE));
+
+	if (!instance)
+	{
+		WLog_ERR(TAG, "failed to queue a thread pool callback");
+		return;
+	}
+
+	instance->Object = object;
+	instance->Generation = object->Generation;
+	instance->WaitResult = result;
+
+	object->Pending++;
+
+	Queue_Enqueue(object->Pool->PendingQueue, instance);
+}
+
+static void dispatcher_expire(TP_DISPATCHER* dispatcher, UINT64 now)
+{
+	UINT64 due;
+	UINT64 period;
+	TP_OBJECT* object;
+
+	while (dispatcher->count && (dispatcher->heap[0]->DueTime <= now))
+	{
+		object = dispatcher->heap[0];
+		due = object->DueTime;
+
+		dispatcher_heap_remove(dispatcher, object);
+
+		if (object->Type == TP_OBJECT_TIMER)
+		{
+			dispatcher_post(object, 0);
+
+			period = ((UINT64) ((PTP_TIMER) object)->Period) * 1000;
+
+			/* periodic timers keep their phase, skipping the periods missed */
+
+			if (period)
+				dispatcher_heap_insert(dispatcher, object, due + (((now - due) / period) + 1) * period);
+		}
+		else
+		{
+			dispatcher_unregister(dispatcher, object);
+			dispatcher_post(object, WAIT_TIMEOUT);
+		}
+	}
+
+	dispatcher_arm_timer(dispatcher);
+}
+
+static void dispatcher_signaled(TP_DISPATCHER* dispatcher, TP_OBJECT* object)
+{
+	struct epoll_event event;
+
+	/* the object may have been closed, or set on another handle or none meanwhile */
+
+	if (object->Closing || (object->Fd < 0))
+		return;
+
+	if (object->Type == TP_OBJECT_IO)
+	{
+		dispatcher_unregister(dispatcher, object);
+		dispatcher_post(object, NO_ERROR);
+		return;
+	}
+
+	/* acquires semaphores and timers, like any other wait would */
+
+	if (WaitForSingleObject(object->Handle, 0) != WAIT_OBJECT_0)
+	{
+		ZeroMemory(&event, sizeof(struct epoll_event));
+		event.events = EPOLLIN | EPOLLONESHOT;
+		event.data.ptr = object;
+
+		epoll_ctl(dispatcher->epollfd, EPOLL_CTL_MOD, object->Fd, &event);
+		return;
+	}
+
+	dispatcher_unregister(dispatcher, object);
+	dispatcher_heap_remove(dispatcher, object);
+	dispatcher_arm_timer(dispatcher);
+
+	dispatcher_post(object, WAIT_OBJECT_0);
+}
+
+static void* dispatcher_thread(void* arg)
+{
+	int index;
+	int count;
+	UINT64 expirations;
+	eventfd_t value;
+	struct epoll_event events[TP_DISPATCH_EVENTS];
+	TP_DISPATCHER* dispatcher = (TP_DISPATCHER*) arg;
+
+	while (1)
+	{
+		count = epoll_wait(dispatcher->epollfd, events, TP_DISPATCH_EVENTS, -1);
+
+		if (count < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			WLog_ERR(TAG, "epoll_wait failure [%d] %s", errno, strerror(errno));
+			break;
+		}
+
+		pthread_mutex_lock(&dispatcher->mutex);
+
+		if (dispatcher->stop)
+		{
+			pthread_mutex_unlock(&dispatcher->mutex);
+			break;
+		}
+
+		for (index = 0; index < count; index++)
+		{
+			if (events[index].data.ptr == &dispatcher->wakefd)
+			{
+				eventfd_read(dispatcher->wakefd, &value);
+				continue;
+			}
+
+			if (events[index].data.ptr == &dispatcher->timerfd)
+			{
+				if (read(dispatcher->timerfd, &expirations, sizeof(UINT64)) < 0)
+					expirations = 0;
+
+				continue;
+			}
+
+			dispatcher_signaled(dispatcher, (TP_OBJECT*) events[index].data.ptr);
+		}
+
+		dispatcher_expire(dispatcher, dispatcher_now());
+		dispatcher_release(dispatcher);
+
+		pthread_mutex_unlock(&dispatcher->mutex);
+	}
+
+	ExitThread(0);
+	return NULL;
+}
+
+static void dispatcher_free(TP_DISPATCHER* dispatcher)
+{
+	TP_OBJECT* object;
+
+	if (!dispatcher)
+		return;
+
+	if (dispatcher->thread)
+	{
+		pthread_mutex_lock(&dispatcher->mutex);
+		dispatcher->stop = TRUE;
+		pthread_mutex_unlock(&dispatcher->mutex);
+
+		eventfd_write(dispatcher->wakefd, 1);
+		WaitForSingleObject(dispatcher->thread, INFINITE);
+		CloseHandle(dispatcher->thread);
+	}
+
+	while (dispatcher->closed)
+	{
+		object = dispatcher->closed;
+		dispatcher->closed = object->Next;
+		free(object);
+	}
+
+	if (dispatcher->epollfd >= 0)
+		close(dispatcher->epollfd);
+
+	if (dispatcher->timerfd >= 0)
+		close(dispatcher->timerfd);
+
+	if (dispatcher->wakefd >= 0)
+		close(dispatcher->wakefd);
+
+	pthread_cond_destroy(&dispatcher->cond);
+	pthread_mutex_destroy(&dispatcher->mutex);
+
+	free(dispatcher->heap);
+	free(dispatcher);
+}
+
+static TP_DISPATCHER* dispatcher_new(void)
+{
+	struct epoll_event event;
+	TP_DISPATCHER* dispatcher;
+
+	dispatcher = (TP_DISPATCHER*) calloc(1, sizeof(TP_DISPATCHER));
+
+	if (!dispatcher)
+		return NULL;
+
+	pthread_mutex_init(&dispatcher->mutex, NULL);
+	pthread_cond_init(&dispatcher->cond, NULL);
+
+	dispatcher->epollfd = epoll_create1(EPOLL_CLOEXEC);
+	dispatcher->timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	dispatcher->wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+	if ((dispatcher->epollfd < 0) || (dispatcher->timerfd < 0) || (dispatcher->wakefd < 0))
+		goto fail;
+
+	ZeroMemory(&event, sizeof(struct epoll_event));
+	event.events = EPOLLIN;
+
+	event.data.ptr = &dispatcher->timerfd;
+
+	if (epoll_ctl(dispatcher->epollfd, EPOLL_CTL_ADD, dispatcher->timerfd, &event) < 0)
+		goto fail;
+
+	event.data.ptr = &dispatcher->wakefd;
+
+	if (epoll_ctl(dispatcher->epollfd, EPOLL_CTL_ADD, dispatcher->wakefd, &event) < 0)
+		goto fail;
+
+	dispatcher->thread = CreateThread(NULL, 0,
+			(LPTHREAD_START_ROUTINE) dispatcher_thread, (void*) dispatcher, 0, NULL);
+
+	if (!dispatcher->thread)
+		goto fail;
+
+	return dispatcher;
+
+fail:
+	WLog_ERR(TAG, "failed to start the thread pool dispatcher [%d] %s", errno, strerror(errno));
+	dispatcher_free(dispatcher);
+	return NULL;
+}
+
+static PTP_POOL dispatcher_get_pool(PTP_CALLBACK_ENVIRON pcbe)
+{
+	if (!pcbe)
+		pcbe = GetDefaultThreadpoolEnvironment();
+
+	if (pcbe->Pool)
+		return pcbe->Pool;
+
+	return GetDefaultThreadpool();
+}
+
+BOOL InitializeThreadpoolObject(TP_OBJECT* object, DWORD type, PVOID pv, PTP_CALLBACK_ENVIRON pcbe)
+{
+	PTP_POOL pool;
+
+	pool = dispatcher_get_pool(pcbe);
+
+	pthread_mutex_lock(&g_DispatcherMutex);
+
+	if (!pool->Dispatcher)
+		pool->Dispatcher = dispatcher_new();
+
+	pthread_mutex_unlock(&g_DispatcherMutex);
+
+	if (!pool->Dispatcher)
+		return FALSE;
+
+	object->Type = type;
+	object->Pool = pool;
+	object->CallbackParameter = pv;
+	object->CallbackEnvironment = pcbe;
+	object->HeapIndex = -1;
+	object->Fd = -1;
+
+	return TRUE;
+}
+
+/**
+ * Stops queuing callbacks and cancels those not started yet. The object
+ * may be closed from its own callback.
+ */
+
+VOID CloseThreadpoolObject(TP_OBJECT* object)
+{
+	TP_DISPATCHER* dispatcher = object->Pool->Dispatcher;
+
+	pthread_mutex_lock(&dispatcher->mutex);
+
+	dispatcher_unregister(dispatcher, object);
+	dispatcher_heap_remove(dispatcher, object);
+	dispatcher_arm_timer(dispatcher);
+
+	object->Generation++;
+	object->Closing = TRUE;
+	object->Next = dispatcher->closed;
+	dispatcher->closed = object;
+
+	pthread_mutex_unlock(&dispatcher->mutex);
+
+	eventfd_write(dispatcher->wakefd, 1);
+}
+
+VOID SetThreadpoolObjectTimer(TP_OBJECT* object, PFILETIME pftDueTime, DWORD msPeriod)
+{
+	TP_DISPATCHER* dispatcher = object->Pool->Dispatcher;
+
+	pthread_mutex_lock(&dispatcher->mutex);
+
+	dispatcher_heap_remove(dispatcher, object);
+
+	if (object->Type == TP_OBJECT_TIMER)
+		((PTP_TIMER) object)->Period = msPeriod;
+
+	if (pftDueTime)
+	{
+		if (!dispatcher_heap_insert(dispatcher, object, dispatcher_due_time(pftDueTime)))
+			WLog_ERR(TAG, "failed to set a thread pool timer");
+	}
+
+	dispatcher_arm_timer(dispatcher);
+
+	pthread_mutex_unlock(&dispatcher->mutex);
+}
+
+BOOL IsThreadpoolObjectTimerSet(TP_OBJECT* object)
+{
+	BOOL status;
+	TP_DISPATCHER* dispatcher = object->Pool->Dispatcher;
+
+	pthread_mutex_lock(&dispatcher->mutex);
+	status = (object->HeapIndex >= 0);
+	pthread_mutex_unlock(&dispatcher->mutex);
+
+	return status;
+}
+
+/**
+ * Waits for a handle to be signaled, at most until the given timeout,
+ * replacing any previous wait of the object. A NULL handle stops waiting.
+ */
+
+BOOL SetThreadpoolObjectHandle(TP_OBJECT* object, HANDLE handle, PFILETIME pftTimeout)
+{
+	BOOL status = TRUE;
+	TP_DISPATCHER* dispatcher = object->Pool->Dispatcher;
+
+	pthread_mutex_lock(&dispatcher->mutex);
+
+	dispatcher_unregister(dispatcher, object);
+	dispatcher_heap_remove(dispatcher, object);
+
+	object->Handle = handle;
+
+	if (handle)
+	{
+		status = dispatcher_register(dispatcher, object, handle);
+
+		if (status && pftTimeout)
+		{
+			status = dispatcher_heap_insert(dispatcher, object, dispatcher_due_time(pftTimeout));
+
+			if (!status)
+				dispatcher_unregister(dispatcher, object);
+		}
+	}
+
+	dispatcher_arm_timer(dispatcher);
+
+	pthread_mutex_unlock(&dispatcher->mutex);
+
+	return status;
+}
+
+VOID WaitForThreadpoolObjectCallbacks(TP_OBJECT* object, BOOL fCancelPendingCallbacks)
+{
+	TP_DISPATCHER* dispatcher = object->Pool->Dispatcher;
+
+	pthread_mutex_lock(&dispatcher->mutex);
+
+	if (fCancelPendingCallbacks)
+		object->Generation++;
+
+	while (object->Pending)
+		pthread_cond_wait(&dispatcher->cond, &dispatcher->mutex);
+
+	pthread_mutex_unlock(&dispatcher->mutex);
+}
+
+/**
+ * Runs a queued timer, wait or I/O callback on a worker thread, unless it
+ * has been cancelled since it was queued.
+ */
+
+VOID InvokeThreadpoolObjectCallback(PTP_CALLBACK_INSTANCE instance)
+{
+	BOOL cancelled;
+	BOOL release;
+	LPOVERLAPPED overlapped;
+	ULONG Type;
+	PVOID Object;
+	TP_OBJECT* object = instance->Object;
+	TP_DISPATCHER* dispatcher = object->Pool->Dispatcher;
+
+	pthread_mutex_lock(&dispatcher->mutex);
+	cancelled = (instance->Generation != object->Generation);
+	pthread_mutex_unlock(&dispatcher->mutex);
+
+	if (!cancelled)
+	{
+		switch (object->Type)
+		{
+			case TP_OBJECT_TIMER:
+				((PTP_TIMER) object)->TimerCallback(instance, object->CallbackParameter, (PTP_TIMER) object);
+				break;
+
+			case TP_OBJECT_WAIT:
+				((PTP_WAIT) object)->WaitCallback(instance, object->CallbackParameter,
+						(PTP_WAIT) object, instance->WaitResult);
+				break;
+
+			case TP_OBJECT_IO:
+				overlapped = NULL;
+
+				if (winpr_Handle_GetInfo(object->Handle, &Type, &Object) && (Type == HANDLE_TYPE_NAMED_PIPE))
+					overlapped = ((WINPR_NAMED_PIPE*) Object)->lpOverlapped;
+
+				((PTP_IO) object)->IoCallback(instance, object->CallbackParameter,
+						overlapped, instance->WaitResult, 0, (PTP_IO) object);
+				break;
+		}
+	}
+
+	pthread_mutex_lock(&dispatcher->mutex);
+
+	object->Pending--;
+	release = (object->Closing && !object->Pending);
+
+	if (!object->Pending)
+		pthread_cond_broadcast(&dispatcher->cond);
+
+	pthread_mutex_unlock(&dispatcher->mutex);
+
+	if (release)
+		eventfd_write(dispatcher->wakefd, 1);
+}
+
+VOID CloseThreadpoolDispatcher(PTP_POOL pool)
+{
+	dispatcher_free(pool->Dispatcher);
+	pool->Dispatcher = NULL;
+}
+
+#endif
@@ -24,31 +24,68 @@
 #include <winpr/crt.h>
 #include <winpr/pool.h>
 
+#include "pool.h"
+
 #ifdef WINPR_THREAD_POOL
 
+/**
+ * There is no completion port to report the end of overlapped operations,
+ * so I/O objects report readiness instead: StartThreadpoolIo queues the
+ * callback once, when the file has data to read. The callback receives the
+ * OVERLAPPED structure of the last overlapped operation on a named pipe,
+ * NULL otherwise, and no transfer count.
+ */
+
 PTP_IO CreateThreadpoolIo(HANDLE fl, PTP_WIN32_IO_CALLBACK pfnio, PVOID pv, PTP_CALLBACK_ENVIRON pcbe)
 {
-	return NULL;
+	PTP_IO io = NULL;
+#ifdef WINPR_POOL_DISPATCHER
+	io = (PTP_IO) calloc(1, sizeof(TP_IO));
+
+	if (!io)
+		return NULL;
+
+	if (!InitializeThreadpoolObject(&io->Object, TP_OBJECT_IO, pv, pcbe))
+	{
+		free(io);
+		return NULL;
+	}
+
+	io->Object.Handle = fl;
+	io->IoCallback = pfnio;
+#endif
+	return io;
 }
 
 VOID CloseThreadpoolIo(PTP_IO pio)
 {
-
+#ifdef WINPR_POOL_DISPATCHER
+	CloseThreadpoolObject(&pio->Object);
+#endif
 }
 
 VOID StartThreadpoolIo(PTP_IO pio)
 {
-
+#ifdef WINPR_POOL_DISPATCHER
+	SetThreadpoolObjectHandle(&pio->Object, pio->Object.Handle, NULL);
+#endif
 }
 
 VOID CancelThreadpoolIo(PTP_IO pio)
 {
+#ifdef WINPR_POOL_DISPATCHER
+	HANDLE handle = pio->Object.Handle;
 
+	SetThreadpoolObjectHandle(&pio->Object, NULL, NULL);
+	pio->Object.Handle = handle;
+#endif
 }
 
 VOID WaitForThreadpoolIoCallbacks(PTP_IO pio, BOOL fCancelPendingCallbacks)
 {
-
+#ifdef WINPR_POOL_DISPATCHER
+	WaitForThreadpoolObjectCallbacks(&pio->Object, fCancelPendingCallbacks);
+#endif
 }
 
 #endif
\ No newline at end of file
@@ -94,8 +94,19 @@ static void* thread_pool_work_func(void* arg)
 		if (callbackInstance)
 		{
 			work = callbackInstance->Work;
-			work->WorkCallback(callbackInstance, work->CallbackParameter, work);
-			CountdownEvent_Signal(pool->WorkComplete, 1);
+
+			if (work)
+			{
+				work->WorkCallback(callbackInstance, work->CallbackParameter, work);
+				CountdownEvent_Signal(pool->WorkComplete, 1);
+			}
+#ifdef WINPR_POOL_DISPATCHER
+			else
+			{
+				InvokeThreadpoolObjectCallback(callbackInstance);
+			}
+#endif
+
 			free(callbackInstance);
 		}
 	}
@@ -181,6 +192,10 @@ VOID CloseThreadpool(PTP_POOL ptpp)
 	if (pCloseThreadpool)
 		pCloseThreadpool(ptpp);
 #else
+#ifdef WINPR_POOL_DISPATCHER
+	CloseThreadpoolDispatcher(ptpp);
+#endif
+
 	SetEvent(ptpp->TerminateEvent);
 
 	ArrayList_Free(ptpp->Threads);
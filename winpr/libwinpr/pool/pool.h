@@ -25,9 +25,51 @@
 #include <winpr/thread.h>
 #include <winpr/collections.h>
 
+#if !defined(_WIN32) && defined(HAVE_SYS_EPOLL_H) && defined(HAVE_TIMERFD_H)
+#define WINPR_POOL_DISPATCHER	1
+#endif
+
+#define TP_OBJECT_TIMER		1
+#define TP_OBJECT_WAIT		2
+#define TP_OBJECT_IO		3
+
+typedef struct _TP_DISPATCHER TP_DISPATCHER;
+
+/**
+ * Common part of the timer, wait and I/O objects, which the pool dispatcher
+ * thread queues to the pool's worker threads. All fields are protected by
+ * the dispatcher lock.
+ */
+
+typedef struct _TP_OBJECT TP_OBJECT;
+
+struct _TP_OBJECT
+{
+	DWORD Type;
+	PTP_POOL Pool;
+	PVOID CallbackParameter;
+	PTP_CALLBACK_ENVIRON CallbackEnvironment;
+
+	DWORD Generation;
+	DWORD Pending;
+	BOOL Closing;
+	TP_OBJECT* Next;
+
+	UINT64 DueTime;
+	int HeapIndex;
+
+	HANDLE Handle;
+	int Fd;
+	BOOL FdDuplicated;
+};
+
 struct _TP_CALLBACK_INSTANCE
 {
 	PTP_WORK Work;
+
+	TP_OBJECT* Object;
+	DWORD Generation;
+	TP_WAIT_RESULT WaitResult;
 };
 
 struct _TP_POOL
@@ -38,6 +80,7 @@ struct _TP_POOL
 	wQueue* PendingQueue;
 	HANDLE TerminateEvent;
 	wCountdownEvent* WorkComplete;
+	TP_DISPATCHER* Dispatcher;
 };
 
 struct _TP_WORK
@@ -49,17 +92,21 @@ struct _TP_WORK
 
 struct _TP_TIMER
 {
-	void* dummy;
+	TP_OBJECT Object;
+	PTP_TIMER_CALLBACK TimerCallback;
+	DWORD Period;
 };
 
 struct _TP_WAIT
 {
-	void* dummy;
+	TP_OBJECT Object;
+	PTP_WAIT_CALLBACK WaitCallback;
 };
 
 struct _TP_IO
 {
-	void* dummy;
+	TP_OBJECT Object;
+	PTP_WIN32_IO_CALLBACK IoCallback;
 };
 
 struct _TP_CLEANUP_GROUP
@@ -74,5 +121,20 @@ PTP_CALLBACK_ENVIRON GetDefaultThreadpoolEnvironment(void);
 
 #endif
 
+#ifdef WINPR_POOL_DISPATCHER
+
+BOOL InitializeThreadpoolObject(TP_OBJECT* object, DWORD type, PVOID pv, PTP_CALLBACK_ENVIRON pcbe);
+VOID CloseThreadpoolObject(TP_OBJECT* object);
+
+VOID SetThreadpoolObjectTimer(TP_OBJECT* object, PFILETIME pftDueTime, DWORD msPeriod);
+BOOL IsThreadpoolObjectTimerSet(TP_OBJECT* object);
+BOOL SetThreadpoolObjectHandle(TP_OBJECT* object, HANDLE handle, PFILETIME pftTimeout);
+VOID WaitForThreadpoolObjectCallbacks(TP_OBJECT* object, BOOL fCancelPendingCallbacks);
+
+VOID InvokeThreadpoolObjectCallback(PTP_CALLBACK_INSTANCE instance);
+VOID CloseThreadpoolDispatcher(PTP_POOL pool);
+
+#endif
+
 #endif /* WINPR_POOL_PRIVATE_H */
 
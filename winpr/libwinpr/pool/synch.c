@@ -24,26 +24,56 @@
 #include <winpr/crt.h>
 #include <winpr/pool.h>
 
+#include "pool.h"
+
 #ifdef WINPR_THREAD_POOL
 
 PTP_WAIT CreateThreadpoolWait(PTP_WAIT_CALLBACK pfnwa, PVOID pv, PTP_CALLBACK_ENVIRON pcbe)
 {
-	return NULL;
+	PTP_WAIT wait = NULL;
+#ifdef WINPR_POOL_DISPATCHER
+	wait = (PTP_WAIT) calloc(1, sizeof(TP_WAIT));
+
+	if (!wait)
+		return NULL;
+
+	if (!InitializeThreadpoolObject(&wait->Object, TP_OBJECT_WAIT, pv, pcbe))
+	{
+		free(wait);
+		return NULL;
+	}
+
+	wait->WaitCallback = pfnwa;
+#endif
+	return wait;
 }
 
 VOID CloseThreadpoolWait(PTP_WAIT pwa)
 {
-
+#ifdef WINPR_POOL_DISPATCHER
+	CloseThreadpoolObject(&pwa->Object);
+#endif
 }
 
+/**
+ * The callback is queued once, with WAIT_OBJECT_0 when h is signaled or
+ * WAIT_TIMEOUT when pftTimeout expires first. Events, semaphores, timers,
+ * threads and named pipes can be waited on, as well as sockets through
+ * CreateFileDescriptorEvent. A NULL h stops waiting.
+ */
+
 VOID SetThreadpoolWait(PTP_WAIT pwa, HANDLE h, PFILETIME pftTimeout)
 {
-
+#ifdef WINPR_POOL_DISPATCHER
+	SetThreadpoolObjectHandle(&pwa->Object, h, pftTimeout);
+#endif
 }
 
 VOID WaitForThreadpoolWaitCallbacks(PTP_WAIT pwa, BOOL fCancelPendingCallbacks)
 {
-
+#ifdef WINPR_POOL_DISPATCHER
+	WaitForThreadpoolObjectCallbacks(&pwa->Object, fCancelPendingCallbacks);
+#endif
 }
 
 #endif
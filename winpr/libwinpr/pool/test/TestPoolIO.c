@@ -1,9 +1,95 @@
 
 #include <winpr/crt.h>
 #include <winpr/pool.h>
+#include <winpr/synch.h>
+#include <winpr/interlocked.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/socket.h>
+#endif
+
+static LONG volatile g_Completions = 0;
+static HANDLE g_Completed = NULL;
+
+static VOID CALLBACK test_IoCallback(PTP_CALLBACK_INSTANCE instance, PVOID context, PVOID overlapped,
+		ULONG result, ULONG_PTR transferred, PTP_IO io)
+{
+	char buffer[16];
+	int* fd = (int*) context;
+
+#ifndef _WIN32
+	if (read(*fd, buffer, sizeof(buffer)) <= 0)
+		return;
+#endif
+
+	InterlockedIncrement(&g_Completions);
+	SetEvent(g_Completed);
+}
 
 int TestPoolIO(int argc, char* argv[])
 {
+#ifndef _WIN32
+	int index;
+	int fds[2];
+	HANDLE file;
+	PTP_IO io;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0)
+		return -1;
+
+	g_Completed = CreateEvent(NULL, TRUE, FALSE, NULL);
+	file = CreateFileDescriptorEvent(NULL, TRUE, FALSE, fds[0]);
+	io = CreateThreadpoolIo(file, test_IoCallback, &fds[0], NULL);
+
+	if (!io)
+	{
+		printf("CreateThreadpoolIo failure\n");
+		return -1;
+	}
+
+	/* one callback per StartThreadpoolIo, once the data is there */
+
+	for (index = 0; index < 10; index++)
+	{
+		ResetEvent(g_Completed);
+		StartThreadpoolIo(io);
+
+		if (write(fds[1], "x", 1) != 1)
+			return -1;
+
+		WaitForSingleObject(g_Completed, 1000);
+		WaitForThreadpoolIoCallbacks(io, FALSE);
+
+		if (g_Completions != index + 1)
+		{
+			printf("%d completions after %d operations\n", (int) g_Completions, index + 1);
+			return -1;
+		}
+	}
+
+	/* no callback once cancelled */
+
+	StartThreadpoolIo(io);
+	CancelThreadpoolIo(io);
+
+	if (write(fds[1], "x", 1) != 1)
+		return -1;
+
+	Sleep(10);
+	WaitForThreadpoolIoCallbacks(io, TRUE);
+
+	if (g_Completions != 10)
+	{
+		printf("completion reported after CancelThreadpoolIo\n");
+		return -1;
+	}
+
+	CloseThreadpoolIo(io);
+	CloseHandle(file);
+	CloseHandle(g_Completed);
+	close(fds[0]);
+	close(fds[1]);
+#endif
 	return 0;
 }
-
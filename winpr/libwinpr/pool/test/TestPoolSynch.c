@@ -1,9 +1,316 @@
 
 #include <winpr/crt.h>
 #include <winpr/pool.h>
+#include <winpr/synch.h>
+#include <winpr/sysinfo.h>
+#include <winpr/interlocked.h>
 
-int TestPoolSynch(int argc, char* argv[])
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+#define TEST_WAIT_HANDLES	10000
+#define TEST_WAIT_ROUNDS	5
+
+struct test_wait_context
 {
+	HANDLE done;
+	LONG volatile count;
+	LONG limit;
+	TP_WAIT_RESULT result;
+};
+
+static VOID CALLBACK test_WaitCallback(PTP_CALLBACK_INSTANCE instance, PVOID context,
+		PTP_WAIT wait, TP_WAIT_RESULT result)
+{
+	struct test_wait_context* test = (struct test_wait_context*) context;
+
+	test->result = result;
+
+	if (InterlockedIncrement(&test->count) == test->limit)
+		SetEvent(test->done);
+}
+
+static void test_relative_time(FILETIME* ft, DWORD milliseconds)
+{
+	ULARGE_INTEGER due;
+
+	due.QuadPart = (ULONGLONG) -((LONGLONG) milliseconds * 10000);
+	ft->dwLowDateTime = due.LowPart;
+	ft->dwHighDateTime = due.HighPart;
+}
+
+static int test_wait_basic(void)
+{
+	DWORD start;
+	DWORD elapsed;
+	FILETIME timeout;
+	HANDLE event;
+	HANDLE semaphore;
+	PTP_WAIT wait[2];
+	struct test_wait_context test[2];
+
+	ZeroMemory(test, sizeof(test));
+	test[0].done = CreateEvent(NULL, TRUE, FALSE, NULL);
+	test[1].done = CreateEvent(NULL, TRUE, FALSE, NULL);
+	test[0].limit = test[1].limit = 1;
+
+	event = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+	wait[0] = CreateThreadpoolWait(test_WaitCallback, &test[0], NULL);
+	wait[1] = CreateThreadpoolWait(test_WaitCallback, &test[1], NULL);
+
+	if (!wait[0] || !wait[1])
+	{
+		printf("CreateThreadpoolWait failure\n");
+		return -1;
+	}
+
+	/* two waits on the same event */
+
+	SetThreadpoolWait(wait[0], event, NULL);
+	SetThreadpoolWait(wait[1], event, NULL);
+	Sleep(10);
+
+	if (test[0].count || test[1].count)
+	{
+		printf("wait callback queued before the event was set\n");
+		return -1;
+	}
+
+	SetEvent(event);
+
+	if ((WaitForSingleObject(test[0].done, 1000) != WAIT_OBJECT_0) ||
+			(WaitForSingleObject(test[1].done, 1000) != WAIT_OBJECT_0) ||
+			(test[0].result != WAIT_OBJECT_0) || (test[1].result != WAIT_OBJECT_0))
+	{
+		printf("event wait not satisfied\n");
+		return -1;
+	}
+
+	/* timeout */
+
+	ResetEvent(event);
+	ResetEvent(test[0].done);
+	test[0].count = 0;
+
+	test_relative_time(&timeout, 20);
+	start = GetTickCount();
+	SetThreadpoolWait(wait[0], event, &timeout);
+
+	if ((WaitForSingleObject(test[0].done, 1000) != WAIT_OBJECT_0) || (test[0].result != WAIT_TIMEOUT))
+	{
+		printf("wait did not time out\n");
+		return -1;
+	}
+
+	elapsed = GetTickCount() - start;
+
+	if ((elapsed < 19) || (elapsed > 200))
+	{
+		printf("wait timed out after %d ms instead of 20 ms\n", (int) elapsed);
+		return -1;
+	}
+
+	/* the wait acquires the semaphore */
+
+	semaphore = CreateSemaphore(NULL, 0, 1, NULL);
+	ResetEvent(test[0].done);
+	test[0].count = 0;
+
+	SetThreadpoolWait(wait[0], semaphore, NULL);
+	ReleaseSemaphore(semaphore, 1, NULL);
+
+	if ((WaitForSingleObject(test[0].done, 1000) != WAIT_OBJECT_0) || (test[0].result != WAIT_OBJECT_0))
+	{
+		printf("semaphore wait not satisfied\n");
+		return -1;
+	}
+
+	WaitForThreadpoolWaitCallbacks(wait[0], FALSE);
+
+	if (WaitForSingleObject(semaphore, 0) != WAIT_TIMEOUT)
+	{
+		printf("semaphore not acquired by the wait\n");
+		return -1;
+	}
+
+	/* a wait that is reset is not satisfied */
+
+	ResetEvent(event);
+	test[1].count = 0;
+	SetThreadpoolWait(wait[1], event, NULL);
+	SetThreadpoolWait(wait[1], NULL, NULL);
+	SetEvent(event);
+	Sleep(10);
+	WaitForThreadpoolWaitCallbacks(wait[1], TRUE);
+
+	if (test[1].count)
+	{
+		printf("wait satisfied after being reset\n");
+		return -1;
+	}
+
+	CloseThreadpoolWait(wait[0]);
+	CloseThreadpoolWait(wait[1]);
+
+	CloseHandle(semaphore);
+	CloseHandle(event);
+	CloseHandle(test[0].done);
+	CloseHandle(test[1].done);
+
 	return 0;
 }
 
+struct test_wait_item
+{
+	HANDLE event;
+	PTP_WAIT wait;
+	LONG volatile* count;
+	HANDLE done;
+	LONG limit;
+};
+
+static VOID CALLBACK test_WaitScaleCallback(PTP_CALLBACK_INSTANCE instance, PVOID context,
+		PTP_WAIT wait, TP_WAIT_RESULT result)
+{
+	struct test_wait_item* item = (struct test_wait_item*) context;
+
+	ResetEvent(item->event);
+
+	if (InterlockedIncrement(item->count) == item->limit)
+		SetEvent(item->done);
+}
+
+/**
+ * Multiplexes many event handles onto a few worker threads, signaling them
+ * in a shuffled order round after round, and reports the throughput.
+ */
+
+static int test_wait_scale(void)
+{
+	int index;
+	int round;
+	int count;
+	int swap;
+	int other;
+	int* order;
+	UINT64 start;
+	UINT64 elapsed;
+	HANDLE done;
+	PTP_POOL pool;
+	LONG volatile signaled = 0;
+	TP_CALLBACK_ENVIRON environment;
+	struct test_wait_item* items;
+#ifndef _WIN32
+	struct rlimit limit;
+#endif
+
+	count = TEST_WAIT_HANDLES;
+
+#ifndef _WIN32
+	/* each event uses a descriptor */
+
+	if (getrlimit(RLIMIT_NOFILE, &limit) == 0)
+	{
+		if (limit.rlim_cur < (rlim_t) count + 256)
+		{
+			limit.rlim_cur = (limit.rlim_max < (rlim_t) count + 256) ? limit.rlim_max : (rlim_t) count + 256;
+			setrlimit(RLIMIT_NOFILE, &limit);
+			getrlimit(RLIMIT_NOFILE, &limit);
+		}
+
+		if (limit.rlim_cur < (rlim_t) count + 256)
+			count = (int) limit.rlim_cur - 256;
+	}
+#endif
+
+	items = (struct test_wait_item*) calloc(count, sizeof(struct test_wait_item));
+	order = (int*) calloc(count, sizeof(int));
+	done = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+	if (!items || !order || !done)
+		return -1;
+
+	pool = CreateThreadpool(NULL);
+	SetThreadpoolThreadMinimum(pool, 4);
+
+	InitializeThreadpoolEnvironment(&environment);
+	SetThreadpoolCallbackPool(&environment, pool);
+
+	for (index = 0; index < count; index++)
+	{
+		items[index].event = CreateEvent(NULL, TRUE, FALSE, NULL);
+		items[index].wait = CreateThreadpoolWait(test_WaitScaleCallback, &items[index], &environment);
+		items[index].count = &signaled;
+		items[index].done = done;
+		items[index].limit = count;
+		order[index] = index;
+
+		if (!items[index].event || !items[index].wait)
+		{
+			printf("failed to create wait %d\n", index);
+			return -1;
+		}
+	}
+
+	start = GetTickCount64();
+
+	for (round = 0; round < TEST_WAIT_ROUNDS; round++)
+	{
+		signaled = 0;
+		ResetEvent(done);
+
+		for (index = 0; index < count; index++)
+			SetThreadpoolWait(items[index].wait, items[index].event, NULL);
+
+		for (index = count - 1; index > 0; index--)
+		{
+			other = rand() % (index + 1);
+			swap = order[index];
+			order[index] = order[other];
+			order[other] = swap;
+		}
+
+		for (index = 0; index < count; index++)
+			SetEvent(items[order[index]].event);
+
+		if (WaitForSingleObject(done, 30000) != WAIT_OBJECT_0)
+		{
+			printf("round %d: %d of %d waits satisfied\n", round, (int) signaled, count);
+			return -1;
+		}
+	}
+
+	elapsed = GetTickCount64() - start;
+
+	printf("%d waits on %d handles in %d ms (%d waits/s)\n", count * TEST_WAIT_ROUNDS, count,
+			(int) elapsed, (int) ((count * TEST_WAIT_ROUNDS * 1000ULL) / (elapsed ? elapsed : 1)));
+
+	for (index = 0; index < count; index++)
+	{
+		WaitForThreadpoolWaitCallbacks(items[index].wait, FALSE);
+		CloseThreadpoolWait(items[index].wait);
+		CloseHandle(items[index].event);
+	}
+
+	DestroyThreadpoolEnvironment(&environment);
+	CloseThreadpool(pool);
+
+	CloseHandle(done);
+	free(order);
+	free(items);
+
+	return 0;
+}
+
+int TestPoolSynch(int argc, char* argv[])
+{
+	if (test_wait_basic() < 0)
+		return -1;
+
+	if (test_wait_scale() < 0)
+		return -1;
+
+	return 0;
+}
@@ -1,9 +1,276 @@
 
+#include <time.h>
+
 #include <winpr/crt.h>
 #include <winpr/pool.h>
+#include <winpr/synch.h>
+#include <winpr/sysinfo.h>
+#include <winpr/interlocked.h>
 
-int TestPoolTimer(int argc, char* argv[])
+#define TEST_ONESHOT_COUNT	20
+#define TEST_ONESHOT_DUE	25
+#define TEST_PERIOD		10
+#define TEST_PERIOD_COUNT	200
+
+struct test_timer_context
+{
+	HANDLE event;
+	LONG volatile count;
+	LONG limit;
+	UINT64 due;
+	UINT64 fired[TEST_PERIOD_COUNT];
+};
+
+static UINT64 test_now(void)
+{
+#ifdef _WIN32
+	return GetTickCount64() * 1000;
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ((UINT64) ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
+#endif
+}
+
+static void test_relative_due_time(FILETIME* ft, DWORD milliseconds)
+{
+	ULARGE_INTEGER due;
+
+	due.QuadPart = (ULONGLONG) -((LONGLONG) milliseconds * 10000);
+	ft->dwLowDateTime = due.LowPart;
+	ft->dwHighDateTime = due.HighPart;
+}
+
+static VOID CALLBACK test_TimerCallback(PTP_CALLBACK_INSTANCE instance, PVOID context, PTP_TIMER timer)
+{
+	LONG index;
+	struct test_timer_context* test = (struct test_timer_context*) context;
+
+	index = InterlockedIncrement(&test->count) - 1;
+
+	if (index < TEST_PERIOD_COUNT)
+		test->fired[index] = test_now();
+
+	if (index + 1 == test->limit)
+		SetEvent(test->event);
+}
+
+/**
+ * One-shot timers must not fire early, and should fire within a
+ * millisecond or two of their due time.
+ */
+
+static int test_timer_precision(void)
+{
+	int index;
+	INT64 late;
+	INT64 worst = 0;
+	INT64 total = 0;
+	FILETIME dueTime;
+	PTP_TIMER timer;
+	struct test_timer_context test;
+
+	ZeroMemory(&test, sizeof(test));
+	test.event = CreateEvent(NULL, TRUE, FALSE, NULL);
+	test.limit = 1;
+
+	timer = CreateThreadpoolTimer(test_TimerCallback, &test, NULL);
+
+	if (!timer)
+	{
+		printf("CreateThreadpoolTimer failure\n");
+		return -1;
+	}
+
+	for (index = 0; index < TEST_ONESHOT_COUNT; index++)
+	{
+		test.count = 0;
+		ResetEvent(test.event);
+
+		test_relative_due_time(&dueTime, TEST_ONESHOT_DUE);
+		test.due = test_now() + (TEST_ONESHOT_DUE * 1000);
+		SetThreadpoolTimer(timer, &dueTime, 0, 0);
+
+		if (!IsThreadpoolTimerSet(timer))
+		{
+			printf("IsThreadpoolTimerSet returned FALSE for a set timer\n");
+			return -1;
+		}
+
+		if (WaitForSingleObject(test.event, 1000) != WAIT_OBJECT_0)
+		{
+			printf("one-shot timer did not fire\n");
+			return -1;
+		}
+
+		late = (INT64) (test.fired[0] - test.due);
+
+		if (late < -1000)
+		{
+			printf("one-shot timer fired %d us early\n", (int) -late);
+			return -1;
+		}
+
+		total += late;
+
+		if (late > worst)
+			worst = late;
+
+		WaitForThreadpoolTimerCallbacks(timer, FALSE);
+
+		if (IsThreadpoolTimerSet(timer))
+		{
+			printf("one-shot timer still set after firing\n");
+			return -1;
+		}
+	}
+
+	printf("one-shot timers: %d us late on average, %d us at worst\n",
+			(int) (total / TEST_ONESHOT_COUNT), (int) worst);
+
+	CloseThreadpoolTimer(timer);
+	CloseHandle(test.event);
+
+	if (total / TEST_ONESHOT_COUNT > 5000)
+		return -1;
+
+	return 0;
+}
+
+/**
+ * Periodic timers keep their phase: the last of many periods must not
+ * have accumulated the scheduling delays of the previous ones. Periods
+ * missed under load are skipped, so each callback is compared with the
+ * period it falls in, and the least late of the last ones must be close.
+ */
+
+static int test_timer_periodic(void)
+{
+	int index;
+	INT64 late;
+	INT64 drift;
+	INT64 period;
+	UINT64 start;
+	FILETIME dueTime;
+	PTP_TIMER timer;
+	struct test_timer_context test;
+
+	ZeroMemory(&test, sizeof(test));
+	test.event = CreateEvent(NULL, TRUE, FALSE, NULL);
+	test.limit = TEST_PERIOD_COUNT;
+
+	timer = CreateThreadpoolTimer(test_TimerCallback, &test, NULL);
+
+	if (!timer)
+		return -1;
+
+	test_relative_due_time(&dueTime, TEST_PERIOD);
+	start = test_now();
+	SetThreadpoolTimer(timer, &dueTime, TEST_PERIOD, 0);
+
+	if (WaitForSingleObject(test.event, TEST_PERIOD * TEST_PERIOD_COUNT * 4) != WAIT_OBJECT_0)
+	{
+		printf("periodic timer fired %d times only\n", (int) test.count);
+		return -1;
+	}
+
+	SetThreadpoolTimer(timer, NULL, 0, 0);
+	WaitForThreadpoolTimerCallbacks(timer, TRUE);
+
+	period = TEST_PERIOD * 1000;
+	drift = period;
+
+	for (index = TEST_PERIOD_COUNT - 20; index < TEST_PERIOD_COUNT; index++)
+	{
+		late = ((INT64) (test.fired[index] - start)) % period;
+
+		if (late > period / 2)
+			late -= period;
+
+		if (late < drift)
+			drift = late;
+	}
+
+	printf("periodic timer: %d periods of %d ms, %d skipped, drift %d us\n",
+			TEST_PERIOD_COUNT, TEST_PERIOD, (int) (((test.fired[TEST_PERIOD_COUNT - 1] - start) + period / 2) /
+			period) - TEST_PERIOD_COUNT, (int) drift);
+
+	CloseThreadpoolTimer(timer);
+	CloseHandle(test.event);
+
+	if ((drift < -1000) || (drift > 5000))
+		return -1;
+
+	return 0;
+}
+
+/**
+ * Once WaitForThreadpoolTimerCallbacks has cancelled the pending callbacks
+ * of a stopped timer and returned, none may run anymore.
+ */
+
+static int test_timer_cancel(void)
 {
+	int index;
+	LONG count;
+	FILETIME dueTime;
+	PTP_TIMER timer;
+	struct test_timer_context test;
+
+	ZeroMemory(&test, sizeof(test));
+	test.event = CreateEvent(NULL, TRUE, FALSE, NULL);
+	test.limit = -1;
+
+	timer = CreateThreadpoolTimer(test_TimerCallback, &test, NULL);
+
+	if (!timer)
+		return -1;
+
+	for (index = 0; index < 50; index++)
+	{
+		ZeroMemory(&dueTime, sizeof(FILETIME));
+		SetThreadpoolTimer(timer, &dueTime, 1, 0);
+		Sleep(index % 5);
+
+		SetThreadpoolTimer(timer, NULL, 0, 0);
+		WaitForThreadpoolTimerCallbacks(timer, TRUE);
+
+		if (IsThreadpoolTimerSet(timer))
+		{
+			printf("stopped timer still set\n");
+			return -1;
+		}
+
+		count = test.count;
+		Sleep(3);
+
+		if (test.count != count)
+		{
+			printf("timer callback ran after its cancellation\n");
+			return -1;
+		}
+	}
+
+	printf("cancellation: %d callbacks before 50 cancellations\n", (int) test.count);
+
+	CloseThreadpoolTimer(timer);
+	CloseHandle(test.event);
+
 	return 0;
 }
 
+int TestPoolTimer(int argc, char* argv[])
+{
+	if (test_timer_precision() < 0)
+		return -1;
+
+	if (test_timer_periodic() < 0)
+		return -1;
+
+	if (test_timer_cancel() < 0)
+		return -1;
+
+	return 0;
+}
@@ -24,31 +24,64 @@
 #include <winpr/crt.h>
 #include <winpr/pool.h>
 
+#include "pool.h"
+
 #ifdef WINPR_THREAD_POOL
 
 PTP_TIMER CreateThreadpoolTimer(PTP_TIMER_CALLBACK pfnti, PVOID pv, PTP_CALLBACK_ENVIRON pcbe)
 {
-	return NULL;
+	PTP_TIMER timer = NULL;
+#ifdef WINPR_POOL_DISPATCHER
+	timer = (PTP_TIMER) calloc(1, sizeof(TP_TIMER));
+
+	if (!timer)
+		return NULL;
+
+	if (!InitializeThreadpoolObject(&timer->Object, TP_OBJECT_TIMER, pv, pcbe))
+	{
+		free(timer);
+		return NULL;
+	}
+
+	timer->TimerCallback = pfnti;
+#endif
+	return timer;
 }
 
 VOID CloseThreadpoolTimer(PTP_TIMER pti)
 {
-
+#ifdef WINPR_POOL_DISPATCHER
+	CloseThreadpoolObject(&pti->Object);
+#endif
 }
 
 BOOL IsThreadpoolTimerSet(PTP_TIMER pti)
 {
+#ifdef WINPR_POOL_DISPATCHER
+	return IsThreadpoolObjectTimerSet(&pti->Object);
+#else
 	return FALSE;
+#endif
 }
 
+/**
+ * The timer is due at pftDueTime, then every msPeriod milliseconds if not
+ * zero. A NULL pftDueTime stops the timer. msWindowLength, which allows
+ * delaying the callbacks to batch them, is not used.
+ */
+
 VOID SetThreadpoolTimer(PTP_TIMER pti, PFILETIME pftDueTime, DWORD msPeriod, DWORD msWindowLength)
 {
-
+#ifdef WINPR_POOL_DISPATCHER
+	SetThreadpoolObjectTimer(&pti->Object, pftDueTime, msPeriod);
+#endif
 }
 
 VOID WaitForThreadpoolTimerCallbacks(PTP_TIMER pti, BOOL fCancelPendingCallbacks)
 {
-
+#ifdef WINPR_POOL_DISPATCHER
+	WaitForThreadpoolObjectCallbacks(&pti->Object, fCancelPendingCallbacks);
+#endif
 }
 
 #endif
\ No newline at end of file
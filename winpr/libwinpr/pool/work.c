@@ -115,7 +115,7 @@ VOID SubmitThreadpoolWork(PTP_WORK pwk)
 	PTP_POOL pool;
 	PTP_CALLBACK_INSTANCE callbackInstance;
 	pool = pwk->CallbackEnvironment->Pool;
-	callbackInstance = (PTP_CALLBACK_INSTANCE) malloc(sizeof(TP_CALLBACK_INSTANCE));
+	callbackInstance = (PTP_CALLBACK_INSTANCE) calloc(1, sizeof(TP_CALLBACK_INSTANCE));
 
 	if (callbackInstance)
 	{
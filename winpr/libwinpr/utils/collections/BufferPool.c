@@ -25,93 +25,94 @@
 
 #include <winpr/collections.h>
 
+#include "PoolCache.h"
+
 /**
  * C equivalent of the C# BufferManager Class:
  * http://msdn.microsoft.com/en-us/library/ms405814.aspx
  */
 
 /**
- * Methods
+ * Buffers are cached by power-of-two size class (see PoolCache.c). Each
+ * buffer is preceded by a header recording its capacity and requested size,
+ * so that returning a buffer or querying its size needs no lookup.
  */
 
-static BOOL BufferPool_ShiftAvailable(wBufferPool* pool, int index, int count)
+struct _wBufferPoolHeader
 {
-	if (count > 0)
-	{
-		if (pool->aSize + count > pool->aCapacity)
-		{
-			wBufferPoolItem *newArray;
-			int newCapacity = pool->aCapacity * 2;
-
-			newArray = (wBufferPoolItem*) realloc(pool->aArray, sizeof(wBufferPoolItem) * newCapacity);
-			if (!newArray)
-				return FALSE;
-			pool->aArray = newArray;
-			pool->aCapacity = newCapacity;
-		}
+	void* next;
+	size_t capacity;
+	size_t size;
+};
+typedef struct _wBufferPoolHeader wBufferPoolHeader;
 
-		MoveMemory(&pool->aArray[index + count], &pool->aArray[index], (pool->aSize - index) * sizeof(wBufferPoolItem));
-		pool->aSize += count;
-	}
-	else if (count < 0)
-	{
-		MoveMemory(&pool->aArray[index], &pool->aArray[index - count], (pool->aSize - index) * sizeof(wBufferPoolItem));
-		pool->aSize += count;
-	}
-	return TRUE;
+#define BufferPool_Header(_buffer) ((wBufferPoolHeader*) (((BYTE*) (_buffer)) - sizeof(wBufferPoolHeader)))
+
+static void* BufferPool_AllocBuffer(void* context, size_t size)
+{
+	BYTE* base;
+	wBufferPoolHeader* header;
+	wBufferPool* pool = (wBufferPool*) context;
+
+	if (pool->alignment)
+		base = (BYTE*) _aligned_malloc(pool->headerSize + size, pool->alignment);
+	else
+		base = (BYTE*) malloc(pool->headerSize + size);
+
+	if (!base)
+		return NULL;
+
+	header = BufferPool_Header(base + pool->headerSize);
+	header->next = NULL;
+	header->capacity = size;
+	header->size = size;
+
+	return base + pool->headerSize;
 }
 
-static BOOL BufferPool_ShiftUsed(wBufferPool* pool, int index, int count)
+static void BufferPool_FreeBuffer(void* context, void* item)
 {
-	if (count > 0)
-	{
-		if (pool->uSize + count > pool->uCapacity)
-		{
-			int newUCapacity = pool->uCapacity * 2;
-			wBufferPoolItem *newUArray = (wBufferPoolItem *)realloc(pool->uArray, sizeof(wBufferPoolItem) *newUCapacity);
-			if (!newUArray)
-				return FALSE;
-			pool->uCapacity = newUCapacity;
-			pool->uArray = newUArray;
-		}
+	wBufferPool* pool = (wBufferPool*) context;
+	BYTE* base = ((BYTE*) item) - pool->headerSize;
 
-		MoveMemory(&pool->uArray[index + count], &pool->uArray[index], (pool->uSize - index) * sizeof(wBufferPoolItem));
-		pool->uSize += count;
-	}
-	else if (count < 0)
-	{
-		MoveMemory(&pool->uArray[index], &pool->uArray[index - count], (pool->uSize - index) * sizeof(wBufferPoolItem));
-		pool->uSize += count;
-	}
-	return TRUE;
+	if (pool->alignment)
+		_aligned_free(base);
+	else
+		free(base);
 }
 
+static size_t BufferPool_BufferSize(void* item)
+{
+	return BufferPool_Header(item)->capacity;
+}
+
+static void** BufferPool_BufferLink(void* item)
+{
+	return &BufferPool_Header(item)->next;
+}
+
+/**
+ * Methods
+ */
+
 /**
  * Get the buffer pool size
  */
 
 int BufferPool_GetPoolSize(wBufferPool* pool)
 {
-	int size;
+	wPoolStatistics statistics;
 
-	if (pool->synchronized)
-		EnterCriticalSection(&pool->lock);
+	PoolCache_GetStatistics(pool->cache, &statistics);
 
 	if (pool->fixedSize)
 	{
 		/* fixed size buffers */
-		size = pool->size;
-	}
-	else
-	{
-		/* variable size buffers */
-		size = pool->uSize;
+		return (int) statistics.itemsHeld;
 	}
 
-	if (pool->synchronized)
-		LeaveCriticalSection(&pool->lock);
-
-	return size;
+	/* variable size buffers */
+	return (int) statistics.itemsInUse;
 }
 
 /**
@@ -120,38 +121,18 @@ int BufferPool_GetPoolSize(wBufferPool* pool)
 
 int BufferPool_GetBufferSize(wBufferPool* pool, void* buffer)
 {
-	int size = 0;
-	int index = 0;
-	BOOL found = FALSE;
-
-	if (pool->synchronized)
-		EnterCriticalSection(&pool->lock);
-
 	if (pool->fixedSize)
 	{
 		/* fixed size buffers */
-		size = pool->fixedSize;
-		found = TRUE;
+		return pool->fixedSize;
 	}
-	else
-	{
-		/* variable size buffers */
 
-		for (index = 0; index < pool->uSize; index++)
-		{
-			if (pool->uArray[index].buffer == buffer)
-			{
-				size = pool->uArray[index].size;
-				found = TRUE;
-				break;
-			}
-		}
-	}
+	/* variable size buffers */
 
-	if (pool->synchronized)
-		LeaveCriticalSection(&pool->lock);
+	if (!buffer)
+		return -1;
 
-	return (found) ? size : -1;
+	return (int) BufferPool_Header(buffer)->size;
 }
 
 /**
@@ -160,131 +141,22 @@ int BufferPool_GetBufferSize(wBufferPool* pool, void* buffer)
 
 void* BufferPool_Take(wBufferPool* pool, int size)
 {
-	int index;
-	int maxSize;
-	int maxIndex;
-	int foundIndex;
-	BOOL found = FALSE;
-	void* buffer = NULL;
-
-	if (pool->synchronized)
-		EnterCriticalSection(&pool->lock);
+	void* buffer;
 
 	if (pool->fixedSize)
-	{
-		/* fixed size buffers */
-
-		if (pool->size > 0)
-			buffer = pool->array[--(pool->size)];
-
-		if (!buffer)
-		{
-			if (pool->alignment)
-				buffer = _aligned_malloc(pool->fixedSize, pool->alignment);
-			else
-				buffer = malloc(pool->fixedSize);
-		}
-
-		if (!buffer)
-			goto out_error;
-	}
-	else
-	{
-		/* variable size buffers */
-
-		maxSize = 0;
-		maxIndex = 0;
-
-		if (size < 1)
-			size = pool->fixedSize;
-
-		for (index = 0; index < pool->aSize; index++)
-		{
-			if (pool->aArray[index].size > maxSize)
-			{
-				maxIndex = index;
-				maxSize = pool->aArray[index].size;
-			}
-
-			if (pool->aArray[index].size >= size)
-			{
-				foundIndex = index;
-				found = TRUE;
-				break;
-			}
-		}
-
-		if (!found && maxSize)
-		{
-			foundIndex = maxIndex;
-			found = TRUE;
-		}
-
-		if (!found)
-		{
-			if (!size)
-				buffer = NULL;
-			else if (pool->alignment)
-				buffer = _aligned_malloc(size, pool->alignment);
-			else
-				buffer = malloc(size);
-		}
-		else
-		{
-			buffer = pool->aArray[foundIndex].buffer;
-
-			if (maxSize < size)
-			{
-				if (pool->alignment)
-				{
-					_aligned_free(buffer);
-					buffer = _aligned_malloc(size, pool->alignment);
-				}
-				else
-				{
-					void *newBuffer = realloc(buffer, size);
-					if (!newBuffer)
-						goto out_error;
-
-					buffer = newBuffer;
-				}
-			}
-
-			if (!BufferPool_ShiftAvailable(pool, foundIndex, -1))
-				goto out_error;
-		}
+		size = pool->fixedSize;
 
-		if (!buffer)
-			goto out_error;
+	if (size < 1)
+		return NULL;
 
-		if (pool->uSize + 1 > pool->uCapacity)
-		{
-			int newUCapacity = pool->uCapacity * 2;
-			wBufferPoolItem *newUArray = (wBufferPoolItem *)realloc(pool->uArray, sizeof(wBufferPoolItem) * newUCapacity);
-			if (!newUArray)
-				goto out_error;
+	buffer = PoolCache_Get(pool->cache, (size_t) size);
 
-			pool->uCapacity = newUCapacity;
-			pool->uArray = newUArray;
-		}
+	if (!buffer)
+		return NULL;
 
-		pool->uArray[pool->uSize].buffer = buffer;
-		pool->uArray[pool->uSize].size = size;
-		(pool->uSize)++;
-	}
-
-	if (pool->synchronized)
-		LeaveCriticalSection(&pool->lock);
+	BufferPool_Header(buffer)->size = (size_t) size;
 
 	return buffer;
-
-out_error:
-	if (buffer)
-		free(buffer);
-
-	if (pool->synchronized)
-		LeaveCriticalSection(&pool->lock);
-	return NULL;
 }
 
 /**
@@ -293,129 +165,31 @@ out_error:
 
 BOOL BufferPool_Return(wBufferPool* pool, void* buffer)
 {
-	int size = 0;
-	int index = 0;
-	BOOL found = FALSE;
-
-	if (pool->synchronized)
-		EnterCriticalSection(&pool->lock);
-
-	if (pool->fixedSize)
-	{
-		/* fixed size buffers */
-
-		if ((pool->size + 1) >= pool->capacity)
-		{
-			int newCapacity = pool->capacity * 2;
-			void **newArray = (void **)realloc(pool->array, sizeof(void*) * newCapacity);
-			if (!newArray)
-				goto out_error;
-
-			pool->capacity = newCapacity;
-			pool->array = newArray;
-		}
+	if (!buffer)
+		return FALSE;
 
-		pool->array[(pool->size)++] = buffer;
-	}
-	else
-	{
-		/* variable size buffers */
+	PoolCache_Put(pool->cache, buffer);
 
-		for (index = 0; index < pool->uSize; index++)
-		{
-			if (pool->uArray[index].buffer == buffer)
-			{
-				found = TRUE;
-				break;
-			}
-		}
-
-		if (found)
-		{
-			size = pool->uArray[index].size;
-			if (!BufferPool_ShiftUsed(pool, index, -1))
-				goto out_error;
-		}
-
-		if (size)
-		{
-			if ((pool->aSize + 1) >= pool->aCapacity)
-			{
-				int newCapacity = pool->aCapacity * 2;
-				wBufferPoolItem *newArray = (wBufferPoolItem*) realloc(pool->aArray, sizeof(wBufferPoolItem) * newCapacity);
-				if (!newArray)
-					goto out_error;
-
-				pool->aCapacity = newCapacity;
-				pool->aArray = newArray;
-			}
-
-			pool->aArray[pool->aSize].buffer = buffer;
-			pool->aArray[pool->aSize].size = size;
-			(pool->aSize)++;
-		}
-	}
-
-	if (pool->synchronized)
-		LeaveCriticalSection(&pool->lock);
 	return TRUE;
-
-out_error:
-	if (pool->synchronized)
-		LeaveCriticalSection(&pool->lock);
-	return FALSE;
 }
 
 /**
- * Releases the buffers currently cached in the pool.
+ * Releases the buffers currently cached in the pool. Buffers that have
+ * been taken and not returned are not tracked, and are left to the caller.
  */
 
 void BufferPool_Clear(wBufferPool* pool)
 {
-	if (pool->synchronized)
-		EnterCriticalSection(&pool->lock);
-
-	if (pool->fixedSize)
-	{
-		/* fixed size buffers */
-
-		while (pool->size > 0)
-		{
-			(pool->size)--;
-
-			if (pool->alignment)
-				_aligned_free(pool->array[pool->size]);
-			else
-				free(pool->array[pool->size]);
-		}
-	}
-	else
-	{
-		/* variable size buffers */
-
-		while (pool->aSize > 0)
-		{
-			(pool->aSize)--;
-
-			if (pool->alignment)
-				_aligned_free(pool->aArray[pool->aSize].buffer);
-			else
-				free(pool->aArray[pool->aSize].buffer);
-		}
-
-		while (pool->uSize > 0)
-		{
-			(pool->uSize)--;
+	PoolCache_Clear(pool->cache);
+}
 
-			if (pool->alignment)
-				_aligned_free(pool->uArray[pool->uSize].buffer);
-			else
-				free(pool->uArray[pool->uSize].buffer);
-		}
-	}
+/**
+ * Gets the pool counters.
+ */
 
-	if (pool->synchronized)
-		LeaveCriticalSection(&pool->lock);
+void BufferPool_GetStatistics(wBufferPool* pool, wPoolStatistics* statistics)
+{
+	PoolCache_GetStatistics(pool->cache, statistics);
 }
 
 /**
@@ -424,9 +198,10 @@ void BufferPool_Clear(wBufferPool* pool)
 
 wBufferPool* BufferPool_New(BOOL synchronized, int fixedSize, DWORD alignment)
 {
+	size_t align;
 	wBufferPool* pool = NULL;
 
-	pool = (wBufferPool*) malloc(sizeof(wBufferPool));
+	pool = (wBufferPool*) calloc(1, sizeof(wBufferPool));
 
 	if (pool)
 	{
@@ -438,28 +213,18 @@ wBufferPool* BufferPool_New(BOOL synchronized, int fixedSize, DWORD alignment)
 		pool->alignment = alignment;
 		pool->synchronized = synchronized;
 
-		if (pool->synchronized)
-			InitializeCriticalSectionAndSpinCount(&pool->lock, 4000);
+		/* the header must keep the buffer that follows it aligned */
 
-		if (pool->fixedSize)
-		{
-			/* fixed size buffers */
+		align = pool->alignment ? pool->alignment : 16;
+		pool->headerSize = (sizeof(wBufferPoolHeader) + align - 1) & ~(align - 1);
 
-			pool->size = 0;
-			pool->capacity = 32;
-			pool->array = (void**) malloc(sizeof(void*) * pool->capacity);
-		}
-		else
-		{
-			/* variable size buffers */
+		pool->cache = PoolCache_New(synchronized, pool, BufferPool_AllocBuffer,
+				BufferPool_FreeBuffer, BufferPool_BufferSize, BufferPool_BufferLink);
 
-			pool->aSize = 0;
-			pool->aCapacity = 32;
-			pool->aArray = (wBufferPoolItem*) malloc(sizeof(wBufferPoolItem) * pool->aCapacity);
-
-			pool->uSize = 0;
-			pool->uCapacity = 32;
-			pool->uArray = (wBufferPoolItem*) malloc(sizeof(wBufferPoolItem) * pool->uCapacity);
+		if (!pool->cache)
+		{
+			free(pool);
+			return NULL;
 		}
 	}
 
@@ -470,24 +235,7 @@ void BufferPool_Free(wBufferPool* pool)
 {
 	if (pool)
 	{
-		BufferPool_Clear(pool);
-
-		if (pool->synchronized)
-			DeleteCriticalSection(&pool->lock);
-
-		if (pool->fixedSize)
-		{
-			/* fixed size buffers */
-
-			free(pool->array);
-		}
-		else
-		{
-			/* variable size buffers */
-
-			free(pool->aArray);
-			free(pool->uArray);
-		}
+		PoolCache_Free(pool->cache);
 
 		free(pool);
 	}
@@ -22,7 +22,9 @@
 #endif
 
 #include <winpr/crt.h>
+#include <winpr/thread.h>
 #include <winpr/sysinfo.h>
+#include <winpr/interlocked.h>
 
 #include <winpr/collections.h>
 
@@ -31,6 +33,207 @@
  * http://msdn.microsoft.com/en-us/library/ms632590/
  */
 
+/**
+ * Lock-free variants
+ *
+ * The ring is a bounded queue of sequenced slots: a writer may fill the
+ * slot at position pos when its sequence is pos, and publishes it by
+ * setting the sequence to pos + 1. The reader releases the slot for the
+ * next lap by setting the sequence to pos + capacity.
+ *
+ * A writer that finds the ring full spills into the locked array, and
+ * keeps doing so until the reader has taken all spilled messages. The
+ * reader only reads the array once the ring is empty, so the messages of
+ * each writer stay in order and posting never blocks.
+ *
+ * count holds the number of messages in the ring and the array. The event
+ * is set when it goes from zero to one and reset when it drops to zero.
+ */
+
+#define WMQ_RING_CAPACITY	1024
+#define WMQ_CACHE_LINE_SIZE	64
+
+typedef struct _wMessageSlot wMessageSlot;
+
+struct _wMessageSlot
+{
+	LONG volatile sequence;
+	wMessage message;
+};
+
+struct _wMessageRing
+{
+	LONG volatile enqueue;
+	BYTE padding1[WMQ_CACHE_LINE_SIZE - sizeof(LONG)];
+
+	LONG volatile dequeue;
+	BYTE padding2[WMQ_CACHE_LINE_SIZE - sizeof(LONG)];
+
+	LONG volatile count;
+	LONG volatile overflow;
+	BYTE padding3[WMQ_CACHE_LINE_SIZE - (2 * sizeof(LONG))];
+
+	ULONG mask;
+	wMessageSlot* slots;
+};
+
+static LONG MessageQueue_SlotSequence(wMessageSlot* slot)
+{
+	return InterlockedCompareExchange(&slot->sequence, 0, 0);
+}
+
+static BOOL MessageQueue_RingPost(wMessageQueue* queue, wMessage* message)
+{
+	LONG diff;
+	ULONG position;
+	wMessageSlot* slot;
+	wMessageRing* ring = queue->ring;
+
+	position = (ULONG) ring->enqueue;
+
+	while (1)
+	{
+		slot = &ring->slots[position & ring->mask];
+		diff = (LONG) ((ULONG) MessageQueue_SlotSequence(slot) - position);
+
+		if (diff == 0)
+		{
+			if (queue->flags & WMQ_FLAG_SPSC)
+			{
+				ring->enqueue = (LONG) (position + 1);
+				break;
+			}
+
+			if (InterlockedCompareExchange(&ring->enqueue, (LONG) (position + 1), (LONG) position) == (LONG) position)
+				break;
+		}
+		else if (diff < 0)
+		{
+			/* full */
+			return FALSE;
+		}
+
+		position = (ULONG) ring->enqueue;
+	}
+
+	CopyMemory(&slot->message, message, sizeof(wMessage));
+	slot->message.time = (UINT64) GetTickCount();
+
+	InterlockedExchange(&slot->sequence, (LONG) (position + 1));
+
+	return TRUE;
+}
+
+static void MessageQueue_RingRemoved(wMessageQueue* queue)
+{
+	wMessageRing* ring = queue->ring;
+
+	if (InterlockedDecrement(&ring->count) == 0)
+	{
+		ResetEvent(queue->event);
+
+		/* a writer may have posted between the decrement and the reset */
+
+		if (InterlockedCompareExchange(&ring->count, 0, 0) > 0)
+			SetEvent(queue->event);
+	}
+}
+
+/**
+ * Array
+ */
+
+static void MessageQueue_ArrayPush(wMessageQueue* queue, wMessage* message)
+{
+	if (queue->size == queue->capacity)
+	{
+		int old_capacity;
+		int new_capacity;
+
+		old_capacity = queue->capacity;
+		new_capacity = queue->capacity * 2;
+
+		queue->capacity = new_capacity;
+		queue->array = (wMessage*) realloc(queue->array, sizeof(wMessage) * queue->capacity);
+		ZeroMemory(&(queue->array[old_capacity]), old_capacity * sizeof(wMessage));
+
+		if (queue->tail < old_capacity)
+		{
+			CopyMemory(&(queue->array[old_capacity]), queue->array, queue->tail * sizeof(wMessage));
+			queue->tail += old_capacity;
+		}
+	}
+
+	CopyMemory(&(queue->array[queue->tail]), message, sizeof(wMessage));
+	queue->array[queue->tail].time = (UINT64) GetTickCount();
+
+	queue->tail = (queue->tail + 1) % queue->capacity;
+	queue->size++;
+}
+
+static int MessageQueue_ArrayPeek(wMessageQueue* queue, wMessage* message, BOOL remove)
+{
+	if (queue->size < 1)
+		return 0;
+
+	CopyMemory(message, &(queue->array[queue->head]), sizeof(wMessage));
+
+	if (remove)
+	{
+		ZeroMemory(&(queue->array[queue->head]), sizeof(wMessage));
+		queue->head = (queue->head + 1) % queue->capacity;
+		queue->size--;
+	}
+
+	return 1;
+}
+
+static int MessageQueue_RingPeek(wMessageQueue* queue, wMessage* message, BOOL remove)
+{
+	int status;
+	ULONG position;
+	wMessageSlot* slot;
+	wMessageRing* ring = queue->ring;
+
+	position = (ULONG) ring->dequeue;
+	slot = &ring->slots[position & ring->mask];
+
+	if ((ULONG) MessageQueue_SlotSequence(slot) == (position + 1))
+	{
+		CopyMemory(message, &slot->message, sizeof(wMessage));
+
+		if (remove)
+		{
+			ZeroMemory(&slot->message, sizeof(wMessage));
+			InterlockedExchange(&slot->sequence, (LONG) (position + ring->mask + 1));
+			InterlockedExchange(&ring->dequeue, (LONG) (position + 1));
+
+			MessageQueue_RingRemoved(queue);
+		}
+
+		return 1;
+	}
+
+	/* the head slot may be claimed but not yet published */
+
+	if (((ULONG) ring->enqueue != position) || !InterlockedCompareExchange(&ring->overflow, 0, 0))
+		return 0;
+
+	EnterCriticalSection(&queue->lock);
+
+	status = MessageQueue_ArrayPeek(queue, message, remove);
+
+	if (status && remove)
+		InterlockedDecrement(&ring->overflow);
+
+	LeaveCriticalSection(&queue->lock);
+
+	if (status && remove)
+		MessageQueue_RingRemoved(queue);
+
+	return status;
+}
+
 /**
  * Properties
  */
@@ -50,6 +253,9 @@ HANDLE MessageQueue_Event(wMessageQueue* queue)
 
 int MessageQueue_Size(wMessageQueue* queue)
 {
+	if (queue->ring)
+		return (int) InterlockedCompareExchange(&queue->ring->count, 0, 0);
+
 	return queue->size;
 }
 
@@ -69,33 +275,27 @@ BOOL MessageQueue_Wait(wMessageQueue* queue)
 
 void MessageQueue_Dispatch(wMessageQueue* queue, wMessage* message)
 {
-	EnterCriticalSection(&queue->lock);
+	wMessageRing* ring = queue->ring;
 
-	if (queue->size == queue->capacity)
+	if (ring)
 	{
-		int old_capacity;
-		int new_capacity;
-
-		old_capacity = queue->capacity;
-		new_capacity = queue->capacity * 2;
-
-		queue->capacity = new_capacity;
-		queue->array = (wMessage*) realloc(queue->array, sizeof(wMessage) * queue->capacity);
-		ZeroMemory(&(queue->array[old_capacity]), old_capacity * sizeof(wMessage));
-
-		if (queue->tail < old_capacity)
+		if (InterlockedCompareExchange(&ring->overflow, 0, 0) || !MessageQueue_RingPost(queue, message))
 		{
-			CopyMemory(&(queue->array[old_capacity]), queue->array, queue->tail * sizeof(wMessage));
-			queue->tail += old_capacity;
+			EnterCriticalSection(&queue->lock);
+			MessageQueue_ArrayPush(queue, message);
+			InterlockedIncrement(&ring->overflow);
+			LeaveCriticalSection(&queue->lock);
 		}
+
+		if (InterlockedIncrement(&ring->count) == 1)
+			SetEvent(queue->event);
+
+		return;
 	}
 
-	CopyMemory(&(queue->array[queue->tail]), message, sizeof(wMessage));
-	queue->tail = (queue->tail + 1) % queue->capacity;
-	queue->size++;
+	EnterCriticalSection(&queue->lock);
 
-	message = &(queue->array[queue->tail]);
-	message->time = (UINT64) GetTickCount();
+	MessageQueue_ArrayPush(queue, message);
 
 	if (queue->size > 0)
 		SetEvent(queue->event);
@@ -125,18 +325,30 @@ int MessageQueue_Get(wMessageQueue* queue, wMessage* message)
 {
 	int status = -1;
 
+	if (queue->ring)
+	{
+		while (MessageQueue_Wait(queue))
+		{
+			if (MessageQueue_RingPeek(queue, message, TRUE))
+				return (message->id != WMQ_QUIT) ? 1 : 0;
+
+			if (!MessageQueue_Size(queue))
+				break;
+
+			/* a writer is still filling the head slot */
+			SwitchToThread();
+		}
+
+		return status;
+	}
+
 	if (!MessageQueue_Wait(queue))
 		return status;
 
 	EnterCriticalSection(&queue->lock);
 
-	if (queue->size > 0)
+	if (MessageQueue_ArrayPeek(queue, message, TRUE))
 	{
-		CopyMemory(message, &(queue->array[queue->head]), sizeof(wMessage));
-		ZeroMemory(&(queue->array[queue->head]), sizeof(wMessage));
-		queue->head = (queue->head + 1) % queue->capacity;
-		queue->size--;
-
 		if (queue->size < 1)
 			ResetEvent(queue->event);
 
@@ -152,23 +364,15 @@ int MessageQueue_Peek(wMessageQueue* queue, wMessage* message, BOOL remove)
 {
 	int status = 0;
 
-	EnterCriticalSection(&queue->lock);
+	if (queue->ring)
+		return MessageQueue_RingPeek(queue, message, remove);
 
-	if (queue->size > 0)
-	{
-		CopyMemory(message, &(queue->array[queue->head]), sizeof(wMessage));
-		status = 1;
+	EnterCriticalSection(&queue->lock);
 
-		if (remove)
-		{
-			ZeroMemory(&(queue->array[queue->head]), sizeof(wMessage));
-			queue->head = (queue->head + 1) % queue->capacity;
-			queue->size--;
+	status = MessageQueue_ArrayPeek(queue, message, remove);
 
-			if (queue->size < 1)
-				ResetEvent(queue->event);
-		}
-	}
+	if (status && remove && (queue->size < 1))
+		ResetEvent(queue->event);
 
 	LeaveCriticalSection(&queue->lock);
 
@@ -179,7 +383,41 @@ int MessageQueue_Peek(wMessageQueue* queue, wMessage* message, BOOL remove)
  * Construction, Destruction
  */
 
-wMessageQueue* MessageQueue_New(const wObject *callback)
+static wMessageRing* MessageQueue_RingNew(int capacity)
+{
+	ULONG index;
+	ULONG size = 1;
+	wMessageRing* ring;
+
+	if (capacity < 1)
+		capacity = WMQ_RING_CAPACITY;
+
+	while (size < (ULONG) capacity)
+		size <<= 1;
+
+	ring = (wMessageRing*) _aligned_malloc(sizeof(wMessageRing), WMQ_CACHE_LINE_SIZE);
+
+	if (!ring)
+		return NULL;
+
+	ZeroMemory(ring, sizeof(wMessageRing));
+
+	ring->mask = size - 1;
+	ring->slots = (wMessageSlot*) calloc(size, sizeof(wMessageSlot));
+
+	if (!ring->slots)
+	{
+		_aligned_free(ring);
+		return NULL;
+	}
+
+	for (index = 0; index < size; index++)
+		ring->slots[index].sequence = (LONG) index;
+
+	return ring;
+}
+
+wMessageQueue* MessageQueue_NewEx(const wObject *callback, DWORD flags, int capacity)
 {
 	wMessageQueue* queue = NULL;
 
@@ -195,6 +433,21 @@ wMessageQueue* MessageQueue_New(const wObject *callback)
 		queue->array = (wMessage*) malloc(sizeof(wMessage) * queue->capacity);
 		ZeroMemory(queue->array, sizeof(wMessage) * queue->capacity);
 
+		queue->flags = flags;
+		queue->ring = NULL;
+
+		if (flags & (WMQ_FLAG_MPSC | WMQ_FLAG_SPSC))
+		{
+			queue->ring = MessageQueue_RingNew(capacity);
+
+			if (!queue->ring)
+			{
+				free(queue->array);
+				free(queue);
+				return NULL;
+			}
+		}
+
 		InitializeCriticalSectionAndSpinCount(&queue->lock, 4000);
 		queue->event = CreateEvent(NULL, TRUE, FALSE, NULL);
 
@@ -207,11 +460,22 @@ wMessageQueue* MessageQueue_New(const wObject *callback)
 	return queue;
 }
 
+wMessageQueue* MessageQueue_New(const wObject *callback)
+{
+	return MessageQueue_NewEx(callback, 0, 0);
+}
+
 void MessageQueue_Free(wMessageQueue* queue)
 {
 	CloseHandle(queue->event);
 	DeleteCriticalSection(&queue->lock);
 
+	if (queue->ring)
+	{
+		free(queue->ring->slots);
+		_aligned_free(queue->ring);
+	}
+
 	free(queue->array);
 	free(queue);
 }
@@ -220,6 +484,28 @@ int MessageQueue_Clear(wMessageQueue *queue)
 {
 	int status = 0;
 
+	if (queue->ring)
+	{
+		wMessage message;
+
+		while (MessageQueue_Size(queue) > 0)
+		{
+			if (!MessageQueue_RingPeek(queue, &message, TRUE))
+			{
+				SwitchToThread();
+				continue;
+			}
+
+			/* Free resources of message. */
+			if (queue->object.fnObjectUninit)
+				queue->object.fnObjectUninit(&message);
+			if (queue->object.fnObjectFree)
+				queue->object.fnObjectFree(&message);
+		}
+
+		return status;
+	}
+
 	EnterCriticalSection(&queue->lock);
 
 	while(queue->size > 0)
@@ -0,0 +1,674 @@
+/**
+ * WinPR: Windows Portable Runtime
+ * Size Class Pool Cache
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <winpr/crt.h>
+#include <winpr/thread.h>
+#include <winpr/sysinfo.h>
+
+#include "PoolCache.h"
+
+/**
+ * Magazine allocator, after Bonwick & Adams, "Magazines and Vmem" (2001).
+ *
+ * Every thread owns a small stack (magazine) of free items per size class
+ * and takes from or returns to it without locking. Only when a magazine
+ * runs empty or full is half of it exchanged with the shared depot, under
+ * the lock. The depot chains free items through a link inside the item, so
+ * no array ever needs to grow.
+ *
+ * The depot is trimmed to its working set: items that stayed unused in the
+ * depot for a whole trim interval are freed, and returns beyond the high
+ * water mark are freed right away instead of being cached. The high water
+ * mark covers the magazines as well, as of the last time each thread took
+ * the lock.
+ *
+ * The magazines of a thread are flushed to the depot when it exits, from a
+ * thread local storage destructor. The pool must thus outlive the threads
+ * using it, or be freed only after they exited.
+ */
+
+#define PoolCache_Lock(_cache)		if ((_cache)->synchronized) EnterCriticalSection(&(_cache)->lock)
+#define PoolCache_Unlock(_cache)	if ((_cache)->synchronized) LeaveCriticalSection(&(_cache)->lock)
+
+/**
+ * Smallest class whose items can hold size bytes.
+ */
+
+static INLINE int PoolCache_Class(size_t size)
+{
+	if (size <= ((size_t) 1 << POOL_CACHE_MIN_CLASS))
+		return POOL_CACHE_MIN_CLASS;
+
+	if (size > ((size_t) 1 << POOL_CACHE_MAX_CLASS))
+		return POOL_CACHE_MAX_CLASS + 1;
+
+	return (int) (32 - __lzcnt((UINT32) (size - 1)));
+}
+
+/**
+ * Largest class an item of size bytes can serve.
+ */
+
+static INLINE int PoolCache_FloorClass(size_t size)
+{
+	if (size < ((size_t) 1 << POOL_CACHE_MIN_CLASS))
+		return -1;
+
+	if (size >= ((size_t) 1 << (POOL_CACHE_MAX_CLASS + 1)))
+		return POOL_CACHE_MAX_CLASS + 1;
+
+	return (int) (31 - __lzcnt((UINT32) size));
+}
+
+static void PoolCache_FreeChain(wPoolCache* cache, void* chain)
+{
+	void* next;
+
+	while (chain)
+	{
+		next = *cache->link(chain);
+		cache->free(cache->context, chain);
+		chain = next;
+	}
+}
+
+/**
+ * Makes the bytes held by the magazines of a thread count against the high
+ * water mark, called with the lock held.
+ */
+
+static INLINE void PoolCache_Publish(wPoolCache* cache, wPoolThreadCache* tc)
+{
+	cache->magazineBytes += tc->bytes - tc->published;
+	tc->published = tc->bytes;
+}
+
+static void* PoolCache_DepotPop(wPoolCache* cache, int k)
+{
+	void* item;
+	wPoolDepot* depot = &cache->depot[k];
+
+	item = depot->head;
+
+	if (!item)
+		return NULL;
+
+	depot->head = *cache->link(item);
+	depot->count--;
+
+	if (depot->count < depot->minCount)
+		depot->minCount = depot->count;
+
+	cache->depotItems--;
+	cache->depotBytes -= cache->size(item);
+
+	return item;
+}
+
+static void PoolCache_DepotPush(wPoolCache* cache, int k, void* item, void** chain)
+{
+	size_t size = cache->size(item);
+	wPoolDepot* depot = &cache->depot[k];
+
+	if (cache->depotBytes + cache->magazineBytes + size > cache->highWater)
+	{
+		*cache->link(item) = *chain;
+		*chain = item;
+		cache->trimmed++;
+		return;
+	}
+
+	*cache->link(item) = depot->head;
+	depot->head = item;
+	depot->count++;
+
+	cache->depotItems++;
+	cache->depotBytes += size;
+}
+
+/**
+ * Frees the items that no thread asked for during the last interval:
+ * the lowest depot level seen since the previous trim.
+ */
+
+static void PoolCache_DepotTrim(wPoolCache* cache, void** chain)
+{
+	int k;
+	int excess;
+	void* item;
+	UINT64 now = GetTickCount64();
+
+	if ((now - cache->trimTime) < POOL_CACHE_TRIM_INTERVAL)
+		return;
+
+	cache->trimTime = now;
+
+	for (k = POOL_CACHE_MIN_CLASS; k < POOL_CACHE_CLASSES; k++)
+	{
+		excess = cache->depot[k].minCount;
+
+		while ((excess-- > 0) && (item = PoolCache_DepotPop(cache, k)))
+		{
+			*cache->link(item) = *chain;
+			*chain = item;
+			cache->trimmed++;
+		}
+
+		cache->depot[k].minCount = cache->depot[k].count;
+	}
+}
+
+/**
+ * Flushes the magazines of an exiting thread to the depot, keeps its
+ * counters with the pool and frees its cache.
+ */
+
+static void WINAPI PoolCache_ThreadExit(void* value)
+{
+	int k;
+	void* item;
+	void* chain = NULL;
+	wPoolThreadCache** link;
+	wPoolMagazine* magazine;
+	wPoolThreadCache* tc = (wPoolThreadCache*) value;
+	wPoolCache* cache;
+
+	if (!tc)
+		return;
+
+	cache = tc->cache;
+
+	EnterCriticalSection(&cache->lock);
+
+	for (link = &cache->caches; *link; link = &(*link)->next)
+	{
+		if (*link == tc)
+		{
+			*link = tc->next;
+			break;
+		}
+	}
+
+	cache->magazineBytes -= tc->published;
+
+	for (k = POOL_CACHE_MIN_CLASS; k < POOL_CACHE_CLASSES; k++)
+	{
+		magazine = &tc->magazines[k];
+
+		while (magazine->count > 0)
+		{
+			item = magazine->rounds[--(magazine->count)];
+			PoolCache_DepotPush(cache, k, item, &chain);
+		}
+	}
+
+	cache->shared.hits += tc->hits;
+	cache->shared.misses += tc->misses;
+	cache->shared.returns += tc->returns;
+
+	LeaveCriticalSection(&cache->lock);
+
+	PoolCache_FreeChain(cache, chain);
+	free(tc);
+}
+
+static BOOL PoolCache_TlsAlloc(wPoolCache* cache)
+{
+#ifdef _WIN32
+	cache->tlsIndex = FlsAlloc(PoolCache_ThreadExit);
+	cache->tlsValid = (cache->tlsIndex != FLS_OUT_OF_INDEXES) ? TRUE : FALSE;
+#else
+	cache->tlsValid = (pthread_key_create(&cache->tlsKey, PoolCache_ThreadExit) == 0) ? TRUE : FALSE;
+#endif
+	return cache->tlsValid;
+}
+
+/**
+ * Once the key is gone no destructor runs anymore. On Windows, freeing
+ * it runs the destructor for the threads still holding a cache.
+ */
+
+static void PoolCache_TlsFree(wPoolCache* cache)
+{
+	if (!cache->tlsValid)
+		return;
+
+#ifdef _WIN32
+	FlsFree(cache->tlsIndex);
+#else
+	pthread_key_delete(cache->tlsKey);
+#endif
+	cache->tlsValid = FALSE;
+}
+
+static INLINE wPoolThreadCache* PoolCache_TlsGetValue(wPoolCache* cache)
+{
+#ifdef _WIN32
+	return (wPoolThreadCache*) FlsGetValue(cache->tlsIndex);
+#else
+	return (wPoolThreadCache*) pthread_getspecific(cache->tlsKey);
+#endif
+}
+
+static wPoolThreadCache* PoolCache_GetThreadCache(wPoolCache* cache)
+{
+	wPoolThreadCache* tc;
+
+	if (!cache->synchronized)
+		return &cache->shared;
+
+	if (!cache->tlsValid)
+		return NULL;
+
+	tc = PoolCache_TlsGetValue(cache);
+
+	if (tc)
+		return tc;
+
+	tc = (wPoolThreadCache*) calloc(1, sizeof(wPoolThreadCache));
+
+	if (!tc)
+		return NULL;
+
+	tc->cache = cache;
+
+	EnterCriticalSection(&cache->lock);
+	tc->next = cache->caches;
+	cache->caches = tc;
+	LeaveCriticalSection(&cache->lock);
+
+#ifdef _WIN32
+	FlsSetValue(cache->tlsIndex, tc);
+#else
+	pthread_setspecific(cache->tlsKey, tc);
+#endif
+
+	return tc;
+}
+
+static void PoolCache_Refill(wPoolCache* cache, wPoolThreadCache* tc, int k)
+{
+	void* item;
+	void* chain = NULL;
+	int count = (cache->rounds[k] + 1) / 2;
+	wPoolMagazine* magazine = &tc->magazines[k];
+
+	PoolCache_Lock(cache);
+
+	while ((magazine->count < count) && (item = PoolCache_DepotPop(cache, k)))
+	{
+		magazine->rounds[magazine->count++] = item;
+		tc->bytes += cache->size(item);
+		tc->items++;
+	}
+
+	PoolCache_Publish(cache, tc);
+	PoolCache_DepotTrim(cache, &chain);
+
+	PoolCache_Unlock(cache);
+
+	PoolCache_FreeChain(cache, chain);
+}
+
+/**
+ * Moves the oldest half of a full magazine to the depot,
+ * keeping the most recently used items with the thread.
+ */
+
+static void PoolCache_Flush(wPoolCache* cache, wPoolThreadCache* tc, int k)
+{
+	int index;
+	void* item;
+	void* chain = NULL;
+	int count = (cache->rounds[k] + 1) / 2;
+	wPoolMagazine* magazine = &tc->magazines[k];
+
+	if (count > magazine->count)
+		count = magazine->count;
+
+	PoolCache_Lock(cache);
+
+	for (index = 0; index < count; index++)
+	{
+		item = magazine->rounds[index];
+		tc->bytes -= cache->size(item);
+		tc->items--;
+		PoolCache_Publish(cache, tc);
+		PoolCache_DepotPush(cache, k, item, &chain);
+	}
+
+	PoolCache_DepotTrim(cache, &chain);
+
+	PoolCache_Unlock(cache);
+
+	magazine->count -= count;
+	MoveMemory(&magazine->rounds[0], &magazine->rounds[count], magazine->count * sizeof(void*));
+
+	PoolCache_FreeChain(cache, chain);
+}
+
+/**
+ * Gets an item of at least size bytes, allocating one of the full class
+ * size when none is cached.
+ */
+
+void* PoolCache_Get(wPoolCache* cache, size_t size)
+{
+	int k;
+	void* item = NULL;
+	void* chain = NULL;
+	wPoolThreadCache* tc;
+	wPoolMagazine* magazine;
+
+	k = PoolCache_Class(size);
+	tc = PoolCache_GetThreadCache(cache);
+
+	if (k <= POOL_CACHE_MAX_CLASS)
+	{
+		if (tc)
+		{
+			magazine = &tc->magazines[k];
+
+			if (!magazine->count)
+				PoolCache_Refill(cache, tc, k);
+
+			if (magazine->count)
+			{
+				item = magazine->rounds[--(magazine->count)];
+				tc->bytes -= cache->size(item);
+				tc->items--;
+				tc->hits++;
+				return item;
+			}
+		}
+		else
+		{
+			EnterCriticalSection(&cache->lock);
+
+			item = PoolCache_DepotPop(cache, k);
+
+			if (item)
+				cache->shared.hits++;
+
+			PoolCache_DepotTrim(cache, &chain);
+
+			LeaveCriticalSection(&cache->lock);
+
+			PoolCache_FreeChain(cache, chain);
+
+			if (item)
+				return item;
+		}
+
+		size = ((size_t) 1) << k;
+	}
+
+	item = cache->alloc(cache->context, size);
+
+	if (!item)
+		return NULL;
+
+	if (tc)
+	{
+		tc->misses++;
+	}
+	else
+	{
+		EnterCriticalSection(&cache->lock);
+		cache->shared.misses++;
+		LeaveCriticalSection(&cache->lock);
+	}
+
+	return item;
+}
+
+/**
+ * Returns an item to the cache, or frees it when it is too large to be cached.
+ */
+
+void PoolCache_Put(wPoolCache* cache, void* item)
+{
+	int k;
+	void* chain = NULL;
+	wPoolThreadCache* tc;
+	wPoolMagazine* magazine;
+
+	k = PoolCache_FloorClass(cache->size(item));
+	tc = PoolCache_GetThreadCache(cache);
+
+	if ((k < POOL_CACHE_MIN_CLASS) || (k > POOL_CACHE_MAX_CLASS))
+	{
+		if (tc)
+		{
+			tc->returns++;
+		}
+		else
+		{
+			EnterCriticalSection(&cache->lock);
+			cache->shared.returns++;
+			LeaveCriticalSection(&cache->lock);
+		}
+
+		cache->free(cache->context, item);
+		return;
+	}
+
+	if (tc)
+	{
+		magazine = &tc->magazines[k];
+
+		if (magazine->count >= cache->rounds[k])
+			PoolCache_Flush(cache, tc, k);
+
+		magazine->rounds[magazine->count++] = item;
+		tc->bytes += cache->size(item);
+		tc->items++;
+		tc->returns++;
+		return;
+	}
+
+	EnterCriticalSection(&cache->lock);
+
+	PoolCache_DepotPush(cache, k, item, &chain);
+	cache->shared.returns++;
+	PoolCache_DepotTrim(cache, &chain);
+
+	LeaveCriticalSection(&cache->lock);
+
+	PoolCache_FreeChain(cache, chain);
+}
+
+/**
+ * The counters of other threads are read without synchronization,
+ * so the result is only exact while the pool is idle.
+ */
+
+void PoolCache_GetStatistics(wPoolCache* cache, wPoolStatistics* statistics)
+{
+	UINT64 takes = 0;
+	UINT64 returns = 0;
+	wPoolThreadCache* tc;
+
+	ZeroMemory(statistics, sizeof(wPoolStatistics));
+
+	PoolCache_Lock(cache);
+
+	for (tc = &cache->shared; tc; tc = (tc == &cache->shared) ? cache->caches : tc->next)
+	{
+		statistics->hits += tc->hits;
+		statistics->misses += tc->misses;
+		statistics->bytesHeld += tc->bytes;
+		statistics->itemsHeld += tc->items;
+		returns += tc->returns;
+	}
+
+	takes = statistics->hits + statistics->misses;
+
+	statistics->trimmed = cache->trimmed;
+	statistics->bytesHeld += cache->depotBytes;
+	statistics->itemsHeld += cache->depotItems;
+	statistics->itemsInUse = (size_t) (takes - returns);
+
+	PoolCache_Unlock(cache);
+}
+
+static void PoolCache_DrainThreadCache(wPoolCache* cache, wPoolThreadCache* tc, void** chain)
+{
+	int k;
+	void* item;
+	wPoolMagazine* magazine;
+
+	for (k = POOL_CACHE_MIN_CLASS; k < POOL_CACHE_CLASSES; k++)
+	{
+		magazine = &tc->magazines[k];
+
+		while (magazine->count > 0)
+		{
+			item = magazine->rounds[--(magazine->count)];
+			*cache->link(item) = *chain;
+			*chain = item;
+		}
+	}
+
+	cache->magazineBytes -= tc->published;
+	tc->published = 0;
+	tc->bytes = 0;
+	tc->items = 0;
+}
+
+static void PoolCache_DrainDepot(wPoolCache* cache, void** chain)
+{
+	int k;
+	void* item;
+
+	for (k = POOL_CACHE_MIN_CLASS; k < POOL_CACHE_CLASSES; k++)
+	{
+		while ((item = PoolCache_DepotPop(cache, k)))
+		{
+			*cache->link(item) = *chain;
+			*chain = item;
+		}
+
+		cache->depot[k].minCount = 0;
+	}
+}
+
+/**
+ * Frees the items held by the depot and by the calling thread. Magazines
+ * of other threads cannot be touched while those threads may use them.
+ */
+
+void PoolCache_Clear(wPoolCache* cache)
+{
+	void* chain = NULL;
+	wPoolThreadCache* tc = NULL;
+
+	if (!cache->synchronized)
+		tc = &cache->shared;
+	else if (cache->tlsValid)
+		tc = PoolCache_TlsGetValue(cache);
+
+	PoolCache_Lock(cache);
+
+	if (tc)
+		PoolCache_DrainThreadCache(cache, tc, &chain);
+
+	PoolCache_DrainDepot(cache, &chain);
+
+	PoolCache_Unlock(cache);
+
+	PoolCache_FreeChain(cache, chain);
+}
+
+wPoolCache* PoolCache_New(BOOL synchronized, void* context, POOL_CACHE_ALLOC_FN fnAlloc,
+		POOL_CACHE_FREE_FN fnFree, POOL_CACHE_SIZE_FN fnSize, POOL_CACHE_LINK_FN fnLink)
+{
+	int k;
+	int rounds;
+	wPoolCache* cache;
+
+	cache = (wPoolCache*) calloc(1, sizeof(wPoolCache));
+
+	if (!cache)
+		return NULL;
+
+	cache->synchronized = synchronized;
+	cache->context = context;
+	cache->alloc = fnAlloc;
+	cache->free = fnFree;
+	cache->size = fnSize;
+	cache->link = fnLink;
+
+	cache->highWater = POOL_CACHE_HIGH_WATER;
+	cache->trimTime = GetTickCount64();
+
+	/* magazines of large classes hold fewer items */
+
+	for (k = POOL_CACHE_MIN_CLASS; k < POOL_CACHE_CLASSES; k++)
+	{
+		rounds = POOL_CACHE_MAGAZINE_BYTES >> k;
+
+		if (rounds > POOL_CACHE_MAGAZINE)
+			rounds = POOL_CACHE_MAGAZINE;
+		else if (rounds < 1)
+			rounds = 1;
+
+		cache->rounds[k] = rounds;
+	}
+
+	if (synchronized)
+	{
+		InitializeCriticalSectionAndSpinCount(&cache->lock, 4000);
+		PoolCache_TlsAlloc(cache);
+	}
+
+	return cache;
+}
+
+void PoolCache_Free(wPoolCache* cache)
+{
+	void* chain = NULL;
+	wPoolThreadCache* tc;
+	wPoolThreadCache* next;
+
+	if (!cache)
+		return;
+
+	if (cache->synchronized)
+		PoolCache_TlsFree(cache);
+
+	PoolCache_DrainThreadCache(cache, &cache->shared, &chain);
+
+	for (tc = cache->caches; tc; tc = next)
+	{
+		next = tc->next;
+		PoolCache_DrainThreadCache(cache, tc, &chain);
+		free(tc);
+	}
+
+	PoolCache_DrainDepot(cache, &chain);
+	PoolCache_FreeChain(cache, chain);
+
+	if (cache->synchronized)
+		DeleteCriticalSection(&cache->lock);
+
+	free(cache);
+}
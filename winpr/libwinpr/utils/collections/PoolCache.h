@@ -0,0 +1,121 @@
+/**
+ * WinPR: Windows Portable Runtime
+ * Size Class Pool Cache
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WINPR_UTILS_POOL_CACHE_H
+#define WINPR_UTILS_POOL_CACHE_H
+
+#include <winpr/winpr.h>
+#include <winpr/wtypes.h>
+#include <winpr/synch.h>
+#include <winpr/stream.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+/**
+ * Items are cached in power-of-two size classes, from 64 bytes to 16 MB.
+ * Larger items are allocated and freed directly.
+ */
+
+#define POOL_CACHE_MIN_CLASS		6
+#define POOL_CACHE_MAX_CLASS		24
+#define POOL_CACHE_CLASSES		(POOL_CACHE_MAX_CLASS + 1)
+
+#define POOL_CACHE_MAGAZINE		16
+#define POOL_CACHE_MAGAZINE_BYTES	(256 * 1024)
+#define POOL_CACHE_HIGH_WATER		(32 * 1024 * 1024)
+#define POOL_CACHE_TRIM_INTERVAL	1000
+
+typedef void* (*POOL_CACHE_ALLOC_FN)(void* context, size_t size);
+typedef void (*POOL_CACHE_FREE_FN)(void* context, void* item);
+typedef size_t (*POOL_CACHE_SIZE_FN)(void* item);
+typedef void** (*POOL_CACHE_LINK_FN)(void* item);
+
+struct _wPoolMagazine
+{
+	int count;
+	void* rounds[POOL_CACHE_MAGAZINE];
+};
+typedef struct _wPoolMagazine wPoolMagazine;
+
+struct _wPoolThreadCache
+{
+	struct _wPoolThreadCache* next;
+	struct _wPoolCache* cache;
+
+	UINT64 hits;
+	UINT64 misses;
+	UINT64 returns;
+	size_t bytes;
+	size_t items;
+	size_t published;
+
+	wPoolMagazine magazines[POOL_CACHE_CLASSES];
+};
+typedef struct _wPoolThreadCache wPoolThreadCache;
+
+struct _wPoolDepot
+{
+	void* head;
+	int count;
+	int minCount;
+};
+typedef struct _wPoolDepot wPoolDepot;
+
+struct _wPoolCache
+{
+	BOOL synchronized;
+	CRITICAL_SECTION lock;
+
+	BOOL tlsValid;
+#ifdef _WIN32
+	DWORD tlsIndex;
+#else
+	pthread_key_t tlsKey;
+#endif
+	wPoolThreadCache* caches;
+	wPoolThreadCache shared;
+
+	int rounds[POOL_CACHE_CLASSES];
+	wPoolDepot depot[POOL_CACHE_CLASSES];
+	size_t depotBytes;
+	size_t depotItems;
+	size_t magazineBytes;
+	size_t highWater;
+	UINT64 trimTime;
+	UINT64 trimmed;
+
+	void* context;
+	POOL_CACHE_ALLOC_FN alloc;
+	POOL_CACHE_FREE_FN free;
+	POOL_CACHE_SIZE_FN size;
+	POOL_CACHE_LINK_FN link;
+};
+typedef struct _wPoolCache wPoolCache;
+
+void* PoolCache_Get(wPoolCache* cache, size_t size);
+void PoolCache_Put(wPoolCache* cache, void* item);
+
+void PoolCache_GetStatistics(wPoolCache* cache, wPoolStatistics* statistics);
+void PoolCache_Clear(wPoolCache* cache);
+
+wPoolCache* PoolCache_New(BOOL synchronized, void* context, POOL_CACHE_ALLOC_FN fnAlloc,
+		POOL_CACHE_FREE_FN fnFree, POOL_CACHE_SIZE_FN fnSize, POOL_CACHE_LINK_FN fnLink);
+void PoolCache_Free(wPoolCache* cache);
+
+#endif /* WINPR_UTILS_POOL_CACHE_H */
@@ -24,96 +24,105 @@
 #include <winpr/crt.h>
 
 #include <winpr/collections.h>
+#include <winpr/interlocked.h>
+
+#include "PoolCache.h"
 
 /**
- * Methods
+ * Streams are cached by power-of-two capacity in per-thread magazines
+ * backed by a shared depot (see PoolCache.c), which makes take and return
+ * constant time and lock free in the common case. The pool still keeps
+ * the list of all streams it owns, updated only when a stream is allocated
+ * or freed, for StreamPool_Find.
  */
 
-void StreamPool_ShiftUsed(wStreamPool* pool, int index, int count)
+static BOOL StreamPool_AddOwned(wStreamPool* pool, wStream* s)
 {
-	if (count > 0)
-	{
-		if (pool->uSize + count > pool->uCapacity)
-		{
-			pool->uCapacity *= 2;
-			pool->uArray = (wStream**) realloc(pool->uArray, sizeof(wStream*) * pool->uCapacity);
-		}
+	int capacity;
+	wStream** array;
 
-		MoveMemory(&pool->uArray[index + count], &pool->uArray[index], (pool->uSize - index) * sizeof(wStream*));
-		pool->uSize += count;
-	}
-	else if (count < 0)
+	EnterCriticalSection(&pool->lock);
+
+	if (pool->size + 1 > pool->capacity)
 	{
-		if (pool->uSize - index + count > 0)
+		capacity = pool->capacity * 2;
+		array = (wStream**) realloc(pool->array, sizeof(wStream*) * capacity);
+
+		if (!array)
 		{
-			MoveMemory(&pool->uArray[index], &pool->uArray[index - count],
-					(pool->uSize - index + count) * sizeof(wStream*));
+			LeaveCriticalSection(&pool->lock);
+			return FALSE;
 		}
 
-		pool->uSize += count;
+		pool->array = array;
+		pool->capacity = capacity;
 	}
-}
 
-/**
- * Adds a used stream to the pool.
- */
+	pool->array[(pool->size)++] = s;
 
-void StreamPool_AddUsed(wStreamPool* pool, wStream* s)
-{
-	if ((pool->uSize + 1) >= pool->uCapacity)
-	{
-		pool->uCapacity *= 2;
-		pool->uArray = (wStream**) realloc(pool->uArray, sizeof(wStream*) * pool->uCapacity);
-	}
+	LeaveCriticalSection(&pool->lock);
 
-	pool->uArray[(pool->uSize)++] = s;
+	return TRUE;
 }
 
-/**
- * Removes a used stream from the pool.
- */
-
-void StreamPool_RemoveUsed(wStreamPool* pool, wStream* s)
+static void StreamPool_RemoveOwned(wStreamPool* pool, wStream* s)
 {
 	int index;
-	BOOL found = FALSE;
 
-	for (index = 0; index < pool->uSize; index++)
+	EnterCriticalSection(&pool->lock);
+
+	for (index = pool->size - 1; index >= 0; index--)
 	{
-		if (pool->uArray[index] == s)
+		if (pool->array[index] == s)
 		{
-			found = TRUE;
+			pool->array[index] = pool->array[--(pool->size)];
 			break;
 		}
 	}
 
-	if (found)
-		StreamPool_ShiftUsed(pool, index, -1);
+	LeaveCriticalSection(&pool->lock);
 }
 
-void StreamPool_ShiftAvailable(wStreamPool* pool, int index, int count)
+static void* StreamPool_AllocStream(void* context, size_t size)
 {
-	if (count > 0)
-	{
-		if (pool->aSize + count > pool->aCapacity)
-		{
-			pool->aCapacity *= 2;
-			pool->aArray = (wStream**) realloc(pool->aArray, sizeof(wStream*) * pool->aCapacity);
-		}
+	wStream* s;
+	wStreamPool* pool = (wStreamPool*) context;
 
-		MoveMemory(&pool->aArray[index + count], &pool->aArray[index], (pool->aSize - index) * sizeof(wStream*));
-		pool->aSize += count;
-	}
-	else if (count < 0)
-	{
-		if (pool->aSize - index + count > 0)
-		{
-			MoveMemory(&pool->aArray[index], &pool->aArray[index - count],
-					(pool->aSize - index + count) * sizeof(wStream*));
-		}
+	s = Stream_New(NULL, size);
 
-		pool->aSize += count;
+	if (!s)
+		return NULL;
+
+	if (!s->buffer || !StreamPool_AddOwned(pool, s))
+	{
+		Stream_Free(s, TRUE);
+		return NULL;
 	}
+
+	return s;
+}
+
+static void StreamPool_FreeStream(void* context, void* item)
+{
+	wStream* s = (wStream*) item;
+	wStreamPool* pool = (wStreamPool*) context;
+
+	StreamPool_RemoveOwned(pool, s);
+	Stream_Free(s, TRUE);
+}
+
+static size_t StreamPool_StreamSize(void* item)
+{
+	wStream* s = (wStream*) item;
+
+	return Stream_Capacity(s);
+}
+
+/* a cached stream has no position, so the pointer links it in the depot */
+
+static void** StreamPool_StreamLink(void* item)
+{
+	return (void**) &((wStream*) item)->pointer;
 }
 
 /**
@@ -122,49 +131,22 @@ void StreamPool_ShiftAvailable(wStreamPool* pool, int index, int count)
 
 wStream* StreamPool_Take(wStreamPool* pool, size_t size)
 {
-	int index;
-	int foundIndex;
-	wStream* s = NULL;
-
-	if (pool->synchronized)
-		EnterCriticalSection(&pool->lock);
+	wStream* s;
 
 	if (size == 0)
 		size = pool->defaultSize;
 
-	foundIndex = -1;
+	s = (wStream*) PoolCache_Get(pool->cache, size);
 
-	for (index = 0; index < pool->aSize; index++)
-	{
-		s = pool->aArray[index];
-
-		if (Stream_Capacity(s) >= size)
-		{
-			foundIndex = index;
-			break;
-		}
-	}
-
-	if (foundIndex < 0)
-	{
-		s = Stream_New(NULL, size);
-	}
-	else
-	{
-		StreamPool_ShiftAvailable(pool, foundIndex, -1);
+	if (!s)
+		return NULL;
 
-		Stream_SetPosition(s, 0);
-		Stream_EnsureCapacity(s, size);
-	}
+	Stream_SetPosition(s, 0);
+	Stream_SetLength(s, size);
 
 	s->pool = pool;
 	s->count = 1;
 
-	StreamPool_AddUsed(pool, s);
-
-	if (pool->synchronized)
-		LeaveCriticalSection(&pool->lock);
-
 	return s;
 }
 
@@ -174,25 +156,7 @@ wStream* StreamPool_Take(wStreamPool* pool, size_t size)
 
 void StreamPool_Return(wStreamPool* pool, wStream* s)
 {
-	if (pool->synchronized)
-		EnterCriticalSection(&pool->lock);
-
-	if ((pool->aSize + 1) >= pool->aCapacity)
-	{
-		pool->aCapacity *= 2;
-		pool->aArray = (wStream**) realloc(pool->aArray, sizeof(wStream*) * pool->aCapacity);
-	}
-	else if ((pool->aSize + 1) * 3 < pool->aCapacity)
-	{
-		pool->aCapacity /= 2;
-		pool->aArray = (wStream**) realloc(pool->aArray, sizeof(wStream*) * pool->aCapacity);
-	}
-
-	pool->aArray[(pool->aSize)++] = s;
-	StreamPool_RemoveUsed(pool, s);
-
-	if (pool->synchronized)
-		LeaveCriticalSection(&pool->lock);
+	PoolCache_Put(pool->cache, s);
 }
 
 /**
@@ -220,11 +184,7 @@ void StreamPool_Unlock(wStreamPool* pool)
 void Stream_AddRef(wStream* s)
 {
 	if (s->pool)
-	{
-		StreamPool_Lock(s->pool);
-		s->count++;
-		StreamPool_Unlock(s->pool);
-	}
+		InterlockedIncrement((LONG volatile*) &s->count);
 }
 
 /**
@@ -233,15 +193,9 @@ void Stream_AddRef(wStream* s)
 
 void Stream_Release(wStream* s)
 {
-	DWORD count;
-
 	if (s->pool)
 	{
-		StreamPool_Lock(s->pool);
-		count = --(s->count);
-		StreamPool_Unlock(s->pool);
-
-		if (count == 0)
+		if (InterlockedDecrement((LONG volatile*) &s->count) == 0)
 			StreamPool_Return(s->pool, s);
 	}
 }
@@ -258,9 +212,9 @@ wStream* StreamPool_Find(wStreamPool* pool, BYTE* ptr)
 
 	EnterCriticalSection(&pool->lock);
 
-	for (index = 0; index < pool->uSize; index++)
+	for (index = 0; index < pool->size; index++)
 	{
-		s = pool->uArray[index];
+		s = pool->array[index];
 
 		if ((ptr >= Stream_Buffer(s)) && (ptr < (Stream_Buffer(s) + Stream_Capacity(s))))
 		{
@@ -308,17 +262,16 @@ void StreamPool_Release(wStreamPool* pool, BYTE* ptr)
 
 void StreamPool_Clear(wStreamPool* pool)
 {
-	if (pool->synchronized)
-		EnterCriticalSection(&pool->lock);
+	PoolCache_Clear(pool->cache);
+}
 
-	while (pool->aSize > 0)
-	{
-		(pool->aSize)--;
-		Stream_Free(pool->aArray[pool->aSize], TRUE);
-	}
+/**
+ * Gets the pool counters.
+ */
 
-	if (pool->synchronized)
-		LeaveCriticalSection(&pool->lock);
+void StreamPool_GetStatistics(wStreamPool* pool, wPoolStatistics* statistics)
+{
+	PoolCache_GetStatistics(pool->cache, statistics);
 }
 
 /**
@@ -336,23 +289,22 @@ wStreamPool* StreamPool_New(BOOL synchronized, size_t defaultSize)
 		pool->synchronized = synchronized;
 		pool->defaultSize = defaultSize;
 
-		pool->aSize = 0;
-		pool->aCapacity = 32;
-		pool->aArray = (wStream**) calloc(pool->aCapacity, sizeof(wStream*));
+		pool->size = 0;
+		pool->capacity = 32;
+		pool->array = (wStream**) calloc(pool->capacity, sizeof(wStream*));
 
-		if (!pool->aArray)
+		if (!pool->array)
 		{
 			free(pool);
 			return NULL;
 		}
 
-		pool->uSize = 0;
-		pool->uCapacity = 32;
-		pool->uArray = (wStream**) calloc(pool->uCapacity, sizeof(wStream*));
+		pool->cache = PoolCache_New(synchronized, pool, StreamPool_AllocStream,
+				StreamPool_FreeStream, StreamPool_StreamSize, StreamPool_StreamLink);
 
-		if (!pool->uArray)
+		if (!pool->cache)
 		{
-			free(pool->aArray);
+			free(pool->array);
 			free(pool);
 			return NULL;
 		}
@@ -367,12 +319,11 @@ void StreamPool_Free(wStreamPool* pool)
 {
 	if (pool)
 	{
-		StreamPool_Clear(pool);
+		PoolCache_Free(pool->cache);
 
 		DeleteCriticalSection(&pool->lock);
 
-		free(pool->aArray);
-		free(pool->uArray);
+		free(pool->array);
 
 		free(pool);
 	}
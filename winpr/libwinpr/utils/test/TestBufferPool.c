@@ -51,6 +51,9 @@ int TestBufferPool(int argc, char* argv[])
 		return -1;
 	}
 
+	BufferPool_Return(pool, Buffers[0]);
+	BufferPool_Return(pool, Buffers[2]);
+
 	BufferPool_Clear(pool);
 
 	BufferPool_Free(pool);
@@ -0,0 +1,177 @@
+
+#include <stdio.h>
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+#include <winpr/thread.h>
+#include <winpr/sysinfo.h>
+#include <winpr/collections.h>
+
+#define TEST_MESSAGES		160000
+#define TEST_MAX_PRODUCERS	16
+
+struct _TEST_QUEUE_RUN
+{
+	wMessageQueue* queue;
+	HANDLE start;
+	int producers;
+	int messages;
+	int received;
+	BOOL ordered;
+	UINT32 next[TEST_MAX_PRODUCERS];
+};
+typedef struct _TEST_QUEUE_RUN TEST_QUEUE_RUN;
+
+struct _TEST_PRODUCER
+{
+	TEST_QUEUE_RUN* run;
+	int id;
+};
+typedef struct _TEST_PRODUCER TEST_PRODUCER;
+
+static void* test_producer_thread(void* arg)
+{
+	int index;
+	TEST_PRODUCER* producer = (TEST_PRODUCER*) arg;
+	TEST_QUEUE_RUN* run = producer->run;
+
+	WaitForSingleObject(run->start, INFINITE);
+
+	for (index = 0; index < run->messages; index++)
+	{
+		MessageQueue_Post(run->queue, NULL, 1, (void*) (size_t) producer->id,
+				(void*) (size_t) index);
+	}
+
+	return NULL;
+}
+
+/**
+ * Reads until all producers are done, checking that the messages of each
+ * producer arrive in the order they were posted.
+ */
+
+static void* test_consumer_thread(void* arg)
+{
+	int id;
+	UINT32 sequence;
+	wMessage message;
+	TEST_QUEUE_RUN* run = (TEST_QUEUE_RUN*) arg;
+
+	while (MessageQueue_Wait(run->queue))
+	{
+		if (!MessageQueue_Peek(run->queue, &message, TRUE))
+			continue;
+
+		if (message.id == WMQ_QUIT)
+			break;
+
+		id = (int) (size_t) message.wParam;
+		sequence = (UINT32) (size_t) message.lParam;
+
+		if ((id < 0) || (id >= run->producers) || (sequence != run->next[id]))
+			run->ordered = FALSE;
+		else
+			run->next[id]++;
+
+		run->received++;
+	}
+
+	return NULL;
+}
+
+static int test_queue_contention(const char* name, DWORD flags, int capacity, int producers)
+{
+	int index;
+	UINT64 start;
+	UINT64 elapsed;
+	HANDLE consumer;
+	TEST_QUEUE_RUN run;
+	HANDLE threads[TEST_MAX_PRODUCERS];
+	TEST_PRODUCER context[TEST_MAX_PRODUCERS];
+
+	ZeroMemory(&run, sizeof(TEST_QUEUE_RUN));
+
+	run.queue = MessageQueue_NewEx(NULL, flags, capacity);
+
+	if (!run.queue)
+		return -1;
+
+	run.start = CreateEvent(NULL, TRUE, FALSE, NULL);
+	run.producers = producers;
+	run.messages = TEST_MESSAGES / producers;
+	run.ordered = TRUE;
+
+	consumer = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE) test_consumer_thread, (void*) &run, 0, NULL);
+
+	for (index = 0; index < producers; index++)
+	{
+		context[index].run = &run;
+		context[index].id = index;
+		threads[index] = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE) test_producer_thread,
+				(void*) &context[index], 0, NULL);
+	}
+
+	start = GetTickCount64();
+	SetEvent(run.start);
+
+	for (index = 0; index < producers; index++)
+	{
+		WaitForSingleObject(threads[index], INFINITE);
+		CloseHandle(threads[index]);
+	}
+
+	MessageQueue_PostQuit(run.queue, 0);
+	WaitForSingleObject(consumer, INFINITE);
+	CloseHandle(consumer);
+
+	elapsed = GetTickCount64() - start;
+
+	if (!elapsed)
+		elapsed = 1;
+
+	printf("%-6s %2d producer(s): %10.0f messages/s\n", name, producers,
+			((double) run.received) / ((double) elapsed / 1000.0));
+
+	CloseHandle(run.start);
+	MessageQueue_Free(run.queue);
+
+	if (run.received != run.messages * producers)
+	{
+		printf("expected %d messages, got %d\n", run.messages * producers, run.received);
+		return -1;
+	}
+
+	if (!run.ordered)
+	{
+		printf("messages of a producer arrived out of order\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+int TestMessageQueueContention(int argc, char* argv[])
+{
+	int index;
+	int producers[] = { 1, 4, 16 };
+
+	for (index = 0; index < 3; index++)
+	{
+		if (test_queue_contention("locked", 0, 0, producers[index]) < 0)
+			return -1;
+
+		if (test_queue_contention("mpsc", WMQ_FLAG_MPSC, 0, producers[index]) < 0)
+			return -1;
+	}
+
+	if (test_queue_contention("spsc", WMQ_FLAG_SPSC, 0, 1) < 0)
+		return -1;
+
+	/* a small ring spills into the array without losing or reordering messages */
+
+	if (test_queue_contention("mpsc-8", WMQ_FLAG_MPSC, 8, 4) < 0)
+		return -1;
+
+	return 0;
+}
@@ -5,6 +5,15 @@
 
 #define BUFFER_SIZE 16384
 
+static void test_stream_pool_print(wStreamPool* pool)
+{
+	wPoolStatistics statistics;
+
+	StreamPool_GetStatistics(pool, &statistics);
+
+	printf("StreamPool: held: %d used: %d\n", (int) statistics.itemsHeld, (int) statistics.itemsInUse);
+}
+
 int TestStreamPool(int argc, char* argv[])
 {
 	wStream* s[5];
@@ -16,29 +25,29 @@ int TestStreamPool(int argc, char* argv[])
 	s[1] = StreamPool_Take(pool, 0);
 	s[2] = StreamPool_Take(pool, 0);
 
-	printf("StreamPool: aSize: %d uSize: %d\n", pool->aSize, pool->uSize);
+	test_stream_pool_print(pool);
 
 	Stream_Release(s[0]);
 	Stream_Release(s[1]);
 	Stream_Release(s[2]);
 
-	printf("StreamPool: aSize: %d uSize: %d\n", pool->aSize, pool->uSize);
+	test_stream_pool_print(pool);
 
 	s[3] = StreamPool_Take(pool, 0);
 	s[4] = StreamPool_Take(pool, 0);
 
-	printf("StreamPool: aSize: %d uSize: %d\n", pool->aSize, pool->uSize);
+	test_stream_pool_print(pool);
 
 	Stream_Release(s[3]);
 	Stream_Release(s[4]);
 
-	printf("StreamPool: aSize: %d uSize: %d\n", pool->aSize, pool->uSize);
+	test_stream_pool_print(pool);
 
 	s[2] = StreamPool_Take(pool, 0);
 	s[3] = StreamPool_Take(pool, 0);
 	s[4] = StreamPool_Take(pool, 0);
 
-	printf("StreamPool: aSize: %d uSize: %d\n", pool->aSize, pool->uSize);
+	test_stream_pool_print(pool);
 
 	Stream_AddRef(s[2]);
 
@@ -61,13 +70,13 @@ int TestStreamPool(int argc, char* argv[])
 	Stream_Release(s[4]);
 	Stream_Release(s[4]);
 
-	printf("StreamPool: aSize: %d uSize: %d\n", pool->aSize, pool->uSize);
+	test_stream_pool_print(pool);
 
 	s[2] = StreamPool_Take(pool, 0);
 	s[3] = StreamPool_Take(pool, 0);
 	s[4] = StreamPool_Take(pool, 0);
 
-	printf("StreamPool: aSize: %d uSize: %d\n", pool->aSize, pool->uSize);
+	test_stream_pool_print(pool);
 
 	StreamPool_AddRef(pool, s[2]->buffer + 1024);
 
@@ -78,7 +87,7 @@ int TestStreamPool(int argc, char* argv[])
 	StreamPool_AddRef(pool, s[4]->buffer + 1024 * 2);
 	StreamPool_AddRef(pool, s[4]->buffer + 1024 * 3);
 
-	printf("StreamPool: aSize: %d uSize: %d\n", pool->aSize, pool->uSize);
+	test_stream_pool_print(pool);
 
 	StreamPool_Release(pool, s[2]->buffer + 2048);
 	StreamPool_Release(pool, s[2]->buffer + 2048 * 2);
@@ -92,7 +101,7 @@ int TestStreamPool(int argc, char* argv[])
 	StreamPool_Release(pool, s[4]->buffer + 2048 * 3);
 	StreamPool_Release(pool, s[4]->buffer + 2048 * 4);
 
-	printf("StreamPool: aSize: %d uSize: %d\n", pool->aSize, pool->uSize);
+	test_stream_pool_print(pool);
 
 	StreamPool_Free(pool);
 
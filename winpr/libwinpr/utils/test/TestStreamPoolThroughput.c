@@ -0,0 +1,266 @@
+
+#include <stdio.h>
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+#include <winpr/thread.h>
+#include <winpr/sysinfo.h>
+#include <winpr/stream.h>
+#include <winpr/collections.h>
+
+#define TEST_THREADS		4
+#define TEST_OPERATIONS		400000
+#define TEST_IN_FLIGHT		32
+
+/* the magazines of this thread: the two large streams and the small ones */
+#define TEST_MAX_HELD		(8 * 1024 * 1024)
+
+/**
+ * Stream sizes seen on a busy session, by share of takes: fast-path input
+ * and small orders, virtual channel chunks, bitmap updates, RemoteFX
+ * messages and the occasional reassembled large PDU.
+ */
+
+struct _TEST_SIZE_CLASS
+{
+	int percent;
+	int minSize;
+	int maxSize;
+};
+typedef struct _TEST_SIZE_CLASS TEST_SIZE_CLASS;
+
+static const TEST_SIZE_CLASS test_sizes[] =
+{
+	{ 40, 16, 512 },
+	{ 25, 1600, 1600 },
+	{ 20, 4096, 16384 },
+	{ 14, 32768, 65536 },
+	{ 1, 262144, 1048576 }
+};
+
+struct _TEST_POOL_RUN
+{
+	wStreamPool* pool;
+	HANDLE start;
+	BOOL pooled;
+};
+typedef struct _TEST_POOL_RUN TEST_POOL_RUN;
+
+static UINT32 test_random(UINT32* seed)
+{
+	*seed = (*seed * 1103515245) + 12345;
+	return (*seed >> 8);
+}
+
+static size_t test_size(UINT32* seed)
+{
+	int index;
+	int percent = test_random(seed) % 100;
+	const TEST_SIZE_CLASS* size = NULL;
+
+	for (index = 0; index < (int) (sizeof(test_sizes) / sizeof(test_sizes[0])); index++)
+	{
+		size = &test_sizes[index];
+
+		if (percent < size->percent)
+			break;
+
+		percent -= size->percent;
+	}
+
+	return size->minSize + (test_random(seed) % (size->maxSize - size->minSize + 1));
+}
+
+/**
+ * Keeps a window of streams in flight, as the receive path does while
+ * updates are queued, and releases the oldest one for every new take.
+ */
+
+static void* test_pool_thread(void* arg)
+{
+	int index;
+	size_t size;
+	UINT32 seed;
+	wStream* stream;
+	wStream* s[TEST_IN_FLIGHT];
+	TEST_POOL_RUN* run = (TEST_POOL_RUN*) arg;
+
+	seed = (UINT32) GetCurrentThreadId();
+	ZeroMemory(s, sizeof(s));
+
+	WaitForSingleObject(run->start, INFINITE);
+
+	for (index = 0; index < TEST_OPERATIONS / TEST_THREADS; index++)
+	{
+		stream = s[index % TEST_IN_FLIGHT];
+
+		if (stream)
+		{
+			if (run->pooled)
+				Stream_Release(stream);
+			else
+				Stream_Free(stream, TRUE);
+		}
+
+		size = test_size(&seed);
+
+		if (run->pooled)
+			stream = StreamPool_Take(run->pool, size);
+		else
+			stream = Stream_New(NULL, size);
+
+		s[index % TEST_IN_FLIGHT] = stream;
+
+		if (!stream)
+			return NULL;
+
+		Stream_Write_UINT8(stream, 0);
+		Stream_SetPosition(stream, size - 1);
+		Stream_Write_UINT8(stream, 0);
+	}
+
+	for (index = 0; index < TEST_IN_FLIGHT; index++)
+	{
+		if (!s[index])
+			continue;
+
+		if (run->pooled)
+			Stream_Release(s[index]);
+		else
+			Stream_Free(s[index], TRUE);
+	}
+
+	return NULL;
+}
+
+static int test_pool_throughput(const char* name, BOOL pooled, wStreamPool* pool)
+{
+	int index;
+	UINT64 start;
+	UINT64 elapsed;
+	TEST_POOL_RUN run;
+	HANDLE threads[TEST_THREADS];
+
+	run.pool = pool;
+	run.pooled = pooled;
+	run.start = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+	for (index = 0; index < TEST_THREADS; index++)
+		threads[index] = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE) test_pool_thread, (void*) &run, 0, NULL);
+
+	start = GetTickCount64();
+	SetEvent(run.start);
+
+	for (index = 0; index < TEST_THREADS; index++)
+	{
+		WaitForSingleObject(threads[index], INFINITE);
+		CloseHandle(threads[index]);
+	}
+
+	elapsed = GetTickCount64() - start;
+
+	if (!elapsed)
+		elapsed = 1;
+
+	printf("%-8s %10.0f takes/s\n", name, ((double) TEST_OPERATIONS) / ((double) elapsed / 1000.0));
+
+	CloseHandle(run.start);
+
+	return 0;
+}
+
+int TestStreamPoolThroughput(int argc, char* argv[])
+{
+	int index;
+	wStream* s;
+	UINT64 trimmed;
+	wStreamPool* pool;
+	wPoolStatistics statistics;
+
+	test_pool_throughput("malloc", FALSE, NULL);
+
+	pool = StreamPool_New(TRUE, 4096);
+
+	if (!pool)
+		return -1;
+
+	test_pool_throughput("pool", TRUE, pool);
+
+	StreamPool_GetStatistics(pool, &statistics);
+
+	printf("hits: %d misses: %d trimmed: %d held: %d bytes in %d streams\n",
+			(int) statistics.hits, (int) statistics.misses, (int) statistics.trimmed,
+			(int) statistics.bytesHeld, (int) statistics.itemsHeld);
+
+	if (statistics.hits + statistics.misses != TEST_OPERATIONS)
+	{
+		printf("expected %d takes, counted %d\n", TEST_OPERATIONS,
+				(int) (statistics.hits + statistics.misses));
+		return -1;
+	}
+
+	if (statistics.itemsInUse != 0)
+	{
+		printf("%d streams still in use\n", (int) statistics.itemsInUse);
+		return -1;
+	}
+
+	if (statistics.hits < statistics.misses * 10)
+	{
+		printf("pool hit rate too low\n");
+		return -1;
+	}
+
+	/* a stream must come back with at least the requested capacity */
+
+	for (index = 1; index < 70000; index += 997)
+	{
+		s = StreamPool_Take(pool, index);
+
+		if (!s || (Stream_Capacity(s) < (size_t) index) || (Stream_GetPosition(s) != 0))
+			return -1;
+
+		Stream_Release(s);
+	}
+
+	/**
+	 * Streams left unused in the depot for two trim intervals are released,
+	 * including those the exited threads flushed from their magazines.
+	 * Taking from classes this thread never used goes through the depot.
+	 */
+
+	trimmed = statistics.trimmed;
+
+	for (index = 0; index < 2; index++)
+	{
+		Sleep(1100);
+
+		s = StreamPool_Take(pool, (size_t) 1 << (21 + index));
+
+		if (!s)
+			return -1;
+
+		Stream_Release(s);
+	}
+
+	StreamPool_GetStatistics(pool, &statistics);
+
+	printf("after trimming: trimmed: %d held: %d bytes in %d streams\n",
+			(int) statistics.trimmed, (int) statistics.bytesHeld, (int) statistics.itemsHeld);
+
+	if (statistics.trimmed <= trimmed)
+	{
+		printf("idle streams were not trimmed\n");
+		return -1;
+	}
+
+	if (statistics.bytesHeld > TEST_MAX_HELD)
+	{
+		printf("the streams of the exited threads are still held\n");
+		return -1;
+	}
+
+	StreamPool_Free(pool);
+
+	return 0;
+}
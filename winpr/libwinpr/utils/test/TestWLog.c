@@ -11,6 +11,7 @@ int TestWLog(int argc, char* argv[])
 	wLog* logB;
 	wLogLayout* layout;
 	wLogAppender* appender;
+	static wLogCache cache = { NULL };
 
 	WLog_Init();
 
@@ -42,9 +43,27 @@ int TestWLog(int argc, char* argv[])
 	WLog_Print(logB, WLOG_ERROR, "we've got an error");
 	WLog_Print(logB, WLOG_TRACE, "leaving a trace behind");
 
+	/* a call site with a variable tag must not keep the logger of a previous tag */
+	{
+		int index;
+		char tagA[] = "com.test.ChannelA";
+		char tagB[] = "com.test.ChannelB";
+
+		for (index = 0; index < 4; index++)
+		{
+			if (WLog_GetCached((index % 2) ? tagB : tagA, &cache) != ((index % 2) ? logB : logA))
+				return -1;
+		}
+	}
+
 	WLog_CloseAppender(root);
 
 	WLog_Uninit();
 
+	/* the cache entries are freed and detached from their call sites */
+
+	if (cache.entry)
+		return -1;
+
 	return 0;
 }
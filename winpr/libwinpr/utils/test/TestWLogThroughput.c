@@ -0,0 +1,200 @@
+
+#include <stdio.h>
+
+#include <winpr/crt.h>
+#include <winpr/file.h>
+#include <winpr/path.h>
+#include <winpr/synch.h>
+#include <winpr/thread.h>
+#include <winpr/sysinfo.h>
+#include <winpr/wlog.h>
+
+#define TEST_THREADS		4
+#define TEST_LOOKUPS		200000
+#define TEST_MESSAGES		20000
+#define TEST_LOGGERS		128
+
+static const char* TEST_TAG = "com.winpr.test.throughput";
+
+static HANDLE g_StartEvent = NULL;
+
+static void* test_lookup_uncached(void* arg)
+{
+	int i;
+
+	WaitForSingleObject(g_StartEvent, INFINITE);
+
+	for (i = 0; i < TEST_LOOKUPS; i++)
+		WLog_Print(WLog_Get(TEST_TAG), WLOG_DEBUG, "filtered message %d", i);
+
+	return NULL;
+}
+
+static void* test_lookup_cached(void* arg)
+{
+	int i;
+
+	WaitForSingleObject(g_StartEvent, INFINITE);
+
+	for (i = 0; i < TEST_LOOKUPS; i++)
+		WLog_DBG(TEST_TAG, "filtered message %d", i);
+
+	return NULL;
+}
+
+static void* test_write_messages(void* arg)
+{
+	int i;
+	int id = (int) (size_t) arg;
+
+	WaitForSingleObject(g_StartEvent, INFINITE);
+
+	for (i = 0; i < TEST_MESSAGES; i++)
+		WLog_INFO(TEST_TAG, "thread %d message %d", id, i);
+
+	return NULL;
+}
+
+static double test_run_threads(LPTHREAD_START_ROUTINE routine, int calls)
+{
+	int i;
+	UINT64 start;
+	UINT64 elapsed;
+	HANDLE threads[TEST_THREADS];
+
+	g_StartEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+	for (i = 0; i < TEST_THREADS; i++)
+		threads[i] = CreateThread(NULL, 0, routine, (void*) (size_t) i, 0, NULL);
+
+	start = GetTickCount64();
+	SetEvent(g_StartEvent);
+
+	for (i = 0; i < TEST_THREADS; i++)
+	{
+		WaitForSingleObject(threads[i], INFINITE);
+		CloseHandle(threads[i]);
+	}
+
+	elapsed = GetTickCount64() - start;
+	CloseHandle(g_StartEvent);
+
+	if (!elapsed)
+		elapsed = 1;
+
+	return ((double) calls * TEST_THREADS) / ((double) elapsed / 1000.0);
+}
+
+static int test_count_lines(const char* filename)
+{
+	int c;
+	FILE* fp;
+	int lines = 0;
+
+	fp = fopen(filename, "rb");
+
+	if (!fp)
+		return -1;
+
+	while ((c = fgetc(fp)) != EOF)
+	{
+		if (c == '\n')
+			lines++;
+	}
+
+	fclose(fp);
+
+	return lines;
+}
+
+static int test_write_throughput(const char* path, DWORD type)
+{
+	int lines;
+	double rate;
+	char* filename;
+	wLogAppender* appender;
+	wLog* root = WLog_GetRoot();
+	const char* name = (type == WLOG_APPENDER_ASYNC) ? "async.log" : "file.log";
+
+	WLog_SetLogAppenderType(root, type);
+	appender = WLog_GetLogAppender(root);
+
+	if (type == WLOG_APPENDER_ASYNC)
+	{
+		WLog_AsyncAppender_SetOutputFilePath(root, (wLogAsyncAppender*) appender, path);
+		WLog_AsyncAppender_SetOutputFileName(root, (wLogAsyncAppender*) appender, name);
+	}
+	else
+	{
+		WLog_FileAppender_SetOutputFilePath(root, (wLogFileAppender*) appender, path);
+		WLog_FileAppender_SetOutputFileName(root, (wLogFileAppender*) appender, name);
+	}
+
+	filename = GetCombinedPath(path, name);
+	DeleteFileA(filename);
+
+	WLog_OpenAppender(root);
+
+	rate = test_run_threads((LPTHREAD_START_ROUTINE) test_write_messages, TEST_MESSAGES);
+
+	WLog_CloseAppender(root);
+
+	lines = test_count_lines(filename);
+	DeleteFileA(filename);
+	free(filename);
+
+	printf("%-8s appender: %10.0f messages/s\n", (type == WLOG_APPENDER_ASYNC) ? "async" : "file", rate);
+
+	if (lines != TEST_THREADS * TEST_MESSAGES)
+	{
+		printf("expected %d lines, got %d\n", TEST_THREADS * TEST_MESSAGES, lines);
+		return -1;
+	}
+
+	return 0;
+}
+
+int TestWLogThroughput(int argc, char* argv[])
+{
+	int i;
+	char* path;
+	double rate;
+	wLog* root;
+	char name[64];
+
+	WLog_Init();
+
+	root = WLog_GetRoot();
+	WLog_SetLogLevel(root, WLOG_INFO);
+
+	/* populate the logger table the way a full client does */
+
+	for (i = 0; i < TEST_LOGGERS; i++)
+	{
+		sprintf_s(name, sizeof(name), "com.winpr.test.logger%d", i);
+		WLog_Get(name);
+	}
+
+	rate = test_run_threads((LPTHREAD_START_ROUTINE) test_lookup_uncached, TEST_LOOKUPS);
+	printf("WLog_Get lookup:   %10.0f filtered calls/s\n", rate);
+
+	rate = test_run_threads((LPTHREAD_START_ROUTINE) test_lookup_cached, TEST_LOOKUPS);
+	printf("cached lookup:     %10.0f filtered calls/s\n", rate);
+
+	path = GetKnownSubPath(KNOWN_PATH_TEMP, "wlog-test");
+
+	if (!PathFileExistsA(path))
+		CreateDirectoryA(path, 0);
+
+	if (test_write_throughput(path, WLOG_APPENDER_FILE) < 0)
+		return -1;
+
+	if (test_write_throughput(path, WLOG_APPENDER_ASYNC) < 0)
+		return -1;
+
+	free(path);
+
+	WLog_Uninit();
+
+	return 0;
+}
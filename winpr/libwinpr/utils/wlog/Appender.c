@@ -47,6 +47,10 @@ wLogAppender* WLog_Appender_New(wLog* log, DWORD logAppenderType)
 	{
 		appender = (wLogAppender*) WLog_CallbackAppender_New(log);
 	}
+	else if (logAppenderType == WLOG_APPENDER_ASYNC)
+	{
+		appender = (wLogAppender*) WLog_AsyncAppender_New(log);
+	}
 
 	if (!appender)
 		appender = (wLogAppender*) WLog_ConsoleAppender_New(log);
@@ -86,6 +90,10 @@ void WLog_Appender_Free(wLog* log, wLogAppender* appender)
 		{
 			WLog_CallbackAppender_Free(log, (wLogCallbackAppender*) appender);
 		}
+		else if (appender->Type == WLOG_APPENDER_ASYNC)
+		{
+			WLog_AsyncAppender_Free(log, (wLogAsyncAppender*) appender);
+		}
 	}
 }
 
@@ -124,12 +132,17 @@ int WLog_OpenAppender(wLog* log)
 	if (!appender->Open)
 		return 0;
 
+	EnterCriticalSection(&appender->lock);
+
 	if (!appender->State)
 	{
-		status = appender->Open(log, appender);
+		/* opening may log (e.g. from handle creation), which must not reopen */
 		appender->State = 1;
+		status = appender->Open(log, appender);
 	}
 
+	LeaveCriticalSection(&appender->lock);
+
 	return status;
 }
 
@@ -26,6 +26,7 @@
 #include "wlog/BinaryAppender.h"
 #include "wlog/ConsoleAppender.h"
 #include "wlog/CallbackAppender.h"
+#include "wlog/AsyncAppender.h"
 
 void WLog_Appender_Free(wLog* log, wLogAppender* appender);
 
@@ -0,0 +1,495 @@
+/**
+ * WinPR: Windows Portable Runtime
+ * WinPR Logger
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <fcntl.h>
+
+#ifdef _WIN32
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <errno.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#endif
+
+#include <winpr/crt.h>
+#include <winpr/file.h>
+#include <winpr/path.h>
+#include <winpr/synch.h>
+#include <winpr/thread.h>
+#include <winpr/interlocked.h>
+
+#include <winpr/wlog.h>
+
+#include "wlog/AsyncAppender.h"
+
+/**
+ * Asynchronous Appender
+ *
+ * The records form a bounded multi-producer, single-consumer ring. Each
+ * record carries a sequence number: a producer may claim the record at
+ * position pos when its sequence is pos, and publishes it by setting the
+ * sequence to pos + 1. The writer thread releases it for the next lap by
+ * setting the sequence to pos + RecordCount.
+ */
+
+#define WLOG_ASYNC_RECORD_COUNT		1024
+#define WLOG_ASYNC_RECORD_SIZE		512
+#define WLOG_ASYNC_FLUSH_INTERVAL	100
+#define WLOG_ASYNC_FLUSH_THRESHOLD	256
+#define WLOG_ASYNC_BATCH_SIZE		64
+
+struct _wLogAsyncRecord
+{
+	LONG volatile Sequence;
+	DWORD Length;
+	char* Heap;
+	char Data[WLOG_ASYNC_RECORD_SIZE];
+};
+
+void WLog_AsyncAppender_SetOutputFileName(wLog* log, wLogAsyncAppender* appender, const char* filename)
+{
+	if (!appender)
+		return;
+
+	if (appender->Type != WLOG_APPENDER_ASYNC)
+		return;
+
+	if (!filename)
+		return;
+
+	free(appender->FileName);
+	appender->FileName = _strdup(filename);
+}
+
+void WLog_AsyncAppender_SetOutputFilePath(wLog* log, wLogAsyncAppender* appender, const char* filepath)
+{
+	if (!appender)
+		return;
+
+	if (appender->Type != WLOG_APPENDER_ASYNC)
+		return;
+
+	if (!filepath)
+		return;
+
+	free(appender->FilePath);
+	appender->FilePath = _strdup(filepath);
+}
+
+void WLog_AsyncAppender_SetFlushPolicy(wLog* log, wLogAsyncAppender* appender, DWORD interval, DWORD threshold)
+{
+	if (!appender)
+		return;
+
+	if (appender->Type != WLOG_APPENDER_ASYNC)
+		return;
+
+	appender->FlushInterval = interval ? interval : WLOG_ASYNC_FLUSH_INTERVAL;
+	appender->FlushThreshold = threshold ? threshold : 1;
+}
+
+static LONG WLog_AsyncAppender_GetSequence(wLogAsyncRecord* record)
+{
+	return InterlockedCompareExchange(&record->Sequence, 0, 0);
+}
+
+static void WLog_AsyncAppender_WriteRecords(wLogAsyncAppender* appender, wLogAsyncRecord** records, int count)
+{
+#ifdef _WIN32
+	int index;
+	wLogAsyncRecord* record;
+
+	for (index = 0; index < count; index++)
+	{
+		record = records[index];
+		_write(appender->FileDescriptor, record->Heap ? record->Heap : record->Data, record->Length);
+	}
+#else
+	int index;
+	ssize_t status;
+	struct iovec* iov;
+	struct iovec iovs[WLOG_ASYNC_BATCH_SIZE];
+
+	for (index = 0; index < count; index++)
+	{
+		iovs[index].iov_base = records[index]->Heap ? records[index]->Heap : records[index]->Data;
+		iovs[index].iov_len = records[index]->Length;
+	}
+
+	iov = iovs;
+
+	while (count > 0)
+	{
+		status = writev(appender->FileDescriptor, iov, count);
+
+		if (status < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			break;
+		}
+
+		while ((count > 0) && ((size_t) status >= iov->iov_len))
+		{
+			status -= iov->iov_len;
+			iov++;
+			count--;
+		}
+
+		if (count > 0)
+		{
+			iov->iov_base = ((char*) iov->iov_base) + status;
+			iov->iov_len -= status;
+		}
+	}
+#endif
+}
+
+/**
+ * Write out all published records, in batches of up to WLOG_ASYNC_BATCH_SIZE.
+ */
+
+static void WLog_AsyncAppender_Drain(wLogAsyncAppender* appender)
+{
+	int index;
+	int count;
+	ULONG tail;
+	ULONG mask;
+	wLogAsyncRecord* record;
+	wLogAsyncRecord* records[WLOG_ASYNC_BATCH_SIZE];
+
+	mask = appender->RecordCount - 1;
+	tail = (ULONG) appender->Tail;
+
+	while (1)
+	{
+		for (count = 0; count < WLOG_ASYNC_BATCH_SIZE; count++)
+		{
+			record = &appender->Records[(tail + count) & mask];
+
+			if ((ULONG) WLog_AsyncAppender_GetSequence(record) != (tail + count + 1))
+				break;
+
+			records[count] = record;
+		}
+
+		if (!count)
+			break;
+
+		WLog_AsyncAppender_WriteRecords(appender, records, count);
+
+		for (index = 0; index < count; index++)
+		{
+			record = records[index];
+
+			free(record->Heap);
+			record->Heap = NULL;
+
+			InterlockedExchange(&record->Sequence, (LONG) (tail + index + appender->RecordCount));
+		}
+
+		tail += count;
+		InterlockedExchange(&appender->Tail, (LONG) tail);
+	}
+}
+
+static void* WLog_AsyncAppender_Thread(void* arg)
+{
+	wLogAsyncAppender* appender = (wLogAsyncAppender*) arg;
+
+	while (1)
+	{
+		WaitForSingleObject(appender->Event, appender->FlushInterval);
+
+		/* reset before draining, so that records published from now on signal again */
+		ResetEvent(appender->Event);
+		InterlockedExchange(&appender->Signaled, 0);
+
+		WLog_AsyncAppender_Drain(appender);
+
+		if (appender->Stopping)
+			break;
+	}
+
+	WLog_AsyncAppender_Drain(appender);
+
+	return NULL;
+}
+
+int WLog_AsyncAppender_Close(wLog* log, wLogAsyncAppender* appender);
+
+int WLog_AsyncAppender_Open(wLog* log, wLogAsyncAppender* appender)
+{
+	DWORD index;
+	DWORD ProcessId;
+
+	ProcessId = GetCurrentProcessId();
+
+	if (!log || !appender)
+		return -1;
+
+	if (!appender->FilePath)
+	{
+		appender->FilePath = GetKnownSubPath(KNOWN_PATH_TEMP, "wlog");
+	}
+
+	if (!PathFileExistsA(appender->FilePath))
+	{
+		CreateDirectoryA(appender->FilePath, 0);
+		UnixChangeFileMode(appender->FilePath, 0xFFFF);
+	}
+
+	if (!appender->FileName)
+	{
+		appender->FileName = (char*) malloc(256);
+		sprintf_s(appender->FileName, 256, "%u.log", (unsigned int) ProcessId);
+	}
+
+	if (!appender->FullFileName)
+	{
+		appender->FullFileName = GetCombinedPath(appender->FilePath, appender->FileName);
+	}
+
+#ifdef _WIN32
+	appender->FileDescriptor = _open(appender->FullFileName,
+			_O_WRONLY | _O_APPEND | _O_CREAT | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+	appender->FileDescriptor = open(appender->FullFileName, O_WRONLY | O_APPEND | O_CREAT, 0644);
+#endif
+
+	if (appender->FileDescriptor < 0)
+		return -1;
+
+	appender->Records = (wLogAsyncRecord*) calloc(appender->RecordCount, sizeof(wLogAsyncRecord));
+
+	if (!appender->Records)
+	{
+		WLog_AsyncAppender_Close(log, appender);
+		return -1;
+	}
+
+	for (index = 0; index < appender->RecordCount; index++)
+		appender->Records[index].Sequence = (LONG) index;
+
+	appender->Head = 0;
+	appender->Tail = 0;
+	appender->Signaled = 0;
+	appender->Stopping = FALSE;
+
+	appender->Event = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+	if (!appender->Event)
+	{
+		WLog_AsyncAppender_Close(log, appender);
+		return -1;
+	}
+
+	appender->Thread = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE) WLog_AsyncAppender_Thread,
+			(void*) appender, 0, NULL);
+
+	if (!appender->Thread)
+	{
+		WLog_AsyncAppender_Close(log, appender);
+		return -1;
+	}
+
+	return 0;
+}
+
+int WLog_AsyncAppender_Close(wLog* log, wLogAsyncAppender* appender)
+{
+	DWORD index;
+
+	if (!log || !appender)
+		return -1;
+
+	if (appender->Thread)
+	{
+		appender->Stopping = TRUE;
+		SetEvent(appender->Event);
+
+		WaitForSingleObject(appender->Thread, INFINITE);
+		CloseHandle(appender->Thread);
+		appender->Thread = NULL;
+	}
+
+	if (appender->Event)
+	{
+		CloseHandle(appender->Event);
+		appender->Event = NULL;
+	}
+
+	if (appender->Records)
+	{
+		for (index = 0; index < appender->RecordCount; index++)
+			free(appender->Records[index].Heap);
+
+		free(appender->Records);
+		appender->Records = NULL;
+	}
+
+	if (appender->FileDescriptor >= 0)
+	{
+#ifdef _WIN32
+		_close(appender->FileDescriptor);
+#else
+		close(appender->FileDescriptor);
+#endif
+		appender->FileDescriptor = -1;
+	}
+
+	return 0;
+}
+
+int WLog_AsyncAppender_WriteMessage(wLog* log, wLogAsyncAppender* appender, wLogMessage* message)
+{
+	char* buffer;
+	LONG position;
+	ULONG pending;
+	size_t length;
+	size_t textLength;
+	size_t prefixLength;
+	wLogAsyncRecord* record;
+	char prefix[WLOG_MAX_PREFIX_SIZE];
+
+	if (!log || !appender || !message)
+		return -1;
+
+	if (!appender->Records)
+		return -1;
+
+	message->PrefixString = prefix;
+	WLog_Layout_GetMessagePrefix(log, appender->Layout, message);
+
+	prefixLength = strlen(message->PrefixString);
+	textLength = strlen(message->TextString);
+	length = prefixLength + textLength + 1;
+
+	/* claim the next record, waiting for the writer when the ring is full */
+
+	position = appender->Head;
+
+	while (1)
+	{
+		LONG diff;
+
+		record = &appender->Records[((ULONG) position) & (appender->RecordCount - 1)];
+		diff = (LONG) ((ULONG) WLog_AsyncAppender_GetSequence(record) - (ULONG) position);
+
+		if (diff == 0)
+		{
+			if (InterlockedCompareExchange(&appender->Head, (LONG) ((ULONG) position + 1), position) == position)
+				break;
+		}
+		else if (diff < 0)
+		{
+			/* nobody is going to drain the ring while it is being opened */
+			if (!appender->Thread)
+				return -1;
+
+			if (InterlockedCompareExchange(&appender->Signaled, 1, 0) == 0)
+				SetEvent(appender->Event);
+
+			SwitchToThread();
+		}
+
+		position = appender->Head;
+	}
+
+	buffer = record->Data;
+
+	if (length > WLOG_ASYNC_RECORD_SIZE)
+	{
+		record->Heap = (char*) malloc(length);
+
+		if (record->Heap)
+		{
+			buffer = record->Heap;
+		}
+		else
+		{
+			length = WLOG_ASYNC_RECORD_SIZE;
+			if (prefixLength > length - 1)
+				prefixLength = length - 1;
+
+			textLength = length - prefixLength - 1;
+		}
+	}
+
+	CopyMemory(buffer, message->PrefixString, prefixLength);
+	CopyMemory(&buffer[prefixLength], message->TextString, textLength);
+	buffer[prefixLength + textLength] = '\n';
+	record->Length = (DWORD) length;
+
+	InterlockedExchange(&record->Sequence, (LONG) ((ULONG) position + 1));
+
+	pending = (ULONG) position + 1 - (ULONG) appender->Tail;
+
+	if ((pending >= appender->FlushThreshold) && (InterlockedCompareExchange(&appender->Signaled, 1, 0) == 0))
+		SetEvent(appender->Event);
+
+	return 1;
+}
+
+wLogAsyncAppender* WLog_AsyncAppender_New(wLog* log)
+{
+	wLogAsyncAppender* AsyncAppender;
+
+	AsyncAppender = (wLogAsyncAppender*) calloc(1, sizeof(wLogAsyncAppender));
+
+	if (AsyncAppender)
+	{
+		AsyncAppender->Type = WLOG_APPENDER_ASYNC;
+
+		AsyncAppender->Open = (WLOG_APPENDER_OPEN_FN) WLog_AsyncAppender_Open;
+		AsyncAppender->Close = (WLOG_APPENDER_OPEN_FN) WLog_AsyncAppender_Close;
+
+		AsyncAppender->WriteMessage =
+				(WLOG_APPENDER_WRITE_MESSAGE_FN) WLog_AsyncAppender_WriteMessage;
+
+		AsyncAppender->FileDescriptor = -1;
+		AsyncAppender->RecordCount = WLOG_ASYNC_RECORD_COUNT;
+		AsyncAppender->FlushInterval = WLOG_ASYNC_FLUSH_INTERVAL;
+		AsyncAppender->FlushThreshold = WLOG_ASYNC_FLUSH_THRESHOLD;
+	}
+
+	return AsyncAppender;
+}
+
+void WLog_AsyncAppender_Free(wLog* log, wLogAsyncAppender* appender)
+{
+	if (appender)
+	{
+		if (appender->State)
+		{
+			WLog_AsyncAppender_Close(log, appender);
+			appender->State = 0;
+		}
+
+		free(appender->FileName);
+		free(appender->FilePath);
+		free(appender->FullFileName);
+
+		free(appender);
+	}
+}
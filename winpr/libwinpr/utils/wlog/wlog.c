@@ -27,6 +27,9 @@
 #include <winpr/crt.h>
 #include <winpr/print.h>
 #include <winpr/debug.h>
+#include <winpr/synch.h>
+#include <winpr/interlocked.h>
+#include <winpr/collections.h>
 #include <winpr/environment.h>
 
 #if defined(ANDROID)
@@ -63,6 +66,21 @@ const char* WLOG_LEVELS[7] =
 static DWORD g_FilterCount = 0;
 static wLogFilter* g_Filters = NULL;
 
+/**
+ * Loggers are looked up by name in g_LogTable. Call sites cache the result
+ * in a wLogCache, which is invalidated by bumping g_LogGeneration whenever
+ * the loggers are freed. A cache entry is not freed when it is replaced, as
+ * another thread may still be reading it, so there is one per call site and
+ * generation. All entries are kept in g_LogCacheEntries and freed by
+ * WLog_Uninit, which detaches them from their call sites first.
+ */
+
+static wHashTable* g_LogTable = NULL;
+static CRITICAL_SECTION g_LogLock;
+static INIT_ONCE g_LogLockOnce = INIT_ONCE_STATIC_INIT;
+static LONG g_LogGeneration = 1;
+static wLogCacheEntry* g_LogCacheEntries = NULL;
+
 static void log_recursion(const char* file, const char* fkt, int line)
 {
 	size_t used, i;
@@ -106,6 +124,11 @@ int WLog_Write(wLog* log, wLogMessage* message)
 	if (!appender->WriteMessage)
 		return -1;
 
+	/* the asynchronous appender only touches its lock-free ring */
+
+	if (appender->Type == WLOG_APPENDER_ASYNC)
+		return appender->WriteMessage(log, appender, message);
+
 	EnterCriticalSection(&appender->lock);
 
 	if (appender->recursive)
@@ -266,14 +289,10 @@ void WLog_PrintMessage(wLog* log, wLogMessage* message, ...)
 
 DWORD WLog_GetLogLevel(wLog* log)
 {
-	if (log->Level == WLOG_LEVEL_INHERIT)
-	{
-		return WLog_GetLogLevel(log->Parent);
-	}
-	else
-	{
-		return log->Level;
-	}
+	while ((log->Level == WLOG_LEVEL_INHERIT) && log->Parent)
+		log = log->Parent;
+
+	return log->Level;
 }
 
 void WLog_SetLogLevel(wLog* log, DWORD logLevel)
@@ -594,16 +613,40 @@ void WLog_Free(wLog* log)
 
 static wLog* g_RootLog = NULL;
 
+static BOOL CALLBACK WLog_InitLock(PINIT_ONCE once, PVOID param, PVOID* context)
+{
+	InitializeCriticalSectionAndSpinCount(&g_LogLock, 4000);
+	return TRUE;
+}
+
 wLog* WLog_GetRoot()
 {
 	char* env;
+	wLog* root;
 	DWORD nSize;
 	DWORD logAppenderType;
 
+	if (g_RootLog)
+		return g_RootLog;
+
+	InitOnceExecuteOnce(&g_LogLockOnce, WLog_InitLock, NULL, NULL);
+
+	EnterCriticalSection(&g_LogLock);
+
 	if (!g_RootLog)
 	{
-		g_RootLog = WLog_New("", NULL);
-		g_RootLog->IsRoot = TRUE;
+		g_LogTable = HashTable_New(TRUE);
+
+		if (g_LogTable)
+		{
+			g_LogTable->hash = HashTable_StringHash;
+			g_LogTable->keyCompare = HashTable_StringCompare;
+			g_LogTable->keyClone = HashTable_StringClone;
+			g_LogTable->keyFree = HashTable_StringFree;
+		}
+
+		root = WLog_New("", NULL);
+		root->IsRoot = TRUE;
 		WLog_ParseFilters();
 		logAppenderType = WLOG_APPENDER_CONSOLE;
 		nSize = GetEnvironmentVariableA("WLOG_APPENDER", NULL, 0);
@@ -621,14 +664,21 @@ wLog* WLog_GetRoot()
 					logAppenderType = WLOG_APPENDER_FILE;
 				else if (_stricmp(env, "BINARY") == 0)
 					logAppenderType = WLOG_APPENDER_BINARY;
+				else if (_stricmp(env, "ASYNC") == 0)
+					logAppenderType = WLOG_APPENDER_ASYNC;
 
 				free(env);
 			}
 		}
 
-		WLog_SetLogAppenderType(g_RootLog, logAppenderType);
+		WLog_SetLogAppenderType(root, logAppenderType);
+
+		/* only publish the root logger once it is fully set up */
+		g_RootLog = root;
 	}
 
+	LeaveCriticalSection(&g_LogLock);
+
 	return g_RootLog;
 }
 
@@ -675,6 +725,9 @@ wLog* WLog_FindChild(LPCSTR name)
 	BOOL found = FALSE;
 	root = WLog_GetRoot();
 
+	if (g_LogTable)
+		return (wLog*) HashTable_GetItemValue(g_LogTable, (void*) name);
+
 	for (index = 0; index < root->ChildrenCount; index++)
 	{
 		child = root->Children[index];
@@ -698,10 +751,67 @@ wLog* WLog_Get(LPCSTR name)
 
 	if (!log)
 	{
-		log = WLog_New(name,root);
-		WLog_AddChild(root, log);
+		EnterCriticalSection(&g_LogLock);
+
+		log = WLog_FindChild(name);
+
+		if (!log)
+		{
+			log = WLog_New(name, root);
+
+			if (log)
+			{
+				WLog_AddChild(root, log);
+
+				if (g_LogTable)
+					HashTable_Add(g_LogTable, (void*) log->Name, log);
+			}
+		}
+
+		LeaveCriticalSection(&g_LogLock);
+	}
+
+	return log;
+}
+
+wLog* WLog_GetCached(LPCSTR name, wLogCache* cache)
+{
+	wLog* log;
+	wLogCacheEntry* entry;
+	wLogCacheEntry* previous = cache->entry;
+	DWORD generation = (DWORD) g_LogGeneration;
+
+	if (previous && (previous->tag == name) && (previous->generation == generation))
+		return previous->log;
+
+	log = WLog_Get(name);
+
+	/* the tag of a call site is usually constant, a computed one is not cached */
+
+	if (!log || (previous && (previous->generation == generation)))
+		return log;
+
+	entry = (wLogCacheEntry*) malloc(sizeof(wLogCacheEntry));
+
+	if (!entry)
+		return log;
+
+	entry->tag = name;
+	entry->log = log;
+	entry->generation = generation;
+	entry->cache = cache;
+
+	if (InterlockedCompareExchangePointer((PVOID volatile*) &cache->entry, entry, previous) != previous)
+	{
+		free(entry);
+		return log;
 	}
 
+	EnterCriticalSection(&g_LogLock);
+	entry->next = g_LogCacheEntries;
+	g_LogCacheEntries = entry;
+	LeaveCriticalSection(&g_LogLock);
+
 	return log;
 }
 
@@ -714,8 +824,22 @@ void WLog_Uninit()
 {
 	DWORD index;
 	wLog* child = NULL;
+	wLogCacheEntry* entry;
 	wLog* root = WLog_GetRoot();
 
+	EnterCriticalSection(&g_LogLock);
+
+	while (g_LogCacheEntries)
+	{
+		entry = g_LogCacheEntries;
+		g_LogCacheEntries = entry->next;
+
+		InterlockedCompareExchangePointer((PVOID volatile*) &entry->cache->entry, NULL, entry);
+		free(entry);
+	}
+
+	LeaveCriticalSection(&g_LogLock);
+
 	for (index = 0; index < root->ChildrenCount; index++)
 	{
 		child = root->Children[index];
@@ -724,4 +848,12 @@ void WLog_Uninit()
 
 	WLog_Free(root);
 	g_RootLog = NULL;
+
+	if (g_LogTable)
+	{
+		HashTable_Free(g_LogTable);
+		g_LogTable = NULL;
+	}
+
+	InterlockedIncrement(&g_LogGeneration);
 }